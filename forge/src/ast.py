@@ -42,6 +42,7 @@ class FunctionDef(ASTNode):
     extern_abi: Optional[str] = None  # "C", "Rust", etc.
     where_clause: List[tuple[str, List[str]]] = None  # Where T: Trait1 + Trait2
     attributes: List['Attribute'] = None  # @noalloc, #[allow(...)], etc.
+    is_async: bool = False  # async fn (lowered by AsyncLowerPass)
     
     def __post_init__(self):
         if self.where_clause is None:
@@ -482,6 +483,12 @@ class TryExpr(ASTNode):
     expression: 'Expression'
 
 
+@dataclass
+class AwaitExpr(ASTNode):
+    """Await expression: call into an async fn (erased by AsyncLowerPass)"""
+    expression: 'Expression'
+
+
 @dataclass
 class ParameterClosure(ASTNode):
     """
@@ -626,7 +633,7 @@ Statement = (VarDecl | Assignment | ExpressionStmt | ReturnStmt |
 Expression = (IntLiteral | FloatLiteral | StringLiteral | CharLiteral |
               BoolLiteral | NoneLiteral | Identifier | BinOp | UnaryOp |
               TernaryExpr | FunctionCall | MethodCall | FieldAccess |
-              IndexAccess | SliceAccess | StructLiteral | ListLiteral | TupleLiteral | TryExpr |
+              IndexAccess | SliceAccess | StructLiteral | ListLiteral | TupleLiteral | TryExpr | AwaitExpr |
               GenericType | AsExpression)  # Allow GenericType as expression for Type[Args].method() syntax
 Pattern = (LiteralPattern | IdentifierPattern | TuplePattern | WildcardPattern |
            EnumPattern | OrPattern)
@@ -1425,6 +1425,9 @@ class LLVMCodeGen:
                     if not isinstance(py_type, ReferenceType) and not isinstance(py_type, PointerType):
                         return self.builder.load(val)
                 return val
+            elif expr.name in self.functions:
+                # A function named as a value (e.g. an entry point for coro_spawn)
+                return self.functions[expr.name]
             else:
                 raise CodeGenError(f"Undefined variable: {expr.name}", expr.span)
         
@@ -10,7 +10,7 @@ from llvmlite import binding
 from .frontend import lex, LexerError, parse, ParseError, Span
 from .middle import type_check, TypeCheckError, analyze_ownership, check_borrows, resolve_modules, ModuleError
 from .backend import generate_llvm, compile_to_executable, LLVMCodeGen, link_with_stdlib, link_llvm_ir, monomorphize_program
-from .passes import ClosureInlinePass, WithDesugarPass
+from .passes import ClosureInlinePass, WithDesugarPass, AsyncLowerPass, AsyncLowerError
 from .utils import ErrorFormatter
 from pathlib import Path
 
@@ -128,6 +128,11 @@ def compile_source(source: str, filename: str = "<input>", output_path: Optional
             # If module resolution fails, continue without imports (backward compatibility)
             print(f"Warning: Module resolution failed: {e}, continuing without imports")
         
+        # Phase 2.4: Lower async fn / await (stackful coroutines: await is a plain call)
+        print(f"[2.4/7] Lowering async functions...")
+        async_lower = AsyncLowerPass()
+        program_ast = async_lower.lower_program(program_ast, imported_modules_list)
+        
         # Phase 2.5: Desugar with statements (with → let + defer)
         print(f"[2.5/7] Desugaring with statements...")
         with_desugar = WithDesugarPass()
@@ -346,6 +351,9 @@ def compile_source(source: str, filename: str = "<input>", output_path: Optional
     except ParseError as e:
         print(f"\nParse error: {e}")
         return False
+    except AsyncLowerError as e:
+        print(f"\nAsync error: {e}")
+        return False
     except Exception as e:
         print(f"\nInternal compiler error: {e}")
         import traceback
@@ -141,7 +141,7 @@ class Parser:
         
         if self.match_token(TokenType.EXTERN):
             item = self.parse_extern()
-        elif self.match_token(TokenType.FN, TokenType.UNSAFE):
+        elif self.match_token(TokenType.FN, TokenType.UNSAFE, TokenType.ASYNC):
             item = self.parse_function()
         elif self.match_token(TokenType.STRUCT):
             item = self.parse_struct()
@@ -228,6 +228,12 @@ class Parser:
         """Parse function definition"""
         start_span = self.current().span
         
+        # Optional async keyword (lowered by AsyncLowerPass)
+        is_async = False
+        if self.match_token(TokenType.ASYNC):
+            is_async = True
+            self.advance()
+        
         # Optional unsafe keyword
         is_unsafe = False
         if self.match_token(TokenType.UNSAFE):
@@ -276,6 +282,7 @@ class Parser:
             is_extern=False,
             extern_abi=None,
             where_clause=where_clause,
+            is_async=is_async,
             span=self.make_span(start_span)
         )
     
@@ -1102,7 +1109,7 @@ class Parser:
                     # This is a function declaration, not a closure - we've exited the block
                     break
             # Check for other top-level items
-            elif current.type in (TokenType.STRUCT, TokenType.ENUM, TokenType.IMPL, TokenType.TRAIT, TokenType.CONST, TokenType.EXTERN):
+            elif current.type in (TokenType.STRUCT, TokenType.ENUM, TokenType.IMPL, TokenType.TRAIT, TokenType.CONST, TokenType.EXTERN, TokenType.ASYNC):
                 # Other top-level items - we've exited the block
                 break
             
@@ -1797,6 +1804,14 @@ class Parser:
                 span=self.make_span(start_span)
             )
         
+        if self.match_token(TokenType.AWAIT):
+            self.advance()
+            operand = self.parse_unary()
+            return ast.AwaitExpr(
+                expression=operand,
+                span=self.make_span(start_span)
+            )
+        
         return self.parse_cast()
     
     def parse_cast(self) -> ast.Expression:
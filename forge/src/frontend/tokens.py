@@ -39,6 +39,8 @@ class TokenType(Enum):
     DEFER = auto()
     WITH = auto()
     TRY = auto()
+    ASYNC = auto()
+    AWAIT = auto()
     EXTERN = auto()
     AND = auto()
     OR = auto()
@@ -141,6 +143,8 @@ KEYWORDS = {
     'defer': TokenType.DEFER,
     'with': TokenType.WITH,
     'try': TokenType.TRY,
+    'async': TokenType.ASYNC,
+    'await': TokenType.AWAIT,
     'extern': TokenType.EXTERN,
     'and': TokenType.AND,
     'or': TokenType.OR,
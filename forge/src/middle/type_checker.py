@@ -1088,6 +1088,11 @@ class TypeChecker:
                 print(f"[VLOOKUP]   Scope depth {depth}: symbols={list(scope.symbols.keys())}")
                 scope = scope.parent
                 depth += 1
+        if not self.resolver.current_scope.lookup(ident.name):
+            # A function named as a value (e.g. an entry point for coro_spawn)
+            func_symbol = self.resolver.global_scope.lookup_function(ident.name)
+            if func_symbol:
+                return func_symbol.type
         symbol = self.resolver.lookup_variable(ident.name, ident.span)
         if symbol:
             if debug:
@@ -2210,7 +2215,8 @@ class TypeChecker:
         
         elif isinstance(type_annotation, ast.FunctionType):
             param_types = [self.resolve_type(t) for t in type_annotation.param_types]
-            return_type = None
+            # fn(T) returns void, like a function declared without a return type
+            return_type = VOID
             if type_annotation.return_type:
                 return_type = self.resolve_type(type_annotation.return_type)
             return FunctionType(param_types, return_type)
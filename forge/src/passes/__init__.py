@@ -7,6 +7,7 @@ Modules:
     closure_inline_pass: Closure inlining optimization pass
     closure_inlining: Closure inlining utilities
     with_desugar_pass: `with` statement desugaring pass
+    async_lower_pass: `async fn` / `await` checking and lowering pass
 
 See Also:
     compiler: Main compiler driver
@@ -16,5 +17,6 @@ See Also:
 from .closure_inline_pass import ClosureInlinePass
 from .closure_inlining import ClosureInliner
 from .with_desugar_pass import WithDesugarPass
+from .async_lower_pass import AsyncLowerPass, AsyncLowerError
 
-__all__ = ['ClosureInlinePass', 'ClosureInliner', 'WithDesugarPass']
+__all__ = ['ClosureInlinePass', 'ClosureInliner', 'WithDesugarPass', 'AsyncLowerPass', 'AsyncLowerError']
@@ -0,0 +1,282 @@
+"""AST lowering pass for async fn / await
+
+Pyrite coroutines are stackful (see pyrite/task/coro.c): a coroutine owns a
+whole call stack and suspends inside blocking calls, wherever they are. So
+async functions need no state-machine transform - an `await f(x)` is a
+plain call that may park the running coroutine. This pass checks that
+`async` is used consistently and erases it:
+
+    await f(x)              ->  f(x)          (only inside an async fn)
+    async fn f(...): body   ->  fn f(...): body
+
+Calling an async fn without `await`, or from a sync fn, is an error: the
+callee may suspend, which only works on a coroutine stack. Sync code starts
+async work with spawn() instead, which takes the function by name. So is
+`await` on anything but an async fn, which would promise a suspension point
+that is not there.
+
+Method calls are resolved to their impl method by the receiver's type when
+the pass can see it: a type name (`Client.connect(...)`), `self`, or a
+parameter or `let` with a declared type. Otherwise the method name decides,
+as long as every impl that defines it agrees on async; when they disagree
+the call is left unchecked (the receiver could be either).
+
+`async fn main` is the entry into coroutine mode. It becomes:
+
+    fn main():
+        coro_main_enter()
+        defer:
+            coro_main_exit()
+        body
+
+so the main thread runs as the first coroutine and main returns only after
+every spawned coroutine has finished.
+"""
+
+from dataclasses import fields
+from typing import Dict, List, Optional, Set, Tuple
+from .. import ast
+from ..frontend.tokens import Span
+
+
+class AsyncLowerError(Exception):
+    """Misuse of async / await"""
+    def __init__(self, message: str, span: Span):
+        self.message = message
+        self.span = span
+        super().__init__(f"{span}: {message}")
+
+
+# Runtime entry points used by the async main lowering (pyrite/task/coro.c)
+MAIN_ENTER = "coro_main_enter"
+MAIN_EXIT = "coro_main_exit"
+
+
+class AsyncLowerPass:
+    """AST pass that checks and erases async fn / await"""
+
+    def __init__(self):
+        self.async_functions: Set[str] = set()
+        self.sync_functions: Set[str] = set()
+        self.methods: Dict[str, Dict[str, bool]] = {}  # type -> method -> is_async
+        self.current: Optional[ast.FunctionDef] = None
+        self.current_impl: Optional[str] = None
+        self.locals: Set[str] = set()           # names bound in the current fn
+        self.local_types: Dict[str, str] = {}  # local -> impl type name, when known
+
+    def lower_program(self, program: ast.Program, imported_modules=None) -> ast.Program:
+        """Lower all async functions in a program
+
+        imported_modules (module_system.Module list) only contribute
+        declarations, so awaiting an imported async fn is recognised.
+        """
+        programs = [program] + [m.ast for m in (imported_modules or []) if m.ast is not None]
+        self.async_functions = set()
+        self.sync_functions = set()
+        self.methods = {}
+        for source in programs:
+            self._collect(source)
+
+        new_items = []
+        async_main = None
+        for item in program.items:
+            if isinstance(item, ast.FunctionDef) and not item.is_extern:
+                item = self._lower_function(item)
+                if item.name == "main" and item.is_async:
+                    item = self._lower_main(item)
+                    async_main = item
+            elif isinstance(item, ast.ImplBlock):
+                self.current_impl = item.type_name
+                item.methods = [self._lower_function(method) for method in item.methods]
+                self.current_impl = None
+            new_items.append(item)
+
+        if async_main is not None:
+            declared = {item.name for item in new_items if isinstance(item, ast.FunctionDef)}
+            externs = [
+                self._runtime_extern(name, async_main.span)
+                for name in (MAIN_ENTER, MAIN_EXIT) if name not in declared
+            ]
+            new_items = externs + new_items
+
+        return ast.Program(
+            imports=program.imports,
+            items=new_items,
+            span=program.span
+        )
+
+    def _collect(self, program: ast.Program):
+        """Record which functions and impl methods are async"""
+        for item in program.items:
+            if isinstance(item, ast.FunctionDef):
+                (self.async_functions if item.is_async else self.sync_functions).add(item.name)
+            elif isinstance(item, ast.ImplBlock):
+                methods = self.methods.setdefault(item.type_name, {})
+                for method in item.methods:
+                    methods[method.name] = method.is_async
+
+    def _lower_function(self, func: ast.FunctionDef) -> ast.FunctionDef:
+        """Erase await in a function body, checking each use"""
+        self.current = func
+        self.locals = set()
+        self.local_types = {}
+        for param in func.params:
+            self._bind_local(param.name, param.type_annotation)
+        func.body = self._lower(func.body)
+        self.current = None
+        self.locals = set()
+        self.local_types = {}
+        return func
+
+    def _bind_local(self, name: str, type_annotation):
+        """Remember name's type for method resolution (or forget a shadowed one)"""
+        self.locals.add(name)
+        type_name = self._type_name(type_annotation)
+        if type_name is not None:
+            self.local_types[name] = type_name
+        else:
+            self.local_types.pop(name, None)
+
+    def _type_name(self, type_annotation) -> Optional[str]:
+        """Impl type named by an annotation (through &, &mut and pointers)"""
+        while isinstance(type_annotation, (ast.ReferenceType, ast.PointerType)):
+            type_annotation = type_annotation.inner
+        if isinstance(type_annotation, (ast.PrimitiveType, ast.GenericType)):
+            if type_annotation.name == "Self":
+                return self.current_impl
+            return type_annotation.name
+        return None
+
+    def _lower(self, node):
+        """Rewrite node and its children (AST nodes, lists, tuples) in place"""
+        if isinstance(node, list):
+            return [self._lower(child) for child in node]
+        if isinstance(node, tuple):
+            return tuple(self._lower(child) for child in node)
+        if not isinstance(node, ast.ASTNode):
+            return node
+
+        if isinstance(node, ast.AwaitExpr):
+            return self._lower_await(node)
+        if isinstance(node, ast.VarDecl) and isinstance(node.pattern, ast.IdentifierPattern):
+            # Children first: the initializer still sees the outer binding
+            self._lower_children(node)
+            annotation = node.type_annotation
+            if annotation is None and isinstance(node.initializer, ast.StructLiteral):
+                annotation = ast.PrimitiveType(name=node.initializer.struct_name, span=node.span)
+            self._bind_local(node.pattern.name, annotation)
+            return node
+        if isinstance(node, (ast.FunctionCall, ast.MethodCall)):
+            name, is_async = self._callee(node)
+            if is_async:
+                if self.current.is_async:
+                    raise AsyncLowerError(f"call to async fn '{name}' must be awaited", node.span)
+                raise AsyncLowerError(
+                    f"async fn '{name}' called from non-async fn '{self.current.name}'"
+                    f" (make the caller async, or start it with spawn)",
+                    node.span
+                )
+
+        self._lower_children(node)
+        return node
+
+    def _lower_await(self, node: ast.AwaitExpr) -> ast.Expression:
+        """await call -> call"""
+        if not self.current.is_async:
+            raise AsyncLowerError(f"'await' outside an async fn (in '{self.current.name}')", node.span)
+        call = node.expression
+        if not isinstance(call, (ast.FunctionCall, ast.MethodCall)):
+            raise AsyncLowerError("'await' expects a call", node.span)
+        name, is_async = self._callee(call)
+        if is_async is False:
+            raise AsyncLowerError(f"'await' on '{name}', which is not an async fn", node.span)
+        # The call itself is fine; its arguments are checked as usual
+        self._lower_children(call)
+        return call
+
+    def _lower_children(self, node: ast.ASTNode):
+        for field in fields(node):
+            if field.name == "span":
+                continue
+            value = getattr(node, field.name)
+            if isinstance(value, (ast.ASTNode, list, tuple)):
+                setattr(node, field.name, self._lower(value))
+
+    def _callee(self, call) -> Tuple[str, Optional[bool]]:
+        """(name, is_async) of what a call invokes; is_async is None when the
+        pass cannot tell (an ambiguous method on a receiver of unknown type)"""
+        if isinstance(call, ast.MethodCall):
+            return call.method, self._method_is_async(call)
+        if isinstance(call.function, ast.Identifier):
+            name = call.function.name
+            # A local holding a function value is never async: fn types carry no async
+            if name in self.async_functions and name not in self.locals:
+                return name, True
+            return name, False
+        return "<expression>", False
+
+    def _method_is_async(self, call: ast.MethodCall) -> Optional[bool]:
+        """Resolve a method call to its impl method, by receiver type or by name"""
+        receiver = None
+        if isinstance(call.object, ast.Identifier):
+            name = call.object.name
+            if name == "self":
+                receiver = self.local_types.get(name, self.current_impl)
+            elif name in self.locals:
+                receiver = self.local_types.get(name)
+            elif name in self.methods:
+                receiver = name  # Type.method(...)
+            elif call.method in self.async_functions:
+                return True  # module.function(...)
+        if receiver is not None and call.method in self.methods.get(receiver, {}):
+            return self.methods[receiver][call.method]
+        candidates: List[bool] = [
+            methods[call.method] for methods in self.methods.values() if call.method in methods
+        ]
+        if not candidates:
+            return False  # Not an impl method at all (builtin or unknown): never async
+        if all(candidates) or not any(candidates):
+            return candidates[0]
+        return None
+
+    def _lower_main(self, func: ast.FunctionDef) -> ast.FunctionDef:
+        """async fn main -> fn main wrapped in coro_main_enter / coro_main_exit"""
+        span = func.span
+        enter = ast.ExpressionStmt(expression=self._runtime_call(MAIN_ENTER, span), span=span)
+        exit_defer = ast.DeferStmt(
+            body=ast.Block(
+                statements=[ast.ExpressionStmt(expression=self._runtime_call(MAIN_EXIT, span), span=span)],
+                span=span
+            ),
+            span=span
+        )
+        func.body = ast.Block(
+            statements=[enter, exit_defer] + func.body.statements,
+            span=func.body.span
+        )
+        func.is_async = False
+        return func
+
+    def _runtime_call(self, name: str, span: Span) -> ast.FunctionCall:
+        return ast.FunctionCall(
+            function=ast.Identifier(name=name, span=span),
+            compile_time_args=[],
+            arguments=[],
+            span=span
+        )
+
+    def _runtime_extern(self, name: str, span: Span) -> ast.FunctionDef:
+        """extern "C" fn name() -> i32"""
+        return ast.FunctionDef(
+            name=name,
+            generic_params=[],
+            compile_time_params=[],
+            params=[],
+            return_type=ast.PrimitiveType(name="i32", span=span),
+            body=ast.Block(statements=[], span=span),
+            is_unsafe=False,
+            is_extern=True,
+            extern_abi="C",
+            attributes=[],
+            span=span
+        )
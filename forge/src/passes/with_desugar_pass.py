@@ -52,6 +52,7 @@ class WithDesugarPass:
             is_unsafe=func.is_unsafe,
             is_extern=func.is_extern,
             extern_abi=func.extern_abi,
+            is_async=func.is_async,
             span=func.span
         )
     
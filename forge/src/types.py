@@ -240,7 +240,7 @@ class FunctionType(Type):
     
     def __str__(self):
         params = ", ".join(str(t) for t in self.param_types)
-        ret = f" -> {self.return_type}" if self.return_type else ""
+        ret = f" -> {self.return_type}" if self.return_type and not isinstance(self.return_type, VoidType) else ""
         return f"fn({params}){ret}"
 
 
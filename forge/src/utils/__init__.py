@@ -8,6 +8,7 @@ Modules:
     error_formatter: Error message formatting
     error_explanations: Error explanation system
     incremental: Incremental compilation support
+    file_watch: inotify-backed changed-path tracking for incremental builds
     drops: Drop analysis
 
 See Also:
@@ -20,9 +21,10 @@ from .error_formatter import ErrorFormatter, Colors, format_error_message
 from .error_explanations import ERROR_EXPLANATIONS, get_explanation, list_error_codes
 from .drops import DropAnalyzer, insert_drops
 from .incremental import *
+from .file_watch import FileWatcher
 
 __all__ = [
     'ErrorFormatter', 'Colors', 'format_error_message',
     'ERROR_EXPLANATIONS', 'get_explanation', 'list_error_codes',
-    'DropAnalyzer', 'insert_drops'
+    'DropAnalyzer', 'insert_drops', 'FileWatcher'
 ]
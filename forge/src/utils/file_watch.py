@@ -0,0 +1,123 @@
+"""File watching for incremental compilation
+
+Wraps the runtime's inotify watcher (pyrite/io/watch.c). A long-lived process
+(a watch-mode build, the LSP server) keeps a FileWatcher open on the project
+root and hands the changed-path set to IncrementalCompiler, which then skips
+hashing every source the watcher did not report.
+
+The watcher is only available on Linux with the runtime library built into
+forge/target; everywhere else FileWatcher.available is False and callers keep
+hashing as before.
+"""
+
+import os
+import sys
+import ctypes
+from pathlib import Path
+from typing import Optional, Set
+
+# Feature flags
+# Master flag: PYRITE_ACCELERATE enables all Pyrite acceleration features
+# Individual flag: PYRITE_USE_WATCH_FFI (can override master flag if explicitly set)
+PYRITE_ACCELERATE = os.getenv("PYRITE_ACCELERATE", "").lower() in ("1", "true", "yes", "on")
+PYRITE_USE_WATCH_FFI_EXPLICIT = "PYRITE_USE_WATCH_FFI" in os.environ
+USE_FFI = PYRITE_USE_WATCH_FFI_EXPLICIT and os.getenv("PYRITE_USE_WATCH_FFI", "false").lower() == "true"
+USE_FFI = USE_FFI or (PYRITE_ACCELERATE and not PYRITE_USE_WATCH_FFI_EXPLICIT)
+
+def _bind(lib: ctypes.CDLL) -> ctypes.CDLL:
+    """Declare the watch_* signatures on a loaded runtime library"""
+    lib.watch_open.argtypes = [ctypes.c_char_p, ctypes.c_int32]
+    lib.watch_open.restype = ctypes.c_void_p
+    
+    lib.watch_wait.argtypes = [ctypes.c_void_p, ctypes.c_int32]
+    lib.watch_wait.restype = ctypes.c_int64
+    
+    lib.watch_pending.argtypes = [ctypes.c_void_p]
+    lib.watch_pending.restype = ctypes.c_int64
+    
+    lib.watch_take_changes.argtypes = [ctypes.c_void_p, ctypes.POINTER(ctypes.c_int64)]
+    lib.watch_take_changes.restype = ctypes.POINTER(ctypes.c_char_p)
+    
+    lib.watch_free_changes.argtypes = [ctypes.POINTER(ctypes.c_char_p), ctypes.c_int64]
+    lib.watch_free_changes.restype = None
+    
+    lib.watch_overflow_count.argtypes = [ctypes.c_void_p]
+    lib.watch_overflow_count.restype = ctypes.c_int64
+    
+    lib.watch_close.argtypes = [ctypes.c_void_p]
+    lib.watch_close.restype = None
+    return lib
+
+
+_lib = None
+if USE_FFI and sys.platform.startswith("linux"):
+    try:
+        # Find library path (will be built during compilation)
+        lib_path = Path(__file__).parent.parent.parent / "target" / "libwatch.so"
+        if lib_path.exists():
+            _lib = _bind(ctypes.CDLL(str(lib_path)))
+    except Exception as e:
+        _lib = None
+        print(f"Warning: Failed to load watch FFI library: {e}", file=sys.stderr)
+
+
+class FileWatcher:
+    """Recursive watcher reporting coalesced, debounced sets of changed paths"""
+    
+    def __init__(self, root: Path, debounce_ms: int = 50):
+        self.root = Path(root).resolve()
+        self._handle = None
+        if _lib:
+            self._handle = _lib.watch_open(os.fsencode(self.root), debounce_ms)
+    
+    @property
+    def available(self) -> bool:
+        """True if changes are being tracked (otherwise callers must hash)"""
+        return self._handle is not None
+    
+    def wait(self, timeout_ms: int = -1) -> int:
+        """Block until a settled batch of changes is pending
+        
+        Returns its size, 0 on timeout (or when unavailable), -1 if waiting failed.
+        """
+        if not self._handle:
+            return 0
+        return _lib.watch_wait(self._handle, timeout_ms)
+    
+    def take_changes(self) -> Optional[Set[str]]:
+        """Return and reset the changed-path set (absolute paths)
+        
+        Returns None when the watcher is unavailable, meaning "unknown".
+        """
+        if not self._handle:
+            return None
+        _lib.watch_pending(self._handle)
+        count = ctypes.c_int64(0)
+        paths = _lib.watch_take_changes(self._handle, ctypes.byref(count))
+        changes = set()
+        if paths:
+            for i in range(count.value):
+                changes.add(os.fsdecode(paths[i]))
+            _lib.watch_free_changes(paths, count)
+        return changes
+    
+    @property
+    def overflow_count(self) -> int:
+        """Kernel queue overflows seen (each forced a full rescan)"""
+        if not self._handle:
+            return 0
+        return _lib.watch_overflow_count(self._handle)
+    
+    def close(self):
+        if self._handle:
+            _lib.watch_close(self._handle)
+            self._handle = None
+    
+    def __enter__(self) -> 'FileWatcher':
+        return self
+    
+    def __exit__(self, *exc):
+        self.close()
+    
+    def __del__(self):
+        self.close()
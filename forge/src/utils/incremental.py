@@ -2,6 +2,7 @@
 
 import hashlib
 import json
+import os
 import time
 from pathlib import Path
 from typing import Dict, List, Set, Optional, Tuple
@@ -133,6 +134,8 @@ class IncrementalCompiler:
         self.module_hashes: Dict[str, str] = {}
         self.cache_entries: Dict[str, CacheEntry] = {}
         self.modules_json_path = self.cache_dir / "modules.json"  # Store module metadata in modules.json
+        # Changed-path set from a FileWatcher (None = unknown, hash everything)
+        self.watched_changes: Optional[Set[str]] = None
     
     def load_cache_metadata(self):
         """Load cached metadata from previous build"""
@@ -226,6 +229,9 @@ class IncrementalCompiler:
         # Save module hashes (for backwards compatibility)
         hashes_file = self.cache_dir / "module_hashes.json"
         hashes_file.write_text(json.dumps(self.module_hashes, indent=2))
+        
+        # The watched set described changes since the cache just replaced
+        self.watched_changes = None
     
     def compute_file_hash(self, filepath: Path) -> str:
         """Compute hash of file contents"""
@@ -239,6 +245,25 @@ class IncrementalCompiler:
         except Exception:
             return ""
     
+    def set_watched_changes(self, changes: Optional[Set[str]]):
+        """Record the paths a FileWatcher saw change since the cache was written
+        
+        Sources outside this set are trusted to be unchanged and are not
+        rehashed. The watcher must have been running since the cache entries
+        were saved; pass None (the default) to hash every source. The set is
+        cleared by save_cache_metadata(), so each build supplies its own.
+        """
+        if changes is None:
+            self.watched_changes = None
+        else:
+            self.watched_changes = {os.path.abspath(p) for p in changes}
+    
+    def _unchanged_since_watch(self, module_path: str) -> bool:
+        """True if the file watcher vouches module_path was not touched"""
+        if self.watched_changes is None:
+            return False
+        return os.path.abspath(module_path) not in self.watched_changes
+    
     def should_recompile(self, module_path: str) -> Tuple[bool, str]:
         """Check if module needs recompilation"""
         # Check if cache entry exists
@@ -246,8 +271,11 @@ class IncrementalCompiler:
         if not cache_entry:
             return True, "No cache entry"
         
-        # Check source hash
-        current_hash = self.compute_file_hash(Path(module_path))
+        # Check source hash (skipped when the file watcher saw no change)
+        if self._unchanged_since_watch(module_path):
+            current_hash = cache_entry.source_hash
+        else:
+            current_hash = self.compute_file_hash(Path(module_path))
         if current_hash != cache_entry.source_hash:
             return True, "Source changed"
         
@@ -0,0 +1,340 @@
+"""Tests for async fn / await lowering"""
+
+import pytest
+
+pytestmark = pytest.mark.integration  # All tests in this file are integration tests
+from src.frontend import lex
+from src.frontend import parse
+from src.passes.async_lower_pass import AsyncLowerPass, AsyncLowerError
+from src import ast
+
+
+def lower(source):
+    tokens = lex(source, "<test>")
+    program = parse(tokens)
+    return AsyncLowerPass().lower_program(program)
+
+
+def find_function(program, name):
+    for item in program.items:
+        if isinstance(item, ast.FunctionDef) and item.name == name:
+            return item
+    raise AssertionError(f"no function {name}")
+
+
+def test_async_fn_and_await_parse():
+    """Test that async fn and await parse into the AST"""
+    source = """
+async fn fetch(n: i64) -> i64:
+    return n
+
+async fn run():
+    let x = await fetch(1)
+"""
+    program = parse(lex(source, "<test>"))
+    
+    fetch = program.items[0]
+    assert isinstance(fetch, ast.FunctionDef)
+    assert fetch.is_async
+    
+    let_stmt = program.items[1].body.statements[0]
+    assert isinstance(let_stmt.initializer, ast.AwaitExpr)
+    assert isinstance(let_stmt.initializer.expression, ast.FunctionCall)
+
+
+def test_await_is_erased():
+    """Test that await f(x) lowers to the plain call f(x)"""
+    source = """
+async fn fetch(n: i64) -> i64:
+    return n
+
+async fn run() -> i64:
+    let x = await fetch(1)
+    if x > 0:
+        return await fetch(x)
+    return 0
+"""
+    program = lower(source)
+    run = find_function(program, "run")
+    
+    let_stmt = run.body.statements[0]
+    assert isinstance(let_stmt.initializer, ast.FunctionCall)
+    assert let_stmt.initializer.function.name == "fetch"
+    
+    return_stmt = run.body.statements[1].then_block.statements[0]
+    assert isinstance(return_stmt.value, ast.FunctionCall)
+
+
+def test_async_main_enters_coroutine_mode():
+    """Test that async fn main is wrapped in coro_main_enter / coro_main_exit"""
+    source = """
+async fn main():
+    print("hi")
+"""
+    program = lower(source)
+    main = find_function(program, "main")
+    
+    assert not main.is_async
+    enter = main.body.statements[0]
+    assert isinstance(enter, ast.ExpressionStmt)
+    assert enter.expression.function.name == "coro_main_enter"
+    
+    defer_stmt = main.body.statements[1]
+    assert isinstance(defer_stmt, ast.DeferStmt)
+    assert defer_stmt.body.statements[0].expression.function.name == "coro_main_exit"
+    
+    # Original body follows
+    assert len(main.body.statements) == 3
+    
+    # Runtime entry points are declared
+    assert find_function(program, "coro_main_enter").is_extern
+    assert find_function(program, "coro_main_exit").is_extern
+
+
+def test_async_main_keeps_existing_declarations():
+    """Test that runtime externs are not declared twice"""
+    source = """
+extern "C" fn coro_main_enter() -> i32
+
+async fn main():
+    print("hi")
+"""
+    program = lower(source)
+    names = [item.name for item in program.items if isinstance(item, ast.FunctionDef)]
+    assert names.count("coro_main_enter") == 1
+    assert names.count("coro_main_exit") == 1
+
+
+def test_sync_main_unchanged():
+    """Test that programs without async are left alone"""
+    source = """
+fn main():
+    print("hi")
+"""
+    program = lower(source)
+    assert len(program.items) == 1
+    assert len(program.items[0].body.statements) == 1
+
+
+def test_await_outside_async_fn_is_error():
+    """Test that await in a sync fn is rejected"""
+    source = """
+async fn fetch() -> i64:
+    return 1
+
+fn main():
+    let x = await fetch()
+"""
+    with pytest.raises(AsyncLowerError, match="outside an async fn"):
+        lower(source)
+
+
+def test_async_call_from_sync_fn_is_error():
+    """Test that a sync fn cannot call an async fn directly"""
+    source = """
+async fn fetch() -> i64:
+    return 1
+
+fn main():
+    let x = fetch()
+"""
+    with pytest.raises(AsyncLowerError, match="called from non-async fn 'main'"):
+        lower(source)
+
+
+def test_unawaited_async_call_is_error():
+    """Test that an async fn call inside an async fn needs await"""
+    source = """
+async fn fetch() -> i64:
+    return 1
+
+async fn run():
+    let x = fetch()
+"""
+    with pytest.raises(AsyncLowerError, match="must be awaited"):
+        lower(source)
+
+
+def test_async_fn_passed_by_name_is_allowed():
+    """Test that naming an async fn without calling it (for spawn) is fine"""
+    source = """
+async fn worker(arg: *mut u8):
+    pass
+
+fn main():
+    spawn(worker, arg)
+"""
+    program = lower(source)
+    call = find_function(program, "main").body.statements[0].expression
+    assert call.arguments[0].name == "worker"
+
+
+def test_awaited_async_method_is_erased():
+    """Test that await on an async impl method lowers to the plain method call"""
+    source = """
+struct Client:
+    fd: i64
+
+impl Client:
+    async fn fetch(&self) -> i64:
+        return self.fd
+
+    async fn twice(&self) -> i64:
+        return await self.fetch() + await self.fetch()
+
+async fn run(client: &Client) -> i64:
+    let other = Client { fd: 2 }
+    return await client.fetch() + await other.fetch()
+"""
+    program = lower(source)
+    run = find_function(program, "run")
+    total = run.body.statements[1].value
+    assert isinstance(total.left, ast.MethodCall)
+    assert isinstance(total.right, ast.MethodCall)
+
+
+def test_unawaited_async_method_is_error():
+    """Test that an async method call inside an async fn needs await"""
+    source = """
+struct Client:
+    fd: i64
+
+impl Client:
+    async fn fetch(&self) -> i64:
+        return self.fd
+
+async fn run(client: &Client):
+    let x = client.fetch()
+"""
+    with pytest.raises(AsyncLowerError, match="call to async fn 'fetch' must be awaited"):
+        lower(source)
+
+
+def test_async_method_from_sync_fn_is_error():
+    """Test that a sync fn cannot call an async method directly"""
+    source = """
+struct Client:
+    fd: i64
+
+impl Client:
+    async fn connect() -> i64:
+        return 1
+
+fn main():
+    let x = Client.connect()
+"""
+    with pytest.raises(AsyncLowerError, match="called from non-async fn 'main'"):
+        lower(source)
+
+
+def test_method_resolved_by_receiver_type():
+    """Test that the receiver's impl decides when impls disagree on a method"""
+    source = """
+struct Socket:
+    fd: i64
+
+struct Buffer:
+    len: i64
+
+impl Socket:
+    async fn read(&self) -> i64:
+        return self.fd
+
+impl Buffer:
+    fn read(&self) -> i64:
+        return self.len
+
+async fn run(sock: &Socket, buf: &Buffer) -> i64:
+    return await sock.read() + buf.read()
+"""
+    lower(source)
+
+    bad = source.replace("await sock.read() + buf.read()", "sock.read() + buf.read()")
+    with pytest.raises(AsyncLowerError, match="'read' must be awaited"):
+        lower(bad)
+
+    bad = source.replace("await sock.read() + buf.read()", "await sock.read() + await buf.read()")
+    with pytest.raises(AsyncLowerError, match="'await' on 'read', which is not an async fn"):
+        lower(bad)
+
+
+def test_await_on_sync_fn_is_error():
+    """Test that await on a plain fn is rejected"""
+    source = """
+fn compute() -> i64:
+    return 1
+
+async fn run():
+    let x = await compute()
+"""
+    with pytest.raises(AsyncLowerError, match="'await' on 'compute', which is not an async fn"):
+        lower(source)
+
+
+def test_await_on_extern_and_builtin_is_error():
+    """Test that await on externs and builtins (never async) is rejected"""
+    source = """
+extern "C" fn tcp_close(sock: i64)
+
+async fn run():
+    await tcp_close(1)
+"""
+    with pytest.raises(AsyncLowerError, match="'await' on 'tcp_close'"):
+        lower(source)
+
+    source = """
+async fn run():
+    await print("hi")
+"""
+    with pytest.raises(AsyncLowerError, match="'await' on 'print'"):
+        lower(source)
+
+
+def test_await_on_sync_method_is_error():
+    """Test that await on a sync impl method is rejected"""
+    source = """
+struct Counter:
+    n: i64
+
+impl Counter:
+    fn get(&self) -> i64:
+        return self.n
+
+async fn run(c: &Counter) -> i64:
+    return await c.get()
+"""
+    with pytest.raises(AsyncLowerError, match="'await' on 'get', which is not an async fn"):
+        lower(source)
+
+
+def test_await_on_function_value_is_error():
+    """Test that a local holding a function value is not treated as async"""
+    source = """
+async fn fetch() -> i64:
+    return 1
+
+async fn run(fetch: fn() -> i64) -> i64:
+    return await fetch()
+"""
+    with pytest.raises(AsyncLowerError, match="'await' on 'fetch'"):
+        lower(source)
+
+
+def test_await_on_imported_async_fn():
+    """Test that async fns declared by imported modules can be awaited"""
+    from src.middle.module_system import Module
+    from pathlib import Path
+
+    library = parse(lex("""
+async fn download(n: i64) -> i64:
+    return n
+""", "<lib>"))
+    source = """
+async fn run() -> i64:
+    return await download(1)
+"""
+    program = parse(lex(source, "<test>"))
+    AsyncLowerPass().lower_program(program, [Module(Path("lib.pyrite"), library)])
+
+    with pytest.raises(AsyncLowerError, match="'await' on 'download'"):
+        lower(source)
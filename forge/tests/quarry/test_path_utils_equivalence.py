@@ -112,6 +112,16 @@ class TestResolvePathEquivalence:
         pyrite_result = resolve_path_ffi(path, base)
         # .. should be resolved
         assert Path(python_result).resolve() == Path(pyrite_result).resolve()
+    
+    @pytest.mark.skipif(os.name == 'nt', reason="symlinks need privileges on Windows")
+    def test_through_symlinks(self, tmp_path):
+        """Symlinked prefixes resolve like Path.resolve(), repeatedly"""
+        (tmp_path / "real" / "sub").mkdir(parents=True)
+        (tmp_path / "link").symlink_to("real")
+        for path in ["link/sub", "link/sub/../sub", "link/missing/..", "link/sub"]:
+            python_result = resolve_path_python(path, str(tmp_path))
+            pyrite_result = resolve_path_ffi(path, str(tmp_path))
+            assert python_result == pyrite_result
 
 
 class TestJoinPathsEquivalence:
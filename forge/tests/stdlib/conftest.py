@@ -0,0 +1,97 @@
+"""Fixtures for stdlib behaviour tests that exercise the C runtime directly
+
+The C sources under pyrite/ are compiled with the system C compiler into a
+per-session temporary directory, either as a shared library (loaded through
+ctypes) or together with a small C driver from tests/stdlib/native/ as an
+executable. Tests are skipped when no C compiler is available.
+"""
+
+import ctypes
+import os
+import shutil
+import socket
+import subprocess
+import sys
+from pathlib import Path
+
+import pytest
+
+REPO_ROOT = Path(__file__).resolve().parent.parent.parent.parent
+PYRITE_DIR = REPO_ROOT / "pyrite"
+NATIVE_DIR = Path(__file__).resolve().parent / "native"
+
+
+def _find_compiler():
+    return os.environ.get("CC") or shutil.which("cc") or shutil.which("gcc")
+
+
+class NativeBuilder:
+    """Compile pyrite/ sources (and test drivers) once per session"""
+
+    def __init__(self, compiler, out_dir):
+        self.compiler = compiler
+        self.out_dir = out_dir
+        self._built = {}
+
+    def _compile(self, name, sources, flags, shared):
+        key = (name, tuple(sources), tuple(flags), shared)
+        if key in self._built:
+            return self._built[key]
+        suffix = ".so" if shared else ""
+        output = self.out_dir / f"{name}{suffix}"
+        # "native/..." names a test driver; anything else is relative to pyrite/
+        paths = [str(NATIVE_DIR.parent / s) if s.startswith("native/") else str(PYRITE_DIR / s)
+                 for s in sources]
+        cmd = [self.compiler, "-O2", "-g", *flags]
+        if shared:
+            cmd += ["-shared", "-fPIC"]
+        cmd += [*paths, "-o", str(output), "-lpthread", "-lm"]
+        result = subprocess.run(cmd, capture_output=True, text=True)
+        if result.returncode != 0:
+            pytest.fail(f"native build of {name} failed:\n{result.stderr}")
+        self._built[key] = output
+        return output
+
+    def shared(self, name, sources, flags=()):
+        """Build sources (relative to pyrite/) into a shared library and load it"""
+        return ctypes.CDLL(str(self._compile(name, sources, flags, True)), use_errno=True)
+
+    def executable(self, name, sources, flags=()):
+        """Build a driver ('native/<file>.c') together with pyrite/ sources"""
+        return self._compile(name, sources, flags, False)
+
+    def run(self, binary, *args, timeout=120):
+        """Run a built driver; it prints diagnostics and exits non-zero on failure"""
+        result = subprocess.run([str(binary), *map(str, args)], capture_output=True,
+                                text=True, timeout=timeout)
+        assert result.returncode == 0, f"{binary.name} {' '.join(map(str, args))} failed " \
+            f"(exit {result.returncode}):\n{result.stdout}{result.stderr}"
+        return result.stdout
+
+
+@pytest.fixture(scope="session")
+def native(tmp_path_factory):
+    """NativeBuilder for the C runtime; skips when there is no C compiler"""
+    if sys.platform == "win32":
+        pytest.skip("native stdlib tests run on POSIX only")
+    compiler = _find_compiler()
+    if not compiler:
+        pytest.skip("no C compiler available (set CC)")
+    return NativeBuilder(compiler, tmp_path_factory.mktemp("native"))
+
+
+@pytest.fixture
+def tcp_pair():
+    """(sender, receiver) over loopback with small buffers"""
+    listener = socket.socket()
+    listener.bind(("127.0.0.1", 0))
+    listener.listen(1)
+    sender = socket.socket()
+    sender.setsockopt(socket.SOL_SOCKET, socket.SO_SNDBUF, 32 * 1024)
+    sender.connect(listener.getsockname())
+    receiver, _ = listener.accept()
+    receiver.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 32 * 1024)
+    listener.close()
+    yield sender, receiver
+    sender.close()
+    receiver.close()
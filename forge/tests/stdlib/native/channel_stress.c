@@ -0,0 +1,263 @@
+/* pyrite/net/channel.c under concurrent producers and corrupt rings.
+ *
+ * Stress: a small ring (lots of wrapping, padding records and full-ring
+ * waits) fed at once by forked producer processes, which open the inherited
+ * descriptor, and by producer threads sharing this process's handle. Half
+ * the messages go through chan_send and half through reserve/commit. One
+ * consumer checks that each producer's messages arrive complete and in
+ * order.
+ *
+ * Corruption: record headers and head are overwritten through a second
+ * mapping of the same file, the way a misbehaving peer process would. The
+ * consumer must refuse them (EPROTO) instead of reading or clearing memory
+ * outside the ring. The channel is then shut down for the producers as well.
+ *
+ * Usage: channel_stress [messages per producer]. Prints "ok" and exits 0 on
+ * success.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+void* chan_create(int64_t capacity, int32_t flags);
+void* chan_open(int64_t fd);
+int64_t chan_fd(void* chan);
+int64_t chan_capacity(void* chan);
+char* chan_reserve(void* chan, int64_t len, int32_t timeout_ms);
+int32_t chan_commit(void* chan, char* slot, int64_t len);
+int32_t chan_send(void* chan, const char* data, int64_t len, int32_t timeout_ms);
+char* chan_peek(void* chan, int64_t* len, int32_t timeout_ms);
+int32_t chan_release(void* chan);
+int64_t chan_recv(void* chan, char* buf, int64_t cap, int32_t timeout_ms);
+int32_t chan_shutdown(void* chan);
+void chan_close(void* chan);
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s (errno %d)\n", __FILE__, __LINE__, #cond, errno); \
+        exit(1); \
+    } \
+} while (0)
+
+#define HEADER_SIZE 4096         /* CHAN_HEADER_SIZE: the ring follows */
+#define HEAD_OFFSET 128          /* ChanShared.head */
+#define PAD_LENGTH 0xffffffffu
+#define PROCESSES 2
+#define THREADS 3
+#define PRODUCERS (PROCESSES + THREADS)
+#define MAX_WORDS 40
+
+static void* chan;
+static long per_producer = 100000;
+
+/* Message i of producer id: 1..MAX_WORDS words plus 0..7 trailing bytes */
+static int64_t message_len(uint64_t i) {
+    return (int64_t)((1 + i % MAX_WORDS) * 8 + (i * 5) % 8);
+}
+
+static void fill(uint64_t* words, uint64_t id, uint64_t i) {
+    words[0] = (id << 48) | i;
+    for (uint64_t w = 1; w <= MAX_WORDS; w++) words[w] = words[0] * 0x9e3779b97f4a7c15ULL + w;
+}
+
+static void produce(void* ch, uint64_t id) {
+    uint64_t words[MAX_WORDS + 1];
+    for (uint64_t i = 0; i < (uint64_t)per_producer; i++) {
+        fill(words, id, i);
+        int64_t len = message_len(i);
+        if (i & 1) {
+            char* slot = chan_reserve(ch, len, -1);
+            CHECK(slot != NULL);
+            memcpy(slot, words, (size_t)len);
+            CHECK(chan_commit(ch, slot, len) == 0);
+        } else {
+            CHECK(chan_send(ch, (const char*)words, len, -1) == 0);
+        }
+    }
+}
+
+static void* producer_thread(void* arg) {
+    produce(chan, (uint64_t)(uintptr_t)arg);
+    return NULL;
+}
+
+static void test_mpsc_stress(void) {
+    chan = chan_create(16 * 1024, 0);
+    CHECK(chan != NULL);
+    pid_t pids[PROCESSES];
+    for (int p = 0; p < PROCESSES; p++) {
+        pids[p] = fork();
+        CHECK(pids[p] >= 0);
+        if (pids[p] == 0) {
+            void* ch = chan_open(dup((int)chan_fd(chan)));
+            if (!ch) _exit(2);
+            produce(ch, (uint64_t)p);
+            chan_close(ch);
+            _exit(0);
+        }
+    }
+    pthread_t threads[THREADS];
+    for (int t = 0; t < THREADS; t++) {
+        CHECK(pthread_create(&threads[t], NULL, producer_thread, (void*)(uintptr_t)(PROCESSES + t)) == 0);
+    }
+
+    uint64_t next[PRODUCERS] = {0};
+    uint64_t expected[MAX_WORDS + 1];
+    for (long n = 0; n < (long)PRODUCERS * per_producer; n++) {
+        int64_t len = 0;
+        char* message = chan_peek(chan, &len, 10000);
+        CHECK(message != NULL);
+        CHECK(len >= 8);
+        uint64_t first;
+        memcpy(&first, message, 8);
+        uint64_t id = first >> 48, i = first & 0xffffffffffffULL;
+        CHECK(id < PRODUCERS && i == next[id]);
+        next[id]++;
+        CHECK(len == message_len(i));
+        fill(expected, id, i);
+        CHECK(memcmp(message, expected, (size_t)len) == 0);
+        CHECK(chan_release(chan) == 0);
+    }
+    for (int t = 0; t < THREADS; t++) CHECK(pthread_join(threads[t], NULL) == 0);
+    for (int p = 0; p < PROCESSES; p++) {
+        int status;
+        CHECK(waitpid(pids[p], &status, 0) == pids[p]);
+        CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+    int64_t len;
+    CHECK(chan_peek(chan, &len, 0) == NULL && errno == EAGAIN);
+    chan_close(chan);
+}
+
+/* ---- Corrupt rings ---- */
+
+typedef struct {
+    void* chan;
+    char* map;            /* Second mapping of the whole file */
+    size_t map_size;
+    uint64_t capacity;
+} Corruptible;
+
+static Corruptible corruptible(void) {
+    Corruptible c;
+    c.chan = chan_create(4096, 0);
+    CHECK(c.chan != NULL);
+    c.capacity = (uint64_t)chan_capacity(c.chan);
+    c.map_size = HEADER_SIZE + c.capacity;
+    c.map = mmap(NULL, c.map_size, PROT_READ | PROT_WRITE, MAP_SHARED, (int)chan_fd(c.chan), 0);
+    CHECK(c.map != MAP_FAILED);
+    return c;
+}
+
+static void corruptible_free(Corruptible* c) {
+    munmap(c->map, c->map_size);
+    chan_close(c->chan);
+}
+
+static void set_header(Corruptible* c, uint64_t offset, uint64_t span, uint32_t len) {
+    uint64_t word = (span << 32) | len;
+    memcpy(c->map + HEADER_SIZE + offset, &word, 8);
+}
+
+/* The consumer refuses the ring, for good, and producers see it shut down */
+static void expect_failed(Corruptible* c) {
+    int64_t len = 0;
+    char buf[64];
+    CHECK(chan_peek(c->chan, &len, 0) == NULL && errno == EPROTO);
+    CHECK(chan_peek(c->chan, &len, 100) == NULL && errno == EPROTO);
+    CHECK(chan_recv(c->chan, buf, sizeof(buf), 0) == -1 && errno == EPROTO);
+    CHECK(chan_release(c->chan) == -1 && errno == EPROTO);
+    CHECK(chan_send(c->chan, "x", 1, 0) == -1 && errno == EPIPE);
+}
+
+static void test_corrupt_headers(void) {
+    struct { uint64_t span; uint32_t len; } bad[] = {
+        { 0, 5 },                   /* span below the header */
+        { 4, 0 },
+        { 4096 + 8, 16 },           /* past the end of the ring */
+        { 1ULL << 31, 8 },
+        { 20, 4 },                  /* not 8-aligned */
+        { 16, 9 },                  /* length past the span */
+        { 16, 0xfffffff0u },
+        { 64, PAD_LENGTH },         /* padding that does not reach the ring end */
+    };
+    for (size_t k = 0; k < sizeof(bad) / sizeof(bad[0]); k++) {
+        Corruptible c = corruptible();
+        set_header(&c, 0, bad[k].span, bad[k].len);
+        expect_failed(&c);
+        corruptible_free(&c);
+    }
+
+    /* A good message, then a corrupt one behind it */
+    Corruptible c = corruptible();
+    CHECK(chan_send(c.chan, "hello", 5, 0) == 0);
+    set_header(&c, 16, 1ULL << 20, 8);
+    char buf[16];
+    CHECK(chan_recv(c.chan, buf, sizeof(buf), 0) == 5 && memcmp(buf, "hello", 5) == 0);
+    expect_failed(&c);
+    corruptible_free(&c);
+
+    /* Valid edge cases still pass: a record filling the rest of the ring
+     * after padding, and an empty message */
+    c = corruptible();
+    static char big[2040];
+    memset(big, 'b', sizeof(big));
+    CHECK(chan_send(c.chan, big, sizeof(big), 0) == 0);     /* span 2048 */
+    CHECK(chan_send(c.chan, big, 1000, 0) == 0);            /* span 1008 */
+    CHECK(chan_recv(c.chan, buf, 0, 0) == -1 && errno == EMSGSIZE);
+    int64_t len;
+    CHECK(chan_peek(c.chan, &len, 0) != NULL && len == (int64_t)sizeof(big));
+    CHECK(chan_release(c.chan) == 0);
+    CHECK(chan_peek(c.chan, &len, 0) != NULL && len == 1000);
+    CHECK(chan_release(c.chan) == 0);
+    /* 3056 used: 1040 left before the end, so this one pads and wraps */
+    CHECK(chan_send(c.chan, big, sizeof(big), 0) == 0);
+    CHECK(chan_send(c.chan, "", 0, 0) == 0);
+    CHECK(chan_peek(c.chan, &len, 0) != NULL && len == (int64_t)sizeof(big));
+    CHECK(chan_release(c.chan) == 0);
+    CHECK(chan_peek(c.chan, &len, 0) != NULL && len == 0);
+    CHECK(chan_release(c.chan) == 0);
+    CHECK(chan_peek(c.chan, &len, 0) == NULL && errno == EAGAIN);
+    corruptible_free(&c);
+}
+
+static void test_corrupt_head(void) {
+    /* head moved under a peeked message: its span no longer fits, and
+     * release must not clear past the end of the ring */
+    Corruptible c = corruptible();
+    static char payload[1000];
+    CHECK(chan_send(c.chan, payload, sizeof(payload), 0) == 0);
+    int64_t len;
+    CHECK(chan_peek(c.chan, &len, 0) != NULL && len == (int64_t)sizeof(payload));
+    uint64_t head = c.capacity - 8;
+    memcpy(c.map + HEAD_OFFSET, &head, 8);
+    CHECK(chan_release(c.chan) == -1 && errno == EPROTO);
+    expect_failed(&c);
+    corruptible_free(&c);
+
+    /* A misaligned head is refused before any header is read */
+    c = corruptible();
+    head = 3;
+    memcpy(c.map + HEAD_OFFSET, &head, 8);
+    expect_failed(&c);
+    corruptible_free(&c);
+}
+
+int main(int argc, char** argv) {
+    alarm(120);
+    if (argc > 1) per_producer = atol(argv[1]);
+    CHECK(per_producer > 0);
+    test_corrupt_headers();
+    test_corrupt_head();
+    test_mpsc_stress();
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,242 @@
+/* Context switching in pyrite/task/coro.c.
+ *
+ * - Ready coroutines run in FIFO order, and every coro_yield() hands over to
+ *   the next one.
+ * - Values live across a switch survive it. At -O2 they sit in callee-saved
+ *   registers, which the switch saves and restores.
+ * - Each coroutine keeps its own floating-point rounding mode (MXCSR / x87
+ *   control word). A new one starts with the defaults, and the scheduler's
+ *   thread gets its own mode back.
+ * - Deep recursion on a coroutine stack works. A thousand short coroutines
+ *   reuse pooled stacks.
+ * - coro_join waits for the target. A self-join fails with EDEADLK.
+ *
+ * Prints "ok" and exits 0 on success.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fenv.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+void* coro_scheduler_new(int32_t stack_size);
+int64_t coro_spawn(void* scheduler, void (*entry)(void*), void* arg);
+int32_t coro_scheduler_run(void* scheduler);
+int32_t coro_scheduler_count(void* scheduler);
+void coro_scheduler_free(void* scheduler);
+int64_t coro_current(void);
+int32_t coro_yield(void);
+int32_t coro_join(int64_t id);
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s (errno %d)\n", __FILE__, __LINE__, #cond, errno); \
+        exit(1); \
+    } \
+} while (0)
+
+/* ---- FIFO round robin ---- */
+
+#define PLAYERS 3
+#define ROUNDS 200
+
+static int trace[PLAYERS * ROUNDS];
+static int trace_len = 0;
+
+static void player(void* arg) {
+    int id = (int)(intptr_t)arg;
+    for (int i = 0; i < ROUNDS; i++) {
+        trace[trace_len++] = id;
+        CHECK(coro_yield() == 0);
+    }
+}
+
+static void test_round_robin(void) {
+    void* s = coro_scheduler_new(0);
+    CHECK(s != NULL);
+    for (int i = 0; i < PLAYERS; i++) CHECK(coro_spawn(s, player, (void*)(intptr_t)i) > 0);
+    CHECK(coro_scheduler_count(s) == PLAYERS);
+    CHECK(coro_scheduler_run(s) == 0);
+    CHECK(coro_scheduler_count(s) == 0);
+    CHECK(trace_len == PLAYERS * ROUNDS);
+    for (int i = 0; i < trace_len; i++) CHECK(trace[i] == i % PLAYERS);
+    coro_scheduler_free(s);
+}
+
+/* ---- Live values across switches ---- */
+
+static uint64_t mix(uint64_t x) {
+    x ^= x >> 31;
+    x *= 0x7fb5d329728ea185ULL;
+    return x ^ (x >> 27);
+}
+
+static uint64_t register_results[4];
+
+/* Enough live values that the compiler keeps them in callee-saved registers
+ * (and spills) across the coro_yield() calls */
+static __attribute__((noinline)) void keeper(void* arg) {
+    int slot = (int)(intptr_t)arg;
+    uint64_t a = mix((uint64_t)slot + 1), b = mix(a), c = mix(b), d = mix(c), e = mix(d), f = mix(e);
+    double x = (double)slot + 0.25, y = x * 3.0;
+    for (int i = 0; i < 100; i++) {
+        CHECK(coro_yield() == 0);
+        a += b; b ^= c; c += d; d ^= e; e += f; f ^= a;
+        x = x * 0.5 + y * 0.25;
+        y = y + 1.0;
+    }
+    register_results[slot] = a ^ b ^ c ^ d ^ e ^ f ^ (uint64_t)(x * 1000.0) ^ (uint64_t)y;
+}
+
+static void test_live_values(void) {
+    uint64_t expected[4];
+    for (int slot = 0; slot < 4; slot++) {
+        /* Same computation without switching */
+        uint64_t a = mix((uint64_t)slot + 1), b = mix(a), c = mix(b), d = mix(c), e = mix(d), f = mix(e);
+        double x = (double)slot + 0.25, y = x * 3.0;
+        for (int i = 0; i < 100; i++) {
+            a += b; b ^= c; c += d; d ^= e; e += f; f ^= a;
+            x = x * 0.5 + y * 0.25;
+            y = y + 1.0;
+        }
+        expected[slot] = a ^ b ^ c ^ d ^ e ^ f ^ (uint64_t)(x * 1000.0) ^ (uint64_t)y;
+    }
+    void* s = coro_scheduler_new(0);
+    CHECK(s != NULL);
+    for (int slot = 0; slot < 4; slot++) CHECK(coro_spawn(s, keeper, (void*)(intptr_t)slot) > 0);
+    CHECK(coro_scheduler_run(s) == 0);
+    for (int slot = 0; slot < 4; slot++) CHECK(register_results[slot] == expected[slot]);
+    coro_scheduler_free(s);
+}
+
+/* ---- Floating-point control state ---- */
+
+static int rounding_seen[4];
+
+static void rounder_up(void* arg) {
+    (void)arg;
+    rounding_seen[0] = fegetround();
+    CHECK(fesetround(FE_UPWARD) == 0);
+    CHECK(coro_yield() == 0);
+    rounding_seen[2] = fegetround();
+}
+
+static void rounder_down(void* arg) {
+    (void)arg;
+    rounding_seen[1] = fegetround();
+    CHECK(fesetround(FE_DOWNWARD) == 0);
+    CHECK(coro_yield() == 0);
+    rounding_seen[3] = fegetround();
+}
+
+static void test_float_control(void) {
+    void* s = coro_scheduler_new(0);
+    CHECK(s != NULL);
+    CHECK(fesetround(FE_TOWARDZERO) == 0);
+    CHECK(coro_spawn(s, rounder_up, NULL) > 0);
+    CHECK(coro_spawn(s, rounder_down, NULL) > 0);
+    CHECK(coro_scheduler_run(s) == 0);
+    /* Fresh coroutines start from the defaults, not the spawner's mode */
+    CHECK(rounding_seen[0] == FE_TONEAREST);
+    CHECK(rounding_seen[1] == FE_TONEAREST);
+    /* Each got its own mode back after the other changed it */
+    CHECK(rounding_seen[2] == FE_UPWARD);
+    CHECK(rounding_seen[3] == FE_DOWNWARD);
+    /* And the scheduler's thread got its own */
+    CHECK(fegetround() == FE_TOWARDZERO);
+    CHECK(fesetround(FE_TONEAREST) == 0);
+    coro_scheduler_free(s);
+}
+
+/* ---- Stacks ---- */
+
+static __attribute__((noinline)) int64_t deep(int depth) {
+    volatile char frame[512];
+    memset((char*)frame, depth & 0xff, sizeof(frame));
+    if (depth == 0) return frame[7];
+    if (depth % 64 == 0) CHECK(coro_yield() == 0);
+    return deep(depth - 1) + frame[depth % sizeof(frame)];
+}
+
+static int64_t deep_result[2];
+
+static void diver(void* arg) {
+    int slot = (int)(intptr_t)arg;
+    deep_result[slot] = deep(300);  /* ~170 KiB of a 256 KiB stack */
+}
+
+static int finished = 0;
+
+static void short_lived(void* arg) {
+    (void)arg;
+    CHECK(coro_current() > 0);
+    finished++;
+}
+
+static void test_stacks(void) {
+    int64_t expected = 0;
+    for (int depth = 300; depth > 0; depth--) expected += (char)(depth & 0xff);
+    void* s = coro_scheduler_new(0);
+    CHECK(s != NULL);
+    CHECK(coro_spawn(s, diver, (void*)0) > 0);
+    CHECK(coro_spawn(s, diver, (void*)1) > 0);
+    CHECK(coro_scheduler_run(s) == 0);
+    CHECK(deep_result[0] == expected && deep_result[1] == expected);
+
+    for (int round = 0; round < 10; round++) {
+        for (int i = 0; i < 100; i++) CHECK(coro_spawn(s, short_lived, NULL) > 0);
+        CHECK(coro_scheduler_run(s) == 0);
+    }
+    CHECK(finished == 1000);
+    CHECK(coro_current() == 0);
+    coro_scheduler_free(s);
+}
+
+/* ---- Join ---- */
+
+static int join_order[3];
+static int join_len = 0;
+static int64_t worker_id = 0;
+
+static void join_worker(void* arg) {
+    (void)arg;
+    for (int i = 0; i < 5; i++) CHECK(coro_yield() == 0);
+    join_order[join_len++] = 1;
+}
+
+static void join_waiter(void* arg) {
+    (void)arg;
+    CHECK(coro_join(coro_current()) == -1 && errno == EDEADLK);
+    CHECK(coro_join(worker_id) == 0);
+    join_order[join_len++] = 2;
+    /* Already finished: returns at once */
+    CHECK(coro_join(worker_id) == 0);
+}
+
+static void test_join(void) {
+    void* s = coro_scheduler_new(0);
+    CHECK(s != NULL);
+    CHECK(coro_spawn(s, join_waiter, NULL) > 0);
+    worker_id = coro_spawn(s, join_worker, NULL);
+    CHECK(worker_id > 0);
+    CHECK(coro_scheduler_run(s) == 0);
+    CHECK(join_len == 2 && join_order[0] == 1 && join_order[1] == 2);
+    /* Outside a coroutine */
+    CHECK(coro_join(worker_id) == -1 && errno == EPERM);
+    coro_scheduler_free(s);
+}
+
+int main(void) {
+    alarm(60);
+    test_round_robin();
+    test_live_values();
+    test_float_control();
+    test_stacks();
+    test_join();
+    printf("ok\n");
+    return 0;
+}
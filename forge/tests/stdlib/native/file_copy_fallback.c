@@ -0,0 +1,135 @@
+/* Copy method fallthrough in file_copy (pyrite/io/file.c).
+ *
+ * ioctl(FICLONE), copy_file_range() and sendfile() are overridden below to
+ * fail with a chosen errno, or to do the real copy when it is 0. A method
+ * that reports itself unsupported (EOPNOTSUPP, EXDEV, EINVAL, ENOSYS,
+ * ENOTTY) must hand over to the next one; any other error must fail the
+ * copy without trying the rest. Prints "ok" and exits 0 on success.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define FILE_SIZE (3 * 1024 * 1024 + 17)
+
+int file_copy(const char* src, const char* dst);
+
+static int clone_errno, range_errno, sendfile_errno;
+static int clone_calls, range_calls, sendfile_calls;
+
+int ioctl(int fd, unsigned long request, ...) {
+    va_list args;
+    va_start(args, request);
+    void* arg = va_arg(args, void*);
+    va_end(args);
+    if (request == FICLONE) {
+        clone_calls++;
+        if (clone_errno) {
+            errno = clone_errno;
+            return -1;
+        }
+    }
+    return (int)syscall(SYS_ioctl, fd, request, arg);
+}
+
+ssize_t copy_file_range(int in_fd, off_t* in_off, int out_fd, off_t* out_off, size_t len, unsigned int flags) {
+    range_calls++;
+    if (range_errno) {
+        errno = range_errno;
+        return -1;
+    }
+    return syscall(SYS_copy_file_range, in_fd, in_off, out_fd, out_off, len, flags);
+}
+
+ssize_t sendfile(int out_fd, int in_fd, off_t* offset, size_t count) {
+    sendfile_calls++;
+    if (sendfile_errno) {
+        errno = sendfile_errno;
+        return -1;
+    }
+    return syscall(SYS_sendfile, out_fd, in_fd, offset, count);
+}
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s (errno %d)\n", __FILE__, __LINE__, #cond, errno); \
+        exit(1); \
+    } \
+} while (0)
+
+static char src[64], dst[64];
+
+static int same_contents(void) {
+    static char a[FILE_SIZE], b[FILE_SIZE];
+    int fa = open(src, O_RDONLY);
+    int fb = open(dst, O_RDONLY);
+    CHECK(fa >= 0 && fb >= 0);
+    ssize_t na = read(fa, a, sizeof(a));
+    ssize_t nb = read(fb, b, sizeof(b));
+    close(fa);
+    close(fb);
+    return na == FILE_SIZE && nb == FILE_SIZE && memcmp(a, b, FILE_SIZE) == 0;
+}
+
+/* One copy with the given errnos; expected is 1 (copied) or 0 (failed), and
+ * calls lists how often each method must have been tried */
+static void check_copy(int clone_err, int range_err, int sendfile_err, int expected,
+                       int clone_expected, int range_expected, int sendfile_expected) {
+    clone_errno = clone_err;
+    range_errno = range_err;
+    sendfile_errno = sendfile_err;
+    clone_calls = range_calls = sendfile_calls = 0;
+    unlink(dst);
+    int ok = file_copy(src, dst);
+    if (ok != expected || clone_calls != clone_expected || (range_calls > 0) != range_expected ||
+        (sendfile_calls > 0) != sendfile_expected) {
+        fprintf(stderr, "errnos %d/%d/%d: copy %d (expected %d), calls %d/%d/%d\n",
+                clone_err, range_err, sendfile_err, ok, expected, clone_calls, range_calls, sendfile_calls);
+        exit(1);
+    }
+    if (expected) {
+        CHECK(same_contents());
+    }
+}
+
+int main(void) {
+    alarm(60);
+    strcpy(src, "/tmp/file_copy_srcXXXXXX");
+    int fd = mkstemp(src);
+    CHECK(fd >= 0);
+    static char data[FILE_SIZE];
+    for (int i = 0; i < FILE_SIZE; i++) {
+        data[i] = (char)(i * 131 ^ i >> 11);
+    }
+    CHECK(write(fd, data, sizeof(data)) == FILE_SIZE);
+    close(fd);
+    snprintf(dst, sizeof(dst), "%s.out", src);
+
+    /* Unsupported methods hand over, down to the buffered loop */
+    check_copy(EOPNOTSUPP, ENOSYS, EINVAL, 1, 1, 1, 1);
+    check_copy(ENOTTY, EXDEV, ENOSYS, 1, 1, 1, 1);
+    check_copy(EXDEV, 0, 0, 1, 1, 1, 0);
+    check_copy(EINVAL, EOPNOTSUPP, 0, 1, 1, 1, 1);
+
+    /* Real failures stop the copy where they happen */
+    check_copy(EIO, 0, 0, 0, 1, 0, 0);
+    check_copy(EOPNOTSUPP, EIO, 0, 0, 1, 1, 0);
+    check_copy(EOPNOTSUPP, ENOSPC, 0, 0, 1, 1, 0);
+    check_copy(EOPNOTSUPP, EXDEV, EIO, 0, 1, 1, 1);
+    CHECK(errno == EIO);
+
+    unlink(dst);
+    unlink(src);
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,200 @@
+/* Directory pruning in glob_walk_* (pyrite/io/glob.c).
+ *
+ * opendir() is overridden below to record every directory the walker reads.
+ * For each include/exclude combination the walk must report the expected
+ * entries in order (sorted, parents before their contents) and must not read
+ * a directory that no include pattern can match beneath, or that an exclude
+ * pattern covers. glob_set_may_match_under is checked on the same patterns.
+ * Prints "ok" and exits 0 on success.
+ */
+
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define GLOB_WALK_FILES 1
+#define GLOB_WALK_DIRS 2
+
+void* glob_set_new(void);
+int32_t glob_set_add(void* set, const char* pattern);
+void glob_set_free(void* set);
+int32_t glob_set_may_match_under(void* set, const char* dir, int64_t len);
+void* glob_walk_open(const char* root, void* include, void* exclude, int32_t flags);
+int32_t glob_walk_next(void* walk);
+const char* glob_walk_relative(const void* walk);
+void glob_walk_close(void* walk);
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s (errno %d)\n", __FILE__, __LINE__, #cond, errno); \
+        exit(1); \
+    } \
+} while (0)
+
+static char root[64];
+static char opened[64][256];
+static int opened_count = 0;
+
+DIR* opendir(const char* name) {
+    /* Relative to the root, "" for the root itself */
+    size_t root_len = strlen(root);
+    const char* rel = strncmp(name, root, root_len) == 0 ? name + root_len : name;
+    if (*rel == '/') rel++;
+    CHECK(opened_count < 64 && strlen(rel) < 256);
+    strcpy(opened[opened_count++], rel);
+    int fd = open(name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    return fd < 0 ? NULL : fdopendir(fd);
+}
+
+static void make_tree(void) {
+    static const char* dirs[] = {
+        "build", "build/out", "docs", "docs/deep", "node_modules", "node_modules/pkg",
+        "src", "src/sub", "src/target", "target", "target/debug",
+    };
+    static const char* files[] = {
+        "README.md", "build/out/a.o", "docs/deep/x.md", "docs/guide.md", "node_modules/pkg/i.js",
+        "src/lib.pyrite", "src/main.pyrite", "src/sub/util.pyrite", "src/target/t.pyrite",
+        "target/debug/main",
+    };
+    strcpy(root, "/tmp/glob_walkXXXXXX");
+    CHECK(mkdtemp(root) != NULL);
+    char path[512];
+    for (size_t i = 0; i < sizeof(dirs) / sizeof(dirs[0]); i++) {
+        snprintf(path, sizeof(path), "%s/%s", root, dirs[i]);
+        CHECK(mkdir(path, 0755) == 0);
+    }
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+        snprintf(path, sizeof(path), "%s/%s", root, files[i]);
+        int fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+        CHECK(fd >= 0);
+        close(fd);
+    }
+}
+
+static void remove_tree(const char* path) {
+    DIR* dir = opendir(path);
+    CHECK(dir != NULL);
+    struct dirent* ent;
+    while ((ent = readdir(dir)) != NULL) {
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) continue;
+        char child[512];
+        snprintf(child, sizeof(child), "%s/%s", path, ent->d_name);
+        if (ent->d_type == DT_DIR) {
+            remove_tree(child);
+        } else {
+            CHECK(unlink(child) == 0);
+        }
+    }
+    closedir(dir);
+    CHECK(rmdir(path) == 0);
+}
+
+/* Patterns are separated by '|'; NULL or "" means no set */
+static void* make_set(const char* patterns) {
+    if (!patterns || !*patterns) return NULL;
+    void* set = glob_set_new();
+    CHECK(set != NULL);
+    char copy[256];
+    strcpy(copy, patterns);
+    for (char* p = strtok(copy, "|"); p; p = strtok(NULL, "|")) CHECK(glob_set_add(set, p) >= 0);
+    return set;
+}
+
+/* Expected entries and read directories are '|'-separated, in order */
+static void check_walk(const char* include, const char* exclude, int32_t flags,
+                       const char* expect_entries, const char* expect_opened) {
+    void* inc = make_set(include);
+    void* exc = make_set(exclude);
+    opened_count = 0;
+    void* walk = glob_walk_open(root, inc, exc, flags);
+    CHECK(walk != NULL);
+    char entries[1024] = "";
+    int32_t status;
+    while ((status = glob_walk_next(walk)) == 1) {
+        if (entries[0]) strcat(entries, "|");
+        strcat(entries, glob_walk_relative(walk));
+    }
+    CHECK(status == 0);
+    glob_walk_close(walk);
+
+    char dirs[1024] = "";
+    for (int i = 0; i < opened_count; i++) {
+        if (i > 0) strcat(dirs, "|");
+        strcat(dirs, opened[i]);
+    }
+    if (strcmp(entries, expect_entries) != 0 || strcmp(dirs, expect_opened) != 0) {
+        fprintf(stderr, "include %s exclude %s:\n  entries %s\n  expected %s\n  read %s\n  expected %s\n",
+                include ? include : "-", exclude ? exclude : "-", entries, expect_entries, dirs, expect_opened);
+        exit(1);
+    }
+    glob_set_free(inc);
+    glob_set_free(exc);
+}
+
+static void check_may_match(const char* patterns, const char* dir, int expected) {
+    void* set = make_set(patterns);
+    int32_t got = glob_set_may_match_under(set, dir, (int64_t)strlen(dir));
+    if (got != expected) {
+        fprintf(stderr, "may_match_under(%s, %s) = %d, expected %d\n", patterns, dir, got, expected);
+        exit(1);
+    }
+    glob_set_free(set);
+}
+
+int main(void) {
+    alarm(60);
+    make_tree();
+
+    /* Everything: every directory is read, in sorted order */
+    check_walk(NULL, NULL, GLOB_WALK_FILES,
+               "README.md|build/out/a.o|docs/deep/x.md|docs/guide.md|node_modules/pkg/i.js|"
+               "src/lib.pyrite|src/main.pyrite|src/sub/util.pyrite|src/target/t.pyrite|target/debug/main",
+               "|build|build/out|docs|docs/deep|node_modules|node_modules/pkg|src|src/sub|src/target|"
+               "target|target/debug");
+
+    /* Only src can hold a match */
+    check_walk("src/**/*.pyrite", NULL, GLOB_WALK_FILES,
+               "src/lib.pyrite|src/main.pyrite|src/sub/util.pyrite|src/target/t.pyrite",
+               "|src|src/sub|src/target");
+
+    /* '*' stays within a segment, so docs/deep is not read */
+    check_walk("docs/*.md", NULL, GLOB_WALK_FILES, "docs/guide.md", "|docs");
+
+    /* Excluded directories are skipped with everything below them */
+    check_walk("**/*.pyrite", "**/target|node_modules", GLOB_WALK_FILES,
+               "src/lib.pyrite|src/main.pyrite|src/sub/util.pyrite",
+               "|build|build/out|docs|docs/deep|src|src/sub");
+
+    /* An exclude covering a whole subtree prunes it too */
+    check_walk(NULL, "build/**|docs/**|node_modules/**|target/**|src/**", GLOB_WALK_FILES | GLOB_WALK_DIRS,
+               "README.md|build|docs|node_modules|src|target", "");
+
+    /* Directories as matches: the workspace member shape */
+    check_walk("{src,docs}/*", "**/target", GLOB_WALK_DIRS, "docs/deep|src/sub", "|docs|src");
+
+    /* Alternation and classes across several patterns */
+    check_walk("[bd]*/**/*.{o,md}|README.md", NULL, GLOB_WALK_FILES,
+               "README.md|build/out/a.o|docs/deep/x.md|docs/guide.md",
+               "|build|build/out|docs|docs/deep");
+
+    check_may_match("src/**/*.pyrite", "src", 1);
+    check_may_match("src/**/*.pyrite", "src/a/b", 1);
+    check_may_match("src/**/*.pyrite", "docs", 0);
+    check_may_match("docs/*.md", "docs/deep", 0);
+    check_may_match("*.md", "", 1);
+    check_may_match("[!s]*/x", "src", 0);
+    check_may_match("[!s]*/x", "docs", 1);
+    check_may_match("a\\*/x", "a*", 1);
+    check_may_match("a\\*/x", "ab", 0);
+
+    remove_tree(root);
+    printf("ok\n");
+    return 0;
+}
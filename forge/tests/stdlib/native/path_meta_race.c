@@ -0,0 +1,107 @@
+/* The process-level metadata cache (pyrite/io/path.c) under concurrent use.
+ *
+ * Reader threads call path_metadata, path_stat_batch and path_dirty_check
+ * while the main thread switches the cache on and off and invalidates it.
+ * Run under -fsanitize=thread: the enabled flag must not be a data race, and
+ * a lookup racing with path_meta_cache_enable(0) must not refill the cache it
+ * just freed. Prints "ok" and exits 0 on success.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define READERS 4
+#define FILES 32
+
+typedef struct {
+    int64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint64_t inode;
+    uint64_t dev;
+    int32_t kind;
+    int32_t error;
+} PathMeta;
+
+int32_t path_metadata(const char* path, PathMeta* meta);
+int64_t path_stat_batch(const char** paths, int64_t count, PathMeta* out);
+int64_t path_dirty_check(const char** paths, int64_t count, const PathMeta* previous, int64_t* dirty);
+void path_meta_cache_enable(int32_t enabled);
+void path_meta_cache_invalidate(void);
+void path_meta_cache_invalidate_path(const char* path);
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s (errno %d)\n", __FILE__, __LINE__, #cond, errno); \
+        exit(1); \
+    } \
+} while (0)
+
+static char root[64];
+static char names[FILES][96];
+static const char* paths[FILES];
+static PathMeta recorded[FILES];
+static int stop = 0;
+
+static void* reader(void* arg) {
+    (void)arg;
+    PathMeta out[FILES];
+    int64_t dirty[FILES];
+    while (!__atomic_load_n(&stop, __ATOMIC_ACQUIRE)) {
+        for (int i = 0; i < FILES; i++) {
+            CHECK(path_metadata(paths[i], &out[i]) == 1);
+        }
+        CHECK(path_stat_batch(paths, FILES, out) == FILES);
+        /* Nothing changes on disk, so stale or fresh, nothing is dirty */
+        CHECK(path_dirty_check(paths, FILES, recorded, dirty) == 0);
+    }
+    return NULL;
+}
+
+int main(int argc, char** argv) {
+    int rounds = argc > 1 ? atoi(argv[1]) : 200;
+    alarm(120);
+    strcpy(root, "/tmp/path_metaXXXXXX");
+    CHECK(mkdtemp(root) != NULL);
+    for (int i = 0; i < FILES; i++) {
+        snprintf(names[i], sizeof(names[i]), "%s/f%d", root, i);
+        int fd = open(names[i], O_WRONLY | O_CREAT | O_EXCL, 0644);
+        CHECK(fd >= 0);
+        CHECK(write(fd, names[i], (size_t)i) == i);
+        close(fd);
+        paths[i] = names[i];
+    }
+    CHECK(path_stat_batch(paths, FILES, recorded) == FILES);
+
+    pthread_t threads[READERS];
+    for (int i = 0; i < READERS; i++) {
+        CHECK(pthread_create(&threads[i], NULL, reader, NULL) == 0);
+    }
+    for (int r = 0; r < rounds; r++) {
+        path_meta_cache_enable(1);
+        usleep(100);
+        path_meta_cache_invalidate_path(paths[r % FILES]);
+        path_meta_cache_invalidate();
+        usleep(100);
+        path_meta_cache_enable(0);
+    }
+    __atomic_store_n(&stop, 1, __ATOMIC_RELEASE);
+    for (int i = 0; i < READERS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    for (int i = 0; i < FILES; i++) {
+        CHECK(unlink(names[i]) == 0);
+    }
+    CHECK(rmdir(root) == 0);
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,135 @@
+/* tcp_send_file through its splice() path on a nonblocking socket.
+ *
+ * sendfile() is overridden below to fail with EINVAL, the way it does for
+ * file/socket pairs it cannot handle, so tcp_send_file falls through to the
+ * file -> pipe -> socket path. Nobody reads while the first call runs: it
+ * must return the progress made once the socket fills up instead of waiting
+ * for writability. The rest is resumed from offset + progress and checked
+ * byte for byte. Prints "ok" and exits 0 on success.
+ */
+
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#define TCP_WOULD_BLOCK (-2)
+#define FILE_SIZE (8 * 1024 * 1024)
+
+int64_t tcp_send_file(int64_t sock, int64_t file_fd, int64_t offset, int64_t len);
+
+static int sendfile_calls = 0;
+
+ssize_t sendfile(int out_fd, int in_fd, off_t* offset, size_t count) {
+    (void)out_fd;
+    (void)in_fd;
+    (void)offset;
+    (void)count;
+    sendfile_calls++;
+    errno = EINVAL;
+    return -1;
+}
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s (errno %d)\n", __FILE__, __LINE__, #cond, errno); \
+        exit(1); \
+    } \
+} while (0)
+
+static unsigned char pattern(int64_t i) {
+    return (unsigned char)((i * 131) ^ (i >> 13));
+}
+
+/* Read whatever is available; returns the new received count */
+static int64_t drain(int fd, int64_t received) {
+    static unsigned char buf[256 * 1024];
+    for (;;) {
+        ssize_t n = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            CHECK(errno == EAGAIN || errno == EWOULDBLOCK);
+            return received;
+        }
+        CHECK(n > 0);
+        for (ssize_t i = 0; i < n; i++) {
+            CHECK(buf[i] == pattern(received + i));
+        }
+        received += n;
+    }
+}
+
+int main(void) {
+    alarm(60);  /* A blocked send shows up as a timeout, not a hung test */
+
+    char path[] = "/tmp/send_file_spliceXXXXXX";
+    int file_fd = mkstemp(path);
+    CHECK(file_fd >= 0);
+    unlink(path);
+    unsigned char* data = malloc(FILE_SIZE);
+    CHECK(data != NULL);
+    for (int64_t i = 0; i < FILE_SIZE; i++) data[i] = pattern(i);
+    CHECK(write(file_fd, data, FILE_SIZE) == FILE_SIZE);
+    free(data);
+
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    CHECK(listener >= 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addr_len = sizeof(addr);
+    CHECK(bind(listener, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+    CHECK(listen(listener, 1) == 0);
+    CHECK(getsockname(listener, (struct sockaddr*)&addr, &addr_len) == 0);
+
+    int sender = socket(AF_INET, SOCK_STREAM, 0);
+    CHECK(sender >= 0);
+    int small = 64 * 1024;
+    setsockopt(sender, SOL_SOCKET, SO_SNDBUF, &small, sizeof(small));
+    CHECK(connect(sender, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+    int receiver = accept(listener, NULL, NULL);
+    CHECK(receiver >= 0);
+    setsockopt(receiver, SOL_SOCKET, SO_RCVBUF, &small, sizeof(small));
+    CHECK(fcntl(sender, F_SETFL, fcntl(sender, F_GETFL, 0) | O_NONBLOCK) == 0);
+
+    /* Socket buffers hold far less than the file: partial progress */
+    int64_t sent = tcp_send_file(sender, file_fd, 0, FILE_SIZE);
+    CHECK(sendfile_calls > 0);
+    CHECK(sent > 0 && sent < FILE_SIZE);
+
+    /* Nothing was read, so the next call cannot make progress either */
+    int64_t again = tcp_send_file(sender, file_fd, sent, FILE_SIZE - sent);
+    CHECK(again == TCP_WOULD_BLOCK || again > 0);
+    if (again > 0) sent += again;
+
+    int64_t received = 0;
+    while (received < FILE_SIZE) {
+        received = drain(receiver, received);
+        if (sent < FILE_SIZE) {
+            int64_t n = tcp_send_file(sender, file_fd, sent, FILE_SIZE - sent);
+            CHECK(n > 0 || n == TCP_WOULD_BLOCK);
+            if (n > 0) sent += n;
+        }
+        CHECK(received <= sent);
+        if (received == sent && sent < FILE_SIZE) usleep(1000);
+    }
+    CHECK(sent == FILE_SIZE);
+    /* File position is untouched by the explicit-offset reads */
+    CHECK(lseek(file_fd, 0, SEEK_CUR) == FILE_SIZE);
+
+    close(sender);
+    close(receiver);
+    close(listener);
+    close(file_fd);
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,127 @@
+/* Declarations shared by the pyrite/num/tensor.c test drivers.
+ *
+ * tensor.c has no public header (Pyrite code declares the externs in
+ * num/tensor.pyrite), so the Tensor layout and the functions the drivers call
+ * are repeated here. Keep it in step with tensor.c. The storage is opaque to
+ * the drivers.
+ */
+
+#ifndef PYRITE_TENSOR_DRIVER_H
+#define PYRITE_TENSOR_DRIVER_H
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define TENSOR_MAX_DIMS 8
+
+typedef struct {
+    double* data;
+    void* storage;
+    int64_t offset;
+    int32_t ndim;
+    int64_t shape[TENSOR_MAX_DIMS];
+    int64_t strides[TENSOR_MAX_DIMS];
+} Tensor;
+
+#define TENSOR_GEMM_AUTO (-1)
+#define TENSOR_GEMM_PORTABLE 0
+#define TENSOR_GEMM_AVX2 1
+#define TENSOR_GEMM_AVX512 2
+
+#define TENSOR_EXPR_ADD 0
+#define TENSOR_EXPR_SUB 1
+#define TENSOR_EXPR_MUL 2
+#define TENSOR_EXPR_DIV 3
+#define TENSOR_EXPR_MIN 4
+#define TENSOR_EXPR_MAX 5
+#define TENSOR_EXPR_NEG 6
+#define TENSOR_EXPR_ABS 7
+#define TENSOR_EXPR_SQRT 8
+#define TENSOR_EXPR_EXP 9
+#define TENSOR_EXPR_LOG 10
+
+/* Storage and buffer pool */
+Tensor tensor_new(int64_t rows, int64_t cols);
+Tensor tensor_new_nd(int32_t ndim, const int64_t* shape);
+Tensor tensor_new_uninit(int32_t ndim, const int64_t* shape);
+void tensor_drop(Tensor* t);
+int64_t tensor_numel(const Tensor* t);
+int64_t tensor_set_pool_limit(int64_t bytes);
+int64_t tensor_pool_trim(void);
+
+/* Element access */
+double tensor_get(Tensor* t, int64_t r, int64_t c);
+void tensor_set(Tensor* t, int64_t r, int64_t c, double val);
+double tensor_get_at(const Tensor* t, const int64_t* index);
+void tensor_set_at(Tensor* t, const int64_t* index, double val);
+
+/* Views */
+Tensor tensor_slice(const Tensor* t, int32_t axis, int64_t start, int64_t stop, int64_t step);
+Tensor tensor_select(const Tensor* t, int32_t axis, int64_t index);
+Tensor tensor_permute(const Tensor* t, const int32_t* axes);
+Tensor tensor_transpose(const Tensor* t);
+Tensor tensor_broadcast_to(const Tensor* t, int32_t ndim, const int64_t* shape);
+Tensor tensor_reshape(const Tensor* t, int32_t ndim, const int64_t* shape);
+Tensor tensor_contiguous(const Tensor* t);
+int32_t tensor_is_contiguous(const Tensor* t);
+
+/* Elementwise operations and reductions */
+int32_t tensor_add(const Tensor* a, const Tensor* b, Tensor* out);
+int32_t tensor_sub(const Tensor* a, const Tensor* b, Tensor* out);
+int32_t tensor_mul(const Tensor* a, const Tensor* b, Tensor* out);
+int32_t tensor_scale(const Tensor* a, double s, Tensor* out);
+int32_t tensor_fill(Tensor* t, double value);
+int32_t tensor_assign(Tensor* dst, const Tensor* src);
+double tensor_sum(const Tensor* t);
+double tensor_dot(const Tensor* a, const Tensor* b);
+
+/* Thread pool */
+int32_t tensor_set_threads(int32_t threads);
+int32_t tensor_threads(void);
+
+/* GEMM */
+int32_t tensor_gemm_use_kernel(int32_t kernel);
+int32_t tensor_gemm(double alpha, const Tensor* a, int32_t trans_a,
+                    const Tensor* b, int32_t trans_b, double beta, Tensor* c);
+Tensor tensor_matmul(const Tensor* a, const Tensor* b);
+
+/* Fused expressions */
+void* tensor_expr_new(void);
+int32_t tensor_expr_input(void* expr, const Tensor* t);
+int32_t tensor_expr_const(void* expr, double value);
+int32_t tensor_expr_unary(void* expr, int32_t op, int32_t x);
+int32_t tensor_expr_binary(void* expr, int32_t op, int32_t x, int32_t y);
+int32_t tensor_expr_eval(void* expr, int32_t node, Tensor* out);
+Tensor tensor_expr_eval_new(void* expr, int32_t node);
+void tensor_expr_free(void* expr);
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s (errno %d)\n", __FILE__, __LINE__, #cond, errno); \
+        exit(1); \
+    } \
+} while (0)
+
+/* Deterministic test data: multiples of 1/1024 in [-4, 4), so sums of a few
+ * thousand products are exact in double and results can be compared with == */
+static inline double tensor_driver_value(uint64_t* state) {
+    *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (double)(int64_t)((*state >> 33) % 8192) / 1024.0 - 4.0;
+}
+
+static inline void tensor_driver_fill(Tensor* t, uint64_t* state) {
+    int64_t n = tensor_numel(t);
+    for (int64_t i = 0; i < n; i++) t->data[i] = tensor_driver_value(state);
+}
+
+/* A fresh row-major copy (tensor_contiguous() shares contiguous storage) */
+static inline Tensor tensor_driver_copy(const Tensor* t) {
+    Tensor copy = tensor_new_uninit(t->ndim, t->shape);
+    CHECK(copy.data != NULL || tensor_numel(t) == 0);
+    CHECK(tensor_assign(&copy, t) == 0);
+    return copy;
+}
+
+#endif /* PYRITE_TENSOR_DRIVER_H */
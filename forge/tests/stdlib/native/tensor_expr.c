@@ -0,0 +1,395 @@
+/* Fused expressions (tensor_expr_*) in pyrite/num/tensor.c against the
+ * same computation done unfused.
+ *
+ * - Every operation, on every instruction set the CPU supports (the GEMM
+ *   kernel selection picks the expression kernel too) and at 1 and 4
+ *   threads, over lengths around the vector (8) and tile (256) sizes and
+ *   one large enough to be split into tasks. The data includes NaN, infinities
+ *   and signed zeros. Results must match tensor_add/sub/mul/scale into
+ *   temporaries, or a scalar loop for the rest, bit for bit.
+ * - a * b + c and a * b - c are rounded once (fma()) with AVX2 and AVX-512
+ *   and twice by the portable kernel.
+ * - Longer expressions with folded constants, repeated inputs, broadcast,
+ *   strided and transposed inputs and outputs, in-place evaluation and
+ *   eval_new's result shape.
+ * - Errors: bad ops and node ids, inputs that do not broadcast, a broadcast
+ *   output and more than eight distinct inputs fail with EINVAL.
+ *
+ * Prints "ok" and exits 0 on success.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tensor_driver.h"
+
+static int32_t kernel;
+
+/* Full-precision values in (-4, 4), with special values mixed in */
+static void fill_special(Tensor* t, uint64_t* state, int positive) {
+    static const double special[] = { NAN, INFINITY, -INFINITY, 0.0, -0.0, 1e-310, 1e300 };
+    int64_t n = tensor_numel(t);
+    for (int64_t i = 0; i < n; i++) {
+        *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+        double x = (double)(*state >> 11) / 9007199254740992.0 * 8.0 - 4.0;
+        if (i % 37 == 5) x = special[(i / 37) % 7];
+        t->data[i] = positive ? fabs(x) : x;
+    }
+}
+
+/* Bit-identical, so NaN matches NaN and -0.0 does not match 0.0 */
+static void check_same(const double* got, const double* want, int64_t n, const char* what) {
+    for (int64_t i = 0; i < n; i++) {
+        if (memcmp(&got[i], &want[i], sizeof(double)) != 0) {
+            fprintf(stderr, "kernel %d, %s, n=%ld: [%ld] = %.17g, expected %.17g\n",
+                    kernel, what, (long)n, (long)i, got[i], want[i]);
+            exit(1);
+        }
+    }
+}
+
+static double scalar_op(int32_t op, double x, double y) {
+    switch (op) {
+    case TENSOR_EXPR_DIV: return x / y;
+    case TENSOR_EXPR_MIN: return x < y ? x : y;
+    case TENSOR_EXPR_MAX: return x > y ? x : y;
+    case TENSOR_EXPR_NEG: return -x;
+    case TENSOR_EXPR_ABS: return fabs(x);
+    case TENSOR_EXPR_SQRT: return sqrt(x);
+    case TENSOR_EXPR_EXP: return exp(x);
+    default: return log(x);
+    }
+}
+
+/* ---- Single operations ---- */
+
+static const int64_t lengths[] = { 1, 7, 8, 9, 255, 256, 257, 1000, 70001 };
+#define LENGTHS ((int)(sizeof(lengths) / sizeof(lengths[0])))
+
+static void test_operations(void) {
+    uint64_t seed = 3;
+    for (int l = 0; l < LENGTHS; l++) {
+        int64_t n = lengths[l];
+        int64_t shape[1] = { n };
+        Tensor a = tensor_new_nd(1, shape), b = tensor_new_nd(1, shape), c = tensor_new_nd(1, shape);
+        Tensor pos = tensor_new_nd(1, shape);
+        Tensor out = tensor_new_nd(1, shape), want = tensor_new_nd(1, shape);
+        fill_special(&a, &seed, 0);
+        fill_special(&b, &seed, 0);
+        fill_special(&c, &seed, 0);
+        fill_special(&pos, &seed, 1);
+
+        void* e = tensor_expr_new();
+        CHECK(e != NULL);
+        int32_t na = tensor_expr_input(e, &a), nb = tensor_expr_input(e, &b), nc = tensor_expr_input(e, &c);
+        int32_t npos = tensor_expr_input(e, &pos);
+        CHECK(na >= 0 && nb >= 0 && nc >= 0 && npos >= 0);
+
+        /* The unfused library calls */
+        CHECK(tensor_expr_eval(e, tensor_expr_binary(e, TENSOR_EXPR_ADD, na, nb), &out) == 0);
+        CHECK(tensor_add(&a, &b, &want) == 0);
+        check_same(out.data, want.data, n, "add");
+        CHECK(tensor_expr_eval(e, tensor_expr_binary(e, TENSOR_EXPR_SUB, na, nb), &out) == 0);
+        CHECK(tensor_sub(&a, &b, &want) == 0);
+        check_same(out.data, want.data, n, "sub");
+        CHECK(tensor_expr_eval(e, tensor_expr_binary(e, TENSOR_EXPR_MUL, na, nb), &out) == 0);
+        CHECK(tensor_mul(&a, &b, &want) == 0);
+        check_same(out.data, want.data, n, "mul");
+        int32_t scaled = tensor_expr_binary(e, TENSOR_EXPR_MUL, tensor_expr_const(e, -2.5), na);
+        CHECK(tensor_expr_eval(e, scaled, &out) == 0);
+        CHECK(tensor_scale(&a, -2.5, &want) == 0);
+        check_same(out.data, want.data, n, "scale");
+
+        /* The rest against scalar loops */
+        static const int32_t binary[] = { TENSOR_EXPR_DIV, TENSOR_EXPR_MIN, TENSOR_EXPR_MAX };
+        for (int k = 0; k < 3; k++) {
+            CHECK(tensor_expr_eval(e, tensor_expr_binary(e, binary[k], na, nb), &out) == 0);
+            for (int64_t i = 0; i < n; i++) want.data[i] = scalar_op(binary[k], a.data[i], b.data[i]);
+            check_same(out.data, want.data, n, "div/min/max");
+        }
+        static const int32_t unary[] = { TENSOR_EXPR_NEG, TENSOR_EXPR_ABS, TENSOR_EXPR_SQRT, TENSOR_EXPR_EXP,
+                                         TENSOR_EXPR_LOG };
+        for (int k = 0; k < 5; k++) {
+            int32_t x = unary[k] >= TENSOR_EXPR_SQRT && unary[k] != TENSOR_EXPR_EXP ? npos : na;
+            const Tensor* src = x == npos ? &pos : &a;
+            CHECK(tensor_expr_eval(e, tensor_expr_unary(e, unary[k], x), &out) == 0);
+            for (int64_t i = 0; i < n; i++) want.data[i] = scalar_op(unary[k], src->data[i], 0.0);
+            check_same(out.data, want.data, n, "unary");
+        }
+        /* Negative arguments of sqrt and log, and NaN passed through */
+        CHECK(tensor_expr_eval(e, tensor_expr_unary(e, TENSOR_EXPR_SQRT, na), &out) == 0);
+        for (int64_t i = 0; i < n; i++) CHECK(isnan(out.data[i]) == (isnan(a.data[i]) || a.data[i] < 0));
+
+        /* Multiply-add: one rounding with FMA hardware, two without */
+        int32_t fma_node = tensor_expr_binary(e, TENSOR_EXPR_ADD, tensor_expr_binary(e, TENSOR_EXPR_MUL, na, nb), nc);
+        CHECK(tensor_expr_eval(e, fma_node, &out) == 0);
+        if (kernel == TENSOR_GEMM_PORTABLE) {
+            CHECK(tensor_mul(&a, &b, &want) == 0);
+            CHECK(tensor_add(&want, &c, &want) == 0);
+        } else {
+            for (int64_t i = 0; i < n; i++) want.data[i] = fma(a.data[i], b.data[i], c.data[i]);
+        }
+        check_same(out.data, want.data, n, "a * b + c");
+        int32_t fms_node = tensor_expr_binary(e, TENSOR_EXPR_SUB, tensor_expr_binary(e, TENSOR_EXPR_MUL, na, nb), nc);
+        CHECK(tensor_expr_eval(e, fms_node, &out) == 0);
+        if (kernel == TENSOR_GEMM_PORTABLE) {
+            CHECK(tensor_mul(&a, &b, &want) == 0);
+            CHECK(tensor_sub(&want, &c, &want) == 0);
+        } else {
+            for (int64_t i = 0; i < n; i++) want.data[i] = fma(a.data[i], b.data[i], -c.data[i]);
+        }
+        check_same(out.data, want.data, n, "a * b - c");
+
+        tensor_expr_free(e);
+        Tensor tensors[] = { a, b, c, pos, out, want };
+        for (size_t i = 0; i < sizeof(tensors) / sizeof(tensors[0]); i++) tensor_drop(&tensors[i]);
+    }
+}
+
+/* ---- Whole expressions ---- */
+
+/* ((a * b + c) * 0.5 - |a| + (3 * 4)) / max(b, 1) + (a + a), on exact data so
+ * the unfused chain rounds the same whether or not the multiply-add fuses */
+static int32_t build_expression(void* e, int32_t na, int32_t nb, int32_t nc) {
+    int32_t t = tensor_expr_binary(e, TENSOR_EXPR_ADD, tensor_expr_binary(e, TENSOR_EXPR_MUL, na, nb), nc);
+    t = tensor_expr_binary(e, TENSOR_EXPR_MUL, t, tensor_expr_const(e, 0.5));
+    t = tensor_expr_binary(e, TENSOR_EXPR_SUB, t, tensor_expr_unary(e, TENSOR_EXPR_ABS, na));
+    int32_t twelve = tensor_expr_binary(e, TENSOR_EXPR_MUL, tensor_expr_const(e, 3.0), tensor_expr_const(e, 4.0));
+    t = tensor_expr_binary(e, TENSOR_EXPR_ADD, t, twelve);
+    t = tensor_expr_binary(e, TENSOR_EXPR_DIV, t,
+                           tensor_expr_binary(e, TENSOR_EXPR_MAX, nb, tensor_expr_const(e, 1.0)));
+    return tensor_expr_binary(e, TENSOR_EXPR_ADD, t, tensor_expr_binary(e, TENSOR_EXPR_ADD, na, na));
+}
+
+/* The same, one library call or loop per operation, into want (out's shape;
+ * a, b and c broadcast to it) */
+static void unfused_expression(const Tensor* a, const Tensor* b, const Tensor* c, Tensor* want) {
+    int64_t n = tensor_numel(want);
+    Tensor t = tensor_new_uninit(want->ndim, want->shape), u = tensor_new_uninit(want->ndim, want->shape);
+    Tensor bb = tensor_new_uninit(want->ndim, want->shape);
+    CHECK(tensor_mul(a, b, &t) == 0);
+    CHECK(tensor_add(&t, c, &t) == 0);
+    CHECK(tensor_scale(&t, 0.5, &t) == 0);
+    CHECK(tensor_assign(&u, a) == 0);
+    for (int64_t i = 0; i < n; i++) u.data[i] = fabs(u.data[i]);
+    CHECK(tensor_sub(&t, &u, &t) == 0);
+    CHECK(tensor_fill(&u, 12.0) == 0);
+    CHECK(tensor_add(&t, &u, &t) == 0);
+    CHECK(tensor_assign(&bb, b) == 0);
+    for (int64_t i = 0; i < n; i++) t.data[i] /= bb.data[i] > 1.0 ? bb.data[i] : 1.0;
+    CHECK(tensor_add(a, a, &u) == 0);
+    CHECK(tensor_add(&t, &u, want) == 0);
+    tensor_drop(&t);
+    tensor_drop(&u);
+    tensor_drop(&bb);
+}
+
+static void check_expression(const Tensor* a, const Tensor* b, const Tensor* c, Tensor* out, const char* what) {
+    void* e = tensor_expr_new();
+    int32_t root = build_expression(e, tensor_expr_input(e, a), tensor_expr_input(e, b), tensor_expr_input(e, c));
+    CHECK(root >= 0);
+    CHECK(tensor_expr_eval(e, root, out) == 0);
+    Tensor want = tensor_new_uninit(out->ndim, out->shape);
+    unfused_expression(a, b, c, &want);
+    Tensor got = tensor_driver_copy(out);
+    check_same(got.data, want.data, tensor_numel(out), what);
+    tensor_drop(&want);
+    tensor_drop(&got);
+    tensor_expr_free(e);
+}
+
+static void test_expressions(void) {
+    uint64_t seed = 17;
+    static const int64_t sides[][2] = { { 1, 1 }, { 3, 7 }, { 33, 257 }, { 300, 301 } };
+    for (size_t s = 0; s < sizeof(sides) / sizeof(sides[0]); s++) {
+        int64_t rows = sides[s][0], cols = sides[s][1];
+        Tensor a = tensor_new(rows, cols), b = tensor_new(rows, cols), c = tensor_new(rows, cols);
+        tensor_driver_fill(&a, &seed);
+        tensor_driver_fill(&b, &seed);
+        tensor_driver_fill(&c, &seed);
+        Tensor out = tensor_new(rows, cols);
+        check_expression(&a, &b, &c, &out, "contiguous");
+
+        /* Broadcast: a column, a row and a 0-D tensor */
+        Tensor col = tensor_new(rows, 1), row = tensor_new(1, cols), scalar = tensor_new_nd(0, NULL);
+        tensor_driver_fill(&col, &seed);
+        tensor_driver_fill(&row, &seed);
+        scalar.data[0] = 1.5;
+        check_expression(&col, &row, &scalar, &out, "broadcast");
+        check_expression(&a, &row, &col, &out, "broadcast rows and columns");
+
+        /* Strided and transposed inputs, into a transposed output */
+        Tensor at = tensor_transpose(&a), bt = tensor_transpose(&b), ct = tensor_transpose(&c);
+        Tensor ac = tensor_driver_copy(&at), bc = tensor_driver_copy(&bt);
+        Tensor out_t = tensor_transpose(&out);
+        check_expression(&at, &bc, &ct, &out_t, "transposed");
+        check_expression(&ac, &bt, &ct, &out_t, "transposed");
+        if (cols > 2) {
+            /* Every other column: odd ones of b, even ones of c, into the
+             * odd columns of a zeroed output */
+            Tensor sb = tensor_slice(&b, 1, 1, cols, 2), sc = tensor_slice(&c, 1, 0, cols - 1, 2);
+            Tensor wide = tensor_new(rows, cols), so = tensor_slice(&wide, 1, 1, cols, 2);
+            check_expression(&sc, &sb, &sc, &so, "stepped");
+            for (int64_t i = 0; i < rows; i++) {
+                for (int64_t j = 0; j < cols; j += 2) CHECK(wide.data[i * cols + j] == 0.0);
+            }
+            Tensor tensors[] = { sb, sc, wide, so };
+            for (size_t i = 0; i < sizeof(tensors) / sizeof(tensors[0]); i++) tensor_drop(&tensors[i]);
+        }
+
+        /* eval_new shapes the result by broadcasting the inputs */
+        void* e = tensor_expr_new();
+        int32_t root = build_expression(e, tensor_expr_input(e, &col), tensor_expr_input(e, &row),
+                                        tensor_expr_input(e, &scalar));
+        Tensor fresh = tensor_expr_eval_new(e, root);
+        CHECK(fresh.ndim == 2 && fresh.shape[0] == rows && fresh.shape[1] == cols && tensor_is_contiguous(&fresh));
+        Tensor want = tensor_new(rows, cols);
+        unfused_expression(&col, &row, &scalar, &want);
+        check_same(fresh.data, want.data, rows * cols, "eval_new");
+        tensor_expr_free(e);
+
+        Tensor tensors[] = { a, b, c, out, col, row, scalar, at, bt, ct, ac, bc, out_t, fresh, want };
+        for (size_t i = 0; i < sizeof(tensors) / sizeof(tensors[0]); i++) tensor_drop(&tensors[i]);
+    }
+}
+
+static void test_in_place(void) {
+    uint64_t seed = 23;
+    static const int64_t sizes[] = { 5, 300, 70001 };
+    for (int s = 0; s < 3; s++) {
+        int64_t n = sizes[s];
+        int64_t shape[1] = { n };
+        Tensor a = tensor_new_nd(1, shape), b = tensor_new_nd(1, shape), c = tensor_new_nd(1, shape);
+        tensor_driver_fill(&a, &seed);
+        tensor_driver_fill(&b, &seed);
+        tensor_driver_fill(&c, &seed);
+        Tensor want = tensor_new_nd(1, shape);
+        unfused_expression(&a, &b, &c, &want);
+
+        /* a = f(a, b, c), with a read by several instructions */
+        void* e = tensor_expr_new();
+        int32_t root = build_expression(e, tensor_expr_input(e, &a), tensor_expr_input(e, &b),
+                                        tensor_expr_input(e, &c));
+        CHECK(tensor_expr_eval(e, root, &a) == 0);
+        check_same(a.data, want.data, n, "in place");
+
+        /* An input dropped before evaluation is still read */
+        Tensor b_copy = tensor_driver_copy(&b);
+        Tensor view = tensor_slice(&b, 0, 0, n, 1);
+        int32_t nv = tensor_expr_input(e, &view);
+        tensor_drop(&view);
+        tensor_drop(&b);
+        Tensor neg = tensor_expr_eval_new(e, tensor_expr_unary(e, TENSOR_EXPR_NEG, nv));
+        CHECK(neg.data != NULL && neg.shape[0] == n);
+        for (int64_t i = 0; i < n; i++) CHECK(neg.data[i] == -b_copy.data[i]);
+        tensor_expr_free(e);
+
+        Tensor tensors[] = { a, c, want, b_copy, neg };
+        for (size_t i = 0; i < sizeof(tensors) / sizeof(tensors[0]); i++) tensor_drop(&tensors[i]);
+    }
+}
+
+/* ---- Errors ---- */
+
+static void test_errors(void) {
+    void* e = tensor_expr_new();
+    Tensor a = tensor_new(3, 4), b = tensor_new(4, 3);
+    int32_t na = tensor_expr_input(e, &a), nb = tensor_expr_input(e, &b);
+
+    errno = 0;
+    CHECK(tensor_expr_unary(e, TENSOR_EXPR_ADD, na) == -1 && errno == EINVAL);
+    errno = 0;
+    CHECK(tensor_expr_binary(e, TENSOR_EXPR_NEG, na, na) == -1 && errno == EINVAL);
+    errno = 0;
+    CHECK(tensor_expr_binary(e, TENSOR_EXPR_ADD, na, 99) == -1 && errno == EINVAL);
+    /* A failed call's -1 passes through a chain */
+    int32_t chained = tensor_expr_unary(e, TENSOR_EXPR_NEG, tensor_expr_binary(e, TENSOR_EXPR_ADD, -1, na));
+    CHECK(chained == -1);
+    errno = 0;
+    CHECK(tensor_expr_input(NULL, &a) == -1 && errno == EINVAL);
+    errno = 0;
+    CHECK(tensor_expr_const(NULL, 1.0) == -1 && errno == EINVAL);
+
+    /* Shapes that do not broadcast */
+    int32_t sum = tensor_expr_binary(e, TENSOR_EXPR_ADD, na, nb);
+    errno = 0;
+    Tensor bad = tensor_expr_eval_new(e, sum);
+    CHECK(bad.data == NULL && errno == EINVAL);
+    Tensor out = tensor_new(3, 4);
+    errno = 0;
+    CHECK(tensor_expr_eval(e, sum, &out) == -1 && errno == EINVAL);
+    errno = 0;
+    CHECK(tensor_expr_eval(e, nb, &out) == -1 && errno == EINVAL);
+    errno = 0;
+    CHECK(tensor_expr_eval(e, 1000, &out) == -1 && errno == EINVAL);
+
+    /* A broadcast output */
+    Tensor row = tensor_new(1, 4);
+    int64_t shape[2] = { 3, 4 };
+    Tensor repeated = tensor_broadcast_to(&row, 2, shape);
+    errno = 0;
+    CHECK(tensor_expr_eval(e, na, &repeated) == -1 && errno == EINVAL);
+
+    /* Eight distinct inputs compile; a ninth does not. The same view twice
+     * counts once. */
+    void* wide = tensor_expr_new();
+    Tensor inputs[9];
+    int32_t acc = -1;
+    for (int i = 0; i < 9; i++) {
+        inputs[i] = tensor_new(2, 2);
+        CHECK(tensor_fill(&inputs[i], (double)i) == 0);
+        int32_t n = tensor_expr_input(wide, &inputs[i]);
+        int32_t again = tensor_expr_input(wide, &inputs[i]);
+        int32_t both = tensor_expr_binary(wide, TENSOR_EXPR_ADD, n, again);
+        acc = acc < 0 ? both : tensor_expr_binary(wide, TENSOR_EXPR_ADD, acc, both);
+        if (i == 7) {
+            Tensor eight = tensor_expr_eval_new(wide, acc);
+            CHECK(eight.data != NULL && eight.data[3] == 56.0);
+            tensor_drop(&eight);
+        }
+    }
+    errno = 0;
+    Tensor nine = tensor_expr_eval_new(wide, acc);
+    CHECK(nine.data == NULL && errno == EINVAL);
+    tensor_expr_free(wide);
+    for (int i = 0; i < 9; i++) tensor_drop(&inputs[i]);
+
+    /* Constants only: a single element */
+    int32_t k = tensor_expr_binary(e, TENSOR_EXPR_MUL, tensor_expr_const(e, 6.0), tensor_expr_const(e, 7.0));
+    Tensor scalar = tensor_expr_eval_new(e, k);
+    CHECK(scalar.ndim == 0 && scalar.data != NULL && scalar.data[0] == 42.0);
+    CHECK(tensor_expr_eval(e, k, &out) == 0);
+    for (int64_t i = 0; i < 12; i++) CHECK(out.data[i] == 42.0);
+
+    tensor_expr_free(e);
+    tensor_expr_free(NULL);
+    Tensor tensors[] = { a, b, out, row, repeated, scalar };
+    for (size_t i = 0; i < sizeof(tensors) / sizeof(tensors[0]); i++) tensor_drop(&tensors[i]);
+}
+
+int main(void) {
+    alarm(120);
+    int tested = 0;
+    for (kernel = TENSOR_GEMM_PORTABLE; kernel <= TENSOR_GEMM_AVX512; kernel++) {
+        if (tensor_gemm_use_kernel(kernel) != kernel) continue;
+        tested++;
+        static const int32_t widths[] = { 1, 4 };
+        for (int w = 0; w < 2; w++) {
+            CHECK(tensor_set_threads(widths[w]) == widths[w]);
+            test_operations();
+            test_expressions();
+            test_in_place();
+        }
+    }
+    CHECK(tested > 0);
+    CHECK(tensor_gemm_use_kernel(TENSOR_GEMM_AUTO) >= 0);
+    test_errors();
+    printf("ok\n");
+    return 0;
+}
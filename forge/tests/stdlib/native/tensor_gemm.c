@@ -0,0 +1,219 @@
+/* tensor_gemm in pyrite/num/tensor.c against a naive triple loop.
+ *
+ * - Every micro-kernel this CPU supports (portable, AVX2+FMA, AVX-512),
+ *   selected with tensor_gemm_use_kernel(), for each trans_a / trans_b
+ *   combination. Sizes run through the register-block edges (1 .. 17, 31,
+ *   33, ...), and one product crosses the MC, KC and NC cache blocks.
+ * - alpha and beta, including beta 0 over a C full of NaN (C is not read),
+ *   alpha 0 and k 0 (C is only scaled).
+ * - Errors: mismatched shapes, non-2-D operands, C sharing storage with A or
+ *   B, and a broadcast C fail with EINVAL and leave C alone. A zero-size
+ *   product is not an error.
+ *
+ * The operands are multiples of 1/1024, so every product and partial sum is
+ * exact and results must match the reference bit for bit, whatever order a
+ * kernel adds in. Prints "ok" and exits 0 on success.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tensor_driver.h"
+
+static uint64_t seed = 1;
+
+/* Row-major rows x cols with test data */
+static Tensor random_matrix(int64_t rows, int64_t cols) {
+    Tensor t = tensor_new(rows, cols);
+    CHECK(t.data != NULL || rows * cols == 0);
+    tensor_driver_fill(&t, &seed);
+    return t;
+}
+
+/* Element (i, j) of op(t) for a row-major t */
+static double op_at(const Tensor* t, int trans, int64_t i, int64_t j) {
+    return trans ? t->data[j * t->shape[1] + i] : t->data[i * t->shape[1] + j];
+}
+
+/* Runs one product on the current kernel and compares every element */
+static void check_product(int64_t m, int64_t n, int64_t k, int ta, int tb, double alpha, double beta) {
+    Tensor a = ta ? random_matrix(k, m) : random_matrix(m, k);
+    Tensor b = tb ? random_matrix(n, k) : random_matrix(k, n);
+    Tensor c = random_matrix(m, n);
+    if (beta == 0.0) {
+        for (int64_t i = 0; i < m * n; i++) c.data[i] = NAN;
+    }
+    double* expected = malloc((size_t)(m * n) * sizeof(double));
+    CHECK(expected != NULL);
+    for (int64_t i = 0; i < m; i++) {
+        for (int64_t j = 0; j < n; j++) {
+            double sum = 0.0;
+            for (int64_t p = 0; p < k; p++) sum += op_at(&a, ta, i, p) * op_at(&b, tb, p, j);
+            double old = beta == 0.0 ? 0.0 : beta * c.data[i * n + j];
+            expected[i * n + j] = alpha * sum + old;
+        }
+    }
+    CHECK(tensor_gemm(alpha, &a, ta, &b, tb, beta, &c) == 0);
+    for (int64_t i = 0; i < m * n; i++) {
+        if (c.data[i] != expected[i]) {
+            fprintf(stderr, "m=%ld n=%ld k=%ld trans=%d%d alpha=%g beta=%g: C[%ld] = %.17g, expected %.17g\n",
+                    (long)m, (long)n, (long)k, ta, tb, alpha, beta, (long)i, c.data[i], expected[i]);
+            exit(1);
+        }
+    }
+    free(expected);
+    tensor_drop(&a);
+    tensor_drop(&b);
+    tensor_drop(&c);
+}
+
+static const int64_t sizes[] = { 1, 2, 3, 4, 5, 7, 8, 9, 11, 12, 13, 15, 16, 17, 31, 33, 64, 97, 130 };
+#define SIZES ((int)(sizeof(sizes) / sizeof(sizes[0])))
+
+static void test_kernel(int32_t kernel) {
+    CHECK(tensor_gemm_use_kernel(kernel) == kernel);
+    static const double alphas[] = { 1.0, -0.75, 2.0 };
+    static const double betas[] = { 0.0, 1.0, 0.5, -2.0 };
+    for (int ta = 0; ta < 2; ta++) {
+        for (int tb = 0; tb < 2; tb++) {
+            /* Each size on each dimension, the other two varying */
+            for (int s = 0; s < SIZES; s++) {
+                int64_t m = sizes[s], n = sizes[(s * 7 + 3) % SIZES], k = sizes[(s * 5 + 11) % SIZES];
+                check_product(m, n, k, ta, tb, alphas[s % 3], betas[s % 4]);
+                check_product(n, k, m, ta, tb, alphas[(s + 1) % 3], betas[(s + 1) % 4]);
+                check_product(k, m, n, ta, tb, alphas[(s + 2) % 3], betas[(s + 2) % 4]);
+            }
+            /* Vectors and a product large enough to run on the thread pool */
+            check_product(1, 257, 33, ta, tb, 1.0, 0.0);
+            check_product(257, 1, 33, ta, tb, -0.75, 1.0);
+            check_product(200, 150, 170, ta, tb, 1.0, 0.5);
+        }
+    }
+    /* Crosses the MC, KC and NC blocks */
+    check_product(300, 3100, 600, kernel & 1, kernel & 1, -0.75, 0.5);
+}
+
+static void test_scaling_only(void) {
+    /* alpha 0: C = beta * C, and A and B are not read (NaN stays out) */
+    Tensor a = random_matrix(9, 7), b = random_matrix(7, 5), c = random_matrix(9, 5);
+    a.data[3] = NAN;
+    Tensor before = tensor_driver_copy(&c);
+    CHECK(tensor_gemm(0.0, &a, 0, &b, 0, 0.5, &c) == 0);
+    for (int64_t i = 0; i < 45; i++) CHECK(c.data[i] == 0.5 * before.data[i]);
+    CHECK(tensor_gemm(0.0, &a, 0, &b, 0, 1.0, &c) == 0);
+    for (int64_t i = 0; i < 45; i++) CHECK(c.data[i] == 0.5 * before.data[i]);
+    for (int64_t i = 0; i < 45; i++) c.data[i] = NAN;
+    CHECK(tensor_gemm(0.0, &a, 0, &b, 0, 0.0, &c) == 0);
+    for (int64_t i = 0; i < 45; i++) CHECK(c.data[i] == 0.0);
+
+    /* k 0: the sum over p is empty */
+    Tensor a0 = tensor_new(9, 0), b0 = tensor_new(0, 5);
+    CHECK(a0.ndim == 2 && b0.ndim == 2);
+    for (int64_t i = 0; i < 45; i++) c.data[i] = before.data[i];
+    CHECK(tensor_gemm(1.0, &a0, 0, &b0, 0, -2.0, &c) == 0);
+    for (int64_t i = 0; i < 45; i++) CHECK(c.data[i] == -2.0 * before.data[i]);
+    Tensor z = tensor_matmul(&a0, &b0);
+    CHECK(z.data != NULL && z.shape[0] == 9 && z.shape[1] == 5);
+    for (int64_t i = 0; i < 45; i++) CHECK(z.data[i] == 0.0);
+
+    Tensor tensors[] = { a, b, c, before, a0, b0, z };
+    for (size_t i = 0; i < sizeof(tensors) / sizeof(tensors[0]); i++) tensor_drop(&tensors[i]);
+}
+
+static void test_zero_size(void) {
+    Tensor a = tensor_new(0, 3), b = random_matrix(3, 5);
+    Tensor c = tensor_matmul(&a, &b);
+    CHECK(c.data == NULL && c.ndim == 2 && c.shape[0] == 0 && c.shape[1] == 5);
+    CHECK(tensor_gemm(1.0, &a, 0, &b, 0, 0.0, &c) == 0);
+    Tensor bt = tensor_new(5, 0), d = tensor_new(3, 0);
+    CHECK(tensor_gemm(1.0, &b, 0, &bt, 0, 0.0, &d) == 0);
+    Tensor tensors[] = { a, b, c, bt, d };
+    for (size_t i = 0; i < sizeof(tensors) / sizeof(tensors[0]); i++) tensor_drop(&tensors[i]);
+}
+
+/* C unchanged after a rejected call */
+static void expect_rejected(double alpha, const Tensor* a, int ta, const Tensor* b, int tb, Tensor* c) {
+    Tensor before = tensor_driver_copy(c);
+    errno = 0;
+    CHECK(tensor_gemm(alpha, a, ta, b, tb, 0.0, c) == -1 && errno == EINVAL);
+    int64_t n = tensor_numel(c);
+    for (int64_t i = 0; i < n; i++) {
+        int64_t index[2] = { i / c->shape[1], i % c->shape[1] };
+        CHECK(tensor_get_at(c, index) == before.data[i]);
+    }
+    tensor_drop(&before);
+}
+
+static void test_errors(void) {
+    Tensor a = random_matrix(4, 6), b = random_matrix(6, 5), c = random_matrix(4, 5);
+
+    /* Shapes */
+    expect_rejected(1.0, &a, 1, &b, 0, &c);
+    expect_rejected(1.0, &a, 0, &b, 1, &c);
+    Tensor wide = random_matrix(4, 6);
+    expect_rejected(1.0, &a, 0, &b, 0, &wide);
+    errno = 0;
+    Tensor bad = tensor_matmul(&a, &a);
+    CHECK(bad.data == NULL && errno == EINVAL);
+    int64_t shape3[3] = { 4, 6, 1 };
+    Tensor a3 = tensor_new_nd(3, shape3);
+    errno = 0;
+    CHECK(tensor_gemm(1.0, &a3, 0, &b, 0, 0.0, &c) == -1 && errno == EINVAL);
+    errno = 0;
+    CHECK(tensor_gemm(1.0, NULL, 0, &b, 0, 0.0, &c) == -1 && errno == EINVAL);
+
+    /* C sharing storage with an operand, directly or through a view */
+    Tensor square = random_matrix(6, 6);
+    expect_rejected(1.0, &square, 0, &square, 0, &square);
+    Tensor top = tensor_slice(&square, 0, 0, 4, 1);
+    Tensor left = tensor_slice(&top, 1, 0, 5, 1);
+    Tensor bottom = tensor_slice(&square, 0, 2, 6, 1);
+    expect_rejected(1.0, &bottom, 0, &b, 0, &left);
+    expect_rejected(1.0, &a, 0, &square, 0, &top);
+    Tensor square_t = tensor_transpose(&square);
+    expect_rejected(1.0, &square_t, 0, &b, 0, &left);
+
+    /* Broadcast C */
+    Tensor row = random_matrix(1, 5);
+    int64_t shape[2] = { 4, 5 };
+    Tensor repeated = tensor_broadcast_to(&row, 2, shape);
+    CHECK(repeated.data != NULL);
+    errno = 0;
+    CHECK(tensor_gemm(1.0, &a, 0, &b, 0, 0.0, &repeated) == -1 && errno == EINVAL);
+    for (int64_t j = 0; j < 5; j++) CHECK(!isnan(row.data[j]));
+
+    /* And a valid call still works afterwards */
+    CHECK(tensor_gemm(1.0, &a, 0, &b, 0, 0.0, &c) == 0);
+
+    Tensor tensors[] = { a, b, c, wide, a3, square, top, left, bottom, square_t, row, repeated };
+    for (size_t i = 0; i < sizeof(tensors) / sizeof(tensors[0]); i++) tensor_drop(&tensors[i]);
+}
+
+int main(void) {
+    alarm(300);
+    int tested = 0;
+    for (int32_t kernel = TENSOR_GEMM_PORTABLE; kernel <= TENSOR_GEMM_AVX512; kernel++) {
+        errno = 0;
+        if (tensor_gemm_use_kernel(kernel) == -1) {
+            CHECK(errno == EINVAL && kernel != TENSOR_GEMM_PORTABLE);
+            continue;
+        }
+        test_kernel(kernel);
+        tested++;
+    }
+    CHECK(tested > 0);
+    errno = 0;
+    CHECK(tensor_gemm_use_kernel(7) == -1 && errno == EINVAL);
+    CHECK(tensor_gemm_use_kernel(TENSOR_GEMM_AUTO) >= TENSOR_GEMM_PORTABLE);
+    test_scaling_only();
+    test_zero_size();
+    test_errors();
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,216 @@
+/* The tensor thread pool in pyrite/num/tensor.c.
+ *
+ * - At 1, 3, 4, 8 and the default (one per core) threads, elementwise
+ *   operations, transposed copies and GEMM large enough to be split into
+ *   tasks give the same elements as a serial loop.
+ * - tensor_sum and tensor_dot give bit-identical results at every thread
+ *   count, on data where the order of additions changes the rounding.
+ * - Several threads call into the pool at once while another keeps changing
+ *   the thread cap. A job posted while the pool is busy runs on its caller,
+ *   so every caller still gets its own, correct result.
+ *
+ * Usage: tensor_parallel [rounds]. Run under TSan as well. Prints "ok" and
+ * exits 0 on success.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tensor_driver.h"
+
+static long rounds = 3;
+
+static Tensor random_matrix(int64_t rows, int64_t cols, uint64_t* seed) {
+    Tensor t = tensor_new(rows, cols);
+    CHECK(t.data != NULL);
+    tensor_driver_fill(&t, seed);
+    return t;
+}
+
+/* Naive product of row-major a (m x k) and b (k x n), exact on driver data */
+static double* reference_product(const Tensor* a, const Tensor* b) {
+    int64_t m = a->shape[0], k = a->shape[1], n = b->shape[1];
+    double* c = calloc((size_t)(m * n), sizeof(double));
+    CHECK(c != NULL);
+    for (int64_t i = 0; i < m; i++) {
+        for (int64_t p = 0; p < k; p++) {
+            double x = a->data[i * k + p];
+            for (int64_t j = 0; j < n; j++) c[i * n + j] += x * b->data[p * n + j];
+        }
+    }
+    return c;
+}
+
+/* ---- Elementwise, transposes and GEMM at each width ---- */
+
+static void check_elementwise(int64_t rows, int64_t cols, uint64_t* seed) {
+    int64_t n = rows * cols;
+    Tensor a = random_matrix(rows, cols, seed), b = random_matrix(rows, cols, seed);
+    Tensor out = tensor_new(rows, cols);
+    CHECK(tensor_add(&a, &b, &out) == 0);
+    for (int64_t i = 0; i < n; i++) CHECK(out.data[i] == a.data[i] + b.data[i]);
+    CHECK(tensor_sub(&a, &b, &out) == 0);
+    for (int64_t i = 0; i < n; i++) CHECK(out.data[i] == a.data[i] - b.data[i]);
+    CHECK(tensor_mul(&a, &b, &out) == 0);
+    for (int64_t i = 0; i < n; i++) CHECK(out.data[i] == a.data[i] * b.data[i]);
+    CHECK(tensor_scale(&a, 2.5, &out) == 0);
+    for (int64_t i = 0; i < n; i++) CHECK(out.data[i] == 2.5 * a.data[i]);
+    CHECK(tensor_fill(&out, 7.0) == 0);
+    for (int64_t i = 0; i < n; i++) CHECK(out.data[i] == 7.0);
+    /* In place: out is also an input */
+    Tensor copy = tensor_driver_copy(&a);
+    CHECK(tensor_add(&a, &b, &a) == 0);
+    for (int64_t i = 0; i < n; i++) CHECK(a.data[i] == copy.data[i] + b.data[i]);
+
+    /* Transposed copy: tiles of the view written in bands */
+    Tensor view = tensor_transpose(&a);
+    Tensor t = tensor_contiguous(&view);
+    CHECK(t.data != NULL && t.data != a.data && t.shape[0] == cols && t.shape[1] == rows);
+    for (int64_t i = 0; i < rows; i++) {
+        for (int64_t j = 0; j < cols; j++) CHECK(t.data[j * rows + i] == a.data[i * cols + j]);
+    }
+    Tensor tensors[] = { a, b, out, copy, view, t };
+    for (size_t i = 0; i < sizeof(tensors) / sizeof(tensors[0]); i++) tensor_drop(&tensors[i]);
+}
+
+static void check_gemm(uint64_t* seed) {
+    /* m * n * k above the serial threshold, MC-crossing rows */
+    Tensor a = random_matrix(300, 170, seed), b = random_matrix(170, 150, seed);
+    double* expected = reference_product(&a, &b);
+    Tensor c = tensor_matmul(&a, &b);
+    CHECK(c.data != NULL);
+    CHECK(memcmp(c.data, expected, 300 * 150 * sizeof(double)) == 0);
+    /* Few rows, so the columns are split as well */
+    Tensor rows = tensor_slice(&a, 0, 0, 4, 1);
+    Tensor wide_b = random_matrix(170, 4000, seed);
+    Tensor wide = tensor_matmul(&rows, &wide_b);
+    CHECK(wide.data != NULL);
+    for (int64_t i = 0; i < 4; i++) {
+        for (int64_t j = 0; j < 4000; j++) {
+            double sum = 0.0;
+            for (int64_t p = 0; p < 170; p++) sum += a.data[i * 170 + p] * wide_b.data[p * 4000 + j];
+            CHECK(wide.data[i * 4000 + j] == sum);
+        }
+    }
+    free(expected);
+    Tensor tensors[] = { a, b, c, rows, wide_b, wide };
+    for (size_t i = 0; i < sizeof(tensors) / sizeof(tensors[0]); i++) tensor_drop(&tensors[i]);
+}
+
+/* ---- Reductions ---- */
+
+/* Magnitudes spread over many binades: any change in the order of the
+ * additions shows up in the result */
+static Tensor spread(int64_t rows, int64_t cols, uint64_t* seed) {
+    Tensor t = random_matrix(rows, cols, seed);
+    for (int64_t i = 0; i < rows * cols; i++) t.data[i] *= ldexp(1.0, (int)(i * 7 % 61) - 30) + 0.1;
+    return t;
+}
+
+/* Results at the first width, compared bit for bit at the others */
+static double first_results[4];
+
+static void check_reductions(int first) {
+    uint64_t seed = 99;
+    Tensor a = spread(1000, 1337, &seed), b = spread(1000, 1337, &seed);
+    Tensor view = tensor_transpose(&a);
+    Tensor small = tensor_slice(&a, 0, 0, 3, 1);     /* Stays serial */
+    double results[4] = { tensor_sum(&a), tensor_dot(&a, &b), tensor_sum(&view), tensor_sum(&small) };
+    for (int r = 0; r < 4; r++) {
+        if (first) first_results[r] = results[r];
+        CHECK(memcmp(&first_results[r], &results[r], sizeof(double)) == 0);
+    }
+    /* Any fixed order of additions will do, as long as it is a sum */
+    double plain = 0.0;
+    for (int64_t i = 0; i < 1000 * 1337; i++) plain += a.data[i];
+    CHECK(fabs(results[0] - plain) <= 1e-9 * fabs(plain) + 1e-6);
+    Tensor tensors[] = { a, b, view, small };
+    for (size_t i = 0; i < sizeof(tensors) / sizeof(tensors[0]); i++) tensor_drop(&tensors[i]);
+}
+
+/* ---- Concurrent callers ---- */
+
+#define CALLERS 3
+
+static int stop_toggling = 0;
+
+static void* caller(void* arg) {
+    uint64_t seed = 1000 + (uint64_t)(uintptr_t)arg;
+    for (long r = 0; r < rounds; r++) {
+        check_elementwise(300, 301, &seed);
+        Tensor a = random_matrix(150, 200, &seed), b = random_matrix(200, 140, &seed);
+        double* expected = reference_product(&a, &b);
+        Tensor c = tensor_matmul(&a, &b);
+        CHECK(c.data != NULL);
+        CHECK(memcmp(c.data, expected, 150 * 140 * sizeof(double)) == 0);
+        free(expected);
+        double total = 0.0;
+        for (int64_t i = 0; i < 150 * 140; i++) total += c.data[i];
+        CHECK(fabs(tensor_sum(&c) - total) <= 1e-9 * fabs(total) + 1e-6);
+        tensor_drop(&a);
+        tensor_drop(&b);
+        tensor_drop(&c);
+    }
+    return NULL;
+}
+
+static void* toggler(void* arg) {
+    (void)arg;
+    static const int32_t widths[] = { 1, 4, 0, 3, 2 };
+    for (int i = 0; !__atomic_load_n(&stop_toggling, __ATOMIC_RELAXED); i++) {
+        CHECK(tensor_set_threads(widths[i % 5]) > 0);
+        usleep(500);
+    }
+    return NULL;
+}
+
+static void test_concurrent_callers(int toggle) {
+    pthread_t threads[CALLERS], changer;
+    __atomic_store_n(&stop_toggling, 0, __ATOMIC_RELAXED);
+    if (toggle) CHECK(pthread_create(&changer, NULL, toggler, NULL) == 0);
+    for (int t = 0; t < CALLERS; t++) {
+        CHECK(pthread_create(&threads[t], NULL, caller, (void*)(uintptr_t)t) == 0);
+    }
+    caller((void*)(uintptr_t)CALLERS);
+    for (int t = 0; t < CALLERS; t++) CHECK(pthread_join(threads[t], NULL) == 0);
+    if (toggle) {
+        __atomic_store_n(&stop_toggling, 1, __ATOMIC_RELAXED);
+        CHECK(pthread_join(changer, NULL) == 0);
+    }
+}
+
+int main(int argc, char** argv) {
+    alarm(300);
+    if (argc > 1) rounds = atol(argv[1]);
+    CHECK(rounds > 0);
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    CHECK(tensor_set_threads(0) == (cpus > 64 ? 64 : cpus));
+    errno = 0;
+    CHECK(tensor_set_threads(-1) == -1 && errno == EINVAL);
+    CHECK(tensor_set_threads(1000) == 64 && tensor_threads() == 64);
+
+    static const int32_t widths[] = { 1, 3, 4, 8, 0 };
+    for (int w = 0; w < 5; w++) {
+        int32_t width = tensor_set_threads(widths[w]);
+        CHECK(width == tensor_threads() && width >= 1);
+        uint64_t seed = 7;
+        check_elementwise(1000, 1000, &seed);
+        check_elementwise(70000, 3, &seed);
+        check_elementwise(3, 70000, &seed);
+        check_gemm(&seed);
+        check_reductions(w == 0);
+        test_concurrent_callers(0);
+    }
+    test_concurrent_callers(1);
+    CHECK(tensor_set_threads(0) > 0);
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,310 @@
+/* Tensor storage allocation and the buffer pool in pyrite/num/tensor.c.
+ *
+ * - Element buffers start on 64 bytes, and on a page from 256 KiB.
+ * - A dropped buffer is reused by the next tensor of its size class (four
+ *   per doubling), most recently dropped first, never while a view still
+ *   holds it. tensor_new() zero-fills a reused buffer; tensor_new_uninit()
+ *   does not, and operations that write a fresh output never leak the old
+ *   contents.
+ * - tensor_pool_trim() returns the class bytes it frees. tensor_set_pool_limit()
+ *   caps the pool, frees what is over a lowered cap, and 0 turns it off.
+ * - Threads creating and dropping tensors at once, some of them dropped on
+ *   another thread than the one that made them. Run under TSan as well.
+ *
+ * Usage: tensor_pool [iterations per thread]. Prints "ok" and exits 0 on
+ * success.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tensor_driver.h"
+
+#define PAGE_MIN (256 * 1024)
+
+static long iterations = 20000;
+
+/* Bytes of the smallest class holding bytes: (4 + c % 4) << (c / 4 + 4) */
+static int64_t class_bytes(int64_t bytes) {
+    for (int c = 0;; c++) {
+        int64_t size = (int64_t)(4 + c % 4) << (c / 4 + 4);
+        if (size >= bytes) return size;
+    }
+}
+
+static Tensor vector(int64_t n, int zero) {
+    int64_t shape[1] = { n };
+    Tensor t = zero ? tensor_new_nd(1, shape) : tensor_new_uninit(1, shape);
+    CHECK(t.data != NULL);
+    return t;
+}
+
+static void poison(Tensor* t) {
+    int64_t n = tensor_numel(t);
+    for (int64_t i = 0; i < n; i++) t->data[i] = NAN;
+}
+
+/* ---- Alignment ---- */
+
+static void test_alignment(void) {
+    static const int64_t counts[] = { 1, 3, 8, 9, 100, 1000, 4095, 32767, 32768, 40000, 100000, 1 << 20 };
+    for (int pass = 0; pass < 2; pass++) {
+        for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+            Tensor t = vector(counts[i], pass == 0);
+            uintptr_t p = (uintptr_t)t.data;
+            CHECK(p % 64 == 0);
+            if (counts[i] * 8 >= PAGE_MIN) CHECK(p % 4096 == 0);
+            /* Every element is usable */
+            t.data[0] = 1.0;
+            t.data[counts[i] - 1] = 2.0;
+            tensor_drop(&t);
+        }
+        /* The second pass takes the same buffers from the pool */
+    }
+    int64_t shape[3] = { 3, 5, 7 };
+    Tensor t = tensor_new_nd(3, shape);
+    CHECK((uintptr_t)t.data % 64 == 0);
+    tensor_drop(&t);
+    CHECK(tensor_pool_trim() > 0);
+}
+
+/* ---- Reuse ---- */
+
+static void test_reuse(void) {
+    CHECK(tensor_pool_trim() == 0);
+
+    /* The same class: 10000 and 9999 elements */
+    Tensor a = tensor_new(100, 100);
+    double* first = a.data;
+    poison(&a);
+    tensor_drop(&a);
+    Tensor b = tensor_new(99, 101);
+    CHECK(b.data == first);
+    for (int64_t i = 0; i < 9999; i++) CHECK(b.data[i] == 0.0);
+    poison(&b);
+    tensor_drop(&b);
+    int64_t shape[2] = { 100, 100 };
+    Tensor u = tensor_new_uninit(2, shape);
+    CHECK(u.data == first && isnan(u.data[5]));      /* Not zeroed */
+    tensor_drop(&u);
+
+    /* Another class does not take it */
+    Tensor other = tensor_new(100, 200);
+    CHECK(other.data != first);
+    tensor_drop(&other);
+
+    /* Most recently dropped first */
+    Tensor x = vector(500, 1), y = vector(500, 1);
+    double* px = x.data;
+    double* py = y.data;
+    tensor_drop(&x);
+    tensor_drop(&y);
+    Tensor p1 = vector(490, 1), p2 = vector(510, 1);
+    CHECK(p1.data == py && p2.data == px);
+    tensor_drop(&p1);
+    tensor_drop(&p2);
+
+    /* A view keeps its buffer out of the pool */
+    Tensor base = vector(2000, 1);
+    double* held = base.data;
+    Tensor view = tensor_slice(&base, 0, 10, 20, 1);
+    tensor_drop(&base);
+    Tensor next = vector(2000, 1);
+    CHECK(next.data != held);
+    view.data[0] = 5.0;
+    CHECK(held[10] == 5.0);
+    tensor_drop(&view);
+    Tensor again = vector(2000, 1);
+    CHECK(again.data == held);
+    CHECK(again.data[10] == 0.0);
+    tensor_drop(&next);
+    tensor_drop(&again);
+
+    /* The storage header is reused with the buffer */
+    Tensor h = vector(64, 1);
+    void* header = h.storage;
+    tensor_drop(&h);
+    h = vector(64, 1);
+    CHECK(h.storage == header);
+    tensor_drop(&h);
+
+    /* Zero-size tensors take nothing; 0-D ones take the smallest class */
+    int64_t zero[2] = { 0, 5 };
+    Tensor e = tensor_new_uninit(2, zero);
+    CHECK(e.data == NULL && e.storage == NULL && e.ndim == 2 && e.shape[1] == 5);
+    tensor_drop(&e);
+    Tensor s = tensor_new_nd(0, NULL);
+    CHECK(s.data != NULL && s.data[0] == 0.0);
+    tensor_drop(&s);
+    tensor_pool_trim();
+}
+
+/* Outputs built on uninitialized buffers never show what was there */
+static void test_fresh_outputs(void) {
+    Tensor x = tensor_new(60, 70), y = tensor_new(70, 60);
+    uint64_t seed = 3;
+    tensor_driver_fill(&x, &seed);
+    tensor_driver_fill(&y, &seed);
+    for (int round = 0; round < 3; round++) {
+        /* Fill the pool with NaN buffers of every size used below */
+        static const int64_t counts[] = { 3600, 4200, 60 * 70, 1, 70 };
+        Tensor junk[5];
+        for (int j = 0; j < 5; j++) {
+            junk[j] = vector(counts[j], 0);
+            poison(&junk[j]);
+        }
+        for (int j = 0; j < 5; j++) tensor_drop(&junk[j]);
+
+        Tensor c = tensor_matmul(&x, &y);
+        Tensor xt = tensor_transpose(&x);
+        Tensor xc = tensor_contiguous(&xt);
+        int64_t flat[1] = { -1 };
+        Tensor r = tensor_reshape(&xt, 1, flat);
+        void* e = tensor_expr_new();
+        Tensor expr = tensor_expr_eval_new(e, tensor_expr_binary(e, TENSOR_EXPR_ADD, tensor_expr_input(e, &x),
+                                                                 tensor_expr_const(e, 1.0)));
+        tensor_expr_free(e);
+        Tensor outputs[] = { c, xc, r, expr };
+        for (int o = 0; o < 4; o++) {
+            int64_t n = tensor_numel(&outputs[o]);
+            CHECK(n > 0);
+            for (int64_t i = 0; i < n; i++) CHECK(!isnan(outputs[o].data[i]));
+        }
+        double ref = 0.0;
+        for (int64_t p = 0; p < 70; p++) ref += x.data[3 * 70 + p] * y.data[p * 60 + 4];
+        CHECK(c.data[3 * 60 + 4] == ref);
+        CHECK(xc.data[2 * 60 + 1] == x.data[1 * 70 + 2]);
+        for (int o = 0; o < 4; o++) tensor_drop(&outputs[o]);
+        tensor_drop(&xt);
+    }
+    tensor_drop(&x);
+    tensor_drop(&y);
+}
+
+/* ---- Limits ---- */
+
+static void test_limits(void) {
+    CHECK(tensor_pool_trim() >= 0);
+    CHECK(tensor_pool_trim() == 0);
+
+    /* trim() reports class bytes */
+    static const int64_t counts[] = { 1, 9, 100, 1000, 12345 };
+    for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+        Tensor t = vector(counts[i], 1);
+        tensor_drop(&t);
+        CHECK(tensor_pool_trim() == class_bytes(counts[i] * 8));
+    }
+    CHECK(class_bytes(800) == 896);
+
+    errno = 0;
+    CHECK(tensor_set_pool_limit(-1) == -1 && errno == EINVAL);
+
+    /* Off */
+    CHECK(tensor_set_pool_limit(0) == 0);
+    Tensor z = tensor_new(10, 10);
+    tensor_drop(&z);
+    CHECK(tensor_pool_trim() == 0);
+
+    /* A buffer larger than the cap goes straight back */
+    CHECK(tensor_set_pool_limit(1 << 20) == 1 << 20);
+    Tensor big = tensor_new(1000, 1000);
+    tensor_drop(&big);
+    CHECK(tensor_pool_trim() == 0);
+
+    /* Lowering the cap frees what is over it now, largest first */
+    Tensor keep[4] = { vector(16, 1), vector(1000, 1), vector(20000, 1), vector(60000, 1) };
+    for (int i = 0; i < 4; i++) tensor_drop(&keep[i]);
+    int64_t small = class_bytes(16 * 8) + class_bytes(1000 * 8);
+    CHECK(tensor_set_pool_limit(small) == small);
+    CHECK(tensor_pool_trim() == small);
+
+    /* Past the cap, a drop frees instead of pooling */
+    CHECK(tensor_set_pool_limit(class_bytes(8000)) == class_bytes(8000));
+    Tensor first = vector(1000, 1), second = vector(1000, 1);
+    tensor_drop(&first);
+    tensor_drop(&second);
+    CHECK(tensor_pool_trim() == class_bytes(8000));
+
+    CHECK(tensor_set_pool_limit((int64_t)256 << 20) == (int64_t)256 << 20);
+}
+
+/* ---- Threads ---- */
+
+#define THREADS 4
+#define HANDOFF 64
+
+/* Tensors made by one thread and dropped by the next */
+static Tensor handoff[THREADS][HANDOFF];
+static int handoff_ready[THREADS][HANDOFF];
+
+static void* churn(void* arg) {
+    int id = (int)(intptr_t)arg;
+    uint64_t state = (uint64_t)id * 7919 + 1;
+    for (long i = 0; i < iterations; i++) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        int64_t n = 1 + (int64_t)((state >> 33) % 3000);
+        Tensor t = vector(n, (i & 1) == 0);
+        CHECK((uintptr_t)t.data % 64 == 0);
+        if ((i & 1) == 0) {
+            for (int64_t j = 0; j < n; j++) CHECK(t.data[j] == 0.0);
+        }
+        for (int64_t j = 0; j < n; j++) t.data[j] = (double)id;
+        for (int64_t j = 0; j < n; j++) CHECK(t.data[j] == (double)id);
+
+        /* Every 16th goes to the next thread; take one from the previous */
+        int slot = (int)((i / 16) % HANDOFF);
+        if (i % 16 == 0 && !__atomic_load_n(&handoff_ready[id][slot], __ATOMIC_ACQUIRE)) {
+            handoff[id][slot] = t;
+            __atomic_store_n(&handoff_ready[id][slot], 1, __ATOMIC_RELEASE);
+        } else {
+            tensor_drop(&t);
+        }
+        int from = (id + THREADS - 1) % THREADS;
+        if (__atomic_load_n(&handoff_ready[from][slot], __ATOMIC_ACQUIRE)) {
+            Tensor given = handoff[from][slot];
+            CHECK(given.data[0] == (double)from);
+            tensor_drop(&given);
+            __atomic_store_n(&handoff_ready[from][slot], 0, __ATOMIC_RELEASE);
+        }
+    }
+    return NULL;
+}
+
+static void test_threads(void) {
+    pthread_t threads[THREADS];
+    for (int t = 0; t < THREADS; t++) CHECK(pthread_create(&threads[t], NULL, churn, (void*)(intptr_t)t) == 0);
+    /* Move the cap under them */
+    for (int k = 0; k < 20; k++) {
+        CHECK(tensor_set_pool_limit(k % 2 ? 0 : (int64_t)1 << 20) >= 0);
+        usleep(1000);
+    }
+    CHECK(tensor_set_pool_limit((int64_t)256 << 20) > 0);
+    for (int t = 0; t < THREADS; t++) CHECK(pthread_join(threads[t], NULL) == 0);
+    for (int t = 0; t < THREADS; t++) {
+        for (int s = 0; s < HANDOFF; s++) {
+            if (handoff_ready[t][s]) tensor_drop(&handoff[t][s]);
+        }
+    }
+    CHECK(tensor_pool_trim() >= 0);
+    CHECK(tensor_pool_trim() == 0);
+}
+
+int main(int argc, char** argv) {
+    alarm(120);
+    if (argc > 1) iterations = atol(argv[1]);
+    CHECK(iterations > 0);
+    test_alignment();
+    test_reuse();
+    test_fresh_outputs();
+    test_limits();
+    test_threads();
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,581 @@
+/* Strided views in pyrite/num/tensor.c.
+ *
+ * - slice (with steps, and of slices), select, permute, transpose,
+ *   broadcast_to and reshape (-1 inferred) see the elements a reference
+ *   index mapping says they should. contiguous() copies them out in
+ *   row-major order, and writes through a view land in the base tensor.
+ * - Elementwise ops, assign, reductions and GEMM take strided, transposed
+ *   and broadcast operands, and write strided or transposed outputs.
+ * - Aliasing is refused: a broadcast view as an output, and a GEMM C that
+ *   shares storage with A or B, fail with EINVAL and change nothing.
+ * - Views hold a reference to the storage. The buffer pool is turned off,
+ *   so under ASan a view that outlived its storage, or storage that was
+ *   never released, is reported.
+ *
+ * Prints "ok" and exits 0 on success.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tensor_driver.h"
+
+/* Element (i, j, k) of the 4 x 5 x 6 base tensor */
+static double base_value(int64_t i, int64_t j, int64_t k) {
+    return (double)(i * 10000 + j * 100 + k);
+}
+
+static Tensor base_tensor(void) {
+    int64_t shape[3] = { 4, 5, 6 };
+    Tensor t = tensor_new_nd(3, shape);
+    CHECK(t.data != NULL && tensor_is_contiguous(&t) && tensor_numel(&t) == 120);
+    for (int64_t i = 0; i < 4; i++) {
+        for (int64_t j = 0; j < 5; j++) {
+            for (int64_t k = 0; k < 6; k++) t.data[(i * 5 + j) * 6 + k] = base_value(i, j, k);
+        }
+    }
+    return t;
+}
+
+/* Steps index through shape in row-major order; 0 after the last one */
+static int next_index(int64_t* index, int32_t ndim, const int64_t* shape) {
+    for (int32_t d = ndim - 1; d >= 0; d--) {
+        if (++index[d] < shape[d]) return 1;
+        index[d] = 0;
+    }
+    return 0;
+}
+
+/* The view's element at index must be expected(index); its contiguous
+ * copy must hold the same values in row-major order */
+typedef double (*Expected)(const int64_t* index);
+
+static void check_view(const Tensor* view, int32_t ndim, const int64_t* shape, Expected expected) {
+    CHECK(view->ndim == ndim);
+    for (int32_t d = 0; d < ndim; d++) CHECK(view->shape[d] == shape[d]);
+    Tensor copy = tensor_contiguous(view);
+    CHECK(tensor_is_contiguous(&copy));
+    int64_t n = tensor_numel(view);
+    CHECK(tensor_numel(&copy) == n);
+    if (n == 0) {
+        tensor_drop(&copy);
+        return;
+    }
+    int64_t index[TENSOR_MAX_DIMS] = { 0 };
+    int64_t e = 0;
+    do {
+        double want = expected(index);
+        CHECK(tensor_get_at(view, index) == want);
+        CHECK(copy.data[e] == want);
+        e++;
+    } while (next_index(index, ndim, shape));
+    CHECK(e == n);
+    tensor_drop(&copy);
+}
+
+/* ---- View construction ---- */
+
+static double stepped(const int64_t* x) { return base_value(x[0] + 1, x[1], 1 + 2 * x[2]); }
+static double stepped_twice(const int64_t* x) { return base_value(x[0] + 1, 3 * x[1], 3 + 2 * x[2]); }
+static double row_three(const int64_t* x) { return base_value(3, x[0], x[1]); }
+static double column(const int64_t* x) { return base_value(x[0], 2, 5); }
+static double permuted(const int64_t* x) { return base_value(x[1], x[2], x[0]); }
+static double swapped(const int64_t* x) { return base_value(x[0], x[2], x[1]); }
+static double flat(const int64_t* x) { return base_value(x[0] / 5, x[0] % 5, x[1]); }
+
+static void test_slice_select(void) {
+    Tensor t = base_tensor();
+
+    /* Rows 1..3, every column, planes 1, 3, 5 */
+    Tensor s = tensor_slice(&t, 2, 1, 6, 2);
+    Tensor s2 = tensor_slice(&s, 0, 1, 4, 1);
+    int64_t s2_shape[3] = { 3, 5, 3 };
+    check_view(&s2, 3, s2_shape, stepped);
+    CHECK(!tensor_is_contiguous(&s2));
+
+    /* A slice of a slice: steps multiply, starts add */
+    Tensor s3 = tensor_slice(&s2, 1, 0, 5, 3);
+    Tensor s4 = tensor_slice(&s3, 2, 1, 3, 1);
+    int64_t s4_shape[3] = { 3, 2, 2 };
+    check_view(&s4, 3, s4_shape, stepped_twice);
+
+    Tensor row = tensor_select(&t, 0, 3);
+    int64_t row_shape[2] = { 5, 6 };
+    check_view(&row, 2, row_shape, row_three);
+    CHECK(tensor_is_contiguous(&row));
+    Tensor plane = tensor_select(&t, 1, 2);
+    Tensor col = tensor_select(&plane, 1, 5);
+    int64_t col_shape[1] = { 4 };
+    check_view(&col, 1, col_shape, column);
+
+    /* An empty slice keeps its rank */
+    Tensor empty = tensor_slice(&t, 1, 2, 2, 1);
+    CHECK(empty.ndim == 3 && empty.shape[1] == 0 && tensor_numel(&empty) == 0);
+    CHECK(tensor_sum(&empty) == 0.0);
+
+    /* Writes through a view land in the base tensor */
+    int64_t at[3] = { 2, 4, 1 };
+    tensor_set_at(&s2, at, -1.0);
+    CHECK(t.data[(3 * 5 + 4) * 6 + 3] == -1.0);
+    CHECK(tensor_fill(&col, -2.0) == 0);
+    for (int64_t i = 0; i < 4; i++) CHECK(t.data[(i * 5 + 2) * 6 + 5] == -2.0);
+    CHECK(tensor_sum(&col) == -8.0);
+
+    /* Bad bounds, steps and axes */
+    struct { int32_t axis; int64_t start, stop, step; } bad[] = {
+        { 3, 0, 1, 1 }, { -1, 0, 1, 1 }, { 0, 0, 5, 1 }, { 0, 3, 2, 1 }, { 0, -1, 2, 1 }, { 0, 0, 2, 0 },
+    };
+    for (size_t b = 0; b < sizeof(bad) / sizeof(bad[0]); b++) {
+        errno = 0;
+        Tensor v = tensor_slice(&t, bad[b].axis, bad[b].start, bad[b].stop, bad[b].step);
+        CHECK(v.data == NULL && v.storage == NULL && errno == EINVAL);
+    }
+    errno = 0;
+    Tensor v = tensor_select(&t, 0, 4);
+    CHECK(v.data == NULL && errno == EINVAL);
+
+    Tensor tensors[] = { t, s, s2, s3, s4, row, plane, col, empty };
+    for (size_t i = 0; i < sizeof(tensors) / sizeof(tensors[0]); i++) tensor_drop(&tensors[i]);
+}
+
+static void test_permute_transpose(void) {
+    Tensor t = base_tensor();
+    int32_t axes[3] = { 2, 0, 1 };
+    Tensor p = tensor_permute(&t, axes);
+    int64_t p_shape[3] = { 6, 4, 5 };
+    check_view(&p, 3, p_shape, permuted);
+    CHECK(!tensor_is_contiguous(&p) && p.data == t.data);
+
+    Tensor tr = tensor_transpose(&t);
+    int64_t tr_shape[3] = { 4, 6, 5 };
+    check_view(&tr, 3, tr_shape, swapped);
+
+    /* Transposing twice gives back a contiguous view of the same data */
+    Tensor back = tensor_transpose(&tr);
+    CHECK(tensor_is_contiguous(&back) && back.data == t.data);
+
+    int32_t repeated[3] = { 0, 0, 1 };
+    int32_t outside[3] = { 0, 1, 3 };
+    errno = 0;
+    Tensor bad = tensor_permute(&t, repeated);
+    CHECK(bad.data == NULL && errno == EINVAL);
+    errno = 0;
+    bad = tensor_permute(&t, outside);
+    CHECK(bad.data == NULL && errno == EINVAL);
+
+    /* contiguous() of transposed matrices whose sides are not multiples of
+     * the copy tile */
+    static const int64_t sides[][2] = { { 1, 1 }, { 1, 77 }, { 33, 31 }, { 70, 129 }, { 300, 2 } };
+    for (size_t s = 0; s < sizeof(sides) / sizeof(sides[0]); s++) {
+        int64_t rows = sides[s][0], cols = sides[s][1];
+        Tensor m = tensor_new(rows, cols);
+        for (int64_t e = 0; e < rows * cols; e++) m.data[e] = (double)e;
+        Tensor mt = tensor_transpose(&m);
+        Tensor c = tensor_contiguous(&mt);
+        CHECK(c.shape[0] == cols && c.shape[1] == rows);
+        for (int64_t i = 0; i < rows; i++) {
+            for (int64_t j = 0; j < cols; j++) CHECK(c.data[j * rows + i] == m.data[i * cols + j]);
+        }
+        tensor_drop(&m);
+        tensor_drop(&mt);
+        tensor_drop(&c);
+    }
+
+    Tensor tensors[] = { t, p, tr, back };
+    for (size_t i = 0; i < sizeof(tensors) / sizeof(tensors[0]); i++) tensor_drop(&tensors[i]);
+}
+
+static double broadcast_row(const int64_t* x) { return (double)(x[2] * 1000); }
+
+static void test_broadcast(void) {
+    int64_t vshape[1] = { 6 };
+    Tensor v = tensor_new_nd(1, vshape);
+    for (int64_t k = 0; k < 6; k++) v.data[k] = (double)(k * 1000);
+    int64_t shape[3] = { 4, 5, 6 };
+    Tensor b = tensor_broadcast_to(&v, 3, shape);
+    CHECK(b.strides[0] == 0 && b.strides[1] == 0 && b.strides[2] == 1);
+    check_view(&b, 3, shape, broadcast_row);
+    CHECK(tensor_sum(&b) == 20.0 * 15000.0);
+
+    /* Size-1 dimensions repeat too */
+    int64_t cshape[2] = { 4, 1 };
+    Tensor c = tensor_new_nd(2, cshape);
+    for (int64_t i = 0; i < 4; i++) c.data[i] = (double)i;
+    int64_t wide[2] = { 4, 7 };
+    Tensor cb = tensor_broadcast_to(&c, 2, wide);
+    CHECK(cb.strides[1] == 0);
+    for (int64_t i = 0; i < 4; i++) {
+        for (int64_t j = 0; j < 7; j++) CHECK(tensor_get(&cb, i, j) == (double)i);
+    }
+
+    int64_t mismatched[2] = { 4, 5 };
+    errno = 0;
+    Tensor bad = tensor_broadcast_to(&v, 2, mismatched);
+    CHECK(bad.data == NULL && errno == EINVAL);
+    errno = 0;
+    bad = tensor_broadcast_to(&b, 2, mismatched);   /* Fewer dimensions */
+    CHECK(bad.data == NULL && errno == EINVAL);
+
+    /* Implicit broadcasting in elementwise ops: v and c against a matrix */
+    Tensor t = base_tensor();
+    Tensor sum = tensor_new_nd(3, shape);
+    CHECK(tensor_add(&t, &v, &sum) == 0);
+    for (int64_t e = 0; e < 120; e++) CHECK(sum.data[e] == t.data[e] + (double)((e % 6) * 1000));
+    Tensor m = tensor_new(4, 7);
+    Tensor row7 = tensor_new(1, 7);
+    for (int64_t j = 0; j < 7; j++) row7.data[j] = (double)(j + 1);
+    CHECK(tensor_mul(&c, &row7, &m) == 0);
+    for (int64_t i = 0; i < 4; i++) {
+        for (int64_t j = 0; j < 7; j++) CHECK(m.data[i * 7 + j] == (double)(i * (j + 1)));
+    }
+    errno = 0;
+    CHECK(tensor_add(&t, &row7, &sum) == -1 && errno == EINVAL);
+
+    Tensor tensors[] = { v, b, c, cb, t, sum, m, row7 };
+    for (size_t i = 0; i < sizeof(tensors) / sizeof(tensors[0]); i++) tensor_drop(&tensors[i]);
+}
+
+static void test_reshape(void) {
+    Tensor t = base_tensor();
+
+    /* Contiguous data: a view */
+    int64_t flat_shape[2] = { -1, 6 };
+    Tensor r = tensor_reshape(&t, 2, flat_shape);
+    int64_t r_shape[2] = { 20, 6 };
+    check_view(&r, 2, r_shape, flat);
+    CHECK(r.data == t.data);
+    int64_t one[1] = { -1 };
+    Tensor line = tensor_reshape(&t, 1, one);
+    CHECK(line.ndim == 1 && line.shape[0] == 120 && line.data == t.data);
+
+    /* A permuted view: a row-major copy of its elements */
+    int32_t axes[3] = { 2, 0, 1 };
+    Tensor p = tensor_permute(&t, axes);
+    int64_t p_flat[2] = { 6, -1 };
+    Tensor rp = tensor_reshape(&p, 2, p_flat);
+    CHECK(rp.data != t.data && rp.shape[0] == 6 && rp.shape[1] == 20);
+    for (int64_t k = 0; k < 6; k++) {
+        for (int64_t e = 0; e < 20; e++) CHECK(tensor_get(&rp, k, e) == base_value(e / 5, e % 5, k));
+    }
+    /* The copy does not write through */
+    tensor_set(&rp, 0, 0, -5.0);
+    CHECK(t.data[0] == 0.0);
+
+    /* A 0-D tensor from one element */
+    Tensor single = tensor_slice(&line, 0, 7, 8, 1);
+    Tensor scalar = tensor_reshape(&single, 0, NULL);
+    CHECK(scalar.ndim == 0 && tensor_numel(&scalar) == 1 && tensor_get_at(&scalar, NULL) == base_value(0, 1, 1));
+
+    int64_t bad_shapes[][2] = { { 7, -1 }, { -1, -1 }, { 0, -1 }, { 6, 21 }, { -2, 60 } };
+    for (size_t b = 0; b < sizeof(bad_shapes) / sizeof(bad_shapes[0]); b++) {
+        errno = 0;
+        Tensor bad = tensor_reshape(&t, 2, bad_shapes[b]);
+        CHECK(bad.data == NULL && bad.storage == NULL && errno == EINVAL);
+    }
+
+    Tensor tensors[] = { t, r, line, p, rp, single, scalar };
+    for (size_t i = 0; i < sizeof(tensors) / sizeof(tensors[0]); i++) tensor_drop(&tensors[i]);
+}
+
+/* ---- Operations on views ---- */
+
+static void test_assign(void) {
+    int64_t shape[3] = { 4, 5, 6 };
+    Tensor dst = tensor_new_nd(3, shape);
+    Tensor t = base_tensor();
+
+    /* Broadcast source into a stepped slice */
+    Tensor block = tensor_slice(&dst, 1, 1, 5, 2);   /* j = 1, 3 */
+    int64_t vshape[1] = { 6 };
+    Tensor v = tensor_new_nd(1, vshape);
+    for (int64_t k = 0; k < 6; k++) v.data[k] = (double)(k + 1);
+    CHECK(tensor_assign(&block, &v) == 0);
+    for (int64_t i = 0; i < 4; i++) {
+        for (int64_t j = 0; j < 5; j++) {
+            for (int64_t k = 0; k < 6; k++) {
+                double want = (j == 1 || j == 3) ? (double)(k + 1) : 0.0;
+                CHECK(dst.data[(i * 5 + j) * 6 + k] == want);
+            }
+        }
+    }
+
+    /* A permuted source into a permuted destination */
+    int32_t axes[3] = { 2, 0, 1 };
+    Tensor from = tensor_permute(&t, axes);
+    Tensor into = tensor_permute(&dst, axes);
+    CHECK(tensor_assign(&into, &from) == 0);
+    for (int64_t e = 0; e < 120; e++) CHECK(dst.data[e] == t.data[e]);
+
+    /* A transposed source into a contiguous destination */
+    Tensor m = tensor_new(3, 7), out = tensor_new(7, 3);
+    for (int64_t e = 0; e < 21; e++) m.data[e] = (double)e;
+    Tensor mt = tensor_transpose(&m);
+    CHECK(tensor_assign(&out, &mt) == 0);
+    for (int64_t i = 0; i < 7; i++) {
+        for (int64_t j = 0; j < 3; j++) CHECK(out.data[i * 3 + j] == (double)(j * 7 + i));
+    }
+
+    errno = 0;
+    CHECK(tensor_assign(&out, &m) == -1 && errno == EINVAL);
+
+    Tensor tensors[] = { dst, t, block, v, from, into, m, out, mt };
+    for (size_t i = 0; i < sizeof(tensors) / sizeof(tensors[0]); i++) tensor_drop(&tensors[i]);
+}
+
+static void test_elementwise_on_views(void) {
+    /* Large enough to be split into tasks */
+    Tensor a = tensor_new(400, 300), b = tensor_new(300, 400);
+    uint64_t seed = 5;
+    tensor_driver_fill(&a, &seed);
+    tensor_driver_fill(&b, &seed);
+    Tensor bt = tensor_transpose(&b);              /* 400 x 300, strided */
+    Tensor ac = tensor_driver_copy(&a), btc = tensor_driver_copy(&bt);
+    Tensor out = tensor_new(400, 300), expect = tensor_new(400, 300);
+    CHECK(tensor_add(&a, &bt, &out) == 0);
+    CHECK(tensor_add(&ac, &btc, &expect) == 0);
+    CHECK(memcmp(out.data, expect.data, 400 * 300 * sizeof(double)) == 0);
+    CHECK(tensor_dot(&a, &bt) == tensor_dot(&ac, &btc));
+    CHECK(tensor_sum(&bt) == tensor_sum(&btc));
+
+    /* Every other row and column, written into a transposed output */
+    Tensor sa = tensor_slice(&a, 0, 0, 400, 2);
+    Tensor sa2 = tensor_slice(&sa, 1, 1, 300, 2);   /* 200 x 150 */
+    Tensor sb = tensor_slice(&bt, 0, 1, 400, 2);
+    Tensor sb2 = tensor_slice(&sb, 1, 0, 300, 2);
+    Tensor o = tensor_new(150, 200);
+    Tensor ot = tensor_transpose(&o);
+    CHECK(tensor_mul(&sa2, &sb2, &ot) == 0);
+    for (int64_t i = 0; i < 200; i++) {
+        for (int64_t j = 0; j < 150; j++) {
+            double want = a.data[(2 * i) * 300 + 2 * j + 1] * b.data[(2 * j) * 400 + 2 * i + 1];
+            CHECK(o.data[j * 200 + i] == want);
+        }
+    }
+
+    Tensor tensors[] = { a, b, bt, ac, btc, out, expect, sa, sa2, sb, sb2, o, ot };
+    for (size_t i = 0; i < sizeof(tensors) / sizeof(tensors[0]); i++) tensor_drop(&tensors[i]);
+}
+
+/* Naive product of two 2-D views into a row-major m x n array */
+static double* reference_product(const Tensor* a, const Tensor* b) {
+    int64_t m = a->shape[0], k = a->shape[1], n = b->shape[1];
+    double* c = calloc((size_t)(m * n), sizeof(double));
+    CHECK(c != NULL);
+    for (int64_t i = 0; i < m; i++) {
+        for (int64_t j = 0; j < n; j++) {
+            double sum = 0.0;
+            for (int64_t p = 0; p < k; p++) sum += tensor_get((Tensor*)a, i, p) * tensor_get((Tensor*)b, p, j);
+            c[i * n + j] = sum;
+        }
+    }
+    return c;
+}
+
+static void check_matrix(Tensor* c, const double* expected, double scale) {
+    for (int64_t i = 0; i < c->shape[0]; i++) {
+        for (int64_t j = 0; j < c->shape[1]; j++) {
+            CHECK(tensor_get(c, i, j) == scale * expected[i * c->shape[1] + j]);
+        }
+    }
+}
+
+static void test_gemm_on_views(void) {
+    uint64_t seed = 11;
+    Tensor big_a = tensor_new(150, 140), big_b = tensor_new(120, 130);
+    tensor_driver_fill(&big_a, &seed);
+    tensor_driver_fill(&big_b, &seed);
+
+    /* A: every other row, columns 3 .. 122 (75 x 120, row stride 280);
+     * B: every other column (120 x 65, column stride 2) */
+    Tensor ar = tensor_slice(&big_a, 0, 0, 150, 2);
+    Tensor a120 = tensor_slice(&ar, 1, 3, 123, 1);
+    Tensor bk = tensor_slice(&big_b, 1, 0, 130, 2);
+    CHECK(a120.shape[0] == 75 && a120.shape[1] == 120 && bk.shape[0] == 120 && bk.shape[1] == 65);
+    double* expected = reference_product(&a120, &bk);
+
+    /* Plain call on strided operands */
+    Tensor c = tensor_matmul(&a120, &bk);
+    CHECK(c.data != NULL && c.shape[0] == 75 && c.shape[1] == 65);
+    check_matrix(&c, expected, 1.0);
+
+    /* The same product through the trans flags on transposed views */
+    Tensor a120_t = tensor_transpose(&a120);               /* 120 x 75 */
+    Tensor bk_t = tensor_transpose(&bk);                   /* 65 x 120 */
+    Tensor c2 = tensor_new(75, 65);
+    CHECK(tensor_gemm(1.0, &a120_t, 1, &bk_t, 1, 0.0, &c2) == 0);
+    check_matrix(&c2, expected, 1.0);
+
+    /* A transposed C (staged and copied back), with beta */
+    Tensor ct_base = tensor_new(65, 75);
+    Tensor ct = tensor_transpose(&ct_base);
+    CHECK(tensor_gemm(1.0, &a120, 0, &bk, 0, 0.0, &ct) == 0);
+    check_matrix(&ct, expected, 1.0);
+    CHECK(tensor_gemm(1.0, &a120, 0, &bk, 0, 1.0, &ct) == 0);
+    check_matrix(&ct, expected, 2.0);
+
+    /* C a column block of a wider matrix: only the block is written */
+    Tensor wide = tensor_new(75, 100);
+    CHECK(tensor_fill(&wide, 9.0) == 0);
+    Tensor block = tensor_slice(&wide, 1, 20, 85, 1);
+    CHECK(tensor_gemm(-1.0, &a120, 0, &bk, 0, 0.0, &block) == 0);
+    check_matrix(&block, expected, -1.0);
+    for (int64_t i = 0; i < 75; i++) {
+        for (int64_t j = 0; j < 100; j++) {
+            if (j < 20 || j >= 85) CHECK(wide.data[i * 100 + j] == 9.0);
+        }
+    }
+    /* C with stepped rows and columns */
+    Tensor sparse_base = tensor_new(150, 130);
+    Tensor sr = tensor_slice(&sparse_base, 0, 0, 150, 2);
+    Tensor sparse = tensor_slice(&sr, 1, 0, 130, 2);
+    CHECK(tensor_gemm(1.0, &a120, 0, &bk, 0, 0.0, &sparse) == 0);
+    check_matrix(&sparse, expected, 1.0);
+    CHECK(tensor_sum(&sparse_base) == tensor_sum(&sparse));
+
+    free(expected);
+    Tensor tensors[] = { big_a, big_b, ar, a120, bk, c, a120_t, bk_t, c2, ct_base, ct,
+                         wide, block, sparse_base, sr, sparse };
+    for (size_t i = 0; i < sizeof(tensors) / sizeof(tensors[0]); i++) tensor_drop(&tensors[i]);
+}
+
+/* ---- Aliasing ---- */
+
+static void test_aliasing_rejected(void) {
+    Tensor m = tensor_new(8, 8);
+    for (int64_t e = 0; e < 64; e++) m.data[e] = (double)e;
+    Tensor before = tensor_driver_copy(&m);
+
+    /* GEMM: C and an operand in the same storage, even where the views
+     * do not overlap */
+    Tensor top = tensor_slice(&m, 0, 0, 4, 1);
+    Tensor bottom = tensor_slice(&m, 0, 4, 8, 1);
+    Tensor left = tensor_slice(&bottom, 1, 0, 4, 1);
+    Tensor right = tensor_slice(&top, 1, 4, 8, 1);
+    Tensor top_t = tensor_transpose(&top);
+    Tensor other = tensor_new(4, 4);
+    errno = 0;
+    CHECK(tensor_gemm(1.0, &left, 0, &other, 0, 0.0, &right) == -1 && errno == EINVAL);
+    errno = 0;
+    CHECK(tensor_gemm(1.0, &other, 0, &left, 1, 0.0, &right) == -1 && errno == EINVAL);
+    Tensor rows = tensor_slice(&top_t, 0, 0, 4, 1);      /* 4 x 4 view of m */
+    errno = 0;
+    CHECK(tensor_gemm(1.0, &other, 0, &other, 0, 0.0, &rows) == 0);   /* No operand shares it */
+    for (int64_t e = 0; e < 64; e++) CHECK(m.data[e] == ((e % 8) < 4 && e < 32 ? 0.0 : before.data[e]));
+    for (int64_t e = 0; e < 64; e++) m.data[e] = before.data[e];
+    errno = 0;
+    CHECK(tensor_gemm(1.0, &rows, 0, &other, 0, 0.0, &left) == -1 && errno == EINVAL);
+    for (int64_t e = 0; e < 64; e++) CHECK(m.data[e] == before.data[e]);
+
+    /* Broadcast views are read-only for every operation */
+    Tensor row = tensor_slice(&m, 0, 0, 1, 1);
+    int64_t shape[2] = { 8, 8 };
+    Tensor repeated = tensor_broadcast_to(&row, 2, shape);
+    errno = 0;
+    CHECK(tensor_fill(&repeated, 1.0) == -1 && errno == EINVAL);
+    errno = 0;
+    CHECK(tensor_add(&m, &m, &repeated) == -1 && errno == EINVAL);
+    errno = 0;
+    CHECK(tensor_scale(&m, 2.0, &repeated) == -1 && errno == EINVAL);
+    errno = 0;
+    CHECK(tensor_assign(&repeated, &other) == -1 && errno == EINVAL);
+    Tensor eight = tensor_new(8, 8);
+    errno = 0;
+    CHECK(tensor_gemm(1.0, &eight, 0, &eight, 0, 0.0, &repeated) == -1 && errno == EINVAL);
+    for (int64_t e = 0; e < 64; e++) CHECK(m.data[e] == before.data[e]);
+
+    /* But a broadcast over a dimension of size 1 writes each element once */
+    int64_t single[2] = { 1, 8 };
+    Tensor once = tensor_broadcast_to(&row, 2, single);
+    CHECK(tensor_fill(&once, -1.0) == 0);
+    for (int64_t j = 0; j < 8; j++) CHECK(m.data[j] == -1.0);
+
+    /* In place through the same view is allowed */
+    CHECK(tensor_add(&bottom, &bottom, &bottom) == 0);
+    for (int64_t e = 32; e < 64; e++) CHECK(m.data[e] == 2.0 * before.data[e]);
+
+    Tensor tensors[] = { m, before, top, bottom, left, right, top_t, other, rows, row, repeated, eight, once };
+    for (size_t i = 0; i < sizeof(tensors) / sizeof(tensors[0]); i++) tensor_drop(&tensors[i]);
+}
+
+/* ---- References ---- */
+
+static void test_views_outlive_base(void) {
+    Tensor t = base_tensor();
+    Tensor row = tensor_select(&t, 0, 3);
+    int32_t axes[3] = { 1, 2, 0 };
+    Tensor p = tensor_permute(&t, axes);
+    Tensor s = tensor_slice(&p, 2, 1, 4, 2);
+    tensor_drop(&t);
+    CHECK(t.data == NULL && t.storage == NULL);
+    tensor_drop(&t);                                /* Dropping an empty tensor is a no-op */
+
+    /* The storage is still there (ASan: no use after free) */
+    CHECK(tensor_get(&row, 2, 5) == base_value(3, 2, 5));
+    int64_t at[3] = { 4, 5, 1 };
+    CHECK(tensor_get_at(&s, at) == base_value(3, 4, 5));
+    tensor_drop(&row);
+    tensor_drop(&p);
+    CHECK(tensor_get_at(&s, at) == base_value(3, 4, 5));
+    CHECK(tensor_fill(&s, 0.5) == 0);
+    CHECK(tensor_sum(&s) == 0.5 * 5 * 6 * 2);
+    tensor_drop(&s);
+
+    /* Views of views of a contiguous copy, dropped in creation order */
+    for (int round = 0; round < 100; round++) {
+        Tensor base = base_tensor();
+        Tensor chain[6];
+        chain[0] = tensor_transpose(&base);
+        chain[1] = tensor_contiguous(&chain[0]);
+        chain[2] = tensor_slice(&chain[1], 1, 1, 6, 2);
+        chain[3] = tensor_select(&chain[2], 0, 3);
+        int64_t whole[3] = { 4, 3, 5 };
+        chain[4] = tensor_broadcast_to(&chain[3], 3, whole);
+        chain[5] = tensor_contiguous(&chain[4]);
+        tensor_drop(&base);
+        for (int i = 0; i < 5; i++) tensor_drop(&chain[i]);
+        CHECK(tensor_numel(&chain[5]) == 60);
+        tensor_drop(&chain[5]);
+    }
+
+    /* 0-D and zero-size tensors */
+    Tensor scalar = tensor_new_nd(0, NULL);
+    CHECK(scalar.data != NULL && tensor_numel(&scalar) == 1 && tensor_get_at(&scalar, NULL) == 0.0);
+    int64_t zero[2] = { 0, 3 };
+    Tensor empty = tensor_new_nd(2, zero);
+    CHECK(empty.data == NULL && empty.storage == NULL && empty.ndim == 2);
+    Tensor et = tensor_transpose(&empty);
+    Tensor ec = tensor_contiguous(&et);
+    CHECK(ec.ndim == 2 && ec.shape[0] == 3 && ec.shape[1] == 0 && tensor_sum(&ec) == 0.0);
+    tensor_drop(&scalar);
+    tensor_drop(&empty);
+    tensor_drop(&et);
+    tensor_drop(&ec);
+}
+
+int main(void) {
+    alarm(60);
+    /* Freed storage goes back to the allocator, where ASan watches it */
+    tensor_set_pool_limit(0);
+    static const int32_t widths[] = { 1, 4 };
+    for (int w = 0; w < 2; w++) {
+        CHECK(tensor_set_threads(widths[w]) == widths[w]);
+        test_slice_select();
+        test_permute_transpose();
+        test_broadcast();
+        test_reshape();
+        test_assign();
+        test_elementwise_on_views();
+        test_gemm_on_views();
+        test_aliasing_rejected();
+        test_views_outlive_base();
+    }
+    CHECK(tensor_pool_trim() == 0);
+    printf("ok\n");
+    return 0;
+}
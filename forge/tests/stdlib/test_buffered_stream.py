@@ -0,0 +1,298 @@
+"""Test buffered stream declarations"""
+import pytest
+import sys
+from pathlib import Path
+
+# Add forge to path
+repo_root = Path(__file__).parent.parent.parent
+compiler_dir = repo_root / "forge"
+sys.path.insert(0, str(compiler_dir))
+
+from src.frontend import lex
+from src.frontend import parse
+
+
+def test_bufstream_extern_declarations():
+    """Test that buffered stream extern declarations parse"""
+    source = """extern "C" fn bufstream_new(sock: i64, read_capacity: i64, write_capacity: i64) -> *mut u8
+extern "C" fn bufstream_read_frame(stream: *mut u8, codec: i32, param: i64) -> i64
+extern "C" fn bufstream_frame(stream: *mut u8) -> String
+extern "C" fn bufstream_write_frame(stream: *mut u8, codec: i32, param: i64, data: *const u8, len: i64) -> i32
+extern "C" fn bufstream_flush(stream: *mut u8) -> i32
+"""
+    
+    tokens = lex(source)
+    program = parse(tokens)
+    
+    assert program is not None
+    assert len(program.items) == 5
+
+
+def test_buffered_module_parses():
+    """Test that the stdlib buffered.pyrite module parses"""
+    module = repo_root.parent / "pyrite" / "net" / "buffered.pyrite"
+    
+    tokens = lex(module.read_text())
+    program = parse(tokens)
+    
+    assert program is not None
+    assert len(program.items) >= 20
+
+
+# ---- Native behaviour (pyrite/net/buffered.c) ----
+
+import ctypes
+import errno
+import socket
+import time
+
+U16, U32, VARINT, LINE, CRLF, FIXED = 1, 2, 3, 4, 5, 6
+TCP_WOULD_BLOCK = -2
+BUFSTREAM_EOF = -3
+
+
+@pytest.fixture(scope="module")
+def stream_lib(native):
+    lib = native.shared("libbuffered", ["net/buffered.c", "net/socket.c"])
+    lib.bufstream_new.argtypes = [ctypes.c_int64, ctypes.c_int64, ctypes.c_int64]
+    lib.bufstream_new.restype = ctypes.c_void_p
+    lib.bufstream_set_max_frame.argtypes = [ctypes.c_void_p, ctypes.c_int64]
+    lib.bufstream_set_max_frame.restype = None
+    lib.bufstream_read_frame.argtypes = [ctypes.c_void_p, ctypes.c_int32, ctypes.c_int64]
+    lib.bufstream_read_frame.restype = ctypes.c_int64
+    lib.bufstream_frame_data.argtypes = [ctypes.c_void_p]
+    lib.bufstream_frame_data.restype = ctypes.c_void_p
+    lib.bufstream_read.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_int64]
+    lib.bufstream_read.restype = ctypes.c_int64
+    lib.bufstream_buffered.argtypes = [ctypes.c_void_p]
+    lib.bufstream_buffered.restype = ctypes.c_int64
+    lib.bufstream_write.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_int64]
+    lib.bufstream_write.restype = ctypes.c_int32
+    lib.bufstream_write_frame.argtypes = [ctypes.c_void_p, ctypes.c_int32, ctypes.c_int64,
+                                          ctypes.c_char_p, ctypes.c_int64]
+    lib.bufstream_write_frame.restype = ctypes.c_int32
+    lib.bufstream_flush.argtypes = [ctypes.c_void_p]
+    lib.bufstream_flush.restype = ctypes.c_int32
+    lib.bufstream_pending_write.argtypes = [ctypes.c_void_p]
+    lib.bufstream_pending_write.restype = ctypes.c_int64
+    lib.bufstream_free.argtypes = [ctypes.c_void_p]
+    lib.bufstream_free.restype = None
+    return lib
+
+
+@pytest.fixture
+def streams(stream_lib, tcp_pair):
+    """BufferedStreams on both ends of tcp_pair, with 4 KiB buffers"""
+    sender, receiver = tcp_pair
+    writer = stream_lib.bufstream_new(sender.fileno(), 4096, 4096)
+    reader = stream_lib.bufstream_new(receiver.fileno(), 4096, 4096)
+    yield writer, reader
+    stream_lib.bufstream_free(writer)
+    stream_lib.bufstream_free(reader)
+
+
+def read_frame(lib, stream, codec, param=0):
+    """Payload bytes, or the negative status"""
+    n = lib.bufstream_read_frame(stream, codec, param)
+    if n < 0:
+        return n
+    return ctypes.string_at(lib.bufstream_frame_data(stream), n) if n else b""
+
+
+def recv_available(sock, wait=0.05):
+    time.sleep(wait)
+    data = bytearray()
+    while True:
+        try:
+            chunk = sock.recv(65536, socket.MSG_DONTWAIT)
+        except BlockingIOError:
+            return bytes(data)
+        if not chunk:
+            return bytes(data)
+        data += chunk
+
+
+WIRE_CASES = [
+    (U16, 0, b"hello", b"\x00\x05hello"),
+    (U32, 0, b"hello", b"\x00\x00\x00\x05hello"),
+    (VARINT, 0, b"x" * 300, b"\xac\x02" + b"x" * 300),
+    (VARINT, 0, b"", b"\x00"),
+    (LINE, 0, b"GET / HTTP/1.1", b"GET / HTTP/1.1\n"),
+    (CRLF, 0, b"a\nb", b"a\nb\r\n"),
+    (FIXED, 4, b"abcd", b"abcd"),
+]
+
+
+@pytest.mark.parametrize("codec,param,payload,wire", WIRE_CASES)
+def test_frame_codecs_encode_and_decode(stream_lib, streams, tcp_pair, codec, param, payload, wire):
+    """Each codec's bytes on the wire, and the payload read back from them"""
+    writer, reader = streams
+    sender, receiver = tcp_pair
+    assert stream_lib.bufstream_write_frame(writer, codec, param, payload, len(payload)) == 0
+    assert stream_lib.bufstream_flush(writer) == 0
+    received = recv_available(receiver)
+    assert received == wire
+    
+    # Twice back to back, so the second frame starts inside the buffer
+    sender.sendall(wire * 2)
+    assert read_frame(stream_lib, reader, codec, param) == payload
+    assert read_frame(stream_lib, reader, codec, param) == payload
+    assert stream_lib.bufstream_buffered(reader) == 0
+
+
+def test_line_codecs_strip_their_delimiters(stream_lib, streams, tcp_pair):
+    _, reader = streams
+    sender, _ = tcp_pair
+    sender.sendall(b"one\r\ntwo\nthree\r\n" b"a\nb\r\n")
+    assert read_frame(stream_lib, reader, LINE) == b"one"
+    assert read_frame(stream_lib, reader, LINE) == b"two"
+    assert read_frame(stream_lib, reader, LINE) == b"three"
+    assert read_frame(stream_lib, reader, CRLF) == b"a\nb"      # Bare "\n" is payload
+
+
+def test_partial_frames_wait_for_the_rest(stream_lib, streams, tcp_pair):
+    """A nonblocking socket returns TCP_WOULD_BLOCK and keeps the partial frame"""
+    _, reader = streams
+    sender, receiver = tcp_pair
+    receiver.setblocking(False)
+    pieces = [
+        (U32, 0, [b"\x00\x00", b"\x00\x06ab", b"cd", b"ef"], b"abcdef"),
+        (VARINT, 0, [b"\xac", b"\x02" + b"y" * 100, b"y" * 200], b"y" * 300),
+        (LINE, 0, [b"par", b"tial", b" line\r", b"\n"], b"partial line"),
+        (CRLF, 0, [b"x\r", b"y\n", b"z\r", b"\n"], b"x\ry\nz"),
+        (FIXED, 5, [b"12", b"345"], b"12345"),
+    ]
+    for codec, param, chunks, payload in pieces:
+        assert read_frame(stream_lib, reader, codec, param) == TCP_WOULD_BLOCK
+        for chunk in chunks[:-1]:
+            sender.sendall(chunk)
+            time.sleep(0.02)
+            assert read_frame(stream_lib, reader, codec, param) == TCP_WOULD_BLOCK
+        sender.sendall(chunks[-1])
+        time.sleep(0.02)
+        assert read_frame(stream_lib, reader, codec, param) == payload
+
+
+def test_codec_switch_after_partial_read(stream_lib, streams, tcp_pair):
+    """A CRLF scan that passed a bare "\\n" does not hide it from a LINE read"""
+    _, reader = streams
+    sender, receiver = tcp_pair
+    receiver.setblocking(False)
+    sender.sendall(b"first\nsecond")
+    time.sleep(0.02)
+    assert read_frame(stream_lib, reader, CRLF) == TCP_WOULD_BLOCK
+    assert read_frame(stream_lib, reader, LINE) == b"first"
+    assert read_frame(stream_lib, reader, FIXED, 3) == b"sec"
+    sender.sendall(b"\n")
+    time.sleep(0.02)
+    assert read_frame(stream_lib, reader, LINE) == b"ond"
+
+
+def test_oversized_frames_fail_with_emsgsize(stream_lib, streams, tcp_pair):
+    writer, reader = streams
+    sender, receiver = tcp_pair
+    receiver.setblocking(False)
+    stream_lib.bufstream_set_max_frame(reader, 100)
+    stream_lib.bufstream_set_max_frame(writer, 100)
+    
+    sender.sendall(b"\x00\x00\x03\xe8")                  # U32 length 1000
+    time.sleep(0.02)
+    assert read_frame(stream_lib, reader, U32) == -1
+    assert ctypes.get_errno() == errno.EMSGSIZE
+    
+    big = b"z" * 101
+    assert stream_lib.bufstream_write_frame(writer, U16, 0, big, len(big)) == -1
+    assert ctypes.get_errno() == errno.EMSGSIZE
+    assert read_frame(stream_lib, reader, FIXED, 101) == -1
+    assert ctypes.get_errno() == errno.EINVAL
+
+
+def test_unterminated_line_fails_with_emsgsize(stream_lib, streams, tcp_pair):
+    _, reader = streams
+    sender, receiver = tcp_pair
+    receiver.setblocking(False)
+    stream_lib.bufstream_set_max_frame(reader, 100)
+    sender.sendall(b"w" * 500)
+    time.sleep(0.02)
+    assert read_frame(stream_lib, reader, LINE) == -1
+    assert ctypes.get_errno() == errno.EMSGSIZE
+
+
+def test_unframeable_payloads_are_rejected(stream_lib, streams):
+    writer, _ = streams
+    cases = [
+        (U16, 0, b"q" * 70000),
+        (LINE, 0, b"two\nlines"),
+        (LINE, 0, b"ends in cr\r"),
+        (CRLF, 0, b"has\r\ncrlf"),
+        (FIXED, 4, b"five!"),
+    ]
+    stream_lib.bufstream_set_max_frame(writer, 1 << 20)
+    for codec, param, payload in cases:
+        assert stream_lib.bufstream_write_frame(writer, codec, param, payload, len(payload)) == -1
+        assert ctypes.get_errno() == errno.EINVAL
+    assert stream_lib.bufstream_pending_write(writer) == 0
+
+
+def test_end_of_stream(stream_lib, streams, tcp_pair):
+    """EOF between frames is BUFSTREAM_EOF; inside one it is ECONNRESET"""
+    _, reader = streams
+    sender, _ = tcp_pair
+    sender.sendall(b"\x00\x02ok\x00\x05ab")
+    sender.shutdown(socket.SHUT_WR)
+    assert read_frame(stream_lib, reader, U16) == b"ok"
+    assert read_frame(stream_lib, reader, U16) == -1
+    assert ctypes.get_errno() == errno.ECONNRESET
+
+
+def test_clean_eof_between_frames(stream_lib, streams, tcp_pair):
+    _, reader = streams
+    sender, _ = tcp_pair
+    sender.sendall(b"last\n")
+    sender.shutdown(socket.SHUT_WR)
+    assert read_frame(stream_lib, reader, LINE) == b"last"
+    assert read_frame(stream_lib, reader, LINE) == BUFSTREAM_EOF
+
+
+def test_small_writes_are_batched_until_flush(stream_lib, streams, tcp_pair):
+    writer, _ = streams
+    _, receiver = tcp_pair
+    for i in range(20):
+        assert stream_lib.bufstream_write_frame(writer, LINE, 0, b"line %d" % i, len(b"line %d" % i)) == 0
+    pending = stream_lib.bufstream_pending_write(writer)
+    assert pending == sum(len(b"line %d\n" % i) for i in range(20))
+    assert recv_available(receiver) == b""                   # Nothing sent yet
+    
+    assert stream_lib.bufstream_flush(writer) == 0
+    assert stream_lib.bufstream_pending_write(writer) == 0
+    assert recv_available(receiver) == b"".join(b"line %d\n" % i for i in range(20))
+    
+    # Past the buffer's capacity the socket takes it without a flush (sent
+    # with MSG_MORE); the flush then pushes out what the kernel holds back
+    chunk = b"c" * 3000
+    assert stream_lib.bufstream_write(writer, chunk, len(chunk)) == 0
+    assert stream_lib.bufstream_pending_write(writer) == 3000
+    assert stream_lib.bufstream_write(writer, chunk, len(chunk)) == 0
+    assert stream_lib.bufstream_pending_write(writer) == 0
+    assert stream_lib.bufstream_flush(writer) == 0
+    assert recv_available(receiver, wait=0.02) == chunk * 2
+
+
+def test_backpressure_keeps_unsent_bytes(stream_lib, streams, tcp_pair):
+    """A full nonblocking socket leaves the rest buffered until a later flush"""
+    writer, _ = streams
+    sender, receiver = tcp_pair
+    sender.setblocking(False)
+    payload = bytes(range(256)) * 4096                       # 1 MiB
+    assert stream_lib.bufstream_write(writer, payload, len(payload)) == 0
+    assert stream_lib.bufstream_flush(writer) == TCP_WOULD_BLOCK
+    assert stream_lib.bufstream_pending_write(writer) > 0
+    
+    received = bytearray()
+    while stream_lib.bufstream_pending_write(writer) > 0:
+        received += recv_available(receiver, wait=0.01)
+        status = stream_lib.bufstream_flush(writer)
+        assert status in (0, TCP_WOULD_BLOCK)
+    while len(received) < len(payload):
+        received += recv_available(receiver, wait=0.01)
+    assert bytes(received) == payload
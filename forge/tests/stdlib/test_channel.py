@@ -0,0 +1,56 @@
+"""Test shared-memory channel declarations"""
+import pytest
+import sys
+from pathlib import Path
+
+# Add forge to path
+repo_root = Path(__file__).parent.parent.parent
+compiler_dir = repo_root / "forge"
+sys.path.insert(0, str(compiler_dir))
+
+from src.frontend import lex
+from src.frontend import parse
+
+
+def test_channel_extern_declarations():
+    """Test that channel extern declarations parse"""
+    source = """extern "C" fn chan_create(capacity: i64, flags: i32) -> *mut u8
+extern "C" fn chan_open(fd: i64) -> *mut u8
+extern "C" fn chan_reserve(chan: *mut u8, len: i64, timeout_ms: i32) -> *mut u8
+extern "C" fn chan_commit(chan: *mut u8, slot: *mut u8, len: i64) -> i32
+extern "C" fn chan_peek(chan: *mut u8, len: *mut i64, timeout_ms: i32) -> *mut u8
+extern "C" fn chan_release(chan: *mut u8) -> i32
+"""
+    
+    tokens = lex(source)
+    program = parse(tokens)
+    
+    assert program is not None
+    assert len(program.items) == 6
+
+
+def test_channel_module_parses():
+    """Test that the stdlib channel.pyrite module parses"""
+    module = repo_root.parent / "pyrite" / "net" / "channel.pyrite"
+    
+    tokens = lex(module.read_text())
+    program = parse(tokens)
+    
+    assert program is not None
+    assert len(program.items) >= 15
+
+
+# ---- Native behaviour (pyrite/net/channel.c) ----
+
+CHANNEL_SOURCES = ["native/channel_stress.c", "net/channel.c"]
+
+
+@pytest.mark.parametrize("variant,flags,messages", [
+    ("plain", (), 100000),
+    ("asan", ("-fsanitize=address,undefined", "-fno-omit-frame-pointer"), 20000),
+    ("tsan", ("-fsanitize=thread",), 5000),
+])
+def test_channel_mpsc_stress_and_corrupt_rings(native, variant, flags, messages):
+    """Forked and threaded producers into one consumer; corrupt headers fail the channel"""
+    binary = native.executable(f"channel_stress_{variant}", CHANNEL_SOURCES, flags)
+    assert native.run(binary, messages, timeout=180).strip() == "ok"
@@ -0,0 +1,138 @@
+"""Test connection pool declarations"""
+import pytest
+import sys
+from pathlib import Path
+
+# Add forge to path
+repo_root = Path(__file__).parent.parent.parent
+compiler_dir = repo_root / "forge"
+sys.path.insert(0, str(compiler_dir))
+
+from src.frontend import lex
+from src.frontend import parse
+
+
+def test_pool_extern_declarations():
+    """Test that connection pool and socket option extern declarations parse"""
+    source = """extern "C" fn tcp_pool_new(max_per_host: i32, max_idle_per_host: i32, idle_timeout_ms: i64) -> *mut u8
+extern "C" fn tcp_pool_acquire(pool: *mut u8, address: *const u8, port: i32, timeout_ms: i64) -> i64
+extern "C" fn tcp_pool_release(pool: *mut u8, sock: i64, reusable: i32)
+extern "C" fn tcp_set_nodelay(sock: i64, enabled: i32) -> i32
+extern "C" fn tcp_set_keepalive(sock: i64, enabled: i32, idle_s: i32, interval_s: i32, count: i32) -> i32
+"""
+    
+    tokens = lex(source)
+    program = parse(tokens)
+    
+    assert program is not None
+    assert len(program.items) == 5
+
+
+def test_pool_module_parses():
+    """Test that the stdlib pool.pyrite module parses"""
+    module = repo_root.parent / "pyrite" / "net" / "pool.pyrite"
+    
+    tokens = lex(module.read_text())
+    program = parse(tokens)
+    
+    assert program is not None
+    assert len(program.items) >= 12
+
+
+# ---- Native behaviour (pyrite/net/pool.c) ----
+
+import ctypes
+import os
+import socket
+
+POOL_SOURCES = ["net/pool.c", "net/socket.c"]
+ETIMEDOUT = 110
+
+
+@pytest.fixture(scope="module")
+def pool_lib(native):
+    lib = native.shared("libpool", POOL_SOURCES)
+    lib.tcp_pool_new.restype = ctypes.c_void_p
+    lib.tcp_pool_new.argtypes = [ctypes.c_int32, ctypes.c_int32, ctypes.c_int64]
+    lib.tcp_pool_set_options.argtypes = [ctypes.c_void_p] + [ctypes.c_int32] * 6
+    lib.tcp_pool_acquire.restype = ctypes.c_int64
+    lib.tcp_pool_acquire.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_int32, ctypes.c_int64]
+    lib.tcp_pool_release.argtypes = [ctypes.c_void_p, ctypes.c_int64, ctypes.c_int32]
+    lib.tcp_pool_idle_count.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_int32]
+    lib.tcp_pool_free.argtypes = [ctypes.c_void_p]
+    return lib
+
+
+@pytest.fixture
+def server():
+    s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    s.bind(("127.0.0.1", 0))
+    s.listen(64)
+    yield s
+    s.close()
+
+
+def rcv_wscale(fd):
+    """Receive window scale the socket advertised in its SYN (Linux TCP_INFO)"""
+    with socket.socket(fileno=os.dup(fd)) as s:
+        info = s.getsockopt(socket.IPPROTO_TCP, socket.TCP_INFO, 104)
+    return info[6] >> 4  # tcpi_snd_wscale:4, tcpi_rcv_wscale:4
+
+
+@pytest.mark.skipif(not sys.platform.startswith("linux"), reason="TCP_INFO layout is Linux's")
+def test_buffer_sizes_apply_before_connect(pool_lib, server):
+    """A small SO_RCVBUF set before the handshake lowers the advertised window scale"""
+    port = server.getsockname()[1]
+    default_pool = pool_lib.tcp_pool_new(4, 4, 0)
+    small_pool = pool_lib.tcp_pool_new(4, 4, 0)
+    pool_lib.tcp_pool_set_options(small_pool, 0, 0, 0, 0, 4096, 4096)
+    try:
+        default_fd = pool_lib.tcp_pool_acquire(default_pool, b"127.0.0.1", port, 1000)
+        small_fd = pool_lib.tcp_pool_acquire(small_pool, b"127.0.0.1", port, 1000)
+        assert default_fd >= 0 and small_fd >= 0
+        assert rcv_wscale(small_fd) < rcv_wscale(default_fd)
+        with socket.socket(fileno=os.dup(small_fd)) as s:
+            assert s.getsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF) <= 2 * 4608
+        pool_lib.tcp_pool_release(default_pool, default_fd, 0)
+        pool_lib.tcp_pool_release(small_pool, small_fd, 0)
+    finally:
+        pool_lib.tcp_pool_free(default_pool)
+        pool_lib.tcp_pool_free(small_pool)
+
+
+def test_idle_reuse_and_health_check(pool_lib, server):
+    port = server.getsockname()[1]
+    pool = pool_lib.tcp_pool_new(4, 4, 0)
+    try:
+        fd = pool_lib.tcp_pool_acquire(pool, b"127.0.0.1", port, 1000)
+        peer, _ = server.accept()
+        pool_lib.tcp_pool_release(pool, fd, 1)
+        assert pool_lib.tcp_pool_idle_count(pool, b"127.0.0.1", port) == 1
+        assert pool_lib.tcp_pool_acquire(pool, b"127.0.0.1", port, 1000) == fd
+        
+        # The peer closes while the connection is idle: it is not handed out again
+        pool_lib.tcp_pool_release(pool, fd, 1)
+        peer.close()
+        fresh = pool_lib.tcp_pool_acquire(pool, b"127.0.0.1", port, 1000)
+        assert fresh >= 0
+        assert pool_lib.tcp_pool_idle_count(pool, b"127.0.0.1", port) == 0
+        with socket.socket(fileno=os.dup(fresh)) as s:
+            assert s.getpeername() == server.getsockname()
+        pool_lib.tcp_pool_release(pool, fresh, 0)
+    finally:
+        pool_lib.tcp_pool_free(pool)
+
+
+def test_max_per_host_waits_then_times_out(pool_lib, server):
+    port = server.getsockname()[1]
+    pool = pool_lib.tcp_pool_new(1, 1, 0)
+    try:
+        fd = pool_lib.tcp_pool_acquire(pool, b"127.0.0.1", port, 1000)
+        assert fd >= 0
+        assert pool_lib.tcp_pool_acquire(pool, b"127.0.0.1", port, 50) == -1
+        assert ctypes.get_errno() == ETIMEDOUT
+        pool_lib.tcp_pool_release(pool, fd, 1)
+        assert pool_lib.tcp_pool_acquire(pool, b"127.0.0.1", port, 50) == fd
+        pool_lib.tcp_pool_release(pool, fd, 0)
+    finally:
+        pool_lib.tcp_pool_free(pool)
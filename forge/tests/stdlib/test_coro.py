@@ -0,0 +1,53 @@
+"""Test coroutine runtime declarations"""
+import pytest
+import sys
+from pathlib import Path
+
+# Add forge to path
+repo_root = Path(__file__).parent.parent.parent
+compiler_dir = repo_root / "forge"
+sys.path.insert(0, str(compiler_dir))
+
+from src.frontend import lex
+from src.frontend import parse
+
+
+def test_coro_extern_declarations():
+    """Test that scheduler and coroutine extern declarations parse"""
+    source = """extern "C" fn coro_scheduler_new(stack_size: i32) -> *mut u8
+extern "C" fn coro_spawn(scheduler: *mut u8, entry: fn(*mut u8), arg: *mut u8) -> i64
+extern "C" fn coro_scheduler_run(scheduler: *mut u8) -> i32
+extern "C" fn coro_wait_fd(fd: i64, events: i32, timeout_ms: i32) -> i32
+extern "C" fn coro_join(id: i64) -> i32
+extern "C" fn coro_main_enter() -> i32
+"""
+    
+    tokens = lex(source)
+    program = parse(tokens)
+    
+    assert program is not None
+    assert len(program.items) == 6
+
+
+def test_coro_module_parses():
+    """Test that the stdlib coro.pyrite module parses"""
+    module = repo_root.parent / "pyrite" / "task" / "coro.pyrite"
+    
+    tokens = lex(module.read_text())
+    program = parse(tokens)
+    
+    assert program is not None
+    assert len(program.items) >= 20
+
+
+# ---- Native behaviour (pyrite/task/coro.c) ----
+
+CORO_SOURCES = ["native/coro_switch.c", "task/coro.c", "net/reactor.c", "net/socket.c"]
+
+
+@pytest.mark.parametrize("flags", [(), ("-fsanitize=address,undefined", "-fno-omit-frame-pointer")],
+                         ids=["plain", "asan"])
+def test_coroutine_switch(native, flags):
+    """FIFO yields, live registers, per-coroutine FP control, stacks and join"""
+    binary = native.executable("coro_switch" + ("_asan" if flags else ""), CORO_SOURCES, flags)
+    assert native.run(binary, timeout=120).strip() == "ok"
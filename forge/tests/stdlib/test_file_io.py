@@ -1,4 +1,9 @@
 """Test File I/O operations"""
+import ctypes
+import errno
+import importlib.util
+import os
+import stat
 import pytest
 import sys
 import tempfile
@@ -161,3 +166,141 @@ fn test_walk_dir():
     extern_func = program.items[0]
     assert extern_func.is_extern == True
     assert extern_func.name == "file_walk_dir"
+
+
+def test_file_copy_declarations():
+    """Test that file_copy and dir_copy_tree extern declarations parse"""
+    source = """extern "C" fn file_copy(src: *const u8, dst: *const u8) -> i32
+extern "C" fn dir_copy_tree(src: *const u8, dst: *const u8) -> i32
+
+fn test_copy():
+    # Would test file copying here when FFI is working
+    return
+"""
+    
+    tokens = lex(source)
+    program = parse(tokens)
+    
+    assert program is not None
+    assert len(program.items) >= 2
+    assert program.items[0].is_extern == True
+    assert program.items[0].name == "file_copy"
+    assert program.items[1].name == "dir_copy_tree"
+
+
+# ---- Native behaviour (pyrite/io/file.c) ----
+
+FILE_SOURCES = ["io/file.c", "string/string.c", "collections/list.c"]
+
+
+@pytest.fixture(scope="module")
+def file_lib(native):
+    lib = native.shared("libfile", FILE_SOURCES)
+    for name in ("file_copy", "dir_copy_tree"):
+        getattr(lib, name).argtypes = [ctypes.c_char_p, ctypes.c_char_p]
+        getattr(lib, name).restype = ctypes.c_int32
+    return lib
+
+
+def test_file_copy_onto_itself_keeps_source(file_lib, tmp_path):
+    """file_copy(src, src) and copies onto a hard link fail without truncating"""
+    src = tmp_path / "data.bin"
+    src.write_bytes(b"payload" * 1000)
+    link = tmp_path / "alias.bin"
+    os.link(src, link)
+    
+    assert file_lib.file_copy(bytes(src), bytes(src)) == 0
+    assert ctypes.get_errno() == errno.EINVAL
+    assert file_lib.file_copy(bytes(src), bytes(link)) == 0
+    assert src.read_bytes() == b"payload" * 1000
+
+
+def test_dir_copy_tree_read_only_source(file_lib, tmp_path):
+    """Read-only source directories are copied with their contents and modes"""
+    src = tmp_path / "src"
+    (src / "ro" / "deeper").mkdir(parents=True)
+    (src / "ro" / "file.txt").write_text("hello")
+    (src / "ro" / "deeper" / "more.txt").write_text("world")
+    os.symlink("file.txt", src / "ro" / "link")
+    for i in range(40):
+        (src / f"f{i}.txt").write_text(str(i))
+    os.chmod(src / "ro" / "deeper", 0o555)
+    os.chmod(src / "ro", 0o500)
+    dst = tmp_path / "dst"
+    try:
+        assert file_lib.dir_copy_tree(bytes(src), bytes(dst)) == 1
+        assert (dst / "ro" / "file.txt").read_text() == "hello"
+        assert (dst / "ro" / "deeper" / "more.txt").read_text() == "world"
+        assert os.readlink(dst / "ro" / "link") == "file.txt"
+        assert (dst / "f39.txt").read_text() == "39"
+        assert stat.S_IMODE(os.stat(dst / "ro").st_mode) == 0o500
+        assert stat.S_IMODE(os.stat(dst / "ro" / "deeper").st_mode) == 0o555
+    finally:
+        for root in (src, dst):
+            for path in (root / "ro", root / "ro" / "deeper"):
+                if path.exists():
+                    os.chmod(path, 0o755)
+
+
+def test_copy_tree_ffi_matches_python_on_existing_dst(file_lib, tmp_path, monkeypatch):
+    """Both copy paths refuse an existing destination and never delete it"""
+    # Load the bridge module on its own; importing the quarry package pulls in
+    # the whole installer
+    bridge_path = Path(__file__).resolve().parents[3] / "quarry" / "bridge" / "file_bridge.py"
+    spec = importlib.util.spec_from_file_location("file_bridge_under_test", bridge_path)
+    file_bridge = importlib.util.module_from_spec(spec)
+    spec.loader.exec_module(file_bridge)
+    monkeypatch.setattr(file_bridge, "USE_FFI", True)
+    monkeypatch.setattr(file_bridge, "_lib", file_lib)
+    
+    src = tmp_path / "src"
+    src.mkdir()
+    (src / "a.txt").write_text("a")
+    os.symlink("a.txt", src / "b")
+    dst = tmp_path / "dst"
+    dst.mkdir()
+    (dst / "keep.txt").write_text("keep")
+    
+    for copy in (file_bridge.copy_tree_ffi, file_bridge.copy_tree_python):
+        with pytest.raises(FileExistsError):
+            copy(src, dst)
+        assert (dst / "keep.txt").read_text() == "keep"
+    
+    file_bridge.copy_tree_ffi(src, tmp_path / "ffi")
+    file_bridge.copy_tree_python(src, tmp_path / "py")
+    for out in (tmp_path / "ffi", tmp_path / "py"):
+        assert (out / "a.txt").read_text() == "a"
+        assert os.readlink(out / "b") == "a.txt"
+
+
+@pytest.mark.skipif(not sys.platform.startswith("linux"), reason="FICLONE/copy_file_range are Linux-only")
+def test_file_copy_falls_through_only_when_unsupported(native):
+    """Only "unsupported" errors move on to the next copy method"""
+    binary = native.executable("file_copy_fallback", ["native/file_copy_fallback.c"] + FILE_SOURCES)
+    assert native.run(binary, timeout=60).strip() == "ok"
+
+
+def test_dir_copy_tree_refuses_to_copy_into_itself(file_lib, tmp_path, monkeypatch):
+    """A destination at or below the source fails with EINVAL and is not created"""
+    src = tmp_path / "a"
+    (src / "sub").mkdir(parents=True)
+    (src / "f.txt").write_text("f")
+    os.symlink(src, tmp_path / "alias")
+    
+    for dst in (src, src / "b", src / "sub" / "x" / "y", src / "sub" / ".." / "c",
+                tmp_path / "alias" / "d", src / "f.txt" / "e"):
+        assert file_lib.dir_copy_tree(bytes(src), bytes(dst)) == 0
+        assert ctypes.get_errno() == errno.EINVAL
+    assert sorted(p.name for p in src.iterdir()) == ["f.txt", "sub"]
+    assert list((src / "sub").iterdir()) == []
+    
+    # Relative names, and a source reached through a link
+    monkeypatch.chdir(src / "sub")
+    assert file_lib.dir_copy_tree(b"..", b"new") == 0
+    assert file_lib.dir_copy_tree(bytes(tmp_path / "alias"), b"new") == 0
+    assert not (src / "sub" / "new").exists()
+    
+    # A sibling sharing the name prefix is outside
+    assert file_lib.dir_copy_tree(bytes(src), bytes(tmp_path / "ab")) == 1
+    assert (tmp_path / "ab" / "f.txt").read_text() == "f"
+    assert file_lib.dir_copy_tree(bytes(src / "sub"), bytes(src / "sub2")) == 1
@@ -0,0 +1,223 @@
+"""Test glob declarations"""
+import ctypes
+import importlib.util
+import random
+import pytest
+import sys
+from pathlib import Path
+
+# Add forge to path
+repo_root = Path(__file__).parent.parent.parent
+compiler_dir = repo_root / "forge"
+sys.path.insert(0, str(compiler_dir))
+
+from src.frontend import lex
+from src.frontend import parse
+
+
+def test_glob_extern_declarations():
+    """Test that glob extern declarations parse"""
+    source = """extern "C" fn glob_set_new() -> *mut u8
+extern "C" fn glob_set_add(set: *mut u8, pattern: *const u8) -> i32
+extern "C" fn glob_set_match(set: *mut u8, path: *const u8, len: i64) -> i32
+extern "C" fn glob_walk_open(root: *const u8, include: *mut u8, exclude: *mut u8, flags: i32) -> *mut u8
+extern "C" fn glob_walk_next(walk: *mut u8) -> i32
+extern "C" fn glob_walk_relative(walk: *mut u8) -> *const u8
+"""
+    
+    tokens = lex(source)
+    program = parse(tokens)
+    
+    assert program is not None
+    assert len(program.items) == 6
+
+
+def test_glob_module_parses():
+    """Test that the stdlib glob.pyrite module parses"""
+    module = repo_root.parent / "pyrite" / "io" / "glob.pyrite"
+    
+    tokens = lex(module.read_text())
+    program = parse(tokens)
+    
+    assert program is not None
+    assert len(program.items) >= 18
+
+
+# ---- Matching and walking (pyrite/io/glob.c and quarry/bridge/glob_bridge.py) ----
+
+GLOB_SOURCES = ["io/glob.c", "io/pathbuf.c", "string/string.c", "collections/list.c"]
+QUARRY_DIR = Path(__file__).resolve().parents[3] / "quarry"
+
+
+def _load_quarry_module(name, relative):
+    # Load the module on its own; importing the quarry package pulls in the
+    # whole installer
+    spec = importlib.util.spec_from_file_location(name, QUARRY_DIR / relative)
+    module = importlib.util.module_from_spec(spec)
+    spec.loader.exec_module(module)
+    return module
+
+
+@pytest.fixture
+def glob_bridge(native, monkeypatch):
+    lib = native.shared("libglob", GLOB_SOURCES)
+    lib.glob_set_new.argtypes = []
+    lib.glob_set_new.restype = ctypes.c_void_p
+    lib.glob_set_add.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+    lib.glob_set_add.restype = ctypes.c_int32
+    lib.glob_set_match.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_int64]
+    lib.glob_set_match.restype = ctypes.c_int32
+    lib.glob_set_free.argtypes = [ctypes.c_void_p]
+    lib.glob_set_free.restype = None
+    lib.glob_walk_open.argtypes = [ctypes.c_char_p, ctypes.c_void_p, ctypes.c_void_p, ctypes.c_int32]
+    lib.glob_walk_open.restype = ctypes.c_void_p
+    lib.glob_walk_next.argtypes = [ctypes.c_void_p]
+    lib.glob_walk_next.restype = ctypes.c_int32
+    lib.glob_walk_relative.argtypes = [ctypes.c_void_p]
+    lib.glob_walk_relative.restype = ctypes.c_char_p
+    lib.glob_walk_close.argtypes = [ctypes.c_void_p]
+    lib.glob_walk_close.restype = None
+    bridge = _load_quarry_module("glob_bridge_under_test", "bridge/glob_bridge.py")
+    monkeypatch.setattr(bridge, "_lib", lib)
+    monkeypatch.setattr(bridge, "USE_FFI", True)
+    return bridge
+
+
+MATCH_CASES = [
+    # ** as a whole segment spans zero or more segments
+    ("**/*.pyrite", "main.pyrite", True),
+    ("**/*.pyrite", "src/a/b/main.pyrite", True),
+    ("src/**/*.pyrite", "src/main.pyrite", True),
+    ("src/**/*.pyrite", "src/a/b/main.pyrite", True),
+    ("src/**/*.pyrite", "srcx/main.pyrite", False),
+    ("src/**", "src/a/b", True),
+    ("src/**", "src", False),
+    ("a/**/b", "a/b", True),
+    ("a/**/b", "a/x/y/b", True),
+    ("a/**/b", "a/xb", False),
+    ("a**b", "a/b", False),
+    ("a**b", "axxb", True),
+    # * and ? stay within a segment
+    ("*.md", "docs/a.md", False),
+    ("?.md", "a.md", True),
+    ("?.md", "/.md", False),
+    ("src/*", "src/a/b", False),
+    # Character classes, ranges and negation
+    ("[abc].txt", "b.txt", True),
+    ("[abc].txt", "d.txt", False),
+    ("[a-c0-9]x", "7x", True),
+    ("[!a-c]x", "dx", True),
+    ("[!a-c]x", "bx", False),
+    ("[^a-c]x", "bx", False),
+    ("[!a]x", "/x", False),
+    ("a[/]b", "a/b", False),
+    ("[]]x", "]x", True),
+    ("[!]]x", "]x", False),
+    ("[a-]x", "-x", True),
+    ("[x", "[x", True),
+    # Escapes
+    ("\\*.md", "*.md", True),
+    ("\\*.md", "a.md", False),
+    ("a\\?", "a?", True),
+    ("a\\?", "ab", False),
+    ("\\[x]", "[x]", True),
+    ("[\\]]x", "]x", True),
+    # Alternation, nested
+    ("*.{pyrite,md}", "a.md", True),
+    ("*.{pyrite,md}", "a.txt", False),
+    ("{src,tests/{unit,e2e}}/*.pyrite", "tests/e2e/a.pyrite", True),
+    ("{src,tests/{unit,e2e}}/*.pyrite", "tests/a.pyrite", False),
+    ("{a}", "{a}", True),
+]
+
+
+def _c_match(bridge, patterns, path):
+    """glob_set_match without the bridge's Python fallback"""
+    handle = bridge._new_set(patterns)
+    try:
+        data = path.encode()
+        return bridge._lib.glob_set_match(handle, data, len(data))
+    finally:
+        bridge._lib.glob_set_free(handle)
+
+
+@pytest.mark.parametrize("pattern,path,expected", MATCH_CASES)
+def test_glob_set_match_cases(glob_bridge, pattern, path, expected):
+    """The C automaton and the Python fallback agree on each documented case"""
+    want = 0 if expected else -1
+    assert _c_match(glob_bridge, [pattern], path) == want
+    assert glob_bridge.glob_match_python([pattern], path) == want
+
+
+def test_glob_set_reports_first_matching_pattern(glob_bridge):
+    """The lowest-indexed pattern wins, on the literal and the automaton paths"""
+    literal = ["docs/README.md", "*.md", "src/**"]
+    general = ["[!x]*.md", "**/*.md", "src/**/a?.md"]
+    for patterns in (literal, general):
+        for path in ("docs/README.md", "a.md", "src/b/ab.md", "src/b/c.txt", "x.txt"):
+            assert _c_match(glob_bridge, patterns, path) == glob_bridge.glob_match_python(patterns, path)
+    assert _c_match(glob_bridge, literal, "docs/README.md") == 0
+    assert _c_match(glob_bridge, literal, "a.md") == 1
+    assert _c_match(glob_bridge, general, "src/b/ab.md") == 1
+    assert _c_match(glob_bridge, general, "xa.md") == 1
+
+
+def test_glob_match_parity_fuzz(glob_bridge):
+    """Random patterns and paths over a small alphabet: C and Python agree"""
+    rng = random.Random(58)
+    pieces = ["a", "b", "/", "*", "**", "?", "[ab]", "[!a]", "[a-b]", "{a,b/}", "\\*", ".", "]", "["]
+    path_chars = "ab/.*]["
+    for _ in range(3000):
+        pattern = "".join(rng.choice(pieces) for _ in range(rng.randint(1, 6)))
+        patterns = [pattern] if rng.random() < 0.7 else [pattern, "".join(rng.choice(pieces) for _ in range(3))]
+        path = "".join(rng.choice(path_chars) for _ in range(rng.randint(0, 8)))
+        assert _c_match(glob_bridge, patterns, path) == glob_bridge.glob_match_python(patterns, path), \
+            (patterns, path)
+
+
+def test_glob_walk_prunes_directories(native):
+    """Directories that cannot match, or are excluded, are never read"""
+    binary = native.executable("glob_walk", ["native/glob_walk.c", *GLOB_SOURCES])
+    assert native.run(binary).strip() == "ok"
+
+
+def _tree(root):
+    for rel in ("src/main.pyrite", "src/sub/util.pyrite", "src/target/gen.pyrite", "docs/guide.md",
+                "target/debug/main", ".git/config", "README.md", "tests/a_test.pyrite"):
+        path = root / rel
+        path.parent.mkdir(parents=True, exist_ok=True)
+        path.write_text(rel)
+
+
+@pytest.mark.parametrize("include,exclude,flags", [
+    (["**/*.pyrite"], None, 1),
+    (["**/*.pyrite"], ["**/target", "**/.*"], 1),
+    (["*"], None, 2),
+    (["src/*", "docs/*"], None, 3),
+    (["**"], ["src/**"], 3),
+    (["{src,tests}/**/*_test.pyrite", "README.md"], None, 1),
+])
+def test_glob_walk_matches_python_fallback(glob_bridge, tmp_path, include, exclude, flags):
+    """Both walkers report the same relative paths in the same order"""
+    _tree(tmp_path)
+    native_result = glob_bridge.glob_files_ffi(tmp_path, include, exclude, flags)
+    assert native_result == glob_bridge.glob_files_python(tmp_path, include, exclude, flags)
+    assert native_result
+
+
+def test_workspace_glob_members(glob_bridge, tmp_path, monkeypatch):
+    """A "crates/*" member expands to the package directories beneath it"""
+    workspace = _load_quarry_module("workspace_under_test", "workspace.py")
+    monkeypatch.setattr(workspace, "glob_files_ffi", glob_bridge.glob_files_ffi, raising=False)
+    monkeypatch.setattr(workspace, "WALK_DIRS", glob_bridge.WALK_DIRS, raising=False)
+    (tmp_path / "Workspace.toml").write_text('[workspace]\nmembers = ["crates/*", "tools/cli"]\n')
+    for package in ("crates/core", "crates/net", "tools/cli"):
+        (tmp_path / package).mkdir(parents=True)
+        (tmp_path / package / "Quarry.toml").write_text("[package]\n")
+    (tmp_path / "crates" / "notes").mkdir()                     # No Quarry.toml
+    (tmp_path / "crates" / "README.md").write_text("crates")    # Not a directory
+    (tmp_path / "crates" / ".hidden").mkdir()
+    (tmp_path / "crates" / ".hidden" / "Quarry.toml").write_text("[package]\n")
+    
+    packages = workspace.get_workspace_packages(tmp_path)
+    assert packages == [(tmp_path / p).resolve() for p in ("crates/core", "crates/net", "tools/cli")]
@@ -0,0 +1,176 @@
+"""Test HTTP server, client and parser declarations"""
+import ctypes
+import socket
+import threading
+import pytest
+import sys
+from pathlib import Path
+
+# Add forge to path
+repo_root = Path(__file__).parent.parent.parent
+compiler_dir = repo_root / "forge"
+sys.path.insert(0, str(compiler_dir))
+
+from src.frontend import lex
+from src.frontend import parse
+
+
+def test_http_extern_declarations():
+    """Test that parser, server and client extern declarations parse"""
+    source = """extern "C" fn http_parse_request(msg: *mut u8, buf: *const u8, len: i64, scanned: i64) -> i64
+extern "C" fn http_message_header(msg: *mut u8, name: *const u8) -> String
+extern "C" fn http_server_poll(server: *mut u8, timeout_ms: i32) -> i32
+extern "C" fn http_server_respond(server: *mut u8, id: i64, status: i32, headers: *const u8, headers_len: i64, body: *const u8, body_len: i64) -> i32
+extern "C" fn http_server_serve_static(server: *mut u8, id: i64, root: *const u8) -> i32
+extern "C" fn http_client_response(client: *mut u8, timeout_ms: i32) -> *mut u8
+"""
+    
+    tokens = lex(source)
+    program = parse(tokens)
+    
+    assert program is not None
+    assert len(program.items) == 6
+
+
+def test_http_module_parses():
+    """Test that the stdlib http.pyrite module parses"""
+    module = repo_root.parent / "pyrite" / "net" / "http.pyrite"
+    
+    tokens = lex(module.read_text())
+    program = parse(tokens)
+    
+    assert program is not None
+    assert len(program.items) >= 40
+
+
+# ---- Native behaviour (pyrite/net/http.c) ----
+
+HTTP_MAX_PATH = 4096
+
+
+@pytest.fixture(scope="module")
+def http_lib(native):
+    lib = native.shared("libhttp", ["net/http.c", "net/reactor.c", "net/socket.c"])
+    lib.http_server_new.argtypes = [ctypes.c_char_p, ctypes.c_int32, ctypes.c_int32]
+    lib.http_server_new.restype = ctypes.c_void_p
+    lib.http_server_port.argtypes = [ctypes.c_void_p]
+    lib.http_server_poll.argtypes = [ctypes.c_void_p, ctypes.c_int32]
+    lib.http_server_request_id.argtypes = [ctypes.c_void_p, ctypes.c_int32]
+    lib.http_server_request_id.restype = ctypes.c_int64
+    lib.http_server_serve_static.argtypes = [ctypes.c_void_p, ctypes.c_int64, ctypes.c_char_p]
+    lib.http_server_free.argtypes = [ctypes.c_void_p]
+    return lib
+
+
+@pytest.fixture
+def static_server(http_lib, tmp_path):
+    """(port, root): serve_static on root/www from a polling thread"""
+    root = tmp_path / "www"
+    (root / "docs").mkdir(parents=True)
+    (root / "index.html").write_text("<p>home</p>")
+    (root / "docs" / "index.html").write_text("<p>docs</p>")
+    (root / "a.txt").write_text("alpha")
+    (root / "b.txt").write_text("bravo")
+    (tmp_path / "secret.txt").write_text("outside root")
+    server = http_lib.http_server_new(b"127.0.0.1", 0, 0)
+    assert server
+    stop = threading.Event()
+    failures = []
+
+    def serve():
+        while not stop.is_set():
+            n = http_lib.http_server_poll(server, 20)
+            for i in range(max(n, 0)):
+                rid = http_lib.http_server_request_id(server, i)
+                if http_lib.http_server_serve_static(server, rid, str(root).encode()) != 0:
+                    failures.append(rid)
+
+    thread = threading.Thread(target=serve, daemon=True)
+    thread.start()
+    yield http_lib.http_server_port(server), root
+    stop.set()
+    thread.join(5)
+    http_lib.http_server_free(server)
+    assert not failures
+
+
+def read_responses(sock, count):
+    """[(status, body)] for count responses read off sock"""
+    data = b""
+    out = []
+    while len(out) < count:
+        head_end = data.find(b"\r\n\r\n")
+        if head_end >= 0:
+            head = data[:head_end].decode()
+            length = 0
+            for line in head.split("\r\n")[1:]:
+                name, _, value = line.partition(":")
+                if name.lower() == "content-length":
+                    length = int(value)
+            if len(data) >= head_end + 4 + length:
+                status = int(head.split(" ")[1])
+                out.append((status, data[head_end + 4:head_end + 4 + length]))
+                data = data[head_end + 4 + length:]
+                continue
+        chunk = sock.recv(65536)
+        assert chunk, f"connection closed after {len(out)} responses"
+        data += chunk
+    return out
+
+
+def get(port, *targets):
+    with socket.create_connection(("127.0.0.1", port), timeout=10) as sock:
+        sock.sendall(b"".join(b"GET %s HTTP/1.1\r\nHost: x\r\n\r\n" % t.encode() for t in targets))
+        return read_responses(sock, len(targets))
+
+
+def test_serve_static_files_and_directory_index(static_server):
+    port, _ = static_server
+    assert get(port, "/a.txt") == [(200, b"alpha")]
+    assert get(port, "/") == [(200, b"<p>home</p>")]
+    assert get(port, "/docs/") == [(200, b"<p>docs</p>")]
+    assert get(port, "/docs") == [(200, b"<p>docs</p>")]
+    assert get(port, "/b%2etxt?x=1") == [(200, b"bravo")]
+    assert get(port, "/missing")[0][0] == 404
+
+
+@pytest.mark.parametrize("target,status", [
+    ("/../secret.txt", 404),
+    ("/docs/../../secret.txt", 404),
+    ("/%2e%2e/secret.txt", 404),
+    ("/docs/%2E%2E/%2e%2e/secret.txt", 404),
+    ("/..", 404),
+    ("/./a.txt", 404),
+    ("/..%5csecret.txt", 404),
+    ("/a%00.txt", 400),
+    ("/a%zz.txt", 400),
+    ("a.txt", 400),
+])
+def test_serve_static_refuses_traversal(static_server, target, status):
+    port, _ = static_server
+    got = get(port, target)
+    assert got[0][0] == status
+    assert b"outside root" not in got[0][1]
+
+
+def test_serve_static_long_paths(static_server):
+    """Paths near the limit get 404/414, never a write past the path buffer"""
+    port, root = static_server
+    base = len(str(root))
+    for length in range(HTTP_MAX_PATH - base - 24, HTTP_MAX_PATH - base + 4):
+        target = "/" + "d" * (length - 2) + "/"
+        status = get(port, target)[0][0]
+        assert status in (404, 414)
+    # Still serving after the long requests
+    assert get(port, "/a.txt") == [(200, b"alpha")]
+
+
+def test_serve_static_pipelined_in_order(static_server):
+    """Pipelined requests on one connection come back in request order"""
+    port, _ = static_server
+    targets = ["/a.txt", "/b.txt", "/missing", "/docs/", "/a.txt"] * 8
+    got = get(port, *targets)
+    expected = {"/a.txt": (200, b"alpha"), "/b.txt": (200, b"bravo"), "/docs/": (200, b"<p>docs</p>")}
+    assert [status for status, _ in got] == [expected.get(t, (404, b""))[0] for t in targets]
+    assert [body for (status, body), t in zip(got, targets) if status == 200] == \
+        [expected[t][1] for t in targets if t in expected]
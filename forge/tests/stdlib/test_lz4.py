@@ -0,0 +1,192 @@
+"""Test LZ4 compression declarations"""
+import ctypes
+import random
+import pytest
+import sys
+from pathlib import Path
+
+# Add forge to path
+repo_root = Path(__file__).parent.parent.parent
+compiler_dir = repo_root / "forge"
+sys.path.insert(0, str(compiler_dir))
+
+from src.frontend import lex
+from src.frontend import parse
+
+
+def test_lz4_extern_declarations():
+    """Test that LZ4 extern declarations parse"""
+    source = """extern "C" fn lz4_compress_bound(src_len: i64) -> i64
+extern "C" fn lz4_compress_block(src: *const u8, src_len: i64, dst: *mut u8, dst_cap: i64, level: i32) -> i64
+extern "C" fn lz4_decompress_block(src: *const u8, src_len: i64, dst: *mut u8, dst_cap: i64) -> i64
+extern "C" fn lz4_frame_compress(src: *const u8, src_len: i64, dst: *mut u8, dst_cap: i64, level: i32, threads: i32, flags: i32) -> i64
+extern "C" fn lz4_frame_decompress(src: *const u8, src_len: i64, dst: *mut u8, dst_cap: i64) -> i64
+extern "C" fn lz4_compress_string(data: *const u8, len: i64, level: i32) -> String
+"""
+    
+    tokens = lex(source)
+    program = parse(tokens)
+    
+    assert program is not None
+    assert len(program.items) == 6
+
+
+def test_lz4_module_parses():
+    """Test that the stdlib lz4.pyrite module parses"""
+    module = repo_root.parent / "pyrite" / "compress" / "lz4.pyrite"
+    
+    tokens = lex(module.read_text())
+    program = parse(tokens)
+    
+    assert program is not None
+    assert len(program.items) >= 12
+
+
+# ---- Native behaviour (pyrite/compress/lz4.c) ----
+
+LZ4_SOURCES = ["compress/lz4.c", "string/string.c", "collections/list.c"]
+
+
+@pytest.fixture(scope="module")
+def lz4_lib(native):
+    lib = native.shared("liblz4", LZ4_SOURCES)
+    i64, i32, buf = ctypes.c_int64, ctypes.c_int32, ctypes.c_char_p
+    lib.lz4_compress_bound.argtypes = [i64]
+    lib.lz4_compress_bound.restype = i64
+    lib.lz4_compress_block.argtypes = [buf, i64, buf, i64, i32]
+    lib.lz4_compress_block.restype = i64
+    lib.lz4_decompress_block.argtypes = [buf, i64, buf, i64]
+    lib.lz4_decompress_block.restype = i64
+    lib.lz4_frame_bound.argtypes = [i64]
+    lib.lz4_frame_bound.restype = i64
+    lib.lz4_frame_compress.argtypes = [buf, i64, buf, i64, i32, i32, i32]
+    lib.lz4_frame_compress.restype = i64
+    lib.lz4_frame_decompress.argtypes = [buf, i64, buf, i64]
+    lib.lz4_frame_decompress.restype = i64
+    lib.lz4_frame_content_size.argtypes = [buf, i64]
+    lib.lz4_frame_content_size.restype = i64
+    lib.lz4_xxh32.argtypes = [buf, i64]
+    lib.lz4_xxh32.restype = ctypes.c_uint32
+    return lib
+
+
+def _samples():
+    rng = random.Random(54)
+    text = b"".join(b"line %d: the quick brown fox jumps over the lazy dog\n" % i for i in range(3000))
+    return {
+        "empty": b"",
+        "tiny": b"abc",
+        "mflimit": b"x" * 13,
+        "zeros": bytes(200000),
+        "random": rng.randbytes(100000),
+        "text": text,
+        "mixed": b"".join(rng.randbytes(rng.randrange(1, 64)) + text[:rng.randrange(4, 300)]
+                          for _ in range(2000)),
+    }
+
+
+def _block_compress(lib, data, level):
+    cap = lib.lz4_compress_bound(len(data))
+    out = ctypes.create_string_buffer(cap)
+    size = lib.lz4_compress_block(data, len(data), out, cap, level)
+    assert size > 0 or not data
+    return out.raw[:size]
+
+
+def _block_decompress(lib, block, size):
+    out = ctypes.create_string_buffer(max(size, 1))
+    assert lib.lz4_decompress_block(block, len(block), out, size) == size
+    return out.raw[:size]
+
+
+@pytest.mark.parametrize("level", [0, 1, 9, 12])
+@pytest.mark.parametrize("name", sorted(_samples()))
+def test_block_round_trip(lz4_lib, name, level):
+    data = _samples()[name]
+    block = _block_compress(lz4_lib, data, level)
+    assert _block_decompress(lz4_lib, block, len(data)) == data
+    if name in ("zeros", "text"):
+        assert len(block) < len(data) // 4
+
+
+def test_block_interoperates_with_reference(lz4_lib):
+    """Blocks decode with the reference implementation and vice versa"""
+    lz4_block = pytest.importorskip("lz4.block")
+    for data in _samples().values():
+        if not data:
+            continue
+        for level in (0, 9):
+            ours = _block_compress(lz4_lib, data, level)
+            assert lz4_block.decompress(ours, uncompressed_size=len(data)) == data
+        theirs = lz4_block.compress(data, store_size=False)
+        assert _block_decompress(lz4_lib, theirs, len(data)) == data
+        theirs_hc = lz4_block.compress(data, mode="high_compression", store_size=False)
+        assert _block_decompress(lz4_lib, theirs_hc, len(data)) == data
+
+
+def test_block_rejects_malformed_input(lz4_lib):
+    data = _samples()["text"]
+    block = _block_compress(lz4_lib, data, 0)
+    out = ctypes.create_string_buffer(len(data))
+    # Output too small, truncated input, offset before the start of output
+    assert lz4_lib.lz4_decompress_block(block, len(block), out, len(data) - 1) == -1
+    assert lz4_lib.lz4_decompress_block(block, len(block) // 2, out, len(data)) == -1
+    bad_offset = bytes([0x10, ord("a"), 0xFF, 0x00])
+    assert lz4_lib.lz4_decompress_block(bad_offset, len(bad_offset), out, len(data)) == -1
+    rng = random.Random(7)
+    for _ in range(200):
+        junk = bytearray(block[:512])
+        junk[rng.randrange(len(junk))] = rng.randrange(256)
+        assert lz4_lib.lz4_decompress_block(bytes(junk), len(junk), out, len(data)) <= len(data)
+
+
+def test_xxh32_vectors(lz4_lib):
+    assert lz4_lib.lz4_xxh32(b"", 0) == 0x02CC5D05
+    assert lz4_lib.lz4_xxh32(b"abc", 3) == 0x32D153FF
+
+
+def _frame_compress(lib, data, level=0, threads=1, flags=0):
+    cap = lib.lz4_frame_bound(len(data))
+    out = ctypes.create_string_buffer(cap)
+    size = lib.lz4_frame_compress(data, len(data), out, cap, level, threads, flags)
+    assert size > 0
+    return out.raw[:size]
+
+
+def _frame_decompress(lib, frame, cap):
+    out = ctypes.create_string_buffer(max(cap, 1))
+    size = lib.lz4_frame_decompress(frame, len(frame), out, cap)
+    return out.raw[:size] if size >= 0 else None
+
+
+@pytest.mark.parametrize("threads,flags", [(1, 0), (4, 0), (4, 1)])
+def test_frame_round_trip_multi_block(lz4_lib, threads, flags):
+    """Frames spanning several 1 MiB blocks decode identically for any thread count"""
+    data = _samples()["mixed"] * 12
+    assert len(data) > 3 * 1024 * 1024
+    frame = _frame_compress(lz4_lib, data, 0, threads, flags)
+    assert frame == _frame_compress(lz4_lib, data, 0, 1, flags)
+    assert lz4_lib.lz4_frame_content_size(frame, len(frame)) == len(data)
+    assert _frame_decompress(lz4_lib, frame, len(data)) == data
+
+
+def test_frame_interoperates_with_reference(lz4_lib):
+    lz4_frame = pytest.importorskip("lz4.frame")
+    data = _samples()["mixed"] * 3
+    for flags in (0, 1):
+        assert lz4_frame.decompress(_frame_compress(lz4_lib, data, 9, 2, flags)) == data
+    theirs = lz4_frame.compress(data, block_checksum=True, content_checksum=True)
+    assert _frame_decompress(lz4_lib, theirs, len(data)) == data
+    # Concatenated frames decode as one stream
+    both = theirs + _frame_compress(lz4_lib, b"tail")
+    assert _frame_decompress(lz4_lib, both, len(data) + 4) == data + b"tail"
+
+
+def test_frame_rejects_corruption(lz4_lib):
+    data = _samples()["text"]
+    frame = bytearray(_frame_compress(lz4_lib, data, 0, 1, 1))
+    assert _frame_decompress(lz4_lib, bytes(frame), len(data) - 1) is None
+    assert _frame_decompress(lz4_lib, bytes(frame[:-3]), len(data)) is None
+    frame[len(frame) // 2] ^= 0x40  # Caught by the block checksum
+    assert _frame_decompress(lz4_lib, bytes(frame), len(data)) is None
+    assert lz4_lib.lz4_frame_content_size(b"not a frame", 11) == -1
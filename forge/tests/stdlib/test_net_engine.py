@@ -0,0 +1,254 @@
+"""Test network engine declarations"""
+import pytest
+import sys
+from pathlib import Path
+
+# Add forge to path
+repo_root = Path(__file__).parent.parent.parent
+compiler_dir = repo_root / "forge"
+sys.path.insert(0, str(compiler_dir))
+
+from src.frontend import lex
+from src.frontend import parse
+
+
+def test_net_engine_extern_declarations():
+    """Test that network engine extern declarations parse"""
+    source = """extern "C" fn net_engine_new(buffer_count: i32, buffer_size: i32, flags: i32) -> *mut u8
+extern "C" fn net_engine_accept(engine: *mut u8, listener: i64, token: i64) -> i32
+extern "C" fn net_engine_send(engine: *mut u8, sock: i64, data: *const u8, len: i64, token: i64, flags: i32) -> i32
+extern "C" fn net_engine_poll(engine: *mut u8, timeout_ms: i32) -> i32
+extern "C" fn net_engine_completion_view(engine: *mut u8, index: i32) -> String
+"""
+    
+    tokens = lex(source)
+    program = parse(tokens)
+    
+    assert program is not None
+    assert len(program.items) == 5
+
+
+def test_engine_module_parses():
+    """Test that the stdlib engine.pyrite module parses"""
+    module = repo_root.parent / "pyrite" / "net" / "engine.pyrite"
+    
+    tokens = lex(module.read_text())
+    program = parse(tokens)
+    
+    assert program is not None
+    assert len(program.items) >= 20
+
+
+# ---- Native behaviour (pyrite/net/engine.c) ----
+
+import ctypes
+import os
+import socket
+import time
+
+ENGINE_SOURCES = ["net/engine.c", "net/reactor.c", "net/socket.c"]
+
+NET_BACKEND_EPOLL = 1
+NET_BACKEND_URING = 2
+NET_ENGINE_FORCE_EPOLL = 1
+NET_OP_ACCEPT = 1
+NET_OP_RECV = 2
+NET_OP_SEND = 3
+NET_SEND_LINK = 1
+NET_SEND_ZC = 2
+NET_CQE_MORE = 1
+ECANCELED = 125
+
+
+@pytest.fixture(scope="module")
+def engine_lib(native):
+    lib = native.shared("libengine", ENGINE_SOURCES)
+    lib.net_engine_new.restype = ctypes.c_void_p
+    lib.net_engine_new.argtypes = [ctypes.c_int32, ctypes.c_int32, ctypes.c_int32]
+    for name in ("net_engine_backend", "net_engine_poll", "net_engine_completion_kind",
+                 "net_engine_completion_flags"):
+        getattr(lib, name).restype = ctypes.c_int32
+    lib.net_engine_backend.argtypes = [ctypes.c_void_p]
+    lib.net_engine_accept.argtypes = [ctypes.c_void_p, ctypes.c_int64, ctypes.c_int64]
+    lib.net_engine_recv.argtypes = [ctypes.c_void_p, ctypes.c_int64, ctypes.c_int64]
+    lib.net_engine_send.argtypes = [ctypes.c_void_p, ctypes.c_int64, ctypes.c_void_p,
+                                    ctypes.c_int64, ctypes.c_int64, ctypes.c_int32]
+    lib.net_engine_cancel.argtypes = [ctypes.c_void_p, ctypes.c_int64]
+    lib.net_engine_poll.argtypes = [ctypes.c_void_p, ctypes.c_int32]
+    for name in ("net_engine_completion_token", "net_engine_completion_result"):
+        getattr(lib, name).restype = ctypes.c_int64
+        getattr(lib, name).argtypes = [ctypes.c_void_p, ctypes.c_int32]
+    for name in ("net_engine_completion_kind", "net_engine_completion_flags"):
+        getattr(lib, name).argtypes = [ctypes.c_void_p, ctypes.c_int32]
+    lib.net_engine_completion_data.restype = ctypes.c_void_p
+    lib.net_engine_completion_data.argtypes = [ctypes.c_void_p, ctypes.c_int32]
+    lib.net_engine_free.argtypes = [ctypes.c_void_p]
+    return lib
+
+
+class Engine:
+    """Thin driver: collects completions as (token, kind, result, flags, payload)"""
+    
+    def __init__(self, lib, flags, buffer_count=64, buffer_size=4096):
+        self.lib = lib
+        self.handle = lib.net_engine_new(buffer_count, buffer_size, flags)
+        assert self.handle
+        self.keep = []  # send buffers must outlive their completions
+    
+    def poll(self, timeout_ms=100):
+        n = self.lib.net_engine_poll(self.handle, timeout_ms)
+        assert n >= 0
+        out = []
+        for i in range(n):
+            result = self.lib.net_engine_completion_result(self.handle, i)
+            data = self.lib.net_engine_completion_data(self.handle, i)
+            payload = ctypes.string_at(data, result) if data and result > 0 else None
+            out.append((self.lib.net_engine_completion_token(self.handle, i),
+                        self.lib.net_engine_completion_kind(self.handle, i), result,
+                        self.lib.net_engine_completion_flags(self.handle, i), payload))
+        return out
+    
+    def poll_until(self, done, timeout=10.0):
+        """Poll, accumulating completions, until done(completions) holds"""
+        seen = []
+        deadline = time.monotonic() + timeout
+        while not done(seen):
+            assert time.monotonic() < deadline, f"timed out; completions so far: {seen}"
+            seen += self.poll()
+        return seen
+    
+    def send(self, sock, data, token, flags=0):
+        buf = ctypes.create_string_buffer(data, len(data))
+        self.keep.append(buf)
+        assert self.lib.net_engine_send(self.handle, sock, buf, len(data), token, flags) == 0
+    
+    def free(self):
+        self.lib.net_engine_free(self.handle)
+
+
+@pytest.fixture(params=["epoll", "default"])
+def engine(request, engine_lib):
+    flags = NET_ENGINE_FORCE_EPOLL if request.param == "epoll" else 0
+    e = Engine(engine_lib, flags)
+    if request.param == "epoll":
+        assert engine_lib.net_engine_backend(e.handle) == NET_BACKEND_EPOLL
+    yield e
+    e.free()
+
+
+@pytest.fixture
+def listener():
+    s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    s.bind(("127.0.0.1", 0))
+    s.listen(16)
+    s.setblocking(False)
+    yield s
+    s.close()
+
+
+def accept_one(engine, listener, token=1):
+    """Arm multishot accept, connect a client, return (client, accepted fd)"""
+    assert engine.lib.net_engine_accept(engine.handle, listener.fileno(), token) == 0
+    client = socket.create_connection(listener.getsockname())
+    seen = engine.poll_until(lambda c: any(k == NET_OP_ACCEPT for _, k, _, _, _ in c))
+    (tok, _, fd, flags, _), = [c for c in seen if c[1] == NET_OP_ACCEPT]
+    assert tok == token and fd >= 0
+    assert flags & NET_CQE_MORE
+    return client, fd
+
+
+def close_fds(fds):
+    for fd in fds:
+        os.close(fd)
+
+
+def recv_all(engine, seen, token):
+    return b"".join(p for t, k, r, _, p in seen if t == token and k == NET_OP_RECV and p)
+
+
+def test_multishot_accept_keeps_accepting(engine, listener):
+    client, fd = accept_one(engine, listener)
+    others = [socket.create_connection(listener.getsockname()) for _ in range(3)]
+    accepted = engine.poll_until(lambda c: len(c) >= 3)
+    assert all(k == NET_OP_ACCEPT and r >= 0 and f & NET_CQE_MORE for _, k, r, f, _ in accepted)
+    
+    assert engine.lib.net_engine_cancel(engine.handle, listener.fileno()) == 0
+    seen = engine.poll_until(lambda c: any(r == -ECANCELED for _, _, r, _, _ in c))
+    (_, kind, _, flags, _), = [c for c in seen if c[2] == -ECANCELED]
+    assert kind == NET_OP_ACCEPT and not flags & NET_CQE_MORE
+    for s in [client, *others]:
+        s.close()
+    close_fds([fd] + [r for _, k, r, _, _ in accepted + seen if k == NET_OP_ACCEPT and r >= 0])
+
+
+def test_multishot_recv_through_recycled_buffers(engine_lib, listener):
+    """More data than the buffer pool holds arrives intact and in order, then EOF"""
+    for flags in (NET_ENGINE_FORCE_EPOLL, 0):
+        engine = Engine(engine_lib, flags, buffer_count=4, buffer_size=1024)
+        try:
+            client, fd = accept_one(engine, listener)
+            assert engine.lib.net_engine_recv(engine.handle, fd, 7) == 0
+            payload = bytes(range(256)) * 1024  # 256 KiB through 4 KiB of buffers
+            client.sendall(payload)
+            client.shutdown(socket.SHUT_WR)
+            seen = engine.poll_until(lambda c: any(t == 7 and r == 0 for t, _, r, _, _ in c))
+            assert recv_all(engine, seen, 7) == payload
+            assert all(len(p) <= 1024 for _, _, _, _, p in seen if p)
+            (_, _, _, flags_eof, _), = [c for c in seen if c[0] == 7 and c[2] == 0]
+            assert not flags_eof & NET_CQE_MORE
+            engine.lib.net_engine_cancel(engine.handle, listener.fileno())
+            engine.poll(0)
+            client.close()
+            close_fds([fd])
+        finally:
+            engine.free()
+
+
+def test_linked_sends_arrive_in_order(engine, listener):
+    client, fd = accept_one(engine, listener)
+    chunks = [bytes([65 + i]) * (200 * 1024) for i in range(5)]
+    for i, chunk in enumerate(chunks):
+        engine.send(fd, chunk, 100 + i, NET_SEND_LINK if i < len(chunks) - 1 else 0)
+    
+    received = bytearray()
+    client.setblocking(False)
+    deadline = time.monotonic() + 10
+    done = []
+    while len(received) < sum(map(len, chunks)) or len(done) < len(chunks):
+        assert time.monotonic() < deadline
+        done += [c for c in engine.poll(10) if c[1] == NET_OP_SEND]
+        try:
+            received += client.recv(1 << 20)
+        except BlockingIOError:
+            pass
+    assert bytes(received) == b"".join(chunks)
+    assert sorted((t, r) for t, _, r, _, _ in done) == [(100 + i, len(c)) for i, c in enumerate(chunks)]
+    client.close()
+    close_fds([fd])
+
+
+def test_zero_copy_send_completes_with_full_length(engine, listener):
+    client, fd = accept_one(engine, listener)
+    data = b"z" * (64 * 1024)
+    engine.send(fd, data, 55, NET_SEND_ZC)
+    client.settimeout(10)
+    received = b""
+    seen = []
+    while len(received) < len(data) or not any(t == 55 for t, *_ in seen):
+        seen += engine.poll(10)
+        received += client.recv(1 << 20) if len(received) < len(data) else b""
+    assert received == data
+    assert [(t, k, r) for t, k, r, _, _ in seen if t == 55] == [(55, NET_OP_SEND, len(data))]
+    client.close()
+    close_fds([fd])
+
+
+def test_cancel_ends_armed_recv(engine, listener):
+    client, fd = accept_one(engine, listener)
+    assert engine.lib.net_engine_recv(engine.handle, fd, 9) == 0
+    assert engine.poll(20) == []  # Armed, nothing to read yet
+    assert engine.lib.net_engine_cancel(engine.handle, fd) == 0
+    seen = engine.poll_until(lambda c: any(t == 9 for t, *_ in c))
+    assert [(k, r) for t, k, r, _, _ in seen if t == 9] == [(NET_OP_RECV, -ECANCELED)]
+    client.close()
+    close_fds([fd])
@@ -1,4 +1,5 @@
 """Test Path operations"""
+import ctypes
 import pytest
 import sys
 from pathlib import Path
@@ -73,3 +74,238 @@ impl Path:
     assert program is not None
     # Should have struct and impl
     assert len(program.items) >= 2
+
+
+def test_path_metadata_declarations():
+    """Test that batched stat and metadata cache declarations parse"""
+    source = """struct PathMeta:
+    size: i64
+    mtime_sec: i64
+    mtime_nsec: i64
+    inode: u64
+    dev: u64
+    kind: i32
+    error: i32
+
+extern "C" fn path_stat(path: *const u8, meta: *mut PathMeta) -> i32
+extern "C" fn path_stat_batch(paths: *const *const u8, count: i64, out: *mut PathMeta) -> i64
+extern "C" fn path_meta_cache_enable(enabled: i32)
+extern "C" fn path_meta_cache_invalidate()
+"""
+    
+    tokens = lex(source)
+    program = parse(tokens)
+    
+    assert program is not None
+    assert len(program.items) >= 5
+    assert program.items[2].name == "path_stat_batch"
+
+
+def test_pathbuf_declarations():
+    """Test that PathBuf and component iterator declarations parse"""
+    source = """struct PathComponent:
+    ptr: *const u8
+    len: i64
+    kind: i32
+
+extern "C" fn pathbuf_new(path: *const u8) -> *mut u8
+extern "C" fn pathbuf_push(buf: *mut u8, comp: *const u8, len: i64) -> i32
+extern "C" fn pathbuf_pop(buf: *mut u8) -> i32
+extern "C" fn path_components_next(it: *mut u8, out: *mut PathComponent) -> i32
+
+struct PathBuf:
+    handle: *mut u8
+
+impl PathBuf:
+    fn pop(&mut self) -> bool:
+        return pathbuf_pop(self.handle) == 1
+"""
+    
+    tokens = lex(source)
+    program = parse(tokens)
+    
+    assert program is not None
+    assert len(program.items) >= 7
+    assert program.items[2].name == "pathbuf_push"
+
+
+# ---- Native behaviour (pyrite/io/path.c) ----
+
+PATH_SOURCES = ["io/path.c", "io/pathbuf.c", "string/string.c", "collections/list.c"]
+
+
+class PathMeta(ctypes.Structure):
+    _fields_ = [("size", ctypes.c_int64), ("mtime_sec", ctypes.c_int64),
+                ("mtime_nsec", ctypes.c_int64), ("inode", ctypes.c_uint64),
+                ("dev", ctypes.c_uint64), ("kind", ctypes.c_int32), ("error", ctypes.c_int32)]
+
+
+@pytest.fixture
+def path_lib(native):
+    lib = native.shared("libpath", PATH_SOURCES)
+    for name in ("path_stat", "path_metadata"):
+        getattr(lib, name).argtypes = [ctypes.c_char_p, ctypes.POINTER(PathMeta)]
+        getattr(lib, name).restype = ctypes.c_int32
+    lib.path_meta_cache_enable.argtypes = [ctypes.c_int32]
+    yield lib
+    lib.path_meta_cache_enable(0)
+
+
+def test_metadata_uses_cache_when_enabled(path_lib, tmp_path):
+    """Path.metadata (path_metadata) answers from the cache; path_stat never does"""
+    target = tmp_path / "f.txt"
+    target.write_bytes(b"abc")
+    meta = PathMeta()
+    
+    assert path_lib.path_metadata(bytes(target), ctypes.byref(meta)) == 1
+    assert meta.size == 3 and meta.kind == 1
+    
+    path_lib.path_meta_cache_enable(1)
+    assert path_lib.path_metadata(bytes(target), ctypes.byref(meta)) == 1
+    target.write_bytes(b"abcdef")
+    assert path_lib.path_metadata(bytes(target), ctypes.byref(meta)) == 1
+    assert meta.size == 3
+    assert path_lib.path_stat(bytes(target), ctypes.byref(meta)) == 1
+    assert meta.size == 6
+    
+    path_lib.path_meta_cache_invalidate()
+    assert path_lib.path_metadata(bytes(target), ctypes.byref(meta)) == 1
+    assert meta.size == 6
+    
+    path_lib.path_meta_cache_enable(0)
+    target.unlink()
+    assert path_lib.path_metadata(bytes(target), ctypes.byref(meta)) == 0
+    assert meta.kind == 0
+
+
+# ---- Native path_utils (pyrite/path_utils/path_utils.c) ----
+
+# The link set documented in pyrite/README.md; pathbuf.c needs string_empty
+PATH_UTILS_SOURCES = ["path_utils/path_utils.c", "io/pathbuf.c", "string/string.c",
+                      "collections/list.c"]
+
+
+@pytest.fixture
+def path_utils_bridge(native, tmp_path, monkeypatch):
+    """quarry/bridge/path_utils_bridge.py loading a libpath_utils.so built from PATH_UTILS_SOURCES"""
+    import importlib.util
+    import shutil
+    lib = native.shared("libpath_utils", PATH_UTILS_SOURCES)
+    # The bridge looks for <its parent's parent>/target/libpath_utils.so
+    (tmp_path / "bridge").mkdir()
+    (tmp_path / "target").mkdir()
+    bridge_src = repo_root.parent / "quarry" / "bridge" / "path_utils_bridge.py"
+    shutil.copy(bridge_src, tmp_path / "bridge" / "path_utils_bridge.py")
+    shutil.copy(lib._name, tmp_path / "target" / "libpath_utils.so")
+    monkeypatch.setenv("PYRITE_USE_PATH_UTILS_FFI", "true")
+    spec = importlib.util.spec_from_file_location(
+        "path_utils_bridge_under_test", tmp_path / "bridge" / "path_utils_bridge.py")
+    bridge = importlib.util.module_from_spec(spec)
+    spec.loader.exec_module(bridge)
+    assert bridge.USE_FFI and bridge._lib is not None, "bridge fell back to Python"
+    bridge.clear_path_cache()
+    yield bridge
+    bridge.clear_path_cache()
+
+
+def test_path_utils_bridge_uses_native_library(path_utils_bridge, tmp_path):
+    """The documented link set loads and the bridge answers natively"""
+    (tmp_path / "real").mkdir()
+    (tmp_path / "link").symlink_to(tmp_path / "real")
+    assert path_utils_bridge.is_absolute_ffi("/x")
+    assert not path_utils_bridge.is_absolute_ffi("x")
+    resolved = path_utils_bridge.resolve_path_ffi("link/a/../b", str(tmp_path))
+    assert resolved == str((tmp_path / "real" / "b").resolve())
+    assert path_utils_bridge.join_paths_ffi("a", "b") == str(Path("a") / "b")
+
+
+def test_resolve_sees_relinked_directory(path_utils_bridge, tmp_path):
+    """deps/foo relinked to a new target: deps/foo/Q resolves under the new one"""
+    (tmp_path / "old").mkdir()
+    (tmp_path / "new").mkdir()
+    (tmp_path / "deps").mkdir()
+    link = tmp_path / "deps" / "foo"
+    link.symlink_to(tmp_path / "old", target_is_directory=True)
+    assert path_utils_bridge.resolve_path_ffi(str(link / "Q")) == str(tmp_path / "old" / "Q")
+    
+    link.unlink()
+    link.symlink_to(tmp_path / "new", target_is_directory=True)
+    assert path_utils_bridge.resolve_path_ffi(str(link / "Q")) == str(tmp_path / "new" / "Q")
+    
+    # A directory replaced by a link (and back) is seen as well
+    link.unlink()
+    link.mkdir()
+    assert path_utils_bridge.resolve_path_ffi(str(link / "Q")) == str(link / "Q")
+
+
+def test_resolve_memo_keyed_by_cwd(path_utils_bridge, tmp_path, monkeypatch):
+    """Relative paths resolve against the current working directory after chdir"""
+    lib = path_utils_bridge._lib
+    out = (ctypes.c_uint8 * 4096)()
+    out_len = ctypes.c_int64(0)
+    
+    def resolve(path):
+        data = path.encode()
+        buf = (ctypes.c_uint8 * len(data)).from_buffer_copy(data)
+        assert lib.resolve_path_c(buf, len(data), None, 0, out, 4096, ctypes.byref(out_len)) == 0
+        return bytes(out[:out_len.value]).decode()
+    
+    (tmp_path / "a").mkdir()
+    (tmp_path / "b").mkdir()
+    monkeypatch.chdir(tmp_path / "a")
+    assert resolve("x/../y") == str(tmp_path / "a" / "y")
+    monkeypatch.chdir(tmp_path / "b")
+    assert resolve("x/../y") == str(tmp_path / "b" / "y")
+    assert path_utils_bridge.resolve_path_ffi("y") == str(tmp_path / "b" / "y")
+
+
+def bind_dirty_check(lib):
+    paths = ctypes.POINTER(ctypes.c_char_p)
+    lib.path_stat_batch.argtypes = [paths, ctypes.c_int64, ctypes.POINTER(PathMeta)]
+    lib.path_stat_batch.restype = ctypes.c_int64
+    lib.path_dirty_check.argtypes = [paths, ctypes.c_int64, ctypes.POINTER(PathMeta),
+                                     ctypes.POINTER(ctypes.c_int64)]
+    lib.path_dirty_check.restype = ctypes.c_int64
+    lib.path_meta_cache_invalidate_path.argtypes = [ctypes.c_char_p]
+
+
+def test_dirty_check_flags_modified_files(path_lib, tmp_path):
+    """A modified file is reported dirty; with the cache on, once its entry is dropped"""
+    bind_dirty_check(path_lib)
+    files = [tmp_path / f"f{i}.pyrite" for i in range(3)]
+    for f in files:
+        f.write_text("fn f(): return")
+    paths = (ctypes.c_char_p * 3)(*(bytes(f) for f in files))
+    recorded = (PathMeta * 3)()
+    dirty = (ctypes.c_int64 * 3)()
+    assert path_lib.path_stat_batch(paths, 3, recorded) == 3
+    assert path_lib.path_dirty_check(paths, 3, recorded, dirty) == 0
+    
+    files[1].write_text("fn f(): return 1")
+    assert path_lib.path_dirty_check(paths, 3, recorded, dirty) == 1
+    assert dirty[0] == 1
+    
+    # The cache answers with what it saw until the watcher drops the path
+    path_lib.path_meta_cache_enable(1)
+    assert path_lib.path_stat_batch(paths, 3, recorded) == 3
+    files[2].write_text("fn f(): return 22")
+    assert path_lib.path_dirty_check(paths, 3, recorded, dirty) == 0
+    path_lib.path_meta_cache_invalidate_path(bytes(files[2]))
+    assert path_lib.path_dirty_check(paths, 3, recorded, dirty) == 1
+    assert dirty[0] == 2
+    
+    files[0].unlink()
+    path_lib.path_meta_cache_invalidate()
+    assert path_lib.path_dirty_check(paths, 3, recorded, dirty) == 2
+    assert list(dirty[:2]) == [0, 2]
+
+
+@pytest.mark.parametrize("variant,flags,rounds", [
+    ("plain", (), 500),
+    ("tsan", ("-fsanitize=thread",), 100),
+])
+def test_meta_cache_toggled_under_concurrent_lookups(native, variant, flags, rounds):
+    """Enable/disable/invalidate while threads read through the cache"""
+    binary = native.executable(f"path_meta_race_{variant}", ["native/path_meta_race.c"] + PATH_SOURCES,
+                               flags)
+    assert native.run(binary, rounds, timeout=120).strip() == "ok"
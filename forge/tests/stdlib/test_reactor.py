@@ -0,0 +1,299 @@
+"""Test reactor and nonblocking TCP declarations"""
+import pytest
+import sys
+from pathlib import Path
+
+# Add forge to path
+repo_root = Path(__file__).parent.parent.parent
+compiler_dir = repo_root / "forge"
+sys.path.insert(0, str(compiler_dir))
+
+from src.frontend import lex
+from src.frontend import parse
+
+
+def test_reactor_extern_declarations():
+    """Test that reactor extern declarations parse"""
+    source = """extern "C" fn reactor_new() -> *mut u8
+extern "C" fn reactor_register(reactor: *mut u8, fd: i64, interest: i32, token: i64) -> i32
+extern "C" fn reactor_timer_add(reactor: *mut u8, after_ms: i64, interval_ms: i64, token: i64) -> i64
+extern "C" fn reactor_poll(reactor: *mut u8, timeout_ms: i32) -> i32
+extern "C" fn tcp_try_send(sock: i64, data: *const u8, len: i64) -> i64
+extern "C" fn tcp_try_recv(sock: i64, buf: *mut u8, len: i64) -> i64
+"""
+    
+    tokens = lex(source)
+    program = parse(tokens)
+    
+    assert program is not None
+    assert len(program.items) == 6
+
+
+def test_net_modules_parse():
+    """Test that the stdlib reactor.pyrite and tcp.pyrite modules parse"""
+    for name in ("reactor.pyrite", "tcp.pyrite"):
+        module = repo_root.parent / "pyrite" / "net" / name
+        
+        tokens = lex(module.read_text())
+        program = parse(tokens)
+        
+        assert program is not None
+        assert len(program.items) >= 15
+
+
+# ---- Native behaviour (pyrite/net/reactor.c, pyrite/net/socket.c) ----
+
+import ctypes
+import errno
+import socket
+import time
+
+REACTOR_READ = 1
+REACTOR_WRITE = 2
+REACTOR_HUP = 4
+REACTOR_TIMER = 16
+TCP_WOULD_BLOCK = -2
+
+
+@pytest.fixture(scope="module")
+def reactor_lib(native):
+    lib = native.shared("libreactor", ["net/reactor.c", "net/socket.c"])
+    lib.reactor_new.argtypes = []
+    lib.reactor_new.restype = ctypes.c_void_p
+    for name in ("reactor_register", "reactor_modify"):
+        getattr(lib, name).argtypes = [ctypes.c_void_p, ctypes.c_int64, ctypes.c_int32, ctypes.c_int64]
+        getattr(lib, name).restype = ctypes.c_int32
+    lib.reactor_unregister.argtypes = [ctypes.c_void_p, ctypes.c_int64]
+    lib.reactor_unregister.restype = ctypes.c_int32
+    lib.reactor_timer_add.argtypes = [ctypes.c_void_p, ctypes.c_int64, ctypes.c_int64, ctypes.c_int64]
+    lib.reactor_timer_add.restype = ctypes.c_int64
+    lib.reactor_timer_cancel.argtypes = [ctypes.c_void_p, ctypes.c_int64]
+    lib.reactor_timer_cancel.restype = ctypes.c_int32
+    lib.reactor_timer_count.argtypes = [ctypes.c_void_p]
+    lib.reactor_timer_count.restype = ctypes.c_int32
+    lib.reactor_poll.argtypes = [ctypes.c_void_p, ctypes.c_int32]
+    lib.reactor_poll.restype = ctypes.c_int32
+    lib.reactor_event_token.argtypes = [ctypes.c_void_p, ctypes.c_int32]
+    lib.reactor_event_token.restype = ctypes.c_int64
+    lib.reactor_event_flags.argtypes = [ctypes.c_void_p, ctypes.c_int32]
+    lib.reactor_event_flags.restype = ctypes.c_int32
+    lib.reactor_free.argtypes = [ctypes.c_void_p]
+    lib.reactor_free.restype = None
+    lib.tcp_try_send.argtypes = [ctypes.c_int64, ctypes.c_char_p, ctypes.c_int64]
+    lib.tcp_try_send.restype = ctypes.c_int64
+    lib.tcp_try_recv.argtypes = [ctypes.c_int64, ctypes.c_char_p, ctypes.c_int64]
+    lib.tcp_try_recv.restype = ctypes.c_int64
+    lib.tcp_connect_nonblocking.argtypes = [ctypes.c_char_p, ctypes.c_int32]
+    lib.tcp_connect_nonblocking.restype = ctypes.c_int64
+    lib.tcp_connect_finish.argtypes = [ctypes.c_int64]
+    lib.tcp_connect_finish.restype = ctypes.c_int32
+    lib.tcp_close.argtypes = [ctypes.c_int64]
+    lib.tcp_close.restype = None
+    return lib
+
+
+@pytest.fixture
+def reactor(reactor_lib):
+    handle = reactor_lib.reactor_new()
+    assert handle
+    yield handle
+    reactor_lib.reactor_free(handle)
+
+
+def poll_events(lib, reactor, timeout_ms):
+    """[(token, flags)] from one reactor_poll"""
+    n = lib.reactor_poll(reactor, timeout_ms)
+    assert n >= 0
+    return [(lib.reactor_event_token(reactor, i), lib.reactor_event_flags(reactor, i)) for i in range(n)]
+
+
+def drain(lib, fd):
+    buf = ctypes.create_string_buffer(65536)
+    data = bytearray()
+    while True:
+        n = lib.tcp_try_recv(fd, buf, len(buf))
+        if n <= 0:
+            return bytes(data), n
+        data += buf.raw[:n]
+
+
+def test_readiness_is_edge_triggered(reactor_lib, reactor, tcp_pair):
+    """Readiness is reported once per transition until the socket is drained"""
+    sender, receiver = tcp_pair
+    receiver.setblocking(False)
+    fd = receiver.fileno()
+    assert reactor_lib.reactor_register(reactor, fd, REACTOR_READ, 42) == 0
+    assert poll_events(reactor_lib, reactor, 20) == []
+    
+    sender.sendall(b"first")
+    events = poll_events(reactor_lib, reactor, 1000)
+    assert len(events) == 1 and events[0][0] == 42 and events[0][1] & REACTOR_READ
+    # Not drained, no new data: no new edge
+    assert poll_events(reactor_lib, reactor, 50) == []
+    
+    sender.sendall(b"second")
+    assert [token for token, _ in poll_events(reactor_lib, reactor, 1000)] == [42]
+    assert drain(reactor_lib, fd) == (b"firstsecond", TCP_WOULD_BLOCK)
+    
+    sender.sendall(b"third")
+    assert [token for token, _ in poll_events(reactor_lib, reactor, 1000)] == [42]
+
+
+def test_modify_and_unregister(reactor_lib, reactor, tcp_pair):
+    sender, receiver = tcp_pair
+    receiver.setblocking(False)
+    fd = receiver.fileno()
+    assert reactor_lib.reactor_register(reactor, fd, REACTOR_READ, 1) == 0
+    assert reactor_lib.reactor_register(reactor, fd, REACTOR_READ, 1) == -1
+    assert ctypes.get_errno() == errno.EEXIST
+    assert reactor_lib.reactor_register(reactor, sender.fileno(), REACTOR_READ, -1) == -1
+    assert ctypes.get_errno() == errno.EINVAL
+    
+    # Switching to write interest (with a new token) reports the writable socket
+    assert reactor_lib.reactor_modify(reactor, fd, REACTOR_WRITE, 7) == 0
+    events = poll_events(reactor_lib, reactor, 1000)
+    assert len(events) == 1 and events[0][0] == 7
+    assert events[0][1] & REACTOR_WRITE and not events[0][1] & REACTOR_READ
+    assert poll_events(reactor_lib, reactor, 20) == []
+    # Re-arming re-reports readiness that is still there
+    assert reactor_lib.reactor_modify(reactor, fd, REACTOR_WRITE, 8) == 0
+    assert [token for token, _ in poll_events(reactor_lib, reactor, 1000)] == [8]
+    
+    assert reactor_lib.reactor_unregister(reactor, fd) == 0
+    sender.sendall(b"ignored")
+    assert poll_events(reactor_lib, reactor, 50) == []
+    assert reactor_lib.reactor_unregister(reactor, fd) == -1
+    assert ctypes.get_errno() == errno.ENOENT
+
+
+def test_peer_close_reports_hangup(reactor_lib, reactor, tcp_pair):
+    sender, receiver = tcp_pair
+    receiver.setblocking(False)
+    assert reactor_lib.reactor_register(reactor, receiver.fileno(), REACTOR_READ, 5) == 0
+    sender.sendall(b"bye")
+    sender.close()
+    events = poll_events(reactor_lib, reactor, 1000)
+    assert len(events) == 1 and events[0][1] & REACTOR_HUP and events[0][1] & REACTOR_READ
+    assert drain(reactor_lib, receiver.fileno()) == (b"bye", 0)
+
+
+def test_one_shot_timers_fire_in_deadline_order(reactor_lib, reactor):
+    for after, token in ((60, 3), (20, 1), (40, 2)):
+        assert reactor_lib.reactor_timer_add(reactor, after, 0, token) > 0
+    assert reactor_lib.reactor_timer_count(reactor) == 3
+    
+    fired = []
+    start = time.monotonic()
+    while len(fired) < 3 and time.monotonic() - start < 5:
+        # -1: only the timerfd can wake this poll
+        for token, flags in poll_events(reactor_lib, reactor, -1):
+            assert flags == REACTOR_TIMER
+            fired.append(token)
+    assert fired == [1, 2, 3]
+    assert time.monotonic() - start >= 0.055
+    assert reactor_lib.reactor_timer_count(reactor) == 0
+    assert poll_events(reactor_lib, reactor, 80) == []
+
+
+def test_periodic_timer_repeats_until_cancelled(reactor_lib, reactor):
+    timer = reactor_lib.reactor_timer_add(reactor, 10, 10, 9)
+    fired = 0
+    start = time.monotonic()
+    while fired < 5 and time.monotonic() - start < 5:
+        fired += sum(1 for token, flags in poll_events(reactor_lib, reactor, 1000)
+                     if token == 9 and flags == REACTOR_TIMER)
+    assert fired == 5
+    assert reactor_lib.reactor_timer_count(reactor) == 1
+    assert reactor_lib.reactor_timer_cancel(reactor, timer) == 1
+    assert reactor_lib.reactor_timer_cancel(reactor, timer) == 0
+    assert reactor_lib.reactor_timer_count(reactor) == 0
+    assert poll_events(reactor_lib, reactor, 50) == []
+
+
+def test_cancel_rejects_stale_timer_ids(reactor_lib, reactor):
+    """An id whose timer already fired does not cancel the timer reusing its slot"""
+    fired_id = reactor_lib.reactor_timer_add(reactor, 0, 0, 1)
+    assert [token for token, _ in poll_events(reactor_lib, reactor, 1000)] == [1]
+    reused = reactor_lib.reactor_timer_add(reactor, 10000, 0, 2)
+    assert reused & 0xffffffff == fired_id & 0xffffffff          # Same slot
+    assert reused != fired_id                                    # New generation
+    assert reactor_lib.reactor_timer_cancel(reactor, fired_id) == 0
+    assert reactor_lib.reactor_timer_count(reactor) == 1
+    
+    cancelled = reactor_lib.reactor_timer_add(reactor, 10000, 0, 3)
+    assert reactor_lib.reactor_timer_cancel(reactor, cancelled) == 1
+    again = reactor_lib.reactor_timer_add(reactor, 10000, 0, 4)
+    assert reactor_lib.reactor_timer_cancel(reactor, cancelled) == 0
+    assert reactor_lib.reactor_timer_cancel(reactor, 0) == 0
+    assert reactor_lib.reactor_timer_cancel(reactor, (1 << 32) | 5000) == 0
+    assert reactor_lib.reactor_timer_count(reactor) == 2
+    assert reactor_lib.reactor_timer_cancel(reactor, again) == 1
+    assert reactor_lib.reactor_timer_cancel(reactor, reused) == 1
+
+
+def test_try_send_and_recv_never_block(reactor_lib, tcp_pair):
+    sender, receiver = tcp_pair
+    sender.setblocking(False)
+    receiver.setblocking(False)
+    buf = ctypes.create_string_buffer(16)
+    assert reactor_lib.tcp_try_recv(receiver.fileno(), buf, 16) == TCP_WOULD_BLOCK
+    assert reactor_lib.tcp_try_recv(receiver.fileno(), buf, -1) == -1
+    assert ctypes.get_errno() == errno.EINVAL
+    assert reactor_lib.tcp_try_send(sender.fileno(), b"", 0) == 0
+    
+    chunk = b"s" * 65536
+    sent = 0
+    while True:
+        n = reactor_lib.tcp_try_send(sender.fileno(), chunk, len(chunk))
+        if n == TCP_WOULD_BLOCK:
+            break
+        assert 0 < n <= len(chunk)
+        sent += n
+    assert sent > 0
+    
+    received = bytearray()
+    while len(received) < sent:
+        data, status = drain(reactor_lib, receiver.fileno())
+        received += data
+        assert status == TCP_WOULD_BLOCK
+        time.sleep(0.01)
+    assert len(received) == sent and set(received) == {ord("s")}
+    
+    sender.shutdown(socket.SHUT_WR)
+    time.sleep(0.02)
+    assert reactor_lib.tcp_try_recv(receiver.fileno(), buf, 16) == 0
+
+
+def test_connect_nonblocking_completes_through_the_reactor(reactor_lib, reactor):
+    listener = socket.socket()
+    listener.bind(("127.0.0.1", 0))
+    listener.listen(1)
+    port = listener.getsockname()[1]
+    sock = reactor_lib.tcp_connect_nonblocking(b"127.0.0.1", port)
+    assert sock >= 0
+    try:
+        assert reactor_lib.reactor_register(reactor, sock, REACTOR_WRITE, 11) == 0
+        events = poll_events(reactor_lib, reactor, 2000)
+        assert events and events[0][0] == 11 and events[0][1] & REACTOR_WRITE
+        assert reactor_lib.tcp_connect_finish(sock) == 0
+        peer, _ = listener.accept()
+        assert reactor_lib.tcp_try_send(sock, b"hi", 2) == 2
+        assert peer.recv(2) == b"hi"
+        peer.close()
+        assert reactor_lib.reactor_unregister(reactor, sock) == 0
+    finally:
+        reactor_lib.tcp_close(sock)
+    
+    # Nothing listens on the port any more: the connect fails
+    listener.close()
+    sock = reactor_lib.tcp_connect_nonblocking(b"127.0.0.1", port)
+    assert sock >= 0
+    try:
+        assert reactor_lib.reactor_register(reactor, sock, REACTOR_WRITE, 12) == 0
+        assert poll_events(reactor_lib, reactor, 2000)
+        assert reactor_lib.tcp_connect_finish(sock) == -1
+        assert ctypes.get_errno() == errno.ECONNREFUSED
+    finally:
+        reactor_lib.tcp_close(sock)
+    
+    assert reactor_lib.tcp_connect_nonblocking(b"not an address", 80) == -1
@@ -0,0 +1,174 @@
+"""Test tar archive declarations"""
+import ctypes
+import hashlib
+import importlib.util
+import io
+import os
+import tarfile
+import pytest
+import sys
+from pathlib import Path
+
+# Add forge to path
+repo_root = Path(__file__).parent.parent.parent
+compiler_dir = repo_root / "forge"
+sys.path.insert(0, str(compiler_dir))
+
+from src.frontend import lex
+from src.frontend import parse
+
+
+def test_tar_extern_declarations():
+    """Test that tar extern declarations parse"""
+    source = """extern "C" fn tar_reader_open(file: *mut u8, flags: i32) -> *mut u8
+extern "C" fn tar_reader_next(handle: *mut u8) -> i32
+extern "C" fn tar_reader_read(handle: *mut u8, buf: *mut u8, cap: i64) -> i64
+extern "C" fn tar_extractor_new(dest: *const u8, workers: i32, flags: i32) -> *mut u8
+extern "C" fn tar_extractor_feed(handle: *mut u8, data: *const u8, len: i64) -> i32
+extern "C" fn tar_extract_file(file: *mut u8, dest: *const u8, workers: i32, digest_out: *mut u8) -> i64
+"""
+    
+    tokens = lex(source)
+    program = parse(tokens)
+    
+    assert program is not None
+    assert len(program.items) == 6
+
+
+def test_tar_module_parses():
+    """Test that the stdlib tar.pyrite module parses"""
+    module = repo_root.parent / "pyrite" / "archive" / "tar.pyrite"
+    
+    tokens = lex(module.read_text())
+    program = parse(tokens)
+    
+    assert program is not None
+    assert len(program.items) >= 28
+
+
+# ---- Extraction safety (pyrite/archive/tar.c and quarry/bridge/tar_bridge.py) ----
+
+TAR_SOURCES = ["archive/tar.c", "string/string.c", "collections/list.c"]
+
+
+def _load_tar_bridge():
+    # Load the bridge module on its own; importing the quarry package pulls
+    # in the whole installer
+    path = Path(__file__).resolve().parents[3] / "quarry" / "bridge" / "tar_bridge.py"
+    spec = importlib.util.spec_from_file_location("tar_bridge_under_test", path)
+    module = importlib.util.module_from_spec(spec)
+    spec.loader.exec_module(module)
+    return module
+
+
+@pytest.fixture
+def tar_bridge(native, monkeypatch):
+    lib = native.shared("libtar", TAR_SOURCES)
+    lib.tar_extractor_new.argtypes = [ctypes.c_char_p, ctypes.c_int32, ctypes.c_int32]
+    lib.tar_extractor_new.restype = ctypes.c_void_p
+    lib.tar_extractor_feed.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_int64]
+    lib.tar_extractor_feed.restype = ctypes.c_int32
+    lib.tar_extractor_finish.argtypes = [ctypes.c_void_p]
+    lib.tar_extractor_finish.restype = ctypes.c_int64
+    lib.tar_extractor_free.argtypes = [ctypes.c_void_p]
+    lib.tar_extractor_free.restype = None
+    bridge = _load_tar_bridge()
+    monkeypatch.setattr(bridge, "_lib", lib)
+    monkeypatch.setattr(bridge, "USE_FFI", True)
+    return bridge
+
+
+def _make_tar(path, members):
+    """members: (name, kind, payload) with kind file/dir/symlink/hardlink"""
+    with tarfile.open(path, "w") as archive:
+        for name, kind, payload in members:
+            info = tarfile.TarInfo(name)
+            if kind == "file":
+                data = payload.encode()
+                info.size = len(data)
+                archive.addfile(info, io.BytesIO(data))
+                continue
+            info.type = {"dir": tarfile.DIRTYPE, "symlink": tarfile.SYMTYPE,
+                         "hardlink": tarfile.LNKTYPE}[kind]
+            info.mode = 0o755 if kind == "dir" else 0o777
+            info.linkname = payload or ""
+            archive.addfile(info)
+    return path
+
+
+# The review's chain: each link is harmless on its own, e escapes once d exists
+CHAIN = [("d", "symlink", "."), ("e", "symlink", "d/d/d/..")]
+ESCAPES = {
+    "chain": CHAIN,
+    "chain_reversed": CHAIN[::-1],
+    "chain_write_through": CHAIN + [("e/evil", "file", "pwned")],
+    "chain_via_dir_link": [("a", "dir", None), ("a/up", "symlink", ".."),
+                           ("b", "symlink", "a/up/a/up/.."), ("b/evil", "file", "pwned")],
+    "absolute_target": [("abs", "symlink", "/etc")],
+    "loop": [("x", "symlink", "y"), ("y", "symlink", "x/..")],
+    "dotdot_name": [("../evil", "file", "pwned")],
+}
+
+
+def _extract(tar_bridge, backend, tarball, dest, monkeypatch):
+    if backend == "native":
+        return tar_bridge.extract_tarball_ffi(tarball, dest)
+    if backend == "python-manual":
+        monkeypatch.delattr(tarfile, "data_filter", raising=False)
+    return tar_bridge.extract_tarball_python(tarball, dest)
+
+
+@pytest.mark.parametrize("backend", ["native", "python", "python-manual"])
+@pytest.mark.parametrize("case", sorted(ESCAPES))
+def test_extract_rejects_escapes(tar_bridge, backend, case, tmp_path, monkeypatch):
+    outside = tmp_path / "outside"
+    dest = outside / "dest"
+    outside.mkdir()
+    tarball = _make_tar(tmp_path / "evil.tar", ESCAPES[case])
+    
+    with pytest.raises(RuntimeError):
+        _extract(tar_bridge, backend, tarball, dest, monkeypatch)
+    assert not (outside / "evil").exists()
+    assert sorted(p.name for p in outside.iterdir()) == ["dest"]
+
+
+def test_native_rejection_is_not_retried_in_python(tar_bridge, tmp_path, monkeypatch):
+    tarball = _make_tar(tmp_path / "evil.tar", CHAIN)
+    monkeypatch.setattr(tar_bridge, "extract_tarball_python",
+                        lambda *args: pytest.fail("fell back to Python"))
+    with pytest.raises(RuntimeError):
+        tar_bridge.extract_tarball_ffi(tarball, tmp_path / "dest")
+
+
+@pytest.mark.parametrize("backend", ["native", "python", "python-manual"])
+def test_extract_refuses_existing_symlink_out_of_dest(tar_bridge, backend, tmp_path, monkeypatch):
+    """Neither files nor hard links are written through a symlink already in dest"""
+    outside = tmp_path / "outside"
+    outside.mkdir()
+    (outside / "secret").write_text("secret")
+    for members in ([("out/x", "file", "pwned")], [("h", "hardlink", "out/secret")]):
+        dest = tmp_path / f"dest-{len(members[0][0])}"
+        dest.mkdir()
+        os.symlink(outside, dest / "out")
+        tarball = _make_tar(tmp_path / "evil.tar", members)
+        with pytest.raises(RuntimeError):
+            _extract(tar_bridge, backend, tarball, dest, monkeypatch)
+        assert not (outside / "x").exists()
+        assert not (dest / "h").exists()
+
+
+@pytest.mark.parametrize("backend", ["native", "python", "python-manual"])
+def test_extract_keeps_contained_links(tar_bridge, backend, tmp_path, monkeypatch):
+    members = [("pkg", "dir", None), ("pkg/real", "dir", None),
+               ("pkg/real/data.txt", "file", "data"),
+               ("pkg/lib", "symlink", "real"),
+               ("pkg/real/up", "symlink", "../lib/data.txt"),
+               ("pkg/self", "symlink", "lib/../lib/./data.txt"),
+               ("pkg/hard.txt", "hardlink", "pkg/real/data.txt")]
+    tarball = _make_tar(tmp_path / "ok.tar", members)
+    dest = tmp_path / "dest"
+    digest = _extract(tar_bridge, backend, tarball, dest, monkeypatch)
+    assert digest == hashlib.sha256(tarball.read_bytes()).hexdigest()
+    for name in ("pkg/lib/data.txt", "pkg/real/up", "pkg/self", "pkg/hard.txt"):
+        assert (dest / name).read_text() == "data"
+    assert os.readlink(dest / "pkg" / "lib") == "real"
@@ -0,0 +1,454 @@
+"""Test TCP listener declarations"""
+import pytest
+import sys
+from pathlib import Path
+
+# Add forge to path
+repo_root = Path(__file__).parent.parent.parent
+compiler_dir = repo_root / "forge"
+sys.path.insert(0, str(compiler_dir))
+
+from src.frontend import lex
+from src.frontend import parse
+
+
+def test_tcp_listener_extern_declarations():
+    """Test that listener and acceptor group extern declarations parse"""
+    source = """extern "C" fn tcp_listen(addr: *const u8, port: i32, backlog: i32, flags: i32) -> i64
+extern "C" fn tcp_accept(listener: i64, flags: i32) -> i64
+extern "C" fn tcp_local_port(sock: i64) -> i32
+extern "C" fn tcp_acceptor_group_open(addr: *const u8, port: i32, backlog: i32, count: i32) -> *mut u8
+extern "C" fn tcp_acceptor_group_listener(group: *mut u8, index: i32) -> i64
+"""
+    
+    tokens = lex(source)
+    program = parse(tokens)
+    
+    assert program is not None
+    assert len(program.items) == 5
+
+
+def test_tcp_send_file_extern_declaration():
+    """Test that the send_file extern declaration parses"""
+    source = """extern "C" fn tcp_send_file(sock: i64, file_fd: i64, offset: i64, len: i64) -> i64
+"""
+    
+    tokens = lex(source)
+    program = parse(tokens)
+    
+    assert program is not None
+    assert len(program.items) == 1
+
+
+def test_tcp_vectored_extern_declarations():
+    """Test that vectored I/O and zero-copy sender extern declarations parse"""
+    source = """extern "C" fn tcp_sendv(sock: i64, parts: *const String, count: i32, timeout_ms: i32, status: *mut i32) -> i64
+extern "C" fn tcp_try_sendv(sock: i64, parts: *const String, count: i32, skip: i64) -> i64
+extern "C" fn tcp_recvv(sock: i64, bufs: *const String, count: i32, flags: i32) -> i64
+extern "C" fn tcp_zc_send(zc: *mut u8, parts: *const String, count: i32, timeout_ms: i32, status: *mut i32) -> i64
+extern "C" fn tcp_zc_wait(zc: *mut u8, ticket: i64, timeout_ms: i32) -> i32
+"""
+    
+    tokens = lex(source)
+    program = parse(tokens)
+    
+    assert program is not None
+    assert len(program.items) == 5
+
+
+def test_tcp_large_transfer_extern_declarations():
+    """Test that 64-bit send_all/recv_exact extern declarations parse"""
+    source = """extern "C" fn tcp_send_all64(sock: i64, data: *const u8, len: i64, timeout_ms: i32, status: *mut i32) -> i64
+extern "C" fn tcp_recv_exact64(sock: i64, buf: *mut u8, len: i64, timeout_ms: i32, status: *mut i32) -> i64
+"""
+    
+    tokens = lex(source)
+    program = parse(tokens)
+    
+    assert program is not None
+    assert len(program.items) == 2
+
+
+def test_tcp_module_parses():
+    """Test that the stdlib tcp.pyrite module parses"""
+    module = repo_root.parent / "pyrite" / "net" / "tcp.pyrite"
+    
+    tokens = lex(module.read_text())
+    program = parse(tokens)
+    
+    assert program is not None
+    assert len(program.items) >= 40
+
+
+# ---- Native behaviour (pyrite/net/socket.c) ----
+
+def test_send_file_splice_returns_progress_when_nonblocking(native):
+    """The splice path hands back partial progress instead of waiting for POLLOUT"""
+    binary = native.executable("send_file_splice", ["native/send_file_splice.c", "net/socket.c"])
+    assert native.run(binary, timeout=60).strip() == "ok"
+
+
+import ctypes
+import os
+import socket
+import threading
+import time
+
+TCP_WOULD_BLOCK = -2
+TCP_RECVV_ALL = 1
+ETIMEDOUT = 110
+
+
+class String(ctypes.Structure):
+    _fields_ = [("data", ctypes.c_char_p), ("len", ctypes.c_int64)]
+
+
+@pytest.fixture(scope="module")
+def socket_lib(native):
+    lib = native.shared("libsocket", ["net/socket.c"])
+    parts = [ctypes.c_int64, ctypes.POINTER(String), ctypes.c_int32]
+    status = [ctypes.c_int32, ctypes.POINTER(ctypes.c_int32)]
+    lib.tcp_sendv.argtypes = parts + status
+    lib.tcp_sendv.restype = ctypes.c_int64
+    lib.tcp_recvv.argtypes = parts + [ctypes.c_int32]
+    lib.tcp_recvv.restype = ctypes.c_int64
+    lib.tcp_zc_open.argtypes = [ctypes.c_int64]
+    lib.tcp_zc_open.restype = ctypes.c_void_p
+    lib.tcp_zc_send.argtypes = [ctypes.c_void_p, ctypes.POINTER(String), ctypes.c_int32] + status
+    lib.tcp_zc_send.restype = ctypes.c_int64
+    lib.tcp_zc_issued.argtypes = [ctypes.c_void_p]
+    lib.tcp_zc_issued.restype = ctypes.c_int64
+    lib.tcp_zc_wait.argtypes = [ctypes.c_void_p, ctypes.c_int64, ctypes.c_int32]
+    lib.tcp_zc_close.argtypes = [ctypes.c_void_p]
+    return lib
+
+
+def string_array(chunks):
+    arr = (String * len(chunks))()
+    for i, chunk in enumerate(chunks):
+        arr[i].data = chunk
+        arr[i].len = len(chunk)
+    return arr
+
+
+def read_exactly(sock, n, out):
+    while len(out) < n:
+        data = sock.recv(1 << 20)
+        if not data:
+            break
+        out += data
+
+
+def test_sendv_reports_progress_and_status(socket_lib, tcp_pair):
+    """A full send buffer ends the call with the bytes sent and a status, never a hang"""
+    sender, receiver = tcp_pair
+    chunks = [bytes([i]) * (1 << 20) for i in range(4)]
+    parts = string_array(chunks)
+    total = sum(map(len, chunks))
+    status = ctypes.c_int32(-99)
+    
+    sent = socket_lib.tcp_sendv(sender.fileno(), parts, 4, 0, ctypes.byref(status))
+    assert 0 < sent < total and status.value == TCP_WOULD_BLOCK
+    payload = b"".join(chunks)
+    more = socket_lib.tcp_sendv(sender.fileno(), string_array([payload[sent:]]), 1, 50,
+                                ctypes.byref(status))
+    assert 0 <= more < total - sent and status.value == ETIMEDOUT
+    sent += more
+    
+    # Resume with the unsent tail while the peer reads
+    received = bytearray()
+    reader = threading.Thread(target=read_exactly, args=(receiver, total, received))
+    reader.start()
+    tail = payload[sent:]
+    rest = socket_lib.tcp_sendv(sender.fileno(), string_array([tail]), 1, -1, ctypes.byref(status))
+    reader.join(30)
+    assert rest == len(tail) and status.value == 0
+    assert bytes(received) == payload
+
+
+def test_sendv_reports_connection_errors(socket_lib, tcp_pair):
+    sender, receiver = tcp_pair
+    receiver.setsockopt(socket.SOL_SOCKET, socket.SO_LINGER, b"\x01\x00\x00\x00\x00\x00\x00\x00")
+    receiver.close()  # RST
+    status = ctypes.c_int32(0)
+    chunk = b"x" * 4096
+    parts = string_array([chunk])
+    for _ in range(100):
+        socket_lib.tcp_sendv(sender.fileno(), parts, 1, 1000, ctypes.byref(status))
+        if status.value != 0:
+            break
+    assert status.value not in (0, TCP_WOULD_BLOCK, ETIMEDOUT)
+
+
+def test_recvv_all_returns_partial_data_when_nonblocking(socket_lib, tcp_pair):
+    sender, receiver = tcp_pair
+    receiver.setblocking(False)
+    bufs = [ctypes.create_string_buffer(64), ctypes.create_string_buffer(64)]
+    arr = (String * 2)()
+    for i, buf in enumerate(bufs):
+        arr[i].data = ctypes.cast(buf, ctypes.c_char_p)
+        arr[i].len = 64
+    assert socket_lib.tcp_recvv(receiver.fileno(), arr, 2, TCP_RECVV_ALL) == TCP_WOULD_BLOCK
+    sender.sendall(b"a" * 80)
+    time.sleep(0.05)
+    assert socket_lib.tcp_recvv(receiver.fileno(), arr, 2, TCP_RECVV_ALL) == 80
+    assert bufs[0].raw == b"a" * 64 and bufs[1].raw[:16] == b"a" * 16
+
+
+def test_zero_copy_send_progress_and_wait(socket_lib, tcp_pair):
+    sender, receiver = tcp_pair
+    zc = socket_lib.tcp_zc_open(sender.fileno())
+    try:
+        payload = bytes(range(256)) * 4096  # 1 MiB, above the zero-copy threshold
+        received = bytearray()
+        reader = threading.Thread(target=read_exactly, args=(receiver, len(payload), received))
+        reader.start()
+        status = ctypes.c_int32(-99)
+        sent = socket_lib.tcp_zc_send(zc, string_array([payload]), 1, 10000, ctypes.byref(status))
+        reader.join(30)
+        assert sent == len(payload) and status.value == 0
+        assert bytes(received) == payload
+        assert socket_lib.tcp_zc_wait(zc, socket_lib.tcp_zc_issued(zc), 5000) == 0
+    finally:
+        socket_lib.tcp_zc_close(zc)
+
+
+TCP_EOF = -3
+
+
+def bind_transfer(lib):
+    lib.tcp_send_all64.argtypes = [ctypes.c_int64, ctypes.c_char_p, ctypes.c_int64, ctypes.c_int32,
+                                   ctypes.POINTER(ctypes.c_int32)]
+    lib.tcp_send_all64.restype = ctypes.c_int64
+    lib.tcp_recv_exact64.argtypes = [ctypes.c_int64, ctypes.c_void_p, ctypes.c_int64, ctypes.c_int32,
+                                     ctypes.POINTER(ctypes.c_int32)]
+    lib.tcp_recv_exact64.restype = ctypes.c_int64
+
+
+def test_send_all64_deadline_and_resume(socket_lib, tcp_pair):
+    bind_transfer(socket_lib)
+    sender, receiver = tcp_pair
+    payload = bytes(range(256)) * 16384  # 4 MiB
+    status = ctypes.c_int32(-99)
+    
+    start = time.monotonic()
+    sent = socket_lib.tcp_send_all64(sender.fileno(), payload, len(payload), 100, ctypes.byref(status))
+    assert status.value == ETIMEDOUT and 0 < sent < len(payload)
+    assert time.monotonic() - start < 5
+    
+    received = bytearray()
+    reader = threading.Thread(target=read_exactly, args=(receiver, len(payload), received))
+    reader.start()
+    rest = socket_lib.tcp_send_all64(sender.fileno(), payload[sent:], len(payload) - sent, -1,
+                                     ctypes.byref(status))
+    reader.join(30)
+    assert rest == len(payload) - sent and status.value == 0
+    assert bytes(received) == payload
+
+
+def test_recv_exact64_progress_eof_and_timeout(socket_lib, tcp_pair):
+    bind_transfer(socket_lib)
+    sender, receiver = tcp_pair
+    buf = ctypes.create_string_buffer(1000)
+    status = ctypes.c_int32(-99)
+    
+    sender.sendall(b"q" * 300)
+    got = socket_lib.tcp_recv_exact64(receiver.fileno(), buf, 1000, 100, ctypes.byref(status))
+    assert got == 300 and status.value == ETIMEDOUT
+    assert socket_lib.tcp_recv_exact64(receiver.fileno(), buf, 1000, 0, ctypes.byref(status)) == 0
+    assert status.value == TCP_WOULD_BLOCK
+    
+    sender.sendall(b"r" * 200)
+    sender.shutdown(socket.SHUT_WR)
+    got = socket_lib.tcp_recv_exact64(receiver.fileno(), ctypes.byref(buf, 300), 700, -1, ctypes.byref(status))
+    assert got == 200 and status.value == TCP_EOF
+    assert buf.raw[:500] == b"q" * 300 + b"r" * 200
+
+
+TCP_LISTEN_REUSEADDR = 1
+TCP_LISTEN_REUSEPORT = 2
+TCP_LISTEN_NONBLOCK = 4
+TCP_LISTEN_V6ONLY = 8
+EADDRINUSE = 98
+EINVAL = 22
+
+needs_ipv6 = pytest.mark.skipif(not socket.has_ipv6, reason="IPv6 is unavailable")
+
+
+def bind_listen(lib):
+    lib.tcp_listen.argtypes = [ctypes.c_char_p, ctypes.c_int32, ctypes.c_int32, ctypes.c_int32]
+    lib.tcp_listen.restype = ctypes.c_int64
+    lib.tcp_accept.argtypes = [ctypes.c_int64, ctypes.c_int32]
+    lib.tcp_accept.restype = ctypes.c_int64
+    lib.tcp_local_port.argtypes = [ctypes.c_int64]
+    lib.tcp_local_port.restype = ctypes.c_int32
+    lib.tcp_close.argtypes = [ctypes.c_int64]
+    lib.tcp_close.restype = None
+    lib.tcp_acceptor_group_open.argtypes = [ctypes.c_char_p, ctypes.c_int32, ctypes.c_int32, ctypes.c_int32]
+    lib.tcp_acceptor_group_open.restype = ctypes.c_void_p
+    lib.tcp_acceptor_group_size.argtypes = [ctypes.c_void_p]
+    lib.tcp_acceptor_group_size.restype = ctypes.c_int32
+    lib.tcp_acceptor_group_listener.argtypes = [ctypes.c_void_p, ctypes.c_int32]
+    lib.tcp_acceptor_group_listener.restype = ctypes.c_int64
+    lib.tcp_acceptor_group_port.argtypes = [ctypes.c_void_p]
+    lib.tcp_acceptor_group_port.restype = ctypes.c_int32
+    lib.tcp_acceptor_group_close.argtypes = [ctypes.c_void_p]
+    lib.tcp_acceptor_group_close.restype = None
+
+
+def accept_all(lib, listener):
+    """Drain a nonblocking listener, closing what it accepted"""
+    count = 0
+    while (conn := lib.tcp_accept(listener, 0)) >= 0:
+        lib.tcp_close(conn)
+        count += 1
+    assert conn == TCP_WOULD_BLOCK
+    return count
+
+
+def connect_clients(family, host, port, count):
+    clients = [socket.create_connection((host, port), timeout=5) for _ in range(count)]
+    assert all(client.family == family for client in clients)
+    time.sleep(0.05)
+    return clients
+
+
+def test_listen_reuseport_shares_one_port(socket_lib):
+    """Two REUSEPORT listeners bind one port and the kernel spreads connections"""
+    bind_listen(socket_lib)
+    flags = TCP_LISTEN_REUSEADDR | TCP_LISTEN_REUSEPORT | TCP_LISTEN_NONBLOCK
+    first = socket_lib.tcp_listen(b"127.0.0.1", 0, 0, flags)
+    assert first >= 0
+    port = socket_lib.tcp_local_port(first)
+    second = socket_lib.tcp_listen(b"127.0.0.1", port, 0, flags)
+    assert second >= 0
+    try:
+        # Without REUSEPORT the port is taken
+        assert socket_lib.tcp_listen(b"127.0.0.1", port, 0, TCP_LISTEN_REUSEADDR) == -1
+        assert ctypes.get_errno() == EADDRINUSE
+        
+        clients = connect_clients(socket.AF_INET, "127.0.0.1", port, 32)
+        counts = [accept_all(socket_lib, first), accept_all(socket_lib, second)]
+        assert sum(counts) == 32 and min(counts) > 0
+        for client in clients:
+            client.close()
+    finally:
+        socket_lib.tcp_close(first)
+        socket_lib.tcp_close(second)
+
+
+@needs_ipv6
+@pytest.mark.parametrize("address", [b"::1", b"[::1]"])
+def test_listen_and_accept_over_ipv6(socket_lib, address):
+    bind_listen(socket_lib)
+    listener = socket_lib.tcp_listen(address, 0, 0, 0)
+    assert listener >= 0
+    try:
+        port = socket_lib.tcp_local_port(listener)
+        assert port > 0
+        client = socket.create_connection(("::1", port), timeout=5)
+        conn = socket_lib.tcp_accept(listener, 0)
+        assert conn >= 0
+        peer = socket.socket(fileno=os.dup(conn))
+        assert peer.family == socket.AF_INET6 and peer.getpeername()[1] == client.getsockname()[1]
+        client.sendall(b"v6")
+        assert peer.recv(2) == b"v6"
+        peer.close()
+        client.close()
+        socket_lib.tcp_close(conn)
+    finally:
+        socket_lib.tcp_close(listener)
+
+
+@needs_ipv6
+def test_listen_dual_stack_unless_v6only(socket_lib):
+    """"::" accepts IPv4 clients as mapped addresses; TCP_LISTEN_V6ONLY refuses them"""
+    bind_listen(socket_lib)
+    listener = socket_lib.tcp_listen(b"::", 0, 0, TCP_LISTEN_NONBLOCK)
+    assert listener >= 0
+    try:
+        port = socket_lib.tcp_local_port(listener)
+        clients = connect_clients(socket.AF_INET, "127.0.0.1", port, 1)
+        clients += connect_clients(socket.AF_INET6, "::1", port, 1)
+        assert accept_all(socket_lib, listener) == 2
+        for client in clients:
+            client.close()
+    finally:
+        socket_lib.tcp_close(listener)
+    
+    listener = socket_lib.tcp_listen(b"::", 0, 0, TCP_LISTEN_V6ONLY | TCP_LISTEN_NONBLOCK)
+    assert listener >= 0
+    try:
+        port = socket_lib.tcp_local_port(listener)
+        with pytest.raises(ConnectionRefusedError):
+            socket.create_connection(("127.0.0.1", port), timeout=5)
+        assert accept_all(socket_lib, listener) == 0
+    finally:
+        socket_lib.tcp_close(listener)
+
+
+def test_listen_backlog_limits_pending_connections(socket_lib):
+    """The accept queue holds backlog + 1 connections; further SYNs wait"""
+    bind_listen(socket_lib)
+    listener = socket_lib.tcp_listen(b"127.0.0.1", 0, 1, TCP_LISTEN_NONBLOCK)
+    assert listener >= 0
+    clients = []
+    try:
+        port = socket_lib.tcp_local_port(listener)
+        for _ in range(4):
+            client = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+            client.setblocking(False)
+            client.connect_ex(("127.0.0.1", port))
+            clients.append(client)
+            time.sleep(0.05)
+        assert accept_all(socket_lib, listener) == 2
+    finally:
+        for client in clients:
+            client.close()
+        socket_lib.tcp_close(listener)
+
+
+def test_listen_rejects_bad_arguments(socket_lib):
+    bind_listen(socket_lib)
+    assert socket_lib.tcp_listen(b"127.0.0.1", 65536, 0, 0) == -1
+    assert ctypes.get_errno() == EINVAL
+    assert socket_lib.tcp_listen(b"127.0.0.1", -1, 0, 0) == -1
+    assert socket_lib.tcp_listen(b"not-an-address", 0, 0, 0) == -1
+    
+    # Nothing pending on a nonblocking listener
+    listener = socket_lib.tcp_listen(b"127.0.0.1", 0, 0, TCP_LISTEN_NONBLOCK)
+    assert socket_lib.tcp_accept(listener, 0) == TCP_WOULD_BLOCK
+    socket_lib.tcp_close(listener)
+
+
+def test_acceptor_group_listeners_share_the_port(socket_lib):
+    """Every listener in the group serves the port; together they accept all"""
+    bind_listen(socket_lib)
+    group = socket_lib.tcp_acceptor_group_open(b"127.0.0.1", 0, 0, 3)
+    assert group
+    try:
+        assert socket_lib.tcp_acceptor_group_size(group) == 3
+        port = socket_lib.tcp_acceptor_group_port(group)
+        listeners = [socket_lib.tcp_acceptor_group_listener(group, i) for i in range(3)]
+        assert len(set(listeners)) == 3
+        assert all(socket_lib.tcp_local_port(listener) == port for listener in listeners)
+        assert socket_lib.tcp_acceptor_group_listener(group, 3) == -1
+        assert socket_lib.tcp_acceptor_group_listener(group, -1) == -1
+        
+        # Listeners are nonblocking, so an idle one reports TCP_WOULD_BLOCK
+        assert all(socket_lib.tcp_accept(listener, 0) == TCP_WOULD_BLOCK for listener in listeners)
+        clients = connect_clients(socket.AF_INET, "127.0.0.1", port, 48)
+        counts = [accept_all(socket_lib, listener) for listener in listeners]
+        assert sum(counts) == 48 and min(counts) > 0
+        for client in clients:
+            client.close()
+    finally:
+        socket_lib.tcp_acceptor_group_close(group)
+    
+    # count <= 0 opens one listener per online CPU
+    group = socket_lib.tcp_acceptor_group_open(b"127.0.0.1", 0, 0, 0)
+    assert group
+    assert socket_lib.tcp_acceptor_group_size(group) == os.cpu_count()
+    socket_lib.tcp_acceptor_group_close(group)
+    assert socket_lib.tcp_acceptor_group_size(None) == 0
+    assert socket_lib.tcp_acceptor_group_port(None) == -1
@@ -0,0 +1,179 @@
+"""Test tensor GEMM declarations"""
+import pytest
+import sys
+from pathlib import Path
+
+# Add forge to path
+repo_root = Path(__file__).parent.parent.parent
+compiler_dir = repo_root / "forge"
+sys.path.insert(0, str(compiler_dir))
+
+from src.frontend import lex
+from src.frontend import parse
+
+
+def test_tensor_gemm_extern_declarations():
+    """Test that matrix multiplication extern declarations parse"""
+    source = """extern "C" fn tensor_matmul(a: *const Tensor, b: *const Tensor) -> Tensor
+extern "C" fn tensor_gemm(alpha: f64, a: *const Tensor, trans_a: i32, b: *const Tensor, trans_b: i32, beta: f64, c: *mut Tensor) -> i32
+extern "C" fn tensor_gemm_use_kernel(kernel: i32) -> i32
+"""
+    
+    tokens = lex(source)
+    program = parse(tokens)
+    
+    assert program is not None
+    assert len(program.items) == 3
+
+
+def test_tensor_parallel_extern_declarations():
+    """Test that thread pool, elementwise and reduction extern declarations parse"""
+    source = """extern "C" fn tensor_set_threads(threads: i32) -> i32
+extern "C" fn tensor_threads() -> i32
+extern "C" fn tensor_add(a: *const Tensor, b: *const Tensor, out: *mut Tensor) -> i32
+extern "C" fn tensor_scale(a: *const Tensor, s: f64, out: *mut Tensor) -> i32
+extern "C" fn tensor_sum(t: *const Tensor) -> f64
+extern "C" fn tensor_dot(a: *const Tensor, b: *const Tensor) -> f64
+extern "C" fn tensor_transpose(a: *const Tensor) -> Tensor
+"""
+    
+    tokens = lex(source)
+    program = parse(tokens)
+    
+    assert program is not None
+    assert len(program.items) == 7
+
+
+def test_tensor_view_extern_declarations():
+    """Test that N-dimensional constructor and view extern declarations parse"""
+    source = """extern "C" fn tensor_new_nd(ndim: i32, shape: *const i64) -> Tensor
+extern "C" fn tensor_slice(t: *const Tensor, axis: i32, start: i64, stop: i64, step: i64) -> Tensor
+extern "C" fn tensor_select(t: *const Tensor, axis: i32, index: i64) -> Tensor
+extern "C" fn tensor_permute(t: *const Tensor, axes: *const i32) -> Tensor
+extern "C" fn tensor_broadcast_to(t: *const Tensor, ndim: i32, shape: *const i64) -> Tensor
+extern "C" fn tensor_reshape(t: *const Tensor, ndim: i32, shape: *const i64) -> Tensor
+extern "C" fn tensor_contiguous(t: *const Tensor) -> Tensor
+"""
+    
+    tokens = lex(source)
+    program = parse(tokens)
+    
+    assert program is not None
+    assert len(program.items) == 7
+
+
+def test_tensor_storage_extern_declarations():
+    """Test that uninitialized constructor and buffer pool extern declarations parse"""
+    source = """extern "C" fn tensor_new_uninit(ndim: i32, shape: *const i64) -> Tensor
+extern "C" fn tensor_set_pool_limit(bytes: i64) -> i64
+extern "C" fn tensor_pool_trim() -> i64
+"""
+    
+    tokens = lex(source)
+    program = parse(tokens)
+    
+    assert program is not None
+    assert len(program.items) == 3
+
+
+def test_tensor_struct_has_strided_layout():
+    """Test that the Tensor struct with shape and stride arrays parses"""
+    source = """struct Tensor:
+    data: *mut f64
+    storage: *mut u8
+    offset: i64
+    ndim: i32
+    shape: [i64; 8]
+    strides: [i64; 8]
+"""
+    
+    tokens = lex(source)
+    program = parse(tokens)
+    
+    assert program is not None
+    assert len(program.items) == 1
+
+
+def test_tensor_expr_extern_declarations():
+    """Test that fused expression extern declarations parse"""
+    source = """extern "C" fn tensor_expr_new() -> *mut u8
+extern "C" fn tensor_expr_input(expr: *mut u8, t: *const Tensor) -> i32
+extern "C" fn tensor_expr_const(expr: *mut u8, value: f64) -> i32
+extern "C" fn tensor_expr_unary(expr: *mut u8, op: i32, x: i32) -> i32
+extern "C" fn tensor_expr_binary(expr: *mut u8, op: i32, x: i32, y: i32) -> i32
+extern "C" fn tensor_expr_eval(expr: *mut u8, node: i32, out: *mut Tensor) -> i32
+extern "C" fn tensor_expr_eval_new(expr: *mut u8, node: i32) -> Tensor
+extern "C" fn tensor_expr_free(expr: *mut u8)
+"""
+    
+    tokens = lex(source)
+    program = parse(tokens)
+    
+    assert program is not None
+    assert len(program.items) == 8
+
+
+def test_tensor_module_parses():
+    """Test that the stdlib tensor.pyrite module parses"""
+    module = repo_root.parent / "pyrite" / "num" / "tensor.pyrite"
+    
+    tokens = lex(module.read_text())
+    program = parse(tokens)
+    
+    assert program is not None
+    assert len(program.items) >= 62
+
+
+# ---- Native behaviour (pyrite/num/tensor.c) ----
+
+SANITIZERS = [
+    ("plain", ()),
+    ("asan", ("-fsanitize=address,undefined", "-fno-omit-frame-pointer")),
+]
+
+
+def tensor_driver(native, name, variant, flags):
+    return native.executable(f"{name}_{variant}", [f"native/{name}.c", "num/tensor.c"], flags)
+
+
+@pytest.mark.parametrize("variant,flags", SANITIZERS, ids=[v for v, _ in SANITIZERS])
+def test_gemm_matches_reference(native, variant, flags):
+    """Every available kernel and transpose combination, exact against a naive loop"""
+    binary = tensor_driver(native, "tensor_gemm", variant, flags)
+    assert native.run(binary, timeout=300).strip() == "ok"
+
+
+@pytest.mark.parametrize("variant,flags,rounds", [
+    ("plain", (), 20),
+    ("asan", ("-fsanitize=address,undefined", "-fno-omit-frame-pointer"), 5),
+    ("tsan", ("-fsanitize=thread",), 2),
+])
+def test_thread_pool_widths_and_concurrent_callers(native, variant, flags, rounds):
+    """Same results at 1, 3, 4, 8 and all threads; reductions bit-identical; racing callers"""
+    binary = tensor_driver(native, "tensor_parallel", variant, flags)
+    assert native.run(binary, rounds, timeout=300).strip() == "ok"
+
+
+@pytest.mark.parametrize("variant,flags", SANITIZERS, ids=[v for v, _ in SANITIZERS])
+def test_strided_views_and_aliasing(native, variant, flags):
+    """Views match a reference index mapping; aliased and broadcast outputs are refused"""
+    binary = tensor_driver(native, "tensor_views", variant, flags)
+    assert native.run(binary, timeout=120).strip() == "ok"
+
+
+@pytest.mark.parametrize("variant,flags", SANITIZERS, ids=[v for v, _ in SANITIZERS])
+def test_fused_expressions_match_unfused(native, variant, flags):
+    """Every op on every instruction set, bit for bit against unfused calls"""
+    binary = tensor_driver(native, "tensor_expr", variant, flags)
+    assert native.run(binary, timeout=120).strip() == "ok"
+
+
+@pytest.mark.parametrize("variant,flags,iterations", [
+    ("plain", (), 20000),
+    ("asan", ("-fsanitize=address,undefined", "-fno-omit-frame-pointer"), 5000),
+    ("tsan", ("-fsanitize=thread",), 2000),
+])
+def test_buffer_pool_alignment_reuse_and_limits(native, variant, flags, iterations):
+    """Aligned buffers, reuse by size class, zero-fill on reuse, the pool cap, threads churning"""
+    binary = tensor_driver(native, "tensor_pool", variant, flags)
+    assert native.run(binary, iterations, timeout=120).strip() == "ok"
@@ -0,0 +1,140 @@
+"""Test UDP socket and datagram ring declarations"""
+import ctypes
+import errno
+import socket
+import pytest
+import sys
+from pathlib import Path
+
+# Add forge to path
+repo_root = Path(__file__).parent.parent.parent
+compiler_dir = repo_root / "forge"
+sys.path.insert(0, str(compiler_dir))
+
+from src.frontend import lex
+from src.frontend import parse
+
+
+def test_udp_extern_declarations():
+    """Test that batched UDP extern declarations parse"""
+    source = """extern "C" fn udp_bind(addr: *const u8, port: i32, flags: i32) -> i64
+extern "C" fn udp_send_batch(sock: i64, datagrams: *const String, count: i32) -> i32
+extern "C" fn udp_send_gso(sock: i64, data: *const u8, len: i64, segment_size: i32) -> i64
+extern "C" fn udp_ring_new(sock: i64, slots: i32, slot_size: i32, flags: i32) -> *mut u8
+extern "C" fn udp_ring_datagram(ring: *mut u8, index: i32) -> String
+"""
+    
+    tokens = lex(source)
+    program = parse(tokens)
+    
+    assert program is not None
+    assert len(program.items) == 5
+
+
+def test_udp_module_parses():
+    """Test that the stdlib udp.pyrite module parses"""
+    module = repo_root.parent / "pyrite" / "net" / "udp.pyrite"
+    
+    tokens = lex(module.read_text())
+    program = parse(tokens)
+    
+    assert program is not None
+    assert len(program.items) >= 30
+
+
+# ---- Native behaviour (pyrite/net/socket.c) ----
+
+UDP_RING_GRO = 1
+
+
+class String(ctypes.Structure):
+    _fields_ = [("data", ctypes.c_void_p), ("len", ctypes.c_int64)]
+
+
+@pytest.fixture(scope="module")
+def udp_lib(native):
+    lib = native.shared("libsocket_udp", ["net/socket.c"])
+    lib.udp_ring_new.argtypes = [ctypes.c_int64, ctypes.c_int32, ctypes.c_int32, ctypes.c_int32]
+    lib.udp_ring_new.restype = ctypes.c_void_p
+    for name in ("udp_ring_recv", "udp_ring_count"):
+        getattr(lib, name).argtypes = [ctypes.c_void_p]
+        getattr(lib, name).restype = ctypes.c_int32
+    lib.udp_ring_datagram.argtypes = [ctypes.c_void_p, ctypes.c_int32]
+    lib.udp_ring_datagram.restype = String
+    lib.udp_ring_truncated.argtypes = [ctypes.c_void_p, ctypes.c_int32]
+    lib.udp_ring_truncated.restype = ctypes.c_int32
+    lib.udp_ring_free.argtypes = [ctypes.c_void_p]
+    return lib
+
+
+@pytest.fixture
+def udp_pair():
+    """(sender, receiver) connected over loopback"""
+    receiver = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    receiver.bind(("127.0.0.1", 0))
+    sender = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sender.connect(receiver.getsockname())
+    yield sender, receiver
+    sender.close()
+    receiver.close()
+
+
+def ring_datagrams(lib, ring):
+    out = []
+    for i in range(lib.udp_ring_count(ring)):
+        view = lib.udp_ring_datagram(ring, i)
+        out.append((ctypes.string_at(view.data, view.len), lib.udp_ring_truncated(ring, i)))
+    return out
+
+
+def test_ring_flags_truncated_datagrams(udp_lib, udp_pair):
+    """A datagram longer than its slot is cut to the slot and flagged"""
+    sender, receiver = udp_pair
+    ring = udp_lib.udp_ring_new(receiver.fileno(), 4, 64, 0)
+    assert ring
+    try:
+        sender.send(b"a" * 64)
+        sender.send(b"b" * 200)
+        sender.send(b"c" * 10)
+        got = []
+        while len(got) < 3:
+            assert udp_lib.udp_ring_recv(ring) > 0
+            got += ring_datagrams(udp_lib, ring)
+        assert got == [(b"a" * 64, 0), (b"b" * 64, 1), (b"c" * 10, 0)]
+        assert udp_lib.udp_ring_truncated(ring, 5) == -1
+    finally:
+        udp_lib.udp_ring_free(ring)
+
+
+def test_gro_ring_requires_whole_buffer_slots(udp_lib, udp_pair):
+    """GRO slots smaller than a coalesced buffer would split truncated data"""
+    _, receiver = udp_pair
+    ring = udp_lib.udp_ring_new(receiver.fileno(), 2, 2048, UDP_RING_GRO)
+    assert not ring
+    assert ctypes.get_errno() == errno.EINVAL
+    ring = udp_lib.udp_ring_new(receiver.fileno(), 2, 65534, UDP_RING_GRO)
+    assert not ring
+    ring = udp_lib.udp_ring_new(receiver.fileno(), 2, 65535, UDP_RING_GRO)
+    if not ring:
+        pytest.skip("UDP_GRO not supported here")
+    udp_lib.udp_ring_free(ring)
+
+
+@pytest.mark.skipif(sys.platform != "linux", reason="UDP_GRO is Linux-only")
+def test_gro_ring_splits_coalesced_datagrams(udp_lib, udp_pair):
+    """Whatever the kernel coalesces comes back as the datagrams sent"""
+    sender, receiver = udp_pair
+    ring = udp_lib.udp_ring_new(receiver.fileno(), 8, 0, UDP_RING_GRO)
+    if not ring:
+        pytest.skip("UDP_GRO not supported here")
+    try:
+        sent = [bytes([i]) * 1000 for i in range(20)] + [b"tail"]
+        for payload in sent:
+            sender.send(payload)
+        got = []
+        while len(got) < len(sent):
+            assert udp_lib.udp_ring_recv(ring) > 0
+            got += ring_datagrams(udp_lib, ring)
+        assert got == [(payload, 0) for payload in sent]
+    finally:
+        udp_lib.udp_ring_free(ring)
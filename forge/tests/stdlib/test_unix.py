@@ -0,0 +1,286 @@
+"""Test Unix domain socket declarations"""
+import pytest
+import sys
+from pathlib import Path
+
+# Add forge to path
+repo_root = Path(__file__).parent.parent.parent
+compiler_dir = repo_root / "forge"
+sys.path.insert(0, str(compiler_dir))
+
+from src.frontend import lex
+from src.frontend import parse
+
+
+def test_unix_extern_declarations():
+    """Test that Unix socket and descriptor passing extern declarations parse"""
+    source = """extern "C" fn unix_listen(path: *const u8, backlog: i32, flags: i32) -> i64
+extern "C" fn unix_connect(path: *const u8, flags: i32) -> i64
+extern "C" fn unix_socketpair(kind: i32, flags: i32, other: *mut i64) -> i64
+extern "C" fn unix_send_fds(sock: i64, data: *const u8, len: i64, fds: *const i32, count: i32) -> i64
+extern "C" fn unix_recv_fds(sock: i64, buf: *mut u8, len: i64, fds: *mut i32, max_fds: i32, fd_count: *mut i32) -> i64
+"""
+    
+    tokens = lex(source)
+    program = parse(tokens)
+    
+    assert program is not None
+    assert len(program.items) == 5
+
+
+def test_unix_module_parses():
+    """Test that the stdlib unix.pyrite module parses"""
+    module = repo_root.parent / "pyrite" / "net" / "unix.pyrite"
+    
+    tokens = lex(module.read_text())
+    program = parse(tokens)
+    
+    assert program is not None
+    assert len(program.items) >= 25
+
+
+# ---- Native behaviour (pyrite/net/socket.c Unix sockets) ----
+
+import ctypes
+import errno
+import os
+
+UNIX_UNLINK = 1
+UNIX_NONBLOCK = 4
+UNIX_STREAM = 1
+UNIX_DATAGRAM = 2
+
+linux_only = pytest.mark.skipif(not sys.platform.startswith("linux"), reason="abstract names and SO_PEERCRED are Linux-only")
+
+
+@pytest.fixture(scope="module")
+def unix_lib(native):
+    lib = native.shared("libsocket_unix", ["net/socket.c"])
+    i32, i64, p = ctypes.c_int32, ctypes.c_int64, ctypes.c_char_p
+    fds = ctypes.POINTER(ctypes.c_int32)
+    lib.unix_listen.argtypes = [p, i32, i32]
+    lib.unix_listen.restype = i64
+    lib.unix_connect.argtypes = [p, i32]
+    lib.unix_connect.restype = i64
+    lib.unix_bind.argtypes = [p, i32]
+    lib.unix_bind.restype = i64
+    lib.unix_socketpair.argtypes = [i32, i32, ctypes.POINTER(i64)]
+    lib.unix_socketpair.restype = i64
+    lib.unix_send_to.argtypes = [i64, p, i64, p]
+    lib.unix_send_to.restype = i64
+    lib.unix_recv_from.argtypes = [i64, p, i64, p, i32]
+    lib.unix_recv_from.restype = i64
+    lib.unix_send_fds.argtypes = [i64, p, i64, fds, i32]
+    lib.unix_send_fds.restype = i64
+    lib.unix_recv_fds.argtypes = [i64, p, i64, fds, i32, fds]
+    lib.unix_recv_fds.restype = i64
+    lib.unix_peer_credentials.argtypes = [i64, fds, fds, fds]
+    lib.unix_peer_credentials.restype = i32
+    lib.unix_local_path.argtypes = [i64, p, i32]
+    lib.unix_local_path.restype = i32
+    lib.tcp_accept.argtypes = [i64, i32]
+    lib.tcp_accept.restype = i64
+    lib.tcp_send.argtypes = [i64, p, i64]
+    lib.tcp_send.restype = i32
+    lib.tcp_recv.argtypes = [i64, p, i64]
+    lib.tcp_recv.restype = i32
+    lib.tcp_close.argtypes = [i64]
+    lib.tcp_close.restype = None
+    return lib
+
+
+@pytest.fixture
+def socketpair(unix_lib):
+    other = ctypes.c_int64(-1)
+    sock = unix_lib.unix_socketpair(UNIX_STREAM, 0, ctypes.byref(other))
+    assert sock >= 0 and other.value >= 0
+    yield sock, other.value
+    unix_lib.tcp_close(sock)
+    unix_lib.tcp_close(other.value)
+
+
+def send_fds(lib, sock, data, fds):
+    arr = (ctypes.c_int32 * len(fds))(*fds)
+    return lib.unix_send_fds(sock, data, len(data), arr, len(fds))
+
+
+def recv_fds(lib, sock, size, max_fds):
+    buf = ctypes.create_string_buffer(size)
+    fds = (ctypes.c_int32 * max(max_fds, 1))()
+    count = ctypes.c_int32(-1)
+    n = lib.unix_recv_fds(sock, buf, size, fds, max_fds, ctypes.byref(count))
+    return n, buf.raw[:max(n, 0)], list(fds[:count.value])
+
+
+def local_path(lib, sock):
+    buf = ctypes.create_string_buffer(128)
+    n = lib.unix_local_path(sock, buf, len(buf))
+    assert n >= 0
+    return buf.raw[:n].decode()
+
+
+def test_passed_fd_refers_to_the_same_file(unix_lib, socketpair, tmp_path):
+    """The received descriptor shares the sender's open file, offset included"""
+    sender, receiver = socketpair
+    path = tmp_path / "shared.txt"
+    fd = os.open(path, os.O_RDWR | os.O_CREAT, 0o644)
+    try:
+        os.write(fd, b"head:")
+        assert send_fds(unix_lib, sender, b"file", [fd]) == 4
+        
+        n, data, received = recv_fds(unix_lib, receiver, 16, 4)
+        assert (n, data) == (4, b"file")
+        assert len(received) == 1 and received[0] != fd
+        try:
+            mine, theirs = os.fstat(fd), os.fstat(received[0])
+            assert (theirs.st_dev, theirs.st_ino) == (mine.st_dev, mine.st_ino)
+            # One open file description: writes continue at the shared offset
+            os.write(received[0], b"tail")
+            assert os.lseek(fd, 0, os.SEEK_CUR) == 9
+            assert path.read_bytes() == b"head:tail"
+            assert not os.get_inheritable(received[0])
+        finally:
+            os.close(received[0])
+        
+        # The sender's descriptor stays open
+        os.fstat(fd)
+    finally:
+        os.close(fd)
+
+
+def test_fds_without_data_and_extras_beyond_max_fds(unix_lib, socketpair):
+    """An empty message carries one zero byte; descriptors past max_fds are closed"""
+    sender, receiver = socketpair
+    r, w = os.pipe()
+    try:
+        assert send_fds(unix_lib, sender, b"", [r, w]) == 0
+        n, data, received = recv_fds(unix_lib, receiver, 16, 4)
+        assert (n, data) == (1, b"\0")
+        assert len(received) == 2
+        os.write(received[1], b"x")
+        assert os.read(r, 1) == b"x"
+        for got in received:
+            os.close(got)
+        
+        before = set(os.listdir("/proc/self/fd"))
+        assert send_fds(unix_lib, sender, b"ab", [r, w, r]) == 2
+        n, data, received = recv_fds(unix_lib, receiver, 16, 1)
+        assert (n, data) == (2, b"ab")
+        assert len(received) == 1
+        os.close(received[0])
+        assert set(os.listdir("/proc/self/fd")) == before
+    finally:
+        os.close(r)
+        os.close(w)
+
+
+def test_send_fds_rejects_bad_counts(unix_lib, socketpair):
+    """More than UNIX_MAX_FDS (253) descriptors, or a negative count, is EINVAL"""
+    sender, receiver = socketpair
+    assert send_fds(unix_lib, sender, b"x", [0] * 254) == -1
+    assert ctypes.get_errno() == errno.EINVAL
+    assert unix_lib.unix_send_fds(sender, b"x", 1, None, -1) == -1
+    assert ctypes.get_errno() == errno.EINVAL
+    
+    # No descriptors is a plain send
+    assert send_fds(unix_lib, sender, b"x", []) == 1
+    assert recv_fds(unix_lib, receiver, 16, 4) == (1, b"x", [])
+
+
+def stream_round_trip(lib, name):
+    listener = lib.unix_listen(name.encode(), 0, UNIX_UNLINK)
+    assert listener >= 0
+    client = lib.unix_connect(name.encode(), 0)
+    assert client >= 0
+    server = lib.tcp_accept(listener, 0)
+    assert server >= 0
+    try:
+        assert local_path(lib, listener) == name
+        assert lib.tcp_send(client, b"ping", 4) == 4
+        buf = ctypes.create_string_buffer(8)
+        assert lib.tcp_recv(server, buf, 8) == 4 and buf.raw[:4] == b"ping"
+        
+        pid, uid, gid = ctypes.c_int32(), ctypes.c_int32(), ctypes.c_int32()
+        assert lib.unix_peer_credentials(server, ctypes.byref(pid), ctypes.byref(uid), ctypes.byref(gid)) == 0
+        assert (pid.value, uid.value, gid.value) == (os.getpid(), os.getuid(), os.getgid())
+    finally:
+        for sock in (server, client, listener):
+            lib.tcp_close(sock)
+
+
+@linux_only
+def test_stream_sockets_on_paths(unix_lib, tmp_path):
+    """A stale socket file blocks bind unless UNIX_UNLINK removes it"""
+    name = str(tmp_path / "s.sock")
+    stream_round_trip(unix_lib, name)
+    assert os.path.exists(name)
+    assert unix_lib.unix_listen(name.encode(), 0, 0) == -1
+    assert ctypes.get_errno() == errno.EADDRINUSE
+    stream_round_trip(unix_lib, name)
+    
+    assert unix_lib.unix_listen(("/" + "x" * 200).encode(), 0, 0) == -1
+    assert ctypes.get_errno() == errno.ENAMETOOLONG
+
+
+@linux_only
+def test_stream_sockets_on_abstract_names(unix_lib, tmp_path):
+    """Abstract names leave nothing on disk"""
+    before = set(os.listdir(tmp_path))
+    stream_round_trip(unix_lib, f"@pyrite-test-{os.getpid()}")
+    assert set(os.listdir(tmp_path)) == before
+    assert unix_lib.unix_connect(f"@pyrite-test-{os.getpid()}".encode(), 0) == -1
+    assert ctypes.get_errno() == errno.ECONNREFUSED
+
+
+@linux_only
+def test_datagram_autobind_and_reply(unix_lib, tmp_path):
+    """An autobound client gets an abstract name the server can reply to"""
+    server_path = str(tmp_path / "d.sock").encode()
+    server = unix_lib.unix_bind(server_path, UNIX_UNLINK)
+    client = unix_lib.unix_bind(None, UNIX_NONBLOCK)
+    assert server >= 0 and client >= 0
+    try:
+        client_name = local_path(unix_lib, client)
+        assert client_name.startswith("@") and len(client_name) > 1
+        
+        assert unix_lib.unix_send_to(client, b"one", 3, server_path) == 3
+        assert unix_lib.unix_send_to(client, b"two!", 4, server_path) == 4
+        buf = ctypes.create_string_buffer(16)
+        sender = ctypes.create_string_buffer(128)
+        # Message boundaries are kept
+        assert unix_lib.unix_recv_from(server, buf, 16, sender, 128) == 3
+        assert buf.raw[:3] == b"one"
+        assert sender.value.decode() == client_name
+        assert unix_lib.unix_recv_from(server, buf, 16, None, 0) == 4
+        
+        assert unix_lib.unix_send_to(server, b"back", 4, sender.value) == 4
+        assert unix_lib.unix_recv_from(client, buf, 16, sender, 128) == 4
+        assert buf.raw[:4] == b"back"
+        assert sender.value == server_path
+        
+        assert unix_lib.unix_recv_from(client, buf, 16, None, 0) == -2
+    finally:
+        unix_lib.tcp_close(server)
+        unix_lib.tcp_close(client)
+
+
+def test_datagram_socketpair_keeps_boundaries(unix_lib):
+    """Each datagram arrives whole with its own descriptors"""
+    other = ctypes.c_int64(-1)
+    sock = unix_lib.unix_socketpair(UNIX_DATAGRAM, UNIX_NONBLOCK, ctypes.byref(other))
+    assert sock >= 0
+    try:
+        assert unix_lib.unix_send_to(sock, b"abc", 3, None) == -1
+        assert ctypes.get_errno() == errno.EINVAL
+        assert send_fds(unix_lib, sock, b"abc", [0]) == 3
+        assert send_fds(unix_lib, sock, b"de", [1]) == 2
+        n, data, received = recv_fds(unix_lib, other.value, 16, 2)
+        assert (n, data, len(received)) == (3, b"abc", 1)
+        os.close(received[0])
+        n, data, received = recv_fds(unix_lib, other.value, 16, 2)
+        assert (n, data, len(received)) == (2, b"de", 1)
+        os.close(received[0])
+        assert recv_fds(unix_lib, other.value, 16, 2)[0] == -2
+    finally:
+        unix_lib.tcp_close(sock)
+        unix_lib.tcp_close(other.value)
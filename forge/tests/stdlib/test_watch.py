@@ -0,0 +1,123 @@
+"""Test the inotify file watcher (pyrite/io/watch.c) through FileWatcher"""
+import sys
+import time
+from pathlib import Path
+
+import pytest
+
+# Add forge to path
+compiler_dir = Path(__file__).parent.parent.parent
+sys.path.insert(0, str(compiler_dir))
+
+from src.utils import file_watch
+from src.utils.file_watch import FileWatcher
+from src.utils.incremental import IncrementalCompiler, CacheEntry
+
+WATCH_SOURCES = ["io/watch.c", "io/path.c", "io/pathbuf.c", "string/string.c", "collections/list.c"]
+
+pytestmark = pytest.mark.skipif(not sys.platform.startswith("linux"), reason="inotify is Linux-only")
+
+
+@pytest.fixture
+def watch_lib(native, monkeypatch):
+    lib = file_watch._bind(native.shared("libwatch", WATCH_SOURCES))
+    monkeypatch.setattr(file_watch, "_lib", lib)
+    return lib
+
+
+def test_watcher_reports_and_resets_changes(watch_lib, tmp_path):
+    """Changes are coalesced into one set, and taking it empties it"""
+    (tmp_path / "sub").mkdir()
+    with FileWatcher(tmp_path, debounce_ms=20) as watcher:
+        assert watcher.available
+        (tmp_path / "a.pyrite").write_text("fn main(): return")
+        (tmp_path / "sub" / "b.pyrite").write_text("fn b(): return")
+        (tmp_path / "a.pyrite").write_text("fn main(): return 1")
+        
+        assert watcher.wait(5000) >= 2
+        changes = watcher.take_changes()
+        assert str(tmp_path.resolve() / "a.pyrite") in changes
+        assert str(tmp_path.resolve() / "sub" / "b.pyrite") in changes
+        
+        assert watcher.wait(100) == 0
+        assert watcher.take_changes() == set()
+        
+        # Directories created after the watch started are watched too
+        (tmp_path / "new").mkdir()
+        time.sleep(0.05)
+        (tmp_path / "new" / "c.pyrite").write_text("fn c(): return")
+        assert watcher.wait(5000) >= 1
+        assert str(tmp_path.resolve() / "new" / "c.pyrite") in watcher.take_changes()
+
+
+def test_watched_changes_drive_incremental_check(watch_lib, tmp_path):
+    """Only sources the watcher reported are rehashed, once per saved cache"""
+    src = tmp_path / "src"
+    src.mkdir()
+    main = src / "main.pyrite"
+    other = src / "other.pyrite"
+    main.write_text("fn main(): return")
+    other.write_text("fn other(): return")
+    
+    compiler = IncrementalCompiler(tmp_path / "cache")
+    for path in (main, other):
+        compiler.cache_entries[str(path)] = CacheEntry(
+            module_path=str(path), source_hash=compiler.compute_file_hash(path),
+            dependencies=[], dependency_hashes={}, compiled_at=time.time(),
+            compiler_version=compiler.COMPILER_VERSION)
+    
+    with FileWatcher(src, debounce_ms=20) as watcher:
+        main.write_text("fn main(): return 2")
+        assert watcher.wait(5000) >= 1
+        compiler.set_watched_changes(watcher.take_changes())
+    
+    hashed = []
+    real_hash = compiler.compute_file_hash
+    compiler.compute_file_hash = lambda path: hashed.append(str(path)) or real_hash(path)
+    assert compiler.should_recompile(str(main)) == (True, "Source changed")
+    assert compiler.should_recompile(str(other)) == (False, "Cache valid")
+    assert hashed == [str(main)]
+    
+    # Saving the cache ends the build: the next one must bring its own set
+    compiler.save_cache_metadata()
+    assert compiler.watched_changes is None
+
+
+def test_renamed_directories_report_new_paths(watch_lib, tmp_path):
+    """After a rename inside the tree, events use the directory's new path"""
+    root = tmp_path.resolve()
+    (root / "a" / "deep").mkdir(parents=True)
+    (root / "a" / "f.pyrite").write_text("fn f(): return")
+    (root / "a" / "deep" / "g.pyrite").write_text("fn g(): return")
+    with FileWatcher(root, debounce_ms=20) as watcher:
+        (root / "a").rename(root / "b")
+        assert watcher.wait(5000) >= 1
+        watcher.take_changes()
+        
+        (root / "b" / "f.pyrite").write_text("fn f(): return 1")
+        (root / "b" / "deep" / "g.pyrite").write_text("fn g(): return 1")
+        assert watcher.wait(5000) >= 2
+        changes = watcher.take_changes()
+        assert str(root / "b" / "f.pyrite") in changes
+        assert str(root / "b" / "deep" / "g.pyrite") in changes
+        assert not any(path.startswith(str(root / "a") + "/") for path in changes)
+        
+        # A sibling whose name starts with the old one keeps its path
+        (root / "ab").mkdir()
+        time.sleep(0.05)
+        (root / "b").rename(root / "c")
+        assert watcher.wait(5000) >= 1
+        watcher.take_changes()
+        (root / "ab" / "h.pyrite").write_text("fn h(): return")
+        (root / "c" / "deep" / "g.pyrite").write_text("fn g(): return 2")
+        assert watcher.wait(5000) >= 2
+        changes = watcher.take_changes()
+        assert str(root / "ab" / "h.pyrite") in changes
+        assert str(root / "c" / "deep" / "g.pyrite") in changes
+
+
+def test_wait_reports_errors(watch_lib, tmp_path, monkeypatch):
+    """A failing watch_wait surfaces as -1 so the watch loop can stop"""
+    with FileWatcher(tmp_path, debounce_ms=20) as watcher:
+        monkeypatch.setattr(watch_lib, "watch_wait", lambda handle, timeout: -1)
+        assert watcher.wait(0) == -1
@@ -6,6 +6,7 @@ pytestmark = pytest.mark.integration  # All tests in this file are integration t
 from src.frontend import lex
 from src.frontend import parse
 from src.middle import TypeChecker
+from src.types import VOID
 from src import ast
 
 
@@ -130,3 +131,32 @@ def test_function_pointer_in_struct():
     assert len(struct.fields) == 1
     field = struct.fields[0]
     assert isinstance(field.type_annotation, ast.FunctionType)
+
+
+def test_void_function_as_value_matches_void_fn_type():
+    """Test that a function without a return type passes as fn(T), and only there"""
+    source = """extern "C" fn coro_spawn(scheduler: *mut u8, entry: fn(*mut u8), arg: *mut u8) -> i64
+extern "C" fn set_callback(cb: fn(i64) -> i64)
+
+fn worker(arg: *mut u8):
+    pass
+
+fn start(scheduler: *mut u8, arg: *mut u8) -> i64:
+    return coro_spawn(scheduler, worker, arg)
+
+fn main():
+    set_callback(worker)
+"""
+    program = parse(lex(source))
+    type_checker = TypeChecker()
+    type_checker.check_program(program)
+
+    messages = [str(error) for error in type_checker.errors]
+    assert len(messages) == 1, messages
+    assert "expected fn(i64) -> i64, got fn(*mut u8)" in messages[0]
+
+    # The value has the function's own type: void return, same as the fn(T) annotation
+    value_type = type_checker.check_identifier(ast.Identifier(name="worker", span=program.span))
+    entry_type = type_checker.resolve_type(program.items[0].params[1].type_annotation)
+    assert value_type.return_type == VOID
+    assert value_type == entry_type
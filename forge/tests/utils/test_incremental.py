@@ -245,6 +245,54 @@ class TestIncrementalCompiler:
             assert should is False
             assert "Cache valid" in reason
     
+    def test_should_recompile_skips_hash_when_unwatched(self):
+        """Test that sources outside the watcher's change set are not rehashed"""
+        with tempfile.TemporaryDirectory() as tmpdir:
+            compiler = IncrementalCompiler(Path(tmpdir))
+            
+            test_file = Path(tmpdir) / "test.pyrite"
+            test_file.write_text("fn main():\n    print('hello')")
+            
+            entry = CacheEntry(
+                module_path=str(test_file),
+                source_hash="stale_hash",
+                dependencies=[],
+                dependency_hashes={},
+                compiled_at=time.time(),
+                compiler_version=compiler.COMPILER_VERSION
+            )
+            compiler.cache_entries[str(test_file)] = entry
+            
+            # Watcher reported nothing: trust the cache without hashing
+            compiler.set_watched_changes(set())
+            compiler.compute_file_hash = lambda path: pytest.fail("source was rehashed")
+            should, reason = compiler.should_recompile(str(test_file))
+            assert should is False
+            assert "Cache valid" in reason
+    
+    def test_should_recompile_hashes_watched_change(self):
+        """Test that sources in the watcher's change set are rehashed"""
+        with tempfile.TemporaryDirectory() as tmpdir:
+            compiler = IncrementalCompiler(Path(tmpdir))
+            
+            test_file = Path(tmpdir) / "test.pyrite"
+            test_file.write_text("fn main():\n    print('hello')")
+            
+            entry = CacheEntry(
+                module_path=str(test_file),
+                source_hash="stale_hash",
+                dependencies=[],
+                dependency_hashes={},
+                compiled_at=time.time(),
+                compiler_version=compiler.COMPILER_VERSION
+            )
+            compiler.cache_entries[str(test_file)] = entry
+            
+            compiler.set_watched_changes({str(test_file)})
+            should, reason = compiler.should_recompile(str(test_file))
+            assert should is True
+            assert "Source changed" in reason
+    
     def test_save_and_load_cache_entry(self):
         """Test cache entry persistence"""
         with tempfile.TemporaryDirectory() as tmpdir:
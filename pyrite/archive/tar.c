@@ -0,0 +1,2099 @@
+/* Tar archives (ustar/pax) - C implementation
+ *
+ * Streaming reader, writer and extractor for POSIX ustar archives, including
+ * pax extended headers (long names, large sizes, sub-second mtimes) and GNU
+ * long-name entries. Nothing buffers the whole archive:
+ *
+ *   - TarReader pulls 512-byte blocks from a FILE* and hands out entry data
+ *     in caller-sized pieces.
+ *   - TarExtractor is a push parser fed arbitrary chunks (e.g. straight from
+ *     a gzip or LZ4 decoder). Small regular files are handed to a pool of
+ *     writer threads while the archive keeps streaming; large files are
+ *     written as their data arrives.
+ *   - TarWriter emits entries (optionally reproducible) to a FILE*.
+ *
+ * Reader and extractor compute a SHA-256 of every raw archive byte as it
+ * streams past (and the reader optionally a digest per entry), so checksum
+ * verification and extraction happen in one pass.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#endif
+
+#define TAR_BLOCK 512
+#define TAR_RECORD 10240
+#define TAR_NAME_MAX 4096
+#define TAR_META_MAX (1 << 20)
+#define TAR_CHUNK (256 * 1024)
+
+/* Entry kinds (tar_reader_kind) */
+#define TAR_KIND_FILE 0
+#define TAR_KIND_DIR 1
+#define TAR_KIND_SYMLINK 2
+#define TAR_KIND_HARDLINK 3
+#define TAR_KIND_OTHER 4
+
+/* Reader flags */
+#define TAR_HASH_ENTRIES 1
+
+/* Writer flags: zero mtimes/owners and normalize modes to 0644/0755 */
+#define TAR_WRITE_REPRODUCIBLE 1
+
+/* Extraction pool: files up to TAR_POOL_MAX_FILE bytes are buffered and
+ * written by worker threads; at most TAR_POOL_MAX_INFLIGHT bytes are queued. */
+#define TAR_MAX_WORKERS 16
+#define TAR_POOL_MAX_FILE (1 << 20)
+#define TAR_POOL_MAX_INFLIGHT (64 << 20)
+
+/* String structure (from string.c) */
+typedef struct {
+    char* data;
+    int64_t len;
+} String;
+
+extern String string_new(const char* cstr);
+
+/* SHA-256 (streaming) */
+
+typedef struct {
+    uint32_t h[8];
+    uint64_t total_len;
+    uint8_t buffer[64];
+    size_t buffer_len;
+} sha256_ctx;
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+    0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+    0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+    0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+    0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+    0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+#define CH(x, y, z) (((x) & (y)) ^ (~(x) & (z)))
+#define MAJ(x, y, z) (((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+#define EP0(x) (ROTR(x, 2) ^ ROTR(x, 13) ^ ROTR(x, 22))
+#define EP1(x) (ROTR(x, 6) ^ ROTR(x, 11) ^ ROTR(x, 25))
+#define SIG0(x) (ROTR(x, 7) ^ ROTR(x, 18) ^ ((x) >> 3))
+#define SIG1(x) (ROTR(x, 17) ^ ROTR(x, 19) ^ ((x) >> 10))
+
+static void sha256_init(sha256_ctx* ctx) {
+    ctx->h[0] = 0x6a09e667;
+    ctx->h[1] = 0xbb67ae85;
+    ctx->h[2] = 0x3c6ef372;
+    ctx->h[3] = 0xa54ff53a;
+    ctx->h[4] = 0x510e527f;
+    ctx->h[5] = 0x9b05688c;
+    ctx->h[6] = 0x1f83d9ab;
+    ctx->h[7] = 0x5be0cd19;
+    ctx->total_len = 0;
+    ctx->buffer_len = 0;
+}
+
+static void sha256_transform(sha256_ctx* ctx, const uint8_t* data) {
+    uint32_t w[64];
+    uint32_t a, b, c, d, e, f, g, h;
+    int i;
+    
+    for (i = 0; i < 16; i++) {
+        w[i] = ((uint32_t)data[i * 4] << 24) | ((uint32_t)data[i * 4 + 1] << 16) |
+               ((uint32_t)data[i * 4 + 2] << 8) | (uint32_t)data[i * 4 + 3];
+    }
+    
+    for (i = 16; i < 64; i++) {
+        w[i] = SIG1(w[i - 2]) + w[i - 7] + SIG0(w[i - 15]) + w[i - 16];
+    }
+    
+    a = ctx->h[0]; b = ctx->h[1]; c = ctx->h[2]; d = ctx->h[3];
+    e = ctx->h[4]; f = ctx->h[5]; g = ctx->h[6]; h = ctx->h[7];
+    
+    for (i = 0; i < 64; i++) {
+        uint32_t t1 = h + EP1(e) + CH(e, f, g) + sha256_k[i] + w[i];
+        uint32_t t2 = EP0(a) + MAJ(a, b, c);
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+    
+    ctx->h[0] += a; ctx->h[1] += b; ctx->h[2] += c; ctx->h[3] += d;
+    ctx->h[4] += e; ctx->h[5] += f; ctx->h[6] += g; ctx->h[7] += h;
+}
+
+static void sha256_update(sha256_ctx* ctx, const uint8_t* data, size_t len) {
+    ctx->total_len += len;
+    
+    /* Finish a partial block, then transform whole blocks in place */
+    if (ctx->buffer_len > 0) {
+        size_t to_copy = 64 - ctx->buffer_len;
+        if (to_copy > len) {
+            to_copy = len;
+        }
+        memcpy(ctx->buffer + ctx->buffer_len, data, to_copy);
+        ctx->buffer_len += to_copy;
+        data += to_copy;
+        len -= to_copy;
+        if (ctx->buffer_len < 64) {
+            return;
+        }
+        sha256_transform(ctx, ctx->buffer);
+        ctx->buffer_len = 0;
+    }
+    
+    while (len >= 64) {
+        sha256_transform(ctx, data);
+        data += 64;
+        len -= 64;
+    }
+    
+    if (len > 0) {
+        memcpy(ctx->buffer, data, len);
+        ctx->buffer_len = len;
+    }
+}
+
+static void sha256_final(sha256_ctx* ctx, uint8_t* hash) {
+    uint64_t bit_len = ctx->total_len * 8;
+    int i;
+    
+    ctx->buffer[ctx->buffer_len++] = 0x80;
+    
+    if (ctx->buffer_len > 56) {
+        while (ctx->buffer_len < 64) {
+            ctx->buffer[ctx->buffer_len++] = 0;
+        }
+        sha256_transform(ctx, ctx->buffer);
+        ctx->buffer_len = 0;
+    }
+    
+    while (ctx->buffer_len < 56) {
+        ctx->buffer[ctx->buffer_len++] = 0;
+    }
+    
+    for (i = 7; i >= 0; i--) {
+        ctx->buffer[ctx->buffer_len++] = (bit_len >> (i * 8)) & 0xff;
+    }
+    
+    sha256_transform(ctx, ctx->buffer);
+    
+    for (i = 0; i < 8; i++) {
+        hash[i * 4] = (ctx->h[i] >> 24) & 0xff;
+        hash[i * 4 + 1] = (ctx->h[i] >> 16) & 0xff;
+        hash[i * 4 + 2] = (ctx->h[i] >> 8) & 0xff;
+        hash[i * 4 + 3] = ctx->h[i] & 0xff;
+    }
+}
+
+/* Digest of everything hashed so far, leaving the context usable */
+static void sha256_peek(const sha256_ctx* ctx, uint8_t* hash) {
+    sha256_ctx copy = *ctx;
+    sha256_final(&copy, hash);
+}
+
+/* Header decoding */
+
+typedef struct {
+    char name[TAR_NAME_MAX];
+    char link_name[TAR_NAME_MAX];
+    int64_t size;
+    int64_t mtime;
+    int32_t mode;
+    int32_t kind;
+    int64_t data_size;  /* bytes of data following the header */
+} TarEntry;
+
+/* Overrides from pax ('x') and GNU ('L'/'K') entries for the next header */
+typedef struct {
+    char path[TAR_NAME_MAX];
+    char link_path[TAR_NAME_MAX];
+    int64_t size;
+    int64_t mtime;
+    int32_t has_path;
+    int32_t has_link_path;
+    int32_t has_size;
+    int32_t has_mtime;
+} TarPending;
+
+#define TAR_HDR_BAD -1
+#define TAR_HDR_END 0
+#define TAR_HDR_ENTRY 1
+#define TAR_HDR_META 2
+
+static int64_t tar_round_up(int64_t n) {
+    return (n + TAR_BLOCK - 1) & ~(int64_t)(TAR_BLOCK - 1);
+}
+
+/* Parse an octal field, or a GNU base-256 field when the high bit is set */
+static int64_t tar_parse_number(const uint8_t* field, int len) {
+    int64_t value = 0;
+    int i = 0;
+    
+    if (field[0] & 0x80) {
+        value = field[0] & 0x7f;
+        for (i = 1; i < len; i++) {
+            value = (value << 8) | field[i];
+        }
+        return value;
+    }
+    
+    while (i < len && (field[i] == ' ' || field[i] == 0)) {
+        i++;
+    }
+    while (i < len && field[i] >= '0' && field[i] <= '7') {
+        value = (value << 3) | (field[i] - '0');
+        i++;
+    }
+    return value;
+}
+
+static int tar_block_is_zero(const uint8_t* block) {
+    for (int i = 0; i < TAR_BLOCK; i++) {
+        if (block[i] != 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Accept both the unsigned (POSIX) and signed (old Sun tar) checksum */
+static int tar_checksum_ok(const uint8_t* block) {
+    int64_t sum = 0;
+    int64_t signed_sum = 0;
+    
+    for (int i = 0; i < TAR_BLOCK; i++) {
+        uint8_t c = (i >= 148 && i < 156) ? ' ' : block[i];
+        sum += c;
+        signed_sum += (int8_t)c;
+    }
+    
+    int64_t stored = tar_parse_number(block + 148, 8);
+    return stored == sum || stored == signed_sum;
+}
+
+/* Copy a fixed-width, possibly unterminated header field */
+static size_t tar_copy_field(char* dst, size_t dst_cap, const uint8_t* field, size_t width) {
+    size_t len = 0;
+    while (len < width && field[len] != 0) {
+        len++;
+    }
+    if (len >= dst_cap) {
+        len = dst_cap - 1;
+    }
+    memcpy(dst, field, len);
+    dst[len] = '\0';
+    return len;
+}
+
+static void tar_set_pending_string(char* dst, const char* src, size_t len) {
+    if (len >= TAR_NAME_MAX) {
+        len = TAR_NAME_MAX - 1;
+    }
+    memcpy(dst, src, len);
+    dst[len] = '\0';
+}
+
+/* Decode one header block. META headers carry data the caller collects and
+ * passes to tar_apply_meta; *meta_type receives their typeflag. */
+static int tar_decode_header(const uint8_t* block, TarPending* pending, TarEntry* out, char* meta_type) {
+    if (tar_block_is_zero(block)) {
+        return TAR_HDR_END;
+    }
+    if (!tar_checksum_ok(block)) {
+        return TAR_HDR_BAD;
+    }
+    
+    char type = (char)block[156];
+    int64_t size = tar_parse_number(block + 124, 12);
+    if (size < 0) {
+        return TAR_HDR_BAD;
+    }
+    
+    if (type == 'x' || type == 'g' || type == 'L' || type == 'K') {
+        *meta_type = type;
+        out->size = size;
+        out->data_size = size;
+        return TAR_HDR_META;
+    }
+    
+    /* Name: pax/GNU override, else ustar prefix + "/" + name */
+    if (pending->has_path) {
+        memcpy(out->name, pending->path, strlen(pending->path) + 1);
+    } else if (memcmp(block + 257, "ustar", 5) == 0 && block[345] != 0) {
+        size_t len = tar_copy_field(out->name, TAR_NAME_MAX, block + 345, 155);
+        out->name[len++] = '/';
+        tar_copy_field(out->name + len, TAR_NAME_MAX - len, block, 100);
+    } else {
+        tar_copy_field(out->name, TAR_NAME_MAX, block, 100);
+    }
+    
+    if (pending->has_link_path) {
+        memcpy(out->link_name, pending->link_path, strlen(pending->link_path) + 1);
+    } else {
+        tar_copy_field(out->link_name, TAR_NAME_MAX, block + 157, 100);
+    }
+    
+    out->size = pending->has_size ? pending->size : size;
+    out->mtime = pending->has_mtime ? pending->mtime : tar_parse_number(block + 136, 12);
+    out->mode = (int32_t)(tar_parse_number(block + 100, 8) & 07777);
+    
+    /* Only regular (and unknown, per POSIX) entries carry data */
+    switch (type) {
+        case '0': case '\0': case '7':
+            out->kind = TAR_KIND_FILE;
+            out->data_size = out->size;
+            break;
+        case '5':
+            out->kind = TAR_KIND_DIR;
+            out->data_size = 0;
+            break;
+        case '2':
+            out->kind = TAR_KIND_SYMLINK;
+            out->data_size = 0;
+            break;
+        case '1':
+            out->kind = TAR_KIND_HARDLINK;
+            out->data_size = 0;
+            break;
+        case '3': case '4': case '6':
+            out->kind = TAR_KIND_OTHER;
+            out->data_size = 0;
+            break;
+        default:
+            out->kind = TAR_KIND_OTHER;
+            out->data_size = out->size;
+            break;
+    }
+    
+    /* Old-style directories: regular entry whose name ends in '/' */
+    size_t name_len = strlen(out->name);
+    if (out->kind == TAR_KIND_FILE && name_len > 0 && out->name[name_len - 1] == '/') {
+        out->kind = TAR_KIND_DIR;
+    }
+    
+    pending->has_path = 0;
+    pending->has_link_path = 0;
+    pending->has_size = 0;
+    pending->has_mtime = 0;
+    return TAR_HDR_ENTRY;
+}
+
+/* Apply a pax extended header or GNU long name/link to the pending state */
+static void tar_apply_meta(TarPending* pending, char type, const char* data, int64_t len) {
+    if (type == 'L' || type == 'K') {
+        size_t n = 0;
+        while ((int64_t)n < len && data[n] != 0) {
+            n++;
+        }
+        if (type == 'L') {
+            tar_set_pending_string(pending->path, data, n);
+            pending->has_path = 1;
+        } else {
+            tar_set_pending_string(pending->link_path, data, n);
+            pending->has_link_path = 1;
+        }
+        return;
+    }
+    
+    /* Global headers apply to the whole archive; none of their keys matter here */
+    if (type != 'x') {
+        return;
+    }
+    
+    /* Records: "<len> <key>=<value>\n", where len counts the whole record */
+    int64_t pos = 0;
+    while (pos < len) {
+        int64_t record_len = 0;
+        int64_t i = pos;
+        while (i < len && data[i] >= '0' && data[i] <= '9') {
+            record_len = record_len * 10 + (data[i] - '0');
+            i++;
+        }
+        if (i >= len || data[i] != ' ' || record_len <= 0 || pos + record_len > len) {
+            return;
+        }
+        
+        const char* key = data + i + 1;
+        const char* end = data + pos + record_len - 1;  /* trailing '\n' */
+        const char* eq = memchr(key, '=', (size_t)(end - key));
+        if (eq) {
+            size_t key_len = (size_t)(eq - key);
+            const char* value = eq + 1;
+            size_t value_len = (size_t)(end - value);
+            
+            if (key_len == 4 && memcmp(key, "path", 4) == 0) {
+                tar_set_pending_string(pending->path, value, value_len);
+                pending->has_path = 1;
+            } else if (key_len == 8 && memcmp(key, "linkpath", 8) == 0) {
+                tar_set_pending_string(pending->link_path, value, value_len);
+                pending->has_link_path = 1;
+            } else if (key_len == 4 && memcmp(key, "size", 4) == 0) {
+                pending->size = strtoll(value, NULL, 10);
+                pending->has_size = 1;
+            } else if (key_len == 5 && memcmp(key, "mtime", 5) == 0) {
+                pending->mtime = strtoll(value, NULL, 10);
+                pending->has_mtime = 1;
+            }
+        }
+        pos += record_len;
+    }
+}
+
+/* Pull reader over a FILE* */
+
+typedef struct {
+    FILE* in;
+    int32_t flags;
+    int32_t state;  /* 0 = between entries, 1 = in entry, 2 = end, -1 = error */
+    TarEntry entry;
+    TarPending pending;
+    int64_t remaining;
+    int64_t padding;
+    sha256_ctx archive_hash;
+    sha256_ctx entry_hash;
+    uint8_t entry_digest[32];
+    int32_t entry_digest_ready;
+} TarReader;
+
+/* Read up to len bytes, feeding everything through the archive digest */
+static int64_t tar_reader_fill(TarReader* r, uint8_t* buf, int64_t len) {
+    size_t got = fread(buf, 1, (size_t)len, r->in);
+    sha256_update(&r->archive_hash, buf, got);
+    return (int64_t)got;
+}
+
+static int tar_reader_skip(TarReader* r, int64_t len, int hash_entry) {
+    uint8_t buf[8192];
+    while (len > 0) {
+        int64_t n = len < (int64_t)sizeof(buf) ? len : (int64_t)sizeof(buf);
+        int64_t got = tar_reader_fill(r, buf, n);
+        if (got <= 0) {
+            return 0;
+        }
+        if (hash_entry && (r->flags & TAR_HASH_ENTRIES)) {
+            sha256_update(&r->entry_hash, buf, (size_t)got);
+        }
+        len -= got;
+    }
+    return 1;
+}
+
+static void tar_reader_entry_done(TarReader* r) {
+    if (r->flags & TAR_HASH_ENTRIES) {
+        sha256_final(&r->entry_hash, r->entry_digest);
+        r->entry_digest_ready = 1;
+    }
+}
+
+/* Open a reader on a FILE* (from file_open). Returns NULL on allocation failure. */
+void* tar_reader_open(void* in_file, int32_t flags) {
+    if (!in_file) {
+        return NULL;
+    }
+    TarReader* r = calloc(1, sizeof(TarReader));
+    if (!r) {
+        return NULL;
+    }
+    r->in = (FILE*)in_file;
+    r->flags = flags;
+    sha256_init(&r->archive_hash);
+    return r;
+}
+
+/* Advance to the next entry, skipping unread data of the current one.
+ * Returns 1 for an entry, 0 at end of archive, -1 on a malformed archive. */
+int32_t tar_reader_next(void* handle) {
+    TarReader* r = (TarReader*)handle;
+    if (!r || r->state < 0) {
+        return -1;
+    }
+    if (r->state == 2) {
+        return 0;
+    }
+    
+    if (r->state == 1) {
+        int64_t data_left = r->remaining;
+        if (!tar_reader_skip(r, data_left, 1)) {
+            r->state = -1;
+            return -1;
+        }
+        r->remaining = 0;
+        if (data_left > 0) {
+            tar_reader_entry_done(r);
+        }
+        if (!tar_reader_skip(r, r->padding, 0)) {
+            r->state = -1;
+            return -1;
+        }
+        r->padding = 0;
+        r->state = 0;
+    }
+    
+    uint8_t block[TAR_BLOCK];
+    for (;;) {
+        int64_t got = tar_reader_fill(r, block, TAR_BLOCK);
+        if (got == 0) {
+            /* Missing end-of-archive marker: tolerated like GNU tar */
+            r->state = 2;
+            return 0;
+        }
+        if (got < TAR_BLOCK) {
+            r->state = -1;
+            return -1;
+        }
+        
+        char meta_type = 0;
+        int kind = tar_decode_header(block, &r->pending, &r->entry, &meta_type);
+        if (kind == TAR_HDR_BAD) {
+            r->state = -1;
+            return -1;
+        }
+        
+        if (kind == TAR_HDR_END) {
+            /* Drain trailing zero records so the digest covers the whole file */
+            uint8_t buf[8192];
+            while (tar_reader_fill(r, buf, sizeof(buf)) > 0) {
+            }
+            r->state = 2;
+            return 0;
+        }
+        
+        if (kind == TAR_HDR_META) {
+            int64_t size = r->entry.data_size;
+            if (size > TAR_META_MAX) {
+                r->state = -1;
+                return -1;
+            }
+            char* data = malloc((size_t)tar_round_up(size) + 1);
+            if (!data || tar_reader_fill(r, (uint8_t*)data, tar_round_up(size)) != tar_round_up(size)) {
+                free(data);
+                r->state = -1;
+                return -1;
+            }
+            tar_apply_meta(&r->pending, meta_type, data, size);
+            free(data);
+            continue;
+        }
+        
+        r->state = 1;
+        r->remaining = r->entry.data_size;
+        r->padding = tar_round_up(r->entry.data_size) - r->entry.data_size;
+        r->entry_digest_ready = 0;
+        if (r->flags & TAR_HASH_ENTRIES) {
+            sha256_init(&r->entry_hash);
+        }
+        if (r->remaining == 0) {
+            tar_reader_entry_done(r);
+        }
+        return 1;
+    }
+}
+
+/* Read data of the current entry. Returns bytes read, 0 at end of entry, -1 on error. */
+int64_t tar_reader_read(void* handle, uint8_t* buf, int64_t cap) {
+    TarReader* r = (TarReader*)handle;
+    if (!r || r->state < 0 || !buf || cap < 0) {
+        return -1;
+    }
+    if (r->state != 1 || r->remaining == 0) {
+        return 0;
+    }
+    
+    int64_t n = cap < r->remaining ? cap : r->remaining;
+    int64_t got = tar_reader_fill(r, buf, n);
+    if (got < n) {
+        r->state = -1;
+        return -1;
+    }
+    if (r->flags & TAR_HASH_ENTRIES) {
+        sha256_update(&r->entry_hash, buf, (size_t)got);
+    }
+    
+    r->remaining -= got;
+    if (r->remaining == 0) {
+        tar_reader_entry_done(r);
+        if (!tar_reader_skip(r, r->padding, 0)) {
+            r->state = -1;
+            return -1;
+        }
+        r->padding = 0;
+    }
+    return got;
+}
+
+String tar_reader_name(void* handle) {
+    TarReader* r = (TarReader*)handle;
+    return string_new(r ? r->entry.name : "");
+}
+
+String tar_reader_link_name(void* handle) {
+    TarReader* r = (TarReader*)handle;
+    return string_new(r ? r->entry.link_name : "");
+}
+
+int64_t tar_reader_size(void* handle) {
+    TarReader* r = (TarReader*)handle;
+    return r ? r->entry.size : -1;
+}
+
+int64_t tar_reader_mtime(void* handle) {
+    TarReader* r = (TarReader*)handle;
+    return r ? r->entry.mtime : -1;
+}
+
+int32_t tar_reader_mode(void* handle) {
+    TarReader* r = (TarReader*)handle;
+    return r ? r->entry.mode : -1;
+}
+
+int32_t tar_reader_kind(void* handle) {
+    TarReader* r = (TarReader*)handle;
+    return r ? r->entry.kind : -1;
+}
+
+/* SHA-256 of the current entry's data (TAR_HASH_ENTRIES). Available once the
+ * data has been fully read; returns 1 if out (32 bytes) was filled. */
+int32_t tar_reader_entry_digest(void* handle, uint8_t* out) {
+    TarReader* r = (TarReader*)handle;
+    if (!r || !out || !r->entry_digest_ready) {
+        return 0;
+    }
+    memcpy(out, r->entry_digest, 32);
+    return 1;
+}
+
+/* SHA-256 of all archive bytes consumed so far. After tar_reader_next has
+ * returned 0 this equals the digest of the whole archive file. */
+int32_t tar_reader_archive_digest(void* handle, uint8_t* out) {
+    TarReader* r = (TarReader*)handle;
+    if (!r || !out) {
+        return 0;
+    }
+    sha256_peek(&r->archive_hash, out);
+    return 1;
+}
+
+/* Free the reader (the FILE* stays open) */
+void tar_reader_close(void* handle) {
+    free(handle);
+}
+
+/* Writer */
+
+typedef struct {
+    FILE* out;
+    int32_t flags;
+    int32_t failed;
+    int64_t written;
+} TarWriter;
+
+static void tar_writer_put(TarWriter* w, const void* data, size_t len) {
+    if (w->failed || len == 0) {
+        return;
+    }
+    if (fwrite(data, 1, len, w->out) != len) {
+        w->failed = 1;
+        return;
+    }
+    w->written += (int64_t)len;
+}
+
+static void tar_writer_pad(TarWriter* w, int64_t len) {
+    static const uint8_t zeros[TAR_BLOCK];
+    int64_t pad = tar_round_up(len) - len;
+    tar_writer_put(w, zeros, (size_t)pad);
+}
+
+static void tar_put_octal(uint8_t* field, int width, int64_t value) {
+    snprintf((char*)field, (size_t)width, "%0*llo", width - 1, (unsigned long long)value);
+}
+
+/* Split name into ustar prefix/name fields; returns 0 if it does not fit */
+static int tar_split_name(const char* name, size_t len, size_t* split) {
+    if (len <= 100) {
+        *split = 0;
+        return 1;
+    }
+    /* Longest prefix (<= 155) ending at a '/' that leaves <= 100 for the name */
+    size_t limit = len - 1 < 155 ? len - 1 : 155;
+    for (size_t i = limit; i > 0; i--) {
+        if (name[i] == '/' && len - i - 1 <= 100 && len - i - 1 > 0) {
+            *split = i;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void tar_pax_record(char* buf, size_t* pos, size_t cap, const char* key, const char* value) {
+    size_t body = strlen(key) + strlen(value) + 3;  /* ' ', '=', '\n' */
+    size_t total = body + 1;
+    
+    /* The length prefix counts its own digits */
+    for (;;) {
+        char digits[24];
+        size_t next = body + (size_t)snprintf(digits, sizeof(digits), "%zu", total);
+        if (next == total) {
+            break;
+        }
+        total = next;
+    }
+    
+    if (*pos + total < cap) {
+        *pos += (size_t)snprintf(buf + *pos, cap - *pos, "%zu %s=%s\n", total, key, value);
+    }
+}
+
+static void tar_write_raw_header(TarWriter* w, const char* name, const char* link, int64_t size,
+                                 int64_t mtime, int32_t mode, char type) {
+    uint8_t block[TAR_BLOCK];
+    memset(block, 0, sizeof(block));
+    
+    size_t name_len = strlen(name);
+    size_t split = 0;
+    if (tar_split_name(name, name_len, &split) && split > 0) {
+        memcpy(block + 345, name, split);
+        memcpy(block, name + split + 1, name_len - split - 1);
+    } else {
+        memcpy(block, name, name_len < 100 ? name_len : 100);
+    }
+    
+    tar_put_octal(block + 100, 8, mode & 07777);
+    tar_put_octal(block + 108, 8, 0);
+    tar_put_octal(block + 116, 8, 0);
+    tar_put_octal(block + 124, 12, size <= 077777777777LL ? size : 0);
+    tar_put_octal(block + 136, 12, mtime >= 0 && mtime <= 077777777777LL ? mtime : 0);
+    block[156] = (uint8_t)type;
+    if (link) {
+        size_t link_len = strlen(link);
+        memcpy(block + 157, link, link_len < 100 ? link_len : 100);
+    }
+    memcpy(block + 257, "ustar", 6);
+    memcpy(block + 263, "00", 2);
+    
+    memset(block + 148, ' ', 8);
+    uint32_t sum = 0;
+    for (int i = 0; i < TAR_BLOCK; i++) {
+        sum += block[i];
+    }
+    snprintf((char*)block + 148, 8, "%06o", sum);
+    block[155] = ' ';
+    
+    tar_writer_put(w, block, TAR_BLOCK);
+}
+
+/* Write a header, preceded by a pax header when ustar fields cannot hold it */
+static void tar_write_header(TarWriter* w, const char* name, const char* link, int64_t size,
+                             int64_t mtime, int32_t mode, char type) {
+    size_t split = 0;
+    int name_fits = tar_split_name(name, strlen(name), &split);
+    int link_fits = !link || strlen(link) <= 100;
+    int size_fits = size <= 077777777777LL;
+    int mtime_fits = mtime >= 0 && mtime <= 077777777777LL;
+    
+    if (!name_fits || !link_fits || !size_fits || !mtime_fits) {
+        size_t cap = 3 * TAR_NAME_MAX;
+        char* records = malloc(cap);
+        if (!records) {
+            w->failed = 1;
+            return;
+        }
+        size_t pos = 0;
+        char number[32];
+        if (!name_fits) {
+            tar_pax_record(records, &pos, cap, "path", name);
+        }
+        if (!link_fits) {
+            tar_pax_record(records, &pos, cap, "linkpath", link);
+        }
+        if (!size_fits) {
+            snprintf(number, sizeof(number), "%lld", (long long)size);
+            tar_pax_record(records, &pos, cap, "size", number);
+        }
+        if (!mtime_fits) {
+            snprintf(number, sizeof(number), "%lld", (long long)mtime);
+            tar_pax_record(records, &pos, cap, "mtime", number);
+        }
+        tar_write_raw_header(w, "././@PaxHeader", NULL, (int64_t)pos, 0, 0644, 'x');
+        tar_writer_put(w, records, pos);
+        tar_writer_pad(w, (int64_t)pos);
+        free(records);
+    }
+    
+    tar_write_raw_header(w, name, link, size, mtime, mode, type);
+}
+
+static int32_t tar_writer_mode(TarWriter* w, int32_t mode, int is_dir) {
+    if (w->flags & TAR_WRITE_REPRODUCIBLE) {
+        return (is_dir || (mode & 0111)) ? 0755 : 0644;
+    }
+    return mode & 07777;
+}
+
+static int64_t tar_writer_mtime(TarWriter* w, int64_t mtime) {
+    return (w->flags & TAR_WRITE_REPRODUCIBLE) ? 0 : mtime;
+}
+
+/* Open a writer on a FILE* (from file_open). Returns NULL on allocation failure. */
+void* tar_writer_open(void* out_file, int32_t flags) {
+    if (!out_file) {
+        return NULL;
+    }
+    TarWriter* w = calloc(1, sizeof(TarWriter));
+    if (!w) {
+        return NULL;
+    }
+    w->out = (FILE*)out_file;
+    w->flags = flags;
+    return w;
+}
+
+/* Add an in-memory file. Returns 1 on success, 0 on error. */
+int32_t tar_writer_add_bytes(void* handle, const char* name, const uint8_t* data, int64_t len, int32_t mode) {
+    TarWriter* w = (TarWriter*)handle;
+    if (!w || !name || len < 0 || (len > 0 && !data)) {
+        return 0;
+    }
+    tar_write_header(w, name, NULL, len, tar_writer_mtime(w, 0), tar_writer_mode(w, mode, 0), '0');
+    tar_writer_put(w, data, (size_t)len);
+    tar_writer_pad(w, len);
+    return w->failed ? 0 : 1;
+}
+
+static int32_t tar_writer_dir_entry(TarWriter* w, const char* name, int32_t mode, int64_t mtime) {
+    size_t len = strlen(name);
+    char* dir_name = malloc(len + 2);
+    if (!dir_name) {
+        w->failed = 1;
+        return 0;
+    }
+    memcpy(dir_name, name, len);
+    if (len == 0 || name[len - 1] != '/') {
+        dir_name[len++] = '/';
+    }
+    dir_name[len] = '\0';
+    tar_write_header(w, dir_name, NULL, 0, tar_writer_mtime(w, mtime), tar_writer_mode(w, mode, 1), '5');
+    free(dir_name);
+    return w->failed ? 0 : 1;
+}
+
+/* Add a directory entry (a trailing '/' is appended). Returns 1 on success. */
+int32_t tar_writer_add_dir(void* handle, const char* name, int32_t mode) {
+    TarWriter* w = (TarWriter*)handle;
+    if (!w || !name) {
+        return 0;
+    }
+    return tar_writer_dir_entry(w, name, mode, 0);
+}
+
+/* Add a symbolic link entry. Returns 1 on success. */
+int32_t tar_writer_add_symlink(void* handle, const char* name, const char* target) {
+    TarWriter* w = (TarWriter*)handle;
+    if (!w || !name || !target) {
+        return 0;
+    }
+    tar_write_header(w, name, target, 0, tar_writer_mtime(w, 0), 0777, '2');
+    return w->failed ? 0 : 1;
+}
+
+/* Add a file from disk, streamed in chunks. Returns 1 on success, 0 on error. */
+int32_t tar_writer_add_file(void* handle, const char* src_path, const char* name) {
+    TarWriter* w = (TarWriter*)handle;
+    if (!w || !src_path || !name) {
+        return 0;
+    }
+    
+    FILE* in = fopen(src_path, "rb");
+    if (!in) {
+        return 0;
+    }
+    
+    int64_t size = 0;
+    int64_t mtime = 0;
+    int32_t mode = 0644;
+#ifdef _WIN32
+    fseek(in, 0, SEEK_END);
+    size = ftell(in);
+    fseek(in, 0, SEEK_SET);
+#else
+    struct stat st;
+    if (fstat(fileno(in), &st) != 0 || !S_ISREG(st.st_mode)) {
+        fclose(in);
+        return 0;
+    }
+    size = (int64_t)st.st_size;
+    mtime = (int64_t)st.st_mtime;
+    mode = (int32_t)(st.st_mode & 07777);
+#endif
+
+    tar_write_header(w, name, NULL, size, tar_writer_mtime(w, mtime), tar_writer_mode(w, mode, 0), '0');
+    
+    uint8_t* buf = malloc(TAR_CHUNK);
+    if (!buf) {
+        fclose(in);
+        w->failed = 1;
+        return 0;
+    }
+    
+    /* Write exactly the size in the header, even if the file changes under us */
+    int64_t left = size;
+    while (left > 0 && !w->failed) {
+        size_t want = left < TAR_CHUNK ? (size_t)left : TAR_CHUNK;
+        size_t got = fread(buf, 1, want, in);
+        if (got == 0) {
+            memset(buf, 0, want);
+            got = want;
+            w->failed = 1;
+        }
+        tar_writer_put(w, buf, got);
+        left -= (int64_t)got;
+    }
+    tar_writer_pad(w, size);
+    
+    free(buf);
+    fclose(in);
+    return w->failed ? 0 : 1;
+}
+
+#ifndef _WIN32
+static int tar_name_compare(const void* a, const void* b) {
+    return strcmp(*(const char* const*)a, *(const char* const*)b);
+}
+
+/* Recursively add dir (archived as prefix) in sorted order */
+static int64_t tar_writer_add_tree_at(TarWriter* w, const char* dir, const char* prefix) {
+    DIR* d = opendir(dir);
+    if (!d) {
+        return -1;
+    }
+    
+    char** names = NULL;
+    size_t count = 0;
+    size_t cap = 0;
+    struct dirent* entry;
+    while ((entry = readdir(d)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        if (count == cap) {
+            cap = cap ? cap * 2 : 32;
+            char** grown = realloc(names, cap * sizeof(char*));
+            if (!grown) {
+                break;
+            }
+            names = grown;
+        }
+        names[count] = strdup(entry->d_name);
+        if (names[count]) {
+            count++;
+        }
+    }
+    closedir(d);
+    
+    /* Sorted order makes archives of the same tree byte-identical */
+    qsort(names, count, sizeof(char*), tar_name_compare);
+    
+    int64_t added = 0;
+    for (size_t i = 0; i < count && added >= 0; i++) {
+        size_t path_len = strlen(dir) + strlen(names[i]) + 2;
+        size_t name_len = strlen(prefix) + strlen(names[i]) + 2;
+        char* path = malloc(path_len);
+        char* name = malloc(name_len);
+        if (!path || !name) {
+            free(path);
+            free(name);
+            added = -1;
+            break;
+        }
+        snprintf(path, path_len, "%s/%s", dir, names[i]);
+        snprintf(name, name_len, "%s%s%s", prefix, prefix[0] ? "/" : "", names[i]);
+        
+        struct stat st;
+        if (lstat(path, &st) != 0) {
+            added = -1;
+        } else if (S_ISDIR(st.st_mode)) {
+            if (!tar_writer_dir_entry(w, name, (int32_t)st.st_mode, (int64_t)st.st_mtime)) {
+                added = -1;
+            } else {
+                int64_t sub = tar_writer_add_tree_at(w, path, name);
+                added = sub < 0 ? -1 : added + 1 + sub;
+            }
+        } else if (S_ISLNK(st.st_mode)) {
+            char target[TAR_NAME_MAX];
+            ssize_t n = readlink(path, target, sizeof(target) - 1);
+            if (n < 0) {
+                added = -1;
+            } else {
+                target[n] = '\0';
+                added = tar_writer_add_symlink(w, name, target) ? added + 1 : -1;
+            }
+        } else if (S_ISREG(st.st_mode)) {
+            added = tar_writer_add_file(w, path, name) ? added + 1 : -1;
+        }
+        
+        free(path);
+        free(name);
+    }
+    
+    for (size_t i = 0; i < count; i++) {
+        free(names[i]);
+    }
+    free(names);
+    return w->failed ? -1 : added;
+}
+#endif
+
+/* Add a directory tree, with entry names rooted at prefix ("" for none).
+ * Returns the number of entries added, or -1 on error. */
+int64_t tar_writer_add_tree(void* handle, const char* root, const char* prefix) {
+    TarWriter* w = (TarWriter*)handle;
+    if (!w || !root) {
+        return -1;
+    }
+#ifdef _WIN32
+    (void)prefix;
+    return -1;
+#else
+    return tar_writer_add_tree_at(w, root, prefix ? prefix : "");
+#endif
+}
+
+/* Write the end-of-archive marker, pad to a full record and free the writer.
+ * The FILE* stays open. Returns 1 on success, 0 if any write failed. */
+int32_t tar_writer_finish(void* handle) {
+    TarWriter* w = (TarWriter*)handle;
+    if (!w) {
+        return 0;
+    }
+    
+    static const uint8_t zeros[TAR_BLOCK];
+    tar_writer_put(w, zeros, TAR_BLOCK);
+    tar_writer_put(w, zeros, TAR_BLOCK);
+    while (w->written % TAR_RECORD != 0 && !w->failed) {
+        tar_writer_put(w, zeros, TAR_BLOCK);
+    }
+    if (fflush(w->out) != 0) {
+        w->failed = 1;
+    }
+    
+    int32_t ok = w->failed ? 0 : 1;
+    free(w);
+    return ok;
+}
+
+/* Extraction */
+
+#ifndef _WIN32
+
+/* Write job for the pool: the worker owns path and data */
+typedef struct TarJob {
+    char* path;
+    uint8_t* data;
+    int64_t len;
+    int32_t mode;
+    int64_t mtime;
+    struct TarJob* next;
+} TarJob;
+
+/* Links are created after all files so nothing is written through them */
+typedef struct TarLink {
+    char* path;
+    char* target;
+    int32_t kind;
+    int64_t order;      /* Archive order; the last entry for a path wins */
+    struct TarLink* next;
+} TarLink;
+
+#define TAR_ST_HEADER 0
+#define TAR_ST_META 1
+#define TAR_ST_DATA 2
+#define TAR_ST_PAD 3
+#define TAR_ST_END 4
+
+#define TAR_SINK_DISCARD 0
+#define TAR_SINK_BUFFER 1
+#define TAR_SINK_FD 2
+
+typedef struct {
+    char* dest;
+    size_t dest_len;
+    int32_t flags;
+    int32_t failed;
+    int64_t entries;
+    
+    /* parser */
+    int32_t state;
+    uint8_t header[TAR_BLOCK];
+    int32_t header_fill;
+    TarEntry entry;
+    TarPending pending;
+    char meta_type;
+    char* meta;
+    int64_t meta_fill;
+    int64_t remaining;
+    int64_t padding;
+    sha256_ctx archive_hash;
+    
+    /* current entry sink */
+    int32_t sink;
+    int fd;
+    char* path;
+    uint8_t* buffer;
+    int64_t buffer_fill;
+    char last_dir[TAR_NAME_MAX];
+    
+    /* writer pool */
+    pthread_t threads[TAR_MAX_WORKERS];
+    int32_t thread_count;
+    pthread_mutex_t lock;
+    pthread_cond_t job_ready;
+    pthread_cond_t job_done;
+    TarJob* head;
+    TarJob* tail;
+    int64_t inflight;
+    int32_t shutdown;
+    int32_t pool_failed;
+    
+    TarLink* links;
+} TarExtractor;
+
+/* Normalize an archive path: strip "./" and duplicate slashes, reject
+ * absolute paths and ".." components. Returns 0 for unsafe names. */
+static int tar_clean_path(const char* name, char* out, size_t cap) {
+    size_t len = 0;
+    const char* p = name;
+    
+    if (*p == '/') {
+        return 0;
+    }
+    while (*p) {
+        const char* start = p;
+        while (*p && *p != '/') {
+            p++;
+        }
+        size_t part = (size_t)(p - start);
+        if (*p == '/') {
+            p++;
+        }
+        if (part == 0 || (part == 1 && start[0] == '.')) {
+            continue;
+        }
+        if (part == 2 && start[0] == '.' && start[1] == '.') {
+            return 0;
+        }
+        if (len + part + 2 > cap) {
+            return 0;
+        }
+        if (len > 0) {
+            out[len++] = '/';
+        }
+        memcpy(out + len, start, part);
+        len += part;
+    }
+    out[len] = '\0';
+    return 1;
+}
+
+/* True if a symlink at entry path pointing to target leaves the archive root.
+ * Lexical only, so it can reject early while streaming; tar_symlinks_contained
+ * later resolves targets through the archive's other symlinks. */
+static int tar_link_escapes(const char* entry_path, const char* target) {
+    if (target[0] == '/') {
+        return 1;
+    }
+    
+    int64_t depth = 0;
+    for (const char* p = entry_path; *p; p++) {
+        if (*p == '/') {
+            depth++;
+        }
+    }
+    
+    const char* p = target;
+    while (*p) {
+        const char* start = p;
+        while (*p && *p != '/') {
+            p++;
+        }
+        size_t part = (size_t)(p - start);
+        if (*p == '/') {
+            p++;
+        }
+        if (part == 0 || (part == 1 && start[0] == '.')) {
+            continue;
+        }
+        if (part == 2 && start[0] == '.' && start[1] == '.') {
+            if (--depth < 0) {
+                return 1;
+            }
+        } else {
+            depth++;
+        }
+    }
+    return 0;
+}
+
+static char* tar_join_dest(TarExtractor* x, const char* rel) {
+    size_t rel_len = strlen(rel);
+    char* path = malloc(x->dest_len + rel_len + 2);
+    if (!path) {
+        return NULL;
+    }
+    memcpy(path, x->dest, x->dest_len);
+    path[x->dest_len] = '/';
+    memcpy(path + x->dest_len + 1, rel, rel_len + 1);
+    return path;
+}
+
+/* mkdir that accepts an existing directory. With nofollow, an existing
+ * symlink is refused even when it points at a directory. */
+static int tar_mkdir_one(const char* path, mode_t mode, int nofollow) {
+    if (mkdir(path, mode) == 0) {
+        return 1;
+    }
+    struct stat st;
+    if (errno != EEXIST || (nofollow ? lstat(path, &st) : stat(path, &st)) != 0) {
+        return 0;
+    }
+    return S_ISDIR(st.st_mode);
+}
+
+/* Create path and its missing parents. Components longer than nofollow_from
+ * (those below the extraction root) must be real directories, so nothing is
+ * ever written through a symlink that already exists under dest. */
+static int tar_mkdirs(char* path, int32_t mode, size_t nofollow_from) {
+    for (char* p = path + 1; *p; p++) {
+        if (*p != '/') {
+            continue;
+        }
+        *p = '\0';
+        int ok = tar_mkdir_one(path, 0755, (size_t)(p - path) > nofollow_from);
+        *p = '/';
+        if (!ok) {
+            return 0;
+        }
+    }
+    return tar_mkdir_one(path, (mode_t)(mode | 0700), strlen(path) > nofollow_from);
+}
+
+/* True if any component of path below the extraction root is a symlink */
+static int tar_path_crosses_link(TarExtractor* x, char* path) {
+    struct stat st;
+    for (char* p = path + x->dest_len + 1; ; p++) {
+        if (*p != '/' && *p != '\0') {
+            continue;
+        }
+        char c = *p;
+        *p = '\0';
+        int is_link = lstat(path, &st) == 0 && S_ISLNK(st.st_mode);
+        *p = c;
+        if (is_link) {
+            return 1;
+        }
+        if (c == '\0') {
+            return 0;
+        }
+    }
+}
+
+/* Create the parent directories of path (cached across consecutive entries) */
+static int tar_ensure_parent(TarExtractor* x, char* path) {
+    char* slash = strrchr(path, '/');
+    if (!slash || slash == path) {
+        return 1;
+    }
+    *slash = '\0';
+    int ok = 1;
+    if (strcmp(path, x->last_dir) != 0) {
+        ok = tar_mkdirs(path, 0755, x->dest_len);
+        if (ok && strlen(path) < sizeof(x->last_dir)) {
+            strcpy(x->last_dir, path);
+        }
+    }
+    *slash = '/';
+    return ok;
+}
+
+static int tar_write_whole_file(const char* path, const uint8_t* data, int64_t len, int32_t mode, int64_t mtime) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        return 0;
+    }
+    
+    int ok = 1;
+    int64_t off = 0;
+    while (off < len) {
+        ssize_t n = write(fd, data + off, (size_t)(len - off));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ok = 0;
+            break;
+        }
+        off += n;
+    }
+    
+    if (ok) {
+        struct timespec times[2];
+        times[0].tv_sec = (time_t)mtime;
+        times[0].tv_nsec = 0;
+        times[1] = times[0];
+        fchmod(fd, (mode_t)mode);
+        futimens(fd, times);
+    }
+    if (close(fd) != 0) {
+        ok = 0;
+    }
+    return ok;
+}
+
+static void* tar_pool_worker(void* arg) {
+    TarExtractor* x = (TarExtractor*)arg;
+    
+    for (;;) {
+        pthread_mutex_lock(&x->lock);
+        while (!x->head && !x->shutdown) {
+            pthread_cond_wait(&x->job_ready, &x->lock);
+        }
+        TarJob* job = x->head;
+        if (!job) {
+            pthread_mutex_unlock(&x->lock);
+            return NULL;
+        }
+        x->head = job->next;
+        if (!x->head) {
+            x->tail = NULL;
+        }
+        pthread_mutex_unlock(&x->lock);
+        
+        int ok = tar_write_whole_file(job->path, job->data, job->len, job->mode, job->mtime);
+        
+        pthread_mutex_lock(&x->lock);
+        x->inflight -= job->len;
+        if (!ok) {
+            x->pool_failed = 1;
+        }
+        pthread_cond_signal(&x->job_done);
+        pthread_mutex_unlock(&x->lock);
+        
+        free(job->path);
+        free(job->data);
+        free(job);
+    }
+}
+
+/* Queue a buffered file, blocking while too much data is in flight */
+static void tar_pool_submit(TarExtractor* x, char* path, uint8_t* data, int64_t len, int32_t mode, int64_t mtime) {
+    if (x->thread_count == 0) {
+        if (!tar_write_whole_file(path, data, len, mode, mtime)) {
+            x->failed = 1;
+        }
+        free(path);
+        free(data);
+        return;
+    }
+    
+    TarJob* job = malloc(sizeof(TarJob));
+    if (!job) {
+        x->failed = 1;
+        free(path);
+        free(data);
+        return;
+    }
+    job->path = path;
+    job->data = data;
+    job->len = len;
+    job->mode = mode;
+    job->mtime = mtime;
+    job->next = NULL;
+    
+    pthread_mutex_lock(&x->lock);
+    while (x->inflight > 0 && x->inflight + len > TAR_POOL_MAX_INFLIGHT) {
+        pthread_cond_wait(&x->job_done, &x->lock);
+    }
+    x->inflight += len;
+    if (x->tail) {
+        x->tail->next = job;
+    } else {
+        x->head = job;
+    }
+    x->tail = job;
+    pthread_cond_signal(&x->job_ready);
+    pthread_mutex_unlock(&x->lock);
+}
+
+static void tar_defer_link(TarExtractor* x, char* path, const char* target, int32_t kind) {
+    TarLink* link = malloc(sizeof(TarLink));
+    char* target_copy = strdup(target);
+    if (!link || !target_copy) {
+        free(link);
+        free(target_copy);
+        free(path);
+        x->failed = 1;
+        return;
+    }
+    link->path = path;
+    link->target = target_copy;
+    link->kind = kind;
+    link->order = x->entries;
+    link->next = x->links;
+    x->links = link;
+}
+
+static int32_t tar_file_mode(int32_t mode) {
+    mode &= 0777;
+    return mode ? mode : 0644;
+}
+
+/* Header parsed: set up where the entry's data goes */
+static void tar_begin_entry(TarExtractor* x) {
+    TarEntry* e = &x->entry;
+    char rel[TAR_NAME_MAX];
+    
+    x->sink = TAR_SINK_DISCARD;
+    if (!tar_clean_path(e->name, rel, sizeof(rel))) {
+        x->failed = 1;
+        return;
+    }
+    if (rel[0] == '\0') {
+        return;  /* the archive root itself ("./") */
+    }
+    
+    char* path = tar_join_dest(x, rel);
+    if (!path || !tar_ensure_parent(x, path)) {
+        free(path);
+        x->failed = 1;
+        return;
+    }
+    
+    switch (e->kind) {
+        case TAR_KIND_DIR:
+            if (!tar_mkdirs(path, e->mode & 0777, x->dest_len)) {
+                x->failed = 1;
+            }
+            free(path);
+            x->entries++;
+            return;
+        
+        case TAR_KIND_SYMLINK:
+            if (tar_link_escapes(rel, e->link_name)) {
+                free(path);
+                x->failed = 1;
+                return;
+            }
+            tar_defer_link(x, path, e->link_name, TAR_KIND_SYMLINK);
+            x->entries++;
+            return;
+        
+        case TAR_KIND_HARDLINK: {
+            char target_rel[TAR_NAME_MAX];
+            char* target = NULL;
+            if (!tar_clean_path(e->link_name, target_rel, sizeof(target_rel)) ||
+                target_rel[0] == '\0' || !(target = tar_join_dest(x, target_rel))) {
+                free(path);
+                x->failed = 1;
+                return;
+            }
+            tar_defer_link(x, path, target, TAR_KIND_HARDLINK);
+            free(target);
+            x->entries++;
+            return;
+        }
+        
+        case TAR_KIND_FILE:
+            break;
+        
+        default:
+            free(path);  /* devices, fifos: skipped */
+            return;
+    }
+    
+    x->entries++;
+    if (e->data_size <= TAR_POOL_MAX_FILE) {
+        x->buffer = malloc((size_t)e->data_size + 1);
+        if (!x->buffer) {
+            free(path);
+            x->failed = 1;
+            return;
+        }
+        x->buffer_fill = 0;
+        x->path = path;
+        x->sink = TAR_SINK_BUFFER;
+        return;
+    }
+    
+    /* Large file: stream straight to disk as the data arrives */
+    x->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, 0600);
+    free(path);
+    if (x->fd < 0) {
+        x->failed = 1;
+        return;
+    }
+    x->sink = TAR_SINK_FD;
+}
+
+static void tar_entry_data(TarExtractor* x, const uint8_t* data, int64_t len) {
+    if (x->sink == TAR_SINK_BUFFER) {
+        memcpy(x->buffer + x->buffer_fill, data, (size_t)len);
+        x->buffer_fill += len;
+    } else if (x->sink == TAR_SINK_FD) {
+        while (len > 0) {
+            ssize_t n = write(x->fd, data, (size_t)len);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                x->failed = 1;
+                return;
+            }
+            data += n;
+            len -= n;
+        }
+    }
+}
+
+static void tar_end_entry(TarExtractor* x) {
+    TarEntry* e = &x->entry;
+    
+    if (x->sink == TAR_SINK_BUFFER) {
+        tar_pool_submit(x, x->path, x->buffer, x->buffer_fill, tar_file_mode(e->mode), e->mtime);
+        x->path = NULL;
+        x->buffer = NULL;
+    } else if (x->sink == TAR_SINK_FD) {
+        struct timespec times[2];
+        times[0].tv_sec = (time_t)e->mtime;
+        times[0].tv_nsec = 0;
+        times[1] = times[0];
+        fchmod(x->fd, (mode_t)tar_file_mode(e->mode));
+        futimens(x->fd, times);
+        if (close(x->fd) != 0) {
+            x->failed = 1;
+        }
+        x->fd = -1;
+    }
+    x->sink = TAR_SINK_DISCARD;
+}
+
+/* Parse a header block that has been fully accumulated */
+static void tar_extractor_header(TarExtractor* x) {
+    int kind = tar_decode_header(x->header, &x->pending, &x->entry, &x->meta_type);
+    x->header_fill = 0;
+    
+    if (kind == TAR_HDR_BAD) {
+        x->failed = 1;
+        return;
+    }
+    if (kind == TAR_HDR_END) {
+        x->state = TAR_ST_END;
+        return;
+    }
+    
+    x->remaining = x->entry.data_size;
+    x->padding = tar_round_up(x->entry.data_size) - x->entry.data_size;
+    
+    if (kind == TAR_HDR_META) {
+        if (x->remaining > TAR_META_MAX) {
+            x->failed = 1;
+            return;
+        }
+        x->meta = malloc((size_t)x->remaining + 1);
+        if (!x->meta) {
+            x->failed = 1;
+            return;
+        }
+        x->meta_fill = 0;
+        x->state = TAR_ST_META;
+    } else {
+        tar_begin_entry(x);
+        x->state = TAR_ST_DATA;
+    }
+    
+    if (x->remaining == 0) {
+        if (x->state == TAR_ST_META) {
+            tar_apply_meta(&x->pending, x->meta_type, x->meta, 0);
+            free(x->meta);
+            x->meta = NULL;
+        } else {
+            tar_end_entry(x);
+        }
+        x->state = x->padding > 0 ? TAR_ST_PAD : TAR_ST_HEADER;
+    }
+}
+
+/* Create an extractor writing below dest (created if missing). workers: 0 =
+ * one per core, 1 = write files on the feeding thread. Returns NULL on error. */
+void* tar_extractor_new(const char* dest, int32_t workers, int32_t flags) {
+    if (!dest || !dest[0]) {
+        return NULL;
+    }
+    
+    TarExtractor* x = calloc(1, sizeof(TarExtractor));
+    if (!x) {
+        return NULL;
+    }
+    x->dest = strdup(dest);
+    if (!x->dest) {
+        free(x);
+        return NULL;
+    }
+    x->dest_len = strlen(x->dest);
+    while (x->dest_len > 1 && x->dest[x->dest_len - 1] == '/') {
+        x->dest[--x->dest_len] = '\0';
+    }
+    x->flags = flags;
+    x->fd = -1;
+    sha256_init(&x->archive_hash);
+    
+    if (!tar_mkdirs(x->dest, 0755, SIZE_MAX)) {
+        free(x->dest);
+        free(x);
+        return NULL;
+    }
+    
+    if (workers <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = cpus > 0 ? (int32_t)cpus : 1;
+    }
+    if (workers > TAR_MAX_WORKERS) {
+        workers = TAR_MAX_WORKERS;
+    }
+    
+    pthread_mutex_init(&x->lock, NULL);
+    pthread_cond_init(&x->job_ready, NULL);
+    pthread_cond_init(&x->job_done, NULL);
+    if (workers > 1) {
+        for (int32_t i = 0; i < workers; i++) {
+            if (pthread_create(&x->threads[x->thread_count], NULL, tar_pool_worker, x) != 0) {
+                break;
+            }
+            x->thread_count++;
+        }
+    }
+    return x;
+}
+
+/* Feed the next chunk of archive bytes. Returns 1 while the stream is good,
+ * 0 once an error occurred (malformed archive, unsafe path, write failure). */
+int32_t tar_extractor_feed(void* handle, const uint8_t* data, int64_t len) {
+    TarExtractor* x = (TarExtractor*)handle;
+    if (!x || len < 0 || (len > 0 && !data)) {
+        return 0;
+    }
+    
+    sha256_update(&x->archive_hash, data, (size_t)len);
+    
+    while (len > 0 && !x->failed) {
+        int64_t n;
+        switch (x->state) {
+            case TAR_ST_HEADER:
+                n = TAR_BLOCK - x->header_fill;
+                if (n > len) {
+                    n = len;
+                }
+                memcpy(x->header + x->header_fill, data, (size_t)n);
+                x->header_fill += (int32_t)n;
+                if (x->header_fill == TAR_BLOCK) {
+                    tar_extractor_header(x);
+                }
+                break;
+            
+            case TAR_ST_META:
+                n = x->remaining < len ? x->remaining : len;
+                memcpy(x->meta + x->meta_fill, data, (size_t)n);
+                x->meta_fill += n;
+                x->remaining -= n;
+                if (x->remaining == 0) {
+                    tar_apply_meta(&x->pending, x->meta_type, x->meta, x->meta_fill);
+                    free(x->meta);
+                    x->meta = NULL;
+                    x->state = x->padding > 0 ? TAR_ST_PAD : TAR_ST_HEADER;
+                }
+                break;
+            
+            case TAR_ST_DATA:
+                n = x->remaining < len ? x->remaining : len;
+                tar_entry_data(x, data, n);
+                x->remaining -= n;
+                if (x->remaining == 0) {
+                    tar_end_entry(x);
+                    x->state = x->padding > 0 ? TAR_ST_PAD : TAR_ST_HEADER;
+                }
+                break;
+            
+            case TAR_ST_PAD:
+                n = x->padding < len ? x->padding : len;
+                x->padding -= n;
+                if (x->padding == 0) {
+                    x->state = TAR_ST_HEADER;
+                }
+                break;
+            
+            default:
+                n = len;  /* after the end marker: only hashed */
+                break;
+        }
+        data += n;
+        len -= n;
+    }
+    
+    return x->failed ? 0 : 1;
+}
+
+/* Let the workers drain the queue and exit */
+static void tar_pool_stop(TarExtractor* x) {
+    pthread_mutex_lock(&x->lock);
+    x->shutdown = 1;
+    pthread_cond_broadcast(&x->job_ready);
+    pthread_mutex_unlock(&x->lock);
+    for (int32_t i = 0; i < x->thread_count; i++) {
+        pthread_join(x->threads[i], NULL);
+    }
+    x->thread_count = 0;
+}
+
+/* Symlink containment */
+/* Checking each target on its own is not enough: another link in the same
+ * archive can change what a target means (d -> ".", then e -> "d/d/d/..").
+ * Before any link is created, every symlink target is resolved the way the
+ * kernel will resolve it once they all exist: component by component from
+ * the link's directory, continuing into an archive symlink's target whenever
+ * one is reached. Leaving the root, an absolute target or more than
+ * TAR_SYMLOOP_MAX link steps rejects the archive. */
+
+#define TAR_SYMLOOP_MAX 40
+
+static int tar_link_compare(const void* a, const void* b) {
+    const TarLink* la = *(TarLink* const*)a;
+    const TarLink* lb = *(TarLink* const*)b;
+    int c = strcmp(la->path, lb->path);
+    if (c != 0) {
+        return c;
+    }
+    return (la->order > lb->order) - (la->order < lb->order);
+}
+
+static int tar_link_path_compare(const void* key, const void* elem) {
+    return strcmp((const char*)key, (*(TarLink* const*)elem)->path);
+}
+
+/* The symlink that will exist at path (the archive's last entry for it) */
+static const TarLink* tar_find_symlink(TarLink** links, size_t count, const char* path) {
+    TarLink** hit = bsearch(path, links, count, sizeof(TarLink*), tar_link_path_compare);
+    if (!hit) {
+        return NULL;
+    }
+    while (hit + 1 < links + count && strcmp(hit[1]->path, path) == 0) {
+        hit++;
+    }
+    return *hit;
+}
+
+static int tar_symlink_escapes(TarExtractor* x, TarLink** links, size_t count, const TarLink* link) {
+    if (link->target[0] == '/') {
+        return 1;
+    }
+    
+    /* Walk "<link's directory>/<target>" from the root */
+    const char* rel = link->path + x->dest_len + 1;
+    const char* slash = strrchr(rel, '/');
+    size_t dir_len = slash ? (size_t)(slash - rel) : 0;
+    size_t target_len = strlen(link->target);
+    size_t loc_cap = x->dest_len + TAR_NAME_MAX + 2;
+    char* pending = malloc(dir_len + target_len + 2);
+    char* loc = malloc(loc_cap);
+    if (!pending || !loc) {
+        free(pending);
+        free(loc);
+        return 1;
+    }
+    memcpy(pending, rel, dir_len);
+    pending[dir_len] = '/';
+    memcpy(pending + dir_len + 1, link->target, target_len + 1);
+    memcpy(loc, x->dest, x->dest_len);
+    size_t loc_len = x->dest_len;
+    loc[loc_len] = '\0';
+    
+    int escapes = 0;
+    int steps = 0;
+    const char* p = pending;
+    while (*p) {
+        const char* start = p;
+        while (*p && *p != '/') {
+            p++;
+        }
+        size_t part = (size_t)(p - start);
+        if (*p == '/') {
+            p++;
+        }
+        if (part == 0 || (part == 1 && start[0] == '.')) {
+            continue;
+        }
+        if (part == 2 && start[0] == '.' && start[1] == '.') {
+            if (loc_len == x->dest_len) {
+                escapes = 1;
+                break;
+            }
+            do {
+                loc_len--;
+            } while (loc[loc_len] != '/');
+            loc[loc_len] = '\0';
+            continue;
+        }
+        if (loc_len + 1 + part >= loc_cap) {
+            escapes = 1;
+            break;
+        }
+        loc[loc_len] = '/';
+        memcpy(loc + loc_len + 1, start, part);
+        loc_len += part + 1;
+        loc[loc_len] = '\0';
+        
+        const TarLink* hop = tar_find_symlink(links, count, loc);
+        if (!hop) {
+            continue;
+        }
+        /* Reached another symlink: continue with its target, then the rest */
+        if (++steps > TAR_SYMLOOP_MAX || hop->target[0] == '/') {
+            escapes = 1;
+            break;
+        }
+        loc_len -= part + 1;
+        loc[loc_len] = '\0';
+        size_t hop_len = strlen(hop->target);
+        size_t rest_len = strlen(p);
+        char* next = malloc(hop_len + rest_len + 2);
+        if (!next) {
+            escapes = 1;
+            break;
+        }
+        memcpy(next, hop->target, hop_len);
+        next[hop_len] = '/';
+        memcpy(next + hop_len + 1, p, rest_len + 1);
+        free(pending);
+        pending = next;
+        p = pending;
+    }
+    
+    free(pending);
+    free(loc);
+    return escapes;
+}
+
+/* Returns 1 if every symlink in the list resolves inside the root */
+static int tar_symlinks_contained(TarExtractor* x, TarLink* list) {
+    size_t count = 0;
+    for (TarLink* item = list; item; item = item->next) {
+        count += item->kind == TAR_KIND_SYMLINK;
+    }
+    if (count == 0) {
+        return 1;
+    }
+    TarLink** links = malloc(count * sizeof(TarLink*));
+    if (!links) {
+        return 0;
+    }
+    size_t n = 0;
+    for (TarLink* item = list; item; item = item->next) {
+        if (item->kind == TAR_KIND_SYMLINK) {
+            links[n++] = item;
+        }
+    }
+    qsort(links, count, sizeof(TarLink*), tar_link_compare);
+    
+    int ok = 1;
+    for (size_t i = 0; i < count && ok; i++) {
+        if (tar_symlink_escapes(x, links, count, links[i])) {
+            ok = 0;
+        }
+    }
+    free(links);
+    return ok;
+}
+
+/* Wait for queued writes, then create deferred hard and symbolic links.
+ * Returns the number of entries extracted, or -1 on error. Call
+ * tar_extractor_free afterwards in either case. */
+int64_t tar_extractor_finish(void* handle) {
+    TarExtractor* x = (TarExtractor*)handle;
+    if (!x) {
+        return -1;
+    }
+    
+    /* Truncated inside an entry (a missing end marker is tolerated) */
+    if (x->state != TAR_ST_END && !(x->state == TAR_ST_HEADER && x->header_fill == 0)) {
+        x->failed = 1;
+    }
+    
+    tar_pool_stop(x);
+    if (x->pool_failed) {
+        x->failed = 1;
+    }
+    
+    /* Links were pushed in reverse; hard links first, symlinks last */
+    TarLink* ordered = NULL;
+    while (x->links) {
+        TarLink* link = x->links;
+        x->links = link->next;
+        link->next = ordered;
+        ordered = link;
+    }
+    if (!x->failed && !tar_symlinks_contained(x, ordered)) {
+        x->failed = 1;
+    }
+    for (int32_t pass = 0; pass < 2; pass++) {
+        for (TarLink* item = ordered; item && !x->failed; item = item->next) {
+            if ((pass == 0) != (item->kind == TAR_KIND_HARDLINK)) {
+                continue;
+            }
+            /* A hard link must not reach its target through a symlink */
+            if (item->kind == TAR_KIND_HARDLINK && tar_path_crosses_link(x, item->target)) {
+                x->failed = 1;
+                break;
+            }
+            unlink(item->path);
+            int rc = item->kind == TAR_KIND_HARDLINK
+                ? link(item->target, item->path)
+                : symlink(item->target, item->path);
+            if (rc != 0) {
+                x->failed = 1;
+            }
+        }
+    }
+    x->links = ordered;
+    
+    return x->failed ? -1 : x->entries;
+}
+
+/* SHA-256 of all bytes fed so far (the raw archive stream) */
+int32_t tar_extractor_digest(void* handle, uint8_t* out) {
+    TarExtractor* x = (TarExtractor*)handle;
+    if (!x || !out) {
+        return 0;
+    }
+    sha256_peek(&x->archive_hash, out);
+    return 1;
+}
+
+void tar_extractor_free(void* handle) {
+    TarExtractor* x = (TarExtractor*)handle;
+    if (!x) {
+        return;
+    }
+    tar_pool_stop(x);
+    
+    while (x->head) {
+        TarJob* job = x->head;
+        x->head = job->next;
+        free(job->path);
+        free(job->data);
+        free(job);
+    }
+    while (x->links) {
+        TarLink* link = x->links;
+        x->links = link->next;
+        free(link->path);
+        free(link->target);
+        free(link);
+    }
+    if (x->fd >= 0) {
+        close(x->fd);
+    }
+    pthread_mutex_destroy(&x->lock);
+    pthread_cond_destroy(&x->job_ready);
+    pthread_cond_destroy(&x->job_done);
+    free(x->path);
+    free(x->buffer);
+    free(x->meta);
+    free(x->dest);
+    free(x);
+}
+
+#else
+
+void* tar_extractor_new(const char* dest, int32_t workers, int32_t flags) {
+    (void)dest;
+    (void)workers;
+    (void)flags;
+    return NULL;
+}
+
+int32_t tar_extractor_feed(void* handle, const uint8_t* data, int64_t len) {
+    (void)handle;
+    (void)data;
+    (void)len;
+    return 0;
+}
+
+int64_t tar_extractor_finish(void* handle) {
+    (void)handle;
+    return -1;
+}
+
+int32_t tar_extractor_digest(void* handle, uint8_t* out) {
+    (void)handle;
+    (void)out;
+    return 0;
+}
+
+void tar_extractor_free(void* handle) {
+    (void)handle;
+}
+
+#endif
+
+/* Extract a whole archive from a FILE* (from file_open) into dest.
+ * digest_out (32 bytes, may be NULL) receives the SHA-256 of the archive.
+ * Returns the number of entries extracted, or -1 on error. */
+int64_t tar_extract_file(void* in_file, const char* dest, int32_t workers, uint8_t* digest_out) {
+    if (!in_file) {
+        return -1;
+    }
+    void* x = tar_extractor_new(dest, workers, 0);
+    if (!x) {
+        return -1;
+    }
+    
+    uint8_t* buf = malloc(TAR_CHUNK);
+    int ok = buf != NULL;
+    while (ok) {
+        size_t got = fread(buf, 1, TAR_CHUNK, (FILE*)in_file);
+        if (got == 0) {
+            break;
+        }
+        ok = tar_extractor_feed(x, buf, (int64_t)got);
+    }
+    free(buf);
+    
+    int64_t entries = tar_extractor_finish(x);
+    if (digest_out) {
+        tar_extractor_digest(x, digest_out);
+    }
+    tar_extractor_free(x);
+    return ok ? entries : -1;
+}
@@ -0,0 +1,1212 @@
+/* LZ4 compression implementation in C for Pyrite standard library
+ *
+ * Self-contained, format-compatible implementation of the LZ4 block format and
+ * the LZ4 frame format (https://github.com/lz4/lz4/tree/dev/doc). Output can be
+ * read by the reference `lz4` tool and vice versa.
+ *
+ * - Fast mode (level 0): single-probe hash table, skip acceleration on
+ *   incompressible data. Same trade-off as LZ4_compress_default.
+ * - High-compression mode (levels 1-12): hash chains searched up to a
+ *   level-dependent depth, with one step of lazy matching.
+ * - Frames use independent blocks, so large inputs are compressed on several
+ *   threads; frames carry content size, a content checksum and optionally
+ *   per-block checksums (XXH32, as the format requires).
+ * - Streaming variants work on file handles from file.c (FILE*), one batch
+ *   of blocks at a time, so memory stays bounded by threads * block size.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#define LZ4_MINMATCH 4
+#define LZ4_LASTLITERALS 5
+#define LZ4_MFLIMIT 12
+#define LZ4_MAX_DISTANCE 65535
+#define LZ4_HASH_LOG 12
+#define LZ4_SKIP_TRIGGER 6
+
+#define LZ4_HC_HASH_LOG 15
+#define LZ4_HC_MAX_LEVEL 12
+
+#define LZ4_FRAME_MAGIC 0x184D2204U
+#define LZ4_SKIPPABLE_MAGIC_MASK 0xFFFFFFF0U
+#define LZ4_SKIPPABLE_MAGIC 0x184D2A50U
+#define LZ4_FRAME_BLOCK_SIZE (1024 * 1024)   /* BD block max size id 6 */
+#define LZ4_FRAME_BLOCK_SIZE_ID 6
+#define LZ4_FRAME_MAX_HEADER 19
+#define LZ4_MAX_THREADS 16
+
+/* Frame flags (lz4_frame_compress flags argument) */
+#define LZ4_FRAME_BLOCK_CHECKSUM 1
+
+/* String structure (from string.c) */
+typedef struct {
+    char* data;
+    int64_t len;
+} String;
+
+extern String string_empty();
+
+/* Memory access helpers (unaligned, little-endian format) */
+
+static uint32_t read32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint64_t read64(const uint8_t* p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t read_le32(const uint8_t* p) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    return read32(p);
+#else
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+#endif
+}
+
+static void write_le32(uint8_t* p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static uint64_t read_le64(const uint8_t* p) {
+    return (uint64_t)read_le32(p) | ((uint64_t)read_le32(p + 4) << 32);
+}
+
+static void write_le64(uint8_t* p, uint64_t v) {
+    write_le32(p, (uint32_t)v);
+    write_le32(p + 4, (uint32_t)(v >> 32));
+}
+
+/* Length of the common prefix of a and b, not reading past limit (a side) */
+static int64_t count_match(const uint8_t* a, const uint8_t* b, const uint8_t* limit) {
+    const uint8_t* start = a;
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    while (a + 8 <= limit) {
+        uint64_t diff = read64(a) ^ read64(b);
+        if (diff) {
+            return (a - start) + (__builtin_ctzll(diff) >> 3);
+        }
+        a += 8;
+        b += 8;
+    }
+#endif
+    while (a < limit && *a == *b) {
+        a++;
+        b++;
+    }
+    return a - start;
+}
+
+/* XXH32 (checksum required by the frame format) */
+
+#define XXH_P1 2654435761U
+#define XXH_P2 2246822519U
+#define XXH_P3 3266489917U
+#define XXH_P4 668265263U
+#define XXH_P5 374761393U
+
+typedef struct {
+    uint32_t v[4];
+    uint64_t total;
+    uint8_t buffer[16];
+    uint32_t buffered;
+} XXH32State;
+
+static uint32_t rotl32(uint32_t x, int r) {
+    return (x << r) | (x >> (32 - r));
+}
+
+static uint32_t xxh32_round(uint32_t acc, uint32_t input) {
+    acc += input * XXH_P2;
+    acc = rotl32(acc, 13);
+    return acc * XXH_P1;
+}
+
+static void xxh32_init(XXH32State* s) {
+    s->v[0] = XXH_P1 + XXH_P2;
+    s->v[1] = XXH_P2;
+    s->v[2] = 0;
+    s->v[3] = 0U - XXH_P1;
+    s->total = 0;
+    s->buffered = 0;
+}
+
+static void xxh32_update(XXH32State* s, const uint8_t* p, size_t len) {
+    s->total += len;
+    
+    if (s->buffered + len < 16) {
+        memcpy(s->buffer + s->buffered, p, len);
+        s->buffered += (uint32_t)len;
+        return;
+    }
+    
+    if (s->buffered) {
+        size_t fill = 16 - s->buffered;
+        memcpy(s->buffer + s->buffered, p, fill);
+        for (int i = 0; i < 4; i++) {
+            s->v[i] = xxh32_round(s->v[i], read_le32(s->buffer + i * 4));
+        }
+        p += fill;
+        len -= fill;
+        s->buffered = 0;
+    }
+    
+    uint32_t v0 = s->v[0], v1 = s->v[1], v2 = s->v[2], v3 = s->v[3];
+    while (len >= 16) {
+        v0 = xxh32_round(v0, read_le32(p));
+        v1 = xxh32_round(v1, read_le32(p + 4));
+        v2 = xxh32_round(v2, read_le32(p + 8));
+        v3 = xxh32_round(v3, read_le32(p + 12));
+        p += 16;
+        len -= 16;
+    }
+    s->v[0] = v0; s->v[1] = v1; s->v[2] = v2; s->v[3] = v3;
+    
+    memcpy(s->buffer, p, len);
+    s->buffered = (uint32_t)len;
+}
+
+static uint32_t xxh32_digest(const XXH32State* s) {
+    uint32_t h;
+    if (s->total >= 16) {
+        h = rotl32(s->v[0], 1) + rotl32(s->v[1], 7) + rotl32(s->v[2], 12) + rotl32(s->v[3], 18);
+    } else {
+        h = s->v[2] + XXH_P5;  /* v[2] still holds the seed (0) */
+    }
+    h += (uint32_t)s->total;
+    
+    const uint8_t* p = s->buffer;
+    uint32_t len = s->buffered;
+    while (len >= 4) {
+        h += read_le32(p) * XXH_P3;
+        h = rotl32(h, 17) * XXH_P4;
+        p += 4;
+        len -= 4;
+    }
+    while (len > 0) {
+        h += (*p) * XXH_P5;
+        h = rotl32(h, 11) * XXH_P1;
+        p++;
+        len--;
+    }
+    
+    h ^= h >> 15;
+    h *= XXH_P2;
+    h ^= h >> 13;
+    h *= XXH_P3;
+    h ^= h >> 16;
+    return h;
+}
+
+/* One-shot XXH32 with seed 0 */
+uint32_t lz4_xxh32(const uint8_t* data, int64_t len) {
+    XXH32State s;
+    xxh32_init(&s);
+    if (data && len > 0) {
+        xxh32_update(&s, data, (size_t)len);
+    }
+    return xxh32_digest(&s);
+}
+
+/* Block format: sequence emission */
+
+/* Write one sequence; returns new op, or NULL if it would not fit */
+static uint8_t* emit_sequence(uint8_t* op, uint8_t* oend,
+                              const uint8_t* literals, int64_t lit_len,
+                              uint32_t offset, int64_t match_len) {
+    /* Worst case: token + length bytes + literals + offset + length bytes */
+    int64_t need = 1 + lit_len / 255 + 1 + lit_len + 2 + match_len / 255 + 1;
+    if (need > oend - op) {
+        return NULL;
+    }
+    
+    uint8_t* token = op++;
+    if (lit_len >= 15) {
+        *token = 15 << 4;
+        int64_t rest = lit_len - 15;
+        while (rest >= 255) {
+            *op++ = 255;
+            rest -= 255;
+        }
+        *op++ = (uint8_t)rest;
+    } else {
+        *token = (uint8_t)(lit_len << 4);
+    }
+    memcpy(op, literals, (size_t)lit_len);
+    op += lit_len;
+    
+    op[0] = (uint8_t)offset;
+    op[1] = (uint8_t)(offset >> 8);
+    op += 2;
+    
+    int64_t ml = match_len - LZ4_MINMATCH;
+    if (ml >= 15) {
+        *token |= 15;
+        ml -= 15;
+        while (ml >= 255) {
+            *op++ = 255;
+            ml -= 255;
+        }
+        *op++ = (uint8_t)ml;
+    } else {
+        *token |= (uint8_t)ml;
+    }
+    return op;
+}
+
+/* Write the final literal-only sequence; returns new op, or NULL */
+static uint8_t* emit_last_literals(uint8_t* op, uint8_t* oend, const uint8_t* literals, int64_t lit_len) {
+    int64_t need = 1 + lit_len / 255 + 1 + lit_len;
+    if (need > oend - op) {
+        return NULL;
+    }
+    
+    if (lit_len >= 15) {
+        *op++ = 15 << 4;
+        int64_t rest = lit_len - 15;
+        while (rest >= 255) {
+            *op++ = 255;
+            rest -= 255;
+        }
+        *op++ = (uint8_t)rest;
+    } else {
+        *op++ = (uint8_t)(lit_len << 4);
+    }
+    memcpy(op, literals, (size_t)lit_len);
+    return op + lit_len;
+}
+
+/* Worst-case compressed size of a block of src_len bytes */
+int64_t lz4_compress_bound(int64_t src_len) {
+    if (src_len < 0 || src_len > 0x7E000000) {
+        return 0;  /* Same limit as the reference implementation */
+    }
+    return src_len + src_len / 255 + 16;
+}
+
+static uint32_t hash_fast(uint32_t sequence) {
+    return (sequence * 2654435761U) >> (32 - LZ4_HASH_LOG);
+}
+
+/* Fast compressor */
+static int64_t compress_fast(const uint8_t* src, int64_t src_len, uint8_t* dst, int64_t dst_cap) {
+    uint8_t* op = dst;
+    uint8_t* oend = dst + dst_cap;
+    const uint8_t* anchor = src;
+    
+    if (src_len >= LZ4_MFLIMIT + 1) {
+        uint32_t table[1 << LZ4_HASH_LOG];
+        memset(table, 0, sizeof(table));
+        
+        const uint8_t* ip = src;
+        const uint8_t* mflimit = src + src_len - LZ4_MFLIMIT;
+        const uint8_t* matchlimit = src + src_len - LZ4_LASTLITERALS;
+        
+        table[hash_fast(read32(ip))] = 0;
+        ip++;
+        
+        for (;;) {
+            /* Find a match, stepping faster the longer nothing is found */
+            const uint8_t* ref;
+            uint32_t attempts = 1 << LZ4_SKIP_TRIGGER;
+            for (;;) {
+                if (ip > mflimit) {
+                    goto last_literals;
+                }
+                uint32_t h = hash_fast(read32(ip));
+                ref = src + table[h];
+                table[h] = (uint32_t)(ip - src);
+                if (ref < ip && ip - ref <= LZ4_MAX_DISTANCE && read32(ref) == read32(ip)) {
+                    break;
+                }
+                ip += attempts++ >> LZ4_SKIP_TRIGGER;
+            }
+            
+            /* Extend backwards over bytes the literal run would repeat */
+            while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+                ip--;
+                ref--;
+            }
+            
+            int64_t match_len = LZ4_MINMATCH + count_match(ip + LZ4_MINMATCH, ref + LZ4_MINMATCH, matchlimit);
+            op = emit_sequence(op, oend, anchor, ip - anchor, (uint32_t)(ip - ref), match_len);
+            if (!op) {
+                return 0;
+            }
+            ip += match_len;
+            anchor = ip;
+            
+            if (ip > mflimit) {
+                break;
+            }
+            /* Seed the table with a position inside the match */
+            table[hash_fast(read32(ip - 2))] = (uint32_t)(ip - 2 - src);
+        }
+    }
+
+last_literals:
+    op = emit_last_literals(op, oend, anchor, src + src_len - anchor);
+    if (!op) {
+        return 0;
+    }
+    return op - dst;
+}
+
+/* High-compression compressor: hash chains over a 64 KiB window */
+
+typedef struct {
+    int32_t head[1 << LZ4_HC_HASH_LOG];
+    uint16_t chain[1 << 16];
+    int64_t next_to_insert;
+} HCState;
+
+static uint32_t hash_hc(uint32_t sequence) {
+    return (sequence * 2654435761U) >> (32 - LZ4_HC_HASH_LOG);
+}
+
+static void hc_insert(HCState* hc, const uint8_t* src, int64_t upto) {
+    for (int64_t pos = hc->next_to_insert; pos < upto; pos++) {
+        uint32_t h = hash_hc(read32(src + pos));
+        int64_t delta = pos - hc->head[h];
+        hc->chain[pos & 0xFFFF] = (uint16_t)(delta > LZ4_MAX_DISTANCE ? LZ4_MAX_DISTANCE : delta);
+        hc->head[h] = (int32_t)pos;
+    }
+    if (upto > hc->next_to_insert) {
+        hc->next_to_insert = upto;
+    }
+}
+
+/* Longest match for src+pos; returns length (0 if none) and sets *match_pos */
+static int64_t hc_find(HCState* hc, const uint8_t* src, int64_t pos, const uint8_t* matchlimit,
+                       int attempts, int64_t* match_pos) {
+    hc_insert(hc, src, pos);
+    
+    const uint8_t* ip = src + pos;
+    uint32_t sequence = read32(ip);
+    int64_t best_len = 0;
+    int64_t ref = hc->head[hash_hc(sequence)];
+    
+    while (ref >= 0 && pos - ref <= LZ4_MAX_DISTANCE && attempts-- > 0) {
+        const uint8_t* candidate = src + ref;
+        /* Cheap reject: must beat best_len, so compare the byte that decides it */
+        if (candidate[best_len] == ip[best_len] && read32(candidate) == sequence) {
+            int64_t len = LZ4_MINMATCH + count_match(ip + LZ4_MINMATCH, candidate + LZ4_MINMATCH, matchlimit);
+            if (len > best_len) {
+                best_len = len;
+                *match_pos = ref;
+                if (ip + len >= matchlimit) {
+                    break;  /* Cannot do better */
+                }
+            }
+        }
+        ref -= hc->chain[ref & 0xFFFF];
+    }
+    return best_len;
+}
+
+static int64_t compress_hc(const uint8_t* src, int64_t src_len, uint8_t* dst, int64_t dst_cap, int level) {
+    uint8_t* op = dst;
+    uint8_t* oend = dst + dst_cap;
+    const uint8_t* anchor = src;
+    
+    if (src_len >= LZ4_MFLIMIT + 1) {
+        HCState* hc = malloc(sizeof(HCState));
+        if (!hc) {
+            return 0;
+        }
+        memset(hc->head, 0xFF, sizeof(hc->head));  /* -1: empty */
+        hc->next_to_insert = 0;
+        
+        int attempts = 1 << (level > LZ4_HC_MAX_LEVEL ? LZ4_HC_MAX_LEVEL : level);
+        int64_t mflimit = src_len - LZ4_MFLIMIT;
+        const uint8_t* matchlimit = src + src_len - LZ4_LASTLITERALS;
+        int64_t pos = 0;
+        
+        while (pos <= mflimit) {
+            int64_t ref = 0;
+            int64_t len = hc_find(hc, src, pos, matchlimit, attempts, &ref);
+            if (len < LZ4_MINMATCH) {
+                pos++;
+                continue;
+            }
+            
+            /* Lazy step: prefer a longer match starting one byte later */
+            if (pos + 1 <= mflimit) {
+                int64_t ref2 = 0;
+                int64_t len2 = hc_find(hc, src, pos + 1, matchlimit, attempts, &ref2);
+                if (len2 > len + 1) {
+                    pos++;
+                    len = len2;
+                    ref = ref2;
+                }
+            }
+            
+            op = emit_sequence(op, oend, anchor, (src + pos) - anchor, (uint32_t)(pos - ref), len);
+            if (!op) {
+                free(hc);
+                return 0;
+            }
+            pos += len;
+            anchor = src + pos;
+        }
+        free(hc);
+    }
+    
+    op = emit_last_literals(op, oend, anchor, src + src_len - anchor);
+    if (!op) {
+        return 0;
+    }
+    return op - dst;
+}
+
+/* Compress one block. level 0 = fast, 1..12 = high compression.
+ * Returns compressed size, or 0 if dst_cap is too small (or on error). */
+int64_t lz4_compress_block(const uint8_t* src, int64_t src_len, uint8_t* dst, int64_t dst_cap, int32_t level) {
+    if (!src || !dst || src_len < 0 || dst_cap <= 0 || src_len > 0x7E000000) {
+        return 0;
+    }
+    if (level <= 0) {
+        return compress_fast(src, src_len, dst, dst_cap);
+    }
+    return compress_hc(src, src_len, dst, dst_cap, level);
+}
+
+/* Block decompression */
+/* Matches may reach back before dst into the window [window, dst): that is how
+ * linked frame blocks refer to previous blocks. Every read and write is bounds
+ * checked; the wide copies are only taken with room to spare on both sides. */
+
+static int64_t decompress_impl(const uint8_t* src, int64_t src_len,
+                               uint8_t* window, uint8_t* dst, int64_t dst_cap) {
+    const uint8_t* ip = src;
+    const uint8_t* iend = src + src_len;
+    uint8_t* op = dst;
+    uint8_t* oend = dst + dst_cap;
+    
+    for (;;) {
+        /* Input may only end after the literals of a sequence (see below);
+         * a block cut off right after a match is truncated, not complete */
+        if (ip >= iend) {
+            return -1;
+        }
+        unsigned token = *ip++;
+        
+        /* Literals */
+        size_t lit_len = token >> 4;
+        if (lit_len == 15) {
+            unsigned s;
+            do {
+                if (ip >= iend) {
+                    return -1;
+                }
+                s = *ip++;
+                lit_len += s;
+            } while (s == 255);
+        }
+        if (lit_len <= 16 && iend - ip >= 16 && oend - op >= 16) {
+            memcpy(op, ip, 16);  /* Short run: one fixed-size copy */
+        } else {
+            if ((size_t)(iend - ip) < lit_len || (size_t)(oend - op) < lit_len) {
+                return -1;
+            }
+            memcpy(op, ip, lit_len);
+        }
+        op += lit_len;
+        ip += lit_len;
+        
+        if (ip >= iend) {
+            break;  /* Last sequence carries literals only */
+        }
+        
+        /* Match */
+        if (iend - ip < 2) {
+            return -1;
+        }
+        size_t offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - window)) {
+            return -1;
+        }
+        
+        size_t match_len = token & 15;
+        if (match_len == 15) {
+            unsigned s;
+            do {
+                if (ip >= iend) {
+                    return -1;
+                }
+                s = *ip++;
+                match_len += s;
+            } while (s == 255);
+        }
+        match_len += LZ4_MINMATCH;
+        if ((size_t)(oend - op) < match_len) {
+            return -1;
+        }
+        
+        const uint8_t* match = op - offset;
+        uint8_t* mend = op + match_len;
+        if (offset >= 16 && oend - mend >= 16) {
+            /* Non-overlapping in 16-byte steps; may overrun mend by < 16 */
+            do {
+                memcpy(op, match, 16);
+                op += 16;
+                match += 16;
+            } while (op < mend);
+        } else if (offset >= 8 && oend - mend >= 8) {
+            do {
+                memcpy(op, match, 8);
+                op += 8;
+                match += 8;
+            } while (op < mend);
+        } else {
+            /* Short offsets repeat a pattern: byte copy is the correct semantics */
+            while (op < mend) {
+                *op++ = *match++;
+            }
+        }
+        op = mend;
+    }
+    
+    return op - dst;
+}
+
+/* Decompress one block into dst (capacity dst_cap).
+ * Returns decompressed size, or -1 on malformed input / insufficient space.
+ * Bytes of dst beyond the returned size may be overwritten. */
+int64_t lz4_decompress_block(const uint8_t* src, int64_t src_len, uint8_t* dst, int64_t dst_cap) {
+    if (!src || !dst || src_len <= 0 || dst_cap < 0) {
+        return -1;
+    }
+    return decompress_impl(src, src_len, dst, dst, dst_cap);
+}
+
+/* Parallel block compression */
+/* Blocks in a batch are compressed into per-block scratch buffers by a pool of
+ * threads claiming block indices from an atomic counter; the caller then
+ * writes them out in order. */
+
+typedef struct {
+    const uint8_t* src;
+    int64_t src_len;
+    uint8_t* out;         /* Scratch, lz4_compress_bound(src_len) bytes */
+    int64_t out_len;      /* 0 = store uncompressed */
+    uint32_t checksum;    /* XXH32 of the stored bytes (block checksums) */
+} FrameBlock;
+
+typedef struct {
+    FrameBlock* blocks;
+    int count;
+    int next;
+    int level;
+    int block_checksum;
+} FrameJob;
+
+static void frame_job_run(FrameJob* job) {
+    for (;;) {
+#ifdef _WIN32
+        int index = (int)InterlockedIncrement((LONG*)&job->next) - 1;
+#else
+        int index = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+#endif
+        if (index >= job->count) {
+            break;
+        }
+        FrameBlock* block = &job->blocks[index];
+        /* Only keep the compressed form if it is actually smaller */
+        block->out_len = lz4_compress_block(block->src, block->src_len, block->out,
+                                            block->src_len - 1, job->level);
+        if (job->block_checksum) {
+            block->checksum = block->out_len > 0 ? lz4_xxh32(block->out, block->out_len)
+                                                 : lz4_xxh32(block->src, block->src_len);
+        }
+    }
+}
+
+#ifdef _WIN32
+static DWORD WINAPI frame_job_worker(LPVOID arg) {
+    frame_job_run((FrameJob*)arg);
+    return 0;
+}
+#else
+static void* frame_job_worker(void* arg) {
+    frame_job_run((FrameJob*)arg);
+    return NULL;
+}
+#endif
+
+static int resolve_threads(int32_t threads, int block_count) {
+    if (threads <= 0) {
+#ifdef _WIN32
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        threads = (int32_t)info.dwNumberOfProcessors;
+#else
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (int32_t)cpus : 1;
+#endif
+    }
+    if (threads > LZ4_MAX_THREADS) {
+        threads = LZ4_MAX_THREADS;
+    }
+    if (threads > block_count) {
+        threads = block_count;
+    }
+    return threads < 1 ? 1 : threads;
+}
+
+static void frame_job_execute(FrameJob* job, int threads) {
+    job->next = 0;
+#ifdef _WIN32
+    HANDLE handles[LZ4_MAX_THREADS];
+    int started = 0;
+    for (int i = 1; i < threads; i++) {
+        handles[started] = CreateThread(NULL, 0, frame_job_worker, job, 0, NULL);
+        if (!handles[started]) {
+            break;
+        }
+        started++;
+    }
+    frame_job_run(job);
+    for (int i = 0; i < started; i++) {
+        WaitForSingleObject(handles[i], INFINITE);
+        CloseHandle(handles[i]);
+    }
+#else
+    pthread_t handles[LZ4_MAX_THREADS];
+    int started = 0;
+    for (int i = 1; i < threads; i++) {
+        if (pthread_create(&handles[started], NULL, frame_job_worker, job) != 0) {
+            break;  /* The calling thread still drains the whole job */
+        }
+        started++;
+    }
+    frame_job_run(job);
+    for (int i = 0; i < started; i++) {
+        pthread_join(handles[i], NULL);
+    }
+#endif
+}
+
+/* Frame format */
+
+/* Write a frame header; content_size < 0 means unknown. Returns header size. */
+static int64_t write_frame_header(uint8_t* dst, int64_t content_size, int block_checksum) {
+    uint8_t* p = dst;
+    write_le32(p, LZ4_FRAME_MAGIC);
+    p += 4;
+    
+    uint8_t* descriptor = p;
+    uint8_t flg = 0x40 | 0x20 | 0x04;  /* Version 01, independent blocks, content checksum */
+    if (block_checksum) {
+        flg |= 0x10;
+    }
+    if (content_size >= 0) {
+        flg |= 0x08;
+    }
+    *p++ = flg;
+    *p++ = (uint8_t)(LZ4_FRAME_BLOCK_SIZE_ID << 4);
+    if (content_size >= 0) {
+        write_le64(p, (uint64_t)content_size);
+        p += 8;
+    }
+    *p = (uint8_t)((lz4_xxh32(descriptor, p - descriptor) >> 8) & 0xFF);
+    p++;
+    return p - dst;
+}
+
+/* Append compressed blocks to op; returns new op or NULL if out of space */
+static uint8_t* write_frame_blocks(uint8_t* op, uint8_t* oend, FrameBlock* blocks, int count, int block_checksum) {
+    for (int i = 0; i < count; i++) {
+        FrameBlock* block = &blocks[i];
+        int64_t stored = block->out_len > 0 ? block->out_len : block->src_len;
+        if (oend - op < 4 + stored + (block_checksum ? 4 : 0)) {
+            return NULL;
+        }
+        if (block->out_len > 0) {
+            write_le32(op, (uint32_t)block->out_len);
+            memcpy(op + 4, block->out, (size_t)block->out_len);
+        } else {
+            write_le32(op, (uint32_t)block->src_len | 0x80000000U);
+            memcpy(op + 4, block->src, (size_t)block->src_len);
+        }
+        op += 4 + stored;
+        if (block_checksum) {
+            write_le32(op, block->checksum);
+            op += 4;
+        }
+    }
+    return op;
+}
+
+/* Worst-case frame size for src_len bytes of content */
+int64_t lz4_frame_bound(int64_t src_len) {
+    if (src_len < 0) {
+        return 0;
+    }
+    int64_t blocks = (src_len + LZ4_FRAME_BLOCK_SIZE - 1) / LZ4_FRAME_BLOCK_SIZE;
+    /* Blocks that do not compress are stored raw, so no block expands */
+    return LZ4_FRAME_MAX_HEADER + src_len + blocks * 8 + 4 + 4;
+}
+
+/* Compress src into a single LZ4 frame.
+ * level: 0 = fast, 1..12 = high compression. threads: 0 = one per core.
+ * flags: LZ4_FRAME_BLOCK_CHECKSUM to add per-block checksums.
+ * Returns frame size, or -1 on error (dst too small: size it with lz4_frame_bound). */
+int64_t lz4_frame_compress(const uint8_t* src, int64_t src_len, uint8_t* dst, int64_t dst_cap,
+                           int32_t level, int32_t threads, int32_t flags) {
+    if ((!src && src_len > 0) || !dst || src_len < 0) {
+        return -1;
+    }
+    int block_checksum = (flags & LZ4_FRAME_BLOCK_CHECKSUM) != 0;
+    if (dst_cap < LZ4_FRAME_MAX_HEADER) {
+        return -1;
+    }
+    
+    uint8_t* op = dst + write_frame_header(dst, src_len, block_checksum);
+    uint8_t* oend = dst + dst_cap;
+    
+    int count = (int)((src_len + LZ4_FRAME_BLOCK_SIZE - 1) / LZ4_FRAME_BLOCK_SIZE);
+    if (count > 0) {
+        FrameBlock* blocks = calloc((size_t)count, sizeof(FrameBlock));
+        uint8_t* scratch = malloc((size_t)count * LZ4_FRAME_BLOCK_SIZE);
+        if (!blocks || !scratch) {
+            free(blocks);
+            free(scratch);
+            return -1;
+        }
+        for (int i = 0; i < count; i++) {
+            int64_t offset = (int64_t)i * LZ4_FRAME_BLOCK_SIZE;
+            blocks[i].src = src + offset;
+            blocks[i].src_len = src_len - offset < LZ4_FRAME_BLOCK_SIZE ? src_len - offset : LZ4_FRAME_BLOCK_SIZE;
+            blocks[i].out = scratch + offset;
+        }
+        
+        FrameJob job = { blocks, count, 0, level, block_checksum };
+        frame_job_execute(&job, resolve_threads(threads, count));
+        op = write_frame_blocks(op, oend, blocks, count, block_checksum);
+        
+        free(blocks);
+        free(scratch);
+        if (!op) {
+            return -1;
+        }
+    }
+    
+    if (oend - op < 8) {
+        return -1;
+    }
+    write_le32(op, 0);  /* EndMark */
+    write_le32(op + 4, lz4_xxh32(src, src_len));
+    return op + 8 - dst;
+}
+
+/* Compress data into a frame returned as a String - empty String on error */
+String lz4_compress_string(const char* data, int64_t len, int32_t level) {
+    int64_t cap = lz4_frame_bound(len);
+    String result;
+    result.data = malloc((size_t)cap + 1);
+    if (!result.data) {
+        return string_empty();
+    }
+    result.len = lz4_frame_compress((const uint8_t*)data, len, (uint8_t*)result.data, cap, level, 0, 0);
+    if (result.len < 0) {
+        free(result.data);
+        return string_empty();
+    }
+    result.data[result.len] = '\0';
+    return result;
+}
+
+/* Parsed frame header */
+typedef struct {
+    int independent;
+    int block_checksum;
+    int content_checksum;
+    int64_t content_size;   /* -1 if absent */
+    int64_t block_max;
+    int64_t header_len;
+} FrameHeader;
+
+/* Returns 1 on success, 0 if more input is needed, -1 if malformed */
+static int parse_frame_header(const uint8_t* src, int64_t src_len, FrameHeader* h) {
+    if (src_len < 7) {
+        return 0;
+    }
+    if (read_le32(src) != LZ4_FRAME_MAGIC) {
+        return -1;
+    }
+    uint8_t flg = src[4];
+    uint8_t bd = src[5];
+    if ((flg >> 6) != 1 || (flg & 0x02) || (bd & 0x8F)) {
+        return -1;  /* Unknown version or reserved bits set */
+    }
+    int block_size_id = (bd >> 4) & 7;
+    if (block_size_id < 4) {
+        return -1;
+    }
+    
+    h->independent = (flg & 0x20) != 0;
+    h->block_checksum = (flg & 0x10) != 0;
+    h->content_checksum = (flg & 0x04) != 0;
+    h->block_max = (int64_t)1 << (8 + 2 * block_size_id);
+    
+    int64_t len = 6;
+    h->content_size = -1;
+    if (flg & 0x08) {
+        if (src_len < len + 8) {
+            return 0;
+        }
+        h->content_size = (int64_t)read_le64(src + len);
+        len += 8;
+    }
+    if (flg & 0x01) {
+        len += 4;  /* Dictionary ID: dictionaries are not supported */
+        return -1;
+    }
+    if (src_len < len + 1) {
+        return 0;
+    }
+    if (src[len] != (uint8_t)((lz4_xxh32(src + 4, len - 4) >> 8) & 0xFF)) {
+        return -1;
+    }
+    h->header_len = len + 1;
+    return 1;
+}
+
+/* Content size recorded in the frame header, or -1 if absent / not a frame */
+int64_t lz4_frame_content_size(const uint8_t* src, int64_t src_len) {
+    FrameHeader h;
+    if (!src || parse_frame_header(src, src_len, &h) != 1) {
+        return -1;
+    }
+    return h.content_size;
+}
+
+/* Decompress one or more concatenated frames (skippable frames are skipped).
+ * Returns total decompressed size, or -1 on malformed input, checksum
+ * mismatch or insufficient dst_cap. */
+int64_t lz4_frame_decompress(const uint8_t* src, int64_t src_len, uint8_t* dst, int64_t dst_cap) {
+    if (!src || !dst || src_len < 0 || dst_cap < 0) {
+        return -1;
+    }
+    
+    const uint8_t* ip = src;
+    const uint8_t* iend = src + src_len;
+    uint8_t* op = dst;
+    uint8_t* oend = dst + dst_cap;
+    
+    while (ip < iend) {
+        if (iend - ip < 8) {
+            return -1;
+        }
+        uint32_t magic = read_le32(ip);
+        if ((magic & LZ4_SKIPPABLE_MAGIC_MASK) == LZ4_SKIPPABLE_MAGIC) {
+            uint32_t skip = read_le32(ip + 4);
+            if ((uint64_t)(iend - ip - 8) < skip) {
+                return -1;
+            }
+            ip += 8 + skip;
+            continue;
+        }
+        
+        FrameHeader h;
+        if (parse_frame_header(ip, iend - ip, &h) != 1) {
+            return -1;
+        }
+        ip += h.header_len;
+        uint8_t* frame_start = op;
+        
+        for (;;) {
+            if (iend - ip < 4) {
+                return -1;
+            }
+            uint32_t word = read_le32(ip);
+            ip += 4;
+            if (word == 0) {
+                break;  /* EndMark */
+            }
+            
+            int64_t size = word & 0x7FFFFFFF;
+            int raw = (word & 0x80000000U) != 0;
+            if (size > h.block_max || iend - ip < size + (h.block_checksum ? 4 : 0)) {
+                return -1;
+            }
+            if (h.block_checksum && lz4_xxh32(ip, size) != read_le32(ip + size)) {
+                return -1;
+            }
+            
+            if (raw) {
+                if (oend - op < size) {
+                    return -1;
+                }
+                memcpy(op, ip, (size_t)size);
+                op += size;
+            } else {
+                /* Linked blocks may reference the previous 64 KiB of output */
+                uint8_t* window = h.independent ? op : frame_start;
+                int64_t room = oend - op < h.block_max ? oend - op : h.block_max;
+                int64_t n = decompress_impl(ip, size, window, op, room);
+                if (n < 0) {
+                    return -1;
+                }
+                op += n;
+            }
+            ip += size + (h.block_checksum ? 4 : 0);
+        }
+        
+        if (h.content_checksum) {
+            if (iend - ip < 4) {
+                return -1;
+            }
+            if (lz4_xxh32(frame_start, op - frame_start) != read_le32(ip)) {
+                return -1;
+            }
+            ip += 4;
+        }
+        if (h.content_size >= 0 && op - frame_start != h.content_size) {
+            return -1;
+        }
+    }
+    
+    return op - dst;
+}
+
+/* Decompress a frame with a recorded content size into a String.
+ * Returns an empty String on error (and for empty content). */
+String lz4_decompress_string(const char* frame, int64_t len) {
+    int64_t size = lz4_frame_content_size((const uint8_t*)frame, len);
+    if (size < 0) {
+        return string_empty();
+    }
+    String result;
+    result.data = malloc((size_t)size + 1);
+    if (!result.data) {
+        return string_empty();
+    }
+    result.len = lz4_frame_decompress((const uint8_t*)frame, len, (uint8_t*)result.data, size);
+    if (result.len != size) {
+        free(result.data);
+        return string_empty();
+    }
+    result.data[result.len] = '\0';
+    return result;
+}
+
+/* Streaming over file handles (FILE* from file_open) */
+
+static int write_all(FILE* out, const uint8_t* data, size_t len) {
+    return fwrite(data, 1, len, out) == len;
+}
+
+/* Compress everything readable from in as one frame written to out.
+ * Returns 1 on success, 0 on error. Memory use: ~2 * threads * 1 MiB. */
+int32_t lz4_frame_compress_stream(void* in_handle, void* out_handle, int32_t level, int32_t threads, int32_t flags) {
+    FILE* in = (FILE*)in_handle;
+    FILE* out = (FILE*)out_handle;
+    if (!in || !out) {
+        return 0;
+    }
+    int block_checksum = (flags & LZ4_FRAME_BLOCK_CHECKSUM) != 0;
+    int batch = resolve_threads(threads, LZ4_MAX_THREADS);
+    
+    uint8_t header[LZ4_FRAME_MAX_HEADER];
+    int64_t header_len = write_frame_header(header, -1, block_checksum);
+    if (!write_all(out, header, (size_t)header_len)) {
+        return 0;
+    }
+    
+    size_t batch_bytes = (size_t)batch * LZ4_FRAME_BLOCK_SIZE;
+    uint8_t* input = malloc(batch_bytes);
+    uint8_t* scratch = malloc(batch_bytes);
+    uint8_t* output = malloc(batch_bytes + (size_t)batch * 8);
+    FrameBlock* blocks = calloc((size_t)batch, sizeof(FrameBlock));
+    int ok = input && scratch && output && blocks;
+    
+    XXH32State content;
+    xxh32_init(&content);
+    
+    while (ok) {
+        size_t got = fread(input, 1, batch_bytes, in);
+        if (got == 0) {
+            ok = !ferror(in);
+            break;
+        }
+        xxh32_update(&content, input, got);
+        
+        int count = (int)((got + LZ4_FRAME_BLOCK_SIZE - 1) / LZ4_FRAME_BLOCK_SIZE);
+        for (int i = 0; i < count; i++) {
+            size_t offset = (size_t)i * LZ4_FRAME_BLOCK_SIZE;
+            blocks[i].src = input + offset;
+            blocks[i].src_len = (int64_t)(got - offset < LZ4_FRAME_BLOCK_SIZE ? got - offset : LZ4_FRAME_BLOCK_SIZE);
+            blocks[i].out = scratch + offset;
+        }
+        FrameJob job = { blocks, count, 0, level, block_checksum };
+        frame_job_execute(&job, count < batch ? count : batch);
+        
+        uint8_t* end = write_frame_blocks(output, output + batch_bytes + (size_t)batch * 8,
+                                          blocks, count, block_checksum);
+        ok = end && write_all(out, output, (size_t)(end - output));
+        if (got < batch_bytes) {
+            ok = ok && !ferror(in);
+            break;
+        }
+    }
+    
+    if (ok) {
+        uint8_t trailer[8];
+        write_le32(trailer, 0);
+        write_le32(trailer + 4, xxh32_digest(&content));
+        ok = write_all(out, trailer, sizeof(trailer));
+    }
+    
+    free(input);
+    free(scratch);
+    free(output);
+    free(blocks);
+    return ok ? 1 : 0;
+}
+
+static int read_exact(FILE* in, uint8_t* buffer, size_t len) {
+    return fread(buffer, 1, len, in) == len;
+}
+
+/* Decompress frames read from in, writing content to out.
+ * Returns 1 on success, 0 on malformed input, checksum mismatch or I/O error. */
+int32_t lz4_frame_decompress_stream(void* in_handle, void* out_handle) {
+    FILE* in = (FILE*)in_handle;
+    FILE* out = (FILE*)out_handle;
+    if (!in || !out) {
+        return 0;
+    }
+    
+    uint8_t header[LZ4_FRAME_MAX_HEADER];
+    int frames = 0;
+    
+    for (;;) {
+        size_t got = fread(header, 1, 4, in);
+        if (got == 0 && frames > 0 && !ferror(in)) {
+            return 1;  /* Clean end after at least one frame */
+        }
+        if (got != 4) {
+            return 0;
+        }
+        
+        uint32_t magic = read_le32(header);
+        if ((magic & LZ4_SKIPPABLE_MAGIC_MASK) == LZ4_SKIPPABLE_MAGIC) {
+            if (!read_exact(in, header + 4, 4) ||
+                fseek(in, (long)read_le32(header + 4), SEEK_CUR) != 0) {
+                return 0;
+            }
+            frames++;
+            continue;
+        }
+        
+        /* Read the fixed part, then however much the flags say follows */
+        if (!read_exact(in, header + 4, 3)) {
+            return 0;
+        }
+        int64_t header_len = 7 + ((header[4] & 0x08) ? 8 : 0);
+        if (header_len > 7 && !read_exact(in, header + 7, (size_t)(header_len - 7))) {
+            return 0;
+        }
+        FrameHeader h;
+        if (parse_frame_header(header, header_len, &h) != 1) {
+            return 0;
+        }
+        
+        /* Linked blocks need the previous 64 KiB of output as a window */
+        int64_t history = h.independent ? 0 : 65536;
+        uint8_t* compressed = malloc((size_t)h.block_max + 4);
+        uint8_t* decoded = malloc((size_t)(history + h.block_max));
+        if (!compressed || !decoded) {
+            free(compressed);
+            free(decoded);
+            return 0;
+        }
+        
+        XXH32State content;
+        xxh32_init(&content);
+        int64_t kept = 0;    /* History bytes at the start of decoded */
+        int64_t total = 0;
+        int ok = 1;
+        
+        while (ok) {
+            uint8_t word_bytes[4];
+            if (!read_exact(in, word_bytes, 4)) {
+                ok = 0;
+                break;
+            }
+            uint32_t word = read_le32(word_bytes);
+            if (word == 0) {
+                break;
+            }
+            
+            int64_t size = word & 0x7FFFFFFF;
+            int64_t extra = h.block_checksum ? 4 : 0;
+            if (size > h.block_max || !read_exact(in, compressed, (size_t)(size + extra))) {
+                ok = 0;
+                break;
+            }
+            if (h.block_checksum && lz4_xxh32(compressed, size) != read_le32(compressed + size)) {
+                ok = 0;
+                break;
+            }
+            
+            uint8_t* block_out = decoded + kept;
+            int64_t n;
+            if (word & 0x80000000U) {
+                memcpy(block_out, compressed, (size_t)size);
+                n = size;
+            } else {
+                n = decompress_impl(compressed, size, decoded, block_out, h.block_max);
+            }
+            if (n < 0 || !write_all(out, block_out, (size_t)n)) {
+                ok = 0;
+                break;
+            }
+            xxh32_update(&content, block_out, (size_t)n);
+            total += n;
+            
+            if (history) {
+                kept += n;
+                if (kept > history) {
+                    memmove(decoded, decoded + kept - history, (size_t)history);
+                    kept = history;
+                }
+            }
+        }
+        
+        if (ok && h.content_checksum) {
+            uint8_t checksum[4];
+            ok = read_exact(in, checksum, 4) && read_le32(checksum) == xxh32_digest(&content);
+        }
+        if (ok && h.content_size >= 0 && total != h.content_size) {
+            ok = 0;
+        }
+        
+        free(compressed);
+        free(decoded);
+        if (!ok) {
+            return 0;
+        }
+        frames++;
+    }
+}
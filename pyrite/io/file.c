@@ -1,5 +1,10 @@
 /* File I/O implementation in C for Pyrite standard library */
 
+/* copy_file_range() is a GNU extension */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -10,6 +15,19 @@
 #else
 #include <dirent.h>
 #include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#endif
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#ifndef FICLONE
+#define FICLONE _IOW(0x94, 9, int)
+#endif
 #endif
 
 /* String structure (from string.c) */
@@ -156,6 +174,20 @@ void file_close(void* handle) {
     }
 }
 
+/* OS file descriptor behind a handle, for fd-based APIs such as
+ * tcp_send_file(). Pending buffered writes are flushed first. -1 on error. */
+int64_t file_descriptor(void* handle) {
+    FILE* file = (FILE*)handle;
+    if (!file || fflush(file) != 0) {
+        return -1;
+    }
+#ifdef _WIN32
+    return _fileno(file);
+#else
+    return fileno(file);
+#endif
+}
+
 /* Directory entry structure */
 typedef struct {
     char* name;
@@ -249,3 +281,561 @@ void file_read_dir_free_old(DirListing* listing) {
     listing->capacity = 0;
 }
 
+
+/* File copy */
+/* Tries, in order: FICLONE reflink (constant time on CoW filesystems such as
+ * btrfs/XFS), copy_file_range (in-kernel, may be offloaded by the filesystem),
+ * sendfile (in-kernel page cache copy), then a large-buffer read/write loop.
+ * Each stage falls through to the next only if the kernel reports the
+ * operation as unsupported for this pair of files. */
+
+#define FILE_COPY_BUF_SIZE (1024 * 1024)
+
+#ifndef _WIN32
+/* Buffered fallback: copy remaining bytes through a userspace buffer */
+static int copy_fd_buffered(int in_fd, int out_fd) {
+    char* buffer = malloc(FILE_COPY_BUF_SIZE);
+    if (!buffer) {
+        return 0;
+    }
+    
+    for (;;) {
+        ssize_t n = read(in_fd, buffer, FILE_COPY_BUF_SIZE);
+        if (n == 0) {
+            break;
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            free(buffer);
+            return 0;
+        }
+        
+        char* p = buffer;
+        while (n > 0) {
+            ssize_t w = write(out_fd, p, (size_t)n);
+            if (w < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                free(buffer);
+                return 0;
+            }
+            p += w;
+            n -= w;
+        }
+    }
+    
+    free(buffer);
+    return 1;
+}
+
+#ifdef __linux__
+/* Errors meaning a copy method cannot handle this pair of files, as opposed
+ * to a copy that failed (EIO, ENOSPC, ...). ENOTTY is FICLONE before 4.5. */
+static int copy_method_unsupported(int error) {
+    return error == EOPNOTSUPP || error == EXDEV || error == EINVAL || error == ENOSYS ||
+           error == ENOTTY;
+}
+#endif
+
+/* Copy size bytes from in_fd to out_fd, both positioned at offset 0 */
+static int copy_fd_contents(int in_fd, int out_fd, int64_t size) {
+#ifdef __linux__
+    /* 1. Reflink: shares extents, no data is copied */
+    if (ioctl(out_fd, FICLONE, in_fd) == 0) {
+        return 1;
+    }
+    if (!copy_method_unsupported(errno)) {
+        return 0;
+    }
+    
+    /* 2. copy_file_range: stays in the kernel, may be server/fs-offloaded */
+    int64_t copied = 0;
+    int error = 0;
+    while (copied < size) {
+        ssize_t n = copy_file_range(in_fd, NULL, out_fd, NULL, (size_t)(size - copied), 0);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            error = errno;
+            break;
+        }
+        if (n == 0) {
+            break;  /* Source shrank underneath us */
+        }
+        copied += n;
+    }
+    if (copied == size) {
+        return 1;
+    }
+    if (copied > 0 || (error && !copy_method_unsupported(error))) {
+        /* Partial progress means the call is supported but failed: hard error */
+        errno = error ? error : EIO;
+        return 0;
+    }
+    
+    /* 3. sendfile: in-kernel copy through the page cache */
+    error = 0;
+    while (copied < size) {
+        ssize_t n = sendfile(out_fd, in_fd, NULL, (size_t)(size - copied));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            error = errno;
+            break;
+        }
+        if (n == 0) {
+            break;
+        }
+        copied += n;
+    }
+    if (copied == size) {
+        return 1;
+    }
+    if (copied > 0 || (error && !copy_method_unsupported(error))) {
+        errno = error ? error : EIO;
+        return 0;
+    }
+#else
+    (void)size;
+#endif
+    
+    /* 4. Large-buffer userspace loop */
+    return copy_fd_buffered(in_fd, out_fd);
+}
+#endif
+
+/* Copy a single file - returns 1 on success, 0 on error */
+/* The destination is created or truncated and receives the source permissions.
+ * Copying a file onto itself fails with EINVAL instead of truncating it. */
+int file_copy(const char* src, const char* dst) {
+    if (!src || !dst) {
+        return 0;
+    }
+    
+#ifdef _WIN32
+    return CopyFileA(src, dst, FALSE) ? 1 : 0;
+#else
+    int in_fd = open(src, O_RDONLY | O_CLOEXEC);
+    if (in_fd < 0) {
+        return 0;
+    }
+    
+    struct stat st;
+    if (fstat(in_fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(in_fd);
+        return 0;
+    }
+    
+    /* O_TRUNC below would empty the source if dst names the same file */
+    struct stat dst_st;
+    if (stat(dst, &dst_st) == 0 && dst_st.st_dev == st.st_dev && dst_st.st_ino == st.st_ino) {
+        close(in_fd);
+        errno = EINVAL;
+        return 0;
+    }
+    
+    int out_fd = open(dst, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, st.st_mode & 07777);
+    if (out_fd < 0) {
+        close(in_fd);
+        return 0;
+    }
+    
+    int ok = copy_fd_contents(in_fd, out_fd, (int64_t)st.st_size);
+    
+    /* open() applies the umask; match the source mode exactly */
+    if (ok && fchmod(out_fd, st.st_mode & 07777) != 0) {
+        ok = 0;
+    }
+    
+    close(in_fd);
+    if (close(out_fd) != 0) {
+        ok = 0;
+    }
+    return ok;
+#endif
+}
+
+/* Directory tree copy */
+/* The tree is walked once on the calling thread: directories and symlinks are
+ * created immediately (so every destination parent exists), regular files are
+ * queued. The queue is then drained by a pool of worker threads, so many small
+ * files are copied concurrently instead of one syscall chain at a time.
+ * Directories are created owner-writable and receive their source mode only
+ * after everything below them has been copied, so read-only trees copy too. */
+
+#define DIR_COPY_MAX_WORKERS 16
+#define DIR_COPY_MIN_FILES_PER_WORKER 8
+
+typedef struct {
+    char* src;
+    char* dst;
+} CopyJob;
+
+typedef struct {
+    char* path;
+    unsigned int mode;
+} CopyDir;
+
+typedef struct {
+    CopyJob* jobs;
+    int count;
+    int capacity;
+    int next;           /* Next job index to claim (atomic) */
+    int failed;         /* Set to 1 by any worker on error (atomic) */
+    CopyDir* dirs;      /* Created directories in creation (pre-)order */
+    int dir_count;
+    int dir_capacity;
+} CopyQueue;
+
+static char* copy_path_join(const char* base, const char* name) {
+    size_t base_len = strlen(base);
+    size_t name_len = strlen(name);
+    char* result = malloc(base_len + 1 + name_len + 1);
+    if (!result) {
+        return NULL;
+    }
+    memcpy(result, base, base_len);
+#ifdef _WIN32
+    result[base_len] = '\\';
+#else
+    result[base_len] = '/';
+#endif
+    memcpy(result + base_len + 1, name, name_len + 1);
+    return result;
+}
+
+static int copy_queue_push(CopyQueue* queue, char* src, char* dst) {
+    if (queue->count >= queue->capacity) {
+        int new_capacity = queue->capacity ? queue->capacity * 2 : 64;
+        CopyJob* jobs = realloc(queue->jobs, sizeof(CopyJob) * new_capacity);
+        if (!jobs) {
+            return 0;
+        }
+        queue->jobs = jobs;
+        queue->capacity = new_capacity;
+    }
+    queue->jobs[queue->count].src = src;
+    queue->jobs[queue->count].dst = dst;
+    queue->count++;
+    return 1;
+}
+
+static int copy_queue_push_dir(CopyQueue* queue, const char* path, unsigned int mode) {
+    if (queue->dir_count >= queue->dir_capacity) {
+        int new_capacity = queue->dir_capacity ? queue->dir_capacity * 2 : 16;
+        CopyDir* dirs = realloc(queue->dirs, sizeof(CopyDir) * new_capacity);
+        if (!dirs) {
+            return 0;
+        }
+        queue->dirs = dirs;
+        queue->dir_capacity = new_capacity;
+    }
+    char* copy = strdup(path);
+    if (!copy) {
+        return 0;
+    }
+    queue->dirs[queue->dir_count].path = copy;
+    queue->dirs[queue->dir_count].mode = mode;
+    queue->dir_count++;
+    return 1;
+}
+
+static void copy_queue_free(CopyQueue* queue) {
+    for (int i = 0; i < queue->count; i++) {
+        free(queue->jobs[i].src);
+        free(queue->jobs[i].dst);
+    }
+    free(queue->jobs);
+    for (int i = 0; i < queue->dir_count; i++) {
+        free(queue->dirs[i].path);
+    }
+    free(queue->dirs);
+}
+
+/* Create dst directory and recursively populate the queue from src */
+static int copy_tree_collect(const char* src, const char* dst, CopyQueue* queue) {
+#ifdef _WIN32
+    if (!CreateDirectoryA(dst, NULL) && GetLastError() != ERROR_ALREADY_EXISTS) {
+        return 0;
+    }
+    
+    char search_path[1024];
+    snprintf(search_path, sizeof(search_path), "%s\\*", src);
+    
+    WIN32_FIND_DATA find_data;
+    HANDLE find_handle = FindFirstFile(search_path, &find_data);
+    if (find_handle == INVALID_HANDLE_VALUE) {
+        return 0;
+    }
+    
+    int ok = 1;
+    do {
+        if (strcmp(find_data.cFileName, ".") == 0 ||
+            strcmp(find_data.cFileName, "..") == 0) {
+            continue;
+        }
+        
+        char* child_src = copy_path_join(src, find_data.cFileName);
+        char* child_dst = copy_path_join(dst, find_data.cFileName);
+        if (!child_src || !child_dst) {
+            free(child_src);
+            free(child_dst);
+            ok = 0;
+            break;
+        }
+        
+        if (find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            ok = copy_tree_collect(child_src, child_dst, queue);
+            free(child_src);
+            free(child_dst);
+        } else if (!copy_queue_push(queue, child_src, child_dst)) {
+            free(child_src);
+            free(child_dst);
+            ok = 0;
+        }
+    } while (ok && FindNextFile(find_handle, &find_data));
+    
+    FindClose(find_handle);
+    return ok;
+#else
+    struct stat st;
+    if (stat(src, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        return 0;
+    }
+    /* Writable until its contents are in place; see copy_tree_apply_modes */
+    if (mkdir(dst, (st.st_mode & 07777) | S_IRWXU) != 0 && errno != EEXIST) {
+        return 0;
+    }
+    if (!copy_queue_push_dir(queue, dst, st.st_mode & 07777)) {
+        return 0;
+    }
+    
+    DIR* dir = opendir(src);
+    if (!dir) {
+        return 0;
+    }
+    
+    int ok = 1;
+    struct dirent* entry;
+    while (ok && (entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 ||
+            strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        
+        char* child_src = copy_path_join(src, entry->d_name);
+        char* child_dst = copy_path_join(dst, entry->d_name);
+        if (!child_src || !child_dst) {
+            free(child_src);
+            free(child_dst);
+            ok = 0;
+            break;
+        }
+        
+        /* Resolve the type only when readdir could not report it */
+        unsigned char type = entry->d_type;
+        if (type == DT_UNKNOWN) {
+            struct stat child_st;
+            if (lstat(child_src, &child_st) != 0) {
+                type = DT_UNKNOWN;
+            } else if (S_ISDIR(child_st.st_mode)) {
+                type = DT_DIR;
+            } else if (S_ISLNK(child_st.st_mode)) {
+                type = DT_LNK;
+            } else if (S_ISREG(child_st.st_mode)) {
+                type = DT_REG;
+            }
+        }
+        
+        if (type == DT_DIR) {
+            ok = copy_tree_collect(child_src, child_dst, queue);
+            free(child_src);
+            free(child_dst);
+        } else if (type == DT_LNK) {
+            /* Recreate symlinks rather than following them */
+            char target[4096];
+            ssize_t target_len = readlink(child_src, target, sizeof(target) - 1);
+            if (target_len < 0) {
+                ok = 0;
+            } else {
+                target[target_len] = '\0';
+                if (symlink(target, child_dst) != 0 && errno != EEXIST) {
+                    ok = 0;
+                }
+            }
+            free(child_src);
+            free(child_dst);
+        } else if (type == DT_REG) {
+            if (!copy_queue_push(queue, child_src, child_dst)) {
+                free(child_src);
+                free(child_dst);
+                ok = 0;
+            }
+        } else {
+            /* Skip sockets, fifos and devices */
+            free(child_src);
+            free(child_dst);
+        }
+    }
+    
+    closedir(dir);
+    return ok;
+#endif
+}
+
+#ifndef _WIN32
+/* Give each created directory its source mode, deepest first, so a read-only
+ * or non-searchable parent never blocks the directories below it */
+static int copy_tree_apply_modes(CopyQueue* queue) {
+    int ok = 1;
+    for (int i = queue->dir_count - 1; i >= 0; i--) {
+        if (chmod(queue->dirs[i].path, (mode_t)queue->dirs[i].mode) != 0) {
+            ok = 0;
+        }
+    }
+    return ok;
+}
+
+static void* copy_tree_worker(void* arg) {
+    CopyQueue* queue = (CopyQueue*)arg;
+    
+    for (;;) {
+        int index = __atomic_fetch_add(&queue->next, 1, __ATOMIC_RELAXED);
+        if (index >= queue->count) {
+            break;
+        }
+        if (!file_copy(queue->jobs[index].src, queue->jobs[index].dst)) {
+            __atomic_store_n(&queue->failed, 1, __ATOMIC_RELAXED);
+        }
+    }
+    
+    return NULL;
+}
+#endif
+
+#ifndef _WIN32
+/* Whether dst is src itself or lies below it. dst usually does not exist
+ * yet, so its nearest existing ancestor is canonicalized and it and every
+ * parent of it are compared with src by device and inode (which also sees
+ * through symlinks and bind mounts). */
+static int copy_dst_inside_src(const char* src, const char* dst) {
+    struct stat src_st;
+    if (stat(src, &src_st) != 0) {
+        return 0;   /* copy_tree_collect reports the missing source */
+    }
+    
+    char* path = strdup(dst);
+    if (!path) {
+        return 0;
+    }
+    char* real;
+    while ((real = realpath(path, NULL)) == NULL && (errno == ENOENT || errno == ENOTDIR)) {
+        /* Drop the last component; a relative name ends up at "." */
+        char* slash = strrchr(path, '/');
+        if (slash) {
+            slash[slash == path ? 1 : 0] = '\0';
+        } else if (strcmp(path, ".") != 0) {
+            free(path);
+            path = strdup(".");
+            if (!path) {
+                return 0;
+            }
+        } else {
+            break;
+        }
+    }
+    free(path);
+    if (!real) {
+        return 0;
+    }
+    
+    int inside = 0;
+    for (;;) {
+        struct stat st;
+        if (stat(real, &st) == 0 && st.st_dev == src_st.st_dev && st.st_ino == src_st.st_ino) {
+            inside = 1;
+            break;
+        }
+        char* slash = strrchr(real, '/');
+        if (!slash || real[1] == '\0') {
+            break;
+        }
+        slash[slash == real ? 1 : 0] = '\0';
+    }
+    free(real);
+    return inside;
+}
+#endif
+
+/* Recursively copy directory src to dst - returns 1 on success, 0 on error */
+/* dst is created if missing; existing files inside it are overwritten.
+ * Copying a directory into itself fails with EINVAL before dst is created. */
+int dir_copy_tree(const char* src, const char* dst) {
+    if (!src || !dst) {
+        return 0;
+    }
+    
+#ifndef _WIN32
+    if (copy_dst_inside_src(src, dst)) {
+        errno = EINVAL;
+        return 0;
+    }
+#endif
+    
+    CopyQueue queue;
+    memset(&queue, 0, sizeof(queue));
+    
+    if (!copy_tree_collect(src, dst, &queue)) {
+#ifndef _WIN32
+        copy_tree_apply_modes(&queue);
+#endif
+        copy_queue_free(&queue);
+        return 0;
+    }
+    
+#ifdef _WIN32
+    for (int i = 0; i < queue.count; i++) {
+        if (!file_copy(queue.jobs[i].src, queue.jobs[i].dst)) {
+            queue.failed = 1;
+        }
+    }
+#else
+    /* Size the pool to the work: small trees are copied on this thread */
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int workers = queue.count / DIR_COPY_MIN_FILES_PER_WORKER;
+    if (cpus > 0 && workers > cpus) {
+        workers = (int)cpus;
+    }
+    if (workers > DIR_COPY_MAX_WORKERS) {
+        workers = DIR_COPY_MAX_WORKERS;
+    }
+    
+    pthread_t threads[DIR_COPY_MAX_WORKERS];
+    int started = 0;
+    for (int i = 1; i < workers; i++) {
+        if (pthread_create(&threads[started], NULL, copy_tree_worker, &queue) != 0) {
+            break;  /* Fewer workers is fine; the calling thread also drains */
+        }
+        started++;
+    }
+    
+    copy_tree_worker(&queue);
+    
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    
+    if (!copy_tree_apply_modes(&queue)) {
+        queue.failed = 1;
+    }
+#endif
+    
+    int ok = !queue.failed;
+    copy_queue_free(&queue);
+    return ok;
+}
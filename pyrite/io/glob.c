@@ -0,0 +1,1230 @@
+/* Glob matching implementation in C for Pyrite standard library */
+/* Patterns use '/' as the separator and support:
+ *   *        any run of bytes within one path segment
+ *   **       as a whole segment: zero or more segments (so a trailing
+ *            "/" + "**" means everything under a directory)
+ *   ?        one byte other than '/'
+ *   [a-z]    character classes ([!x] or [^x] negates; never matches '/')
+ *   {a,b}    alternation (may nest)
+ *   \x       a literal x
+ * An unclosed '[' or '{' is taken literally.
+ *
+ * A GlobSet combines any number of patterns into one automaton: the patterns
+ * are laid out as a position NFA and determinized lazily, one DFA state per
+ * distinct set of live positions, with transitions over byte classes. Each
+ * path byte is then one table lookup no matter how many patterns the set
+ * holds. Patterns that are a literal with at most one wildcard ("*.pyrite",
+ * "docs/README.md", a directory followed by "**") are also kept as
+ * prefix/suffix checks, which glob_set_match uses when every pattern in the
+ * set is that simple.
+ *
+ * The directory walker (glob_walk_*) threads DFA states down the tree: a
+ * child is matched by feeding only its name from the parent's state, and a
+ * directory is not read at all when no include pattern can match beneath it
+ * or an exclude pattern matches all of it. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "pathbuf.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+/* Position kinds */
+#define GLOB_POS_BYTE 0         /* One byte from set, then next position */
+#define GLOB_POS_STAR 1         /* Any run of bytes from set (never '/') */
+#define GLOB_POS_GLOBSTAR_DIR 2 /* "**" + "/": zero or more whole segments */
+#define GLOB_POS_GLOBSTAR_IN 3  /* Inside a GLOBSTAR_DIR segment run (always follows it) */
+#define GLOB_POS_ANY_STAR 4     /* Any run of bytes, '/' included */
+#define GLOB_POS_END 5          /* Accepting position of one pattern */
+
+/* Simple pattern shapes (prefix P, suffix S) */
+#define GLOB_SIMPLE_NONE 0      /* Needs the automaton */
+#define GLOB_SIMPLE_EXACT 1     /* P */
+#define GLOB_SIMPLE_STAR 2      /* P*S, S without '/' */
+#define GLOB_SIMPLE_GLOBSTAR 3  /* P, "**", "/", "*", S; P empty or ending in '/' */
+#define GLOB_SIMPLE_TREE 4      /* P, "/", "**" */
+
+/* DFA state flags (computed on demand) */
+#define GLOB_STATE_LIVE_KNOWN 1
+#define GLOB_STATE_LIVE 2        /* Some accepting state is reachable */
+#define GLOB_STATE_FULL_KNOWN 4
+#define GLOB_STATE_FULL 8        /* Every reachable state accepts */
+
+/* Limits */
+#define GLOB_MAX_EXPANSIONS 1024 /* Brace alternatives per pattern */
+#define GLOB_MAX_DFA_STATES 8192 /* The DFA is flushed and rebuilt past this */
+
+#define GLOB_DEAD 0             /* DFA state with no live positions */
+
+/* Walker flags */
+#define GLOB_WALK_FILES 1
+#define GLOB_WALK_DIRS 2
+
+typedef struct {
+    uint8_t kind;
+    int32_t pattern;            /* Original pattern index (GLOB_POS_END only) */
+    uint8_t set[32];            /* Byte bitmap (GLOB_POS_BYTE / GLOB_POS_STAR) */
+} GlobPos;
+
+typedef struct {
+    int32_t kind;
+    char* prefix;
+    int64_t prefix_len;
+    char* suffix;
+    int64_t suffix_len;
+} GlobSimple;
+
+typedef struct {
+    /* Position NFA */
+    GlobPos* positions;
+    int32_t position_count;
+    int32_t position_cap;
+    int32_t pattern_count;
+    int32_t start_count;
+    int32_t start_cap;
+    int32_t* starts;            /* First position of every expanded pattern */
+    
+    /* Literal fast path, one per original pattern */
+    GlobSimple* simple;
+    int32_t simple_cap;
+    int all_simple;
+    
+    /* Lazy DFA (rebuilt when patterns are added) */
+    int compiled;
+    uint8_t byte_class[256];
+    int32_t class_count;
+    int32_t words;              /* uint64_t words per position set */
+    uint64_t* sets;             /* state_count * words */
+    int32_t* trans;             /* state_count * class_count, -1 = not built */
+    int32_t* accept;            /* Lowest accepting pattern, or -1 */
+    uint8_t* flags;
+    int32_t state_count;
+    int32_t state_cap;
+    int32_t* table;             /* Open-addressed set -> state id */
+    int32_t table_cap;
+    int32_t start_state;
+    uint64_t generation;        /* Bumped whenever state ids are discarded */
+    uint64_t* scratch;
+} GlobSet;
+
+static void bitmap_set(uint8_t* set, unsigned char b) {
+    set[b >> 3] |= (uint8_t)(1 << (b & 7));
+}
+
+static int bitmap_has(const uint8_t* set, unsigned char b) {
+    return (set[b >> 3] >> (b & 7)) & 1;
+}
+
+/* Pattern parsing */
+
+static int glob_add_position(GlobSet* set, uint8_t kind, const uint8_t* bytes, int32_t pattern) {
+    if (set->position_count == set->position_cap) {
+        int32_t cap = set->position_cap ? set->position_cap * 2 : 64;
+        GlobPos* positions = realloc(set->positions, sizeof(GlobPos) * (size_t)cap);
+        if (!positions) {
+            return 0;
+        }
+        set->positions = positions;
+        set->position_cap = cap;
+    }
+    GlobPos* pos = &set->positions[set->position_count++];
+    pos->kind = kind;
+    pos->pattern = pattern;
+    if (bytes) {
+        memcpy(pos->set, bytes, sizeof(pos->set));
+    } else {
+        memset(pos->set, 0, sizeof(pos->set));
+    }
+    return 1;
+}
+
+/* Parse a class starting after '['. Returns the index past ']', or -1 if the
+ * class is not closed (the '[' is then literal). */
+static int64_t glob_parse_class(const char* p, int64_t len, int64_t i, uint8_t* bytes) {
+    int negate = 0;
+    if (i < len && (p[i] == '!' || p[i] == '^')) {
+        negate = 1;
+        i++;
+    }
+    memset(bytes, 0, 32);
+    int64_t first = i;
+    while (i < len && (p[i] != ']' || i == first)) {
+        unsigned char lo = (unsigned char)p[i];
+        if (lo == '\\' && i + 1 < len) {
+            lo = (unsigned char)p[++i];
+        }
+        unsigned char hi = lo;
+        if (i + 2 < len && p[i + 1] == '-' && p[i + 2] != ']') {
+            hi = (unsigned char)p[i + 2];
+            if (hi == '\\' && i + 3 < len) {
+                hi = (unsigned char)p[++i + 2];
+            }
+            i += 2;
+        }
+        for (int c = lo; c <= hi; c++) {
+            bitmap_set(bytes, (unsigned char)c);
+        }
+        i++;
+    }
+    if (i >= len) {
+        return -1;
+    }
+    if (negate) {
+        for (int k = 0; k < 32; k++) {
+            bytes[k] = (uint8_t)~bytes[k];
+        }
+    }
+    bytes[(unsigned char)'/' >> 3] &= (uint8_t)~(1 << ('/' & 7));
+    return i + 1;
+}
+
+/* Append the positions for one brace-free pattern */
+static int glob_compile_one(GlobSet* set, const char* p, int64_t len, int32_t pattern) {
+    if (set->start_count == set->start_cap) {
+        int32_t cap = set->start_cap ? set->start_cap * 2 : 16;
+        int32_t* starts = realloc(set->starts, sizeof(int32_t) * (size_t)cap);
+        if (!starts) {
+            return 0;
+        }
+        set->starts = starts;
+        set->start_cap = cap;
+    }
+    set->starts[set->start_count++] = set->position_count;
+    
+    uint8_t bytes[32];
+    uint8_t not_sep[32];
+    memset(not_sep, 0xff, sizeof(not_sep));
+    not_sep['/' >> 3] &= (uint8_t)~(1 << ('/' & 7));
+    
+    int64_t i = 0;
+    while (i < len) {
+        char c = p[i];
+        int segment_start = i == 0 || p[i - 1] == '/';
+        if (c == '*' && i + 1 < len && p[i + 1] == '*' && segment_start &&
+            (i + 2 == len || p[i + 2] == '/')) {
+            /* "**" as a whole segment */
+            if (i + 2 == len) {
+                if (!glob_add_position(set, GLOB_POS_ANY_STAR, NULL, -1)) {
+                    return 0;
+                }
+                i += 2;
+            } else {
+                if (!glob_add_position(set, GLOB_POS_GLOBSTAR_DIR, NULL, -1)) {
+                    return 0;
+                }
+                if (!glob_add_position(set, GLOB_POS_GLOBSTAR_IN, NULL, -1)) {
+                    return 0;
+                }
+                i += 3;
+            }
+            continue;
+        }
+        if (c == '*') {
+            /* Runs of '*' inside a segment are one star */
+            while (i < len && p[i] == '*') {
+                i++;
+            }
+            if (!glob_add_position(set, GLOB_POS_STAR, not_sep, -1)) {
+                return 0;
+            }
+            continue;
+        }
+        if (c == '?') {
+            if (!glob_add_position(set, GLOB_POS_BYTE, not_sep, -1)) {
+                return 0;
+            }
+            i++;
+            continue;
+        }
+        if (c == '[') {
+            int64_t end = glob_parse_class(p, len, i + 1, bytes);
+            if (end > 0) {
+                if (!glob_add_position(set, GLOB_POS_BYTE, bytes, -1)) {
+                    return 0;
+                }
+                i = end;
+                continue;
+            }
+        }
+        if (c == '\\' && i + 1 < len) {
+            c = p[++i];
+        }
+        memset(bytes, 0, sizeof(bytes));
+        bitmap_set(bytes, (unsigned char)c);
+        if (!glob_add_position(set, GLOB_POS_BYTE, bytes, -1)) {
+            return 0;
+        }
+        i++;
+    }
+    return glob_add_position(set, GLOB_POS_END, NULL, pattern);
+}
+
+/* Find the first top-level "{...,...}" group; returns 0 if there is none */
+static int glob_find_braces(const char* p, int64_t len, int64_t* open, int64_t* close) {
+    for (int64_t i = 0; i < len; i++) {
+        if (p[i] == '\\') {
+            i++;
+            continue;
+        }
+        if (p[i] != '{') {
+            continue;
+        }
+        int depth = 0;
+        int has_comma = 0;
+        for (int64_t j = i; j < len; j++) {
+            if (p[j] == '\\') {
+                j++;
+            } else if (p[j] == '{') {
+                depth++;
+            } else if (p[j] == '}') {
+                if (--depth == 0) {
+                    if (!has_comma) {
+                        break;
+                    }
+                    *open = i;
+                    *close = j;
+                    return 1;
+                }
+            } else if (p[j] == ',' && depth == 1) {
+                has_comma = 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/* Expand braces recursively, compiling each alternative */
+static int glob_expand(GlobSet* set, const char* p, int64_t len, int32_t pattern, int* budget) {
+    int64_t open = 0;
+    int64_t close = 0;
+    if (!glob_find_braces(p, len, &open, &close)) {
+        if (--*budget < 0) {
+            return 0;
+        }
+        return glob_compile_one(set, p, len, pattern);
+    }
+    
+    char* buf = malloc((size_t)len + 1);
+    if (!buf) {
+        return 0;
+    }
+    int ok = 1;
+    int depth = 0;
+    int64_t alt_start = open + 1;
+    for (int64_t j = open + 1; ok && j <= close; j++) {
+        if (p[j] == '\\' && j < close) {
+            j++;
+            continue;
+        }
+        if (p[j] == '{') {
+            depth++;
+        } else if (p[j] == '}' && depth > 0) {
+            depth--;
+        } else if ((p[j] == ',' && depth == 0) || j == close) {
+            /* prefix + alternative + rest */
+            int64_t n = 0;
+            memcpy(buf, p, (size_t)open);
+            n += open;
+            memcpy(buf + n, p + alt_start, (size_t)(j - alt_start));
+            n += j - alt_start;
+            memcpy(buf + n, p + close + 1, (size_t)(len - close - 1));
+            n += len - close - 1;
+            ok = glob_expand(set, buf, n, pattern, budget);
+            alt_start = j + 1;
+        }
+    }
+    free(buf);
+    return ok;
+}
+
+/* Classify a pattern as a literal prefix/suffix check if it has that shape */
+static void glob_classify(const char* p, int64_t len, GlobSimple* out) {
+    memset(out, 0, sizeof(*out));
+    
+    /* Literal prefix: up to the first special byte */
+    int64_t i = 0;
+    while (i < len && !strchr("*?[{\\", p[i])) {
+        i++;
+    }
+    int64_t prefix_len = i;
+    int64_t suffix_start = len;
+    int kind;
+    
+    if (i == len) {
+        kind = GLOB_SIMPLE_EXACT;
+    } else if (len - i == 2 && prefix_len > 0 && p[i - 1] == '/' && p[i] == '*' && p[i + 1] == '*') {
+        kind = GLOB_SIMPLE_TREE;
+        prefix_len--;
+    } else if (len - i >= 4 && (prefix_len == 0 || p[i - 1] == '/') && memcmp(p + i, "**/*", 4) == 0) {
+        kind = GLOB_SIMPLE_GLOBSTAR;
+        suffix_start = i + 4;
+    } else if (p[i] == '*' && (i + 1 == len || p[i + 1] != '*')) {
+        kind = GLOB_SIMPLE_STAR;
+        suffix_start = i + 1;
+    } else {
+        return;
+    }
+    
+    /* The suffix must be literal and within one segment */
+    for (int64_t j = suffix_start; j < len; j++) {
+        if (strchr("*?[{\\/", p[j])) {
+            return;
+        }
+    }
+    
+    out->prefix = malloc((size_t)prefix_len + 1);
+    out->suffix = malloc((size_t)(len - suffix_start) + 1);
+    if (!out->prefix || !out->suffix) {
+        free(out->prefix);
+        free(out->suffix);
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    memcpy(out->prefix, p, (size_t)prefix_len);
+    out->prefix[prefix_len] = '\0';
+    out->prefix_len = prefix_len;
+    memcpy(out->suffix, p + suffix_start, (size_t)(len - suffix_start));
+    out->suffix[len - suffix_start] = '\0';
+    out->suffix_len = len - suffix_start;
+    out->kind = kind;
+}
+
+static int glob_simple_match(const GlobSimple* s, const char* path, int64_t len) {
+    if (len < s->prefix_len || memcmp(path, s->prefix, (size_t)s->prefix_len) != 0) {
+        return 0;
+    }
+    switch (s->kind) {
+        case GLOB_SIMPLE_EXACT:
+            return len == s->prefix_len;
+        case GLOB_SIMPLE_TREE:
+            return len > s->prefix_len && path[s->prefix_len] == '/';
+        case GLOB_SIMPLE_STAR:
+        case GLOB_SIMPLE_GLOBSTAR: {
+            if (len - s->prefix_len < s->suffix_len ||
+                memcmp(path + len - s->suffix_len, s->suffix, (size_t)s->suffix_len) != 0) {
+                return 0;
+            }
+            if (s->kind == GLOB_SIMPLE_STAR) {
+                return memchr(path + s->prefix_len, '/', (size_t)(len - s->prefix_len - s->suffix_len)) == NULL;
+            }
+            return 1;
+        }
+        default:
+            return 0;
+    }
+}
+
+/* Lazy DFA */
+
+static void glob_dfa_free(GlobSet* set) {
+    free(set->sets);
+    free(set->trans);
+    free(set->accept);
+    free(set->flags);
+    free(set->table);
+    free(set->scratch);
+    set->sets = NULL;
+    set->trans = NULL;
+    set->accept = NULL;
+    set->flags = NULL;
+    set->table = NULL;
+    set->scratch = NULL;
+    set->state_count = 0;
+    set->state_cap = 0;
+    set->table_cap = 0;
+    set->compiled = 0;
+}
+
+/* Add i and everything reachable from it without consuming a byte */
+static void glob_closure(const GlobSet* set, uint64_t* bits, int32_t i) {
+    for (;;) {
+        bits[i >> 6] |= 1ULL << (i & 63);
+        uint8_t kind = set->positions[i].kind;
+        if (kind == GLOB_POS_STAR || kind == GLOB_POS_ANY_STAR) {
+            i++;
+        } else if (kind == GLOB_POS_GLOBSTAR_DIR) {
+            i += 2;     /* Zero segments: skip the inner position */
+        } else {
+            return;
+        }
+    }
+}
+
+static uint64_t glob_set_hash(const uint64_t* bits, int32_t words) {
+    uint64_t h = 1469598103934665603ULL;
+    for (int32_t w = 0; w < words; w++) {
+        h ^= bits[w];
+        h *= 1099511628211ULL;
+        h ^= h >> 29;
+    }
+    return h;
+}
+
+/* Discard every state (ids held by callers become invalid) */
+static void glob_dfa_reset(GlobSet* set) {
+    set->state_count = 0;
+    for (int32_t i = 0; i < set->table_cap; i++) {
+        set->table[i] = -1;
+    }
+    set->generation++;
+}
+
+/* Return the id for a position set, creating the state if needed; -1 when
+ * out of memory or when the state limit is reached */
+static int32_t glob_intern(GlobSet* set, const uint64_t* bits) {
+    int32_t words = set->words;
+    uint64_t h = glob_set_hash(bits, words);
+    int32_t mask = set->table_cap - 1;
+    int32_t slot = (int32_t)(h & (uint64_t)mask);
+    while (set->table[slot] >= 0) {
+        int32_t id = set->table[slot];
+        if (memcmp(set->sets + (size_t)id * (size_t)words, bits, sizeof(uint64_t) * (size_t)words) == 0) {
+            return id;
+        }
+        slot = (slot + 1) & mask;
+    }
+    if (set->state_count >= GLOB_MAX_DFA_STATES) {
+        return -1;
+    }
+    
+    if (set->state_count == set->state_cap) {
+        int32_t cap = set->state_cap * 2;
+        uint64_t* sets = realloc(set->sets, sizeof(uint64_t) * (size_t)cap * (size_t)words);
+        if (!sets) {
+            return -1;
+        }
+        set->sets = sets;
+        int32_t* trans = realloc(set->trans, sizeof(int32_t) * (size_t)cap * (size_t)set->class_count);
+        if (!trans) {
+            return -1;
+        }
+        set->trans = trans;
+        int32_t* accept = realloc(set->accept, sizeof(int32_t) * (size_t)cap);
+        if (!accept) {
+            return -1;
+        }
+        set->accept = accept;
+        uint8_t* flags = realloc(set->flags, (size_t)cap);
+        if (!flags) {
+            return -1;
+        }
+        set->flags = flags;
+        set->state_cap = cap;
+    }
+    
+    int32_t id = set->state_count++;
+    memcpy(set->sets + (size_t)id * (size_t)words, bits, sizeof(uint64_t) * (size_t)words);
+    for (int32_t c = 0; c < set->class_count; c++) {
+        set->trans[(size_t)id * (size_t)set->class_count + (size_t)c] = -1;
+    }
+    set->flags[id] = 0;
+    set->accept[id] = -1;
+    for (int32_t i = 0; i < set->position_count; i++) {
+        if ((bits[i >> 6] >> (i & 63)) & 1 && set->positions[i].kind == GLOB_POS_END) {
+            int32_t pattern = set->positions[i].pattern;
+            if (set->accept[id] < 0 || pattern < set->accept[id]) {
+                set->accept[id] = pattern;
+            }
+        }
+    }
+    
+    /* Keep the table under half full (capacity is at least 2x the state limit) */
+    set->table[slot] = id;
+    return id;
+}
+
+/* Intern the dead and start states */
+static int glob_dfa_seed(GlobSet* set) {
+    uint64_t* bits = set->scratch;
+    memset(bits, 0, sizeof(uint64_t) * (size_t)set->words);
+    if (glob_intern(set, bits) != GLOB_DEAD) {
+        return 0;
+    }
+    for (int32_t k = 0; k < set->start_count; k++) {
+        glob_closure(set, bits, set->starts[k]);
+    }
+    set->start_state = glob_intern(set, bits);
+    return set->start_state >= 0;
+}
+
+/* Build byte classes and the empty DFA */
+static int glob_dfa_compile(GlobSet* set) {
+    if (set->compiled) {
+        return 1;
+    }
+    glob_dfa_free(set);
+    
+    /* Refine byte classes by every byte set the positions test, and by '/' */
+    uint8_t cls[256];
+    memset(cls, 0, sizeof(cls));
+    int32_t count = 1;
+    for (int32_t i = -1; i < set->position_count; i++) {
+        uint8_t sep_only[32];
+        const uint8_t* bytes;
+        if (i < 0) {
+            memset(sep_only, 0, sizeof(sep_only));
+            bitmap_set(sep_only, '/');
+            bytes = sep_only;
+        } else if (set->positions[i].kind == GLOB_POS_BYTE || set->positions[i].kind == GLOB_POS_STAR) {
+            bytes = set->positions[i].set;
+        } else {
+            continue;
+        }
+        int16_t remap[256][2];
+        memset(remap, 0xff, sizeof(remap));
+        int32_t next = 0;
+        for (int b = 0; b < 256; b++) {
+            int in = bitmap_has(bytes, (unsigned char)b);
+            if (remap[cls[b]][in] < 0) {
+                remap[cls[b]][in] = (int16_t)next++;
+            }
+            cls[b] = (uint8_t)remap[cls[b]][in];
+        }
+        count = next;
+    }
+    memcpy(set->byte_class, cls, sizeof(cls));
+    set->class_count = count;
+    set->words = (set->position_count + 63) / 64;
+    if (set->words == 0) {
+        set->words = 1;
+    }
+    
+    set->state_cap = 64;
+    set->table_cap = 1;
+    while (set->table_cap < GLOB_MAX_DFA_STATES * 2) {
+        set->table_cap *= 2;
+    }
+    set->sets = malloc(sizeof(uint64_t) * (size_t)set->state_cap * (size_t)set->words);
+    set->trans = malloc(sizeof(int32_t) * (size_t)set->state_cap * (size_t)count);
+    set->accept = malloc(sizeof(int32_t) * (size_t)set->state_cap);
+    set->flags = malloc((size_t)set->state_cap);
+    set->table = malloc(sizeof(int32_t) * (size_t)set->table_cap);
+    set->scratch = malloc(sizeof(uint64_t) * (size_t)set->words * 2);
+    if (!set->sets || !set->trans || !set->accept || !set->flags || !set->table || !set->scratch) {
+        glob_dfa_free(set);
+        return 0;
+    }
+    glob_dfa_reset(set);
+    if (!glob_dfa_seed(set)) {
+        glob_dfa_free(set);
+        return 0;
+    }
+    set->compiled = 1;
+    return 1;
+}
+
+/* Compute the position set reached from state on a byte of class c */
+static void glob_step_bits(const GlobSet* set, const uint64_t* from, int32_t c, uint64_t* to) {
+    memset(to, 0, sizeof(uint64_t) * (size_t)set->words);
+    /* Any byte of the class stands for all of them */
+    int b = 0;
+    while (set->byte_class[b] != c) {
+        b++;
+    }
+    
+    for (int32_t w = 0; w < set->words; w++) {
+        uint64_t word = from[w];
+        while (word) {
+            int32_t i = w * 64 + __builtin_ctzll(word);
+            word &= word - 1;
+            const GlobPos* pos = &set->positions[i];
+            switch (pos->kind) {
+                case GLOB_POS_BYTE:
+                    if (bitmap_has(pos->set, (unsigned char)b)) {
+                        glob_closure(set, to, i + 1);
+                    }
+                    break;
+                case GLOB_POS_STAR:
+                    if (bitmap_has(pos->set, (unsigned char)b)) {
+                        glob_closure(set, to, i);
+                    }
+                    break;
+                case GLOB_POS_GLOBSTAR_DIR:
+                    /* Any byte enters the run; '/' may also end it */
+                    glob_closure(set, to, i + 1);
+                    if (b == '/') {
+                        glob_closure(set, to, i + 2);
+                    }
+                    break;
+                case GLOB_POS_GLOBSTAR_IN:
+                    glob_closure(set, to, i);
+                    if (b == '/') {
+                        glob_closure(set, to, i + 1);
+                    }
+                    break;
+                case GLOB_POS_ANY_STAR:
+                    glob_closure(set, to, i);
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+}
+
+/* Follow one transition, building it if needed. When the state limit is hit
+ * the DFA is reset (keeping the source state) and the step retried. Returns
+ * -1 only when out of memory. */
+static int32_t glob_next(GlobSet* set, int32_t state, int32_t c) {
+    int32_t next = set->trans[(size_t)state * (size_t)set->class_count + (size_t)c];
+    if (next >= 0) {
+        return next;
+    }
+    
+    uint64_t* from = set->scratch + set->words;
+    memcpy(from, set->sets + (size_t)state * (size_t)set->words, sizeof(uint64_t) * (size_t)set->words);
+    glob_step_bits(set, from, c, set->scratch);
+    next = glob_intern(set, set->scratch);
+    if (next < 0) {
+        /* Start over with the source state, then retry */
+        uint64_t* target = malloc(sizeof(uint64_t) * (size_t)set->words);
+        if (!target) {
+            return -1;
+        }
+        memcpy(target, set->scratch, sizeof(uint64_t) * (size_t)set->words);
+        glob_dfa_reset(set);
+        if (!glob_dfa_seed(set) || (state = glob_intern(set, from)) < 0 ||
+            (next = glob_intern(set, target)) < 0) {
+            free(target);
+            return -1;
+        }
+        free(target);
+    }
+    set->trans[(size_t)state * (size_t)set->class_count + (size_t)c] = next;
+    return next;
+}
+
+/* Feed bytes from a state; returns the final state or -1 (out of memory) */
+static int32_t glob_feed(GlobSet* set, int32_t state, const char* s, int64_t len) {
+    for (int64_t i = 0; i < len && state > GLOB_DEAD; i++) {
+        state = glob_next(set, state, set->byte_class[(unsigned char)s[i]]);
+    }
+    return state;
+}
+
+/* Explore everything reachable from state; live = some state accepts, full =
+ * every state accepts. Results are cached per state; on a DFA reset during
+ * the search the answer is the conservative live = 1, full = 0. */
+static void glob_reach(GlobSet* set, int32_t state, int* live, int* full) {
+    uint8_t f = set->flags[state];
+    if ((f & GLOB_STATE_LIVE_KNOWN) && (f & GLOB_STATE_FULL_KNOWN)) {
+        *live = (f & GLOB_STATE_LIVE) != 0;
+        *full = (f & GLOB_STATE_FULL) != 0;
+        return;
+    }
+
+    *live = 1;
+    *full = 0;
+    uint64_t generation = set->generation;
+    uint8_t* seen = calloc((size_t)GLOB_MAX_DFA_STATES, 1);
+    int32_t* stack = malloc(sizeof(int32_t) * (size_t)GLOB_MAX_DFA_STATES);
+    if (!seen || !stack) {
+        free(seen);
+        free(stack);
+        return;
+    }
+    
+    int any_accept = 0;
+    int all_accept = 1;
+    int32_t top = 0;
+    stack[top++] = state;
+    seen[state] = 1;
+    while (top > 0) {
+        int32_t s = stack[--top];
+        if (set->accept[s] >= 0) {
+            any_accept = 1;
+        } else {
+            all_accept = 0;
+        }
+        for (int32_t c = 0; c < set->class_count; c++) {
+            int32_t next = glob_next(set, s, c);
+            if (next < 0 || set->generation != generation) {
+                free(seen);
+                free(stack);
+                return;
+            }
+            if (!seen[next]) {
+                seen[next] = 1;
+                stack[top++] = next;
+            }
+        }
+    }
+    free(seen);
+    free(stack);
+
+    *live = any_accept;
+    *full = all_accept;
+    set->flags[state] = (uint8_t)(GLOB_STATE_LIVE_KNOWN | GLOB_STATE_FULL_KNOWN |
+                                  (any_accept ? GLOB_STATE_LIVE : 0) | (all_accept ? GLOB_STATE_FULL : 0));
+}
+
+/* Public API */
+
+GlobSet* glob_set_new() {
+    GlobSet* set = calloc(1, sizeof(GlobSet));
+    if (set) {
+        set->all_simple = 1;
+    }
+    return set;
+}
+
+void glob_set_free(GlobSet* set) {
+    if (!set) {
+        return;
+    }
+    glob_dfa_free(set);
+    for (int32_t i = 0; i < set->pattern_count; i++) {
+        free(set->simple[i].prefix);
+        free(set->simple[i].suffix);
+    }
+    free(set->simple);
+    free(set->positions);
+    free(set->starts);
+    free(set);
+}
+
+/* Add a pattern; returns its index, or -1 if out of memory or the braces
+ * expand to more than GLOB_MAX_EXPANSIONS alternatives */
+int32_t glob_set_add(GlobSet* set, const char* pattern) {
+    if (!set || !pattern) {
+        return -1;
+    }
+    if (set->pattern_count == set->simple_cap) {
+        int32_t cap = set->simple_cap ? set->simple_cap * 2 : 8;
+        GlobSimple* simple = realloc(set->simple, sizeof(GlobSimple) * (size_t)cap);
+        if (!simple) {
+            return -1;
+        }
+        set->simple = simple;
+        set->simple_cap = cap;
+    }
+    
+    int64_t len = (int64_t)strlen(pattern);
+    int32_t index = set->pattern_count;
+    int32_t saved_positions = set->position_count;
+    int32_t saved_starts = set->start_count;
+    int budget = GLOB_MAX_EXPANSIONS;
+    if (!glob_expand(set, pattern, len, index, &budget)) {
+        set->position_count = saved_positions;
+        set->start_count = saved_starts;
+        return -1;
+    }
+    
+    glob_classify(pattern, len, &set->simple[index]);
+    if (set->simple[index].kind == GLOB_SIMPLE_NONE) {
+        set->all_simple = 0;
+    }
+    set->pattern_count++;
+    set->compiled = 0;
+    return index;
+}
+
+int32_t glob_set_len(const GlobSet* set) {
+    return set ? set->pattern_count : 0;
+}
+
+/* Index of the first pattern matching path (or -1) */
+int32_t glob_set_match(GlobSet* set, const char* path, int64_t len) {
+    if (!set || !path || set->pattern_count == 0) {
+        return -1;
+    }
+    if (set->all_simple && set->pattern_count <= 8) {
+        for (int32_t i = 0; i < set->pattern_count; i++) {
+            if (glob_simple_match(&set->simple[i], path, len)) {
+                return i;
+            }
+        }
+        return -1;
+    }
+    if (!glob_dfa_compile(set)) {
+        return -1;
+    }
+    int32_t state = glob_feed(set, set->start_state, path, len);
+    return state > GLOB_DEAD ? set->accept[state] : -1;
+}
+
+/* One-shot match of a single pattern: 1 = match, 0 = no match, -1 = error */
+int32_t glob_match(const char* pattern, const char* path) {
+    GlobSet* set = glob_set_new();
+    if (!set || glob_set_add(set, pattern) < 0) {
+        glob_set_free(set);
+        return -1;
+    }
+    int32_t result = glob_set_match(set, path, (int64_t)strlen(path)) >= 0;
+    glob_set_free(set);
+    return result;
+}
+
+/* Could anything under directory dir (relative, no trailing '/') match? */
+int32_t glob_set_may_match_under(GlobSet* set, const char* dir, int64_t len) {
+    if (!set || !dir || !glob_dfa_compile(set)) {
+        return 1;
+    }
+    int32_t state = glob_feed(set, set->start_state, dir, len);
+    if (state > GLOB_DEAD && len > 0) {
+        state = glob_feed(set, state, "/", 1);
+    }
+    if (state <= GLOB_DEAD) {
+        return state == GLOB_DEAD ? 0 : 1;
+    }
+    int live = 1;
+    int full = 0;
+    glob_reach(set, state, &live, &full);
+    return live;
+}
+
+/* Directory walker */
+/* Depth-first, entries sorted by name within each directory, parents before
+ * their contents. Paths are reported relative to the root with '/'.
+ * Symlinks to directories are reported as directories but not descended. */
+
+typedef struct {
+    char* name;
+    int is_dir;
+    int is_link;
+} GlobEntry;
+
+typedef struct {
+    GlobEntry* entries;
+    int32_t count;
+    int32_t next;
+    int64_t dir_len;            /* Length of this directory's path in the buffer */
+    int32_t include_state;      /* States after "<dir>/" */
+    int32_t exclude_state;
+    uint64_t include_generation;
+    uint64_t exclude_generation;
+} GlobFrame;
+
+typedef struct {
+    GlobSet* include;
+    GlobSet* exclude;
+    int32_t flags;
+    PathBuf path;               /* root, then "/<relative path>" */
+    int64_t root_len;
+    GlobFrame* frames;
+    int32_t depth;
+    int32_t frame_cap;
+    int current_is_dir;
+} GlobWalk;
+
+static int glob_entry_cmp(const void* a, const void* b) {
+    return strcmp(((const GlobEntry*)a)->name, ((const GlobEntry*)b)->name);
+}
+
+static void glob_frame_free(GlobFrame* frame) {
+    for (int32_t i = 0; i < frame->count; i++) {
+        free(frame->entries[i].name);
+    }
+    free(frame->entries);
+    frame->entries = NULL;
+    frame->count = 0;
+}
+
+/* Read and sort the directory currently in walk->path */
+static int glob_read_dir(GlobWalk* walk, GlobFrame* frame) {
+    int32_t cap = 16;
+    frame->entries = malloc(sizeof(GlobEntry) * (size_t)cap);
+    frame->count = 0;
+    frame->next = 0;
+    if (!frame->entries) {
+        return 0;
+    }
+
+#ifdef _WIN32
+    char* search = malloc((size_t)walk->path.len + 3);
+    if (!search) {
+        return 0;
+    }
+    memcpy(search, walk->path.data, (size_t)walk->path.len);
+    memcpy(search + walk->path.len, "\\*", 3);
+    WIN32_FIND_DATAA data;
+    HANDLE find = FindFirstFileA(search, &data);
+    free(search);
+    if (find == INVALID_HANDLE_VALUE) {
+        return 1;
+    }
+    do {
+        const char* name = data.cFileName;
+        int is_dir = (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+        int is_link = (data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0;
+#else
+    DIR* dir = opendir(walk->path.data);
+    if (!dir) {
+        return 1;
+    }
+    struct dirent* ent;
+    while ((ent = readdir(dir)) != NULL) {
+        const char* name = ent->d_name;
+        int is_dir = ent->d_type == DT_DIR;
+        int is_link = ent->d_type == DT_LNK;
+        if (ent->d_type == DT_UNKNOWN || is_link) {
+            /* Classify through the link (or when the filesystem did not say) */
+            int64_t saved = walk->path.len;
+            struct stat st;
+            if (pathbuf_push(&walk->path, name, (int64_t)strlen(name)) && stat(walk->path.data, &st) == 0) {
+                is_dir = S_ISDIR(st.st_mode);
+            }
+            if (ent->d_type == DT_UNKNOWN && lstat(walk->path.data, &st) == 0) {
+                is_link = S_ISLNK(st.st_mode);
+            }
+            walk->path.len = saved;
+            walk->path.data[saved] = '\0';
+        }
+#endif
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+            continue;
+        }
+        if (frame->count == cap) {
+            cap *= 2;
+            GlobEntry* entries = realloc(frame->entries, sizeof(GlobEntry) * (size_t)cap);
+            if (!entries) {
+                break;
+            }
+            frame->entries = entries;
+        }
+        size_t n = strlen(name);
+        char* copy = malloc(n + 1);
+        if (!copy) {
+            break;
+        }
+        memcpy(copy, name, n + 1);
+        frame->entries[frame->count].name = copy;
+        frame->entries[frame->count].is_dir = is_dir;
+        frame->entries[frame->count].is_link = is_link;
+        frame->count++;
+#ifdef _WIN32
+    } while (FindNextFileA(find, &data));
+    FindClose(find);
+#else
+    }
+    closedir(dir);
+#endif
+
+    qsort(frame->entries, (size_t)frame->count, sizeof(GlobEntry), glob_entry_cmp);
+    return 1;
+}
+
+/* State of set after the relative path of the current directory plus "/",
+ * recomputed from the root if the DFA was reset since it was stored */
+static int32_t glob_frame_state(GlobWalk* walk, GlobSet* set, int32_t* state, uint64_t* generation) {
+    if (*generation != set->generation) {
+        int64_t rel = walk->root_len + 1;
+        int32_t s = set->start_state;
+        if (walk->path.len > walk->root_len) {
+            for (int64_t i = rel; i < walk->path.len && s > GLOB_DEAD; i++) {
+                char c = walk->path.data[i] == '\\' ? '/' : walk->path.data[i];
+                s = glob_feed(set, s, &c, 1);
+            }
+            if (s > GLOB_DEAD) {
+                s = glob_feed(set, s, "/", 1);
+            }
+        }
+        *state = s;
+        *generation = set->generation;
+    }
+    return *state;
+}
+
+/* Generations of 0 make the frame recompute its states from its path */
+static int glob_push_frame(GlobWalk* walk, int32_t include_state, uint64_t include_generation,
+                           int32_t exclude_state, uint64_t exclude_generation) {
+    if (walk->depth == walk->frame_cap) {
+        int32_t cap = walk->frame_cap ? walk->frame_cap * 2 : 16;
+        GlobFrame* frames = realloc(walk->frames, sizeof(GlobFrame) * (size_t)cap);
+        if (!frames) {
+            return 0;
+        }
+        walk->frames = frames;
+        walk->frame_cap = cap;
+    }
+    GlobFrame* frame = &walk->frames[walk->depth];
+    frame->dir_len = walk->path.len;
+    frame->include_state = include_state;
+    frame->exclude_state = exclude_state;
+    frame->include_generation = include_generation;
+    frame->exclude_generation = exclude_generation;
+    if (!glob_read_dir(walk, frame)) {
+        glob_frame_free(frame);
+        return 0;
+    }
+    walk->depth++;
+    return 1;
+}
+
+/* Start walking root. include may be NULL (everything); exclude may be NULL.
+ * flags: GLOB_WALK_FILES | GLOB_WALK_DIRS (0 = files only). */
+GlobWalk* glob_walk_open(const char* root, GlobSet* include, GlobSet* exclude, int32_t flags) {
+    if (!root) {
+        return NULL;
+    }
+    if ((include && !glob_dfa_compile(include)) || (exclude && !glob_dfa_compile(exclude))) {
+        return NULL;
+    }
+    GlobWalk* walk = calloc(1, sizeof(GlobWalk));
+    if (!walk) {
+        return NULL;
+    }
+    walk->include = include;
+    walk->exclude = exclude;
+    walk->flags = flags ? flags : GLOB_WALK_FILES;
+    pathbuf_init(&walk->path);
+    
+    /* Drop trailing separators so "root/" + name is well formed */
+    int64_t len = (int64_t)strlen(root);
+    while (len > 1 && (root[len - 1] == '/' || root[len - 1] == '\\')) {
+        len--;
+    }
+    if (!pathbuf_set(&walk->path, root, len)) {
+        free(walk);
+        return NULL;
+    }
+    walk->root_len = walk->path.len;
+    
+    if (!glob_push_frame(walk, include ? include->start_state : 0, include ? include->generation : 0,
+                         exclude ? exclude->start_state : 0, exclude ? exclude->generation : 0)) {
+        pathbuf_free(&walk->path);
+        free(walk->frames);
+        free(walk);
+        return NULL;
+    }
+    return walk;
+}
+
+/* Advance to the next match. Returns 1 (glob_walk_current is valid), 0 at
+ * the end, -1 if out of memory. */
+int32_t glob_walk_next(GlobWalk* walk) {
+    if (!walk) {
+        return -1;
+    }
+    while (walk->depth > 0) {
+        GlobFrame* frame = &walk->frames[walk->depth - 1];
+        if (frame->next == frame->count) {
+            glob_frame_free(frame);
+            walk->depth--;
+            continue;
+        }
+        GlobEntry* entry = &frame->entries[frame->next++];
+        
+        /* Rebuild "<root>/<dir>/<name>" */
+        walk->path.len = frame->dir_len;
+        walk->path.data[frame->dir_len] = '\0';
+        int32_t include_dir = 0;
+        int32_t exclude_dir = 0;
+        if (walk->include) {
+            include_dir = glob_frame_state(walk, walk->include, &frame->include_state, &frame->include_generation);
+        }
+        if (walk->exclude) {
+            exclude_dir = glob_frame_state(walk, walk->exclude, &frame->exclude_state, &frame->exclude_generation);
+        }
+        int64_t name_len = (int64_t)strlen(entry->name);
+        if (!pathbuf_push(&walk->path, entry->name, name_len)) {
+            return -1;
+        }
+        
+        /* Excluded entries are skipped along with everything beneath them */
+        int32_t exclude_state = 0;
+        if (walk->exclude && exclude_dir > GLOB_DEAD) {
+            exclude_state = glob_feed(walk->exclude, exclude_dir, entry->name, name_len);
+            if (exclude_state < 0) {
+                return -1;
+            }
+            if (exclude_state > GLOB_DEAD && walk->exclude->accept[exclude_state] >= 0) {
+                continue;
+            }
+        }
+        
+        int matched = 1;
+        int32_t include_state = 0;
+        if (walk->include) {
+            include_state = glob_feed(walk->include, include_dir, entry->name, name_len);
+            if (include_state < 0) {
+                return -1;
+            }
+            matched = include_state > GLOB_DEAD && walk->include->accept[include_state] >= 0;
+        }
+        
+        if (entry->is_dir && !entry->is_link) {
+            /* A DFA reset inside glob_reach invalidates the child state;
+             * the child frame then recomputes it from its path */
+            int descend = 1;
+            int32_t include_child = 0;
+            int32_t exclude_child = 0;
+            uint64_t include_generation = 0;
+            uint64_t exclude_generation = 0;
+            if (walk->include) {
+                include_child = include_state > GLOB_DEAD ? glob_feed(walk->include, include_state, "/", 1) : GLOB_DEAD;
+                include_generation = walk->include->generation;
+                int live = 0;
+                int full = 0;
+                if (include_child > GLOB_DEAD) {
+                    glob_reach(walk->include, include_child, &live, &full);
+                }
+                if (walk->include->generation != include_generation) {
+                    include_generation = 0;
+                }
+                descend = live;
+            }
+            if (descend && walk->exclude) {
+                exclude_child = exclude_state > GLOB_DEAD ? glob_feed(walk->exclude, exclude_state, "/", 1) : GLOB_DEAD;
+                exclude_generation = walk->exclude->generation;
+                int live = 1;
+                int full = 0;
+                if (exclude_child > GLOB_DEAD) {
+                    glob_reach(walk->exclude, exclude_child, &live, &full);
+                }
+                if (walk->exclude->generation != exclude_generation) {
+                    exclude_generation = 0;
+                }
+                descend = !full;
+            }
+            if (include_child < 0 || exclude_child < 0) {
+                return -1;
+            }
+            if (descend && !glob_push_frame(walk, include_child, include_generation,
+                                            exclude_child, exclude_generation)) {
+                return -1;
+            }
+        }
+        
+        int wanted = entry->is_dir ? (walk->flags & GLOB_WALK_DIRS) : (walk->flags & GLOB_WALK_FILES);
+        if (matched && wanted) {
+            walk->current_is_dir = entry->is_dir;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Full path of the current match (root joined with the relative path) */
+const char* glob_walk_current(const GlobWalk* walk) {
+    return walk->path.data;
+}
+
+/* The current match relative to the root */
+const char* glob_walk_relative(const GlobWalk* walk) {
+    return walk->path.data + walk->root_len + 1;
+}
+
+int32_t glob_walk_is_dir(const GlobWalk* walk) {
+    return walk->current_is_dir;
+}
+
+void glob_walk_close(GlobWalk* walk) {
+    if (!walk) {
+        return;
+    }
+    for (int32_t i = 0; i < walk->depth; i++) {
+        glob_frame_free(&walk->frames[i]);
+    }
+    free(walk->frames);
+    pathbuf_free(&walk->path);
+    free(walk);
+}
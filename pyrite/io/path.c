@@ -1,16 +1,26 @@
 /* Path operations implementation in C for Pyrite standard library */
 
+/* statx() is a GNU extension */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
 
+#include "pathbuf.h"
+
 #ifdef _WIN32
 #include <windows.h>
 #include <direct.h>
 #else
 #include <sys/stat.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
 #endif
 
 /* String structure (from string.c) */
@@ -22,85 +32,88 @@ typedef struct {
 extern String string_new(const char* cstr);
 extern String string_empty();
 
-/* Join two paths - cross-platform */
+/* Path metadata */
+/* One record per queried path. kind is PATH_TYPE_MISSING when the path does
+ * not exist (error holds the errno); symlinks are followed, like stat(). */
+
+#define PATH_TYPE_MISSING 0
+#define PATH_TYPE_FILE 1
+#define PATH_TYPE_DIR 2
+#define PATH_TYPE_OTHER 3
+
+typedef struct {
+    int64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint64_t inode;
+    uint64_t dev;
+    int32_t kind;
+    int32_t error;
+} PathMeta;
+
+static int path_meta_lookup(const char* path, PathMeta* out);
+
+/* From pathbuf.c; declared here because it returns String */
+extern String pathbuf_to_string(const PathBuf* buf);
+
+/* Join two paths - cross-platform (an absolute other replaces base) */
 String path_join(const char* base, const char* other) {
-    char result[1024];
+    PathBuf buf;
+    pathbuf_init(&buf);
     
-#ifdef _WIN32
-    /* Windows: use backslash */
-    if (base[strlen(base) - 1] == '\\' || base[strlen(base) - 1] == '/') {
-        snprintf(result, sizeof(result), "%s%s", base, other);
-    } else {
-        snprintf(result, sizeof(result), "%s\\%s", base, other);
-    }
-#else
-    /* Unix: use forward slash */
-    if (base[strlen(base) - 1] == '/') {
-        snprintf(result, sizeof(result), "%s%s", base, other);
-    } else {
-        snprintf(result, sizeof(result), "%s/%s", base, other);
+    if (!pathbuf_set(&buf, base, (int64_t)strlen(base)) ||
+        !pathbuf_push(&buf, other, (int64_t)strlen(other))) {
+        pathbuf_free(&buf);
+        return string_empty();
     }
-#endif
     
-    return string_new(result);
+    String result = pathbuf_to_string(&buf);
+    pathbuf_free(&buf);
+    return result;
 }
 
-/* Get parent directory - returns NULL if no parent */
+/* Get parent directory - returns empty string if no parent */
 String path_parent(const char* path) {
-    if (!path || strlen(path) == 0) {
+    if (!path || path[0] == '\0') {
         return string_empty();
     }
     
-    char result[1024];
-    strncpy(result, path, sizeof(result) - 1);
-    result[sizeof(result) - 1] = '\0';
-    
-    /* Find last separator */
-    char* last_sep = NULL;
-#ifdef _WIN32
-    last_sep = strrchr(result, '\\');
-    if (!last_sep) {
-        last_sep = strrchr(result, '/');
-    }
-#else
-    last_sep = strrchr(result, '/');
-#endif
-    
-    if (last_sep && last_sep != result) {
-        *last_sep = '\0';
-        return string_new(result);
-    } else if (last_sep == result) {
-        /* Root directory */
-        result[1] = '\0';
-        return string_new(result);
-    } else {
-        /* No separator - no parent */
+    PathBuf buf;
+    pathbuf_init(&buf);
+    if (!pathbuf_set(&buf, path, (int64_t)strlen(path))) {
+        pathbuf_free(&buf);
         return string_empty();
     }
+    
+    /* The root is its own parent; "foo" has none */
+    pathbuf_pop(&buf);
+    String result = buf.len > 0 ? pathbuf_to_string(&buf) : string_empty();
+    pathbuf_free(&buf);
+    return result;
 }
 
-/* Get file name - returns NULL if no file name */
+/* Get file name - returns empty string if no file name */
 String path_file_name(const char* path) {
-    if (!path || strlen(path) == 0) {
+    if (!path) {
         return string_empty();
     }
     
-    /* Find last separator */
-    const char* last_sep = NULL;
-#ifdef _WIN32
-    last_sep = strrchr(path, '\\');
-    if (!last_sep) {
-        last_sep = strrchr(path, '/');
+    PathComponents it;
+    PathComponent last;
+    path_components_init(&it, path, (int64_t)strlen(path));
+    if (!path_components_next_back(&it, &last) || last.kind != PATH_COMPONENT_NORMAL) {
+        return string_empty();
     }
-#else
-    last_sep = strrchr(path, '/');
-#endif
     
-    if (last_sep) {
-        return string_new(last_sep + 1);
-    } else {
-        return string_new(path);
+    String result;
+    result.data = malloc((size_t)last.len + 1);
+    if (!result.data) {
+        return string_empty();
     }
+    memcpy(result.data, last.ptr, (size_t)last.len);
+    result.data[last.len] = '\0';
+    result.len = last.len;
+    return result;
 }
 
 /* Check if path exists */
@@ -109,13 +122,8 @@ int path_exists(const char* path) {
         return 0;
     }
     
-#ifdef _WIN32
-    DWORD dwAttrib = GetFileAttributes(path);
-    return (dwAttrib != INVALID_FILE_ATTRIBUTES) ? 1 : 0;
-#else
-    struct stat st;
-    return (stat(path, &st) == 0) ? 1 : 0;
-#endif
+    PathMeta meta;
+    return path_meta_lookup(path, &meta);
 }
 
 /* Check if path is a file */
@@ -124,38 +132,471 @@ int path_is_file(const char* path) {
         return 0;
     }
     
+    PathMeta meta;
+    path_meta_lookup(path, &meta);
+    return (meta.kind == PATH_TYPE_FILE) ? 1 : 0;
+}
+
+/* Check if path is a directory */
+int path_is_dir(const char* path) {
+    if (!path) {
+        return 0;
+    }
+    
+    PathMeta meta;
+    path_meta_lookup(path, &meta);
+    return (meta.kind == PATH_TYPE_DIR) ? 1 : 0;
+}
+
+/* Fill meta for a single path with one syscall (statx on Linux) */
+/* Returns 1 if the path exists, 0 otherwise. Never consults the cache. */
+int32_t path_stat(const char* path, PathMeta* meta) {
+    memset(meta, 0, sizeof(*meta));
+    meta->kind = PATH_TYPE_MISSING;
+    if (!path) {
+        return 0;
+    }
+    
 #ifdef _WIN32
-    DWORD dwAttrib = GetFileAttributes(path);
-    if (dwAttrib == INVALID_FILE_ATTRIBUTES) {
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExA(path, GetFileExInfoStandard, &data)) {
+        meta->error = (int32_t)GetLastError();
         return 0;
     }
-    return !(dwAttrib & FILE_ATTRIBUTE_DIRECTORY);
+    meta->size = ((int64_t)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+    /* FILETIME is 100ns ticks since 1601-01-01 */
+    uint64_t ticks = ((uint64_t)data.ftLastWriteTime.dwHighDateTime << 32) |
+                     data.ftLastWriteTime.dwLowDateTime;
+    ticks -= 116444736000000000ULL;
+    meta->mtime_sec = (int64_t)(ticks / 10000000ULL);
+    meta->mtime_nsec = (int64_t)(ticks % 10000000ULL) * 100;
+    meta->kind = (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) ? PATH_TYPE_DIR : PATH_TYPE_FILE;
+    return 1;
+#elif defined(__linux__) && defined(STATX_BASIC_STATS)
+    /* Ask only for what we report; lets network filesystems skip the rest */
+    struct statx stx;
+    if (statx(AT_FDCWD, path, 0, STATX_TYPE | STATX_SIZE | STATX_MTIME | STATX_INO, &stx) != 0) {
+        meta->error = errno;
+        return 0;
+    }
+    meta->size = (int64_t)stx.stx_size;
+    meta->mtime_sec = stx.stx_mtime.tv_sec;
+    meta->mtime_nsec = stx.stx_mtime.tv_nsec;
+    meta->inode = stx.stx_ino;
+    meta->dev = ((uint64_t)stx.stx_dev_major << 32) | stx.stx_dev_minor;
+    if (S_ISREG(stx.stx_mode)) {
+        meta->kind = PATH_TYPE_FILE;
+    } else if (S_ISDIR(stx.stx_mode)) {
+        meta->kind = PATH_TYPE_DIR;
+    } else {
+        meta->kind = PATH_TYPE_OTHER;
+    }
+    return 1;
 #else
     struct stat st;
     if (stat(path, &st) != 0) {
+        meta->error = errno;
         return 0;
     }
-    return S_ISREG(st.st_mode) ? 1 : 0;
+    meta->size = (int64_t)st.st_size;
+#ifdef __APPLE__
+    meta->mtime_sec = st.st_mtimespec.tv_sec;
+    meta->mtime_nsec = st.st_mtimespec.tv_nsec;
+#else
+    meta->mtime_sec = st.st_mtim.tv_sec;
+    meta->mtime_nsec = st.st_mtim.tv_nsec;
+#endif
+    meta->inode = (uint64_t)st.st_ino;
+    meta->dev = (uint64_t)st.st_dev;
+    if (S_ISREG(st.st_mode)) {
+        meta->kind = PATH_TYPE_FILE;
+    } else if (S_ISDIR(st.st_mode)) {
+        meta->kind = PATH_TYPE_DIR;
+    } else {
+        meta->kind = PATH_TYPE_OTHER;
+    }
+    return 1;
 #endif
 }
 
-/* Check if path is a directory */
-int path_is_dir(const char* path) {
-    if (!path) {
+/* Process-level metadata cache */
+/* Disabled by default. When enabled, path_exists/path_is_file/path_is_dir and
+ * path_stat_batch answer from the cache. Every entry records the generation it
+ * was filled in; path_meta_cache_invalidate() bumps the generation, which makes
+ * all entries stale in O(1). Single paths can be dropped individually (the file
+ * watcher does this for the paths it sees change). */
+
+typedef struct {
+    char* key;
+    uint64_t hash;
+    uint64_t generation;
+    PathMeta meta;
+} MetaCacheEntry;
+
+typedef struct {
+    MetaCacheEntry* entries;
+    int64_t capacity;   /* Power of two */
+    int64_t count;
+    uint64_t generation;
+    int enabled;
+} MetaCache;
+
+static MetaCache meta_cache = { NULL, 0, 0, 1, 0 };
+
+#ifdef _WIN32
+static SRWLOCK meta_cache_lock = SRWLOCK_INIT;
+#define META_CACHE_LOCK() AcquireSRWLockExclusive(&meta_cache_lock)
+#define META_CACHE_UNLOCK() ReleaseSRWLockExclusive(&meta_cache_lock)
+#else
+static pthread_mutex_t meta_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+#define META_CACHE_LOCK() pthread_mutex_lock(&meta_cache_lock)
+#define META_CACHE_UNLOCK() pthread_mutex_unlock(&meta_cache_lock)
+#endif
+
+/* The cache is off by default, so lookups test this without taking the lock;
+ * it is only written under the lock, and meta_cache_put checks it again there
+ * so a lookup racing with path_meta_cache_enable(0) cannot refill the cache. */
+static int meta_cache_enabled() {
+#ifdef _WIN32
+    return InterlockedCompareExchange((volatile LONG*)&meta_cache.enabled, 0, 0) != 0;
+#else
+    return __atomic_load_n(&meta_cache.enabled, __ATOMIC_ACQUIRE);
+#endif
+}
+
+/* FNV-1a */
+static uint64_t meta_hash(const char* s) {
+    uint64_t h = 1469598103934665603ULL;
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+/* Find the slot for key (occupied by key, or the empty slot to insert into) */
+static MetaCacheEntry* meta_cache_slot(const char* key, uint64_t hash) {
+    int64_t mask = meta_cache.capacity - 1;
+    int64_t i = (int64_t)(hash & (uint64_t)mask);
+    for (;;) {
+        MetaCacheEntry* e = &meta_cache.entries[i];
+        if (!e->key || (e->hash == hash && strcmp(e->key, key) == 0)) {
+            return e;
+        }
+        i = (i + 1) & mask;
+    }
+}
+
+static int meta_cache_grow() {
+    int64_t new_capacity = meta_cache.capacity ? meta_cache.capacity * 2 : 1024;
+    MetaCacheEntry* old = meta_cache.entries;
+    int64_t old_capacity = meta_cache.capacity;
+    
+    MetaCacheEntry* entries = calloc((size_t)new_capacity, sizeof(MetaCacheEntry));
+    if (!entries) {
         return 0;
     }
+    meta_cache.entries = entries;
+    meta_cache.capacity = new_capacity;
     
-#ifdef _WIN32
-    DWORD dwAttrib = GetFileAttributes(path);
-    if (dwAttrib == INVALID_FILE_ATTRIBUTES) {
+    for (int64_t i = 0; i < old_capacity; i++) {
+        if (old[i].key) {
+            *meta_cache_slot(old[i].key, old[i].hash) = old[i];
+        }
+    }
+    free(old);
+    return 1;
+}
+
+/* Caller holds the lock. Returns 1 on a fresh hit. */
+static int meta_cache_get(const char* path, uint64_t hash, PathMeta* out) {
+    if (meta_cache.count == 0) {
+        return 0;
+    }
+    MetaCacheEntry* e = meta_cache_slot(path, hash);
+    if (!e->key || e->generation != meta_cache.generation) {
         return 0;
     }
-    return (dwAttrib & FILE_ATTRIBUTE_DIRECTORY) ? 1 : 0;
+    *out = e->meta;
+    return 1;
+}
+
+/* Caller holds the lock */
+static void meta_cache_put(const char* path, uint64_t hash, const PathMeta* meta) {
+    if (!meta_cache.enabled) {
+        return;
+    }
+    /* Keep load factor under 70% */
+    if ((meta_cache.count + 1) * 10 > meta_cache.capacity * 7 && !meta_cache_grow()) {
+        return;
+    }
+    MetaCacheEntry* e = meta_cache_slot(path, hash);
+    if (!e->key) {
+        size_t len = strlen(path);
+        e->key = malloc(len + 1);
+        if (!e->key) {
+            return;
+        }
+        memcpy(e->key, path, len + 1);
+        e->hash = hash;
+        meta_cache.count++;
+    }
+    e->generation = meta_cache.generation;
+    e->meta = *meta;
+}
+
+/* Stat through the cache when it is enabled */
+static int path_meta_lookup(const char* path, PathMeta* out) {
+    if (!meta_cache_enabled()) {
+        return path_stat(path, out);
+    }
+    
+    uint64_t hash = meta_hash(path);
+    META_CACHE_LOCK();
+    int hit = meta_cache_get(path, hash, out);
+    META_CACHE_UNLOCK();
+    if (hit) {
+        return out->kind != PATH_TYPE_MISSING;
+    }
+    
+    int exists = path_stat(path, out);
+    META_CACHE_LOCK();
+    meta_cache_put(path, hash, out);
+    META_CACHE_UNLOCK();
+    return exists;
+}
+
+/* Fill meta for a single path, answering from the cache when it is enabled */
+/* Returns 1 if the path exists, 0 otherwise (Path.metadata) */
+int32_t path_metadata(const char* path, PathMeta* meta) {
+    if (!path) {
+        return path_stat(path, meta);
+    }
+    return path_meta_lookup(path, meta);
+}
+
+/* Enable (1) or disable (0) the metadata cache; disabling frees it */
+void path_meta_cache_enable(int32_t enabled) {
+    META_CACHE_LOCK();
+#ifdef _WIN32
+    InterlockedExchange((volatile LONG*)&meta_cache.enabled, enabled ? 1 : 0);
 #else
-    struct stat st;
-    if (stat(path, &st) != 0) {
+    __atomic_store_n(&meta_cache.enabled, enabled ? 1 : 0, __ATOMIC_RELEASE);
+#endif
+    if (!enabled) {
+        for (int64_t i = 0; i < meta_cache.capacity; i++) {
+            free(meta_cache.entries[i].key);
+        }
+        free(meta_cache.entries);
+        meta_cache.entries = NULL;
+        meta_cache.capacity = 0;
+        meta_cache.count = 0;
+    }
+    META_CACHE_UNLOCK();
+}
+
+/* Mark every cached entry stale */
+void path_meta_cache_invalidate() {
+    META_CACHE_LOCK();
+    meta_cache.generation++;
+    META_CACHE_UNLOCK();
+}
+
+/* Mark a single cached path stale */
+void path_meta_cache_invalidate_path(const char* path) {
+    if (!path) {
+        return;
+    }
+    uint64_t hash = meta_hash(path);
+    META_CACHE_LOCK();
+    if (meta_cache.count > 0) {
+        MetaCacheEntry* e = meta_cache_slot(path, hash);
+        if (e->key) {
+            e->generation = 0;  /* Generations start at 1 */
+        }
+    }
+    META_CACHE_UNLOCK();
+}
+
+/* Current cache generation (changes whenever the whole cache is invalidated) */
+uint64_t path_meta_cache_generation() {
+    META_CACHE_LOCK();
+    uint64_t generation = meta_cache.generation;
+    META_CACHE_UNLOCK();
+    return generation;
+}
+
+/* Batched stat */
+/* Cache hits are answered under one lock acquisition; the misses are stat'ed
+ * in parallel on a short-lived worker pool once there are enough of them to
+ * amortize thread start-up, then written back to the cache in one pass. */
+
+#define PATH_STAT_BATCH_CHUNK 64
+#define PATH_STAT_PARALLEL_MIN 512
+#define PATH_STAT_MAX_WORKERS 16
+
+typedef struct {
+    const char** paths;
+    PathMeta* out;
+    const int64_t* indices;  /* Which entries of paths still need a stat */
+    int64_t count;
+    int64_t next;            /* Next chunk start (atomic) */
+} StatBatch;
+
+static void stat_batch_run(StatBatch* batch) {
+    for (;;) {
+#ifdef _WIN32
+        int64_t start = InterlockedExchangeAdd64((LONG64*)&batch->next, PATH_STAT_BATCH_CHUNK);
+#else
+        int64_t start = __atomic_fetch_add(&batch->next, PATH_STAT_BATCH_CHUNK, __ATOMIC_RELAXED);
+#endif
+        if (start >= batch->count) {
+            break;
+        }
+        int64_t end = start + PATH_STAT_BATCH_CHUNK;
+        if (end > batch->count) {
+            end = batch->count;
+        }
+        for (int64_t i = start; i < end; i++) {
+            int64_t index = batch->indices[i];
+            path_stat(batch->paths[index], &batch->out[index]);
+        }
+    }
+}
+
+#ifndef _WIN32
+static void* stat_batch_worker(void* arg) {
+    stat_batch_run((StatBatch*)arg);
+    return NULL;
+}
+#endif
+
+/* Stat count paths into out[0..count) - returns the number that exist, -1 on error */
+int64_t path_stat_batch(const char** paths, int64_t count, PathMeta* out) {
+    if (!paths || !out || count < 0) {
+        return -1;
+    }
+    if (count == 0) {
         return 0;
     }
-    return S_ISDIR(st.st_mode) ? 1 : 0;
+    
+    int64_t* misses = malloc(sizeof(int64_t) * (size_t)count);
+    uint64_t* hashes = NULL;
+    if (!misses) {
+        return -1;
+    }
+    int64_t miss_count = 0;
+    
+    if (meta_cache_enabled()) {
+        hashes = malloc(sizeof(uint64_t) * (size_t)count);
+        if (!hashes) {
+            free(misses);
+            return -1;
+        }
+        for (int64_t i = 0; i < count; i++) {
+            hashes[i] = paths[i] ? meta_hash(paths[i]) : 0;
+        }
+        META_CACHE_LOCK();
+        for (int64_t i = 0; i < count; i++) {
+            if (!paths[i] || !meta_cache_get(paths[i], hashes[i], &out[i])) {
+                misses[miss_count++] = i;
+            }
+        }
+        META_CACHE_UNLOCK();
+    } else {
+        for (int64_t i = 0; i < count; i++) {
+            misses[miss_count++] = i;
+        }
+    }
+    
+    StatBatch batch = { paths, out, misses, miss_count, 0 };
+    
+#ifdef _WIN32
+    stat_batch_run(&batch);
+#else
+    int workers = 1;
+    if (miss_count >= PATH_STAT_PARALLEL_MIN) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = (int)(miss_count / (PATH_STAT_PARALLEL_MIN / 2));
+        if (cpus > 0 && workers > cpus) {
+            workers = (int)cpus;
+        }
+        if (workers > PATH_STAT_MAX_WORKERS) {
+            workers = PATH_STAT_MAX_WORKERS;
+        }
+    }
+    
+    pthread_t threads[PATH_STAT_MAX_WORKERS];
+    int started = 0;
+    for (int i = 1; i < workers; i++) {
+        if (pthread_create(&threads[started], NULL, stat_batch_worker, &batch) != 0) {
+            break;
+        }
+        started++;
+    }
+    stat_batch_run(&batch);
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
 #endif
+    
+    if (hashes) {
+        META_CACHE_LOCK();
+        for (int64_t i = 0; i < miss_count; i++) {
+            int64_t index = misses[i];
+            if (paths[index]) {
+                meta_cache_put(paths[index], hashes[index], &out[index]);
+            }
+        }
+        META_CACHE_UNLOCK();
+        free(hashes);
+    }
+    free(misses);
+    
+    int64_t existing = 0;
+    for (int64_t i = 0; i < count; i++) {
+        if (out[i].kind != PATH_TYPE_MISSING) {
+            existing++;
+        }
+    }
+    return existing;
+}
+
+/* Incremental dirty check */
+/* Re-stats paths (batched, through the cache) and compares against the
+ * metadata recorded at the last build. Returns the number of changed paths
+ * and writes their indices to dirty (if non-NULL, capacity count). */
+int64_t path_dirty_check(const char** paths, int64_t count, const PathMeta* previous, int64_t* dirty) {
+    if (!paths || !previous || count < 0) {
+        return -1;
+    }
+    if (count == 0) {
+        return 0;
+    }
+    
+    PathMeta* current = malloc(sizeof(PathMeta) * (size_t)count);
+    if (!current) {
+        return -1;
+    }
+    if (path_stat_batch(paths, count, current) < 0) {
+        free(current);
+        return -1;
+    }
+    
+    int64_t dirty_count = 0;
+    for (int64_t i = 0; i < count; i++) {
+        const PathMeta* a = &previous[i];
+        const PathMeta* b = &current[i];
+        if (a->kind != b->kind || a->size != b->size ||
+            a->mtime_sec != b->mtime_sec || a->mtime_nsec != b->mtime_nsec ||
+            a->inode != b->inode || a->dev != b->dev) {
+            if (dirty) {
+                dirty[dirty_count] = i;
+            }
+            dirty_count++;
+        }
+    }
+    
+    free(current);
+    return dirty_count;
 }
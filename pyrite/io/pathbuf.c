@@ -0,0 +1,463 @@
+/* PathBuf - growable path buffer for the Pyrite standard library
+ *
+ * A PathBuf keeps paths up to PATHBUF_INLINE - 1 bytes in inline storage and
+ * only moves to the heap beyond that, so join/parent/extension edits on a
+ * PathBuf living on the stack normally never allocate. All edits happen in
+ * place and the buffer is always NUL-terminated.
+ *
+ * data may point into the struct itself: never copy a PathBuf by value, pass
+ * a pointer (or use pathbuf_new for a heap-allocated one).
+ *
+ * PathComponents walks a path front-to-back or back-to-front, handing out
+ * borrowed (pointer, length) views into the original string.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "pathbuf.h"
+
+#ifdef _WIN32
+#define PATHBUF_SEP '\\'
+#define PATHBUF_IS_SEP(c) ((c) == '\\' || (c) == '/')
+#else
+#define PATHBUF_SEP '/'
+#define PATHBUF_IS_SEP(c) ((c) == '/')
+#endif
+
+/* String structure (from string.c) */
+typedef struct {
+    char* data;
+    int64_t len;
+} String;
+
+extern String string_empty();
+
+/* PathBuf, PathComponent(s) and the component kinds live in pathbuf.h */
+
+/* Length of a Windows drive or UNC prefix ("C:", "\\server\share") */
+static int64_t path_prefix_len(const char* s, int64_t len) {
+#ifdef _WIN32
+    if (len >= 2 && ((s[0] >= 'A' && s[0] <= 'Z') || (s[0] >= 'a' && s[0] <= 'z')) && s[1] == ':') {
+        return 2;
+    }
+    if (len >= 2 && PATHBUF_IS_SEP(s[0]) && PATHBUF_IS_SEP(s[1])) {
+        /* \\server\share */
+        int64_t i = 2;
+        int parts = 0;
+        while (i < len && parts < 2) {
+            while (i < len && !PATHBUF_IS_SEP(s[i])) {
+                i++;
+            }
+            parts++;
+            if (parts < 2 && i < len) {
+                i++;
+            }
+        }
+        return i;
+    }
+#else
+    (void)s;
+    (void)len;
+#endif
+    return 0;
+}
+
+/* Length of prefix plus root separator: where the first component starts */
+static int64_t path_root_len(const char* s, int64_t len) {
+    int64_t i = path_prefix_len(s, len);
+    if (i < len && PATHBUF_IS_SEP(s[i])) {
+        i++;
+    }
+    return i;
+}
+
+/* Absolute: has a root (and, on Windows, a prefix) */
+int32_t path_view_is_absolute(const char* s, int64_t len) {
+    if (!s || len <= 0) {
+        return 0;
+    }
+#ifdef _WIN32
+    int64_t prefix = path_prefix_len(s, len);
+    if (prefix > 2 || (prefix == 2 && len > 2 && PATHBUF_IS_SEP(s[2]))) {
+        return 1;
+    }
+    return 0;
+#else
+    return s[0] == '/' ? 1 : 0;
+#endif
+}
+
+/* File name view: last normal component (trailing separators ignored).
+ * Returns 0 if the path ends in root, "." or "..". */
+int32_t path_file_name_view(const char* s, int64_t len, int64_t* name_start, int64_t* name_len) {
+    if (!s) {
+        return 0;
+    }
+    int64_t root = path_root_len(s, len);
+    int64_t end = len;
+    while (end > root && PATHBUF_IS_SEP(s[end - 1])) {
+        end--;
+    }
+    int64_t start = end;
+    while (start > root && !PATHBUF_IS_SEP(s[start - 1])) {
+        start--;
+    }
+    int64_t n = end - start;
+    if (n == 0 || (n == 1 && s[start] == '.') || (n == 2 && s[start] == '.' && s[start + 1] == '.')) {
+        return 0;
+    }
+    *name_start = start;
+    *name_len = n;
+    return 1;
+}
+
+/* Buffer management */
+
+void pathbuf_init(PathBuf* buf) {
+    buf->data = buf->inline_buf;
+    buf->len = 0;
+    buf->cap = PATHBUF_INLINE - 1;
+    buf->inline_buf[0] = '\0';
+}
+
+/* Release heap storage (if any) and reset to empty */
+void pathbuf_free(PathBuf* buf) {
+    if (buf->data != buf->inline_buf) {
+        free(buf->data);
+    }
+    pathbuf_init(buf);
+}
+
+/* Make room for additional bytes. Returns 1 on success, 0 if out of memory. */
+int32_t pathbuf_reserve(PathBuf* buf, int64_t additional) {
+    int64_t need = buf->len + additional;
+    if (need <= buf->cap) {
+        return 1;
+    }
+    
+    int64_t cap = buf->cap * 2;
+    if (cap < need) {
+        cap = need;
+    }
+    
+    char* data;
+    if (buf->data == buf->inline_buf) {
+        data = malloc((size_t)cap + 1);
+        if (data) {
+            memcpy(data, buf->data, (size_t)buf->len + 1);
+        }
+    } else {
+        data = realloc(buf->data, (size_t)cap + 1);
+    }
+    if (!data) {
+        return 0;
+    }
+    buf->data = data;
+    buf->cap = cap;
+    return 1;
+}
+
+static int32_t pathbuf_append(PathBuf* buf, const char* s, int64_t len) {
+    if (!pathbuf_reserve(buf, len)) {
+        return 0;
+    }
+    memcpy(buf->data + buf->len, s, (size_t)len);
+    buf->len += len;
+    buf->data[buf->len] = '\0';
+    return 1;
+}
+
+static void pathbuf_truncate(PathBuf* buf, int64_t len) {
+    buf->len = len;
+    buf->data[len] = '\0';
+}
+
+/* Replace the contents. Returns 1 on success, 0 if out of memory. */
+int32_t pathbuf_set(PathBuf* buf, const char* s, int64_t len) {
+    pathbuf_truncate(buf, 0);
+    return pathbuf_append(buf, s, len);
+}
+
+/* Heap-allocated PathBuf (for callers that cannot hold the struct) */
+PathBuf* pathbuf_new(const char* path) {
+    PathBuf* buf = malloc(sizeof(PathBuf));
+    if (!buf) {
+        return NULL;
+    }
+    pathbuf_init(buf);
+    if (path && !pathbuf_set(buf, path, (int64_t)strlen(path))) {
+        free(buf);
+        return NULL;
+    }
+    return buf;
+}
+
+void pathbuf_destroy(PathBuf* buf) {
+    if (buf) {
+        pathbuf_free(buf);
+        free(buf);
+    }
+}
+
+const char* pathbuf_as_ptr(const PathBuf* buf) {
+    return buf->data;
+}
+
+int64_t pathbuf_len(const PathBuf* buf) {
+    return buf->len;
+}
+
+/* Copy out as a String (the only allocating accessor) */
+String pathbuf_to_string(const PathBuf* buf) {
+    String result;
+    result.data = malloc((size_t)buf->len + 1);
+    if (!result.data) {
+        return string_empty();
+    }
+    memcpy(result.data, buf->data, (size_t)buf->len + 1);
+    result.len = buf->len;
+    return result;
+}
+
+/* In-place edits */
+
+/* Append a component. An absolute component replaces the whole path (like
+ * pathlib and Rust's PathBuf::push). Returns 1 on success. */
+int32_t pathbuf_push(PathBuf* buf, const char* comp, int64_t len) {
+    if (path_view_is_absolute(comp, len)) {
+        return pathbuf_set(buf, comp, len);
+    }
+    if (buf->len > 0 && !PATHBUF_IS_SEP(buf->data[buf->len - 1])) {
+        char sep = PATHBUF_SEP;
+        if (!pathbuf_append(buf, &sep, 1)) {
+            return 0;
+        }
+    }
+    return pathbuf_append(buf, comp, len);
+}
+
+/* Truncate to the parent. Returns 0 (unchanged) if there is nothing left to
+ * remove: empty path or bare root. "foo" pops to "". */
+int32_t pathbuf_pop(PathBuf* buf) {
+    int64_t root = path_root_len(buf->data, buf->len);
+    int64_t end = buf->len;
+    while (end > root && PATHBUF_IS_SEP(buf->data[end - 1])) {
+        end--;
+    }
+    if (end == root) {
+        return 0;
+    }
+    
+    while (end > root && !PATHBUF_IS_SEP(buf->data[end - 1])) {
+        end--;
+    }
+    while (end > root && PATHBUF_IS_SEP(buf->data[end - 1])) {
+        end--;
+    }
+    pathbuf_truncate(buf, end);
+    return 1;
+}
+
+/* Replace the file name (pop then push). Returns 1 on success. */
+int32_t pathbuf_set_file_name(PathBuf* buf, const char* name, int64_t len) {
+    int64_t start = 0;
+    int64_t name_len = 0;
+    if (path_file_name_view(buf->data, buf->len, &start, &name_len)) {
+        pathbuf_pop(buf);
+    }
+    return pathbuf_push(buf, name, len);
+}
+
+/* Replace or (with an empty ext) remove the extension of the file name.
+ * A leading '.' in ext is optional. Returns 0 if there is no file name. */
+int32_t pathbuf_set_extension(PathBuf* buf, const char* ext, int64_t ext_len) {
+    int64_t start = 0;
+    int64_t name_len = 0;
+    if (!path_file_name_view(buf->data, buf->len, &start, &name_len)) {
+        return 0;
+    }
+    
+    /* The extension starts at the last '.', unless that is the first byte */
+    int64_t end = start + name_len;
+    for (int64_t i = end - 1; i > start; i--) {
+        if (buf->data[i] == '.') {
+            end = i;
+            break;
+        }
+    }
+    pathbuf_truncate(buf, end);
+    
+    if (ext_len > 0 && ext[0] == '.') {
+        ext++;
+        ext_len--;
+    }
+    if (ext_len == 0) {
+        return 1;
+    }
+    return pathbuf_append(buf, ".", 1) && pathbuf_append(buf, ext, ext_len);
+}
+
+/* Lexically normalize in place: collapse separators, drop "." components and
+ * resolve ".." against preceding components. ".." above the root is dropped;
+ * leading ".." of a relative path is kept. Separators become the native one.
+ * Never allocates. */
+void pathbuf_normalize(PathBuf* buf) {
+    char* s = buf->data;
+    int64_t len = buf->len;
+    int64_t root = path_root_len(s, len);
+    int absolute = root > 0 && PATHBUF_IS_SEP(s[root - 1]);
+    
+    for (int64_t i = 0; i < root; i++) {
+        if (PATHBUF_IS_SEP(s[i])) {
+            s[i] = PATHBUF_SEP;
+        }
+    }
+    
+    int64_t w = root;          /* write cursor */
+    int64_t written = 0;       /* components written */
+    int64_t kept_parents = 0;  /* leading ".." among them (relative paths) */
+    int64_t r = root;
+    while (r < len) {
+        while (r < len && PATHBUF_IS_SEP(s[r])) {
+            r++;
+        }
+        int64_t start = r;
+        while (r < len && !PATHBUF_IS_SEP(s[r])) {
+            r++;
+        }
+        int64_t n = r - start;
+        if (n == 0 || (n == 1 && s[start] == '.')) {
+            continue;
+        }
+        
+        if (n == 2 && s[start] == '.' && s[start + 1] == '.') {
+            if (written > kept_parents) {
+                /* drop the last written component and its separator */
+                while (w > root && !PATHBUF_IS_SEP(s[w - 1])) {
+                    w--;
+                }
+                if (w > root) {
+                    w--;
+                }
+                written--;
+                continue;
+            }
+            if (absolute) {
+                continue;
+            }
+            kept_parents++;
+        }
+        
+        if (written > 0) {
+            s[w++] = PATHBUF_SEP;
+        }
+        memmove(s + w, s + start, (size_t)n);
+        w += n;
+        written++;
+    }
+    
+    pathbuf_truncate(buf, w);
+}
+
+/* Components */
+
+void path_components_init(PathComponents* it, const char* path, int64_t len) {
+    it->path = path;
+    it->prefix_len = path_prefix_len(path, len);
+    it->has_root = it->prefix_len < len && PATHBUF_IS_SEP(path[it->prefix_len]);
+    it->front = it->prefix_len + (it->has_root ? 1 : 0);
+    it->back = len;
+    
+    /* A leading "." of a relative path is reported as CUR_DIR */
+    int64_t f = it->front;
+    it->has_cur_dir = !it->has_root && f < len && path[f] == '.' &&
+                      (f + 1 == len || PATHBUF_IS_SEP(path[f + 1]));
+    if (it->has_cur_dir) {
+        it->front = f + 1;
+    }
+    
+    it->head_front = 0;
+    it->head_back = (it->prefix_len > 0) + it->has_root + it->has_cur_dir;
+}
+
+/* Head item i (0 = prefix, 1 = root, 2 = "."), skipping those not present */
+static int path_components_head(PathComponents* it, int32_t index, PathComponent* out) {
+    int32_t seen = 0;
+    if (it->prefix_len > 0 && seen++ == index) {
+        out->ptr = it->path;
+        out->len = it->prefix_len;
+        out->kind = PATH_COMPONENT_PREFIX;
+        return 1;
+    }
+    if (it->has_root && seen++ == index) {
+        out->ptr = it->path + it->prefix_len;
+        out->len = 1;
+        out->kind = PATH_COMPONENT_ROOT;
+        return 1;
+    }
+    if (it->has_cur_dir && seen++ == index) {
+        out->ptr = it->path + it->prefix_len;
+        out->len = 1;
+        out->kind = PATH_COMPONENT_CUR_DIR;
+        return 1;
+    }
+    return 0;
+}
+
+static void path_component_body(const char* p, int64_t n, PathComponent* out) {
+    out->ptr = p;
+    out->len = n;
+    out->kind = (n == 2 && p[0] == '.' && p[1] == '.') ? PATH_COMPONENT_PARENT_DIR : PATH_COMPONENT_NORMAL;
+}
+
+/* Next component from the front. Returns 1 and fills out, or 0 when done. */
+int32_t path_components_next(PathComponents* it, PathComponent* out) {
+    if (it->head_front < it->head_back) {
+        return path_components_head(it, it->head_front++, out);
+    }
+    
+    const char* s = it->path;
+    while (it->front < it->back) {
+        while (it->front < it->back && PATHBUF_IS_SEP(s[it->front])) {
+            it->front++;
+        }
+        int64_t start = it->front;
+        while (it->front < it->back && !PATHBUF_IS_SEP(s[it->front])) {
+            it->front++;
+        }
+        int64_t n = it->front - start;
+        if (n == 0 || (n == 1 && s[start] == '.')) {
+            continue;
+        }
+        path_component_body(s + start, n, out);
+        return 1;
+    }
+    return 0;
+}
+
+/* Next component from the back. Returns 1 and fills out, or 0 when done. */
+int32_t path_components_next_back(PathComponents* it, PathComponent* out) {
+    const char* s = it->path;
+    while (it->back > it->front) {
+        while (it->back > it->front && PATHBUF_IS_SEP(s[it->back - 1])) {
+            it->back--;
+        }
+        int64_t end = it->back;
+        while (it->back > it->front && !PATHBUF_IS_SEP(s[it->back - 1])) {
+            it->back--;
+        }
+        int64_t n = end - it->back;
+        if (n == 0 || (n == 1 && s[it->back] == '.')) {
+            continue;
+        }
+        path_component_body(s + it->back, n, out);
+        return 1;
+    }
+    
+    if (it->head_back > it->head_front) {
+        return path_components_head(it, --it->head_back, out);
+    }
+    return 0;
+}
@@ -0,0 +1,68 @@
+/* PathBuf and PathComponents layouts, shared by pathbuf.c and its C callers
+ * (path.c, glob.c, path_utils/path_utils.c). Callers embed these structs on their own
+ * stacks, so this header is the only definition: never copy it into a .c file.
+ *
+ * Functions returning String (pathbuf_to_string) are declared by each caller
+ * next to its own String definition.
+ */
+
+#ifndef PYRITE_PATHBUF_H
+#define PYRITE_PATHBUF_H
+
+#include <stdint.h>
+
+#define PATHBUF_INLINE 256
+
+typedef struct {
+    char* data;      /* inline_buf or heap, NUL-terminated */
+    int64_t len;
+    int64_t cap;     /* usable bytes, excluding the NUL */
+    char inline_buf[PATHBUF_INLINE];
+} PathBuf;
+
+/* Component kinds */
+#define PATH_COMPONENT_PREFIX 0      /* Windows drive ("C:") or UNC share */
+#define PATH_COMPONENT_ROOT 1        /* leading separator */
+#define PATH_COMPONENT_CUR_DIR 2     /* leading "." of a relative path */
+#define PATH_COMPONENT_PARENT_DIR 3  /* ".." */
+#define PATH_COMPONENT_NORMAL 4
+
+typedef struct {
+    const char* ptr;
+    int64_t len;
+    int32_t kind;
+} PathComponent;
+
+typedef struct {
+    const char* path;
+    int64_t front;        /* next unread byte of the body */
+    int64_t back;         /* end of the unread body */
+    int64_t prefix_len;
+    int32_t has_root;
+    int32_t has_cur_dir;
+    int32_t head_front;   /* head items (prefix, root, ".") taken from the front */
+    int32_t head_back;    /* head items still available to next_back */
+} PathComponents;
+
+int32_t path_view_is_absolute(const char* s, int64_t len);
+int32_t path_file_name_view(const char* s, int64_t len, int64_t* name_start, int64_t* name_len);
+
+void pathbuf_init(PathBuf* buf);
+void pathbuf_free(PathBuf* buf);
+PathBuf* pathbuf_new(const char* path);
+void pathbuf_destroy(PathBuf* buf);
+int32_t pathbuf_reserve(PathBuf* buf, int64_t additional);
+int32_t pathbuf_set(PathBuf* buf, const char* s, int64_t len);
+int32_t pathbuf_push(PathBuf* buf, const char* comp, int64_t len);
+int32_t pathbuf_pop(PathBuf* buf);
+int32_t pathbuf_set_file_name(PathBuf* buf, const char* name, int64_t len);
+int32_t pathbuf_set_extension(PathBuf* buf, const char* ext, int64_t ext_len);
+void pathbuf_normalize(PathBuf* buf);
+const char* pathbuf_as_ptr(const PathBuf* buf);
+int64_t pathbuf_len(const PathBuf* buf);
+
+void path_components_init(PathComponents* it, const char* path, int64_t len);
+int32_t path_components_next(PathComponents* it, PathComponent* out);
+int32_t path_components_next_back(PathComponents* it, PathComponent* out);
+
+#endif /* PYRITE_PATHBUF_H */
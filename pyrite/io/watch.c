@@ -0,0 +1,569 @@
+/* File watching implementation in C for Pyrite standard library
+ *
+ * Watches a directory tree with inotify and accumulates the set of paths that
+ * changed since the last time the caller asked. Incremental builds use this to
+ * skip rehashing sources that provably did not change.
+ *
+ * - Recursive: every directory under the root gets its own watch; directories
+ *   created later are watched as soon as their creation event is seen, and
+ *   their existing contents are reported as changed (they may have been filled
+ *   before the watch was in place).
+ * - Coalescing: the pending set is keyed by path, so N events on one file
+ *   produce one entry.
+ * - Debouncing: watch_wait() only returns once no event has arrived for
+ *   debounce_ms, so an editor's save burst or a `git checkout` is delivered
+ *   as one batch.
+ * - Overflow: if the kernel queue overflows (IN_Q_OVERFLOW) events were lost;
+ *   the tree is rescanned, watches are re-registered, every file is reported
+ *   as changed and the overflow counter is bumped so callers can tell.
+ *
+ * Only Linux has inotify; elsewhere watch_open() returns NULL and callers fall
+ * back to content hashing.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <poll.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <limits.h>
+#endif
+
+/* Path invalidation hook (from path.c) */
+extern void path_meta_cache_invalidate_path(const char* path);
+extern void path_meta_cache_invalidate();
+
+#ifdef __linux__
+
+#define WATCH_MASK (IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | \
+                    IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | \
+                    IN_ONLYDIR | IN_DONT_FOLLOW)
+
+#define WATCH_EVENT_BUF_SIZE (64 * 1024)
+
+/* String set (open addressing, FNV-1a) used for the pending changes */
+typedef struct {
+    char** keys;
+    uint64_t* hashes;
+    int64_t capacity;   /* Power of two */
+    int64_t count;
+} PathSet;
+
+/* Watch descriptor -> directory path */
+typedef struct {
+    int wd;
+    char* path;
+} WatchDir;
+
+typedef struct {
+    int fd;
+    char* root;
+    int32_t debounce_ms;
+    WatchDir* dirs;
+    int dir_count;
+    int dir_capacity;
+    PathSet pending;
+    int64_t overflows;
+    int64_t last_event_ms;
+} Watcher;
+
+static uint64_t set_hash(const char* s) {
+    uint64_t h = 1469598103934665603ULL;
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static int64_t set_find(PathSet* set, const char* key, uint64_t hash) {
+    int64_t mask = set->capacity - 1;
+    int64_t i = (int64_t)(hash & (uint64_t)mask);
+    while (set->keys[i] && (set->hashes[i] != hash || strcmp(set->keys[i], key) != 0)) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+static int set_grow(PathSet* set) {
+    int64_t new_capacity = set->capacity ? set->capacity * 2 : 256;
+    char** keys = calloc((size_t)new_capacity, sizeof(char*));
+    uint64_t* hashes = calloc((size_t)new_capacity, sizeof(uint64_t));
+    if (!keys || !hashes) {
+        free(keys);
+        free(hashes);
+        return 0;
+    }
+    
+    PathSet grown = { keys, hashes, new_capacity, set->count };
+    for (int64_t i = 0; i < set->capacity; i++) {
+        if (set->keys[i]) {
+            int64_t slot = set_find(&grown, set->keys[i], set->hashes[i]);
+            grown.keys[slot] = set->keys[i];
+            grown.hashes[slot] = set->hashes[i];
+        }
+    }
+    free(set->keys);
+    free(set->hashes);
+    *set = grown;
+    return 1;
+}
+
+/* Add path to set (copying it); duplicates are coalesced */
+static void set_add(PathSet* set, const char* path) {
+    if ((set->count + 1) * 10 > set->capacity * 7 && !set_grow(set)) {
+        return;
+    }
+    uint64_t hash = set_hash(path);
+    int64_t slot = set_find(set, path, hash);
+    if (set->keys[slot]) {
+        return;
+    }
+    size_t len = strlen(path);
+    char* key = malloc(len + 1);
+    if (!key) {
+        return;
+    }
+    memcpy(key, path, len + 1);
+    set->keys[slot] = key;
+    set->hashes[slot] = hash;
+    set->count++;
+}
+
+static void set_clear(PathSet* set) {
+    for (int64_t i = 0; i < set->capacity; i++) {
+        free(set->keys[i]);
+    }
+    free(set->keys);
+    free(set->hashes);
+    memset(set, 0, sizeof(*set));
+}
+
+static int64_t now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static char* watch_join(const char* dir, const char* name) {
+    size_t dir_len = strlen(dir);
+    size_t name_len = strlen(name);
+    char* result = malloc(dir_len + 1 + name_len + 1);
+    if (!result) {
+        return NULL;
+    }
+    memcpy(result, dir, dir_len);
+    result[dir_len] = '/';
+    memcpy(result + dir_len + 1, name, name_len + 1);
+    return result;
+}
+
+static const char* watch_dir_path(Watcher* w, int wd) {
+    for (int i = 0; i < w->dir_count; i++) {
+        if (w->dirs[i].wd == wd) {
+            return w->dirs[i].path;
+        }
+    }
+    return NULL;
+}
+
+static void watch_forget_dir(Watcher* w, int wd) {
+    for (int i = 0; i < w->dir_count; i++) {
+        if (w->dirs[i].wd == wd) {
+            free(w->dirs[i].path);
+            w->dirs[i] = w->dirs[--w->dir_count];
+            return;
+        }
+    }
+}
+
+/* Rewrite the paths of from and the directories below it to start with to */
+static int watch_move_dirs(Watcher* w, const char* from, const char* to) {
+    size_t from_len = strlen(from);
+    size_t to_len = strlen(to);
+    char* old = malloc(from_len + 1);
+    if (!old) {
+        return 0;
+    }
+    memcpy(old, from, from_len + 1);  /* from is one of the paths replaced */
+
+    for (int i = 0; i < w->dir_count; i++) {
+        const char* path = w->dirs[i].path;
+        if (strncmp(path, old, from_len) != 0 || (path[from_len] != '\0' && path[from_len] != '/')) {
+            continue;
+        }
+        size_t rest = strlen(path + from_len);
+        char* moved = malloc(to_len + rest + 1);
+        if (!moved) {
+            free(old);
+            return 0;
+        }
+        memcpy(moved, to, to_len);
+        memcpy(moved + to_len, path + from_len, rest + 1);
+        free(w->dirs[i].path);
+        w->dirs[i].path = moved;
+    }
+    free(old);
+    return 1;
+}
+
+static int watch_add_dir(Watcher* w, const char* path) {
+    int wd = inotify_add_watch(w->fd, path, WATCH_MASK);
+    if (wd < 0) {
+        return 0;
+    }
+    
+    /* inotify returns the existing wd when a directory is re-added, e.g.
+     * after a rename inside the tree: its path and those below it move */
+    for (int i = 0; i < w->dir_count; i++) {
+        if (w->dirs[i].wd == wd) {
+            return strcmp(w->dirs[i].path, path) == 0 || watch_move_dirs(w, w->dirs[i].path, path);
+        }
+    }
+    
+    if (w->dir_count >= w->dir_capacity) {
+        int new_capacity = w->dir_capacity ? w->dir_capacity * 2 : 64;
+        WatchDir* dirs = realloc(w->dirs, sizeof(WatchDir) * new_capacity);
+        if (!dirs) {
+            return 0;
+        }
+        w->dirs = dirs;
+        w->dir_capacity = new_capacity;
+    }
+    
+    size_t len = strlen(path);
+    char* copy = malloc(len + 1);
+    if (!copy) {
+        return 0;
+    }
+    memcpy(copy, path, len + 1);
+    w->dirs[w->dir_count].wd = wd;
+    w->dirs[w->dir_count].path = copy;
+    w->dir_count++;
+    return 1;
+}
+
+/* Watch dir and everything below it; report contents as changed if asked */
+static void watch_scan(Watcher* w, const char* path, int report) {
+    if (!watch_add_dir(w, path)) {
+        return;
+    }
+    
+    DIR* dir = opendir(path);
+    if (!dir) {
+        return;
+    }
+    
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 ||
+            strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        
+        char* child = watch_join(path, entry->d_name);
+        if (!child) {
+            continue;
+        }
+        
+        unsigned char type = entry->d_type;
+        if (type == DT_UNKNOWN) {
+            struct stat st;
+            if (lstat(child, &st) == 0 && S_ISDIR(st.st_mode)) {
+                type = DT_DIR;
+            }
+        }
+        
+        if (type == DT_DIR) {
+            watch_scan(w, child, report);
+        } else if (report) {
+            set_add(&w->pending, child);
+        }
+        free(child);
+    }
+    
+    closedir(dir);
+}
+
+/* Lost events: rebuild every watch and treat the whole tree as changed */
+static void watch_rescan(Watcher* w) {
+    w->overflows++;
+    for (int i = 0; i < w->dir_count; i++) {
+        inotify_rm_watch(w->fd, w->dirs[i].wd);
+        free(w->dirs[i].path);
+    }
+    w->dir_count = 0;
+    watch_scan(w, w->root, 1);
+    path_meta_cache_invalidate();
+}
+
+/* Drain the inotify queue without blocking - returns number of events read */
+static int watch_drain(Watcher* w) {
+    char buffer[WATCH_EVENT_BUF_SIZE] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int events = 0;
+    int overflowed = 0;
+    
+    for (;;) {
+        ssize_t n = read(w->fd, buffer, sizeof(buffer));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;  /* EAGAIN: queue empty */
+        }
+        if (n == 0) {
+            break;
+        }
+        
+        for (char* p = buffer; p < buffer + n; ) {
+            struct inotify_event* event = (struct inotify_event*)p;
+            p += sizeof(struct inotify_event) + event->len;
+            events++;
+            
+            if (event->mask & IN_Q_OVERFLOW) {
+                overflowed = 1;
+                continue;
+            }
+            if (event->mask & IN_IGNORED) {
+                watch_forget_dir(w, event->wd);
+                continue;
+            }
+            
+            const char* dir = watch_dir_path(w, event->wd);
+            if (!dir) {
+                continue;
+            }
+            if (event->len == 0) {
+                /* Event on the watched directory itself (deleted or moved) */
+                set_add(&w->pending, dir);
+                path_meta_cache_invalidate_path(dir);
+                continue;
+            }
+            
+            char* path = watch_join(dir, event->name);
+            if (!path) {
+                continue;
+            }
+            set_add(&w->pending, path);
+            path_meta_cache_invalidate_path(path);
+            if ((event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO))) {
+                watch_scan(w, path, 1);
+            }
+            free(path);
+        }
+    }
+    
+    if (overflowed) {
+        watch_rescan(w);
+    }
+    if (events > 0) {
+        w->last_event_ms = now_ms();
+    }
+    return events;
+}
+
+#endif
+
+/* Start watching root recursively - returns handle, NULL if unsupported or on error */
+void* watch_open(const char* root, int32_t debounce_ms) {
+#ifdef __linux__
+    if (!root) {
+        return NULL;
+    }
+    
+    Watcher* w = calloc(1, sizeof(Watcher));
+    if (!w) {
+        return NULL;
+    }
+    w->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (w->fd < 0) {
+        free(w);
+        return NULL;
+    }
+    
+    size_t len = strlen(root);
+    while (len > 1 && root[len - 1] == '/') {
+        len--;  /* Keep joined paths free of "//" */
+    }
+    w->root = malloc(len + 1);
+    if (!w->root) {
+        close(w->fd);
+        free(w);
+        return NULL;
+    }
+    memcpy(w->root, root, len);
+    w->root[len] = '\0';
+    w->debounce_ms = debounce_ms < 0 ? 0 : debounce_ms;
+    
+    watch_scan(w, w->root, 0);
+    if (w->dir_count == 0) {
+        close(w->fd);
+        free(w->root);
+        free(w);
+        return NULL;
+    }
+    return w;
+#else
+    (void)root;
+    (void)debounce_ms;
+    return NULL;
+#endif
+}
+
+/* Wait up to timeout_ms (-1 = forever) for a settled batch of changes.
+ * Returns the number of pending changed paths (0 on timeout), -1 on error.
+ * A batch is settled once no event has arrived for debounce_ms. */
+int64_t watch_wait(void* handle, int32_t timeout_ms) {
+#ifdef __linux__
+    Watcher* w = (Watcher*)handle;
+    if (!w) {
+        return -1;
+    }
+    
+    int64_t deadline = timeout_ms < 0 ? -1 : now_ms() + timeout_ms;
+    watch_drain(w);
+    
+    for (;;) {
+        int64_t now = now_ms();
+        int wait_ms;
+        
+        if (w->pending.count > 0) {
+            int64_t quiet_until = w->last_event_ms + w->debounce_ms;
+            if (now >= quiet_until) {
+                return w->pending.count;
+            }
+            wait_ms = (int)(quiet_until - now);
+        } else {
+            wait_ms = -1;
+        }
+        
+        if (deadline >= 0) {
+            if (now >= deadline) {
+                return 0;
+            }
+            if (wait_ms < 0 || deadline - now < wait_ms) {
+                wait_ms = (int)(deadline - now);
+            }
+        }
+        
+        struct pollfd pfd = { w->fd, POLLIN, 0 };
+        int ready = poll(&pfd, 1, wait_ms);
+        if (ready < 0 && errno != EINTR) {
+            return -1;
+        }
+        if (ready > 0) {
+            watch_drain(w);
+        }
+    }
+#else
+    (void)handle;
+    (void)timeout_ms;
+    return -1;
+#endif
+}
+
+/* Return pending changes without waiting (ignores the debounce window) */
+int64_t watch_pending(void* handle) {
+#ifdef __linux__
+    Watcher* w = (Watcher*)handle;
+    if (!w) {
+        return -1;
+    }
+    watch_drain(w);
+    return w->pending.count;
+#else
+    (void)handle;
+    return -1;
+#endif
+}
+
+/* Take the pending change set and reset it.
+ * Returns a malloc'd array of *count paths; free with watch_free_changes(). */
+char** watch_take_changes(void* handle, int64_t* count) {
+    if (count) {
+        *count = 0;
+    }
+#ifdef __linux__
+    Watcher* w = (Watcher*)handle;
+    if (!w || !count || w->pending.count == 0) {
+        return NULL;
+    }
+    
+    char** paths = malloc(sizeof(char*) * (size_t)w->pending.count);
+    if (!paths) {
+        return NULL;
+    }
+    int64_t n = 0;
+    for (int64_t i = 0; i < w->pending.capacity; i++) {
+        if (w->pending.keys[i]) {
+            paths[n++] = w->pending.keys[i];
+            w->pending.keys[i] = NULL;  /* Ownership moves to the caller */
+        }
+    }
+    w->pending.count = 0;
+    *count = n;
+    return paths;
+#else
+    (void)handle;
+    return NULL;
+#endif
+}
+
+void watch_free_changes(char** paths, int64_t count) {
+    if (!paths) {
+        return;
+    }
+    for (int64_t i = 0; i < count; i++) {
+        free(paths[i]);
+    }
+    free(paths);
+}
+
+/* Number of queue overflows (each one forced a full rescan) */
+int64_t watch_overflow_count(void* handle) {
+#ifdef __linux__
+    Watcher* w = (Watcher*)handle;
+    return w ? w->overflows : -1;
+#else
+    (void)handle;
+    return -1;
+#endif
+}
+
+/* File descriptor for integrating with an external poll/epoll loop (-1 if none) */
+int32_t watch_fd(void* handle) {
+#ifdef __linux__
+    Watcher* w = (Watcher*)handle;
+    return w ? w->fd : -1;
+#else
+    (void)handle;
+    return -1;
+#endif
+}
+
+void watch_close(void* handle) {
+#ifdef __linux__
+    Watcher* w = (Watcher*)handle;
+    if (!w) {
+        return;
+    }
+    close(w->fd);
+    for (int i = 0; i < w->dir_count; i++) {
+        free(w->dirs[i].path);
+    }
+    free(w->dirs);
+    set_clear(&w->pending);
+    free(w->root);
+    free(w);
+#else
+    (void)handle;
+#endif
+}
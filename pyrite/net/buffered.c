@@ -0,0 +1,720 @@
+/* Buffered socket stream with message framing in C for Pyrite standard library
+ *
+ * Wraps a connected socket (blocking or nonblocking) with a read buffer and a
+ * write buffer so protocols do one recv()/send() per buffer instead of one
+ * per field:
+ *
+ * - Reads: bufstream_read_frame() decodes one message with a framing codec
+ *   and returns a borrowed view into the read buffer (no copy). The view is
+ *   valid until the next read call on the stream. On a blocking socket it
+ *   waits for the whole frame; on a nonblocking one it returns
+ *   TCP_WOULD_BLOCK and keeps the partial frame buffered for the next call.
+ * - Writes: small writes are only copied into the write buffer; nothing hits
+ *   the socket until the buffer fills or bufstream_flush() is called. Large
+ *   writes go out with one sendmsg() together with whatever is buffered.
+ *   Sends triggered by a full buffer carry MSG_MORE (more data is coming),
+ *   and bufstream_set_cork() toggles TCP_CORK for batching across flushes.
+ *   Data the socket cannot take yet stays buffered; watch
+ *   bufstream_pending_write() for backpressure.
+ *
+ * Codecs (param is only used by FIXED):
+ *   U16 / U32   big-endian length prefix, then the payload
+ *   VARINT      unsigned LEB128 length prefix, then the payload
+ *   LINE        payload terminated by "\n" (a preceding "\r" is stripped)
+ *   CRLF        payload terminated by "\r\n" (bare "\n" is payload)
+ *   FIXED       exactly param bytes
+ *
+ * Frames larger than the stream's max frame size (16 MiB by default) are
+ * rejected with EMSGSIZE instead of growing the buffer without bound.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+#ifndef MSG_MORE
+#define MSG_MORE 0
+#endif
+
+/* Codecs (match buffered.pyrite) */
+#define BUFSTREAM_U16 1
+#define BUFSTREAM_U32 2
+#define BUFSTREAM_VARINT 3
+#define BUFSTREAM_LINE 4
+#define BUFSTREAM_CRLF 5
+#define BUFSTREAM_FIXED 6
+
+/* Results besides lengths */
+#define TCP_WOULD_BLOCK (-2)
+#define BUFSTREAM_EOF (-3)
+
+#define BUFSTREAM_DEFAULT_CAPACITY (64 * 1024)
+#define BUFSTREAM_DEFAULT_MAX_FRAME (16 * 1024 * 1024)
+#define BUFSTREAM_MAX_HEADER 10     /* Longest varint prefix for 64 bits */
+#define BUFSTREAM_MAX_PIECES 4
+
+typedef struct {
+    char* data;
+    int64_t len;
+} String;
+
+/* From socket.c */
+extern int64_t tcp_try_recv(int64_t sock, char* buf, int64_t len);
+
+typedef struct {
+    const char* data;
+    int64_t len;
+} BufPiece;
+
+typedef struct {
+    int64_t sock;
+    int64_t max_frame;
+
+    char* rbuf;
+    int64_t rcap;
+    int64_t rpos;       /* First unread byte */
+    int64_t rlen;       /* End of buffered data */
+    int64_t consume;    /* Bytes of the last frame to drop before the next read */
+    int64_t scan;       /* Delimiter search resumes here (relative to rpos) */
+    int32_t scan_codec; /* Codec that scan was computed for */
+    const char* frame;
+    int64_t frame_len;
+
+    char* wbuf;
+    int64_t wcap;
+    int64_t wpos;       /* First unsent byte */
+    int64_t wlen;       /* End of buffered data */
+    int more_queued;    /* The last send carried MSG_MORE */
+    int corked;         /* bufstream_set_cork() is on */
+} BufStream;
+
+static void bufstream_set_errno(int error) {
+#ifdef _WIN32
+    WSASetLastError(error == EINVAL ? WSAEINVAL : error == EMSGSIZE ? WSAEMSGSIZE : WSAECONNRESET);
+#endif
+    errno = error;
+}
+
+static int bufstream_would_block() {
+#ifdef _WIN32
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
+
+/* ---- Socket output ---- */
+
+/* One gathered send; returns bytes sent, TCP_WOULD_BLOCK or -1 */
+static int64_t bufstream_sendv(int64_t sock, const BufPiece* pieces, int count, int more) {
+    int flags = MSG_NOSIGNAL | (more ? MSG_MORE : 0);
+#ifdef _WIN32
+    (void)flags;
+    WSABUF bufs[BUFSTREAM_MAX_PIECES];
+    for (int i = 0; i < count; i++) {
+        bufs[i].buf = (char*)pieces[i].data;
+        bufs[i].len = (ULONG)(pieces[i].len > (int64_t)0x7fffffff ? 0x7fffffff : pieces[i].len);
+    }
+    for (;;) {
+        DWORD sent = 0;
+        if (WSASend((SOCKET)sock, bufs, (DWORD)count, &sent, 0, NULL, NULL) == 0) {
+            return (int64_t)sent;
+        }
+        if (WSAGetLastError() == WSAEINTR) {
+            continue;
+        }
+        return bufstream_would_block() ? TCP_WOULD_BLOCK : -1;
+    }
+#else
+    struct iovec iov[BUFSTREAM_MAX_PIECES];
+    for (int i = 0; i < count; i++) {
+        iov[i].iov_base = (void*)pieces[i].data;
+        iov[i].iov_len = (size_t)pieces[i].len;
+    }
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = count;
+    for (;;) {
+        ssize_t sent = sendmsg((int)sock, &msg, flags);
+        if (sent >= 0) {
+            return (int64_t)sent;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        return bufstream_would_block() ? TCP_WOULD_BLOCK : -1;
+    }
+#endif
+}
+
+static int bufstream_reserve_write(BufStream* s, int64_t extra) {
+    if (s->wpos > 0 && s->wcap - s->wlen < extra) {
+        memmove(s->wbuf, s->wbuf + s->wpos, (size_t)(s->wlen - s->wpos));
+        s->wlen -= s->wpos;
+        s->wpos = 0;
+    }
+    if (s->wcap - s->wlen >= extra) {
+        return 1;
+    }
+    int64_t new_capacity = s->wcap * 2;
+    while (new_capacity - s->wlen < extra) {
+        new_capacity *= 2;
+    }
+    char* grown = realloc(s->wbuf, (size_t)new_capacity);
+    if (!grown) {
+        return 0;
+    }
+    s->wbuf = grown;
+    s->wcap = new_capacity;
+    return 1;
+}
+
+/* Send the buffered bytes followed by pieces; whatever the socket does not
+ * take right now is appended to the write buffer. 0 on success, -1 on error. */
+static int bufstream_push(BufStream* s, const BufPiece* extra, int extra_count, int more) {
+    int64_t total = 0;
+    for (int i = 0; i < extra_count; i++) {
+        total += extra[i].len;
+    }
+
+    /* Batching: it fits, so just buffer it */
+    if (s->wlen + total <= s->wcap || (s->wpos > 0 && s->wlen - s->wpos + total <= s->wcap)) {
+        if (!bufstream_reserve_write(s, total)) {
+            return -1;
+        }
+        for (int i = 0; i < extra_count; i++) {
+            memcpy(s->wbuf + s->wlen, extra[i].data, (size_t)extra[i].len);
+            s->wlen += extra[i].len;
+        }
+        return 0;
+    }
+
+    BufPiece pieces[BUFSTREAM_MAX_PIECES];
+    int count = 0;
+    if (s->wlen > s->wpos) {
+        pieces[count].data = s->wbuf + s->wpos;
+        pieces[count].len = s->wlen - s->wpos;
+        count++;
+    }
+    for (int i = 0; i < extra_count; i++) {
+        if (extra[i].len > 0) {
+            pieces[count++] = extra[i];
+        }
+    }
+
+    int first = 0;
+    while (first < count) {
+        int64_t sent = bufstream_sendv(s->sock, pieces + first, count - first, more);
+        if (sent == TCP_WOULD_BLOCK) {
+            break;
+        }
+        if (sent < 0) {
+            return -1;
+        }
+        s->more_queued = more;
+        while (first < count && sent >= pieces[first].len) {
+            sent -= pieces[first].len;
+            first++;
+        }
+        if (first < count) {
+            pieces[first].data += sent;
+            pieces[first].len -= sent;
+        }
+    }
+
+    /* Keep the unsent tail. pieces[0] may point into wbuf, so rebuild the
+     * buffer from the tail rather than appending to it. */
+    int64_t tail = 0;
+    for (int i = first; i < count; i++) {
+        tail += pieces[i].len;
+    }
+    if (tail == 0) {
+        s->wpos = s->wlen = 0;
+        return 0;
+    }
+    int in_buffer = first < count && pieces[first].data >= s->wbuf && pieces[first].data < s->wbuf + s->wcap;
+    if (in_buffer) {
+        s->wpos = pieces[first].data - s->wbuf;
+        first++;
+    } else {
+        s->wpos = s->wlen = 0;
+    }
+    for (int i = first; i < count; i++) {
+        if (!bufstream_reserve_write(s, pieces[i].len)) {
+            return -1;
+        }
+        memcpy(s->wbuf + s->wlen, pieces[i].data, (size_t)pieces[i].len);
+        s->wlen += pieces[i].len;
+    }
+    return 0;
+}
+
+/* ---- Socket input ---- */
+
+/* Drop the previous frame so its bytes can be reused */
+static void bufstream_release_frame(BufStream* s) {
+    if (s->consume > 0) {
+        s->rpos += s->consume;
+        s->scan = 0;    /* It was relative to the old rpos */
+    }
+    s->consume = 0;
+    s->frame = NULL;
+    s->frame_len = 0;
+    if (s->rpos == s->rlen) {
+        s->rpos = s->rlen = 0;
+    }
+}
+
+/* Make room for at least need bytes of unread data in one contiguous run */
+static int bufstream_reserve_read(BufStream* s, int64_t need) {
+    if (need <= s->rcap - s->rpos) {
+        return 1;
+    }
+    if (s->rpos > 0) {
+        memmove(s->rbuf, s->rbuf + s->rpos, (size_t)(s->rlen - s->rpos));
+        s->rlen -= s->rpos;
+        s->rpos = 0;
+        if (need <= s->rcap) {
+            return 1;
+        }
+    }
+    int64_t new_capacity = s->rcap * 2;
+    while (new_capacity < need) {
+        new_capacity *= 2;
+    }
+    char* grown = realloc(s->rbuf, (size_t)new_capacity);
+    if (!grown) {
+        return 0;
+    }
+    s->rbuf = grown;
+    s->rcap = new_capacity;
+    return 1;
+}
+
+/* One recv() into the free space; returns bytes, 0 on EOF, TCP_WOULD_BLOCK or -1 */
+static int64_t bufstream_fill(BufStream* s) {
+    if (s->rlen == s->rcap && !bufstream_reserve_read(s, s->rlen - s->rpos + 1)) {
+        return -1;
+    }
+    int64_t n = tcp_try_recv(s->sock, s->rbuf + s->rlen, s->rcap - s->rlen);
+    if (n > 0) {
+        s->rlen += n;
+    }
+    return n;
+}
+
+/* Decode a length prefix; returns header size, 0 if incomplete, -1 if invalid */
+static int bufstream_parse_header(const unsigned char* p, int64_t avail, int32_t codec, uint64_t* len) {
+    switch (codec) {
+        case BUFSTREAM_U16:
+            if (avail < 2) {
+                return 0;
+            }
+            *len = ((uint64_t)p[0] << 8) | p[1];
+            return 2;
+        case BUFSTREAM_U32:
+            if (avail < 4) {
+                return 0;
+            }
+            *len = ((uint64_t)p[0] << 24) | ((uint64_t)p[1] << 16) | ((uint64_t)p[2] << 8) | p[3];
+            return 4;
+        default: {
+            uint64_t value = 0;
+            for (int i = 0; i < BUFSTREAM_MAX_HEADER; i++) {
+                if (i >= avail) {
+                    return 0;
+                }
+                value |= (uint64_t)(p[i] & 0x7f) << (7 * i);
+                if (!(p[i] & 0x80)) {
+                    *len = value;
+                    return i + 1;
+                }
+            }
+            return -1;
+        }
+    }
+}
+
+/* ---- Public API ---- */
+
+/* Wrap a connected socket; capacities <= 0 use 64 KiB. NULL on failure. */
+void* bufstream_new(int64_t sock, int64_t read_capacity, int64_t write_capacity) {
+    BufStream* s = calloc(1, sizeof(BufStream));
+    if (!s) {
+        return NULL;
+    }
+    s->sock = sock;
+    s->max_frame = BUFSTREAM_DEFAULT_MAX_FRAME;
+    s->rcap = read_capacity > 0 ? read_capacity : BUFSTREAM_DEFAULT_CAPACITY;
+    s->wcap = write_capacity > 0 ? write_capacity : BUFSTREAM_DEFAULT_CAPACITY;
+    s->rbuf = malloc((size_t)s->rcap);
+    s->wbuf = malloc((size_t)s->wcap);
+    if (!s->rbuf || !s->wbuf) {
+        free(s->rbuf);
+        free(s->wbuf);
+        free(s);
+        return NULL;
+    }
+    return s;
+}
+
+/* Largest payload read_frame() accepts (and write_frame() sends) */
+void bufstream_set_max_frame(void* handle, int64_t max_frame) {
+    BufStream* s = (BufStream*)handle;
+    if (s && max_frame > 0) {
+        s->max_frame = max_frame;
+    }
+}
+
+/**
+ * Reads one frame and returns its payload length; the payload itself is
+ * available from bufstream_frame() until the next read on this stream.
+ *
+ * @return Payload length (>= 0), BUFSTREAM_EOF (-3) on a clean end of
+ *         stream between frames, TCP_WOULD_BLOCK (-2) if a nonblocking
+ *         socket has no complete frame yet, or -1 on error (EMSGSIZE for an
+ *         oversized frame, ECONNRESET for EOF inside a frame)
+ */
+int64_t bufstream_read_frame(void* handle, int32_t codec, int64_t param) {
+    BufStream* s = (BufStream*)handle;
+    if (!s || codec < BUFSTREAM_U16 || codec > BUFSTREAM_FIXED ||
+        (codec == BUFSTREAM_FIXED && (param < 0 || param > s->max_frame))) {
+        bufstream_set_errno(EINVAL);
+        return -1;
+    }
+    bufstream_release_frame(s);
+    if (codec != s->scan_codec) {
+        /* LINE and CRLF split on different bytes: a CRLF scan may have
+         * passed a bare "\n" that ends a LINE frame */
+        s->scan = 0;
+        s->scan_codec = codec;
+    }
+
+    for (;;) {
+        const unsigned char* p = (const unsigned char*)s->rbuf + s->rpos;
+        int64_t avail = s->rlen - s->rpos;
+        int64_t header = 0;
+        int64_t payload = -1;    /* Known payload length, or -1 if not yet */
+        int64_t trailer = 0;
+
+        if (codec == BUFSTREAM_FIXED) {
+            payload = param;
+        } else if (codec == BUFSTREAM_LINE || codec == BUFSTREAM_CRLF) {
+            const unsigned char* nl = NULL;
+            int64_t from = s->scan;
+            while (from < avail) {
+                nl = memchr(p + from, '\n', (size_t)(avail - from));
+                if (!nl) {
+                    break;
+                }
+                int64_t at = nl - p;
+                if (codec == BUFSTREAM_LINE || (at > 0 && p[at - 1] == '\r')) {
+                    payload = at;
+                    trailer = 1;
+                    if (at > 0 && p[at - 1] == '\r') {
+                        payload--;
+                        trailer++;
+                    }
+                    break;
+                }
+                from = at + 1;
+                nl = NULL;
+            }
+            if (payload < 0) {
+                s->scan = avail;
+                if (avail > s->max_frame + 1) {
+                    bufstream_set_errno(EMSGSIZE);
+                    return -1;
+                }
+            }
+        } else {
+            uint64_t len = 0;
+            int parsed = bufstream_parse_header(p, avail, codec, &len);
+            if (parsed < 0 || (parsed > 0 && len > (uint64_t)s->max_frame)) {
+                bufstream_set_errno(parsed < 0 ? EINVAL : EMSGSIZE);
+                return -1;
+            }
+            if (parsed > 0) {
+                header = parsed;
+                payload = (int64_t)len;
+            }
+        }
+
+        if (payload >= 0 && avail >= header + payload + trailer) {
+            s->frame = (const char*)p + header;
+            s->frame_len = payload;
+            s->consume = header + payload + trailer;
+            s->scan = 0;
+            return payload;
+        }
+
+        /* Need more bytes: make sure the whole frame will fit, then recv */
+        if (payload >= 0 && !bufstream_reserve_read(s, header + payload + trailer)) {
+            return -1;
+        }
+        int64_t n = bufstream_fill(s);
+        if (n == 0) {
+            if (s->rlen == s->rpos) {
+                return BUFSTREAM_EOF;
+            }
+            bufstream_set_errno(ECONNRESET);
+            return -1;
+        }
+        if (n < 0) {
+            return n;
+        }
+    }
+}
+
+/* Borrowed view of the last frame (do not drop); valid until the next read */
+String bufstream_frame(void* handle) {
+    BufStream* s = (BufStream*)handle;
+    String view = { NULL, 0 };
+    if (s && s->frame) {
+        view.data = (char*)s->frame;
+        view.len = s->frame_len;
+    }
+    return view;
+}
+
+const char* bufstream_frame_data(void* handle) {
+    BufStream* s = (BufStream*)handle;
+    return s ? s->frame : NULL;
+}
+
+/**
+ * Reads up to len unframed bytes, from the buffer first. Reads at least as
+ * large as the buffer bypass it when it is empty.
+ *
+ * @return Bytes read, 0 on EOF, TCP_WOULD_BLOCK (-2) or -1 on error
+ */
+int64_t bufstream_read(void* handle, char* buf, int64_t len) {
+    BufStream* s = (BufStream*)handle;
+    if (!s || len < 0 || (len > 0 && !buf)) {
+        bufstream_set_errno(EINVAL);
+        return -1;
+    }
+    bufstream_release_frame(s);
+    s->scan = 0;
+    if (len == 0) {
+        return 0;
+    }
+
+    if (s->rlen == s->rpos) {
+        if (len >= s->rcap) {
+            return tcp_try_recv(s->sock, buf, len);
+        }
+        int64_t n = bufstream_fill(s);
+        if (n <= 0) {
+            return n;
+        }
+    }
+    int64_t avail = s->rlen - s->rpos;
+    int64_t n = avail < len ? avail : len;
+    memcpy(buf, s->rbuf + s->rpos, (size_t)n);
+    s->rpos += n;
+    if (s->rpos == s->rlen) {
+        s->rpos = s->rlen = 0;
+    }
+    return n;
+}
+
+/* Bytes received but not yet consumed */
+int64_t bufstream_buffered(void* handle) {
+    BufStream* s = (BufStream*)handle;
+    return s ? s->rlen - s->rpos - s->consume : 0;
+}
+
+/**
+ * Queues len bytes for sending. The data is always accepted: it is batched
+ * in the write buffer, and whatever a nonblocking socket cannot take stays
+ * buffered until the next flush. 0 on success, -1 on error.
+ */
+int32_t bufstream_write(void* handle, const char* data, int64_t len) {
+    BufStream* s = (BufStream*)handle;
+    if (!s || len < 0 || (len > 0 && !data)) {
+        bufstream_set_errno(EINVAL);
+        return -1;
+    }
+    BufPiece piece = { data, len };
+    return bufstream_push(s, &piece, 1, 1);
+}
+
+/**
+ * Queues one frame: the codec's header, the payload and its delimiter.
+ * Fails with EINVAL if the payload cannot be framed (too long for U16/U32,
+ * contains the delimiter, wrong size for FIXED) and EMSGSIZE if it exceeds
+ * the max frame size. 0 on success, -1 on error.
+ */
+int32_t bufstream_write_frame(void* handle, int32_t codec, int64_t param, const char* data, int64_t len) {
+    BufStream* s = (BufStream*)handle;
+    if (!s || len < 0 || (len > 0 && !data)) {
+        bufstream_set_errno(EINVAL);
+        return -1;
+    }
+    if (len > s->max_frame) {
+        bufstream_set_errno(EMSGSIZE);
+        return -1;
+    }
+
+    unsigned char header[BUFSTREAM_MAX_HEADER];
+    int header_len = 0;
+    const char* trailer = "";
+    int trailer_len = 0;
+    int valid = 1;
+    switch (codec) {
+        case BUFSTREAM_U16:
+            valid = len <= 0xffff;
+            header[0] = (unsigned char)(len >> 8);
+            header[1] = (unsigned char)len;
+            header_len = 2;
+            break;
+        case BUFSTREAM_U32:
+            valid = len <= (int64_t)0xffffffffLL;
+            header[0] = (unsigned char)(len >> 24);
+            header[1] = (unsigned char)(len >> 16);
+            header[2] = (unsigned char)(len >> 8);
+            header[3] = (unsigned char)len;
+            header_len = 4;
+            break;
+        case BUFSTREAM_VARINT: {
+            uint64_t value = (uint64_t)len;
+            do {
+                header[header_len] = (unsigned char)(value & 0x7f);
+                value >>= 7;
+                if (value) {
+                    header[header_len] |= 0x80;
+                }
+                header_len++;
+            } while (value);
+            break;
+        }
+        case BUFSTREAM_LINE:
+            valid = len == 0 || (!memchr(data, '\n', (size_t)len) && data[len - 1] != '\r');
+            trailer = "\n";
+            trailer_len = 1;
+            break;
+        case BUFSTREAM_CRLF:
+            for (int64_t i = 1; i < len && valid; i++) {
+                if (data[i] == '\n' && data[i - 1] == '\r') {
+                    valid = 0;
+                }
+            }
+            valid = valid && (len == 0 || data[len - 1] != '\r');
+            trailer = "\r\n";
+            trailer_len = 2;
+            break;
+        case BUFSTREAM_FIXED:
+            valid = len == param;
+            break;
+        default:
+            valid = 0;
+    }
+    if (!valid) {
+        bufstream_set_errno(EINVAL);
+        return -1;
+    }
+
+    BufPiece pieces[3] = {
+        { (const char*)header, header_len },
+        { data, len },
+        { trailer, trailer_len },
+    };
+    return bufstream_push(s, pieces, 3, 1);
+}
+
+/**
+ * Sends everything buffered (without MSG_MORE, so the kernel pushes it out
+ * unless the socket is corked).
+ *
+ * @return 0 when the buffer is empty, TCP_WOULD_BLOCK (-2) if a nonblocking
+ *         socket filled up first (the rest stays buffered), -1 on error
+ */
+int32_t bufstream_flush(void* handle) {
+    BufStream* s = (BufStream*)handle;
+    if (!s) {
+        return -1;
+    }
+    while (s->wpos < s->wlen) {
+        BufPiece piece = { s->wbuf + s->wpos, s->wlen - s->wpos };
+        int64_t sent = bufstream_sendv(s->sock, &piece, 1, 0);
+        if (sent < 0) {
+            return (int32_t)sent;
+        }
+        s->wpos += sent;
+        s->more_queued = 0;
+    }
+    s->wpos = s->wlen = 0;
+#if defined(TCP_CORK)
+    /* Nothing was buffered, but the kernel may still hold the tail of an
+     * earlier MSG_MORE send; clearing TCP_CORK pushes it out */
+    if (s->more_queued && !s->corked) {
+        int off = 0;
+        setsockopt((int)s->sock, IPPROTO_TCP, TCP_CORK, &off, sizeof(off));
+    }
+#endif
+    s->more_queued = 0;
+    return 0;
+}
+
+/* Bytes queued but not yet accepted by the socket */
+int64_t bufstream_pending_write(void* handle) {
+    BufStream* s = (BufStream*)handle;
+    return s ? s->wlen - s->wpos : 0;
+}
+
+/* Hold back partial TCP segments (TCP_CORK) until uncorked; uncorking pushes
+ * out what the kernel is holding. Returns 0, or -1 where unsupported. */
+int32_t bufstream_set_cork(void* handle, int32_t enabled) {
+    BufStream* s = (BufStream*)handle;
+    if (!s) {
+        return -1;
+    }
+    int value = enabled ? 1 : 0;
+    s->corked = value;
+#if defined(TCP_CORK)
+    return setsockopt((int)s->sock, IPPROTO_TCP, TCP_CORK, &value, sizeof(value)) == 0 ? 0 : -1;
+#elif defined(TCP_NOPUSH)
+    return setsockopt((int)s->sock, IPPROTO_TCP, TCP_NOPUSH, &value, sizeof(value)) == 0 ? 0 : -1;
+#else
+    (void)value;
+    bufstream_set_errno(EINVAL);
+    return -1;
+#endif
+}
+
+int64_t bufstream_socket(void* handle) {
+    BufStream* s = (BufStream*)handle;
+    return s ? s->sock : -1;
+}
+
+/* Free the buffers (unsent data is discarded; the socket is not closed) */
+void bufstream_free(void* handle) {
+    BufStream* s = (BufStream*)handle;
+    if (!s) {
+        return;
+    }
+    free(s->rbuf);
+    free(s->wbuf);
+    free(s);
+}
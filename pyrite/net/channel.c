@@ -0,0 +1,698 @@
+/* Shared-memory message channel in C for Pyrite standard library
+ *
+ * A channel is a ring of variable-length messages in a memory file that
+ * several processes map at once, for bulk IPC on one machine without a
+ * syscall per message:
+ *
+ * - Storage: an anonymous memfd on Linux (sealed against resizing, so a
+ *   peer can't truncate it under a reader) or an unlinked shm_open()
+ *   object elsewhere. chan_fd() is the descriptor to share: inherit it
+ *   across fork() or pass it over a Unix socket (unix_send_fds), then
+ *   chan_open() it on the other side.
+ * - Layout: one header page, then a power-of-two byte ring. Each message is
+ *   an 8-byte header word (span << 32 | length) plus its payload, padded to
+ *   8 bytes. A message never wraps: a padding record fills the end of the
+ *   ring instead, so chan_peek() and chan_reserve() hand out contiguous
+ *   memory and nothing is copied twice.
+ * - Producers (any number of threads or processes, or exactly one with
+ *   CHAN_SPSC) claim space by advancing tail, with a CAS unless single
+ *   producer, fill it in, then publish it by storing the header word with
+ *   release ordering. The single consumer reads the header at head (zero
+ *   means nothing published yet), consumes, zeroes the span and advances
+ *   head. Producers only re-read head when their cached copy says the ring
+ *   is full, so the two sides share no cache line in the steady state.
+ * - Waiting: each side spins briefly, then sleeps on a futex in the shared
+ *   page (Linux; process-shared, so it works across processes). The other
+ *   side only makes the wake syscall when a waiting flag is set, which is
+ *   rare under load. Other systems sleep in short polling intervals.
+ * - Trust: every process mapping the ring can write any of it, so the
+ *   consumer checks each record header before using it (span inside the
+ *   ring and 8-aligned, length inside the span). A bad header fails the
+ *   channel: it is shut down for everyone and the consumer gets EPROTO.
+ *
+ * Windows is not supported: chan_create()/chan_open() return NULL there.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <limits.h>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#endif
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+/* chan_create() flags (match channel.pyrite) */
+#define CHAN_SPSC 1             /* Exactly one producer: claim space without a CAS */
+
+#define CHAN_MAGIC 0x314e414843595950ULL  /* "PYRCHAN1" */
+#define CHAN_VERSION 1
+#define CHAN_HEADER_SIZE 4096             /* Shared header page; the ring follows */
+#define CHAN_DEFAULT_CAPACITY (4 * 1024 * 1024)
+#define CHAN_MIN_CAPACITY 4096
+#define CHAN_MAX_CAPACITY (1LL << 30)
+#define CHAN_RECORD_HEADER 8
+#define CHAN_PAD_LENGTH 0xffffffffu       /* Header length of a padding record */
+#define CHAN_SPIN 256                     /* Checks before sleeping */
+#define CHAN_POLL_US 200                  /* Sleep between checks without futexes */
+
+/* The shared header page. Fields written by different sides live on
+ * different cache lines. */
+typedef struct {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t flags;
+    uint64_t capacity;
+    uint32_t closed;            /* Set by chan_shutdown() */
+    char pad0[36];
+    uint64_t tail;              /* Producers: next byte to claim */
+    char pad1[56];
+    uint64_t head;              /* Consumer: next byte to read */
+    uint32_t space_seq;         /* Futex: bumped when space frees up for a waiting producer */
+    uint32_t producers_waiting;
+    char pad2[48];
+    uint32_t data_seq;          /* Futex: bumped when a message is published to a waiting consumer */
+    uint32_t consumer_waiting;
+} ChanShared;
+
+typedef struct {
+    ChanShared* shared;
+    char* ring;
+    uint64_t capacity;
+    uint64_t mask;
+    size_t map_size;
+    int fd;
+    int32_t flags;
+    uint64_t cached_head;       /* Producers' last view of head */
+    uint64_t peeked;            /* Consumer: span of the message handed out by chan_peek(), 0 if none */
+    int32_t failed;             /* Consumer: a corrupt record header was seen */
+} Chan;
+
+/* ---- Helpers ---- */
+
+static uint64_t chan_span(uint64_t len) {
+    return (CHAN_RECORD_HEADER + len + 7) & ~(uint64_t)7;
+}
+
+static uint64_t* chan_header(Chan* ch, uint64_t position) {
+    return (uint64_t*)(ch->ring + (position & ch->mask));
+}
+
+#ifndef _WIN32
+
+static int64_t chan_now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void chan_pause() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+/* Sleep while *word == expected, at most timeout_ms (-1 = no limit) */
+static void chan_futex_wait(uint32_t* word, uint32_t expected, int64_t timeout_ms) {
+#ifdef __linux__
+    struct timespec ts;
+    struct timespec* timeout = NULL;
+    if (timeout_ms >= 0) {
+        ts.tv_sec = (time_t)(timeout_ms / 1000);
+        ts.tv_nsec = (long)(timeout_ms % 1000) * 1000000;
+        timeout = &ts;
+    }
+    /* Shared mapping: no FUTEX_PRIVATE_FLAG, so other processes can wake us */
+    syscall(SYS_futex, word, FUTEX_WAIT, expected, timeout, NULL, 0);
+#else
+    if (__atomic_load_n(word, __ATOMIC_ACQUIRE) != expected) {
+        return;
+    }
+    int64_t us = timeout_ms >= 0 && timeout_ms * 1000 < CHAN_POLL_US ? timeout_ms * 1000 : CHAN_POLL_US;
+    struct timespec ts = { 0, (long)us * 1000 };
+    nanosleep(&ts, NULL);
+#endif
+}
+
+static void chan_futex_wake(uint32_t* word, int count) {
+    __atomic_add_fetch(word, 1, __ATOMIC_RELEASE);
+#ifdef __linux__
+    syscall(SYS_futex, word, FUTEX_WAKE, count, NULL, NULL, 0);
+#else
+    (void)count;
+#endif
+}
+
+/* Remaining wait for a deadline: -1 = forever, 0 = expired */
+static int64_t chan_remaining(int64_t deadline) {
+    if (deadline < 0) {
+        return -1;
+    }
+    int64_t left = deadline - chan_now_ms();
+    return left > 0 ? left : 0;
+}
+
+#endif
+
+/* ---- Creating and sharing ---- */
+
+static Chan* chan_map(int fd, uint64_t capacity, int32_t flags, int create) {
+#ifdef _WIN32
+    (void)fd;
+    (void)capacity;
+    (void)flags;
+    (void)create;
+    errno = ENOSYS;
+    return NULL;
+#else
+    size_t map_size = (size_t)(CHAN_HEADER_SIZE + capacity);
+    void* base = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        return NULL;
+    }
+    Chan* ch = (Chan*)calloc(1, sizeof(Chan));
+    if (!ch) {
+        munmap(base, map_size);
+        errno = ENOMEM;
+        return NULL;
+    }
+    ch->shared = (ChanShared*)base;
+    ch->ring = (char*)base + CHAN_HEADER_SIZE;
+    ch->capacity = capacity;
+    ch->mask = capacity - 1;
+    ch->map_size = map_size;
+    ch->fd = fd;
+    if (create) {
+        /* The file starts zeroed: every header word reads "not published" */
+        ch->shared->version = CHAN_VERSION;
+        ch->shared->flags = (uint32_t)flags;
+        ch->shared->capacity = capacity;
+        __atomic_store_n(&ch->shared->magic, CHAN_MAGIC, __ATOMIC_RELEASE);
+    }
+    ch->flags = (int32_t)ch->shared->flags;
+    return ch;
+#endif
+}
+
+/**
+ * Creates a channel with a ring of capacity bytes (rounded up to a power
+ * of two; <= 0 picks 4 MiB). The largest message is half the capacity
+ * minus 8 bytes. Flags: CHAN_SPSC (1) when only one thread of one process
+ * will ever send, which makes claiming space a plain store.
+ *
+ * @return The channel, or NULL on error
+ */
+void* chan_create(int64_t capacity, int32_t flags) {
+#ifdef _WIN32
+    (void)capacity;
+    (void)flags;
+    errno = ENOSYS;
+    return NULL;
+#else
+    if (capacity <= 0) {
+        capacity = CHAN_DEFAULT_CAPACITY;
+    }
+    if (capacity > CHAN_MAX_CAPACITY) {
+        errno = EINVAL;
+        return NULL;
+    }
+    uint64_t size = CHAN_MIN_CAPACITY;
+    while (size < (uint64_t)capacity) {
+        size <<= 1;
+    }
+
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+    int fd = memfd_create("pyrite-channel", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+#else
+    /* An shm object that is unlinked at once: only the descriptor names it */
+    char name[64];
+    int fd = -1;
+    for (int attempt = 0; attempt < 16 && fd < 0; attempt++) {
+        snprintf(name, sizeof(name), "/pyrite-chan-%ld-%lld-%d", (long)getpid(),
+                 (long long)chan_now_ms(), attempt);
+        fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    }
+    if (fd >= 0) {
+        shm_unlink(name);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+#endif
+    if (fd < 0) {
+        return NULL;
+    }
+    if (ftruncate(fd, (off_t)(CHAN_HEADER_SIZE + size)) != 0) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return NULL;
+    }
+#if defined(__linux__) && defined(F_ADD_SEALS)
+    fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+#endif
+    Chan* ch = chan_map(fd, size, flags, 1);
+    if (!ch) {
+        int error = errno;
+        close(fd);
+        errno = error;
+    }
+    return ch;
+#endif
+}
+
+/**
+ * Maps a channel created by chan_create() in this or another process, from
+ * a descriptor received via fork() or unix_recv_fds(). The channel takes
+ * ownership of fd and closes it in chan_close(). The file is checked
+ * (magic, version, size) before use.
+ *
+ * @return The channel, or NULL with EINVAL if fd is not a channel
+ */
+void* chan_open(int64_t fd) {
+#ifdef _WIN32
+    (void)fd;
+    errno = ENOSYS;
+    return NULL;
+#else
+    struct stat st;
+    ChanShared header;
+    if (fd < 0 || fstat((int)fd, &st) != 0) {
+        errno = EBADF;
+        return NULL;
+    }
+    if (st.st_size < CHAN_HEADER_SIZE + CHAN_MIN_CAPACITY ||
+        pread((int)fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+        header.magic != CHAN_MAGIC || header.version != CHAN_VERSION ||
+        header.capacity < CHAN_MIN_CAPACITY || (header.capacity & (header.capacity - 1)) != 0 ||
+        (uint64_t)st.st_size != CHAN_HEADER_SIZE + header.capacity) {
+        errno = EINVAL;
+        return NULL;
+    }
+    return chan_map((int)fd, header.capacity, 0, 0);
+#endif
+}
+
+/* Descriptor of the channel's memory, to hand to another process */
+int64_t chan_fd(void* handle) {
+    Chan* ch = (Chan*)handle;
+    return ch ? ch->fd : -1;
+}
+
+/* Ring size in bytes */
+int64_t chan_capacity(void* handle) {
+    Chan* ch = (Chan*)handle;
+    return ch ? (int64_t)ch->capacity : -1;
+}
+
+/* Largest message chan_send()/chan_reserve() accept */
+int64_t chan_max_message(void* handle) {
+    Chan* ch = (Chan*)handle;
+    return ch ? (int64_t)(ch->capacity / 2 - CHAN_RECORD_HEADER) : -1;
+}
+
+/* ---- Sending ---- */
+
+/* Claim span bytes (plus padding to the end of the ring if they would
+ * wrap) without waiting. Returns the message's position, or -1 if full. */
+static int64_t chan_try_claim(Chan* ch, uint64_t span) {
+    ChanShared* shared = ch->shared;
+    uint64_t tail = __atomic_load_n(&shared->tail, __ATOMIC_RELAXED);
+    for (;;) {
+        uint64_t offset = tail & ch->mask;
+        uint64_t pad = offset + span > ch->capacity ? ch->capacity - offset : 0;
+        uint64_t need = pad + span;
+        /* Threads may share a handle: the cache is atomic (acquire/release,
+         * so the consumer's zeroing is visible to whoever reads it), and a
+         * stale, smaller value only makes the ring look fuller than it is */
+        uint64_t head = __atomic_load_n(&ch->cached_head, __ATOMIC_ACQUIRE);
+        if (tail + need - head > ch->capacity) {
+            head = __atomic_load_n(&shared->head, __ATOMIC_ACQUIRE);
+            __atomic_store_n(&ch->cached_head, head, __ATOMIC_RELEASE);
+            if (tail + need - head > ch->capacity) {
+                return -1;
+            }
+        }
+        if (ch->flags & CHAN_SPSC) {
+            __atomic_store_n(&shared->tail, tail + need, __ATOMIC_RELAXED);
+        } else if (!__atomic_compare_exchange_n(&shared->tail, &tail, tail + need, 1,
+                                                __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            continue;   /* tail now holds the current value */
+        }
+        if (pad) {
+            __atomic_store_n(chan_header(ch, tail), (pad << 32) | CHAN_PAD_LENGTH, __ATOMIC_RELEASE);
+        }
+        return (int64_t)(tail + pad);
+    }
+}
+
+/**
+ * Claims room for a message of len bytes and returns where to write it,
+ * for building messages in place. Waits up to timeout_ms for space (0 =
+ * don't wait, -1 = forever). Publish it with chan_commit(ch, slot, len),
+ * with the same len; the consumer sees messages in the order their space
+ * was claimed, so commit promptly.
+ *
+ * @return The message buffer, or NULL with errno EAGAIN (full, no wait),
+ *         ETIMEDOUT, EMSGSIZE (larger than chan_max_message) or EPIPE
+ *         (channel shut down)
+ */
+char* chan_reserve(void* handle, int64_t len, int32_t timeout_ms) {
+    Chan* ch = (Chan*)handle;
+    if (!ch || len < 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+#ifdef _WIN32
+    (void)timeout_ms;
+    errno = ENOSYS;
+    return NULL;
+#else
+    ChanShared* shared = ch->shared;
+    if ((uint64_t)len > ch->capacity / 2 - CHAN_RECORD_HEADER) {
+        errno = EMSGSIZE;
+        return NULL;
+    }
+    uint64_t span = chan_span((uint64_t)len);
+    int64_t deadline = timeout_ms > 0 ? chan_now_ms() + timeout_ms : -1;
+    for (int spins = 0;; spins++) {
+        if (__atomic_load_n(&shared->closed, __ATOMIC_ACQUIRE)) {
+            errno = EPIPE;
+            return NULL;
+        }
+        int64_t position = chan_try_claim(ch, span);
+        if (position >= 0) {
+            return (char*)chan_header(ch, (uint64_t)position) + CHAN_RECORD_HEADER;
+        }
+        if (timeout_ms == 0) {
+            errno = EAGAIN;
+            return NULL;
+        }
+        if (spins < CHAN_SPIN) {
+            chan_pause();
+            continue;
+        }
+        int64_t wait_ms = chan_remaining(deadline);
+        if (wait_ms == 0) {
+            errno = ETIMEDOUT;
+            return NULL;
+        }
+        /* Announce the wait, then re-check before sleeping: the consumer
+         * reads producers_waiting after moving head (both seq_cst) */
+        uint32_t seq = __atomic_load_n(&shared->space_seq, __ATOMIC_ACQUIRE);
+        __atomic_add_fetch(&shared->producers_waiting, 1, __ATOMIC_SEQ_CST);
+        uint64_t head = __atomic_load_n(&shared->head, __ATOMIC_SEQ_CST);
+        uint64_t tail = __atomic_load_n(&shared->tail, __ATOMIC_RELAXED);
+        uint64_t offset = tail & ch->mask;
+        uint64_t need = span + (offset + span > ch->capacity ? ch->capacity - offset : 0);
+        if (tail + need - head > ch->capacity &&
+            !__atomic_load_n(&shared->closed, __ATOMIC_ACQUIRE)) {
+            chan_futex_wait(&shared->space_seq, seq, wait_ms);
+        }
+        __atomic_sub_fetch(&shared->producers_waiting, 1, __ATOMIC_RELAXED);
+    }
+#endif
+}
+
+/* Publish a message claimed with chan_reserve(). Returns 0 or -1. */
+int32_t chan_commit(void* handle, char* slot, int64_t len) {
+    Chan* ch = (Chan*)handle;
+    if (!ch || !slot || len < 0 || (uint64_t)len > ch->capacity / 2 - CHAN_RECORD_HEADER) {
+        errno = EINVAL;
+        return -1;
+    }
+#ifdef _WIN32
+    errno = ENOSYS;
+    return -1;
+#else
+    ChanShared* shared = ch->shared;
+    uint64_t word = (chan_span((uint64_t)len) << 32) | (uint64_t)len;
+    __atomic_store_n((uint64_t*)(slot - CHAN_RECORD_HEADER), word, __ATOMIC_RELEASE);
+    /* Pairs with the consumer's seq_cst announce-then-recheck */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    /* Claim the wakeup so the producers don't all make the syscall while
+     * the consumer is still on its way out of the futex */
+    if (__atomic_load_n(&shared->consumer_waiting, __ATOMIC_RELAXED) &&
+        __atomic_exchange_n(&shared->consumer_waiting, 0, __ATOMIC_RELAXED)) {
+        chan_futex_wake(&shared->data_seq, 1);
+    }
+    return 0;
+#endif
+}
+
+/* Copy one message in, waiting up to timeout_ms for space (0 = don't
+ * wait, -1 = forever). Returns 0, or -1 with errno as for chan_reserve(). */
+int32_t chan_send(void* handle, const char* data, int64_t len, int32_t timeout_ms) {
+    if (len > 0 && data == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    char* slot = chan_reserve(handle, len, timeout_ms);
+    if (!slot) {
+        return -1;
+    }
+    if (len > 0) {
+        memcpy(slot, data, (size_t)len);
+    }
+    return chan_commit(handle, slot, len);
+}
+
+/* ---- Receiving (one consumer) ---- */
+
+/* A corrupt record header: shut the channel down for every process and
+ * refuse further receives here (EPROTO) */
+static void chan_fail(Chan* ch) {
+    ch->failed = 1;
+    ch->peeked = 0;
+#ifndef _WIN32
+    __atomic_store_n(&ch->shared->closed, 1, __ATOMIC_SEQ_CST);
+    chan_futex_wake(&ch->shared->data_seq, INT_MAX);
+    chan_futex_wake(&ch->shared->space_seq, INT_MAX);
+#endif
+    errno = EPROTO;
+}
+
+/* The next published message at head, skipping padding; NULL if none, or
+ * with errno EPROTO if the header there is corrupt (see chan_fail) */
+static char* chan_try_peek(Chan* ch, int64_t* len) {
+    ChanShared* shared = ch->shared;
+    uint64_t head = __atomic_load_n(&shared->head, __ATOMIC_RELAXED);
+    for (;;) {
+        if (head & 7) {
+            chan_fail(ch);
+            return NULL;
+        }
+        uint64_t* header = chan_header(ch, head);
+        uint64_t word = __atomic_load_n(header, __ATOMIC_ACQUIRE);
+        if (word == 0) {
+            return NULL;
+        }
+        uint64_t span = word >> 32;
+        uint64_t room = ch->capacity - (head & ch->mask);
+        uint32_t length = (uint32_t)word;
+        /* A record fits before the end of the ring; padding fills it exactly */
+        if (span < CHAN_RECORD_HEADER || span > room || (span & 7) ||
+            (length == CHAN_PAD_LENGTH ? span != room : length > span - CHAN_RECORD_HEADER)) {
+            chan_fail(ch);
+            return NULL;
+        }
+        if (length != CHAN_PAD_LENGTH) {
+            ch->peeked = span;
+            *len = (int64_t)length;
+            return (char*)header + CHAN_RECORD_HEADER;
+        }
+        /* Padding: zero its header and step over it to the ring start */
+        __atomic_store_n(header, 0, __ATOMIC_RELAXED);
+        head += span;
+        __atomic_store_n(&shared->head, head, __ATOMIC_RELEASE);
+    }
+}
+
+/**
+ * Returns the oldest message in place, without copying: a pointer into the
+ * ring and its length in *len. Waits up to timeout_ms (0 = don't wait, -1 =
+ * forever). The message stays valid, and stays first, until chan_release().
+ * Only one thread may receive from a channel.
+ *
+ * @return The message, or NULL with errno EAGAIN (empty, no wait),
+ *         ETIMEDOUT, EPIPE (shut down and drained) or EPROTO (corrupt
+ *         ring: the channel has failed)
+ */
+char* chan_peek(void* handle, int64_t* len, int32_t timeout_ms) {
+    Chan* ch = (Chan*)handle;
+    if (!ch || !len) {
+        errno = EINVAL;
+        return NULL;
+    }
+#ifdef _WIN32
+    (void)timeout_ms;
+    errno = ENOSYS;
+    return NULL;
+#else
+    ChanShared* shared = ch->shared;
+    int64_t deadline = timeout_ms > 0 ? chan_now_ms() + timeout_ms : -1;
+    for (int spins = 0;; spins++) {
+        if (ch->failed) {
+            errno = EPROTO;
+            return NULL;
+        }
+        char* message = chan_try_peek(ch, len);
+        if (message || ch->failed) {
+            return message;
+        }
+        if (__atomic_load_n(&shared->closed, __ATOMIC_ACQUIRE)) {
+            /* Messages committed before the shutdown still count */
+            message = chan_try_peek(ch, len);
+            if (message || ch->failed) {
+                return message;
+            }
+            errno = EPIPE;
+            return NULL;
+        }
+        if (timeout_ms == 0) {
+            errno = EAGAIN;
+            return NULL;
+        }
+        if (spins < CHAN_SPIN) {
+            chan_pause();
+            continue;
+        }
+        int64_t wait_ms = chan_remaining(deadline);
+        if (wait_ms == 0) {
+            errno = ETIMEDOUT;
+            return NULL;
+        }
+        uint32_t seq = __atomic_load_n(&shared->data_seq, __ATOMIC_ACQUIRE);
+        __atomic_store_n(&shared->consumer_waiting, 1, __ATOMIC_SEQ_CST);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        uint64_t head = __atomic_load_n(&shared->head, __ATOMIC_RELAXED);
+        if (__atomic_load_n(chan_header(ch, head), __ATOMIC_ACQUIRE) == 0 &&
+            !__atomic_load_n(&shared->closed, __ATOMIC_ACQUIRE)) {
+            chan_futex_wait(&shared->data_seq, seq, wait_ms);
+        }
+        __atomic_store_n(&shared->consumer_waiting, 0, __ATOMIC_RELAXED);
+    }
+#endif
+}
+
+/* Drop the message returned by chan_peek(), freeing its space. Returns 0,
+ * or -1 if no message was peeked (EINVAL) or the channel has failed
+ * (EPROTO). */
+int32_t chan_release(void* handle) {
+    Chan* ch = (Chan*)handle;
+    if (ch && ch->failed) {
+        errno = EPROTO;
+        return -1;
+    }
+    if (!ch || ch->peeked == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+#ifdef _WIN32
+    errno = ENOSYS;
+    return -1;
+#else
+    ChanShared* shared = ch->shared;
+    uint64_t head = __atomic_load_n(&shared->head, __ATOMIC_RELAXED);
+    /* head is shared memory too: the span checked by chan_peek() must still
+     * fit where head points now, or the memset below leaves the ring */
+    if ((head & 7) || ch->peeked > ch->capacity - (head & ch->mask)) {
+        chan_fail(ch);
+        return -1;
+    }
+    /* A claimed span must read as zeros until its header is published, so
+     * clear it before handing it back (the lines are still in cache) */
+    uint64_t next = head + ch->peeked;
+    memset(chan_header(ch, head), 0, (size_t)ch->peeked);
+    __atomic_store_n(&shared->head, next, __ATOMIC_SEQ_CST);
+    ch->peeked = 0;
+    /* Wake waiting producers once a quarter of the ring is free, or when
+     * the ring runs dry, rather than on every message */
+    if (__atomic_load_n(&shared->producers_waiting, __ATOMIC_SEQ_CST)) {
+        uint64_t quarter = ch->capacity / 4;
+        if (head / quarter != next / quarter ||
+            __atomic_load_n(chan_header(ch, next), __ATOMIC_ACQUIRE) == 0) {
+            chan_futex_wake(&shared->space_seq, INT_MAX);
+        }
+    }
+    return 0;
+#endif
+}
+
+/**
+ * Copies the oldest message into buf, waiting up to timeout_ms as for
+ * chan_peek(). A message larger than cap stays queued and the call fails
+ * with EMSGSIZE.
+ *
+ * @return The message length, or -1 with errno set
+ */
+int64_t chan_recv(void* handle, char* buf, int64_t cap, int32_t timeout_ms) {
+    int64_t len = 0;
+    if (cap < 0 || (cap > 0 && buf == NULL)) {
+        errno = EINVAL;
+        return -1;
+    }
+    char* message = chan_peek(handle, &len, timeout_ms);
+    if (!message) {
+        return -1;
+    }
+    if (len > cap) {
+        ((Chan*)handle)->peeked = 0;
+        errno = EMSGSIZE;
+        return -1;
+    }
+    if (len > 0) {
+        memcpy(buf, message, (size_t)len);
+    }
+    if (chan_release(handle) != 0) {
+        return -1;
+    }
+    return len;
+}
+
+/* ---- Shutdown ---- */
+
+/* Mark the channel closed for every process: senders get EPIPE, the
+ * receiver drains what was committed and then gets EPIPE. Wakes waiters. */
+int32_t chan_shutdown(void* handle) {
+    Chan* ch = (Chan*)handle;
+    if (!ch) {
+        errno = EINVAL;
+        return -1;
+    }
+#ifndef _WIN32
+    __atomic_store_n(&ch->shared->closed, 1, __ATOMIC_SEQ_CST);
+    chan_futex_wake(&ch->shared->data_seq, INT_MAX);
+    chan_futex_wake(&ch->shared->space_seq, INT_MAX);
+#endif
+    return 0;
+}
+
+/* Unmap this process's view and close its descriptor. The memory lives
+ * on while another process still has the channel open. */
+void chan_close(void* handle) {
+    Chan* ch = (Chan*)handle;
+    if (!ch) {
+        return;
+    }
+#ifndef _WIN32
+    munmap(ch->shared, ch->map_size);
+    close(ch->fd);
+#endif
+    free(ch);
+}
@@ -0,0 +1,1246 @@
+/* Completion-based network engine in C for Pyrite standard library
+ *
+ * Callers queue operations on sockets and later collect completions, instead
+ * of waiting for readiness and doing the I/O themselves:
+ *
+ * - accept (multishot): one request keeps producing accepted connections
+ * - recv (multishot): one request keeps producing received data, each chunk
+ *   in a buffer taken from an engine-owned pool, lent to the caller until the
+ *   next net_engine_poll()
+ * - send: optionally linked into chains that run strictly in order, and
+ *   optionally zero-copy (SEND_ZC): the completion is only reported once the
+ *   kernel no longer references the caller's buffer
+ *
+ * Two backends implement the same API:
+ *
+ * - io_uring (Linux 6.0+): raw syscalls, no liburing. Multishot accept/recv,
+ *   a registered provided-buffer ring for recv, IOSQE_IO_LINK for chains and
+ *   IORING_OP_SEND_ZC where the kernel has it. Submission is batched: queued
+ *   requests go to the kernel with the same io_uring_enter() that waits.
+ * - epoll: emulation on top of reactor.c with nonblocking sockets, used when
+ *   io_uring is missing, disabled (seccomp, sysctl) or too old, and on other
+ *   platforms. Zero-copy requests become ordinary sends.
+ *
+ * Sockets are plain fds in both cases, so a TcpStream works the same whichever
+ * backend is chosen. Accepted sockets are nonblocking, and the epoll backend
+ * switches every socket it is given to nonblocking mode. Cancel a socket's
+ * requests with net_engine_cancel() before closing it.
+ *
+ * Completion results follow the kernel convention: >= 0 is success (the
+ * accepted fd, bytes received - 0 meaning EOF - or bytes sent), < 0 is
+ * -errno. NET_CQE_MORE in the flags means a multishot request is still armed;
+ * without it the request is finished and must be re-issued if wanted.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <unistd.h>
+#include <time.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#endif
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+/* Multishot recv, provided buffer rings and SEND_ZC arrived together in the
+ * 6.0 uapi; older headers build the epoll backend only */
+#if defined(IORING_RECV_MULTISHOT) && defined(__NR_io_uring_setup)
+#define NET_HAVE_URING 1
+#endif
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+#ifndef ECANCELED
+#define ECANCELED 125
+#endif
+
+/* Backends (match engine.pyrite) */
+#define NET_BACKEND_EPOLL 1
+#define NET_BACKEND_URING 2
+
+/* net_engine_new() flags */
+#define NET_ENGINE_FORCE_EPOLL 1
+
+/* Completion kinds */
+#define NET_OP_ACCEPT 1
+#define NET_OP_RECV 2
+#define NET_OP_SEND 3
+
+/* net_engine_send() flags */
+#define NET_SEND_LINK 1     /* The next send waits for this one */
+#define NET_SEND_ZC 2       /* Zero-copy where supported */
+
+/* Completion flags */
+#define NET_CQE_MORE 1
+
+#define NET_DEFAULT_BUFFERS 512
+#define NET_DEFAULT_BUFFER_SIZE (16 * 1024)
+#define NET_URING_ENTRIES 1024
+#define NET_URING_CQ_ENTRIES 16384
+#define NET_BUFFER_GROUP 0
+#define NET_ACCEPT_BATCH 256
+#define NET_INTERNAL_USER_DATA UINT64_MAX
+
+/* From reactor.c and socket.c (epoll backend) */
+extern void* reactor_new();
+extern int32_t reactor_register(void* reactor, int64_t fd, int32_t interest, int64_t token);
+extern int32_t reactor_unregister(void* reactor, int64_t fd);
+extern int32_t reactor_poll(void* reactor, int32_t timeout_ms);
+extern int64_t reactor_event_token(void* reactor, int32_t index);
+extern int32_t reactor_event_flags(void* reactor, int32_t index);
+extern void reactor_free(void* reactor);
+extern int64_t tcp_accept(int64_t listener, int32_t flags);
+extern int32_t tcp_set_nonblocking(int64_t sock, int32_t enabled);
+extern int64_t tcp_try_send(int64_t sock, const char* data, int64_t len);
+extern int64_t tcp_try_recv(int64_t sock, char* buf, int64_t len);
+
+#define REACTOR_READ 1
+#define REACTOR_WRITE 2
+#define REACTOR_HUP 4
+#define REACTOR_ERROR 8
+#define TCP_WOULD_BLOCK (-2)
+#define TCP_ACCEPT_NONBLOCK 1
+
+typedef struct {
+    char* data;
+    int64_t len;
+} String;
+
+typedef struct {
+    uint64_t token;
+    int64_t result;
+    const char* data;   /* RECV: received bytes (lent until the next poll) */
+    int32_t kind;
+    int32_t flags;
+} NetCompletion;
+
+typedef struct {
+    NetCompletion* items;
+    int32_t count;
+    int32_t capacity;
+} NetCompletionList;
+
+/* One queued or armed request */
+typedef struct {
+    uint64_t token;
+    const char* data;   /* SEND payload */
+    int64_t len;
+    int64_t done;       /* SEND progress (epoll) */
+    int64_t result;     /* First SEND_ZC result, reported with its notification */
+    int32_t kind;       /* 0 = free */
+    int32_t fd;
+    int32_t flags;
+    int32_t next;       /* Free list / per-fd send queue */
+} NetOp;
+
+/* Per-fd state for the epoll backend */
+typedef struct {
+    int32_t accept_op;
+    int32_t recv_op;
+    int32_t send_head;
+    int32_t send_tail;
+    uint8_t registered;
+    uint8_t dirty;      /* Queued for an I/O attempt at the next poll */
+} NetFd;
+
+#ifdef NET_HAVE_URING
+typedef struct {
+    int fd;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned sq_entries;
+    unsigned sq_local_tail;     /* SQEs prepared but not yet published */
+    unsigned chain_start;       /* First SQE of an unfinished IO_LINK chain */
+    int chain_open;
+    struct io_uring_sqe* sqes;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_cqe* cqes;
+    void* ring_ptr;
+    size_t ring_size;
+    size_t sqes_size;
+    struct io_uring_buf_ring* buf_ring;
+    size_t buf_ring_size;
+    unsigned short buf_tail;
+} NetUring;
+#endif
+
+typedef struct {
+    int32_t backend;
+    int32_t has_send_zc;
+
+    NetOp* ops;
+    int32_t op_capacity;
+    int32_t free_op;
+
+    NetCompletionList events;   /* Delivered by the last poll */
+    NetCompletionList queued;   /* Produced between polls (cancellations) */
+
+    char* buffers;
+    int32_t buffer_count;
+    int32_t buffer_size;
+    int32_t* lent;              /* Buffers handed out by the last poll */
+    int32_t lent_count;
+
+    /* epoll backend */
+    void* reactor;
+    NetFd* fds;
+    int64_t fd_capacity;
+    int32_t* dirty;
+    int32_t dirty_count;
+    int32_t dirty_capacity;
+    int32_t* free_buffers;
+    int32_t free_buffer_count;
+    int32_t last_send;          /* Previous send op if it was NET_SEND_LINK, else -1 */
+
+#ifdef NET_HAVE_URING
+    NetUring ring;
+    int32_t* rearm;             /* Multishot recv ops stopped by an empty buffer ring */
+    int32_t rearm_count;
+    int32_t rearm_capacity;
+#endif
+} NetEngine;
+
+static int net_last_error() {
+#ifdef _WIN32
+    return WSAGetLastError();
+#else
+    return errno;
+#endif
+}
+
+static int net_push_completion(NetCompletionList* list, uint64_t token, int32_t kind, int64_t result,
+                               const char* data, int32_t flags) {
+    if (list->count == list->capacity) {
+        int32_t new_capacity = list->capacity ? list->capacity * 2 : 256;
+        NetCompletion* items = realloc(list->items, (size_t)new_capacity * sizeof(NetCompletion));
+        if (!items) {
+            return 0;
+        }
+        list->items = items;
+        list->capacity = new_capacity;
+    }
+    NetCompletion* c = &list->items[list->count++];
+    c->token = token;
+    c->kind = kind;
+    c->result = result;
+    c->data = data;
+    c->flags = flags;
+    return 1;
+}
+
+/* ---- Request slots ---- */
+
+static int32_t net_op_alloc(NetEngine* e, int32_t kind, int32_t fd, uint64_t token) {
+    if (e->free_op < 0) {
+        int32_t old_capacity = e->op_capacity;
+        int32_t new_capacity = old_capacity ? old_capacity * 2 : 256;
+        NetOp* ops = realloc(e->ops, (size_t)new_capacity * sizeof(NetOp));
+        if (!ops) {
+            return -1;
+        }
+        e->ops = ops;
+        for (int32_t i = new_capacity - 1; i >= old_capacity; i--) {
+            ops[i].kind = 0;
+            ops[i].next = e->free_op;
+            e->free_op = i;
+        }
+        e->op_capacity = new_capacity;
+    }
+    int32_t index = e->free_op;
+    NetOp* op = &e->ops[index];
+    e->free_op = op->next;
+    memset(op, 0, sizeof(*op));
+    op->kind = kind;
+    op->fd = fd;
+    op->token = token;
+    op->next = -1;
+    return index;
+}
+
+static void net_op_free(NetEngine* e, int32_t index) {
+    e->ops[index].kind = 0;
+    e->ops[index].next = e->free_op;
+    e->free_op = index;
+}
+
+static char* net_buffer(NetEngine* e, int32_t id) {
+    return e->buffers + (size_t)id * (size_t)e->buffer_size;
+}
+
+/* ---- io_uring backend ---- */
+
+#ifdef NET_HAVE_URING
+static int net_uring_setup(unsigned entries, struct io_uring_params* p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int net_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags,
+                           void* arg, size_t arg_size) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, arg_size);
+}
+
+static int net_uring_register(int fd, unsigned opcode, void* arg, unsigned nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/* Publish prepared SQEs and optionally wait; returns 0 or -errno. An open
+ * link chain is held back: the kernel ends a chain at the end of each
+ * submission, which would let its halves run unordered. */
+static int net_uring_submit(NetUring* r, unsigned min_complete, int32_t timeout_ms) {
+    unsigned tail = r->chain_open ? r->chain_start : r->sq_local_tail;
+    __atomic_store_n(r->sq_tail, tail, __ATOMIC_RELEASE);
+    unsigned to_submit = tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    unsigned flags = IORING_ENTER_EXT_ARG;
+    if (min_complete > 0) {
+        flags |= IORING_ENTER_GETEVENTS;
+        if (timeout_ms >= 0) {
+            ts.tv_sec = timeout_ms / 1000;
+            ts.tv_nsec = (long long)(timeout_ms % 1000) * 1000000LL;
+            arg.ts = (uint64_t)(uintptr_t)&ts;
+        }
+    }
+    arg.sigmask_sz = _NSIG / 8;
+
+    for (;;) {
+        int ret = net_uring_enter(r->fd, to_submit, min_complete, flags, &arg, sizeof(arg));
+        if (ret >= 0) {
+            return 0;
+        }
+        if (errno == EINTR) {
+            return 0;
+        }
+        if (errno == ETIME) {
+            return 0;
+        }
+        if (errno == EAGAIN || errno == EBUSY) {
+            /* Completion queue backpressure: reap first, then resubmit */
+            if (flags & IORING_ENTER_GETEVENTS) {
+                return 0;
+            }
+            flags |= IORING_ENTER_GETEVENTS;
+            min_complete = 0;
+            continue;
+        }
+        return -errno;
+    }
+}
+
+static struct io_uring_sqe* net_uring_sqe(NetUring* r) {
+    unsigned head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+    if (r->sq_local_tail - head >= r->sq_entries) {
+        net_uring_submit(r, 0, 0);
+        head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+        if (r->sq_local_tail - head >= r->sq_entries) {
+            return NULL;
+        }
+    }
+    unsigned index = r->sq_local_tail & *r->sq_mask;
+    struct io_uring_sqe* sqe = &r->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    r->sq_array[index] = index;
+    r->sq_local_tail++;
+    return sqe;
+}
+
+/* Close an open chain at the last prepared SQE: anything queued after a
+ * linked send would otherwise join the chain */
+static void net_uring_end_chain(NetUring* r) {
+    if (!r->chain_open) {
+        return;
+    }
+    r->sqes[(r->sq_local_tail - 1) & *r->sq_mask].flags &= ~IOSQE_IO_LINK;
+    r->chain_open = 0;
+}
+
+/* Hand a pool buffer (back) to the kernel */
+static void net_uring_provide(NetEngine* e, int32_t id) {
+    NetUring* r = &e->ring;
+    struct io_uring_buf* buf = &r->buf_ring->bufs[r->buf_tail & (unsigned)(e->buffer_count - 1)];
+    buf->addr = (uint64_t)(uintptr_t)net_buffer(e, id);
+    buf->len = (uint32_t)e->buffer_size;
+    buf->bid = (uint16_t)id;
+    r->buf_tail++;
+}
+
+static void net_uring_publish_buffers(NetUring* r) {
+    __atomic_store_n(&r->buf_ring->tail, r->buf_tail, __ATOMIC_RELEASE);
+}
+
+static void net_uring_close(NetEngine* e) {
+    NetUring* r = &e->ring;
+    if (r->buf_ring) {
+        struct io_uring_buf_reg reg;
+        memset(&reg, 0, sizeof(reg));
+        reg.bgid = NET_BUFFER_GROUP;
+        net_uring_register(r->fd, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+        munmap(r->buf_ring, r->buf_ring_size);
+    }
+    if (r->sqes) {
+        munmap(r->sqes, r->sqes_size);
+    }
+    if (r->ring_ptr) {
+        munmap(r->ring_ptr, r->ring_size);
+    }
+    if (r->fd >= 0) {
+        close(r->fd);
+    }
+    free(e->rearm);
+}
+
+static int net_uring_probe_op(struct io_uring_probe* probe, int op) {
+    return op <= probe->last_op && (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+}
+
+/* Set up the ring, probe the opcodes we need and register the buffer ring.
+ * Returns 1 on success; 0 means "use epoll" (everything is torn down). */
+static int net_uring_open(NetEngine* e) {
+    NetUring* r = &e->ring;
+    memset(r, 0, sizeof(*r));
+    r->fd = -1;
+
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN |
+              IORING_SETUP_SINGLE_ISSUER;
+    p.cq_entries = NET_URING_CQ_ENTRIES;
+    r->fd = net_uring_setup(NET_URING_ENTRIES, &p);
+    if (r->fd < 0 && errno == EINVAL) {
+        /* Pre-6.0 kernels reject the newer setup flags */
+        memset(&p, 0, sizeof(p));
+        p.flags = IORING_SETUP_CQSIZE;
+        p.cq_entries = NET_URING_CQ_ENTRIES;
+        r->fd = net_uring_setup(NET_URING_ENTRIES, &p);
+    }
+    if (r->fd < 0) {
+        return 0;
+    }
+
+    unsigned required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+    if ((p.features & required) != required) {
+        net_uring_close(e);
+        return 0;
+    }
+
+    size_t sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    r->ring_size = sq_size > cq_size ? sq_size : cq_size;
+    r->ring_ptr = mmap(NULL, r->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       r->fd, IORING_OFF_SQ_RING);
+    if (r->ring_ptr == MAP_FAILED) {
+        r->ring_ptr = NULL;
+        net_uring_close(e);
+        return 0;
+    }
+    r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) {
+        r->sqes = NULL;
+        net_uring_close(e);
+        return 0;
+    }
+
+    char* base = (char*)r->ring_ptr;
+    r->sq_head = (unsigned*)(base + p.sq_off.head);
+    r->sq_tail = (unsigned*)(base + p.sq_off.tail);
+    r->sq_mask = (unsigned*)(base + p.sq_off.ring_mask);
+    r->sq_array = (unsigned*)(base + p.sq_off.array);
+    r->sq_entries = p.sq_entries;
+    r->sq_local_tail = *r->sq_tail;
+    r->cq_head = (unsigned*)(base + p.cq_off.head);
+    r->cq_tail = (unsigned*)(base + p.cq_off.tail);
+    r->cq_mask = (unsigned*)(base + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe*)(base + p.cq_off.cqes);
+
+    /* Multishot recv and SEND_ZC are both 6.0; treat SEND_ZC as the marker */
+    size_t probe_size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe* probe = calloc(1, probe_size);
+    int usable = probe && net_uring_register(r->fd, IORING_REGISTER_PROBE, probe, 256) == 0 &&
+                 net_uring_probe_op(probe, IORING_OP_ACCEPT) &&
+                 net_uring_probe_op(probe, IORING_OP_RECV) &&
+                 net_uring_probe_op(probe, IORING_OP_SEND) &&
+                 net_uring_probe_op(probe, IORING_OP_ASYNC_CANCEL) &&
+                 net_uring_probe_op(probe, IORING_OP_SEND_ZC);
+    e->has_send_zc = usable;
+    free(probe);
+    if (!usable) {
+        net_uring_close(e);
+        return 0;
+    }
+
+    /* Provided buffer ring: the kernel picks a pool buffer per recv */
+    long page = sysconf(_SC_PAGESIZE);
+    r->buf_ring_size = (size_t)e->buffer_count * sizeof(struct io_uring_buf);
+    r->buf_ring_size = (r->buf_ring_size + (size_t)page - 1) & ~((size_t)page - 1);
+    void* ring_mem = mmap(NULL, r->buf_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring_mem == MAP_FAILED) {
+        net_uring_close(e);
+        return 0;
+    }
+    r->buf_ring = (struct io_uring_buf_ring*)ring_mem;
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)ring_mem;
+    reg.ring_entries = (uint32_t)e->buffer_count;
+    reg.bgid = NET_BUFFER_GROUP;
+    if (net_uring_register(r->fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+        munmap(ring_mem, r->buf_ring_size);
+        r->buf_ring = NULL;
+        net_uring_close(e);
+        return 0;
+    }
+    for (int32_t id = 0; id < e->buffer_count; id++) {
+        net_uring_provide(e, id);
+    }
+    net_uring_publish_buffers(r);
+    return 1;
+}
+
+static void net_uring_park(NetEngine* e, int32_t index) {
+    if (e->rearm_count == e->rearm_capacity) {
+        int32_t new_capacity = e->rearm_capacity ? e->rearm_capacity * 2 : 64;
+        int32_t* rearm = realloc(e->rearm, (size_t)new_capacity * sizeof(int32_t));
+        if (!rearm) {
+            /* Cannot track it: finish the request so the caller sees it */
+            net_push_completion(&e->events, e->ops[index].token, NET_OP_RECV, -ENOMEM, NULL, 0);
+            net_op_free(e, index);
+            return;
+        }
+        e->rearm = rearm;
+        e->rearm_capacity = new_capacity;
+    }
+    e->rearm[e->rearm_count++] = index;
+}
+
+static int net_uring_prep_recv(NetEngine* e, int32_t index) {
+    net_uring_end_chain(&e->ring);
+    struct io_uring_sqe* sqe = net_uring_sqe(&e->ring);
+    if (!sqe) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = e->ops[index].fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = NET_BUFFER_GROUP;
+    sqe->user_data = (uint64_t)index;
+    return 0;
+}
+
+static void net_uring_reap(NetEngine* e) {
+    NetUring* r = &e->ring;
+    unsigned head = *r->cq_head;
+    unsigned tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+        struct io_uring_cqe* cqe = &r->cqes[head & *r->cq_mask];
+        head++;
+        if (cqe->user_data == NET_INTERNAL_USER_DATA) {
+            continue;
+        }
+
+        int32_t index = (int32_t)cqe->user_data;
+        NetOp* op = &e->ops[index];
+        int more = (cqe->flags & IORING_CQE_F_MORE) != 0;
+
+        if (op->kind == NET_OP_SEND) {
+            if (cqe->flags & IORING_CQE_F_NOTIF) {
+                /* Zero-copy send: the buffer is free now, report the result */
+                net_push_completion(&e->events, op->token, NET_OP_SEND, op->result, NULL, 0);
+                net_op_free(e, index);
+            } else if (more) {
+                op->result = cqe->res;   /* Notification follows */
+            } else {
+                net_push_completion(&e->events, op->token, NET_OP_SEND, cqe->res, NULL, 0);
+                net_op_free(e, index);
+            }
+            continue;
+        }
+
+        if (op->kind == NET_OP_RECV) {
+            if (cqe->res == -ENOBUFS) {
+                /* Pool exhausted: re-arm once lent buffers come back */
+                if (!more) {
+                    net_uring_park(e, index);
+                }
+                continue;
+            }
+            const char* data = NULL;
+            if (cqe->res > 0 && (cqe->flags & IORING_CQE_F_BUFFER)) {
+                int32_t id = (int32_t)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+                data = net_buffer(e, id);
+                e->lent[e->lent_count++] = id;
+            }
+            if (cqe->res > 0 && !more) {
+                /* Kernel stopped the multishot (e.g. CQ pressure) but the
+                 * stream is healthy: keep it going transparently */
+                net_uring_park(e, index);
+                more = 1;
+            }
+            net_push_completion(&e->events, op->token, NET_OP_RECV, cqe->res, data, more ? NET_CQE_MORE : 0);
+            if (!more) {
+                net_op_free(e, index);
+            }
+            continue;
+        }
+
+        /* NET_OP_ACCEPT */
+        net_push_completion(&e->events, op->token, NET_OP_ACCEPT, cqe->res, NULL, more ? NET_CQE_MORE : 0);
+        if (!more) {
+            net_op_free(e, index);
+        }
+    }
+    __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+}
+#endif
+
+/* ---- epoll backend ---- */
+
+static NetFd* net_fd_state(NetEngine* e, int64_t fd) {
+    if (fd < 0) {
+        return NULL;
+    }
+    if (fd >= e->fd_capacity) {
+        int64_t new_capacity = e->fd_capacity ? e->fd_capacity : 1024;
+        while (new_capacity <= fd) {
+            new_capacity *= 2;
+        }
+        NetFd* fds = realloc(e->fds, (size_t)new_capacity * sizeof(NetFd));
+        if (!fds) {
+            return NULL;
+        }
+        for (int64_t i = e->fd_capacity; i < new_capacity; i++) {
+            fds[i].accept_op = fds[i].recv_op = fds[i].send_head = fds[i].send_tail = -1;
+            fds[i].registered = fds[i].dirty = 0;
+        }
+        e->fds = fds;
+        e->fd_capacity = new_capacity;
+    }
+    return &e->fds[fd];
+}
+
+static int net_mark_dirty(NetEngine* e, int32_t fd) {
+    NetFd* state = &e->fds[fd];
+    if (state->dirty) {
+        return 1;
+    }
+    if (e->dirty_count == e->dirty_capacity) {
+        int32_t new_capacity = e->dirty_capacity ? e->dirty_capacity * 2 : 256;
+        int32_t* dirty = realloc(e->dirty, (size_t)new_capacity * sizeof(int32_t));
+        if (!dirty) {
+            return 0;
+        }
+        e->dirty = dirty;
+        e->dirty_capacity = new_capacity;
+    }
+    e->dirty[e->dirty_count++] = fd;
+    state->dirty = 1;
+    return 1;
+}
+
+static int net_fd_register(NetEngine* e, int32_t fd) {
+    NetFd* state = &e->fds[fd];
+    if (state->registered) {
+        return 1;
+    }
+    if (tcp_set_nonblocking(fd, 1) != 0) {
+        return 0;
+    }
+    /* Edge-triggered for both directions; idle edges are harmless */
+    if (reactor_register(e->reactor, fd, REACTOR_READ | REACTOR_WRITE, fd) != 0) {
+        return 0;
+    }
+    state->registered = 1;
+    return 1;
+}
+
+static void net_epoll_accept(NetEngine* e, int32_t fd) {
+    NetFd* state = &e->fds[fd];
+    for (int i = 0; i < NET_ACCEPT_BATCH && state->accept_op >= 0; i++) {
+        int64_t conn = tcp_accept(fd, TCP_ACCEPT_NONBLOCK);
+        if (conn == TCP_WOULD_BLOCK) {
+            return;
+        }
+        NetOp* op = &e->ops[state->accept_op];
+        if (conn < 0) {
+            int error = net_last_error();
+            if (error == EMFILE || error == ENFILE || error == ENOBUFS || error == ENOMEM) {
+                /* Transient: report but stay armed, like io_uring does */
+                net_push_completion(&e->events, op->token, NET_OP_ACCEPT, -error, NULL, NET_CQE_MORE);
+                return;
+            }
+            net_push_completion(&e->events, op->token, NET_OP_ACCEPT, -error, NULL, 0);
+            net_op_free(e, state->accept_op);
+            state->accept_op = -1;
+            return;
+        }
+        net_push_completion(&e->events, op->token, NET_OP_ACCEPT, conn, NULL, NET_CQE_MORE);
+    }
+    if (state->accept_op >= 0) {
+        net_mark_dirty(e, fd);   /* Batch limit: continue next poll */
+    }
+}
+
+static void net_epoll_recv(NetEngine* e, int32_t fd) {
+    NetFd* state = &e->fds[fd];
+    while (state->recv_op >= 0) {
+        if (e->free_buffer_count == 0) {
+            net_mark_dirty(e, fd);   /* Retry once lent buffers come back */
+            return;
+        }
+        int32_t id = e->free_buffers[--e->free_buffer_count];
+        char* buf = net_buffer(e, id);
+        int64_t n = tcp_try_recv(fd, buf, e->buffer_size);
+        if (n == TCP_WOULD_BLOCK) {
+            e->free_buffers[e->free_buffer_count++] = id;
+            return;
+        }
+        NetOp* op = &e->ops[state->recv_op];
+        if (n > 0) {
+            e->lent[e->lent_count++] = id;
+            net_push_completion(&e->events, op->token, NET_OP_RECV, n, buf, NET_CQE_MORE);
+            continue;
+        }
+        e->free_buffers[e->free_buffer_count++] = id;
+        net_push_completion(&e->events, op->token, NET_OP_RECV, n == 0 ? 0 : -net_last_error(), NULL, 0);
+        net_op_free(e, state->recv_op);
+        state->recv_op = -1;
+    }
+}
+
+/* Fail the rest of a linked chain after a send failed */
+static void net_epoll_cancel_chain(NetEngine* e, NetFd* state, int32_t failed_flags) {
+    while ((failed_flags & NET_SEND_LINK) && state->send_head >= 0) {
+        int32_t index = state->send_head;
+        NetOp* op = &e->ops[index];
+        failed_flags = op->flags;
+        state->send_head = op->next;
+        net_push_completion(&e->events, op->token, NET_OP_SEND, -ECANCELED, NULL, 0);
+        net_op_free(e, index);
+    }
+    if (state->send_head < 0) {
+        state->send_tail = -1;
+    }
+}
+
+static void net_epoll_send(NetEngine* e, int32_t fd) {
+    NetFd* state = &e->fds[fd];
+    while (state->send_head >= 0) {
+        int32_t index = state->send_head;
+        NetOp* op = &e->ops[index];
+        while (op->done < op->len) {
+            int64_t n = tcp_try_send(fd, op->data + op->done, op->len - op->done);
+            if (n == TCP_WOULD_BLOCK) {
+                return;   /* Writable edge resumes us */
+            }
+            if (n < 0) {
+                break;
+            }
+            op->done += n;
+        }
+        int64_t result = op->done == op->len ? op->len : (op->done > 0 ? op->done : -net_last_error());
+        int32_t flags = op->flags;
+        state->send_head = op->next;
+        if (state->send_head < 0) {
+            state->send_tail = -1;
+        }
+        net_push_completion(&e->events, op->token, NET_OP_SEND, result, NULL, 0);
+        net_op_free(e, index);
+        if (result != op->len) {
+            net_epoll_cancel_chain(e, state, flags);
+        }
+    }
+}
+
+static void net_epoll_service(NetEngine* e, int32_t fd, int32_t flags) {
+    NetFd* state = &e->fds[fd];
+    if (flags & (REACTOR_READ | REACTOR_HUP | REACTOR_ERROR)) {
+        if (state->accept_op >= 0) {
+            net_epoll_accept(e, fd);
+        }
+        if (state->recv_op >= 0) {
+            net_epoll_recv(e, fd);
+        }
+    }
+    if (flags & (REACTOR_WRITE | REACTOR_HUP | REACTOR_ERROR)) {
+        if (state->send_head >= 0) {
+            net_epoll_send(e, fd);
+        }
+    }
+}
+
+/* ---- Public API ---- */
+
+void net_engine_free(void* handle);
+
+/**
+ * Creates an engine. buffer_count (rounded up to a power of two, max 32768)
+ * and buffer_size size the recv pool; <= 0 picks defaults (512 x 16 KiB).
+ * io_uring is used when available unless NET_ENGINE_FORCE_EPOLL is set.
+ * Returns NULL on failure.
+ */
+void* net_engine_new(int32_t buffer_count, int32_t buffer_size, int32_t flags) {
+    NetEngine* e = calloc(1, sizeof(NetEngine));
+    if (!e) {
+        return NULL;
+    }
+    e->free_op = -1;
+    e->last_send = -1;
+
+    int32_t count = 1;
+    int32_t wanted = buffer_count > 0 ? buffer_count : NET_DEFAULT_BUFFERS;
+    if (wanted > 32768) {
+        wanted = 32768;   /* Buffer ids are 16-bit */
+    }
+    while (count < wanted) {
+        count *= 2;
+    }
+    e->buffer_count = count;
+    e->buffer_size = buffer_size > 0 ? buffer_size : NET_DEFAULT_BUFFER_SIZE;
+    e->buffers = malloc((size_t)e->buffer_count * (size_t)e->buffer_size);
+    e->lent = malloc((size_t)e->buffer_count * sizeof(int32_t));
+    if (!e->buffers || !e->lent) {
+        net_engine_free(e);
+        return NULL;
+    }
+
+#ifdef NET_HAVE_URING
+    if (!(flags & NET_ENGINE_FORCE_EPOLL) && net_uring_open(e)) {
+        e->backend = NET_BACKEND_URING;
+        return e;
+    }
+    e->has_send_zc = 0;
+#else
+    (void)flags;
+#endif
+
+    e->backend = NET_BACKEND_EPOLL;
+    e->reactor = reactor_new();
+    e->free_buffers = malloc((size_t)e->buffer_count * sizeof(int32_t));
+    if (!e->reactor || !e->free_buffers) {
+        net_engine_free(e);
+        return NULL;
+    }
+    for (int32_t id = e->buffer_count - 1; id >= 0; id--) {
+        e->free_buffers[e->free_buffer_count++] = id;
+    }
+    return e;
+}
+
+/* NET_BACKEND_URING or NET_BACKEND_EPOLL */
+int32_t net_engine_backend(void* handle) {
+    NetEngine* e = (NetEngine*)handle;
+    return e ? e->backend : 0;
+}
+
+/* 1 if NET_SEND_ZC really avoids the copy on this engine */
+int32_t net_engine_has_zero_copy(void* handle) {
+    NetEngine* e = (NetEngine*)handle;
+    return e ? e->has_send_zc : 0;
+}
+
+/* Keep accepting connections on listener until cancelled; 0 or -1 */
+int32_t net_engine_accept(void* handle, int64_t listener, int64_t token) {
+    NetEngine* e = (NetEngine*)handle;
+    if (!e || listener < 0 || listener > INT32_MAX) {
+        errno = EINVAL;
+        return -1;
+    }
+    int32_t index = net_op_alloc(e, NET_OP_ACCEPT, (int32_t)listener, (uint64_t)token);
+    if (index < 0) {
+        return -1;
+    }
+#ifdef NET_HAVE_URING
+    if (e->backend == NET_BACKEND_URING) {
+        net_uring_end_chain(&e->ring);
+        struct io_uring_sqe* sqe = net_uring_sqe(&e->ring);
+        if (!sqe) {
+            net_op_free(e, index);
+            errno = EBUSY;
+            return -1;
+        }
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->fd = (int)listener;
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+        sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+        sqe->user_data = (uint64_t)index;
+        return 0;
+    }
+#endif
+    NetFd* state = net_fd_state(e, listener);
+    if (!state || state->accept_op >= 0 || !net_fd_register(e, (int32_t)listener)) {
+        net_op_free(e, index);
+        if (state && state->accept_op >= 0) {
+            errno = EBUSY;
+        }
+        return -1;
+    }
+    state->accept_op = index;
+    net_mark_dirty(e, (int32_t)listener);
+    return 0;
+}
+
+/* Keep receiving on sock into pool buffers until EOF, error or cancel; 0 or -1 */
+int32_t net_engine_recv(void* handle, int64_t sock, int64_t token) {
+    NetEngine* e = (NetEngine*)handle;
+    if (!e || sock < 0 || sock > INT32_MAX) {
+        errno = EINVAL;
+        return -1;
+    }
+    int32_t index = net_op_alloc(e, NET_OP_RECV, (int32_t)sock, (uint64_t)token);
+    if (index < 0) {
+        return -1;
+    }
+#ifdef NET_HAVE_URING
+    if (e->backend == NET_BACKEND_URING) {
+        if (net_uring_prep_recv(e, index) != 0) {
+            net_op_free(e, index);
+            errno = EBUSY;
+            return -1;
+        }
+        return 0;
+    }
+#endif
+    NetFd* state = net_fd_state(e, sock);
+    if (!state || state->recv_op >= 0 || !net_fd_register(e, (int32_t)sock)) {
+        net_op_free(e, index);
+        if (state && state->recv_op >= 0) {
+            errno = EBUSY;
+        }
+        return -1;
+    }
+    state->recv_op = index;
+    net_mark_dirty(e, (int32_t)sock);
+    return 0;
+}
+
+/**
+ * Queues a send of len bytes. data must stay valid until the SEND
+ * completion for token arrives.
+ *
+ * Unlinked sends to one socket may complete in any order, so either wait
+ * for each completion or chain them: with NET_SEND_LINK the next send (to
+ * the same socket) starts only after this one finished in full, and is
+ * cancelled (-ECANCELED) if it did not. A chain ends at the first send
+ * without the flag, at any other request and at net_engine_poll(); it may
+ * hold at most 1024 sends. NET_SEND_ZC asks for zero-copy transmission
+ * (worthwhile for large sends to real NICs, not over loopback). 0 or -1.
+ */
+int32_t net_engine_send(void* handle, int64_t sock, const char* data, int64_t len, int64_t token, int32_t flags) {
+    NetEngine* e = (NetEngine*)handle;
+    if (!e || sock < 0 || sock > INT32_MAX || len < 0 || len > INT32_MAX || (len > 0 && !data)) {
+        errno = EINVAL;
+        return -1;
+    }
+    int32_t index = net_op_alloc(e, NET_OP_SEND, (int32_t)sock, (uint64_t)token);
+    if (index < 0) {
+        return -1;
+    }
+    NetOp* op = &e->ops[index];
+    op->data = data;
+    op->len = len;
+    op->flags = flags;
+#ifdef NET_HAVE_URING
+    if (e->backend == NET_BACKEND_URING) {
+        NetUring* r = &e->ring;
+        unsigned position = r->sq_local_tail;
+        struct io_uring_sqe* sqe = net_uring_sqe(r);
+        if (!sqe) {
+            net_op_free(e, index);
+            errno = EBUSY;
+            return -1;
+        }
+        if (flags & NET_SEND_LINK) {
+            if (!r->chain_open) {
+                r->chain_start = position;
+            }
+            r->chain_open = 1;
+        } else {
+            r->chain_open = 0;
+        }
+        sqe->opcode = ((flags & NET_SEND_ZC) && e->has_send_zc) ? IORING_OP_SEND_ZC : IORING_OP_SEND;
+        sqe->fd = (int)sock;
+        sqe->addr = (uint64_t)(uintptr_t)data;
+        sqe->len = (uint32_t)len;
+        /* WAITALL: a stream send completes in full unless it fails */
+        sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+        if (flags & NET_SEND_LINK) {
+            sqe->flags |= IOSQE_IO_LINK;
+        }
+        sqe->user_data = (uint64_t)index;
+        return 0;
+    }
+#endif
+    NetFd* state = net_fd_state(e, sock);
+    if (!state || !net_fd_register(e, (int32_t)sock)) {
+        net_op_free(e, index);
+        return -1;
+    }
+    if (state->send_tail >= 0) {
+        e->ops[state->send_tail].next = index;
+    } else {
+        state->send_head = index;
+    }
+    state->send_tail = index;
+    net_mark_dirty(e, (int32_t)sock);
+    return 0;
+}
+
+/**
+ * Cancels every request on sock (armed accept/recv, queued sends); each
+ * finishes with -ECANCELED at a later poll. Call this before closing sock.
+ * Returns 0 or -1.
+ */
+int32_t net_engine_cancel(void* handle, int64_t sock) {
+    NetEngine* e = (NetEngine*)handle;
+    if (!e || sock < 0 || sock > INT32_MAX) {
+        errno = EINVAL;
+        return -1;
+    }
+#ifdef NET_HAVE_URING
+    if (e->backend == NET_BACKEND_URING) {
+        net_uring_end_chain(&e->ring);
+        struct io_uring_sqe* sqe = net_uring_sqe(&e->ring);
+        if (!sqe) {
+            errno = EBUSY;
+            return -1;
+        }
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = (int)sock;
+        sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+        sqe->user_data = NET_INTERNAL_USER_DATA;
+        /* Submit now: the lookup is by fd and the caller is about to close it */
+        int ret = net_uring_submit(&e->ring, 0, 0);
+        if (ret < 0) {
+            errno = -ret;
+            return -1;
+        }
+        /* Parked recvs waiting for buffers are not in the kernel */
+        for (int32_t i = 0; i < e->rearm_count; i++) {
+            NetOp* op = &e->ops[e->rearm[i]];
+            if (op->fd == (int32_t)sock) {
+                net_push_completion(&e->queued, op->token, NET_OP_RECV, -ECANCELED, NULL, 0);
+                net_op_free(e, e->rearm[i]);
+                e->rearm[i--] = e->rearm[--e->rearm_count];
+            }
+        }
+        return 0;
+    }
+#endif
+    if (sock >= e->fd_capacity) {
+        return 0;
+    }
+    NetFd* state = &e->fds[sock];
+    if (state->accept_op >= 0) {
+        net_push_completion(&e->queued, e->ops[state->accept_op].token, NET_OP_ACCEPT, -ECANCELED, NULL, 0);
+        net_op_free(e, state->accept_op);
+        state->accept_op = -1;
+    }
+    if (state->recv_op >= 0) {
+        net_push_completion(&e->queued, e->ops[state->recv_op].token, NET_OP_RECV, -ECANCELED, NULL, 0);
+        net_op_free(e, state->recv_op);
+        state->recv_op = -1;
+    }
+    while (state->send_head >= 0) {
+        int32_t index = state->send_head;
+        state->send_head = e->ops[index].next;
+        net_push_completion(&e->queued, e->ops[index].token, NET_OP_SEND, -ECANCELED, NULL, 0);
+        net_op_free(e, index);
+    }
+    state->send_tail = -1;
+    if (state->registered) {
+        reactor_unregister(e->reactor, sock);
+        state->registered = 0;
+    }
+    /* A stale dirty entry finds nothing armed and does nothing */
+    return 0;
+}
+
+/**
+ * Submits queued requests and waits up to timeout_ms (-1 = forever) for at
+ * least one completion. Buffers lent by the previous poll are recycled
+ * first, so RECV data is only valid until the next call.
+ *
+ * @return Number of completions (read them with net_engine_completion_*),
+ *         0 on timeout, -1 on error
+ */
+int32_t net_engine_poll(void* handle, int32_t timeout_ms) {
+    NetEngine* e = (NetEngine*)handle;
+    if (!e) {
+        return -1;
+    }
+    e->events.count = 0;
+    for (int32_t i = 0; i < e->queued.count; i++) {
+        NetCompletion* c = &e->queued.items[i];
+        net_push_completion(&e->events, c->token, c->kind, c->result, c->data, c->flags);
+    }
+    e->queued.count = 0;
+
+#ifdef NET_HAVE_URING
+    if (e->backend == NET_BACKEND_URING) {
+        net_uring_end_chain(&e->ring);
+        for (int32_t i = 0; i < e->lent_count; i++) {
+            net_uring_provide(e, e->lent[i]);
+        }
+        if (e->lent_count > 0) {
+            net_uring_publish_buffers(&e->ring);
+        }
+        e->lent_count = 0;
+        int32_t rearm_count = e->rearm_count;
+        e->rearm_count = 0;
+        for (int32_t i = 0; i < rearm_count; i++) {
+            if (net_uring_prep_recv(e, e->rearm[i]) != 0) {
+                e->rearm[e->rearm_count++] = e->rearm[i];
+            }
+        }
+
+        /* Completions may already be waiting: only block if there are none */
+        net_uring_reap(e);
+        if (e->events.count == 0) {
+            int ret = net_uring_submit(&e->ring, 1, timeout_ms);
+            if (ret < 0) {
+                errno = -ret;
+                return -1;
+            }
+        } else {
+            net_uring_submit(&e->ring, 0, 0);
+        }
+        net_uring_reap(e);
+        return e->events.count;
+    }
+#endif
+
+    for (int32_t i = 0; i < e->lent_count; i++) {
+        e->free_buffers[e->free_buffer_count++] = e->lent[i];
+    }
+    e->lent_count = 0;
+
+    /* Try the I/O that was queued or left unfinished since the last poll */
+    int32_t dirty_count = e->dirty_count;
+    int32_t* dirty = e->dirty;
+    e->dirty = NULL;
+    e->dirty_count = e->dirty_capacity = 0;
+    for (int32_t i = 0; i < dirty_count; i++) {
+        e->fds[dirty[i]].dirty = 0;
+    }
+    for (int32_t i = 0; i < dirty_count; i++) {
+        net_epoll_service(e, dirty[i], REACTOR_READ | REACTOR_WRITE);
+    }
+    free(dirty);
+
+    int wait_ms = (e->events.count > 0 || e->dirty_count > 0) ? 0 : timeout_ms;
+    int32_t n = reactor_poll(e->reactor, wait_ms);
+    if (n < 0) {
+        return e->events.count > 0 ? e->events.count : -1;
+    }
+    for (int32_t i = 0; i < n; i++) {
+        int64_t fd = reactor_event_token(e->reactor, i);
+        if (fd >= 0 && fd < e->fd_capacity) {
+            net_epoll_service(e, (int32_t)fd, reactor_event_flags(e->reactor, i));
+        }
+    }
+    return e->events.count;
+}
+
+int64_t net_engine_completion_token(void* handle, int32_t index) {
+    NetEngine* e = (NetEngine*)handle;
+    if (!e || index < 0 || index >= e->events.count) {
+        return -1;
+    }
+    return (int64_t)e->events.items[index].token;
+}
+
+/* NET_OP_ACCEPT, NET_OP_RECV or NET_OP_SEND */
+int32_t net_engine_completion_kind(void* handle, int32_t index) {
+    NetEngine* e = (NetEngine*)handle;
+    if (!e || index < 0 || index >= e->events.count) {
+        return 0;
+    }
+    return e->events.items[index].kind;
+}
+
+/* fd / bytes (>= 0) or -errno */
+int64_t net_engine_completion_result(void* handle, int32_t index) {
+    NetEngine* e = (NetEngine*)handle;
+    if (!e || index < 0 || index >= e->events.count) {
+        return -EINVAL;
+    }
+    return e->events.items[index].result;
+}
+
+/* NET_CQE_MORE while a multishot request stays armed */
+int32_t net_engine_completion_flags(void* handle, int32_t index) {
+    NetEngine* e = (NetEngine*)handle;
+    if (!e || index < 0 || index >= e->events.count) {
+        return 0;
+    }
+    return e->events.items[index].flags;
+}
+
+/* RECV payload (result bytes), valid until the next poll; NULL otherwise */
+const char* net_engine_completion_data(void* handle, int32_t index) {
+    NetEngine* e = (NetEngine*)handle;
+    if (!e || index < 0 || index >= e->events.count) {
+        return NULL;
+    }
+    return e->events.items[index].data;
+}
+
+/* Borrowed view of the RECV payload (do not drop); valid until the next poll */
+String net_engine_completion_view(void* handle, int32_t index) {
+    NetEngine* e = (NetEngine*)handle;
+    String view = { NULL, 0 };
+    if (e && index >= 0 && index < e->events.count && e->events.items[index].data) {
+        view.data = (char*)e->events.items[index].data;
+        view.len = e->events.items[index].result;
+    }
+    return view;
+}
+
+/* Free the engine (cancel and close sockets first; in-flight sends are dropped) */
+void net_engine_free(void* handle) {
+    NetEngine* e = (NetEngine*)handle;
+    if (!e) {
+        return;
+    }
+#ifdef NET_HAVE_URING
+    if (e->backend == NET_BACKEND_URING) {
+        net_uring_close(e);
+    }
+#endif
+    if (e->reactor) {
+        reactor_free(e->reactor);
+    }
+    free(e->fds);
+    free(e->dirty);
+    free(e->free_buffers);
+    free(e->ops);
+    free(e->events.items);
+    free(e->queued.items);
+    free(e->buffers);
+    free(e->lent);
+    free(e);
+}
@@ -0,0 +1,2131 @@
+/* HTTP/1.1 server and client engine in C for Pyrite standard library
+ *
+ * Three layers, each usable on its own:
+ *
+ * - Parser: http_parse_request()/http_parse_response() parse a message head
+ *   straight out of the caller's buffer. Nothing is copied: method, target,
+ *   reason and every header name and value are views into that buffer.
+ *   Parsing is incremental in the sense that matters: feed the buffer again
+ *   after more data arrived together with how much was already scanned, and
+ *   only the new bytes are searched for the end of the head. Fields are
+ *   validated 16 bytes at a time with SSE2 where available (looking for the
+ *   first control character, which is either the line end or an error).
+ *   Chunked bodies are decoded in place.
+ * - Server: http_server_new() listens on a reactor (reactor.c) and
+ *   http_server_poll() hands out complete requests, body included. Each
+ *   request has an id that stays valid until it is answered with
+ *   http_server_respond(), http_server_respond_file() (sendfile-backed via
+ *   tcp_send_file) or http_server_serve_static(). Connections are kept alive
+ *   and pipelined requests are answered strictly in order: a connection's
+ *   next request is parsed once the current one has its response, and the
+ *   responses of a pipelined batch go out together on the next poll.
+ * - Client: http_client_connect() + http_client_send()/http_client_response()
+ *   on a blocking connection. Sends may run ahead of responses (pipelining);
+ *   responses come back in order.
+ *
+ * Limits: heads up to HTTP_MAX_HEAD bytes with HTTP_MAX_HEADERS headers,
+ * bodies up to the configured maximum (16 MiB by default). Requests over a
+ * limit are answered with 431 or 413 and the connection is closed.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <windows.h>
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+#if defined(__SSE2__) && defined(__GNUC__)
+#include <emmintrin.h>
+#define HTTP_SSE2 1
+#endif
+
+#ifndef O_CLOEXEC
+#define O_CLOEXEC 0
+#endif
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+/* Parser results besides head lengths */
+#define HTTP_INCOMPLETE (-2)
+
+/* Message flags (match http.pyrite) */
+#define HTTP_MSG_CHUNKED 1
+#define HTTP_MSG_KEEP_ALIVE 2
+#define HTTP_MSG_EXPECT_CONTINUE 4
+
+#define HTTP_MAX_HEADERS 64
+#define HTTP_MAX_HEAD (64 * 1024)
+#define HTTP_DEFAULT_MAX_BODY (16 * 1024 * 1024)
+#define HTTP_READ_CHUNK (16 * 1024)
+#define HTTP_MAX_PENDING_OUT (1024 * 1024)     /* Stop reading a connection until this drains */
+#define HTTP_DEFAULT_IDLE_MS 30000
+#define HTTP_SWEEP_MS 1000
+#define HTTP_MAX_PATH 4096
+
+/* From socket.c / reactor.c */
+#define TCP_WOULD_BLOCK (-2)
+#define TCP_LISTEN_REUSEADDR 1
+#define TCP_LISTEN_NONBLOCK 4
+#define TCP_ACCEPT_NONBLOCK 1
+#define REACTOR_READ 1
+#define REACTOR_WRITE 2
+#define REACTOR_HUP 4
+#define REACTOR_ERROR 8
+
+#define HTTP_TOKEN_LISTENER INT64_MAX
+#define HTTP_TOKEN_SWEEP (INT64_MAX - 1)
+
+typedef struct {
+    char* data;
+    int64_t len;
+} String;
+
+extern int32_t net_init();
+extern int64_t tcp_listen(const char* address, int32_t port, int32_t backlog, int32_t flags);
+extern int64_t tcp_accept(int64_t listener, int32_t flags);
+extern int32_t tcp_local_port(int64_t sock);
+extern int64_t tcp_connect(const char* address, int32_t port);
+extern int64_t tcp_try_send(int64_t sock, const char* data, int64_t len);
+extern int64_t tcp_try_recv(int64_t sock, char* buf, int64_t len);
+extern int64_t tcp_send_file(int64_t sock, int64_t file_fd, int64_t offset, int64_t len);
+extern int64_t tcp_send_all64(int64_t sock, const char* data, int64_t len, int32_t timeout_ms, int32_t* status);
+extern int32_t tcp_set_nodelay(int64_t sock, int32_t enabled);
+extern void tcp_close(int64_t sock);
+extern void* reactor_new();
+extern int32_t reactor_register(void* reactor, int64_t fd, int32_t interest, int64_t token);
+extern int32_t reactor_unregister(void* reactor, int64_t fd);
+extern int64_t reactor_timer_add(void* reactor, int64_t after_ms, int64_t interval_ms, int64_t token);
+extern int32_t reactor_poll(void* reactor, int32_t timeout_ms);
+extern int64_t reactor_event_token(void* reactor, int32_t index);
+extern int32_t reactor_event_flags(void* reactor, int32_t index);
+extern void reactor_free(void* reactor);
+
+typedef struct {
+    String name;
+    String value;
+} HttpHeader;
+
+typedef struct {
+    String method;          /* Requests */
+    String target;
+    int32_t status;         /* Responses */
+    String reason;
+    int32_t version;        /* Minor version: HTTP/1.0 or HTTP/1.1 */
+    int32_t flags;          /* HTTP_MSG_* */
+    int64_t content_length; /* -1 when absent (or superseded by chunked) */
+    int64_t head_len;
+    int32_t header_count;
+    HttpHeader headers[HTTP_MAX_HEADERS];
+    String body;            /* Set by the server and client, not the parser */
+} HttpMessage;
+
+/* ---- Parser ---- */
+
+/* RFC 9110 token characters */
+static const unsigned char http_tchar[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 1, 0, 1, 1, 1, 1, 1, 0, 0, 1, 1, 0, 1, 1, 0,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0,
+    0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 0, 1, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+};
+
+/* First byte in [p, end) that may not appear inside a field: a control
+ * character other than HTAB, or DEL. That is the CR/LF ending the line for
+ * valid input. Bytes >= 0x80 (obs-text) are allowed. */
+static const char* http_find_ctl(const char* p, const char* end) {
+#ifdef HTTP_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i space = _mm_set1_epi8(0x20);
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i del = _mm_set1_epi8(0x7f);
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        /* Signed compares: obs-text bytes are negative, so not "< 0x20" */
+        __m128i ctl = _mm_andnot_si128(_mm_cmplt_epi8(v, zero), _mm_cmplt_epi8(v, space));
+        __m128i stop = _mm_or_si128(_mm_andnot_si128(_mm_cmpeq_epi8(v, tab), ctl), _mm_cmpeq_epi8(v, del));
+        int mask = _mm_movemask_epi8(stop);
+        if (mask) {
+            return p + __builtin_ctz((unsigned int)mask);
+        }
+        p += 16;
+    }
+#endif
+    for (; p < end; p++) {
+        unsigned char c = (unsigned char)*p;
+        if ((c < 0x20 && c != '\t') || c == 0x7f) {
+            return p;
+        }
+    }
+    return end;
+}
+
+/* Whether buf holds a blank line (the end of a head), searching only from
+ * scanned - 3 on so repeated calls on a growing buffer stay linear */
+static int http_head_complete(const char* buf, int64_t len, int64_t scanned) {
+    int64_t i = scanned > 3 ? scanned - 3 : 0;
+    while (i < len) {
+        const char* nl = memchr(buf + i, '\n', (size_t)(len - i));
+        if (!nl) {
+            return 0;
+        }
+        int64_t at = nl - buf;
+        if (at + 1 < len && buf[at + 1] == '\n') {
+            return 1;
+        }
+        if (at + 2 < len && buf[at + 1] == '\r' && buf[at + 2] == '\n') {
+            return 1;
+        }
+        i = at + 1;
+    }
+    return 0;
+}
+
+/* Step over CRLF (or a bare LF); NULL if p is not at a line end */
+static const char* http_eol(const char* p, const char* end) {
+    if (p < end && *p == '\n') {
+        return p + 1;
+    }
+    if (end - p >= 2 && p[0] == '\r' && p[1] == '\n') {
+        return p + 2;
+    }
+    return NULL;
+}
+
+static const char* http_parse_version(const char* p, const char* end, int32_t* version) {
+    if (end - p < 8 || memcmp(p, "HTTP/1.", 7) != 0 || (p[7] != '0' && p[7] != '1')) {
+        return NULL;
+    }
+    *version = p[7] - '0';
+    return p + 8;
+}
+
+/* Case-insensitive comparison with a lowercase literal */
+static int http_lower_eq(const char* s, int64_t len, const char* lower) {
+    int64_t i = 0;
+    for (; i < len && lower[i]; i++) {
+        char c = s[i];
+        if (c >= 'A' && c <= 'Z') {
+            c = (char)(c + ('a' - 'A'));
+        }
+        if (c != lower[i]) {
+            return 0;
+        }
+    }
+    return i == len && lower[i] == '\0';
+}
+
+/* Whether the comma-separated value contains token (case-insensitive) */
+static int http_has_token(String value, const char* token) {
+    const char* p = value.data;
+    const char* end = value.data + value.len;
+    while (p < end) {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == ',')) {
+            p++;
+        }
+        const char* start = p;
+        while (p < end && *p != ',') {
+            p++;
+        }
+        const char* stop = p;
+        while (stop > start && (stop[-1] == ' ' || stop[-1] == '\t')) {
+            stop--;
+        }
+        if (stop > start && http_lower_eq(start, stop - start, token)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Whether the last transfer coding in value is chunked */
+static int http_last_token_is(String value, const char* token) {
+    const char* end = value.data + value.len;
+    while (end > value.data && (end[-1] == ' ' || end[-1] == '\t')) {
+        end--;
+    }
+    const char* start = end;
+    while (start > value.data && start[-1] != ',') {
+        start--;
+    }
+    while (start < end && (*start == ' ' || *start == '\t')) {
+        start++;
+    }
+    return end > start && http_lower_eq(start, end - start, token);
+}
+
+/* Framing and connection semantics from the parsed headers; 0 or -1 */
+static int http_apply_headers(HttpMessage* m, int request) {
+    int has_te = 0, chunked = 0, close = 0, keep_alive = 0;
+    m->content_length = -1;
+    for (int32_t i = 0; i < m->header_count; i++) {
+        String name = m->headers[i].name;
+        String value = m->headers[i].value;
+        if (http_lower_eq(name.data, name.len, "content-length")) {
+            if (value.len == 0 || value.len > 18) {
+                return -1;
+            }
+            int64_t length = 0;
+            for (int64_t k = 0; k < value.len; k++) {
+                if (value.data[k] < '0' || value.data[k] > '9') {
+                    return -1;
+                }
+                length = length * 10 + (value.data[k] - '0');
+            }
+            if (m->content_length >= 0 && m->content_length != length) {
+                return -1;
+            }
+            m->content_length = length;
+        } else if (http_lower_eq(name.data, name.len, "transfer-encoding")) {
+            has_te = 1;
+            chunked = http_last_token_is(value, "chunked");
+        } else if (http_lower_eq(name.data, name.len, "connection")) {
+            close |= http_has_token(value, "close");
+            keep_alive |= http_has_token(value, "keep-alive");
+        } else if (request && http_lower_eq(name.data, name.len, "expect")) {
+            if (http_lower_eq(value.data, value.len, "100-continue")) {
+                m->flags |= HTTP_MSG_EXPECT_CONTINUE;
+            }
+        }
+    }
+    if (has_te) {
+        /* Both framings at once is how requests get smuggled: refuse it.
+         * A request body must end with chunked to have a known length. */
+        if (request && (m->content_length >= 0 || !chunked)) {
+            return -1;
+        }
+        m->content_length = -1;
+        if (chunked) {
+            m->flags |= HTTP_MSG_CHUNKED;
+        }
+    }
+    if (m->version == 1 ? !close : (keep_alive && !close)) {
+        m->flags |= HTTP_MSG_KEEP_ALIVE;
+    }
+    return 0;
+}
+
+static int64_t http_parse(HttpMessage* m, const char* buf, int64_t len, int64_t scanned, int request) {
+    if (!m || len < 0 || (len > 0 && !buf)) {
+        errno = EINVAL;
+        return -1;
+    }
+    memset(m, 0, offsetof(HttpMessage, headers));
+    m->content_length = -1;
+    m->body.data = NULL;
+    m->body.len = 0;
+
+    const char* p = buf;
+    const char* end = buf + len;
+    while (p < end && (*p == '\r' || *p == '\n')) {
+        p++;   /* Stray CRLFs before the start line */
+    }
+    int64_t skipped = p - buf;
+    if (!http_head_complete(p, end - p, scanned > skipped ? scanned - skipped : 0)) {
+        if (len > HTTP_MAX_HEAD) {
+            errno = EMSGSIZE;
+            return -1;
+        }
+        return HTTP_INCOMPLETE;
+    }
+
+    int saved_errno = errno;
+    errno = EPROTO;
+    if (request) {
+        const char* start = p;
+        while (p < end && http_tchar[(unsigned char)*p]) {
+            p++;
+        }
+        if (p == start || p >= end || *p != ' ') {
+            return -1;
+        }
+        m->method.data = (char*)start;
+        m->method.len = p - start;
+        start = ++p;
+        while (p < end && *p != ' ' && (unsigned char)*p > 0x20 && *p != 0x7f) {
+            p++;
+        }
+        if (p == start || p >= end || *p != ' ') {
+            return -1;
+        }
+        m->target.data = (char*)start;
+        m->target.len = p - start;
+        p = http_parse_version(p + 1, end, &m->version);
+        if (!p || !(p = http_eol(p, end))) {
+            return -1;
+        }
+    } else {
+        p = http_parse_version(p, end, &m->version);
+        if (!p || end - p < 4 || *p != ' ') {
+            return -1;
+        }
+        p++;
+        for (int i = 0; i < 3; i++) {
+            if (p[i] < '0' || p[i] > '9') {
+                return -1;
+            }
+            m->status = m->status * 10 + (p[i] - '0');
+        }
+        p += 3;
+        if (p < end && *p == ' ') {
+            const char* start = ++p;
+            p = http_find_ctl(p, end);
+            m->reason.data = (char*)start;
+            m->reason.len = p - start;
+        }
+        if (!(p = http_eol(p, end))) {
+            return -1;
+        }
+    }
+
+    for (;;) {
+        if (p < end && (*p == '\r' || *p == '\n')) {
+            if (!(p = http_eol(p, end))) {
+                return -1;
+            }
+            break;
+        }
+        if (m->header_count == HTTP_MAX_HEADERS) {
+            errno = EMSGSIZE;
+            return -1;
+        }
+        /* A line starting with whitespace (obsolete folding) has no name */
+        const char* start = p;
+        while (p < end && http_tchar[(unsigned char)*p]) {
+            p++;
+        }
+        if (p == start || p >= end || *p != ':') {
+            return -1;
+        }
+        HttpHeader* h = &m->headers[m->header_count++];
+        h->name.data = (char*)start;
+        h->name.len = p - start;
+        p++;
+        while (p < end && (*p == ' ' || *p == '\t')) {
+            p++;
+        }
+        start = p;
+        p = http_find_ctl(p, end);
+        const char* value_end = p;
+        while (value_end > start && (value_end[-1] == ' ' || value_end[-1] == '\t')) {
+            value_end--;
+        }
+        h->value.data = (char*)start;
+        h->value.len = value_end - start;
+        if (!(p = http_eol(p, end))) {
+            return -1;
+        }
+    }
+
+    if (http_apply_headers(m, request) != 0) {
+        return -1;
+    }
+    errno = saved_errno;
+    m->head_len = p - buf;
+    return m->head_len;
+}
+
+/* Point every view at the same offsets in a buffer that moved */
+static void http_message_rebase(HttpMessage* m, const char* old_base, char* new_base) {
+    String* views[] = { &m->method, &m->target, &m->reason, &m->body };
+    for (size_t i = 0; i < sizeof(views) / sizeof(views[0]); i++) {
+        if (views[i]->data) {
+            views[i]->data = new_base + (views[i]->data - old_base);
+        }
+    }
+    for (int32_t i = 0; i < m->header_count; i++) {
+        m->headers[i].name.data = new_base + (m->headers[i].name.data - old_base);
+        m->headers[i].value.data = new_base + (m->headers[i].value.data - old_base);
+    }
+}
+
+/* Allocate a message for the parser functions; NULL on failure */
+void* http_message_new() {
+    HttpMessage* m = calloc(1, sizeof(HttpMessage));
+    if (m) {
+        m->content_length = -1;
+    }
+    return m;
+}
+
+/**
+ * Parses a request head from buf[0..len).
+ *
+ * On success every view in msg points into buf, so buf must stay alive and
+ * unchanged while msg is used. When the head is not complete yet, append
+ * the next bytes and call again with scanned = the previous len: only the
+ * new bytes are searched.
+ *
+ * @return Head length (the body starts there), HTTP_INCOMPLETE (-2), or -1
+ *         on a malformed head (EPROTO) or one over the limits (EMSGSIZE)
+ */
+int64_t http_parse_request(void* msg, const char* buf, int64_t len, int64_t scanned) {
+    return http_parse((HttpMessage*)msg, buf, len, scanned, 1);
+}
+
+/* Response counterpart of http_parse_request() */
+int64_t http_parse_response(void* msg, const char* buf, int64_t len, int64_t scanned) {
+    return http_parse((HttpMessage*)msg, buf, len, scanned, 0);
+}
+
+static String http_empty_view() {
+    String view = { NULL, 0 };
+    return view;
+}
+
+/* Borrowed views into the parsed buffer (never free them) */
+String http_message_method(void* msg) {
+    return msg ? ((HttpMessage*)msg)->method : http_empty_view();
+}
+
+String http_message_target(void* msg) {
+    return msg ? ((HttpMessage*)msg)->target : http_empty_view();
+}
+
+String http_message_reason(void* msg) {
+    return msg ? ((HttpMessage*)msg)->reason : http_empty_view();
+}
+
+String http_message_body(void* msg) {
+    return msg ? ((HttpMessage*)msg)->body : http_empty_view();
+}
+
+int32_t http_message_status(void* msg) {
+    return msg ? ((HttpMessage*)msg)->status : 0;
+}
+
+/* Minor version: 0 for HTTP/1.0, 1 for HTTP/1.1 */
+int32_t http_message_version(void* msg) {
+    return msg ? ((HttpMessage*)msg)->version : 0;
+}
+
+/* HTTP_MSG_CHUNKED | HTTP_MSG_KEEP_ALIVE | HTTP_MSG_EXPECT_CONTINUE */
+int32_t http_message_flags(void* msg) {
+    return msg ? ((HttpMessage*)msg)->flags : 0;
+}
+
+/* Content-Length, or -1 when absent or superseded by chunked encoding */
+int64_t http_message_content_length(void* msg) {
+    return msg ? ((HttpMessage*)msg)->content_length : -1;
+}
+
+int32_t http_message_header_count(void* msg) {
+    return msg ? ((HttpMessage*)msg)->header_count : 0;
+}
+
+String http_message_header_name(void* msg, int32_t index) {
+    HttpMessage* m = (HttpMessage*)msg;
+    if (!m || index < 0 || index >= m->header_count) {
+        return http_empty_view();
+    }
+    return m->headers[index].name;
+}
+
+String http_message_header_value(void* msg, int32_t index) {
+    HttpMessage* m = (HttpMessage*)msg;
+    if (!m || index < 0 || index >= m->header_count) {
+        return http_empty_view();
+    }
+    return m->headers[index].value;
+}
+
+/* Index of the first header called name (any case), or -1 */
+int32_t http_message_find_header(void* msg, const char* name) {
+    HttpMessage* m = (HttpMessage*)msg;
+    if (!m || !name) {
+        return -1;
+    }
+    size_t name_len = strlen(name);
+    for (int32_t i = 0; i < m->header_count; i++) {
+        String h = m->headers[i].name;
+        if ((size_t)h.len != name_len) {
+            continue;
+        }
+        int32_t k = 0;
+        while (k < h.len) {
+            char a = h.data[k], b = name[k];
+            if (a >= 'A' && a <= 'Z') {
+                a = (char)(a + ('a' - 'A'));
+            }
+            if (b >= 'A' && b <= 'Z') {
+                b = (char)(b + ('a' - 'A'));
+            }
+            if (a != b) {
+                break;
+            }
+            k++;
+        }
+        if (k == h.len) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Value of header name (any case); empty when absent (see find_header) */
+String http_message_header(void* msg, const char* name) {
+    int32_t index = http_message_find_header(msg, name);
+    return index < 0 ? http_empty_view() : ((HttpMessage*)msg)->headers[index].value;
+}
+
+void http_message_free(void* msg) {
+    free(msg);
+}
+
+/* ---- Chunked transfer coding ---- */
+
+enum {
+    HTTP_CHUNK_SIZE,
+    HTTP_CHUNK_EXT,
+    HTTP_CHUNK_DATA,
+    HTTP_CHUNK_DATA_END,
+    HTTP_CHUNK_LINE_START,      /* Trailer section: start of a line */
+    HTTP_CHUNK_LINE_CR,
+    HTTP_CHUNK_TRAILER
+};
+
+typedef struct {
+    int64_t remaining;      /* Bytes left in the current chunk (or its size so far) */
+    int32_t state;
+    int32_t digits;
+} HttpChunked;
+
+/*
+ * Decodes buf[0..*len) in place, continuing from the state of earlier calls;
+ * afterwards buf[0..*len) holds this call's decoded bytes. Returns
+ * HTTP_INCOMPLETE once all input is consumed and more is needed, -1 on
+ * malformed input, or (body complete, trailers skipped) the number of bytes
+ * left over - the next message - which are moved to buf + *len.
+ */
+static int64_t http_chunked_decode(HttpChunked* d, char* buf, int64_t* len) {
+    int64_t src = 0;
+    int64_t dst = 0;
+    int64_t n = *len;
+    while (src < n) {
+        char c = buf[src];
+        switch (d->state) {
+        case HTTP_CHUNK_SIZE: {
+            int digit = c >= '0' && c <= '9' ? c - '0' :
+                        c >= 'a' && c <= 'f' ? c - 'a' + 10 :
+                        c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+            if (digit >= 0) {
+                if (d->digits == 15) {
+                    return -1;   /* Would overflow int64 */
+                }
+                d->remaining = d->remaining * 16 + digit;
+                d->digits++;
+                src++;
+                break;
+            }
+            if (d->digits == 0) {
+                return -1;
+            }
+            d->state = HTTP_CHUNK_EXT;
+            break;
+        }
+        case HTTP_CHUNK_EXT:
+            /* Chunk extensions are ignored up to the line end */
+            src++;
+            if (c == '\n') {
+                d->state = d->remaining == 0 ? HTTP_CHUNK_LINE_START : HTTP_CHUNK_DATA;
+            }
+            break;
+        case HTTP_CHUNK_DATA: {
+            int64_t take = n - src < d->remaining ? n - src : d->remaining;
+            if (dst != src) {
+                memmove(buf + dst, buf + src, (size_t)take);
+            }
+            dst += take;
+            src += take;
+            d->remaining -= take;
+            if (d->remaining == 0) {
+                d->state = HTTP_CHUNK_DATA_END;
+            }
+            break;
+        }
+        case HTTP_CHUNK_DATA_END:
+            src++;
+            if (c == '\r') {
+                break;
+            }
+            if (c != '\n') {
+                return -1;
+            }
+            d->state = HTTP_CHUNK_SIZE;
+            d->digits = 0;
+            break;
+        case HTTP_CHUNK_LINE_START:
+            src++;
+            if (c == '\r') {
+                d->state = HTTP_CHUNK_LINE_CR;
+            } else if (c == '\n') {
+                goto done;
+            } else {
+                d->state = HTTP_CHUNK_TRAILER;
+            }
+            break;
+        case HTTP_CHUNK_LINE_CR:
+            src++;
+            if (c != '\n') {
+                return -1;
+            }
+            goto done;
+        case HTTP_CHUNK_TRAILER:
+            src++;
+            if (c == '\n') {
+                d->state = HTTP_CHUNK_LINE_START;
+            }
+            break;
+        }
+    }
+    *len = dst;
+    return HTTP_INCOMPLETE;
+
+done:
+    if (dst != src) {
+        memmove(buf + dst, buf + src, (size_t)(n - src));
+    }
+    *len = dst;
+    return n - src;
+}
+
+static void http_chunked_reset(HttpChunked* d) {
+    d->remaining = 0;
+    d->state = HTTP_CHUNK_SIZE;
+    d->digits = 0;
+}
+
+/* ---- Shared helpers ---- */
+
+static int64_t http_now_ms() {
+#ifdef _WIN32
+    return (int64_t)GetTickCount64();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+#endif
+}
+
+/* Grow *buf so that cap >= need; 0 or -1 */
+static int http_reserve(char** buf, int64_t* cap, int64_t need) {
+    if (need <= *cap) {
+        return 0;
+    }
+    int64_t next = *cap ? *cap : HTTP_READ_CHUNK;
+    while (next < need) {
+        next *= 2;
+    }
+    char* grown = realloc(*buf, (size_t)next);
+    if (!grown) {
+        return -1;
+    }
+    *buf = grown;
+    *cap = next;
+    return 0;
+}
+
+static int http_append(char** buf, int64_t* len, int64_t* cap, const char* data, int64_t n) {
+    if (http_reserve(buf, cap, *len + n) != 0) {
+        return -1;
+    }
+    memcpy(*buf + *len, data, (size_t)n);
+    *len += n;
+    return 0;
+}
+
+static const char* http_status_text(int32_t status) {
+    switch (status) {
+    case 100: return "Continue";
+    case 101: return "Switching Protocols";
+    case 200: return "OK";
+    case 201: return "Created";
+    case 202: return "Accepted";
+    case 204: return "No Content";
+    case 206: return "Partial Content";
+    case 301: return "Moved Permanently";
+    case 302: return "Found";
+    case 303: return "See Other";
+    case 304: return "Not Modified";
+    case 307: return "Temporary Redirect";
+    case 308: return "Permanent Redirect";
+    case 400: return "Bad Request";
+    case 401: return "Unauthorized";
+    case 403: return "Forbidden";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 408: return "Request Timeout";
+    case 409: return "Conflict";
+    case 411: return "Length Required";
+    case 413: return "Content Too Large";
+    case 414: return "URI Too Long";
+    case 415: return "Unsupported Media Type";
+    case 429: return "Too Many Requests";
+    case 431: return "Request Header Fields Too Large";
+    case 500: return "Internal Server Error";
+    case 501: return "Not Implemented";
+    case 502: return "Bad Gateway";
+    case 503: return "Service Unavailable";
+    case 504: return "Gateway Timeout";
+    default: return "Unknown";
+    }
+}
+
+/* Statuses whose responses never carry a body */
+static int http_status_has_body(int32_t status) {
+    return status >= 200 && status != 204 && status != 304;
+}
+
+/* Move buf to a larger allocation, keeping msg's views (if any) pointing at
+ * the same bytes; 0 or -1 */
+static int http_grow(char** buf, int64_t* cap, int64_t need, HttpMessage* msg) {
+    if (need <= *cap) {
+        return 0;
+    }
+    int64_t next = *cap ? *cap : HTTP_READ_CHUNK;
+    while (next < need) {
+        next *= 2;
+    }
+    char* grown = malloc((size_t)next);
+    if (!grown) {
+        return -1;
+    }
+    if (*buf) {
+        memcpy(grown, *buf, (size_t)*cap);
+    }
+    if (msg) {
+        http_message_rebase(msg, *buf, grown);
+    }
+    free(*buf);
+    *buf = grown;
+    *cap = next;
+    return 0;
+}
+
+/* Whether the header block has a line starting with "name:" (any case) */
+static int http_headers_have(const char* headers, int64_t len, const char* name) {
+    size_t name_len = strlen(name);
+    int64_t i = 0;
+    while (i < len) {
+        if ((int64_t)(i + name_len) < len && headers[i + name_len] == ':' &&
+            http_lower_eq(headers + i, (int64_t)name_len, name)) {
+            return 1;
+        }
+        const char* nl = memchr(headers + i, '\n', (size_t)(len - i));
+        if (!nl) {
+            break;
+        }
+        i = nl - headers + 1;
+    }
+    return 0;
+}
+
+/* Append caller-supplied header lines, making sure the block ends in CRLF */
+static int http_append_headers(char** buf, int64_t* len, int64_t* cap, const char* headers, int64_t headers_len) {
+    if (headers_len <= 0) {
+        return 0;
+    }
+    if (http_append(buf, len, cap, headers, headers_len) != 0) {
+        return -1;
+    }
+    if (headers[headers_len - 1] != '\n') {
+        return http_append(buf, len, cap, "\r\n", 2);
+    }
+    return 0;
+}
+
+/* IMF-fixdate ("Sun, 06 Nov 1994 08:49:37 GMT") without locale dependence */
+static void http_format_date(time_t when, char* out, size_t cap) {
+    static const char* days[] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+    static const char* months[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                    "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+    struct tm tm;
+#ifdef _WIN32
+    gmtime_s(&tm, &when);
+#else
+    gmtime_r(&when, &tm);
+#endif
+    snprintf(out, cap, "%s, %02d %s %04d %02d:%02d:%02d GMT", days[tm.tm_wday], tm.tm_mday,
+             months[tm.tm_mon], tm.tm_year + 1900, tm.tm_hour, tm.tm_min, tm.tm_sec);
+}
+
+/* ---- Server ---- */
+
+typedef struct {
+    int64_t end;            /* Output bytes up to here go first */
+    int64_t file_fd;        /* Then this file range (-1 = none) */
+    int64_t file_offset;
+    int64_t file_left;
+} HttpOutSegment;
+
+enum {
+    HTTP_CONN_READING,      /* Reading / parsing the next request */
+    HTTP_CONN_HANDLING      /* A request is out with the caller */
+};
+
+typedef struct {
+    int64_t sock;           /* -1: free slot */
+    uint32_t generation;    /* Bumped on close so stale request ids are rejected */
+    int32_t state;
+    int32_t dirty;          /* On the server's dirty list */
+    int32_t eof;
+    int32_t close_after;    /* Close once everything queued is sent */
+    int32_t head_done;      /* msg holds the current request's head */
+    int32_t continue_sent;
+    char* in;
+    int64_t in_len;
+    int64_t in_cap;
+    int64_t start;          /* Current request's first byte in in */
+    int64_t scanned;
+    int64_t body_len;
+    int64_t end;            /* First byte after the current request */
+    HttpChunked chunked;
+    char* out;
+    int64_t out_len;
+    int64_t out_cap;
+    int64_t out_pos;
+    HttpOutSegment* segs;
+    int32_t seg_count;
+    int32_t seg_cap;
+    int64_t last_active_ms;
+    HttpMessage msg;
+} HttpConn;
+
+typedef struct {
+    void* reactor;
+    int64_t listener;
+    int32_t port;
+    HttpConn** conns;
+    int32_t conn_count;     /* Slots in use or free */
+    int32_t conn_cap;
+    int32_t* free_slots;
+    int32_t free_count;
+    int32_t open_count;
+    int64_t* ready;         /* Request ids from the last poll */
+    int32_t ready_count;
+    int32_t ready_cap;
+    int32_t* dirty;         /* Slots to revisit before waiting */
+    int32_t dirty_count;
+    int32_t dirty_cap;
+    int64_t max_body;
+    int32_t idle_timeout_ms;
+    time_t date_time;
+    char date[40];
+} HttpServer;
+
+static int64_t http_conn_id(const HttpServer* s, const HttpConn* c, int32_t slot) {
+    (void)s;
+    return ((int64_t)c->generation << 32) | (int64_t)(uint32_t)slot;
+}
+
+static int http_push_i64(int64_t** items, int32_t* count, int32_t* cap, int64_t value) {
+    if (*count == *cap) {
+        int32_t next = *cap ? *cap * 2 : 64;
+        int64_t* grown = realloc(*items, (size_t)next * sizeof(int64_t));
+        if (!grown) {
+            return -1;
+        }
+        *items = grown;
+        *cap = next;
+    }
+    (*items)[(*count)++] = value;
+    return 0;
+}
+
+static int http_push_i32(int32_t** items, int32_t* count, int32_t* cap, int32_t value) {
+    if (*count == *cap) {
+        int32_t next = *cap ? *cap * 2 : 64;
+        int32_t* grown = realloc(*items, (size_t)next * sizeof(int32_t));
+        if (!grown) {
+            return -1;
+        }
+        *items = grown;
+        *cap = next;
+    }
+    (*items)[(*count)++] = value;
+    return 0;
+}
+
+static void http_conn_close(HttpServer* s, int32_t slot) {
+    HttpConn* c = s->conns[slot];
+    if (c->sock < 0) {
+        return;
+    }
+    reactor_unregister(s->reactor, c->sock);
+    tcp_close(c->sock);
+    for (int32_t i = 0; i < c->seg_count; i++) {
+        if (c->segs[i].file_fd >= 0) {
+            close((int)c->segs[i].file_fd);
+        }
+    }
+    c->sock = -1;
+    c->generation++;
+    c->seg_count = 0;
+    c->in_len = c->out_len = c->out_pos = 0;
+    s->open_count--;
+    s->free_slots[s->free_count++] = slot;   /* Sized with conns */
+}
+
+/* Queue bytes for the connection (after anything already queued) */
+static int http_conn_queue(HttpConn* c, const char* data, int64_t len) {
+    if (len == 0) {
+        return 0;
+    }
+    if (c->seg_count == 0 || c->segs[c->seg_count - 1].file_fd >= 0) {
+        if (c->seg_count == c->seg_cap) {
+            int32_t next = c->seg_cap ? c->seg_cap * 2 : 4;
+            HttpOutSegment* grown = realloc(c->segs, (size_t)next * sizeof(HttpOutSegment));
+            if (!grown) {
+                return -1;
+            }
+            c->segs = grown;
+            c->seg_cap = next;
+        }
+        c->segs[c->seg_count].file_fd = -1;
+        c->segs[c->seg_count].file_offset = 0;
+        c->segs[c->seg_count].file_left = 0;
+        c->seg_count++;
+    }
+    if (http_append(&c->out, &c->out_len, &c->out_cap, data, len) != 0) {
+        return -1;
+    }
+    c->segs[c->seg_count - 1].end = c->out_len;
+    return 0;
+}
+
+/* Queue len bytes of fd from offset; the connection owns fd from here on */
+static int http_conn_queue_file(HttpConn* c, int64_t fd, int64_t offset, int64_t len) {
+    if (c->seg_count == 0 || c->segs[c->seg_count - 1].file_fd >= 0) {
+        if (c->seg_count == c->seg_cap) {
+            int32_t next = c->seg_cap ? c->seg_cap * 2 : 4;
+            HttpOutSegment* grown = realloc(c->segs, (size_t)next * sizeof(HttpOutSegment));
+            if (!grown) {
+                return -1;
+            }
+            c->segs = grown;
+            c->seg_cap = next;
+        }
+        c->segs[c->seg_count].end = c->out_len;
+        c->seg_count++;
+    }
+    HttpOutSegment* seg = &c->segs[c->seg_count - 1];
+    seg->file_fd = fd;
+    seg->file_offset = offset;
+    seg->file_left = len;
+    return 0;
+}
+
+/* Send as much queued output as the socket takes; 0, or -1 on error */
+static int http_conn_flush(HttpConn* c) {
+    while (c->seg_count > 0) {
+        HttpOutSegment* seg = &c->segs[0];
+        while (c->out_pos < seg->end) {
+            int64_t n = tcp_try_send(c->sock, c->out + c->out_pos, seg->end - c->out_pos);
+            if (n == TCP_WOULD_BLOCK) {
+                return 0;
+            }
+            if (n < 0) {
+                return -1;
+            }
+            c->out_pos += n;
+        }
+        while (seg->file_fd >= 0 && seg->file_left > 0) {
+            int64_t n = tcp_send_file(c->sock, seg->file_fd, seg->file_offset, seg->file_left);
+            if (n == TCP_WOULD_BLOCK) {
+                return 0;
+            }
+            if (n <= 0) {
+                return -1;   /* 0: the file shrank under us */
+            }
+            seg->file_offset += n;
+            seg->file_left -= n;
+        }
+        if (seg->file_fd >= 0) {
+            close((int)seg->file_fd);
+        }
+        c->seg_count--;
+        memmove(c->segs, c->segs + 1, (size_t)c->seg_count * sizeof(HttpOutSegment));
+    }
+    c->out_len = 0;
+    c->out_pos = 0;
+    return 0;
+}
+
+static int64_t http_conn_pending(const HttpConn* c) {
+    int64_t pending = c->out_len - c->out_pos;
+    for (int32_t i = 0; i < c->seg_count; i++) {
+        pending += c->segs[i].file_left;
+    }
+    return pending;
+}
+
+static void http_server_update_date(HttpServer* s) {
+    time_t now = time(NULL);
+    if (now != s->date_time) {
+        s->date_time = now;
+        http_format_date(now, s->date, sizeof(s->date));
+    }
+}
+
+/* Queue a status line and headers. Content-Length is added when the status
+ * has a body (body_len < 0: none at all); keep-alive follows the request. */
+static int http_conn_queue_head(HttpServer* s, HttpConn* c, int32_t status, const char* headers,
+                                int64_t headers_len, int64_t body_len, int keep_alive) {
+    char line[160];
+    http_server_update_date(s);
+    int n = snprintf(line, sizeof(line), "HTTP/1.1 %d %s\r\nDate: %s\r\n", status, http_status_text(status), s->date);
+    if (http_conn_queue(c, line, n) != 0) {
+        return -1;
+    }
+    if (headers_len > 0) {
+        if (http_conn_queue(c, headers, headers_len) != 0) {
+            return -1;
+        }
+        if (headers[headers_len - 1] != '\n' && http_conn_queue(c, "\r\n", 2) != 0) {
+            return -1;
+        }
+    }
+    n = 0;
+    if (body_len >= 0 && http_status_has_body(status)) {
+        n = snprintf(line, sizeof(line), "Content-Length: %lld\r\n", (long long)body_len);
+    }
+    if (!keep_alive) {
+        n += snprintf(line + n, sizeof(line) - (size_t)n, "Connection: close\r\n");
+    } else if (c->msg.version == 0) {
+        n += snprintf(line + n, sizeof(line) - (size_t)n, "Connection: keep-alive\r\n");
+    }
+    n += snprintf(line + n, sizeof(line) - (size_t)n, "\r\n");
+    return http_conn_queue(c, line, n);
+}
+
+/* Answer a request that can't be served (status 400/413/431) and close */
+static void http_conn_fail(HttpServer* s, int32_t slot, int32_t status) {
+    HttpConn* c = s->conns[slot];
+    c->msg.version = 1;
+    if (http_conn_queue_head(s, c, status, NULL, 0, 0, 0) != 0 || http_conn_flush(c) != 0 ||
+        http_conn_pending(c) == 0) {
+        http_conn_close(s, slot);
+        return;
+    }
+    c->close_after = 1;
+}
+
+/* 1 when a complete request is ready in msg, 0 when more input is needed,
+ * or the error status to answer with */
+static int32_t http_conn_take_request(HttpServer* s, HttpConn* c) {
+    if (!c->head_done) {
+        int64_t r = http_parse(&c->msg, c->in + c->start, c->in_len - c->start, c->scanned, 1);
+        if (r == HTTP_INCOMPLETE) {
+            c->scanned = c->in_len - c->start;
+            return 0;
+        }
+        if (r < 0) {
+            return errno == EMSGSIZE ? 431 : 400;
+        }
+        c->head_done = 1;
+        c->body_len = 0;
+        c->continue_sent = 0;
+        http_chunked_reset(&c->chunked);
+        if (c->msg.content_length > s->max_body) {
+            return 413;
+        }
+    }
+    int64_t body_start = c->start + c->msg.head_len;
+    if (c->msg.flags & HTTP_MSG_CHUNKED) {
+        int64_t n = c->in_len - (body_start + c->body_len);
+        int64_t rest = http_chunked_decode(&c->chunked, c->in + body_start + c->body_len, &n);
+        c->body_len += n;
+        if (rest == -1) {
+            return 400;
+        }
+        if (c->body_len > s->max_body) {
+            return 413;
+        }
+        if (rest == HTTP_INCOMPLETE) {
+            c->in_len = body_start + c->body_len;
+            return 0;
+        }
+        c->in_len = body_start + c->body_len + rest;
+    } else {
+        int64_t length = c->msg.content_length > 0 ? c->msg.content_length : 0;
+        if (c->in_len - body_start < length) {
+            return 0;
+        }
+        c->body_len = length;
+    }
+    c->end = body_start + c->body_len;
+    c->msg.body.data = c->in + body_start;
+    c->msg.body.len = c->body_len;
+    return 1;
+}
+
+/* Make room for at least one more read; 0, or -1 when out of memory */
+static int http_conn_make_room(HttpConn* c) {
+    if (c->start > 0) {
+        /* Drop finished requests; the current head's views move along */
+        memmove(c->in, c->in + c->start, (size_t)(c->in_len - c->start));
+        if (c->head_done) {
+            http_message_rebase(&c->msg, c->in + c->start, c->in);
+        }
+        c->in_len -= c->start;
+        c->end -= c->start;
+        c->start = 0;
+    }
+    if (c->in_cap - c->in_len >= HTTP_READ_CHUNK / 2) {
+        return 0;
+    }
+    return http_grow(&c->in, &c->in_cap, c->in_len + HTTP_READ_CHUNK, c->head_done ? &c->msg : NULL);
+}
+
+/* Drive a connection as far as it goes without blocking: hand out the next
+ * buffered request, or flush output and read until the socket is drained */
+static void http_conn_progress(HttpServer* s, int32_t slot) {
+    HttpConn* c = s->conns[slot];
+    if (c->sock < 0) {
+        return;
+    }
+    for (;;) {
+        if (c->state == HTTP_CONN_HANDLING || c->close_after) {
+            if (http_conn_flush(c) != 0 || (c->close_after && http_conn_pending(c) == 0)) {
+                http_conn_close(s, slot);
+            }
+            return;
+        }
+        int32_t r = http_conn_take_request(s, c);
+        if (r == 1) {
+            c->state = HTTP_CONN_HANDLING;
+            if (http_push_i64(&s->ready, &s->ready_count, &s->ready_cap, http_conn_id(s, c, slot)) != 0) {
+                http_conn_close(s, slot);
+            }
+            return;
+        }
+        if (r > 1) {
+            http_conn_fail(s, slot, r);
+            return;
+        }
+        /* Out of buffered requests: send their responses, then read more */
+        if (http_conn_flush(c) != 0) {
+            http_conn_close(s, slot);
+            return;
+        }
+        if (http_conn_pending(c) > HTTP_MAX_PENDING_OUT) {
+            return;   /* Resumes on REACTOR_WRITE */
+        }
+        if (c->eof) {
+            if (http_conn_pending(c) == 0) {
+                http_conn_close(s, slot);
+            } else {
+                c->close_after = 1;
+            }
+            return;
+        }
+        if (c->head_done && !c->continue_sent && (c->msg.flags & HTTP_MSG_EXPECT_CONTINUE) &&
+            c->msg.version == 1 && c->in_len == c->start + c->msg.head_len) {
+            /* The client waits for this before sending the body */
+            static const char interim[] = "HTTP/1.1 100 Continue\r\n\r\n";
+            c->continue_sent = 1;
+            if (http_conn_queue(c, interim, sizeof(interim) - 1) != 0 || http_conn_flush(c) != 0) {
+                http_conn_close(s, slot);
+                return;
+            }
+        }
+        if (http_conn_make_room(c) != 0) {
+            http_conn_close(s, slot);
+            return;
+        }
+        int64_t n = tcp_try_recv(c->sock, c->in + c->in_len, c->in_cap - c->in_len);
+        if (n == TCP_WOULD_BLOCK) {
+            return;
+        }
+        if (n < 0) {
+            http_conn_close(s, slot);
+            return;
+        }
+        if (n == 0) {
+            c->eof = 1;
+        } else {
+            c->in_len += n;
+            c->last_active_ms = http_now_ms();
+        }
+    }
+}
+
+static void http_server_accept(HttpServer* s) {
+    for (;;) {
+        int64_t sock = tcp_accept(s->listener, TCP_ACCEPT_NONBLOCK);
+        if (sock < 0) {
+            return;   /* TCP_WOULD_BLOCK, or out of descriptors */
+        }
+        int32_t slot;
+        HttpConn* c;
+        if (s->free_count > 0) {
+            slot = s->free_slots[--s->free_count];
+            c = s->conns[slot];
+        } else {
+            if (s->conn_count == s->conn_cap) {
+                int32_t next = s->conn_cap ? s->conn_cap * 2 : 64;
+                HttpConn** grown = realloc(s->conns, (size_t)next * sizeof(HttpConn*));
+                int32_t* slots = realloc(s->free_slots, (size_t)next * sizeof(int32_t));
+                if (grown) {
+                    s->conns = grown;
+                }
+                if (slots) {
+                    s->free_slots = slots;
+                }
+                if (!grown || !slots) {
+                    tcp_close(sock);
+                    return;
+                }
+                s->conn_cap = next;
+            }
+            c = calloc(1, sizeof(HttpConn));
+            if (!c) {
+                tcp_close(sock);
+                return;
+            }
+            slot = s->conn_count;
+            s->conns[s->conn_count++] = c;
+        }
+        c->sock = sock;
+        c->state = HTTP_CONN_READING;
+        c->eof = c->close_after = c->head_done = c->dirty = 0;
+        c->in_len = c->start = c->scanned = c->end = 0;
+        c->last_active_ms = http_now_ms();
+        tcp_set_nodelay(sock, 1);
+        s->open_count++;
+        if (reactor_register(s->reactor, sock, REACTOR_READ | REACTOR_WRITE, slot) != 0) {
+            http_conn_close(s, slot);
+        }
+    }
+}
+
+/* Close keep-alive connections idle for longer than the timeout */
+static void http_server_sweep(HttpServer* s) {
+    int64_t now = http_now_ms();
+    for (int32_t slot = 0; slot < s->conn_count; slot++) {
+        HttpConn* c = s->conns[slot];
+        if (c->sock >= 0 && c->state == HTTP_CONN_READING && http_conn_pending(c) == 0 &&
+            now - c->last_active_ms > s->idle_timeout_ms) {
+            http_conn_close(s, slot);
+        }
+    }
+}
+
+void http_server_free(void* handle);
+
+/**
+ * Starts an HTTP server listening on address:port (see tcp_listen; "" = all
+ * interfaces, port 0 picks one). flags are extra TCP_LISTEN_* flags, e.g.
+ * TCP_LISTEN_REUSEPORT to run one server per thread on the same port.
+ *
+ * @return The server, or NULL on failure
+ */
+void* http_server_new(const char* address, int32_t port, int32_t flags) {
+    if (net_init() != 0) {
+        return NULL;
+    }
+    HttpServer* s = calloc(1, sizeof(HttpServer));
+    if (!s) {
+        return NULL;
+    }
+    s->listener = -1;
+    s->max_body = HTTP_DEFAULT_MAX_BODY;
+    s->idle_timeout_ms = HTTP_DEFAULT_IDLE_MS;
+    s->reactor = reactor_new();
+    if (!s->reactor) {
+        http_server_free(s);
+        return NULL;
+    }
+    s->listener = tcp_listen(address, port, 0, flags | TCP_LISTEN_REUSEADDR | TCP_LISTEN_NONBLOCK);
+    if (s->listener < 0 ||
+        reactor_register(s->reactor, s->listener, REACTOR_READ, HTTP_TOKEN_LISTENER) != 0 ||
+        reactor_timer_add(s->reactor, HTTP_SWEEP_MS, HTTP_SWEEP_MS, HTTP_TOKEN_SWEEP) < 0) {
+        http_server_free(s);
+        return NULL;
+    }
+    s->port = tcp_local_port(s->listener);
+    return s;
+}
+
+int32_t http_server_port(void* handle) {
+    HttpServer* s = (HttpServer*)handle;
+    return s ? s->port : -1;
+}
+
+/* Largest request body accepted (413 beyond) and keep-alive idle timeout;
+ * values <= 0 keep the current setting */
+void http_server_set_limits(void* handle, int64_t max_body, int32_t idle_timeout_ms) {
+    HttpServer* s = (HttpServer*)handle;
+    if (!s) {
+        return;
+    }
+    if (max_body > 0) {
+        s->max_body = max_body;
+    }
+    if (idle_timeout_ms > 0) {
+        s->idle_timeout_ms = idle_timeout_ms;
+    }
+}
+
+int32_t http_server_connection_count(void* handle) {
+    HttpServer* s = (HttpServer*)handle;
+    return s ? s->open_count : 0;
+}
+
+/**
+ * Sends queued responses, then waits up to timeout_ms (-1 = forever) for
+ * requests. Requests already buffered (pipelined) are returned without
+ * waiting.
+ *
+ * @return Number of requests ready (see http_server_request_id), 0 on
+ *         timeout, or -1 on error
+ */
+int32_t http_server_poll(void* handle, int32_t timeout_ms) {
+    HttpServer* s = (HttpServer*)handle;
+    if (!s) {
+        errno = EINVAL;
+        return -1;
+    }
+    s->ready_count = 0;
+    /* Connections answered since the last poll: flush, parse what's next */
+    for (int32_t i = 0; i < s->dirty_count; i++) {
+        int32_t slot = s->dirty[i];
+        s->conns[slot]->dirty = 0;
+        http_conn_progress(s, slot);
+    }
+    s->dirty_count = 0;
+
+    int32_t n = reactor_poll(s->reactor, s->ready_count > 0 ? 0 : timeout_ms);
+    if (n < 0) {
+        return s->ready_count > 0 ? s->ready_count : -1;
+    }
+    for (int32_t i = 0; i < n; i++) {
+        int64_t token = reactor_event_token(s->reactor, i);
+        if (token == HTTP_TOKEN_LISTENER) {
+            http_server_accept(s);
+        } else if (token == HTTP_TOKEN_SWEEP) {
+            http_server_sweep(s);
+        } else if (token >= 0 && token < s->conn_count && s->conns[token]->sock >= 0) {
+            if (reactor_event_flags(s->reactor, i) & REACTOR_ERROR) {
+                http_conn_close(s, (int32_t)token);
+            } else {
+                http_conn_progress(s, (int32_t)token);
+            }
+        }
+    }
+    return s->ready_count;
+}
+
+/* Id of the index-th request from the last poll (valid until answered) */
+int64_t http_server_request_id(void* handle, int32_t index) {
+    HttpServer* s = (HttpServer*)handle;
+    if (!s || index < 0 || index >= s->ready_count) {
+        return -1;
+    }
+    return s->ready[index];
+}
+
+static HttpConn* http_server_lookup(HttpServer* s, int64_t id, int32_t* slot_out) {
+    if (!s || id < 0) {
+        return NULL;
+    }
+    int32_t slot = (int32_t)(id & 0xffffffff);
+    uint32_t generation = (uint32_t)((uint64_t)id >> 32);
+    if (slot >= s->conn_count) {
+        return NULL;
+    }
+    HttpConn* c = s->conns[slot];
+    if (c->sock < 0 || c->generation != generation || c->state != HTTP_CONN_HANDLING) {
+        return NULL;
+    }
+    *slot_out = slot;
+    return c;
+}
+
+/* The request as a message (http_message_* accessors); NULL once answered.
+ * Views, body included, are valid until the response is queued. */
+void* http_server_request(void* handle, int64_t id) {
+    int32_t slot;
+    return http_server_lookup((HttpServer*)handle, id, &slot) ? &((HttpServer*)handle)->conns[slot]->msg : NULL;
+}
+
+/* The request is answered: move on to the connection's next one */
+static void http_conn_finish(HttpServer* s, int32_t slot, int keep_alive) {
+    HttpConn* c = s->conns[slot];
+    c->state = HTTP_CONN_READING;
+    c->head_done = 0;
+    c->scanned = 0;
+    c->start = c->end;
+    c->last_active_ms = http_now_ms();
+    if (!keep_alive) {
+        c->close_after = 1;
+    }
+    if (!c->dirty) {
+        c->dirty = 1;
+        if (http_push_i32(&s->dirty, &s->dirty_count, &s->dirty_cap, slot) != 0) {
+            c->dirty = 0;
+            http_conn_close(s, slot);
+        }
+    }
+}
+
+static int http_is_head_request(const HttpConn* c) {
+    return c->msg.method.len == 4 && memcmp(c->msg.method.data, "HEAD", 4) == 0;
+}
+
+/**
+ * Answers request id with status, extra header lines (e.g.
+ * "Content-Type: text/plain\r\n"; Date, Content-Length and Connection are
+ * added) and body. Nothing is sent until the next http_server_poll(), so the
+ * responses to pipelined requests leave in one write.
+ *
+ * @return 0, or -1 if id is unknown or already answered (EINVAL) or on
+ *         allocation failure
+ */
+int32_t http_server_respond(void* handle, int64_t id, int32_t status, const char* headers, int64_t headers_len,
+                            const char* body, int64_t body_len) {
+    HttpServer* s = (HttpServer*)handle;
+    int32_t slot;
+    HttpConn* c = http_server_lookup(s, id, &slot);
+    if (!c || status < 100 || status > 999 || headers_len < 0 || body_len < 0 ||
+        (headers_len > 0 && !headers) || (body_len > 0 && !body)) {
+        errno = EINVAL;
+        return -1;
+    }
+    int keep_alive = (c->msg.flags & HTTP_MSG_KEEP_ALIVE) != 0;
+    if (http_conn_queue_head(s, c, status, headers, headers_len, body_len, keep_alive) != 0 ||
+        (!http_is_head_request(c) && http_status_has_body(status) && http_conn_queue(c, body, body_len) != 0)) {
+        http_conn_close(s, slot);
+        return -1;
+    }
+    http_conn_finish(s, slot, keep_alive);
+    return 0;
+}
+
+/* Answer with an open file (taking ownership of fd) of size bytes */
+static int32_t http_conn_respond_fd(HttpServer* s, int32_t slot, int32_t status, const char* headers,
+                                    int64_t headers_len, int64_t fd, int64_t size) {
+    HttpConn* c = s->conns[slot];
+    int keep_alive = (c->msg.flags & HTTP_MSG_KEEP_ALIVE) != 0;
+    if (http_conn_queue_head(s, c, status, headers, headers_len, size, keep_alive) != 0) {
+        close((int)fd);
+        http_conn_close(s, slot);
+        return -1;
+    }
+    if (http_is_head_request(c) || size == 0 || !http_status_has_body(status)) {
+        close((int)fd);
+    } else if (http_conn_queue_file(c, fd, 0, size) != 0) {
+        close((int)fd);
+        http_conn_close(s, slot);
+        return -1;
+    }
+    http_conn_finish(s, slot, keep_alive);
+    return 0;
+}
+
+static int64_t http_open_regular(const char* path, int64_t* size, time_t* mtime) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC | O_BINARY);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (st.st_mode & S_IFMT) != S_IFREG) {
+        close(fd);
+        errno = EISDIR;
+        return -1;
+    }
+    *size = (int64_t)st.st_size;
+    if (mtime) {
+        *mtime = st.st_mtime;
+    }
+    return fd;
+}
+
+/**
+ * Answers request id with the contents of the file at path, sent with
+ * sendfile() (see tcp_send_file) rather than through userspace buffers.
+ *
+ * @return 0, or -1 with errno set when the file can't be opened (the request
+ *         is then still unanswered, e.g. for a 404) or id is unknown
+ */
+int32_t http_server_respond_file(void* handle, int64_t id, int32_t status, const char* headers,
+                                 int64_t headers_len, const char* path) {
+    HttpServer* s = (HttpServer*)handle;
+    int32_t slot;
+    if (!http_server_lookup(s, id, &slot) || !path || headers_len < 0 || (headers_len > 0 && !headers)) {
+        errno = EINVAL;
+        return -1;
+    }
+    int64_t size;
+    int64_t fd = http_open_regular(path, &size, NULL);
+    if (fd < 0) {
+        return -1;
+    }
+    return http_conn_respond_fd(s, slot, status, headers, headers_len, fd, size);
+}
+
+static const char* http_content_type(const char* path) {
+    static const char* types[][2] = {
+        { "html", "text/html; charset=utf-8" },
+        { "htm", "text/html; charset=utf-8" },
+        { "css", "text/css; charset=utf-8" },
+        { "js", "text/javascript; charset=utf-8" },
+        { "mjs", "text/javascript; charset=utf-8" },
+        { "json", "application/json" },
+        { "txt", "text/plain; charset=utf-8" },
+        { "md", "text/markdown; charset=utf-8" },
+        { "toml", "application/toml" },
+        { "xml", "application/xml" },
+        { "svg", "image/svg+xml" },
+        { "png", "image/png" },
+        { "jpg", "image/jpeg" },
+        { "jpeg", "image/jpeg" },
+        { "gif", "image/gif" },
+        { "webp", "image/webp" },
+        { "ico", "image/x-icon" },
+        { "wasm", "application/wasm" },
+        { "pdf", "application/pdf" },
+        { "woff2", "font/woff2" },
+        { "gz", "application/gzip" },
+        { "tgz", "application/gzip" },
+        { "tar", "application/x-tar" },
+        { "zip", "application/zip" },
+    };
+    const char* dot = strrchr(path, '.');
+    const char* slash = strrchr(path, '/');
+    if (dot && (!slash || dot > slash)) {
+        for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+            if (http_lower_eq(dot + 1, (int64_t)strlen(dot + 1), types[i][0])) {
+                return types[i][1];
+            }
+        }
+    }
+    return "application/octet-stream";
+}
+
+static int http_hex_value(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+/* Percent-decode the path of target under root into out; 0, or the status
+ * to answer with (400 bad escape, 404 "." / ".." segments, 414 too long) */
+static int32_t http_static_path(const char* root, String target, char* out, size_t cap) {
+    size_t n = strlen(root);
+    while (n > 1 && root[n - 1] == '/') {
+        n--;
+    }
+    if (n + 1 >= cap) {
+        return 414;
+    }
+    memcpy(out, root, n);
+    const char* t = target.data;
+    const char* end = target.data + target.len;
+    if (t == end || *t != '/') {
+        return 400;
+    }
+    size_t segment = n;
+    for (; t < end && *t != '?' && *t != '#'; t++) {
+        char ch = *t;
+        if (ch == '%') {
+            int hi = end - t > 2 ? http_hex_value(t[1]) : -1;
+            int lo = hi >= 0 ? http_hex_value(t[2]) : -1;
+            if (lo < 0) {
+                return 400;
+            }
+            ch = (char)(hi * 16 + lo);
+            if (ch == '\0') {
+                return 400;
+            }
+            t += 2;
+        }
+        if (ch == '\\') {
+            return 404;
+        }
+        if (n + 1 >= cap) {
+            return 414;
+        }
+        if (ch == '/') {
+            /* Refuse to climb out of root */
+            size_t len = n - segment;
+            if ((len == 1 && out[segment] == '.') || (len == 2 && out[segment] == '.' && out[segment + 1] == '.')) {
+                return 404;
+            }
+            segment = n + 1;
+        }
+        out[n++] = ch;
+    }
+    size_t len = n - segment;
+    if ((len == 1 && out[segment] == '.') || (len == 2 && out[segment] == '.' && out[segment + 1] == '.')) {
+        return 404;
+    }
+    out[n] = '\0';
+    return 0;
+}
+
+/**
+ * Serves request id from the directory tree at root: GET and HEAD of
+ * regular files (index.html for directories) via sendfile, with
+ * Content-Type by extension, Last-Modified and 304 for a matching
+ * If-Modified-Since. Missing files get 404, other methods 405, and paths
+ * that would leave root ("..") are refused.
+ *
+ * @return 0 once answered (errors included), -1 if id is unknown
+ */
+int32_t http_server_serve_static(void* handle, int64_t id, const char* root) {
+    HttpServer* s = (HttpServer*)handle;
+    int32_t slot;
+    HttpConn* c = http_server_lookup(s, id, &slot);
+    if (!c || !root) {
+        errno = EINVAL;
+        return -1;
+    }
+    static const char not_found[] = "Not Found\n";
+    static const char text_plain[] = "Content-Type: text/plain; charset=utf-8\r\n";
+    int is_get = c->msg.method.len == 3 && memcmp(c->msg.method.data, "GET", 3) == 0;
+    if (!is_get && !http_is_head_request(c)) {
+        static const char allow[] = "Allow: GET, HEAD\r\n";
+        return http_server_respond(s, id, 405, allow, sizeof(allow) - 1, NULL, 0);
+    }
+
+    /* Room for the index file; a path that leaves none is answered 414 */
+    static const char index_file[] = "/index.html";
+    char path[HTTP_MAX_PATH + sizeof(index_file)];
+    int32_t status = http_static_path(root, c->msg.target, path, HTTP_MAX_PATH);
+    if (status == 0) {
+        size_t len = strlen(path);
+        if (path[len - 1] == '/') {
+            if (len + sizeof(index_file) - 1 > sizeof(path)) {
+                status = 414;
+            } else {
+                memcpy(path + len, index_file + 1, sizeof(index_file) - 1);
+            }
+        }
+        struct stat st;
+        if (status == 0 && stat(path, &st) == 0 && (st.st_mode & S_IFMT) == S_IFDIR) {
+            len = strlen(path);
+            if (len + sizeof(index_file) > sizeof(path)) {
+                status = 414;
+            } else {
+                memcpy(path + len, index_file, sizeof(index_file));
+            }
+        }
+    }
+    int64_t size = 0;
+    time_t mtime = 0;
+    int64_t fd = status == 0 ? http_open_regular(path, &size, &mtime) : -1;
+    if (fd < 0) {
+        if (status == 0) {
+            status = 404;
+        }
+        const char* body = status == 404 ? not_found : http_status_text(status);
+        return http_server_respond(s, id, status, text_plain, sizeof(text_plain) - 1, body, (int64_t)strlen(body));
+    }
+
+    char modified[40];
+    http_format_date(mtime, modified, sizeof(modified));
+    String since = http_message_header(&c->msg, "if-modified-since");
+    if (since.len == (int64_t)strlen(modified) && memcmp(since.data, modified, (size_t)since.len) == 0) {
+        close((int)fd);
+        char headers[80];
+        int n = snprintf(headers, sizeof(headers), "Last-Modified: %s\r\n", modified);
+        return http_server_respond(s, id, 304, headers, n, NULL, 0);
+    }
+    char headers[160];
+    int n = snprintf(headers, sizeof(headers), "Content-Type: %s\r\nLast-Modified: %s\r\n",
+                     http_content_type(path), modified);
+    return http_conn_respond_fd(s, slot, 200, headers, n, fd, size);
+}
+
+void http_server_free(void* handle) {
+    HttpServer* s = (HttpServer*)handle;
+    if (!s) {
+        return;
+    }
+    for (int32_t slot = 0; slot < s->conn_count; slot++) {
+        http_conn_close(s, slot);
+        free(s->conns[slot]->in);
+        free(s->conns[slot]->out);
+        free(s->conns[slot]->segs);
+        free(s->conns[slot]);
+    }
+    if (s->listener >= 0) {
+        tcp_close(s->listener);
+    }
+    if (s->reactor) {
+        reactor_free(s->reactor);
+    }
+    free(s->conns);
+    free(s->free_slots);
+    free(s->ready);
+    free(s->dirty);
+    free(s);
+}
+
+/* ---- Client ---- */
+
+typedef struct {
+    int64_t sock;
+    int32_t closed;         /* The server ends the connection after the last response */
+    char host[300];         /* Host header value */
+    char* in;
+    int64_t in_len;
+    int64_t in_cap;
+    int64_t start;          /* Unconsumed input begins here */
+    char* out;
+    int64_t out_len;
+    int64_t out_cap;
+    unsigned char* pending; /* Per request in flight: 1 if it was HEAD */
+    int32_t pending_first;
+    int32_t pending_count;
+    int32_t pending_cap;
+    int64_t max_body;
+    HttpChunked chunked;
+    HttpMessage msg;
+} HttpClient;
+
+/* Connect to address:port (numeric IPv4, see tcp_connect); NULL on failure */
+void* http_client_connect(const char* address, int32_t port) {
+    if (!address || net_init() != 0) {
+        return NULL;
+    }
+    HttpClient* c = calloc(1, sizeof(HttpClient));
+    if (!c) {
+        return NULL;
+    }
+    c->sock = tcp_connect(address, port);
+    if (c->sock < 0) {
+        free(c);
+        return NULL;
+    }
+    tcp_set_nodelay(c->sock, 1);
+    c->max_body = HTTP_DEFAULT_MAX_BODY * 64;
+    snprintf(c->host, sizeof(c->host), port == 80 ? "%s" : "%s:%d", address, port);
+    return c;
+}
+
+/* Largest response body accepted (EMSGSIZE beyond); <= 0 keeps the current */
+void http_client_set_max_body(void* handle, int64_t max_body) {
+    HttpClient* c = (HttpClient*)handle;
+    if (c && max_body > 0) {
+        c->max_body = max_body;
+    }
+}
+
+/**
+ * Sends one request. Host is added unless headers has one, and
+ * Content-Length whenever there is a body (or the method is POST, PUT or
+ * PATCH). Several requests may be sent before reading their responses.
+ *
+ * @return 0, or -1 on error (ENOTCONN once the server closed the connection)
+ */
+int32_t http_client_send(void* handle, const char* method, const char* target, const char* headers,
+                         int64_t headers_len, const char* body, int64_t body_len) {
+    HttpClient* c = (HttpClient*)handle;
+    if (!c || !method || !target || headers_len < 0 || body_len < 0 ||
+        (headers_len > 0 && !headers) || (body_len > 0 && !body)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (c->closed) {
+        errno = ENOTCONN;
+        return -1;
+    }
+    if (c->pending_count == c->pending_cap) {
+        int32_t next = c->pending_cap ? c->pending_cap * 2 : 16;
+        unsigned char* grown = malloc((size_t)next);
+        if (!grown) {
+            return -1;
+        }
+        for (int32_t i = 0; i < c->pending_count; i++) {
+            grown[i] = c->pending[(c->pending_first + i) % c->pending_cap];
+        }
+        free(c->pending);
+        c->pending = grown;
+        c->pending_first = 0;
+        c->pending_cap = next;
+    }
+
+    char line[400];
+    c->out_len = 0;
+    int is_head = strcmp(method, "HEAD") == 0;
+    int wants_length = body_len > 0 || strcmp(method, "POST") == 0 || strcmp(method, "PUT") == 0 ||
+                       strcmp(method, "PATCH") == 0;
+    if (http_append(&c->out, &c->out_len, &c->out_cap, method, (int64_t)strlen(method)) != 0 ||
+        http_append(&c->out, &c->out_len, &c->out_cap, " ", 1) != 0 ||
+        http_append(&c->out, &c->out_len, &c->out_cap, target, (int64_t)strlen(target)) != 0 ||
+        http_append(&c->out, &c->out_len, &c->out_cap, " HTTP/1.1\r\n", 11) != 0) {
+        return -1;
+    }
+    int n = 0;
+    if (!http_headers_have(headers, headers_len, "host")) {
+        n = snprintf(line, sizeof(line), "Host: %s\r\n", c->host);
+    }
+    if (http_append(&c->out, &c->out_len, &c->out_cap, line, n) != 0 ||
+        http_append_headers(&c->out, &c->out_len, &c->out_cap, headers, headers_len) != 0) {
+        return -1;
+    }
+    n = wants_length ? snprintf(line, sizeof(line), "Content-Length: %lld\r\n\r\n", (long long)body_len)
+                     : snprintf(line, sizeof(line), "\r\n");
+    if (http_append(&c->out, &c->out_len, &c->out_cap, line, n) != 0) {
+        return -1;
+    }
+    /* Small bodies ride along in the same write */
+    if (body_len > 0 && body_len <= HTTP_READ_CHUNK * 4) {
+        if (http_append(&c->out, &c->out_len, &c->out_cap, body, body_len) != 0) {
+            return -1;
+        }
+        body_len = 0;
+    }
+
+    int32_t status;
+    if (tcp_send_all64(c->sock, c->out, c->out_len, -1, &status) != c->out_len ||
+        (body_len > 0 && tcp_send_all64(c->sock, body, body_len, -1, &status) != body_len)) {
+        errno = status > 0 ? status : EPIPE;
+        c->closed = 1;
+        return -1;
+    }
+    c->pending[(c->pending_first + c->pending_count) % c->pending_cap] = (unsigned char)is_head;
+    c->pending_count++;
+    return 0;
+}
+
+/* Read more response bytes, waiting until deadline_ms (< 0: forever).
+ * Returns bytes read, 0 on EOF or -1 (ETIMEDOUT on timeout). */
+static int64_t http_client_fill(HttpClient* c, int64_t deadline_ms) {
+    if (http_grow(&c->in, &c->in_cap, c->in_len + HTTP_READ_CHUNK, &c->msg) != 0) {
+        return -1;
+    }
+    for (;;) {
+        if (deadline_ms >= 0) {
+            int64_t left = deadline_ms - http_now_ms();
+            if (left <= 0) {
+                errno = ETIMEDOUT;
+                return -1;
+            }
+#ifdef _WIN32
+            WSAPOLLFD pfd;
+            pfd.fd = (SOCKET)c->sock;
+            pfd.events = POLLRDNORM;
+            pfd.revents = 0;
+            int ready = WSAPoll(&pfd, 1, (int)left);
+#else
+            struct pollfd pfd = { (int)c->sock, POLLIN, 0 };
+            int ready = poll(&pfd, 1, (int)left);
+            if (ready < 0 && errno == EINTR) {
+                continue;
+            }
+#endif
+            if (ready < 0) {
+                return -1;
+            }
+            if (ready == 0) {
+                continue;
+            }
+        }
+        int64_t n = tcp_try_recv(c->sock, c->in + c->in_len, c->in_cap - c->in_len);
+        if (n == TCP_WOULD_BLOCK) {
+            continue;
+        }
+        if (n > 0) {
+            c->in_len += n;
+        }
+        return n;
+    }
+}
+
+/**
+ * Reads the response to the oldest request sent and not yet answered,
+ * waiting up to timeout_ms (< 0: forever). Interim 1xx responses are
+ * skipped. The message (http_message_* accessors, body included) is valid
+ * until the next call.
+ *
+ * @return The response, or NULL on error: ETIMEDOUT, ECONNRESET if the
+ *         connection closed early, EPROTO for a malformed response,
+ *         EMSGSIZE for a body over the limit, EINVAL if nothing is pending
+ */
+void* http_client_response(void* handle, int32_t timeout_ms) {
+    HttpClient* c = (HttpClient*)handle;
+    if (!c || c->pending_count == 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    int64_t deadline = timeout_ms >= 0 ? http_now_ms() + timeout_ms : -1;
+    /* The previous response is done with: drop it */
+    memset(&c->msg, 0, offsetof(HttpMessage, headers));
+    if (c->start > 0) {
+        memmove(c->in, c->in + c->start, (size_t)(c->in_len - c->start));
+        c->in_len -= c->start;
+        c->start = 0;
+    }
+
+    int64_t scanned = 0;
+    for (;;) {
+        int64_t r = http_parse(&c->msg, c->in + c->start, c->in_len - c->start, scanned, 0);
+        if (r >= 0 && c->msg.status >= 100 && c->msg.status < 200 && c->msg.status != 101) {
+            c->start += r;   /* Interim response (100 Continue): the real one follows */
+            scanned = 0;
+            continue;
+        }
+        if (r >= 0) {
+            break;
+        }
+        if (r != HTTP_INCOMPLETE) {
+            c->closed = 1;
+            return NULL;
+        }
+        scanned = c->in_len - c->start;
+        int64_t n = http_client_fill(c, deadline);
+        if (n <= 0) {
+            if (n == 0) {
+                errno = ECONNRESET;
+            }
+            c->closed = 1;
+            return NULL;
+        }
+    }
+
+    int is_head = c->pending[c->pending_first];
+    c->pending_first = (c->pending_first + 1) % c->pending_cap;
+    c->pending_count--;
+
+    int64_t body_start = c->start + c->msg.head_len;
+    int64_t body_len = 0;
+    if (is_head || !http_status_has_body(c->msg.status)) {
+        body_len = 0;
+    } else if (c->msg.flags & HTTP_MSG_CHUNKED) {
+        http_chunked_reset(&c->chunked);
+        for (;;) {
+            int64_t n = c->in_len - (body_start + body_len);
+            int64_t rest = http_chunked_decode(&c->chunked, c->in + body_start + body_len, &n);
+            body_len += n;
+            if (rest == -1 || body_len > c->max_body) {
+                errno = rest == -1 ? EPROTO : EMSGSIZE;
+                c->closed = 1;
+                return NULL;
+            }
+            if (rest >= 0) {
+                c->in_len = body_start + body_len + rest;
+                break;
+            }
+            c->in_len = body_start + body_len;
+            n = http_client_fill(c, deadline);
+            if (n <= 0) {
+                if (n == 0) {
+                    errno = ECONNRESET;
+                }
+                c->closed = 1;
+                return NULL;
+            }
+        }
+    } else if (c->msg.content_length >= 0) {
+        body_len = c->msg.content_length;
+        if (body_len > c->max_body) {
+            errno = EMSGSIZE;
+            c->closed = 1;
+            return NULL;
+        }
+        if (http_grow(&c->in, &c->in_cap, body_start + body_len, &c->msg) != 0) {
+            return NULL;
+        }
+        while (c->in_len - body_start < body_len) {
+            int64_t n = http_client_fill(c, deadline);
+            if (n <= 0) {
+                if (n == 0) {
+                    errno = ECONNRESET;
+                }
+                c->closed = 1;
+                return NULL;
+            }
+        }
+    } else {
+        /* No length: the body runs until the server closes */
+        c->msg.flags &= ~HTTP_MSG_KEEP_ALIVE;
+        for (;;) {
+            int64_t n = http_client_fill(c, deadline);
+            if (n == 0) {
+                break;
+            }
+            if (n < 0 || c->in_len - body_start > c->max_body) {
+                if (n > 0) {
+                    errno = EMSGSIZE;
+                }
+                c->closed = 1;
+                return NULL;
+            }
+        }
+        body_len = c->in_len - body_start;
+    }
+    c->msg.body.data = c->in + body_start;
+    c->msg.body.len = body_len;
+    c->start = body_start + body_len;
+    if (!(c->msg.flags & HTTP_MSG_KEEP_ALIVE)) {
+        c->closed = 1;
+    }
+    return &c->msg;
+}
+
+/* Requests sent whose responses have not been read yet */
+int32_t http_client_pending(void* handle) {
+    HttpClient* c = (HttpClient*)handle;
+    return c ? c->pending_count : 0;
+}
+
+/* Whether the connection can take more requests */
+int32_t http_client_is_open(void* handle) {
+    HttpClient* c = (HttpClient*)handle;
+    return c && !c->closed;
+}
+
+void http_client_close(void* handle) {
+    HttpClient* c = (HttpClient*)handle;
+    if (!c) {
+        return;
+    }
+    tcp_close(c->sock);
+    free(c->in);
+    free(c->out);
+    free(c->pending);
+    free(c);
+}
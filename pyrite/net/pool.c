@@ -0,0 +1,639 @@
+/* TCP client connection pool in C for Pyrite standard library
+ *
+ * Keeps established connections per (address, port) so repeated requests to
+ * the same backend skip socket setup and the TCP handshake:
+ *
+ * - idle reuse: released connections wait in a per-host LIFO stack (the most
+ *   recently used one is the likeliest to still be warm) until idle_timeout
+ * - health check: an idle connection is only handed out if the peer has not
+ *   closed it and sent nothing unsolicited (one zero-timeout poll)
+ * - max_per_host: caps open connections (idle + in use + connecting) per host
+ * - fair waiting: when a host is at its cap, acquirers queue FIFO and every
+ *   freed slot or connection is handed straight to the oldest waiter, so a
+ *   newcomer can never overtake a thread that has been waiting longer
+ *
+ * The pool is thread-safe. Connections are plain blocking TcpStream sockets
+ * with the pool's socket options applied once, when they are created: buffer
+ * sizes before connect() (the receive buffer fixes the window scale sent in
+ * the SYN), TCP_NODELAY and keepalive right after. Per-read options such as
+ * TCP_QUICKACK, which the kernel clears again on its own, are left to the
+ * caller (TcpStream.set_quickack after each receive).
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <poll.h>
+#include <time.h>
+#endif
+
+/* tcp_pool_set_options() flags (match pool.pyrite) */
+#define TCP_POOL_NODELAY 1
+#define TCP_POOL_KEEPALIVE 2
+
+#define TCP_POOL_DEFAULT_MAX_PER_HOST 16
+#define TCP_POOL_DEFAULT_IDLE_TIMEOUT_MS 60000
+
+/* From socket.c */
+extern int32_t net_init();
+extern int64_t tcp_connect_with_buffers(const char* address, int32_t port, int32_t send_bytes, int32_t recv_bytes);
+extern void tcp_close(int64_t sock);
+extern int32_t tcp_set_nodelay(int64_t sock, int32_t enabled);
+extern int32_t tcp_set_keepalive(int64_t sock, int32_t enabled, int32_t idle_s, int32_t interval_s, int32_t count);
+
+#ifdef _WIN32
+typedef SRWLOCK PoolMutex;
+typedef CONDITION_VARIABLE PoolCond;
+#define pool_mutex_init(m) InitializeSRWLock(m)
+#define pool_mutex_destroy(m) ((void)(m))
+#define pool_lock(m) AcquireSRWLockExclusive(m)
+#define pool_unlock(m) ReleaseSRWLockExclusive(m)
+#define pool_cond_init(c) InitializeConditionVariable(c)
+#define pool_cond_destroy(c) ((void)(c))
+#define pool_cond_signal(c) WakeConditionVariable(c)
+#else
+typedef pthread_mutex_t PoolMutex;
+typedef pthread_cond_t PoolCond;
+#define pool_mutex_init(m) pthread_mutex_init(m, NULL)
+#define pool_mutex_destroy(m) pthread_mutex_destroy(m)
+#define pool_lock(m) pthread_mutex_lock(m)
+#define pool_unlock(m) pthread_mutex_unlock(m)
+#define pool_cond_init(c) pthread_cond_init(c, NULL)
+#define pool_cond_destroy(c) pthread_cond_destroy(c)
+#define pool_cond_signal(c) pthread_cond_signal(c)
+#endif
+
+typedef struct {
+    int64_t sock;
+    int64_t since_ms;   /* When it went idle */
+} PoolIdle;
+
+/* A thread blocked in tcp_pool_acquire(); lives on that thread's stack */
+typedef struct PoolWaiter {
+    PoolCond cond;
+    int granted;        /* Owns a slot now */
+    int64_t sock;       /* Handed-over connection, or -1: connect yourself */
+    struct PoolWaiter* next;
+} PoolWaiter;
+
+typedef struct PoolHost {
+    char* address;
+    int32_t port;
+    int32_t open;       /* Idle + in use + connecting, capped by max_per_host */
+    PoolIdle* idle;
+    int32_t idle_count;
+    PoolWaiter* wait_head;
+    PoolWaiter* wait_tail;
+    int32_t waiting;
+    struct PoolHost* next;
+} PoolHost;
+
+/* In-use connection -> host, open addressing */
+typedef struct {
+    int64_t sock;       /* -1 = empty */
+    PoolHost* host;
+} PoolLease;
+
+typedef struct {
+    PoolMutex lock;
+    PoolHost* hosts;
+    PoolLease* leases;
+    int64_t lease_capacity;     /* Power of two */
+    int64_t lease_count;
+    int32_t max_per_host;
+    int32_t max_idle_per_host;
+    int64_t idle_timeout_ms;
+    int32_t option_flags;
+    int32_t keepalive_idle_s;
+    int32_t keepalive_interval_s;
+    int32_t keepalive_count;
+    int32_t send_buffer;
+    int32_t recv_buffer;
+} ConnectionPool;
+
+static int64_t pool_now_ms() {
+#ifdef _WIN32
+    return (int64_t)GetTickCount64();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#endif
+}
+
+/* Wait up to timeout_ms (< 0: forever); spurious wakeups are fine */
+static void pool_cond_wait(PoolCond* cond, PoolMutex* lock, int64_t timeout_ms) {
+#ifdef _WIN32
+    SleepConditionVariableSRW(cond, lock, timeout_ms < 0 ? INFINITE : (DWORD)timeout_ms, 0);
+#else
+    if (timeout_ms < 0) {
+        pthread_cond_wait(cond, lock);
+        return;
+    }
+    /* Condition variables time out against CLOCK_REALTIME by default */
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    pthread_cond_timedwait(cond, lock, &deadline);
+#endif
+}
+
+/* Still usable: not closed by the peer and nothing unsolicited to read */
+static int pool_connection_alive(int64_t sock) {
+#ifdef _WIN32
+    WSAPOLLFD pfd;
+    pfd.fd = (SOCKET)sock;
+    pfd.events = POLLRDNORM;
+    pfd.revents = 0;
+    return WSAPoll(&pfd, 1, 0) == 0;
+#else
+    struct pollfd pfd;
+    pfd.fd = (int)sock;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    int ready;
+    do {
+        ready = poll(&pfd, 1, 0);
+    } while (ready < 0 && errno == EINTR);
+    return ready == 0;
+#endif
+}
+
+/* ---- Leases ---- */
+
+static uint64_t pool_hash(int64_t sock) {
+    uint64_t h = (uint64_t)sock * 0x9e3779b97f4a7c15ULL;
+    return h ^ (h >> 29);
+}
+
+static int pool_lease_add(ConnectionPool* pool, int64_t sock, PoolHost* host) {
+    if ((pool->lease_count + 1) * 2 > pool->lease_capacity) {
+        int64_t new_capacity = pool->lease_capacity ? pool->lease_capacity * 2 : 64;
+        PoolLease* leases = malloc((size_t)new_capacity * sizeof(PoolLease));
+        if (!leases) {
+            return 0;
+        }
+        for (int64_t i = 0; i < new_capacity; i++) {
+            leases[i].sock = -1;
+        }
+        for (int64_t i = 0; i < pool->lease_capacity; i++) {
+            if (pool->leases[i].sock < 0) {
+                continue;
+            }
+            uint64_t j = pool_hash(pool->leases[i].sock) & (uint64_t)(new_capacity - 1);
+            while (leases[j].sock >= 0) {
+                j = (j + 1) & (uint64_t)(new_capacity - 1);
+            }
+            leases[j] = pool->leases[i];
+        }
+        free(pool->leases);
+        pool->leases = leases;
+        pool->lease_capacity = new_capacity;
+    }
+    uint64_t mask = (uint64_t)(pool->lease_capacity - 1);
+    uint64_t i = pool_hash(sock) & mask;
+    while (pool->leases[i].sock >= 0) {
+        i = (i + 1) & mask;
+    }
+    pool->leases[i].sock = sock;
+    pool->leases[i].host = host;
+    pool->lease_count++;
+    return 1;
+}
+
+static PoolHost* pool_lease_remove(ConnectionPool* pool, int64_t sock) {
+    if (pool->lease_capacity == 0) {
+        return NULL;
+    }
+    uint64_t mask = (uint64_t)(pool->lease_capacity - 1);
+    uint64_t i = pool_hash(sock) & mask;
+    while (pool->leases[i].sock != sock) {
+        if (pool->leases[i].sock < 0) {
+            return NULL;
+        }
+        i = (i + 1) & mask;
+    }
+    PoolHost* host = pool->leases[i].host;
+    pool->leases[i].sock = -1;
+    pool->lease_count--;
+    /* Backward-shift deletion keeps probe chains intact without tombstones */
+    uint64_t hole = i;
+    for (uint64_t j = (i + 1) & mask; pool->leases[j].sock >= 0; j = (j + 1) & mask) {
+        uint64_t home = pool_hash(pool->leases[j].sock) & mask;
+        if (((j - home) & mask) >= ((j - hole) & mask)) {
+            pool->leases[hole] = pool->leases[j];
+            pool->leases[j].sock = -1;
+            hole = j;
+        }
+    }
+    return host;
+}
+
+/* ---- Hosts ---- */
+
+static PoolHost* pool_find_host(ConnectionPool* pool, const char* address, int32_t port) {
+    for (PoolHost* host = pool->hosts; host; host = host->next) {
+        if (host->port == port && strcmp(host->address, address) == 0) {
+            return host;
+        }
+    }
+    return NULL;
+}
+
+static PoolHost* pool_get_host(ConnectionPool* pool, const char* address, int32_t port) {
+    PoolHost* host = pool_find_host(pool, address, port);
+    if (host) {
+        return host;
+    }
+    host = calloc(1, sizeof(PoolHost));
+    if (!host) {
+        return NULL;
+    }
+    size_t len = strlen(address);
+    host->address = malloc(len + 1);
+    host->idle = malloc((size_t)(pool->max_idle_per_host > 0 ? pool->max_idle_per_host : 1) * sizeof(PoolIdle));
+    if (!host->address || !host->idle) {
+        free(host->address);
+        free(host->idle);
+        free(host);
+        return NULL;
+    }
+    memcpy(host->address, address, len + 1);
+    host->port = port;
+    host->next = pool->hosts;
+    pool->hosts = host;
+    return host;
+}
+
+/* Pass a freed slot (and maybe a connection) to the oldest waiter.
+ * Returns 1 if a waiter took it. Caller holds the lock. */
+static int pool_hand_over(PoolHost* host, int64_t sock) {
+    PoolWaiter* waiter = host->wait_head;
+    if (!waiter) {
+        return 0;
+    }
+    host->wait_head = waiter->next;
+    if (!host->wait_head) {
+        host->wait_tail = NULL;
+    }
+    host->waiting--;
+    waiter->granted = 1;
+    waiter->sock = sock;
+    pool_cond_signal(&waiter->cond);
+    return 1;
+}
+
+/* A slot is free again (connection closed or connect failed) */
+static void pool_release_slot(PoolHost* host) {
+    if (!pool_hand_over(host, -1)) {
+        host->open--;
+    }
+}
+
+static void pool_apply_options(ConnectionPool* pool, int64_t sock) {
+    if (pool->option_flags & TCP_POOL_NODELAY) {
+        tcp_set_nodelay(sock, 1);
+    }
+    if (pool->option_flags & TCP_POOL_KEEPALIVE) {
+        tcp_set_keepalive(sock, 1, pool->keepalive_idle_s, pool->keepalive_interval_s, pool->keepalive_count);
+    }
+}
+
+/* ---- Public API ---- */
+
+/**
+ * Creates a pool. max_per_host caps open connections per (address, port)
+ * (<= 0: 16), max_idle_per_host caps how many are kept for reuse (< 0: same
+ * as max_per_host) and idle_timeout_ms closes connections idle longer than
+ * that (<= 0: 60 s). Returns NULL on failure.
+ */
+void* tcp_pool_new(int32_t max_per_host, int32_t max_idle_per_host, int64_t idle_timeout_ms) {
+    if (net_init() != 0) {
+        return NULL;
+    }
+    ConnectionPool* pool = calloc(1, sizeof(ConnectionPool));
+    if (!pool) {
+        return NULL;
+    }
+    pool->max_per_host = max_per_host > 0 ? max_per_host : TCP_POOL_DEFAULT_MAX_PER_HOST;
+    pool->max_idle_per_host = max_idle_per_host < 0 ? pool->max_per_host : max_idle_per_host;
+    if (pool->max_idle_per_host > pool->max_per_host) {
+        pool->max_idle_per_host = pool->max_per_host;
+    }
+    pool->idle_timeout_ms = idle_timeout_ms > 0 ? idle_timeout_ms : TCP_POOL_DEFAULT_IDLE_TIMEOUT_MS;
+    pool_mutex_init(&pool->lock);
+    return pool;
+}
+
+/**
+ * Socket options for connections the pool creates from now on: flags is a
+ * mix of TCP_POOL_NODELAY / TCP_POOL_KEEPALIVE; the
+ * keepalive values and buffer sizes follow tcp_set_keepalive() and
+ * tcp_set_buffer_sizes() (<= 0 keeps the default).
+ */
+void tcp_pool_set_options(void* handle, int32_t flags, int32_t keepalive_idle_s, int32_t keepalive_interval_s,
+                          int32_t keepalive_count, int32_t send_buffer, int32_t recv_buffer) {
+    ConnectionPool* pool = (ConnectionPool*)handle;
+    if (!pool) {
+        return;
+    }
+    pool_lock(&pool->lock);
+    pool->option_flags = flags;
+    pool->keepalive_idle_s = keepalive_idle_s;
+    pool->keepalive_interval_s = keepalive_interval_s;
+    pool->keepalive_count = keepalive_count;
+    pool->send_buffer = send_buffer;
+    pool->recv_buffer = recv_buffer;
+    pool_unlock(&pool->lock);
+}
+
+/**
+ * Checks out a connection to address:port: a healthy idle one if there is
+ * one, else a new one if the host is below max_per_host, else waits (FIFO)
+ * up to timeout_ms for one to be released (< 0: forever, 0: don't wait).
+ * Give it back with tcp_pool_release().
+ *
+ * @return The socket, or -1 (errno ETIMEDOUT if no connection freed up in
+ *         time, otherwise the connect error)
+ */
+int64_t tcp_pool_acquire(void* handle, const char* address, int32_t port, int64_t timeout_ms) {
+    ConnectionPool* pool = (ConnectionPool*)handle;
+    if (!pool || !address) {
+        errno = EINVAL;
+        return -1;
+    }
+    int64_t deadline = timeout_ms > 0 ? pool_now_ms() + timeout_ms : 0;
+
+    pool_lock(&pool->lock);
+    PoolHost* host = pool_get_host(pool, address, port);
+    if (!host) {
+        pool_unlock(&pool->lock);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    int64_t sock = -1;
+    for (;;) {
+        /* Idle connections, most recently used first */
+        int64_t now = pool_now_ms();
+        while (host->idle_count > 0) {
+            PoolIdle idle = host->idle[--host->idle_count];
+            if (now - idle.since_ms <= pool->idle_timeout_ms) {
+                sock = idle.sock;
+                break;
+            }
+            pool_release_slot(host);
+            pool_unlock(&pool->lock);
+            tcp_close(idle.sock);
+            pool_lock(&pool->lock);
+        }
+        if (sock >= 0) {
+            /* The slot is ours while we check it */
+            pool_unlock(&pool->lock);
+            if (pool_connection_alive(sock)) {
+                break;
+            }
+            tcp_close(sock);
+            sock = -1;
+            goto connect;
+        }
+        if (host->open < pool->max_per_host && !host->wait_head) {
+            host->open++;
+            pool_unlock(&pool->lock);
+            goto connect;
+        }
+        if (timeout_ms == 0) {
+            pool_unlock(&pool->lock);
+            errno = ETIMEDOUT;
+            return -1;
+        }
+
+        /* At the cap: queue up and wait for a hand-over */
+        PoolWaiter waiter;
+        pool_cond_init(&waiter.cond);
+        waiter.granted = 0;
+        waiter.sock = -1;
+        waiter.next = NULL;
+        if (host->wait_tail) {
+            host->wait_tail->next = &waiter;
+        } else {
+            host->wait_head = &waiter;
+        }
+        host->wait_tail = &waiter;
+        host->waiting++;
+        while (!waiter.granted) {
+            int64_t remaining = -1;
+            if (timeout_ms > 0) {
+                remaining = deadline - pool_now_ms();
+                if (remaining <= 0) {
+                    break;
+                }
+            }
+            pool_cond_wait(&waiter.cond, &pool->lock, remaining);
+        }
+        pool_cond_destroy(&waiter.cond);
+        if (!waiter.granted) {
+            /* Timed out: leave the queue */
+            PoolWaiter** link = &host->wait_head;
+            PoolWaiter* prev = NULL;
+            while (*link != &waiter) {
+                prev = *link;
+                link = &(*link)->next;
+            }
+            *link = waiter.next;
+            if (host->wait_tail == &waiter) {
+                host->wait_tail = prev;
+            }
+            host->waiting--;
+            pool_unlock(&pool->lock);
+            errno = ETIMEDOUT;
+            return -1;
+        }
+        pool_unlock(&pool->lock);
+        if (waiter.sock >= 0) {
+            sock = waiter.sock;   /* Just released by its previous user */
+            break;
+        }
+        goto connect;
+    }
+
+    pool_lock(&pool->lock);
+    if (!pool_lease_add(pool, sock, host)) {
+        pool_release_slot(host);
+        pool_unlock(&pool->lock);
+        tcp_close(sock);
+        errno = ENOMEM;
+        return -1;
+    }
+    pool_unlock(&pool->lock);
+    return sock;
+
+connect:
+    /* We hold a slot (host->open counts us) without the lock */
+    pool_lock(&pool->lock);
+    int32_t send_buffer = pool->send_buffer;
+    int32_t recv_buffer = pool->recv_buffer;
+    pool_unlock(&pool->lock);
+    sock = tcp_connect_with_buffers(address, port, send_buffer, recv_buffer);
+    pool_lock(&pool->lock);
+    if (sock < 0) {
+        int error = errno;
+        pool_release_slot(host);
+        pool_unlock(&pool->lock);
+        errno = error;
+        return -1;
+    }
+    if (!pool_lease_add(pool, sock, host)) {
+        pool_release_slot(host);
+        pool_unlock(&pool->lock);
+        tcp_close(sock);
+        errno = ENOMEM;
+        return -1;
+    }
+    pool_unlock(&pool->lock);
+    pool_apply_options(pool, sock);
+    return sock;
+}
+
+/**
+ * Returns a connection from tcp_pool_acquire(). Pass reusable = 0 when its
+ * protocol state is unknown (error, half-read response): it is closed
+ * instead of being kept. Sockets the pool did not hand out are just closed.
+ */
+void tcp_pool_release(void* handle, int64_t sock, int32_t reusable) {
+    ConnectionPool* pool = (ConnectionPool*)handle;
+    if (!pool || sock < 0) {
+        return;
+    }
+    pool_lock(&pool->lock);
+    PoolHost* host = pool_lease_remove(pool, sock);
+    if (!host) {
+        pool_unlock(&pool->lock);
+        tcp_close(sock);
+        return;
+    }
+    if (reusable && pool_hand_over(host, sock)) {
+        pool_unlock(&pool->lock);
+        return;
+    }
+    if (reusable && host->idle_count < pool->max_idle_per_host) {
+        host->idle[host->idle_count].sock = sock;
+        host->idle[host->idle_count].since_ms = pool_now_ms();
+        host->idle_count++;
+        pool_unlock(&pool->lock);
+        return;
+    }
+    pool_release_slot(host);
+    pool_unlock(&pool->lock);
+    tcp_close(sock);
+}
+
+/* Idle connections kept for address:port */
+int32_t tcp_pool_idle_count(void* handle, const char* address, int32_t port) {
+    ConnectionPool* pool = (ConnectionPool*)handle;
+    if (!pool || !address) {
+        return 0;
+    }
+    pool_lock(&pool->lock);
+    PoolHost* host = pool_find_host(pool, address, port);
+    int32_t count = host ? host->idle_count : 0;
+    pool_unlock(&pool->lock);
+    return count;
+}
+
+/* Connections to address:port that are checked out or being opened */
+int32_t tcp_pool_active_count(void* handle, const char* address, int32_t port) {
+    ConnectionPool* pool = (ConnectionPool*)handle;
+    if (!pool || !address) {
+        return 0;
+    }
+    pool_lock(&pool->lock);
+    PoolHost* host = pool_find_host(pool, address, port);
+    int32_t count = host ? host->open - host->idle_count : 0;
+    pool_unlock(&pool->lock);
+    return count;
+}
+
+/* Threads waiting in tcp_pool_acquire() for address:port */
+int32_t tcp_pool_waiting(void* handle, const char* address, int32_t port) {
+    ConnectionPool* pool = (ConnectionPool*)handle;
+    if (!pool || !address) {
+        return 0;
+    }
+    pool_lock(&pool->lock);
+    PoolHost* host = pool_find_host(pool, address, port);
+    int32_t count = host ? host->waiting : 0;
+    pool_unlock(&pool->lock);
+    return count;
+}
+
+/**
+ * Closes idle connections past the idle timeout or found dead (also done
+ * lazily by tcp_pool_acquire(); call this periodically to free sockets for
+ * hosts that are no longer used). Returns the number closed.
+ */
+int32_t tcp_pool_prune(void* handle) {
+    ConnectionPool* pool = (ConnectionPool*)handle;
+    if (!pool) {
+        return 0;
+    }
+    int32_t closed = 0;
+    pool_lock(&pool->lock);
+    int64_t now = pool_now_ms();
+    for (PoolHost* host = pool->hosts; host; host = host->next) {
+        int32_t kept = 0;
+        for (int32_t i = 0; i < host->idle_count; i++) {
+            PoolIdle idle = host->idle[i];
+            if (now - idle.since_ms <= pool->idle_timeout_ms && pool_connection_alive(idle.sock)) {
+                host->idle[kept++] = idle;
+                continue;
+            }
+            tcp_close(idle.sock);
+            pool_release_slot(host);
+            closed++;
+        }
+        host->idle_count = kept;
+    }
+    pool_unlock(&pool->lock);
+    return closed;
+}
+
+/* Close idle connections and free the pool. Release or close checked-out
+ * connections first; nobody may be waiting in tcp_pool_acquire(). */
+void tcp_pool_free(void* handle) {
+    ConnectionPool* pool = (ConnectionPool*)handle;
+    if (!pool) {
+        return;
+    }
+    PoolHost* host = pool->hosts;
+    while (host) {
+        PoolHost* next = host->next;
+        for (int32_t i = 0; i < host->idle_count; i++) {
+            tcp_close(host->idle[i].sock);
+        }
+        free(host->idle);
+        free(host->address);
+        free(host);
+        host = next;
+    }
+    free(pool->leases);
+    pool_mutex_destroy(&pool->lock);
+    free(pool);
+}
@@ -0,0 +1,611 @@
+/* Readiness reactor (event loop) in C for Pyrite standard library
+ *
+ * One thread multiplexes any number of nonblocking sockets and timers:
+ *
+ * - Linux: epoll in edge-triggered mode. A readiness event is reported once
+ *   per transition, so callers must drain a socket (tcp_try_recv /
+ *   tcp_try_send until they return TCP_WOULD_BLOCK) before polling again.
+ *   Registration costs O(1) and poll costs O(ready), which is what makes
+ *   10k+ idle connections on one thread cheap.
+ * - Timers: a binary min-heap of deadlines. On Linux a single timerfd is
+ *   armed to the earliest deadline, so timers wake epoll_wait with nanosecond
+ *   resolution and never need an fd each.
+ * - Elsewhere: a poll()/WSAPoll() fallback with the same API. It is
+ *   level-triggered, which is a superset of edge-triggered behaviour for
+ *   callers that drain, and timers clamp the poll timeout instead.
+ *
+ * Every registration carries a caller-chosen 64-bit token that comes back
+ * with its events. Token -1 (all ones) is reserved for the reactor itself.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <limits.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <time.h>
+#include <poll.h>
+#endif
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#define REACTOR_EPOLL 1
+#endif
+
+/* Interest / event flags (match reactor.pyrite) */
+#define REACTOR_READ 1
+#define REACTOR_WRITE 2
+#define REACTOR_HUP 4
+#define REACTOR_ERROR 8
+#define REACTOR_TIMER 16
+
+#define REACTOR_MAX_EVENTS 1024
+#define REACTOR_INTERNAL_TOKEN UINT64_MAX
+
+typedef struct {
+    uint64_t token;
+    int32_t flags;
+} ReactorEvent;
+
+typedef struct {
+    uint64_t deadline_ns;
+    uint64_t interval_ns;   /* 0 = one-shot */
+    uint64_t token;
+    uint32_t generation;    /* Bumped on free so stale ids are rejected */
+    int32_t heap_index;     /* -1 when the slot is free */
+} ReactorTimer;
+
+typedef struct {
+#ifdef REACTOR_EPOLL
+    int epfd;
+    int timerfd;
+    uint64_t armed_ns;      /* Deadline the timerfd is armed for (0 = disarmed) */
+    struct epoll_event raw[REACTOR_MAX_EVENTS];
+#else
+#ifdef _WIN32
+    WSAPOLLFD* fds;
+#else
+    struct pollfd* fds;
+#endif
+    uint64_t* tokens;
+    int64_t fd_count;
+    int64_t fd_capacity;
+#endif
+    ReactorEvent* events;
+    int32_t event_count;
+    int32_t event_capacity;
+
+    ReactorTimer* timers;
+    int32_t timer_capacity;
+    int32_t* free_slots;
+    int32_t free_count;
+    int32_t* heap;          /* Timer slots ordered by deadline */
+    int32_t heap_len;
+} Reactor;
+
+static uint64_t reactor_now_ns() {
+#ifdef _WIN32
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+    if (freq.QuadPart == 0) {
+        QueryPerformanceFrequency(&freq);
+    }
+    QueryPerformanceCounter(&now);
+    return (uint64_t)((double)now.QuadPart * 1e9 / (double)freq.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+static int reactor_push_event(Reactor* r, uint64_t token, int32_t flags) {
+    if (r->event_count == r->event_capacity) {
+        int32_t new_capacity = r->event_capacity * 2;
+        ReactorEvent* events = realloc(r->events, (size_t)new_capacity * sizeof(ReactorEvent));
+        if (!events) {
+            return 0;
+        }
+        r->events = events;
+        r->event_capacity = new_capacity;
+    }
+    r->events[r->event_count].token = token;
+    r->events[r->event_count].flags = flags;
+    r->event_count++;
+    return 1;
+}
+
+/* ---- Timer heap ---- */
+
+static int reactor_timer_less(Reactor* r, int32_t a, int32_t b) {
+    return r->timers[r->heap[a]].deadline_ns < r->timers[r->heap[b]].deadline_ns;
+}
+
+static void reactor_heap_swap(Reactor* r, int32_t a, int32_t b) {
+    int32_t slot = r->heap[a];
+    r->heap[a] = r->heap[b];
+    r->heap[b] = slot;
+    r->timers[r->heap[a]].heap_index = a;
+    r->timers[r->heap[b]].heap_index = b;
+}
+
+static void reactor_heap_up(Reactor* r, int32_t i) {
+    while (i > 0) {
+        int32_t parent = (i - 1) / 2;
+        if (!reactor_timer_less(r, i, parent)) {
+            break;
+        }
+        reactor_heap_swap(r, i, parent);
+        i = parent;
+    }
+}
+
+static void reactor_heap_down(Reactor* r, int32_t i) {
+    for (;;) {
+        int32_t left = 2 * i + 1;
+        int32_t smallest = i;
+        if (left < r->heap_len && reactor_timer_less(r, left, smallest)) {
+            smallest = left;
+        }
+        if (left + 1 < r->heap_len && reactor_timer_less(r, left + 1, smallest)) {
+            smallest = left + 1;
+        }
+        if (smallest == i) {
+            break;
+        }
+        reactor_heap_swap(r, i, smallest);
+        i = smallest;
+    }
+}
+
+static void reactor_heap_remove(Reactor* r, int32_t i) {
+    int32_t last = --r->heap_len;
+    if (i != last) {
+        reactor_heap_swap(r, i, last);
+        reactor_heap_down(r, i);
+        reactor_heap_up(r, i);
+    }
+}
+
+static void reactor_timer_release(Reactor* r, int32_t slot) {
+    r->timers[slot].heap_index = -1;
+    r->timers[slot].generation++;
+    r->free_slots[r->free_count++] = slot;
+}
+
+static int reactor_timer_grow(Reactor* r) {
+    int32_t old_capacity = r->timer_capacity;
+    int32_t new_capacity = old_capacity ? old_capacity * 2 : 64;
+    ReactorTimer* timers = realloc(r->timers, (size_t)new_capacity * sizeof(ReactorTimer));
+    if (!timers) {
+        return 0;
+    }
+    r->timers = timers;
+    int32_t* free_slots = realloc(r->free_slots, (size_t)new_capacity * sizeof(int32_t));
+    if (!free_slots) {
+        return 0;
+    }
+    r->free_slots = free_slots;
+    int32_t* heap = realloc(r->heap, (size_t)new_capacity * sizeof(int32_t));
+    if (!heap) {
+        return 0;
+    }
+    r->heap = heap;
+
+    /* Push new slots so the lowest index is handed out first */
+    for (int32_t slot = new_capacity - 1; slot >= old_capacity; slot--) {
+        r->timers[slot].heap_index = -1;
+        r->timers[slot].generation = 1;
+        r->free_slots[r->free_count++] = slot;
+    }
+    r->timer_capacity = new_capacity;
+    return 1;
+}
+
+/* Move every expired timer into the event list; periodic ones are re-armed */
+static void reactor_expire_timers(Reactor* r) {
+    if (r->heap_len == 0) {
+        return;
+    }
+    uint64_t now = reactor_now_ns();
+    while (r->heap_len > 0) {
+        int32_t slot = r->heap[0];
+        ReactorTimer* t = &r->timers[slot];
+        if (t->deadline_ns > now) {
+            break;
+        }
+        if (!reactor_push_event(r, t->token, REACTOR_TIMER)) {
+            break;
+        }
+        if (t->interval_ns > 0) {
+            /* Skip missed periods instead of delivering a burst */
+            t->deadline_ns += t->interval_ns;
+            if (t->deadline_ns <= now) {
+                t->deadline_ns = now + t->interval_ns;
+            }
+            reactor_heap_down(r, 0);
+        } else {
+            reactor_heap_remove(r, 0);
+            reactor_timer_release(r, slot);
+        }
+    }
+}
+
+#ifdef REACTOR_EPOLL
+/* Arm the timerfd for the earliest deadline (or disarm it) */
+static void reactor_arm_timerfd(Reactor* r) {
+    uint64_t deadline = r->heap_len > 0 ? r->timers[r->heap[0]].deadline_ns : 0;
+    if (deadline == r->armed_ns) {
+        return;
+    }
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = (time_t)(deadline / 1000000000ULL);
+    spec.it_value.tv_nsec = (long)(deadline % 1000000000ULL);
+    if (timerfd_settime(r->timerfd, TFD_TIMER_ABSTIME, &spec, NULL) == 0) {
+        r->armed_ns = deadline;
+    }
+}
+
+static uint32_t reactor_epoll_mask(int32_t interest) {
+    uint32_t mask = EPOLLET | EPOLLRDHUP;
+    if (interest & REACTOR_READ) {
+        mask |= EPOLLIN;
+    }
+    if (interest & REACTOR_WRITE) {
+        mask |= EPOLLOUT;
+    }
+    return mask;
+}
+#else
+static int64_t reactor_find_fd(Reactor* r, int64_t fd) {
+    for (int64_t i = 0; i < r->fd_count; i++) {
+        if ((int64_t)r->fds[i].fd == fd) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static short reactor_poll_mask(int32_t interest) {
+    short mask = 0;
+    if (interest & REACTOR_READ) {
+        mask |= POLLIN;
+    }
+    if (interest & REACTOR_WRITE) {
+        mask |= POLLOUT;
+    }
+    return mask;
+}
+#endif
+
+/* ---- Public API ---- */
+
+/* Create a reactor; returns NULL on failure */
+void* reactor_new() {
+    Reactor* r = calloc(1, sizeof(Reactor));
+    if (!r) {
+        return NULL;
+    }
+    r->event_capacity = REACTOR_MAX_EVENTS;
+    r->events = malloc((size_t)r->event_capacity * sizeof(ReactorEvent));
+    if (!r->events) {
+        free(r);
+        return NULL;
+    }
+#ifdef REACTOR_EPOLL
+    r->epfd = epoll_create1(EPOLL_CLOEXEC);
+    r->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (r->epfd < 0 || r->timerfd < 0) {
+        if (r->epfd >= 0) {
+            close(r->epfd);
+        }
+        if (r->timerfd >= 0) {
+            close(r->timerfd);
+        }
+        free(r->events);
+        free(r);
+        return NULL;
+    }
+    /* Level-triggered: the timerfd is drained on every wakeup anyway */
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u64 = REACTOR_INTERNAL_TOKEN;
+    if (epoll_ctl(r->epfd, EPOLL_CTL_ADD, r->timerfd, &ev) < 0) {
+        close(r->epfd);
+        close(r->timerfd);
+        free(r->events);
+        free(r);
+        return NULL;
+    }
+#endif
+    return r;
+}
+
+/* Start watching fd for interest (REACTOR_READ | REACTOR_WRITE); 0 on success */
+int32_t reactor_register(void* handle, int64_t fd, int32_t interest, int64_t token) {
+    Reactor* r = (Reactor*)handle;
+    if (!r || fd < 0 || (uint64_t)token == REACTOR_INTERNAL_TOKEN) {
+        errno = EINVAL;
+        return -1;
+    }
+#ifdef REACTOR_EPOLL
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = reactor_epoll_mask(interest);
+    ev.data.u64 = (uint64_t)token;
+    return epoll_ctl(r->epfd, EPOLL_CTL_ADD, (int)fd, &ev) == 0 ? 0 : -1;
+#else
+    if (reactor_find_fd(r, fd) >= 0) {
+        errno = EEXIST;
+        return -1;
+    }
+    if (r->fd_count == r->fd_capacity) {
+        int64_t new_capacity = r->fd_capacity ? r->fd_capacity * 2 : 64;
+        void* fds = realloc(r->fds, (size_t)new_capacity * sizeof(r->fds[0]));
+        if (!fds) {
+            return -1;
+        }
+        r->fds = fds;
+        uint64_t* tokens = realloc(r->tokens, (size_t)new_capacity * sizeof(uint64_t));
+        if (!tokens) {
+            return -1;
+        }
+        r->tokens = tokens;
+        r->fd_capacity = new_capacity;
+    }
+    r->fds[r->fd_count].fd = fd;
+    r->fds[r->fd_count].events = reactor_poll_mask(interest);
+    r->fds[r->fd_count].revents = 0;
+    r->tokens[r->fd_count] = (uint64_t)token;
+    r->fd_count++;
+    return 0;
+#endif
+}
+
+/* Change the interest set and/or token of a registered fd; 0 on success */
+int32_t reactor_modify(void* handle, int64_t fd, int32_t interest, int64_t token) {
+    Reactor* r = (Reactor*)handle;
+    if (!r || fd < 0 || (uint64_t)token == REACTOR_INTERNAL_TOKEN) {
+        errno = EINVAL;
+        return -1;
+    }
+#ifdef REACTOR_EPOLL
+    /* Re-arming also re-reports readiness that is already pending */
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = reactor_epoll_mask(interest);
+    ev.data.u64 = (uint64_t)token;
+    return epoll_ctl(r->epfd, EPOLL_CTL_MOD, (int)fd, &ev) == 0 ? 0 : -1;
+#else
+    int64_t i = reactor_find_fd(r, fd);
+    if (i < 0) {
+        errno = ENOENT;
+        return -1;
+    }
+    r->fds[i].events = reactor_poll_mask(interest);
+    r->tokens[i] = (uint64_t)token;
+    return 0;
+#endif
+}
+
+/* Stop watching fd (call before closing it); 0 on success */
+int32_t reactor_unregister(void* handle, int64_t fd) {
+    Reactor* r = (Reactor*)handle;
+    if (!r || fd < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+#ifdef REACTOR_EPOLL
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    return epoll_ctl(r->epfd, EPOLL_CTL_DEL, (int)fd, &ev) == 0 ? 0 : -1;
+#else
+    int64_t i = reactor_find_fd(r, fd);
+    if (i < 0) {
+        errno = ENOENT;
+        return -1;
+    }
+    r->fd_count--;
+    r->fds[i] = r->fds[r->fd_count];
+    r->tokens[i] = r->tokens[r->fd_count];
+    return 0;
+#endif
+}
+
+/* Schedule a timer after_ms from now, repeating every interval_ms if > 0.
+ * Returns a timer id (> 0) for reactor_timer_cancel, or -1 on error. */
+int64_t reactor_timer_add(void* handle, int64_t after_ms, int64_t interval_ms, int64_t token) {
+    Reactor* r = (Reactor*)handle;
+    if (!r || after_ms < 0 || interval_ms < 0) {
+        return -1;
+    }
+    if (r->free_count == 0 && !reactor_timer_grow(r)) {
+        return -1;
+    }
+
+    int32_t slot = r->free_slots[--r->free_count];
+    ReactorTimer* t = &r->timers[slot];
+    t->deadline_ns = reactor_now_ns() + (uint64_t)after_ms * 1000000ULL;
+    t->interval_ns = (uint64_t)interval_ms * 1000000ULL;
+    t->token = (uint64_t)token;
+    t->heap_index = r->heap_len;
+    r->heap[r->heap_len++] = slot;
+    reactor_heap_up(r, t->heap_index);
+    return ((int64_t)t->generation << 32) | slot;
+}
+
+/* Cancel a pending timer; returns 1 if it was pending, 0 if already gone */
+int32_t reactor_timer_cancel(void* handle, int64_t timer_id) {
+    Reactor* r = (Reactor*)handle;
+    if (!r || timer_id <= 0) {
+        return 0;
+    }
+    int32_t slot = (int32_t)(timer_id & 0xffffffff);
+    uint32_t generation = (uint32_t)((uint64_t)timer_id >> 32);
+    if (slot >= r->timer_capacity) {
+        return 0;
+    }
+    ReactorTimer* t = &r->timers[slot];
+    if (t->heap_index < 0 || t->generation != generation) {
+        return 0;
+    }
+    reactor_heap_remove(r, t->heap_index);
+    reactor_timer_release(r, slot);
+    return 1;
+}
+
+/* Number of pending timers */
+int32_t reactor_timer_count(void* handle) {
+    Reactor* r = (Reactor*)handle;
+    return r ? r->heap_len : 0;
+}
+
+/* Wait up to timeout_ms (-1 = forever) for readiness or timers.
+ * Returns the number of events (read with reactor_event_token/flags),
+ * 0 on timeout, or -1 on error. */
+int32_t reactor_poll(void* handle, int32_t timeout_ms) {
+    Reactor* r = (Reactor*)handle;
+    if (!r) {
+        return -1;
+    }
+    r->event_count = 0;
+
+#ifdef REACTOR_EPOLL
+    reactor_arm_timerfd(r);
+    int n;
+    do {
+        n = epoll_wait(r->epfd, r->raw, REACTOR_MAX_EVENTS, timeout_ms);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+        return -1;
+    }
+
+    for (int i = 0; i < n; i++) {
+        struct epoll_event* ev = &r->raw[i];
+        if (ev->data.u64 == REACTOR_INTERNAL_TOKEN) {
+            uint64_t expirations;
+            while (read(r->timerfd, &expirations, sizeof(expirations)) > 0) {
+            }
+            r->armed_ns = 0;
+            continue;
+        }
+        int32_t flags = 0;
+        if (ev->events & EPOLLIN) {
+            flags |= REACTOR_READ;
+        }
+        if (ev->events & EPOLLOUT) {
+            flags |= REACTOR_WRITE;
+        }
+        if (ev->events & (EPOLLHUP | EPOLLRDHUP)) {
+            flags |= REACTOR_HUP | REACTOR_READ;
+        }
+        if (ev->events & EPOLLERR) {
+            flags |= REACTOR_ERROR;
+        }
+        reactor_push_event(r, ev->data.u64, flags);
+    }
+#else
+    /* Clamp the timeout to the earliest timer deadline (rounded up) */
+    if (r->heap_len > 0) {
+        uint64_t now = reactor_now_ns();
+        uint64_t deadline = r->timers[r->heap[0]].deadline_ns;
+        int64_t wait_ms = deadline > now ? (int64_t)((deadline - now + 999999ULL) / 1000000ULL) : 0;
+        if (timeout_ms < 0 || wait_ms < timeout_ms) {
+            timeout_ms = (int32_t)(wait_ms > INT32_MAX ? INT32_MAX : wait_ms);
+        }
+    }
+    int n;
+#ifdef _WIN32
+    if (r->fd_count == 0) {
+        /* WSAPoll rejects an empty set */
+        Sleep(timeout_ms < 0 ? INFINITE : (DWORD)timeout_ms);
+        n = 0;
+    } else {
+        n = WSAPoll(r->fds, (ULONG)r->fd_count, timeout_ms);
+    }
+#else
+    do {
+        n = poll(r->fds, (nfds_t)r->fd_count, timeout_ms);
+    } while (n < 0 && errno == EINTR);
+#endif
+    if (n < 0) {
+        return -1;
+    }
+
+    for (int64_t i = 0; i < r->fd_count && n > 0; i++) {
+        short revents = r->fds[i].revents;
+        if (!revents) {
+            continue;
+        }
+        n--;
+        int32_t flags = 0;
+        if (revents & POLLIN) {
+            flags |= REACTOR_READ;
+        }
+        if (revents & POLLOUT) {
+            flags |= REACTOR_WRITE;
+        }
+        if (revents & POLLHUP) {
+            flags |= REACTOR_HUP | REACTOR_READ;
+        }
+        if (revents & (POLLERR | POLLNVAL)) {
+            flags |= REACTOR_ERROR;
+        }
+        reactor_push_event(r, r->tokens[i], flags);
+    }
+#endif
+
+    reactor_expire_timers(r);
+    return r->event_count;
+}
+
+/* Token of the index-th event from the last reactor_poll() */
+int64_t reactor_event_token(void* handle, int32_t index) {
+    Reactor* r = (Reactor*)handle;
+    if (!r || index < 0 || index >= r->event_count) {
+        return -1;
+    }
+    return (int64_t)r->events[index].token;
+}
+
+/* Flags (REACTOR_READ | REACTOR_WRITE | REACTOR_HUP | ...) of the index-th event */
+int32_t reactor_event_flags(void* handle, int32_t index) {
+    Reactor* r = (Reactor*)handle;
+    if (!r || index < 0 || index >= r->event_count) {
+        return 0;
+    }
+    return r->events[index].flags;
+}
+
+void reactor_free(void* handle) {
+    Reactor* r = (Reactor*)handle;
+    if (!r) {
+        return;
+    }
+#ifdef REACTOR_EPOLL
+    close(r->epfd);
+    close(r->timerfd);
+#else
+    free(r->fds);
+    free(r->tokens);
+#endif
+    free(r->events);
+    free(r->timers);
+    free(r->free_slots);
+    free(r->heap);
+    free(r);
+}
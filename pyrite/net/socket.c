@@ -1,8 +1,13 @@
 /* TCP implementation in C for Pyrite */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <limits.h>
 #include <errno.h>
@@ -13,9 +18,135 @@
 #pragma comment(lib, "ws2_32.lib")
 #else
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
+#include <sys/stat.h>
+#include <netdb.h>
+#include <poll.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#endif
+
+#ifdef _WIN32
+#include <io.h>
+#include <sys/stat.h>
+#endif
+
+#ifndef _WIN32
+#include <sys/uio.h>
+#endif
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#include <linux/errqueue.h>
+#include <netinet/udp.h>
+#endif
+
+/* Returned by the tcp_try_* functions when the operation would block */
+#define TCP_WOULD_BLOCK (-2)
+
+/* tcp_recv_exact64() status when the peer closed before len bytes arrived */
+#define TCP_EOF (-3)
+
+/* tcp_listen() flags (match tcp.pyrite) */
+#define TCP_LISTEN_REUSEADDR 1
+#define TCP_LISTEN_REUSEPORT 2
+#define TCP_LISTEN_NONBLOCK 4
+#define TCP_LISTEN_V6ONLY 8
+
+/* tcp_accept() flags */
+#define TCP_ACCEPT_NONBLOCK 1
+
+/* tcp_send_file() tuning */
+#define TCP_SENDFILE_MAX_CHUNK 0x7ffff000      /* Linux caps one sendfile() here */
+#define TCP_SPLICE_PIPE_SIZE (1024 * 1024)
+#define TCP_SEND_FILE_BUF_SIZE (256 * 1024)
+
+/* tcp_recvv() flags */
+#define TCP_RECVV_ALL 1     /* Keep reading until every buffer is full or EOF */
+
+/* Vectored I/O: iovecs per sendmsg()/recvmsg() (Linux UIO_MAXIOV) */
+#define TCP_IOV_MAX 1024
+
+/* Sends smaller than this are copied even on a zero-copy sender: pinning
+ * pages and the completion notification cost more than copying */
+#define TCP_ZEROCOPY_MIN_BYTES (16 * 1024)
+
+/* tcp_send_all64()/tcp_recv_exact64(): bytes per send()/recv() call. Linux
+ * moves at most 0x7ffff000 per call and Winsock takes an int length. Where a
+ * send can't be made non-waiting, deadline sends go in send-buffer-sized
+ * chunks (no smaller than the minimum) so one call can't block long. */
+#define TCP_TRANSFER_MAX_CHUNK 0x7ffff000
+#define TCP_TRANSFER_MIN_CHUNK (64 * 1024)
+
+#ifdef MSG_DONTWAIT
+#define TCP_DONTWAIT MSG_DONTWAIT
+#else
+#define TCP_DONTWAIT 0
+#endif
+
+/* udp_bind() flags (same values as TCP_LISTEN_*; match udp.pyrite) */
+#define UDP_BIND_REUSEADDR 1
+#define UDP_BIND_REUSEPORT 2
+#define UDP_BIND_NONBLOCK 4
+#define UDP_BIND_V6ONLY 8
+
+/* udp_ring_new() flags */
+#define UDP_RING_GRO 1      /* Enable UDP_GRO and split coalesced buffers */
+
+#define UDP_RING_DEFAULT_SLOTS 256
+#define UDP_RING_DEFAULT_SLOT_SIZE 2048
+#define UDP_RING_GRO_SLOT_SIZE 65536
+#define UDP_RING_GRO_MIN_SLOT 65535   /* Largest buffer the kernel coalesces into */
+#define UDP_BATCH 64              /* Datagrams per sendmmsg() from udp_send_batch() */
+#define UDP_MAX_SEGMENTS 64       /* Kernel limit for GSO sends and GRO buffers */
+#define UDP_MAX_PAYLOAD 65507     /* Largest datagram over IPv4 */
+
+/* unix_listen()/unix_bind() flags (match unix.pyrite) */
+#define UNIX_UNLINK 1       /* Remove a stale socket file at path first */
+#define UNIX_NONBLOCK 4     /* Same value as TCP_LISTEN_NONBLOCK */
+
+/* unix_socketpair() types */
+#define UNIX_STREAM 1
+#define UNIX_DATAGRAM 2
+
+#define UNIX_MAX_FDS 253    /* Descriptors per message (Linux SCM_MAX_FD) */
+
+#ifdef __linux__
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+#endif
+
+#ifdef _WIN32
+#define TCP_ETIMEDOUT WSAETIMEDOUT
+#define TCP_EINVAL WSAEINVAL
+#else
+#define TCP_ETIMEDOUT ETIMEDOUT
+#define TCP_EINVAL EINVAL
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#if defined(__linux__) && defined(SO_EE_ORIGIN_ZEROCOPY)
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+#define TCP_HAVE_ZEROCOPY 1
 #endif
 
 typedef struct {
@@ -25,6 +156,74 @@ typedef struct {
 
 extern String string_new(const char* cstr);
 
+void tcp_close(int64_t sock);
+int32_t tcp_set_nonblocking(int64_t sock, int32_t enabled);
+int32_t tcp_set_buffer_sizes(int64_t sock, int32_t send_bytes, int32_t recv_bytes);
+int64_t tcp_connect_with_buffers(const char* address, int32_t port, int32_t send_bytes, int32_t recv_bytes);
+static int tcp_would_block();
+static int32_t tcp_last_error();
+static int64_t tcp_now_ms();
+static int tcp_transfer_wait(int64_t sock, int writable, int32_t timeout_ms, int64_t deadline, int32_t* status);
+
+/* ---- Cooperative waits ---- */
+
+/* While a coroutine runs, its scheduler (task/coro.c) installs a wait hook.
+ * The blocking calls in this file then make their syscalls with
+ * MSG_DONTWAIT and, instead of blocking the thread, hand the wait to the
+ * hook, which parks only the coroutine. Sockets the caller made nonblocking
+ * keep returning EAGAIN / TCP_WOULD_BLOCK as usual. */
+
+#define TCP_WAIT_READ 1     /* Same values as REACTOR_READ / CORO_READ */
+#define TCP_WAIT_WRITE 2
+
+#ifdef _MSC_VER
+#define TCP_THREAD_LOCAL __declspec(thread)
+#else
+#define TCP_THREAD_LOCAL __thread
+#endif
+
+/* Returns the ready flags, 0 on timeout or -1; events 0 announces a close */
+typedef int32_t (*TcpWaitHook)(int64_t sock, int32_t events, int32_t timeout_ms);
+
+static TCP_THREAD_LOCAL TcpWaitHook tcp_wait_hook;
+
+/* Install (or with NULL remove) this thread's wait hook */
+void tcp_set_wait_hook(int32_t (*hook)(int64_t sock, int32_t events, int32_t timeout_ms)) {
+    tcp_wait_hook = hook;
+}
+
+/* The hook, if one is installed and sockets can be tried without blocking */
+static TcpWaitHook tcp_cooperative() {
+    return TCP_DONTWAIT != 0 ? tcp_wait_hook : NULL;
+}
+
+/* Extra send()/recv() flags for calls that would block the thread */
+static int tcp_cooperative_flags() {
+    return tcp_cooperative() ? TCP_DONTWAIT : 0;
+}
+
+/* After a call made with tcp_cooperative_flags() would block: if the socket
+ * itself is blocking, wait through the hook. Returns 1 to retry the call,
+ * 0 to report the failure as is. */
+static int tcp_park(int64_t sock, int32_t events) {
+#ifdef _WIN32
+    (void)sock;
+    (void)events;
+    return 0;
+#else
+    TcpWaitHook hook = tcp_cooperative();
+    if (!hook || !tcp_would_block()) {
+        return 0;
+    }
+    int flags = fcntl((int)sock, F_GETFL, 0);
+    if (flags < 0 || (flags & O_NONBLOCK)) {
+        errno = EAGAIN;
+        return 0;
+    }
+    return hook(sock, events, -1) >= 0;
+#endif
+}
+
 int32_t net_init() {
 #ifdef _WIN32
     WSADATA wsaData;
@@ -35,6 +234,16 @@ int32_t net_init() {
 }
 
 int64_t tcp_connect(const char* address, int32_t port) {
+    return tcp_connect_with_buffers(address, port, 0, 0);
+}
+
+/**
+ * tcp_connect() with SO_SNDBUF / SO_RCVBUF set before the handshake (<= 0
+ * keeps the default). The receive buffer fixes the window scale advertised
+ * in the SYN, so setting it after connect cannot grow the window past what
+ * that scale allows.
+ */
+int64_t tcp_connect_with_buffers(const char* address, int32_t port, int32_t send_bytes, int32_t recv_bytes) {
     int64_t sock = socket(AF_INET, SOCK_STREAM, 0);
     if (sock < 0) return -1;
     
@@ -43,7 +252,8 @@ int64_t tcp_connect(const char* address, int32_t port) {
     serv_addr.sin_family = AF_INET;
     serv_addr.sin_port = htons(port);
     
-    if (inet_pton(AF_INET, address, &serv_addr.sin_addr) <= 0) {
+    if (inet_pton(AF_INET, address, &serv_addr.sin_addr) <= 0 ||
+        ((send_bytes > 0 || recv_bytes > 0) && tcp_set_buffer_sizes(sock, send_bytes, recv_bytes) != 0)) {
 #ifdef _WIN32
         closesocket(sock);
 #else
@@ -52,6 +262,36 @@ int64_t tcp_connect(const char* address, int32_t port) {
         return -1;
     }
     
+#ifndef _WIN32
+    if (tcp_cooperative()) {
+        /* In a coroutine: connect without blocking, park until it completes */
+        if (tcp_set_nonblocking(sock, 1) != 0) {
+            close(sock);
+            return -1;
+        }
+        int result = connect(sock, (struct sockaddr *)&serv_addr, sizeof(serv_addr));
+        if (result < 0 && (errno == EINPROGRESS || errno == EINTR)) {
+            int error = 0;
+            socklen_t error_len = sizeof(error);
+            if (tcp_wait_hook(sock, TCP_WAIT_WRITE, -1) < 0 ||
+                getsockopt((int)sock, SOL_SOCKET, SO_ERROR, &error, &error_len) < 0) {
+                error = errno;
+            }
+            result = error ? -1 : 0;
+            if (error) {
+                errno = error;
+            }
+        }
+        if (result < 0 || tcp_set_nonblocking(sock, 0) != 0) {
+            int error = errno;
+            tcp_close(sock);
+            errno = error;
+            return -1;
+        }
+        return sock;
+    }
+#endif
+
     if (connect(sock, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) {
 #ifdef _WIN32
         closesocket(sock);
@@ -76,7 +316,7 @@ int64_t tcp_connect(const char* address, int32_t port) {
  * 
  * Note: We limit the maximum send size to INT32_MAX bytes to ensure the return
  * value accurately reflects the number of bytes sent without truncation. For larger
- * transfers, callers should split the data into multiple calls.
+ * transfers, or to resume after an error, use tcp_send_all64().
  * 
  * Behavior:
  * - len < 0: Returns -1 and sets errno/WSASetLastError to EINVAL
@@ -84,7 +324,8 @@ int64_t tcp_connect(const char* address, int32_t port) {
  * - len > INT32_MAX: Returns -1 and sets errno/WSASetLastError to EINVAL
  * - 0 < len <= INT32_MAX: Performs send() until all data is sent, handling partial sends
  * 
- * On error after partial send, returns -1. The caller cannot determine how much was sent.
+ * On error after partial send, returns -1. The caller cannot determine how much was sent
+ * (tcp_send_all64() reports it).
  * 
  * @param sock The socket file descriptor
  * @param data Pointer to the data buffer to send
@@ -149,10 +390,10 @@ int32_t tcp_send(int64_t sock, const char* data, int64_t len) {
             return -1;
         }
 #else
-        sent = send((int)sock, current_data, (size_t)remaining, 0);
+        sent = send((int)sock, current_data, (size_t)remaining, tcp_cooperative_flags());
         if (sent < 0) {
-            // Retry on EINTR (interrupted system call)
-            if (errno == EINTR) {
+            // Retry on EINTR (interrupted system call), or after waiting in a coroutine
+            if (errno == EINTR || tcp_park(sock, TCP_WAIT_WRITE)) {
                 continue;  // Retry the send
             }
             // Other errors: return -1 (partial send may have occurred)
@@ -243,7 +484,11 @@ int32_t tcp_recv(int64_t sock, char* buf, int64_t len) {
         return -1;
     }
 #else
-    int result = recv((int)sock, buf, (size_t)recv_len, 0);
+    int result;
+    do {
+        // In a coroutine a would-block parks the coroutine and retries
+        result = recv((int)sock, buf, (size_t)recv_len, tcp_cooperative_flags());
+    } while (result < 0 && tcp_park(sock, TCP_WAIT_READ));
     if (result < 0) {
         // Error occurred - errno is already set by recv
         return -1;
@@ -254,11 +499,2802 @@ int32_t tcp_recv(int64_t sock, char* buf, int64_t len) {
     return (int32_t)result;
 }
 
-void tcp_close(int64_t sock) {
+/* Switch a socket between blocking (enabled = 0) and nonblocking mode.
+ * Returns 0 on success, -1 on error. */
+int32_t tcp_set_nonblocking(int64_t sock, int32_t enabled) {
 #ifdef _WIN32
-    closesocket(sock);
+    u_long mode = enabled ? 1 : 0;
+    return ioctlsocket((SOCKET)sock, FIONBIO, &mode) == 0 ? 0 : -1;
 #else
-    close(sock);
+    int flags = fcntl((int)sock, F_GETFL, 0);
+    if (flags < 0) {
+        return -1;
+    }
+    flags = enabled ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+    return fcntl((int)sock, F_SETFL, flags) == 0 ? 0 : -1;
+#endif
+}
+
+static void tcp_set_error(int error) {
+#ifdef _WIN32
+    WSASetLastError(error == EINVAL ? WSAEINVAL : WSAEOPNOTSUPP);
+#else
+    errno = error;
+#endif
+}
+
+static int32_t tcp_setsockopt_int(int64_t sock, int level, int name, int value) {
+#ifdef _WIN32
+    return setsockopt((SOCKET)sock, level, name, (const char*)&value, sizeof(value)) == 0 ? 0 : -1;
+#else
+    return setsockopt((int)sock, level, name, &value, sizeof(value)) == 0 ? 0 : -1;
+#endif
+}
+
+static int32_t tcp_getsockopt_int(int64_t sock, int level, int name) {
+    int value = 0;
+    socklen_t value_len = sizeof(value);
+#ifdef _WIN32
+    if (getsockopt((SOCKET)sock, level, name, (char*)&value, &value_len) != 0) {
+        return -1;
+    }
+#else
+    if (getsockopt((int)sock, level, name, &value, &value_len) != 0) {
+        return -1;
+    }
+#endif
+    return value;
+}
+
+static int tcp_would_block() {
+#ifdef _WIN32
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
+
+/**
+ * Starts a nonblocking connect and returns the socket without waiting.
+ *
+ * The socket is already in nonblocking mode. Register it with a reactor for
+ * REACTOR_WRITE; once it is writable, tcp_connect_finish() reports whether
+ * the connection succeeded.
+ *
+ * @return The socket, or -1 on error (bad address, no sockets left)
+ */
+int64_t tcp_connect_nonblocking(const char* address, int32_t port) {
+    int64_t sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) {
+        return -1;
+    }
+    
+    struct sockaddr_in serv_addr;
+    memset(&serv_addr, 0, sizeof(serv_addr));
+    serv_addr.sin_family = AF_INET;
+    serv_addr.sin_port = htons(port);
+    
+    if (inet_pton(AF_INET, address, &serv_addr.sin_addr) <= 0 || tcp_set_nonblocking(sock, 1) != 0) {
+        tcp_close(sock);
+        return -1;
+    }
+    
+    if (connect(sock, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) {
+#ifdef _WIN32
+        int in_progress = WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+        int in_progress = errno == EINPROGRESS;
+#endif
+        if (!in_progress) {
+            tcp_close(sock);
+            return -1;
+        }
+    }
+    
+    return sock;
+}
+
+/**
+ * Completes a connect started by tcp_connect_nonblocking().
+ *
+ * @return 0 if connected, -1 with errno set to the connect error otherwise
+ */
+int32_t tcp_connect_finish(int64_t sock) {
+    int error = 0;
+    socklen_t error_len = sizeof(error);
+    if (getsockopt(sock, SOL_SOCKET, SO_ERROR, (char*)&error, &error_len) < 0) {
+        return -1;
+    }
+    if (error != 0) {
+#ifdef _WIN32
+        WSASetLastError(error);
+#else
+        errno = error;
+#endif
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Sends as much of data as the socket accepts right now.
+ *
+ * Unlike tcp_send() this never loops until everything is written: on a
+ * nonblocking socket it returns after one send(), so the caller keeps the
+ * unsent tail and retries when the reactor reports REACTOR_WRITE. With an
+ * edge-triggered reactor, keep calling until it returns TCP_WOULD_BLOCK.
+ * SIGPIPE is suppressed where the platform allows it.
+ *
+ * @return Bytes sent (may be less than len), TCP_WOULD_BLOCK (-2) if the send
+ *         buffer is full, or -1 on error
+ */
+int64_t tcp_try_send(int64_t sock, const char* data, int64_t len) {
+    if (len < 0 || (len > 0 && data == NULL)) {
+#ifdef _WIN32
+        WSASetLastError(WSAEINVAL);
+#else
+        errno = EINVAL;
+#endif
+        return -1;
+    }
+    if (len == 0) {
+        return 0;
+    }
+    
+    for (;;) {
+#ifdef _WIN32
+        int chunk = len > (int64_t)INT32_MAX ? INT32_MAX : (int)len;
+        int sent = send((SOCKET)sock, data, chunk, 0);
+        if (sent != SOCKET_ERROR) {
+            return sent;
+        }
+        if (WSAGetLastError() == WSAEINTR) {
+            continue;
+        }
+#else
+        ssize_t sent = send((int)sock, data, (size_t)len, MSG_NOSIGNAL);
+        if (sent >= 0) {
+            return (int64_t)sent;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+#endif
+        return tcp_would_block() ? TCP_WOULD_BLOCK : -1;
+    }
+}
+
+/**
+ * Receives whatever data is available right now.
+ *
+ * @return Bytes received (> 0), 0 on EOF, TCP_WOULD_BLOCK (-2) if nothing is
+ *         available yet, or -1 on error
+ */
+int64_t tcp_try_recv(int64_t sock, char* buf, int64_t len) {
+    if (len < 0 || (len > 0 && buf == NULL)) {
+#ifdef _WIN32
+        WSASetLastError(WSAEINVAL);
+#else
+        errno = EINVAL;
+#endif
+        return -1;
+    }
+    if (len == 0) {
+        return 0;
+    }
+    
+    for (;;) {
+#ifdef _WIN32
+        int chunk = len > (int64_t)INT32_MAX ? INT32_MAX : (int)len;
+        int received = recv((SOCKET)sock, buf, chunk, 0);
+        if (received != SOCKET_ERROR) {
+            return received;
+        }
+        if (WSAGetLastError() == WSAEINTR) {
+            continue;
+        }
+#else
+        ssize_t received = recv((int)sock, buf, (size_t)len, 0);
+        if (received >= 0) {
+            return (int64_t)received;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+#endif
+        return tcp_would_block() ? TCP_WOULD_BLOCK : -1;
+    }
+}
+
+/* ---- Vectored I/O ---- */
+
+/*
+ * Scatter/gather: parts is an array of String {data, len} pieces sent (or
+ * filled) in order with one sendmsg()/recvmsg() per TCP_IOV_MAX pieces, so
+ * a header and a body go out together without being concatenated first.
+ */
+
+#ifdef _WIN32
+typedef WSABUF TcpIoVec;
+#else
+typedef struct iovec TcpIoVec;
+#endif
+
+/* Position inside a parts array */
+typedef struct {
+    int32_t index;
+    int64_t offset;
+} TcpIoCursor;
+
+static int tcp_parts_valid(const String* parts, int32_t count, int64_t* total) {
+    if (count < 0 || (count > 0 && parts == NULL)) {
+        return 0;
+    }
+    int64_t sum = 0;
+    for (int32_t i = 0; i < count; i++) {
+        if (parts[i].len < 0 || (parts[i].len > 0 && parts[i].data == NULL)) {
+            return 0;
+        }
+        if (parts[i].len > INT64_MAX - sum) {
+            return 0;
+        }
+        sum += parts[i].len;
+    }
+    *total = sum;
+    return 1;
+}
+
+/* Move the cursor forward by n bytes, past finished and empty parts */
+static void tcp_cursor_advance(const String* parts, int32_t count, TcpIoCursor* cursor, int64_t n) {
+    cursor->offset += n;
+    while (cursor->index < count && cursor->offset >= parts[cursor->index].len) {
+        cursor->offset -= parts[cursor->index].len;
+        cursor->index++;
+    }
+}
+
+/* iovecs from the cursor on; returns the number filled */
+static int tcp_fill_iov(const String* parts, int32_t count, const TcpIoCursor* cursor, TcpIoVec* iov) {
+    int n = 0;
+    int64_t offset = cursor->offset;
+    for (int32_t i = cursor->index; i < count && n < TCP_IOV_MAX; i++) {
+        int64_t len = parts[i].len - offset;
+        if (len > 0) {
+#ifdef _WIN32
+            /* WSABUF lengths are 32-bit: the cursor resumes at the remainder */
+            iov[n].buf = parts[i].data + offset;
+            iov[n].len = (ULONG)(len > INT32_MAX ? INT32_MAX : len);
+#else
+            iov[n].iov_base = parts[i].data + offset;
+            iov[n].iov_len = (size_t)len;
+#endif
+            n++;
+#ifdef _WIN32
+            if (len > INT32_MAX) {
+                break;
+            }
+#endif
+        }
+        offset = 0;
+    }
+    return n;
+}
+
+/* One gathered send from the cursor; bytes sent or -1 (errno / WSA error) */
+static int64_t tcp_sendmsg_once(int64_t sock, const String* parts, int32_t count, const TcpIoCursor* cursor, int flags) {
+    TcpIoVec iov[TCP_IOV_MAX];
+    int n = tcp_fill_iov(parts, count, cursor, iov);
+    if (n == 0) {
+        return 0;
+    }
+    for (;;) {
+#ifdef _WIN32
+        DWORD sent = 0;
+        (void)flags;
+        if (WSASend((SOCKET)sock, iov, (DWORD)n, &sent, 0, NULL, NULL) == 0) {
+            return (int64_t)sent;
+        }
+        if (WSAGetLastError() == WSAEINTR) {
+            continue;
+        }
+        return -1;
+#else
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = (size_t)n;
+        ssize_t sent = sendmsg((int)sock, &msg, MSG_NOSIGNAL | flags);
+        if (sent >= 0) {
+            return (int64_t)sent;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        return -1;
 #endif
+    }
+}
+
+/**
+ * Sends every byte of parts[0..count) in order, however many sendmsg()
+ * calls that takes.
+ *
+ * As with tcp_send_all64() the result is the progress made even when the
+ * send stops early, and *status (may be NULL) says why: 0 when everything
+ * was sent, TCP_WOULD_BLOCK (timeout_ms == 0 and the send buffer is full),
+ * ETIMEDOUT, or the connection's errno (WSA error on Windows). Resume with
+ * tcp_try_sendv(sock, parts, count, result) or with the unsent tail of
+ * parts. timeout_ms < 0 waits as long as it takes.
+ *
+ * @return Bytes sent by this call (0 <= result <= total)
+ */
+int64_t tcp_sendv(int64_t sock, const String* parts, int32_t count, int32_t timeout_ms, int32_t* status) {
+    int32_t ignored;
+    if (status == NULL) {
+        status = &ignored;
+    }
+    *status = 0;
+    int64_t total;
+    if (!tcp_parts_valid(parts, count, &total)) {
+        *status = TCP_EINVAL;
+        return 0;
+    }
+    int64_t deadline = timeout_ms > 0 ? tcp_now_ms() + timeout_ms : 0;
+    int flags = timeout_ms >= 0 ? TCP_DONTWAIT : tcp_cooperative_flags();
+    TcpIoCursor cursor = { 0, 0 };
+    int64_t sent = 0;
+    while (sent < total) {
+        if (TCP_DONTWAIT == 0 && timeout_ms >= 0 && tcp_transfer_wait(sock, 1, timeout_ms, deadline, status) <= 0) {
+            return sent;
+        }
+        int64_t n = tcp_sendmsg_once(sock, parts, count, &cursor, flags);
+        if (n >= 0) {
+            sent += n;
+            tcp_cursor_advance(parts, count, &cursor, n);
+            continue;
+        }
+        if (!tcp_would_block()) {
+            *status = tcp_last_error();
+            return sent;
+        }
+        if (timeout_ms == 0) {
+            *status = TCP_WOULD_BLOCK;
+            return sent;
+        }
+        if (tcp_transfer_wait(sock, 1, timeout_ms, deadline, status) <= 0) {
+            return sent;
+        }
+    }
+    return sent;
 }
 
+/**
+ * Nonblocking gathered send of parts, starting skip bytes in (the bytes
+ * earlier calls already sent). Partial progress is normal: call again with
+ * skip + result until everything is out.
+ *
+ * @return Bytes sent by this call, TCP_WOULD_BLOCK, or -1 on error
+ */
+int64_t tcp_try_sendv(int64_t sock, const String* parts, int32_t count, int64_t skip) {
+    int64_t total;
+    if (!tcp_parts_valid(parts, count, &total) || skip < 0 || skip > total) {
+        tcp_set_error(EINVAL);
+        return -1;
+    }
+    if (skip == total) {
+        return 0;
+    }
+    TcpIoCursor cursor = { 0, 0 };
+    tcp_cursor_advance(parts, count, &cursor, skip);
+    int64_t n = tcp_sendmsg_once(sock, parts, count, &cursor, 0);
+    if (n < 0) {
+        return tcp_would_block() ? TCP_WOULD_BLOCK : -1;
+    }
+    return n;
+}
+
+/**
+ * Scattered receive into bufs (each String's len is that buffer's
+ * capacity), filled in order. Without flags this is one recvmsg(): whatever
+ * is available, spread across the buffers. With TCP_RECVV_ALL it keeps
+ * reading until every buffer is full or the peer closes; on a nonblocking
+ * socket it also stops when no more data is ready and returns what it has.
+ *
+ * @return Bytes received (0 on EOF before any data), TCP_WOULD_BLOCK on a
+ *         nonblocking socket with nothing to read, or -1 on error
+ */
+int64_t tcp_recvv(int64_t sock, const String* bufs, int32_t count, int32_t flags) {
+    int64_t total;
+    if (!tcp_parts_valid(bufs, count, &total)) {
+        tcp_set_error(EINVAL);
+        return -1;
+    }
+    TcpIoCursor cursor = { 0, 0 };
+    int64_t received = 0;
+    while (received < total) {
+        TcpIoVec iov[TCP_IOV_MAX];
+        int n = tcp_fill_iov(bufs, count, &cursor, iov);
+        int64_t got;
+#ifdef _WIN32
+        DWORD bytes = 0;
+        DWORD recv_flags = 0;
+        if (WSARecv((SOCKET)sock, iov, (DWORD)n, &bytes, &recv_flags, NULL, NULL) == 0) {
+            got = (int64_t)bytes;
+        } else if (WSAGetLastError() == WSAEINTR) {
+            continue;
+        } else {
+            got = -1;
+        }
+#else
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = (size_t)n;
+        ssize_t r = recvmsg((int)sock, &msg, tcp_cooperative_flags());
+        if (r < 0 && errno == EINTR) {
+            continue;
+        }
+        got = (int64_t)r;
+#endif
+        if (got < 0) {
+            if (tcp_would_block()) {
+                if (received > 0 && !(flags & TCP_RECVV_ALL)) {
+                    return received;
+                }
+                if (tcp_park(sock, TCP_WAIT_READ)) {
+                    continue;
+                }
+                return received > 0 ? received : TCP_WOULD_BLOCK;
+            }
+            return -1;
+        }
+        if (got == 0) {
+            break;   /* EOF */
+        }
+        received += got;
+        tcp_cursor_advance(bufs, count, &cursor, got);
+        if (!(flags & TCP_RECVV_ALL)) {
+            break;
+        }
+    }
+    return received;
+}
+
+/*
+ * Zero-copy sender (MSG_ZEROCOPY, Linux 4.14+).
+ *
+ * The kernel transmits straight from the caller's pages instead of copying
+ * them into socket buffers, which saves the copy for large payloads but
+ * means a buffer must not be modified or freed until the kernel says it is
+ * done. Each zero-copy sendmsg() gets a sequence number; completions arrive
+ * as ranges of those numbers on the socket's error queue. The sender turns
+ * them into tickets: tcp_zc_send() returns the ticket covering its data,
+ * and once tcp_zc_done() (or tcp_zc_wait()) reports that ticket, every
+ * buffer sent up to it may be reused.
+ *
+ * Sends below TCP_ZEROCOPY_MIN_BYTES, and all sends where SO_ZEROCOPY is
+ * unavailable, are ordinary copies whose buffers are free on return. Over
+ * loopback the kernel always copies; tcp_zc_copied() counts such
+ * notifications so callers can turn zero-copy off where it does not pay.
+ */
+typedef struct {
+    int64_t sock;
+    int32_t enabled;
+    int64_t issued;         /* Tickets handed out (zero-copy sendmsg calls) */
+    int64_t completed;      /* Every ticket <= completed is done */
+    int64_t copied;         /* Completions the kernel served by copying */
+    int64_t* ranges;        /* Out-of-order completed [lo, hi] ticket pairs */
+    int32_t range_count;
+    int32_t range_capacity;
+    int32_t error;          /* A completion was lost (ENOMEM): tickets are unknowable */
+} TcpZeroCopy;
+
+/* Create a sender for sock (which it does not own); NULL on failure */
+void* tcp_zc_open(int64_t sock) {
+    TcpZeroCopy* zc = calloc(1, sizeof(TcpZeroCopy));
+    if (!zc) {
+        return NULL;
+    }
+    zc->sock = sock;
+#ifdef TCP_HAVE_ZEROCOPY
+    zc->enabled = tcp_setsockopt_int(sock, SOL_SOCKET, SO_ZEROCOPY, 1) == 0;
+#endif
+    return zc;
+}
+
+/* 1 if sends really are zero-copy (SO_ZEROCOPY accepted) */
+int32_t tcp_zc_enabled(void* handle) {
+    TcpZeroCopy* zc = (TcpZeroCopy*)handle;
+    return zc ? zc->enabled : 0;
+}
+
+#ifdef TCP_HAVE_ZEROCOPY
+static void tcp_zc_complete(TcpZeroCopy* zc, int64_t lo, int64_t hi) {
+    if (lo > zc->completed + 1) {
+        if (zc->range_count == zc->range_capacity) {
+            int32_t new_capacity = zc->range_capacity ? zc->range_capacity * 2 : 8;
+            int64_t* ranges = realloc(zc->ranges, (size_t)new_capacity * 2 * sizeof(int64_t));
+            if (!ranges) {
+                /* Dropping [lo, hi] would leave a gap that never closes, so
+                 * waiters would hang; fail the sender instead */
+                zc->error = ENOMEM;
+                return;
+            }
+            zc->ranges = ranges;
+            zc->range_capacity = new_capacity;
+        }
+        zc->ranges[zc->range_count * 2] = lo;
+        zc->ranges[zc->range_count * 2 + 1] = hi;
+        zc->range_count++;
+        return;
+    }
+    if (hi > zc->completed) {
+        zc->completed = hi;
+    }
+    /* Absorb parked ranges the new prefix now reaches */
+    for (int32_t i = 0; i < zc->range_count; i++) {
+        if (zc->ranges[i * 2] <= zc->completed + 1) {
+            if (zc->ranges[i * 2 + 1] > zc->completed) {
+                zc->completed = zc->ranges[i * 2 + 1];
+            }
+            zc->range_count--;
+            zc->ranges[i * 2] = zc->ranges[zc->range_count * 2];
+            zc->ranges[i * 2 + 1] = zc->ranges[zc->range_count * 2 + 1];
+            i = -1;
+        }
+    }
+}
+
+/* Kernel sequence numbers are 32-bit: map one back onto our ticket count */
+static int64_t tcp_zc_ticket(TcpZeroCopy* zc, uint32_t seq) {
+    int64_t last = zc->issued - 1;
+    int64_t candidate = (int64_t)(((uint64_t)last & ~(uint64_t)0xffffffffu) | seq);
+    if (candidate > last) {
+        candidate -= (int64_t)1 << 32;
+    }
+    return candidate + 1;
+}
+
+/* Read pending notifications; returns 1 if any arrived */
+static int tcp_zc_drain(TcpZeroCopy* zc) {
+    int progressed = 0;
+    for (;;) {
+        char control[128];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg((int)zc->sock, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return progressed;
+        }
+        for (struct cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+            if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+                  (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))) {
+                continue;
+            }
+            struct sock_extended_err err;
+            memcpy(&err, CMSG_DATA(cm), sizeof(err));
+            if (err.ee_origin != SO_EE_ORIGIN_ZEROCOPY || err.ee_errno != 0) {
+                continue;
+            }
+            int64_t lo = tcp_zc_ticket(zc, err.ee_info);
+            int64_t hi = tcp_zc_ticket(zc, err.ee_data);
+            if (err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                zc->copied += hi - lo + 1;
+            }
+            tcp_zc_complete(zc, lo, hi);
+            progressed = 1;
+        }
+    }
+}
+#endif
+
+/**
+ * Sends every byte of parts, zero-copy when enabled and the total is at
+ * least TCP_ZEROCOPY_MIN_BYTES. Result, *status and timeout_ms are as for
+ * tcp_sendv(). Afterwards tcp_zc_issued() is the ticket covering the bytes
+ * sent; their buffers must stay untouched until tcp_zc_done() reports it.
+ *
+ * @return Bytes sent by this call (0 <= result <= total)
+ */
+int64_t tcp_zc_send(void* handle, const String* parts, int32_t count, int32_t timeout_ms, int32_t* status) {
+    TcpZeroCopy* zc = (TcpZeroCopy*)handle;
+    int32_t ignored;
+    if (status == NULL) {
+        status = &ignored;
+    }
+    *status = 0;
+    int64_t total;
+    if (!zc || !tcp_parts_valid(parts, count, &total)) {
+        *status = TCP_EINVAL;
+        return 0;
+    }
+    if (zc->error) {
+        *status = zc->error;
+        return 0;
+    }
+#ifdef TCP_HAVE_ZEROCOPY
+    if (zc->enabled && total >= TCP_ZEROCOPY_MIN_BYTES) {
+        int64_t deadline = timeout_ms > 0 ? tcp_now_ms() + timeout_ms : 0;
+        int flags = timeout_ms >= 0 ? MSG_DONTWAIT : tcp_cooperative_flags();
+        TcpIoCursor cursor = { 0, 0 };
+        int64_t sent = 0;
+        while (sent < total) {
+            int64_t n = tcp_sendmsg_once(zc->sock, parts, count, &cursor, MSG_ZEROCOPY | flags);
+            if (n < 0 && errno == ENOBUFS) {
+                /* Too many notifications outstanding (optmem): reap them,
+                 * or copy this chunk if none are ready yet */
+                if (!tcp_zc_drain(zc)) {
+                    n = tcp_sendmsg_once(zc->sock, parts, count, &cursor, flags);
+                }
+                if (n < 0 && errno == ENOBUFS) {
+                    continue;
+                }
+            } else if (n > 0) {
+                zc->issued++;
+            }
+            if (n < 0) {
+                if (!tcp_would_block()) {
+                    *status = errno;
+                    return sent;
+                }
+                if (timeout_ms == 0) {
+                    *status = TCP_WOULD_BLOCK;
+                    return sent;
+                }
+                if (tcp_transfer_wait(zc->sock, 1, timeout_ms, deadline, status) <= 0) {
+                    return sent;
+                }
+                tcp_zc_drain(zc);
+                continue;
+            }
+            sent += n;
+            tcp_cursor_advance(parts, count, &cursor, n);
+        }
+        return sent;
+    }
+#endif
+    /* Copied: only earlier zero-copy sends are pending */
+    return tcp_sendv(zc->sock, parts, count, timeout_ms, status);
+}
+
+/* 1 once every buffer sent up to ticket may be reused, 0 if not yet, -1
+ * (errno ENOMEM) if the sender lost track of completions: close the socket
+ * and keep every buffer alive until it is closed */
+int32_t tcp_zc_done(void* handle, int64_t ticket) {
+    TcpZeroCopy* zc = (TcpZeroCopy*)handle;
+    if (!zc) {
+        return 0;
+    }
+#ifdef TCP_HAVE_ZEROCOPY
+    if (zc->completed < ticket) {
+        tcp_zc_drain(zc);
+    }
+#endif
+    if (zc->completed >= ticket) {
+        return 1;
+    }
+    if (zc->error) {
+        tcp_set_error(zc->error);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Waits until ticket is done (timeout_ms < 0: forever).
+ *
+ * @return 0 when done, -1 on timeout (ETIMEDOUT), socket error or a failed
+ *         sender (ENOMEM, see tcp_zc_done())
+ */
+int32_t tcp_zc_wait(void* handle, int64_t ticket, int32_t timeout_ms) {
+    TcpZeroCopy* zc = (TcpZeroCopy*)handle;
+    if (!zc) {
+        tcp_set_error(EINVAL);
+        return -1;
+    }
+#ifdef TCP_HAVE_ZEROCOPY
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int32_t done;
+    while ((done = tcp_zc_done(zc, ticket)) == 0) {
+        int wait_ms = -1;
+        if (timeout_ms >= 0) {
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            int64_t elapsed = (now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000;
+            if (elapsed >= timeout_ms) {
+                errno = ETIMEDOUT;
+                return -1;
+            }
+            wait_ms = (int)(timeout_ms - elapsed);
+        }
+        /* Notifications raise POLLERR, which poll() always reports */
+        struct pollfd pfd = { (int)zc->sock, 0, 0 };
+        int ready = poll(&pfd, 1, wait_ms);
+        if (ready < 0 && errno != EINTR) {
+            return -1;
+        }
+        if (ready > 0 && (pfd.revents & (POLLERR | POLLNVAL)) && !tcp_zc_drain(zc)) {
+            if (pfd.revents & POLLNVAL) {
+                errno = EBADF;
+                return -1;
+            }
+            int error = tcp_getsockopt_int(zc->sock, SOL_SOCKET, SO_ERROR);
+            if (error > 0) {
+                errno = error;
+                return -1;
+            }
+        }
+    }
+    return done > 0 ? 0 : -1;
+#else
+    (void)timeout_ms;
+    return zc->completed >= ticket ? 0 : -1;
+#endif
+}
+
+/* Tickets handed out so far: waiting for this one covers every send */
+int64_t tcp_zc_issued(void* handle) {
+    TcpZeroCopy* zc = (TcpZeroCopy*)handle;
+    return zc ? zc->issued : 0;
+}
+
+/* Zero-copy sends the kernel ended up copying (e.g. loopback, old NICs) */
+int64_t tcp_zc_copied(void* handle) {
+    TcpZeroCopy* zc = (TcpZeroCopy*)handle;
+    return zc ? zc->copied : 0;
+}
+
+/* Free the sender (not the socket); wait for tcp_zc_issued() first */
+void tcp_zc_close(void* handle) {
+    TcpZeroCopy* zc = (TcpZeroCopy*)handle;
+    if (!zc) {
+        return;
+    }
+    free(zc->ranges);
+    free(zc);
+}
+
+/* ---- Large transfers ---- */
+
+static int32_t tcp_last_error() {
+#ifdef _WIN32
+    return WSAGetLastError();
+#else
+    return errno;
+#endif
+}
+
+static int64_t tcp_now_ms() {
+#ifdef _WIN32
+    return (int64_t)GetTickCount64();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+#endif
+}
+
+static int64_t tcp_transfer_chunk(int64_t sock, int sending, int32_t timeout_ms) {
+    if (!sending || timeout_ms < 0 || TCP_DONTWAIT != 0) {
+        return TCP_TRANSFER_MAX_CHUNK;
+    }
+    int32_t size = tcp_getsockopt_int(sock, SOL_SOCKET, SO_SNDBUF);
+    return size < TCP_TRANSFER_MIN_CHUNK ? TCP_TRANSFER_MIN_CHUNK : size;
+}
+
+/* Waits until sock is writable (or readable) or the deadline passes.
+ * Returns 1 when ready; 0 or -1 with *status set (TCP_WOULD_BLOCK for
+ * timeout_ms == 0, TCP_ETIMEDOUT, or the poll error). */
+static int tcp_transfer_wait(int64_t sock, int writable, int32_t timeout_ms, int64_t deadline,
+                             int32_t* status) {
+    for (;;) {
+        int wait_ms = -1;
+        if (timeout_ms >= 0) {
+            int64_t left = deadline - tcp_now_ms();
+            wait_ms = left > 0 ? (int)left : 0;
+        }
+        TcpWaitHook hook = tcp_cooperative();
+        if (hook && wait_ms != 0) {
+            /* In a coroutine; a timeout loops back to the final poll below */
+            int ready = hook(sock, writable ? TCP_WAIT_WRITE : TCP_WAIT_READ, wait_ms);
+            if (ready > 0) {
+                return 1;
+            }
+            if (ready < 0) {
+                *status = tcp_last_error();
+                return -1;
+            }
+            continue;
+        }
+#ifdef _WIN32
+        WSAPOLLFD pfd;
+        pfd.fd = (SOCKET)sock;
+        pfd.events = writable ? POLLWRNORM : POLLRDNORM;
+        pfd.revents = 0;
+        int ready = WSAPoll(&pfd, 1, wait_ms);
+#else
+        struct pollfd pfd = { (int)sock, (short)(writable ? POLLOUT : POLLIN), 0 };
+        int ready = poll(&pfd, 1, wait_ms);
+        if (ready < 0 && errno == EINTR) {
+            continue;
+        }
+#endif
+        if (ready < 0) {
+            *status = tcp_last_error();
+            return -1;
+        }
+        if (ready > 0) {
+            /* Errors and hangups count as ready: the next call reports them */
+            if (pfd.revents & POLLNVAL) {
+#ifdef _WIN32
+                *status = WSAENOTSOCK;
+#else
+                *status = EBADF;
+#endif
+                return -1;
+            }
+            return 1;
+        }
+        if (wait_ms != 0) {
+            continue;   /* Woke early; poll the remainder */
+        }
+        *status = timeout_ms == 0 ? TCP_WOULD_BLOCK : TCP_ETIMEDOUT;
+        return 0;
+    }
+}
+
+/**
+ * Sends all len bytes of data; len may exceed INT32_MAX (multi-GB buffers go
+ * in one call).
+ *
+ * Unlike tcp_send() the result is always the progress made, even when the
+ * transfer stops early, so the caller can resume with data + result and
+ * len - result. Why it stopped is stored in *status (may be NULL):
+ * - 0: everything was sent
+ * - TCP_WOULD_BLOCK: timeout_ms == 0 and the send buffer is full; retry when
+ *   the socket is writable (the nonblocking, reactor-driven mode)
+ * - ETIMEDOUT: timeout_ms > 0 elapsed before everything was sent
+ * - any other errno (WSA error code on Windows): the connection failed
+ *
+ * timeout_ms < 0 waits as long as it takes, on blocking and nonblocking
+ * sockets alike. With a deadline, sends never block past it (MSG_DONTWAIT
+ * plus poll()). SIGPIPE is suppressed where the platform allows it.
+ *
+ * @return Bytes sent by this call (0 <= result <= len)
+ */
+int64_t tcp_send_all64(int64_t sock, const char* data, int64_t len, int32_t timeout_ms, int32_t* status) {
+    int32_t ignored;
+    if (status == NULL) {
+        status = &ignored;
+    }
+    *status = 0;
+    if (len < 0 || (len > 0 && data == NULL)) {
+        *status = TCP_EINVAL;
+        return 0;
+    }
+    int64_t deadline = timeout_ms > 0 ? tcp_now_ms() + timeout_ms : 0;
+    int64_t chunk = tcp_transfer_chunk(sock, 1, timeout_ms);
+    int flags = MSG_NOSIGNAL | (timeout_ms >= 0 ? TCP_DONTWAIT : tcp_cooperative_flags());
+    int64_t sent = 0;
+    while (sent < len) {
+        int64_t want = len - sent < chunk ? len - sent : chunk;
+        if (TCP_DONTWAIT == 0 && timeout_ms >= 0 && tcp_transfer_wait(sock, 1, timeout_ms, deadline, status) <= 0) {
+            return sent;
+        }
+#ifdef _WIN32
+        int n = send((SOCKET)sock, data + sent, (int)want, flags);
+        if (n == SOCKET_ERROR && WSAGetLastError() == WSAEINTR) {
+            continue;
+        }
+        if (n == SOCKET_ERROR) {
+            n = -1;
+        }
+#else
+        ssize_t n = send((int)sock, data + sent, (size_t)want, flags);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+#endif
+        if (n >= 0) {
+            sent += n;
+            continue;
+        }
+        if (!tcp_would_block()) {
+            *status = tcp_last_error();
+            return sent;
+        }
+        if (timeout_ms == 0) {
+            *status = TCP_WOULD_BLOCK;
+            return sent;
+        }
+        if (tcp_transfer_wait(sock, 1, timeout_ms, deadline, status) <= 0) {
+            return sent;
+        }
+    }
+    return sent;
+}
+
+/**
+ * Receives exactly len bytes into buf (len may exceed INT32_MAX), the
+ * counterpart of tcp_send_all64(): the result is the bytes received by this
+ * call and *status (may be NULL) says why it stopped short. Status is 0 once
+ * buf is full, TCP_EOF (-3) if the peer closed first, and otherwise as for
+ * tcp_send_all64(). Resume with buf + result and len - result.
+ *
+ * @return Bytes received by this call (0 <= result <= len)
+ */
+int64_t tcp_recv_exact64(int64_t sock, char* buf, int64_t len, int32_t timeout_ms, int32_t* status) {
+    int32_t ignored;
+    if (status == NULL) {
+        status = &ignored;
+    }
+    *status = 0;
+    if (len < 0 || (len > 0 && buf == NULL)) {
+        *status = TCP_EINVAL;
+        return 0;
+    }
+    int64_t deadline = timeout_ms > 0 ? tcp_now_ms() + timeout_ms : 0;
+    int64_t chunk = tcp_transfer_chunk(sock, 0, timeout_ms);
+    int flags = timeout_ms >= 0 ? TCP_DONTWAIT : tcp_cooperative_flags();
+    int64_t received = 0;
+    while (received < len) {
+        int64_t want = len - received < chunk ? len - received : chunk;
+        if (TCP_DONTWAIT == 0 && timeout_ms >= 0 && tcp_transfer_wait(sock, 0, timeout_ms, deadline, status) <= 0) {
+            return received;
+        }
+#ifdef _WIN32
+        int n = recv((SOCKET)sock, buf + received, (int)want, flags);
+        if (n == SOCKET_ERROR && WSAGetLastError() == WSAEINTR) {
+            continue;
+        }
+        if (n == SOCKET_ERROR) {
+            n = -1;
+        }
+#else
+        ssize_t n = recv((int)sock, buf + received, (size_t)want, flags);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+#endif
+        if (n > 0) {
+            received += n;
+            continue;
+        }
+        if (n == 0) {
+            *status = TCP_EOF;
+            return received;
+        }
+        if (!tcp_would_block()) {
+            *status = tcp_last_error();
+            return received;
+        }
+        if (timeout_ms == 0) {
+            *status = TCP_WOULD_BLOCK;
+            return received;
+        }
+        if (tcp_transfer_wait(sock, 0, timeout_ms, deadline, status) <= 0) {
+            return received;
+        }
+    }
+    return received;
+}
+
+/* ---- File transfer ---- */
+
+#ifdef __linux__
+/* Kernel-side copy straight from the page cache: no userspace buffer at all.
+ * Returns 1 when done (or stopped with a result in *status), 0 if sendfile is
+ * unsupported for this file/socket pair and nothing was sent. */
+static int tcp_send_file_sendfile(int64_t sock, int64_t file_fd, int64_t offset, int64_t len,
+                                  int64_t* sent, int64_t* status) {
+    while (*sent < len) {
+        off_t pos = (off_t)(offset + *sent);
+        int64_t chunk = len - *sent;
+        if (chunk > TCP_SENDFILE_MAX_CHUNK) {
+            chunk = TCP_SENDFILE_MAX_CHUNK;
+        }
+        ssize_t n = sendfile((int)sock, (int)file_fd, &pos, (size_t)chunk);
+        if (n > 0) {
+            *sent += n;
+            continue;
+        }
+        if (n == 0) {
+            break;  /* File shrank underneath us */
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            *status = *sent > 0 ? *sent : TCP_WOULD_BLOCK;
+            return 1;
+        }
+        if (*sent == 0 && (errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP)) {
+            return 0;
+        }
+        *status = *sent > 0 ? *sent : -1;
+        return 1;
+    }
+    *status = *sent;
+    return 1;
+}
+
+/* Move everything in the pipe to the socket. 1 when drained; 0 on error or
+ * when a nonblocking socket fills up (errno EAGAIN). Bytes left in the pipe
+ * are not lost: the file is read at explicit offsets, so the caller resumes
+ * from offset + sent and they are spliced from the file again. */
+static int tcp_splice_drain(int64_t sock, int pipe_read, int64_t in_pipe, int64_t* sent) {
+    while (in_pipe > 0) {
+        ssize_t n = splice(pipe_read, NULL, (int)sock, NULL, (size_t)in_pipe, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (n > 0) {
+            in_pipe -= n;
+            *sent += n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        return 0;
+    }
+    return 1;
+}
+
+/* File -> pipe -> socket: still no userspace copy, works where sendfile
+ * does not (e.g. some filesystems or socket types). Same contract as above. */
+static int tcp_send_file_splice(int64_t sock, int64_t file_fd, int64_t offset, int64_t len,
+                                int64_t* sent, int64_t* status) {
+    int pipe_fds[2];
+    if (pipe2(pipe_fds, O_CLOEXEC) < 0) {
+        return 0;
+    }
+    fcntl(pipe_fds[1], F_SETPIPE_SZ, TCP_SPLICE_PIPE_SIZE);
+    
+    int supported = 1;
+    *status = -1;
+    while (*sent < len) {
+        loff_t pos = (loff_t)(offset + *sent);
+        int64_t chunk = len - *sent;
+        if (chunk > TCP_SPLICE_PIPE_SIZE) {
+            chunk = TCP_SPLICE_PIPE_SIZE;
+        }
+        ssize_t n = splice((int)file_fd, &pos, pipe_fds[1], NULL, (size_t)chunk, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            if (*sent == 0 && (errno == EINVAL || errno == ENOSYS)) {
+                supported = 0;
+            }
+            *status = *sent > 0 ? *sent : -1;
+            break;
+        }
+        if (n == 0) {
+            *status = *sent;  /* File shrank */
+            break;
+        }
+        if (!tcp_splice_drain(sock, pipe_fds[0], n, sent)) {
+            if (*sent > 0) {
+                *status = *sent;
+            } else {
+                *status = (errno == EAGAIN || errno == EWOULDBLOCK) ? TCP_WOULD_BLOCK : -1;
+            }
+            break;
+        }
+        *status = *sent;
+    }
+    
+    int error = errno;
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+    errno = error;
+    return supported;
+}
+#endif
+
+static int64_t tcp_pread(int64_t file_fd, char* buf, int64_t len, int64_t offset) {
+#ifdef _WIN32
+    if (_lseeki64((int)file_fd, offset, SEEK_SET) < 0) {
+        return -1;
+    }
+    return _read((int)file_fd, buf, (unsigned int)len);
+#else
+    ssize_t n;
+    do {
+        n = pread((int)file_fd, buf, (size_t)len, (off_t)offset);
+    } while (n < 0 && errno == EINTR);
+    return n;
+#endif
+}
+
+/* Portable fallback: pread() into a buffer and send() it. Bytes read but not
+ * accepted by the socket are simply read again on the next call. */
+static int64_t tcp_send_file_buffered(int64_t sock, int64_t file_fd, int64_t offset, int64_t len, int64_t sent) {
+    char* buffer = malloc(TCP_SEND_FILE_BUF_SIZE);
+    if (!buffer) {
+        return sent > 0 ? sent : -1;
+    }
+    
+    while (sent < len) {
+        int64_t chunk = len - sent;
+        if (chunk > TCP_SEND_FILE_BUF_SIZE) {
+            chunk = TCP_SEND_FILE_BUF_SIZE;
+        }
+        int64_t n = tcp_pread(file_fd, buffer, chunk, offset + sent);
+        if (n <= 0) {
+            if (n < 0 && sent == 0) {
+                sent = -1;
+            }
+            break;
+        }
+        int64_t done = 0;
+        while (done < n) {
+            int64_t w = tcp_try_send(sock, buffer + done, n - done);
+            if (w < 0) {
+                free(buffer);
+                if (sent + done > 0) {
+                    return sent + done;
+                }
+                return w;  /* -1 or TCP_WOULD_BLOCK */
+            }
+            done += w;
+        }
+        sent += n;
+    }
+    
+    free(buffer);
+    return sent;
+}
+
+/**
+ * Sends len bytes of an open file, starting at offset, over a TCP socket.
+ *
+ * Data goes from the page cache to the socket without passing through
+ * userspace: sendfile() first, then splice() through a pipe where sendfile
+ * is not supported, then a pread()/send() loop as the last resort (and on
+ * non-Linux platforms). Memory use is flat regardless of file size, and the
+ * file position is not used or changed.
+ *
+ * len < 0 sends everything from offset to the end of the file. Lengths and
+ * offsets are 64-bit; transfers larger than one sendfile() call are chunked.
+ *
+ * On a blocking socket the call returns once len bytes are sent (fewer if
+ * the file is shorter). On a nonblocking socket it returns as soon as the
+ * socket fills up; resume with offset + result once it is writable again.
+ *
+ * @param sock Connected socket
+ * @param file_fd Readable file descriptor (see file_descriptor() in file.c)
+ * @return Bytes sent, TCP_WOULD_BLOCK (-2) if nothing could be sent yet, or
+ *         -1 on error (after partial progress, the progress is returned and
+ *         the error reappears on the next call)
+ */
+int64_t tcp_send_file(int64_t sock, int64_t file_fd, int64_t offset, int64_t len) {
+    if (file_fd < 0 || offset < 0) {
+        tcp_set_error(EINVAL);
+        return -1;
+    }
+    
+    struct stat st;
+    if (fstat((int)file_fd, &st) < 0) {
+        return -1;
+    }
+    if ((st.st_mode & S_IFMT) == S_IFREG) {
+        int64_t available = (int64_t)st.st_size > offset ? (int64_t)st.st_size - offset : 0;
+        if (len < 0 || len > available) {
+            len = available;
+        }
+    } else if (len < 0) {
+        tcp_set_error(EINVAL);  /* No end to send up to */
+        return -1;
+    }
+    if (len == 0) {
+        return 0;
+    }
+    
+    int64_t sent = 0;
+#ifdef __linux__
+    int64_t status;
+    if (tcp_send_file_sendfile(sock, file_fd, offset, len, &sent, &status)) {
+        return status;
+    }
+    if (tcp_send_file_splice(sock, file_fd, offset, len, &sent, &status)) {
+        return status;
+    }
+#endif
+    return tcp_send_file_buffered(sock, file_fd, offset, len, sent);
+}
+
+/* ---- Server side ---- */
+
+/* Create, configure and bind one resolved address; stream sockets also listen.
+ * flags are TCP_LISTEN_* (UDP_BIND_* share the values). */
+static int64_t tcp_listen_on(const struct addrinfo* ai, int32_t backlog, int32_t flags) {
+    int64_t sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (sock < 0) {
+        return -1;
+    }
+    
+    int one = 1;
+#ifndef _WIN32
+    /* On Windows SO_REUSEADDR lets another process steal the port; the
+     * default there already allows quick rebinding after TIME_WAIT */
+    if ((flags & TCP_LISTEN_REUSEADDR) &&
+        setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (const char*)&one, sizeof(one)) < 0) {
+        tcp_close(sock);
+        return -1;
+    }
+#endif
+    if (flags & TCP_LISTEN_REUSEPORT) {
+#ifdef SO_REUSEPORT
+        if (setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, (const char*)&one, sizeof(one)) < 0) {
+            tcp_close(sock);
+            return -1;
+        }
+#else
+        tcp_close(sock);
+        tcp_set_error(ENOPROTOOPT);
+        return -1;
+#endif
+    }
+    if (ai->ai_family == AF_INET6) {
+        /* Dual-stack unless asked otherwise, so "::" also accepts IPv4 */
+        int v6only = (flags & TCP_LISTEN_V6ONLY) ? 1 : 0;
+        setsockopt(sock, IPPROTO_IPV6, IPV6_V6ONLY, (const char*)&v6only, sizeof(v6only));
+    }
+    
+    if (bind(sock, ai->ai_addr, (socklen_t)ai->ai_addrlen) < 0 ||
+        (ai->ai_socktype == SOCK_STREAM && listen(sock, backlog > 0 ? backlog : SOMAXCONN) < 0) ||
+        ((flags & TCP_LISTEN_NONBLOCK) && tcp_set_nonblocking(sock, 1) != 0)) {
+        int error = errno;
+        tcp_close(sock);
+        errno = error;
+        return -1;
+    }
+    return sock;
+}
+
+static int64_t tcp_bind_address(const char* address, int32_t port, int socktype, int32_t backlog, int32_t flags);
+
+/**
+ * Opens a listening TCP socket.
+ *
+ * address is a numeric IPv4 or IPv6 address ("127.0.0.1", "::1", "[::1]");
+ * NULL or "" listens on all interfaces, dual-stack where IPv6 is available
+ * and IPv4-only otherwise. Port 0 picks a free port (see tcp_local_port).
+ * backlog <= 0 uses SOMAXCONN.
+ *
+ * Flags: TCP_LISTEN_REUSEADDR (1) allows rebinding while old connections are
+ * in TIME_WAIT, TCP_LISTEN_REUSEPORT (2) lets several sockets share the port
+ * with the kernel spreading connections between them, TCP_LISTEN_NONBLOCK (4)
+ * makes tcp_accept() return TCP_WOULD_BLOCK instead of waiting and
+ * TCP_LISTEN_V6ONLY (8) disables IPv4-mapped connections on IPv6 sockets.
+ *
+ * @return The listening socket, or -1 on error
+ */
+int64_t tcp_listen(const char* address, int32_t port, int32_t backlog, int32_t flags) {
+    return tcp_bind_address(address, port, SOCK_STREAM, backlog, flags);
+}
+
+/* Resolve address ("" = all interfaces) and bind the first that works */
+static int64_t tcp_bind_address(const char* address, int32_t port, int socktype, int32_t backlog, int32_t flags) {
+    if (port < 0 || port > 65535) {
+        tcp_set_error(EINVAL);
+        return -1;
+    }
+    
+    char service[8];
+    snprintf(service, sizeof(service), "%d", port);
+    
+    char host[64];
+    const char* candidates[2] = { "::", "0.0.0.0" };
+    int candidate_count = 2;
+    if (address && *address) {
+        /* Accept the bracketed form used in "host:port" strings */
+        size_t len = strlen(address);
+        if (address[0] == '[' && len >= 2 && address[len - 1] == ']' && len - 2 < sizeof(host)) {
+            memcpy(host, address + 1, len - 2);
+            host[len - 2] = '\0';
+            candidates[0] = host;
+        } else {
+            candidates[0] = address;
+        }
+        candidate_count = 1;
+    }
+    
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = socktype;
+    hints.ai_protocol = socktype == SOCK_STREAM ? IPPROTO_TCP : IPPROTO_UDP;
+    hints.ai_flags = AI_PASSIVE | AI_NUMERICHOST | AI_NUMERICSERV;
+    
+    for (int c = 0; c < candidate_count; c++) {
+        struct addrinfo* result = NULL;
+        if (getaddrinfo(candidates[c], service, &hints, &result) != 0 || !result) {
+            tcp_set_error(EINVAL);
+            continue;
+        }
+        for (struct addrinfo* ai = result; ai; ai = ai->ai_next) {
+            int64_t sock = tcp_listen_on(ai, backlog, flags);
+            if (sock >= 0) {
+                freeaddrinfo(result);
+                return sock;
+            }
+        }
+        freeaddrinfo(result);
+    }
+    return -1;
+}
+
+/**
+ * Accepts one connection from a listening socket.
+ *
+ * With TCP_ACCEPT_NONBLOCK (1) the new socket is created in nonblocking mode
+ * (atomically via accept4(SOCK_NONBLOCK) on Linux), ready for a reactor.
+ * Connections reset before they were accepted are skipped.
+ *
+ * @return The connected socket, TCP_WOULD_BLOCK (-2) if the listener is
+ *         nonblocking and nothing is pending, or -1 on error
+ */
+int64_t tcp_accept(int64_t listener, int32_t flags) {
+    for (;;) {
+#ifndef _WIN32
+        if (tcp_cooperative()) {
+            /* In a coroutine: park until a connection is pending (a
+             * nonblocking listener just returns TCP_WOULD_BLOCK below) */
+            struct pollfd pfd = { (int)listener, POLLIN, 0 };
+            int listener_flags = fcntl((int)listener, F_GETFL, 0);
+            if (listener_flags >= 0 && !(listener_flags & O_NONBLOCK) && poll(&pfd, 1, 0) == 0 &&
+                tcp_wait_hook(listener, TCP_WAIT_READ, -1) < 0) {
+                return -1;
+            }
+        }
+#endif
+#ifdef __linux__
+        int conn_flags = SOCK_CLOEXEC | ((flags & TCP_ACCEPT_NONBLOCK) ? SOCK_NONBLOCK : 0);
+        int64_t conn = accept4((int)listener, NULL, NULL, conn_flags);
+#elif defined(_WIN32)
+        SOCKET raw = accept((SOCKET)listener, NULL, NULL);
+        int64_t conn = raw == INVALID_SOCKET ? -1 : (int64_t)raw;
+#else
+        int64_t conn = accept((int)listener, NULL, NULL);
+#endif
+        if (conn >= 0) {
+#ifndef __linux__
+            if ((flags & TCP_ACCEPT_NONBLOCK) && tcp_set_nonblocking(conn, 1) != 0) {
+                tcp_close(conn);
+                return -1;
+            }
+#endif
+            return conn;
+        }
+#ifdef _WIN32
+        int error = WSAGetLastError();
+        if (error == WSAEINTR || error == WSAECONNRESET) {
+            continue;
+        }
+#else
+        if (errno == EINTR || errno == ECONNABORTED) {
+            continue;
+        }
+#endif
+        return tcp_would_block() ? TCP_WOULD_BLOCK : -1;
+    }
+}
+
+/* Port a socket is bound to (useful after listening on port 0), or -1 */
+int32_t tcp_local_port(int64_t sock) {
+    struct sockaddr_storage addr;
+    socklen_t addr_len = sizeof(addr);
+    if (getsockname(sock, (struct sockaddr*)&addr, &addr_len) < 0) {
+        return -1;
+    }
+    if (addr.ss_family == AF_INET) {
+        return ntohs(((struct sockaddr_in*)&addr)->sin_port);
+    }
+    if (addr.ss_family == AF_INET6) {
+        return ntohs(((struct sockaddr_in6*)&addr)->sin6_port);
+    }
+    return -1;
+}
+
+static int32_t tcp_format_address(const struct sockaddr_storage* addr, char* buf, int32_t cap);
+
+/**
+ * Writes the peer address of a connected socket as "ip:port" (IPv6 as
+ * "[ip]:port") into buf, NUL-terminated.
+ *
+ * @return Length written (excluding the NUL), or -1 on error / short buffer
+ */
+int32_t tcp_peer_address(int64_t sock, char* buf, int32_t cap) {
+    struct sockaddr_storage addr;
+    socklen_t addr_len = sizeof(addr);
+    if (!buf || cap <= 0 || getpeername(sock, (struct sockaddr*)&addr, &addr_len) < 0) {
+        return -1;
+    }
+    return tcp_format_address(&addr, buf, cap);
+}
+
+/* "ip:port" / "[ip]:port" for addr into buf; length or -1 */
+static int32_t tcp_format_address(const struct sockaddr_storage* addr_in, char* buf, int32_t cap) {
+    struct sockaddr_storage addr = *addr_in;
+    char ip[64];
+    int port;
+    int written;
+    if (addr.ss_family == AF_INET) {
+        struct sockaddr_in* in4 = (struct sockaddr_in*)&addr;
+        if (!inet_ntop(AF_INET, &in4->sin_addr, ip, sizeof(ip))) {
+            return -1;
+        }
+        port = ntohs(in4->sin_port);
+        written = snprintf(buf, (size_t)cap, "%s:%d", ip, port);
+    } else if (addr.ss_family == AF_INET6) {
+        struct sockaddr_in6* in6 = (struct sockaddr_in6*)&addr;
+        port = ntohs(in6->sin6_port);
+        if (IN6_IS_ADDR_V4MAPPED(&in6->sin6_addr)) {
+            /* IPv4 client of a dual-stack listener */
+            if (!inet_ntop(AF_INET, &in6->sin6_addr.s6_addr[12], ip, sizeof(ip))) {
+                return -1;
+            }
+            written = snprintf(buf, (size_t)cap, "%s:%d", ip, port);
+        } else {
+            if (!inet_ntop(AF_INET6, &in6->sin6_addr, ip, sizeof(ip))) {
+                return -1;
+            }
+            written = snprintf(buf, (size_t)cap, "[%s]:%d", ip, port);
+        }
+    } else {
+        return -1;
+    }
+    return (written < 0 || written >= cap) ? -1 : written;
+}
+
+/* TCP_NODELAY: send small writes immediately instead of coalescing them (Nagle) */
+int32_t tcp_set_nodelay(int64_t sock, int32_t enabled) {
+    return tcp_setsockopt_int(sock, IPPROTO_TCP, TCP_NODELAY, enabled ? 1 : 0);
+}
+
+/**
+ * Turns SO_KEEPALIVE probing on or off. With keepalive on, a connection idle
+ * for idle_s seconds is probed every interval_s seconds and dropped after
+ * count unanswered probes, so dead peers behind NATs and load balancers are
+ * noticed. Values <= 0 keep the system default (two hours idle on Linux);
+ * where the platform cannot tune a value it is silently left alone.
+ *
+ * @return 0 on success, -1 on error
+ */
+int32_t tcp_set_keepalive(int64_t sock, int32_t enabled, int32_t idle_s, int32_t interval_s, int32_t count) {
+    if (tcp_setsockopt_int(sock, SOL_SOCKET, SO_KEEPALIVE, enabled ? 1 : 0) != 0) {
+        return -1;
+    }
+    if (!enabled) {
+        return 0;
+    }
+#if defined(TCP_KEEPIDLE)
+    if (idle_s > 0 && tcp_setsockopt_int(sock, IPPROTO_TCP, TCP_KEEPIDLE, idle_s) != 0) {
+        return -1;
+    }
+#elif defined(TCP_KEEPALIVE)
+    if (idle_s > 0 && tcp_setsockopt_int(sock, IPPROTO_TCP, TCP_KEEPALIVE, idle_s) != 0) {
+        return -1;
+    }
+#endif
+#ifdef TCP_KEEPINTVL
+    if (interval_s > 0 && tcp_setsockopt_int(sock, IPPROTO_TCP, TCP_KEEPINTVL, interval_s) != 0) {
+        return -1;
+    }
+#endif
+#ifdef TCP_KEEPCNT
+    if (count > 0 && tcp_setsockopt_int(sock, IPPROTO_TCP, TCP_KEEPCNT, count) != 0) {
+        return -1;
+    }
+#endif
+    (void)idle_s;
+    (void)interval_s;
+    (void)count;
+    return 0;
+}
+
+/**
+ * Sets SO_SNDBUF / SO_RCVBUF; a size <= 0 leaves that buffer alone. Setting
+ * either disables the kernel's automatic tuning for it, so only do this to
+ * cap memory per connection or to fit a known bandwidth-delay product. Set
+ * the receive buffer before connecting or listening to affect the window
+ * scale. The kernel may round the size (Linux doubles it for bookkeeping);
+ * read the result back with tcp_send_buffer_size() / tcp_recv_buffer_size().
+ *
+ * @return 0 on success, -1 on error
+ */
+int32_t tcp_set_buffer_sizes(int64_t sock, int32_t send_bytes, int32_t recv_bytes) {
+    if (send_bytes > 0 && tcp_setsockopt_int(sock, SOL_SOCKET, SO_SNDBUF, send_bytes) != 0) {
+        return -1;
+    }
+    if (recv_bytes > 0 && tcp_setsockopt_int(sock, SOL_SOCKET, SO_RCVBUF, recv_bytes) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+int32_t tcp_send_buffer_size(int64_t sock) {
+    return tcp_getsockopt_int(sock, SOL_SOCKET, SO_SNDBUF);
+}
+
+int32_t tcp_recv_buffer_size(int64_t sock) {
+    return tcp_getsockopt_int(sock, SOL_SOCKET, SO_RCVBUF);
+}
+
+/**
+ * TCP_QUICKACK (Linux): acknowledge received data immediately instead of
+ * delaying ACKs, which removes the ~40 ms stall of request/response traffic
+ * that meets Nagle on the other side. The kernel may drop back to delayed
+ * ACKs on its own, so latency-sensitive callers re-enable it after reads.
+ *
+ * @return 0 on success, -1 on error or where unsupported (EOPNOTSUPP)
+ */
+int32_t tcp_set_quickack(int64_t sock, int32_t enabled) {
+#ifdef TCP_QUICKACK
+    return tcp_setsockopt_int(sock, IPPROTO_TCP, TCP_QUICKACK, enabled ? 1 : 0);
+#else
+    (void)sock;
+    (void)enabled;
+    tcp_set_error(EOPNOTSUPP);
+    return -1;
+#endif
+}
+
+/*
+ * Multi-acceptor group: one SO_REUSEPORT listener per worker.
+ *
+ * A single listener shared by N threads serialises every accept on the
+ * socket's queue lock and wakes all waiters for each connection. With one
+ * listener per worker the kernel hashes each incoming connection to one of
+ * the sockets, so every worker accepts from its own queue (typically from
+ * its own reactor) with no shared lock and no thundering herd.
+ *
+ * Listeners are nonblocking. Where SO_REUSEPORT is unavailable the group
+ * degrades to a single listener. Closing a listener resets connections still
+ * waiting in its queue, so stop workers before closing the group.
+ */
+typedef struct {
+    int64_t* listeners;
+    int32_t count;
+    int32_t port;
+} AcceptorGroup;
+
+static int32_t tcp_cpu_count() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int32_t)info.dwNumberOfProcessors : 1;
+#else
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? (int32_t)cpus : 1;
+#endif
+}
+
+void tcp_acceptor_group_close(void* handle);
+
+/* Open count listeners (count <= 0: one per online CPU); NULL on failure */
+void* tcp_acceptor_group_open(const char* address, int32_t port, int32_t backlog, int32_t count) {
+    if (count <= 0) {
+        count = tcp_cpu_count();
+    }
+    int32_t flags = TCP_LISTEN_REUSEADDR | TCP_LISTEN_NONBLOCK;
+#ifdef SO_REUSEPORT
+    flags |= TCP_LISTEN_REUSEPORT;
+#else
+    count = 1;
+#endif
+    
+    AcceptorGroup* group = calloc(1, sizeof(AcceptorGroup));
+    if (!group) {
+        return NULL;
+    }
+    group->listeners = malloc((size_t)count * sizeof(int64_t));
+    if (!group->listeners) {
+        free(group);
+        return NULL;
+    }
+    
+    for (int32_t i = 0; i < count; i++) {
+        /* With port 0 the first socket picks the port and the rest join it */
+        int64_t sock = tcp_listen(address, i == 0 ? port : group->port, backlog, flags);
+        if (sock < 0) {
+            tcp_acceptor_group_close(group);
+            return NULL;
+        }
+        group->listeners[group->count++] = sock;
+        if (i == 0) {
+            group->port = tcp_local_port(sock);
+            if (group->port < 0) {
+                tcp_acceptor_group_close(group);
+                return NULL;
+            }
+        }
+    }
+    return group;
+}
+
+int32_t tcp_acceptor_group_size(void* handle) {
+    AcceptorGroup* group = (AcceptorGroup*)handle;
+    return group ? group->count : 0;
+}
+
+/* Listener for worker index (0 <= index < size), or -1 */
+int64_t tcp_acceptor_group_listener(void* handle, int32_t index) {
+    AcceptorGroup* group = (AcceptorGroup*)handle;
+    if (!group || index < 0 || index >= group->count) {
+        return -1;
+    }
+    return group->listeners[index];
+}
+
+int32_t tcp_acceptor_group_port(void* handle) {
+    AcceptorGroup* group = (AcceptorGroup*)handle;
+    return group ? group->port : -1;
+}
+
+void tcp_acceptor_group_close(void* handle) {
+    AcceptorGroup* group = (AcceptorGroup*)handle;
+    if (!group) {
+        return;
+    }
+    for (int32_t i = 0; i < group->count; i++) {
+        tcp_close(group->listeners[i]);
+    }
+    free(group->listeners);
+    free(group);
+}
+
+void tcp_close(int64_t sock) {
+    /* Coroutines waiting on sock are woken before the number is reused */
+    if (tcp_wait_hook) {
+        tcp_wait_hook(sock, 0, 0);
+    }
+#ifdef _WIN32
+    closesocket(sock);
+#else
+    close(sock);
+#endif
+}
+
+
+/* ---- UDP ---- */
+
+/**
+ * Opens a UDP socket bound to address:port (numeric; NULL or "" = all
+ * interfaces, dual-stack where available; port 0 picks a free port, see
+ * tcp_local_port). Flags are UDP_BIND_REUSEADDR (1), UDP_BIND_REUSEPORT (2)
+ * to spread datagrams over one socket per worker, UDP_BIND_NONBLOCK (4) and
+ * UDP_BIND_V6ONLY (8).
+ *
+ * @return The socket, or -1 on error
+ */
+int64_t udp_bind(const char* address, int32_t port, int32_t flags) {
+    return tcp_bind_address(address, port, SOCK_DGRAM, 0, flags);
+}
+
+/* Resolve a numeric address for sock's family (IPv4 becomes v4-mapped on
+ * an IPv6 socket). Returns 0, or -1 with EINVAL. */
+static int udp_resolve(int64_t sock, const char* address, int32_t port,
+                       struct sockaddr_storage* out, socklen_t* out_len) {
+    struct sockaddr_storage local;
+    socklen_t local_len = sizeof(local);
+    if (!address || port < 0 || port > 65535 ||
+        getsockname(sock, (struct sockaddr*)&local, &local_len) < 0) {
+        tcp_set_error(EINVAL);
+        return -1;
+    }
+    char service[8];
+    snprintf(service, sizeof(service), "%d", port);
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = local.ss_family;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV | (local.ss_family == AF_INET6 ? AI_V4MAPPED : 0);
+    struct addrinfo* result = NULL;
+    if (getaddrinfo(address, service, &hints, &result) != 0 || !result) {
+        tcp_set_error(EINVAL);
+        return -1;
+    }
+    memcpy(out, result->ai_addr, result->ai_addrlen);
+    *out_len = (socklen_t)result->ai_addrlen;
+    freeaddrinfo(result);
+    return 0;
+}
+
+/* Fix the peer for udp_send()/udp_send_batch()/udp_send_gso() and drop
+ * datagrams from anyone else. Returns 0 or -1. */
+int32_t udp_connect(int64_t sock, const char* address, int32_t port) {
+    struct sockaddr_storage peer;
+    socklen_t peer_len;
+    if (udp_resolve(sock, address, port, &peer, &peer_len) != 0) {
+        return -1;
+    }
+    return connect(sock, (struct sockaddr*)&peer, peer_len) == 0 ? 0 : -1;
+}
+
+/* One datagram to the connected peer: len, TCP_WOULD_BLOCK or -1 */
+int64_t udp_send(int64_t sock, const char* data, int64_t len) {
+    if (len < 0 || len > UDP_MAX_PAYLOAD || (len > 0 && data == NULL)) {
+        tcp_set_error(EINVAL);
+        return -1;
+    }
+    for (;;) {
+#ifdef _WIN32
+        int sent = send((SOCKET)sock, data, (int)len, 0);
+        if (sent != SOCKET_ERROR) {
+            return sent;
+        }
+        if (WSAGetLastError() == WSAEINTR) {
+            continue;
+        }
+#else
+        ssize_t sent = send((int)sock, data, (size_t)len, MSG_NOSIGNAL);
+        if (sent >= 0) {
+            return (int64_t)sent;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+#endif
+        return tcp_would_block() ? TCP_WOULD_BLOCK : -1;
+    }
+}
+
+/* One datagram to address:port (resolved per call; connect for hot paths) */
+int64_t udp_send_to(int64_t sock, const char* data, int64_t len, const char* address, int32_t port) {
+    struct sockaddr_storage peer;
+    socklen_t peer_len;
+    if (len < 0 || len > UDP_MAX_PAYLOAD || (len > 0 && data == NULL)) {
+        tcp_set_error(EINVAL);
+        return -1;
+    }
+    if (udp_resolve(sock, address, port, &peer, &peer_len) != 0) {
+        return -1;
+    }
+    for (;;) {
+#ifdef _WIN32
+        int sent = sendto((SOCKET)sock, data, (int)len, 0, (struct sockaddr*)&peer, peer_len);
+        if (sent != SOCKET_ERROR) {
+            return sent;
+        }
+        if (WSAGetLastError() == WSAEINTR) {
+            continue;
+        }
+#else
+        ssize_t sent = sendto((int)sock, data, (size_t)len, MSG_NOSIGNAL, (struct sockaddr*)&peer, peer_len);
+        if (sent >= 0) {
+            return (int64_t)sent;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+#endif
+        return tcp_would_block() ? TCP_WOULD_BLOCK : -1;
+    }
+}
+
+/* One datagram (truncated to len): its length, TCP_WOULD_BLOCK or -1 */
+int64_t udp_recv(int64_t sock, char* buf, int64_t len) {
+    if (len < 0 || (len > 0 && buf == NULL)) {
+        tcp_set_error(EINVAL);
+        return -1;
+    }
+    int64_t want = len > UDP_RING_GRO_SLOT_SIZE ? UDP_RING_GRO_SLOT_SIZE : len;
+    for (;;) {
+#ifdef _WIN32
+        int received = recv((SOCKET)sock, buf, (int)want, 0);
+        if (received != SOCKET_ERROR) {
+            return received;
+        }
+        int error = WSAGetLastError();
+        if (error == WSAEINTR) {
+            continue;
+        }
+        if (error == WSAEMSGSIZE) {
+            return want;
+        }
+#else
+        ssize_t received = recv((int)sock, buf, (size_t)want, 0);
+        if (received >= 0) {
+            return (int64_t)received;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+#endif
+        return tcp_would_block() ? TCP_WOULD_BLOCK : -1;
+    }
+}
+
+/**
+ * Sends count datagrams to the connected peer, UDP_BATCH per sendmmsg() on
+ * Linux (one send() each elsewhere). On a nonblocking socket it stops when
+ * the send buffer fills.
+ *
+ * @return Datagrams sent (the first result of them went out, in order),
+ *         TCP_WOULD_BLOCK if none could be, or -1 on error
+ */
+int32_t udp_send_batch(int64_t sock, const String* datagrams, int32_t count) {
+    if (count < 0 || (count > 0 && datagrams == NULL)) {
+        tcp_set_error(EINVAL);
+        return -1;
+    }
+    for (int32_t i = 0; i < count; i++) {
+        if (datagrams[i].len < 0 || datagrams[i].len > UDP_MAX_PAYLOAD ||
+            (datagrams[i].len > 0 && datagrams[i].data == NULL)) {
+            tcp_set_error(EINVAL);
+            return -1;
+        }
+    }
+    int32_t sent = 0;
+#ifdef __linux__
+    struct mmsghdr msgs[UDP_BATCH];
+    struct iovec iov[UDP_BATCH];
+    while (sent < count) {
+        int32_t batch = count - sent < UDP_BATCH ? count - sent : UDP_BATCH;
+        memset(msgs, 0, (size_t)batch * sizeof(msgs[0]));
+        for (int32_t i = 0; i < batch; i++) {
+            iov[i].iov_base = datagrams[sent + i].data;
+            iov[i].iov_len = (size_t)datagrams[sent + i].len;
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        int n = sendmmsg((int)sock, msgs, (unsigned int)batch, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (sent > 0) {
+                return sent;
+            }
+            return tcp_would_block() ? TCP_WOULD_BLOCK : -1;
+        }
+        sent += n;
+        if (n < batch) {
+            break;   /* Send buffer full or an error on datagram n */
+        }
+    }
+#else
+    while (sent < count) {
+        int64_t n = udp_send(sock, datagrams[sent].data, datagrams[sent].len);
+        if (n < 0) {
+            if (sent > 0) {
+                return sent;
+            }
+            return (int32_t)n;
+        }
+        sent++;
+    }
+#endif
+    return sent;
+}
+
+/**
+ * Sends data to the connected peer as consecutive segment_size datagrams
+ * (the last may be shorter). On Linux each sendmsg() carries up to
+ * UDP_MAX_SEGMENTS of them with UDP_SEGMENT, so the kernel splits them
+ * (generic segmentation offload: one trip down the stack per 64 KiB instead
+ * of per datagram). Where GSO is unavailable it falls back to batches.
+ *
+ * @return Bytes sent (whole datagrams), TCP_WOULD_BLOCK, or -1 on error
+ */
+int64_t udp_send_gso(int64_t sock, const char* data, int64_t len, int32_t segment_size) {
+    if (len < 0 || (len > 0 && data == NULL) || segment_size <= 0 || segment_size > UDP_MAX_PAYLOAD) {
+        tcp_set_error(EINVAL);
+        return -1;
+    }
+    int64_t sent = 0;
+#ifdef __linux__
+    int64_t per_call = (int64_t)(UDP_MAX_PAYLOAD / segment_size);
+    if (per_call > UDP_MAX_SEGMENTS) {
+        per_call = UDP_MAX_SEGMENTS;
+    }
+    per_call *= segment_size;
+    while (sent < len && per_call > segment_size) {
+        int64_t chunk = len - sent < per_call ? len - sent : per_call;
+        struct iovec iov = { (void*)(data + sent), (size_t)chunk };
+        union {
+            char buf[CMSG_SPACE(sizeof(uint16_t))];
+            struct cmsghdr align;
+        } control;
+        memset(&control, 0, sizeof(control));
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        if (chunk > segment_size) {
+            msg.msg_control = control.buf;
+            msg.msg_controllen = sizeof(control.buf);
+            struct cmsghdr* cm = CMSG_FIRSTHDR(&msg);
+            cm->cmsg_level = SOL_UDP;
+            cm->cmsg_type = UDP_SEGMENT;
+            cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            uint16_t gso_size = (uint16_t)segment_size;
+            memcpy(CMSG_DATA(cm), &gso_size, sizeof(gso_size));
+        }
+        ssize_t n = sendmsg((int)sock, &msg, MSG_NOSIGNAL);
+        if (n >= 0) {
+            sent += n;
+            continue;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno == EINVAL || errno == EIO || errno == ENOPROTOOPT || errno == EOPNOTSUPP) {
+            break;   /* No GSO here (old kernel, device without checksum offload) */
+        }
+        if (sent > 0) {
+            return sent;
+        }
+        return tcp_would_block() ? TCP_WOULD_BLOCK : -1;
+    }
+#endif
+    String parts[UDP_BATCH];
+    while (sent < len) {
+        int32_t batch = 0;
+        int64_t batch_bytes = 0;
+        while (batch < UDP_BATCH && sent + batch_bytes < len) {
+            int64_t left = len - sent - batch_bytes;
+            parts[batch].data = (char*)data + sent + batch_bytes;
+            parts[batch].len = left < segment_size ? left : segment_size;
+            batch_bytes += parts[batch].len;
+            batch++;
+        }
+        int32_t n = udp_send_batch(sock, parts, batch);
+        if (n < 0) {
+            return sent > 0 ? sent : n;
+        }
+        for (int32_t i = 0; i < n; i++) {
+            sent += parts[i].len;
+        }
+        if (n < batch) {
+            break;
+        }
+    }
+    return sent;
+}
+
+/* UDP_GRO (Linux): let the kernel coalesce a flow's datagrams into one
+ * buffer per receive; read them through a ring made with UDP_RING_GRO. */
+int32_t udp_set_gro(int64_t sock, int32_t enabled) {
+#ifdef __linux__
+    return tcp_setsockopt_int(sock, SOL_UDP, UDP_GRO, enabled ? 1 : 0);
+#else
+    (void)sock;
+    (void)enabled;
+    tcp_set_error(EOPNOTSUPP);
+    return -1;
+#endif
+}
+
+/*
+ * Datagram ring: preallocated buffers for batched receives.
+ *
+ * Every slot has its buffer, peer address and (on Linux) message header and
+ * control space set up once, so udp_ring_recv() is a single recvmmsg()
+ * that fills up to slots datagrams and allocates nothing. With UDP_RING_GRO
+ * a slot may hold many coalesced datagrams of the same flow; the ring
+ * splits them by the segment size the kernel reports, so callers always
+ * see individual datagrams. Views stay valid until the next receive.
+ * A datagram longer than its slot is cut short and flagged (see
+ * udp_ring_truncated); GRO slots are never smaller than a coalesced buffer,
+ * so a truncated buffer can never be split into short datagrams.
+ */
+typedef struct {
+    int32_t slot;
+    int32_t offset;
+    int32_t len;
+    int32_t truncated;      /* The datagram was longer than its slot */
+} UdpView;
+
+typedef struct {
+    int64_t sock;
+    int32_t slots;
+    int32_t slot_size;
+    int32_t flags;
+    int32_t count;          /* Datagrams from the last receive */
+    int32_t filled;         /* Slots the last receive used */
+    char* buffers;          /* slots * slot_size */
+    struct sockaddr_storage* peers;
+    UdpView* views;
+    int32_t view_capacity;
+#ifdef __linux__
+    struct mmsghdr* msgs;
+    struct iovec* iov;
+    char* control;          /* UDP_RING_CONTROL_SIZE per slot */
+#endif
+} UdpRing;
+
+#ifdef __linux__
+#define UDP_RING_CONTROL_SIZE CMSG_SPACE(sizeof(int))
+#endif
+
+void udp_ring_free(void* handle);
+
+/* Slots and slot_size <= 0 pick defaults (64 KiB slots with UDP_RING_GRO);
+ * datagrams longer than slot_size are truncated and flagged. With
+ * UDP_RING_GRO, slot_size must be at least UDP_RING_GRO_MIN_SLOT (EINVAL
+ * otherwise). NULL on failure. */
+void* udp_ring_new(int64_t sock, int32_t slots, int32_t slot_size, int32_t flags) {
+    if (slots <= 0) {
+        slots = UDP_RING_DEFAULT_SLOTS;
+    }
+    if (slot_size <= 0) {
+        slot_size = (flags & UDP_RING_GRO) ? UDP_RING_GRO_SLOT_SIZE : UDP_RING_DEFAULT_SLOT_SIZE;
+    }
+    if (slot_size > UDP_RING_GRO_SLOT_SIZE || (int64_t)slots * slot_size > INT32_MAX ||
+        ((flags & UDP_RING_GRO) && slot_size < UDP_RING_GRO_MIN_SLOT)) {
+        tcp_set_error(EINVAL);
+        return NULL;
+    }
+    UdpRing* ring = calloc(1, sizeof(UdpRing));
+    if (!ring) {
+        return NULL;
+    }
+    ring->sock = sock;
+    ring->slots = slots;
+    ring->slot_size = slot_size;
+    ring->flags = flags;
+    ring->view_capacity = (flags & UDP_RING_GRO) ? slots * UDP_MAX_SEGMENTS : slots;
+    ring->buffers = malloc((size_t)slots * (size_t)slot_size);
+    ring->peers = calloc((size_t)slots, sizeof(struct sockaddr_storage));
+    ring->views = malloc((size_t)ring->view_capacity * sizeof(UdpView));
+#ifdef __linux__
+    ring->msgs = calloc((size_t)slots, sizeof(struct mmsghdr));
+    ring->iov = calloc((size_t)slots, sizeof(struct iovec));
+    ring->control = calloc((size_t)slots, UDP_RING_CONTROL_SIZE);
+    if (!ring->msgs || !ring->iov || !ring->control) {
+        udp_ring_free(ring);
+        return NULL;
+    }
+    for (int32_t i = 0; i < slots; i++) {
+        ring->iov[i].iov_base = ring->buffers + (size_t)i * (size_t)slot_size;
+        ring->iov[i].iov_len = (size_t)slot_size;
+        ring->msgs[i].msg_hdr.msg_iov = &ring->iov[i];
+        ring->msgs[i].msg_hdr.msg_iovlen = 1;
+        ring->msgs[i].msg_hdr.msg_name = &ring->peers[i];
+        ring->msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+        ring->msgs[i].msg_hdr.msg_control = ring->control + (size_t)i * UDP_RING_CONTROL_SIZE;
+        ring->msgs[i].msg_hdr.msg_controllen = UDP_RING_CONTROL_SIZE;
+    }
+#endif
+    if (!ring->buffers || !ring->peers || !ring->views) {
+        udp_ring_free(ring);
+        return NULL;
+    }
+    if ((flags & UDP_RING_GRO) && udp_set_gro(sock, 1) != 0) {
+        udp_ring_free(ring);
+        return NULL;
+    }
+    return ring;
+}
+
+/* Record slot's len bytes as datagrams, split at the GRO segment size.
+ * A truncated slot is one datagram, whatever the segment size says. */
+static void udp_ring_add(UdpRing* ring, int32_t slot, int32_t len, int32_t segment, int32_t truncated) {
+    if (truncated || segment <= 0 || segment >= len || !(ring->flags & UDP_RING_GRO)) {
+        segment = len;
+    }
+    int32_t offset = 0;
+    do {
+        UdpView* view = &ring->views[ring->count++];
+        view->slot = slot;
+        view->offset = offset;
+        view->len = len - offset < segment ? len - offset : segment;
+        view->truncated = truncated;
+        offset += view->len;
+    } while (offset < len && ring->count < ring->view_capacity);
+}
+
+/**
+ * Receives as many datagrams as are queued, up to one per slot, in one
+ * recvmmsg() on Linux (a recvfrom() loop elsewhere). Blocks for the first
+ * datagram on a blocking socket, never for the rest.
+ *
+ * @return Datagrams received (see udp_ring_datagram), TCP_WOULD_BLOCK on a
+ *         nonblocking socket with nothing queued, or -1 on error
+ */
+int32_t udp_ring_recv(void* handle) {
+    UdpRing* ring = (UdpRing*)handle;
+    if (!ring) {
+        tcp_set_error(EINVAL);
+        return -1;
+    }
+    ring->count = 0;
+#ifdef __linux__
+    /* The kernel overwrote these on the slots it filled last time */
+    for (int32_t i = 0; i < ring->filled; i++) {
+        ring->msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+        ring->msgs[i].msg_hdr.msg_controllen = UDP_RING_CONTROL_SIZE;
+    }
+    ring->filled = 0;
+    int n;
+    do {
+        n = recvmmsg((int)ring->sock, ring->msgs, (unsigned int)ring->slots, MSG_WAITFORONE, NULL);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+        return tcp_would_block() ? TCP_WOULD_BLOCK : -1;
+    }
+    ring->filled = n;
+    for (int32_t i = 0; i < n; i++) {
+        struct msghdr* hdr = &ring->msgs[i].msg_hdr;
+        int32_t segment = 0;
+        for (struct cmsghdr* cm = CMSG_FIRSTHDR(hdr); cm; cm = CMSG_NXTHDR(hdr, cm)) {
+            if (cm->cmsg_level == SOL_UDP && cm->cmsg_type == UDP_GRO) {
+                int value;
+                memcpy(&value, CMSG_DATA(cm), sizeof(value));
+                segment = value;
+            }
+        }
+        int32_t len = (int32_t)ring->msgs[i].msg_len;
+        int32_t truncated = (hdr->msg_flags & MSG_TRUNC) != 0;
+        if (len > ring->slot_size) {
+            len = ring->slot_size;
+            truncated = 1;
+        }
+        udp_ring_add(ring, i, len, segment, truncated);
+    }
+#else
+    /* Wait for the first datagram, then take whatever else is queued
+     * (Winsock has no per-call nonblocking flag: one per receive there) */
+    int32_t limit = TCP_DONTWAIT != 0 ? ring->slots : 1;
+    int32_t i = 0;
+    while (i < limit) {
+        char* slot = ring->buffers + (size_t)i * (size_t)ring->slot_size;
+        socklen_t peer_len = sizeof(struct sockaddr_storage);
+#ifdef _WIN32
+        int32_t truncated = 0;
+        int received = recvfrom((SOCKET)ring->sock, slot, ring->slot_size, 0,
+                                (struct sockaddr*)&ring->peers[i], &peer_len);
+        if (received == SOCKET_ERROR && WSAGetLastError() == WSAEMSGSIZE) {
+            received = ring->slot_size;
+            truncated = 1;
+        }
+        if (received == SOCKET_ERROR) {
+            if (WSAGetLastError() == WSAEINTR) {
+                continue;
+            }
+            return tcp_would_block() ? TCP_WOULD_BLOCK : -1;
+        }
+#else
+        /* recvmsg() rather than recvfrom() for MSG_TRUNC in msg_flags */
+        struct iovec iov = { slot, (size_t)ring->slot_size };
+        struct msghdr hdr;
+        memset(&hdr, 0, sizeof(hdr));
+        hdr.msg_name = &ring->peers[i];
+        hdr.msg_namelen = peer_len;
+        hdr.msg_iov = &iov;
+        hdr.msg_iovlen = 1;
+        ssize_t received = recvmsg((int)ring->sock, &hdr, i == 0 ? 0 : TCP_DONTWAIT);
+        if (received < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (i > 0) {
+                break;
+            }
+            return tcp_would_block() ? TCP_WOULD_BLOCK : -1;
+        }
+        int32_t truncated = (hdr.msg_flags & MSG_TRUNC) != 0;
+#endif
+        udp_ring_add(ring, i, (int32_t)received, 0, truncated);
+        i++;
+    }
+#endif
+    return ring->count;
+}
+
+/* Datagrams from the last udp_ring_recv() */
+int32_t udp_ring_count(void* handle) {
+    UdpRing* ring = (UdpRing*)handle;
+    return ring ? ring->count : 0;
+}
+
+/* Borrowed view of datagram index (valid until the next receive; do not
+ * free). Empty for an index out of range. */
+String udp_ring_datagram(void* handle, int32_t index) {
+    UdpRing* ring = (UdpRing*)handle;
+    String view = { NULL, 0 };
+    if (!ring || index < 0 || index >= ring->count) {
+        return view;
+    }
+    const UdpView* v = &ring->views[index];
+    view.data = ring->buffers + (size_t)v->slot * (size_t)ring->slot_size + v->offset;
+    view.len = v->len;
+    return view;
+}
+
+/* 1 when datagram index was longer than its slot and was cut short, 0 when
+ * it is whole, -1 for an index out of range */
+int32_t udp_ring_truncated(void* handle, int32_t index) {
+    UdpRing* ring = (UdpRing*)handle;
+    if (!ring || index < 0 || index >= ring->count) {
+        return -1;
+    }
+    return ring->views[index].truncated;
+}
+
+/* Sender of datagram index as "ip:port" into buf (see tcp_peer_address) */
+int32_t udp_ring_peer_address(void* handle, int32_t index, char* buf, int32_t cap) {
+    UdpRing* ring = (UdpRing*)handle;
+    if (!ring || index < 0 || index >= ring->count || !buf || cap <= 0) {
+        return -1;
+    }
+    return tcp_format_address(&ring->peers[ring->views[index].slot], buf, cap);
+}
+
+int32_t udp_ring_peer_port(void* handle, int32_t index) {
+    UdpRing* ring = (UdpRing*)handle;
+    if (!ring || index < 0 || index >= ring->count) {
+        return -1;
+    }
+    const struct sockaddr_storage* peer = &ring->peers[ring->views[index].slot];
+    if (peer->ss_family == AF_INET) {
+        return ntohs(((const struct sockaddr_in*)peer)->sin_port);
+    }
+    if (peer->ss_family == AF_INET6) {
+        return ntohs(((const struct sockaddr_in6*)peer)->sin6_port);
+    }
+    return -1;
+}
+
+/* Free the ring (not the socket) */
+void udp_ring_free(void* handle) {
+    UdpRing* ring = (UdpRing*)handle;
+    if (!ring) {
+        return;
+    }
+#ifdef __linux__
+    free(ring->msgs);
+    free(ring->iov);
+    free(ring->control);
+#endif
+    free(ring->buffers);
+    free(ring->peers);
+    free(ring->views);
+    free(ring);
+}
+
+
+/* ---- Unix domain sockets ---- */
+
+/* Stream sockets reuse the TCP calls once connected: tcp_accept, tcp_send,
+ * tcp_recv, the vectored and 64-bit transfers, tcp_close (and so the
+ * coroutine hook). A path starting with '@' names a socket in the Linux
+ * abstract namespace: nothing on disk, gone with its last descriptor. */
+
+#ifndef _WIN32
+
+/* Fill a sockaddr_un for path. Returns 0, or -1 with EINVAL / ENAMETOOLONG. */
+static int unix_address(const char* path, struct sockaddr_un* addr, socklen_t* addr_len) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    size_t len = path ? strlen(path) : 0;
+    if (len == 0) {
+        tcp_set_error(EINVAL);
+        return -1;
+    }
+    if (len >= sizeof(addr->sun_path)) {
+        tcp_set_error(ENAMETOOLONG);
+        return -1;
+    }
+    memcpy(addr->sun_path, path, len);
+    if (path[0] == '@') {
+#ifdef __linux__
+        addr->sun_path[0] = '\0';
+        *addr_len = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + len);
+        return 0;
+#else
+        tcp_set_error(EINVAL);
+        return -1;
+#endif
+    }
+    *addr_len = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + len + 1);
+    return 0;
+}
+
+/* Write a peer address as a path ("@name" for abstract, "" for unnamed) */
+static int32_t unix_format_address(const struct sockaddr_un* addr, socklen_t addr_len, char* buf, int32_t cap) {
+    if (!buf || cap <= 0) {
+        return -1;
+    }
+    size_t offset = offsetof(struct sockaddr_un, sun_path);
+    size_t len = addr_len > offset ? (size_t)addr_len - offset : 0;
+    if (len > 0 && addr->sun_path[0] != '\0') {
+        len = strnlen(addr->sun_path, len);
+    }
+    if (len >= (size_t)cap) {
+        tcp_set_error(ENAMETOOLONG);
+        return -1;
+    }
+    memcpy(buf, addr->sun_path, len);
+    if (len > 0 && buf[0] == '\0') {
+        buf[0] = '@';
+    }
+    buf[len] = '\0';
+    return (int32_t)len;
+}
+
+static int64_t unix_socket(int type, int32_t flags) {
+#ifdef __linux__
+    return socket(AF_UNIX, type | SOCK_CLOEXEC | ((flags & UNIX_NONBLOCK) ? SOCK_NONBLOCK : 0), 0);
+#else
+    int64_t sock = socket(AF_UNIX, type, 0);
+    if (sock < 0) {
+        return -1;
+    }
+    fcntl((int)sock, F_SETFD, FD_CLOEXEC);
+    if ((flags & UNIX_NONBLOCK) && tcp_set_nonblocking(sock, 1) != 0) {
+        tcp_close(sock);
+        return -1;
+    }
+    return sock;
+#endif
+}
+
+/* Create a socket of type bound to path (unbound for NULL or "") */
+static int64_t unix_bind_path(int type, const char* path, int32_t backlog, int32_t flags) {
+    struct sockaddr_un addr;
+    socklen_t addr_len = 0;
+    int bound = path && *path;
+    if (bound && unix_address(path, &addr, &addr_len) != 0) {
+        return -1;
+    }
+    if (bound && (flags & UNIX_UNLINK) && path[0] != '@') {
+        unlink(path);
+    }
+    int64_t sock = unix_socket(type, flags);
+    if (sock < 0) {
+        return -1;
+    }
+#ifdef __linux__
+    if (!bound && type == SOCK_DGRAM) {
+        /* Autobind to a unique abstract name so peers can reply */
+        sa_family_t family = AF_UNIX;
+        bound = bind((int)sock, (struct sockaddr*)&family, sizeof(family)) == 0 ? 2 : -1;
+    }
+#endif
+    if ((bound == 1 && bind((int)sock, (struct sockaddr*)&addr, addr_len) < 0) || bound < 0 ||
+        (type == SOCK_STREAM && listen((int)sock, backlog > 0 ? backlog : SOMAXCONN) < 0)) {
+        int error = errno;
+        tcp_close(sock);
+        errno = error;
+        return -1;
+    }
+    return sock;
+}
+
+#endif
+
+/**
+ * Opens a listening Unix stream socket at path ("@name" = abstract).
+ *
+ * Accept connections with tcp_accept(). Flags: UNIX_UNLINK (1) removes a
+ * leftover socket file first (a stale file makes bind fail with
+ * EADDRINUSE), UNIX_NONBLOCK (4) makes tcp_accept() return TCP_WOULD_BLOCK
+ * instead of waiting. backlog <= 0 uses SOMAXCONN. The socket file stays
+ * after tcp_close(); unlink it when done.
+ *
+ * @return The listening socket, or -1 on error
+ */
+int64_t unix_listen(const char* path, int32_t backlog, int32_t flags) {
+#ifdef _WIN32
+    (void)path;
+    (void)backlog;
+    (void)flags;
+    tcp_set_error(EOPNOTSUPP);
+    return -1;
+#else
+    if (!path || !*path) {
+        tcp_set_error(EINVAL);
+        return -1;
+    }
+    return unix_bind_path(SOCK_STREAM, path, backlog, flags);
+#endif
+}
+
+/* Connect a stream socket to path. UNIX_NONBLOCK (4) switches the
+ * connected socket to nonblocking mode. Returns the socket or -1. */
+int64_t unix_connect(const char* path, int32_t flags) {
+#ifdef _WIN32
+    (void)path;
+    (void)flags;
+    tcp_set_error(EOPNOTSUPP);
+    return -1;
+#else
+    struct sockaddr_un addr;
+    socklen_t addr_len;
+    if (unix_address(path, &addr, &addr_len) != 0) {
+        return -1;
+    }
+    int64_t sock = unix_socket(SOCK_STREAM, 0);
+    if (sock < 0) {
+        return -1;
+    }
+    int result;
+    for (;;) {
+        /* Local connects finish at once; they block only while the
+         * listener's backlog is full */
+        result = connect((int)sock, (struct sockaddr*)&addr, addr_len);
+        if (result == 0 || errno != EINTR) {
+            break;
+        }
+    }
+    if (result < 0 || ((flags & UNIX_NONBLOCK) && tcp_set_nonblocking(sock, 1) != 0)) {
+        int error = errno;
+        tcp_close(sock);
+        errno = error;
+        return -1;
+    }
+    return sock;
+#endif
+}
+
+/**
+ * Opens a Unix datagram socket bound to path ("@name" = abstract). NULL or
+ * "" leaves it nameless: on Linux it is autobound to a unique abstract name
+ * so peers can still reply. Flags as for unix_listen(). Datagrams keep
+ * their boundaries and, unlike UDP, are never dropped or reordered: a full
+ * receiver makes the sender wait (or get TCP_WOULD_BLOCK).
+ *
+ * @return The socket, or -1 on error
+ */
+int64_t unix_bind(const char* path, int32_t flags) {
+#ifdef _WIN32
+    (void)path;
+    (void)flags;
+    tcp_set_error(EOPNOTSUPP);
+    return -1;
+#else
+    return unix_bind_path(SOCK_DGRAM, path, 0, flags);
+#endif
+}
+
+/* Fix the peer of a datagram socket, so tcp_send(), tcp_recv() and
+ * unix_send_fds() need no path. Returns 0 or -1. */
+int32_t unix_connect_datagram(int64_t sock, const char* path) {
+#ifdef _WIN32
+    (void)sock;
+    (void)path;
+    tcp_set_error(EOPNOTSUPP);
+    return -1;
+#else
+    struct sockaddr_un addr;
+    socklen_t addr_len;
+    if (unix_address(path, &addr, &addr_len) != 0) {
+        return -1;
+    }
+    return connect((int)sock, (struct sockaddr*)&addr, addr_len) == 0 ? 0 : -1;
+#endif
+}
+
+/**
+ * Creates a connected pair of Unix sockets, the usual way to talk to a
+ * forked child. type is UNIX_STREAM (1) or UNIX_DATAGRAM (2); flags may
+ * include UNIX_NONBLOCK (4). Both ends are close-on-exec.
+ *
+ * @return One end (the other is stored in *other), or -1 on error
+ */
+int64_t unix_socketpair(int32_t type, int32_t flags, int64_t* other) {
+#ifdef _WIN32
+    (void)type;
+    (void)flags;
+    (void)other;
+    tcp_set_error(EOPNOTSUPP);
+    return -1;
+#else
+    if (!other || (type != UNIX_STREAM && type != UNIX_DATAGRAM)) {
+        tcp_set_error(EINVAL);
+        return -1;
+    }
+    int fds[2];
+    int socktype = type == UNIX_STREAM ? SOCK_STREAM : SOCK_DGRAM;
+#ifdef __linux__
+    socktype |= SOCK_CLOEXEC | ((flags & UNIX_NONBLOCK) ? SOCK_NONBLOCK : 0);
+#endif
+    if (socketpair(AF_UNIX, socktype, 0, fds) < 0) {
+        return -1;
+    }
+#ifndef __linux__
+    for (int i = 0; i < 2; i++) {
+        fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+        if ((flags & UNIX_NONBLOCK) && tcp_set_nonblocking(fds[i], 1) != 0) {
+            close(fds[0]);
+            close(fds[1]);
+            return -1;
+        }
+    }
+#endif
+    *other = fds[1];
+    return fds[0];
+#endif
+}
+
+/* One datagram to path: len, TCP_WOULD_BLOCK or -1 */
+int64_t unix_send_to(int64_t sock, const char* data, int64_t len, const char* path) {
+#ifdef _WIN32
+    (void)sock;
+    (void)data;
+    (void)len;
+    (void)path;
+    tcp_set_error(EOPNOTSUPP);
+    return -1;
+#else
+    struct sockaddr_un addr;
+    socklen_t addr_len;
+    if (len < 0 || (len > 0 && data == NULL)) {
+        tcp_set_error(EINVAL);
+        return -1;
+    }
+    if (unix_address(path, &addr, &addr_len) != 0) {
+        return -1;
+    }
+    int flags = MSG_NOSIGNAL | tcp_cooperative_flags();
+    for (;;) {
+        ssize_t sent = sendto((int)sock, data, (size_t)len, flags, (struct sockaddr*)&addr, addr_len);
+        if (sent >= 0) {
+            return (int64_t)sent;
+        }
+        if (errno == EINTR || tcp_park(sock, TCP_WAIT_WRITE)) {
+            continue;
+        }
+        return tcp_would_block() ? TCP_WOULD_BLOCK : -1;
+    }
+#endif
+}
+
+/* One datagram (truncated to len) and its sender's path in from ("" when
+ * nameless; from may be NULL): its length, TCP_WOULD_BLOCK or -1 */
+int64_t unix_recv_from(int64_t sock, char* buf, int64_t len, char* from, int32_t from_cap) {
+#ifdef _WIN32
+    (void)sock;
+    (void)buf;
+    (void)len;
+    (void)from;
+    (void)from_cap;
+    tcp_set_error(EOPNOTSUPP);
+    return -1;
+#else
+    if (len < 0 || (len > 0 && buf == NULL)) {
+        tcp_set_error(EINVAL);
+        return -1;
+    }
+    int flags = tcp_cooperative_flags();
+    for (;;) {
+        struct sockaddr_un addr;
+        socklen_t addr_len = sizeof(addr);
+        ssize_t received = recvfrom((int)sock, buf, (size_t)len, flags, (struct sockaddr*)&addr, &addr_len);
+        if (received >= 0) {
+            if (from && unix_format_address(&addr, addr_len, from, from_cap) < 0) {
+                return -1;
+            }
+            return (int64_t)received;
+        }
+        if (errno == EINTR || tcp_park(sock, TCP_WAIT_READ)) {
+            continue;
+        }
+        return tcp_would_block() ? TCP_WOULD_BLOCK : -1;
+    }
+#endif
+}
+
+/**
+ * Sends data together with copies of count open descriptors (SCM_RIGHTS):
+ * files, sockets, pipes, memfds. The receiver gets new descriptors for the
+ * same open files; the sender's stay open. At least one byte must go with
+ * them, so an empty message sends a single zero byte.
+ *
+ * On a stream socket the descriptors travel with the first byte sent; if
+ * only part of data went out, send the rest with tcp_send().
+ *
+ * @return Bytes of data sent (0 for an empty message), TCP_WOULD_BLOCK if
+ *         nothing could be sent, or -1 on error
+ */
+int64_t unix_send_fds(int64_t sock, const char* data, int64_t len, const int32_t* fds, int32_t count) {
+#ifdef _WIN32
+    (void)sock;
+    (void)data;
+    (void)len;
+    (void)fds;
+    (void)count;
+    tcp_set_error(EOPNOTSUPP);
+    return -1;
+#else
+    if (len < 0 || (len > 0 && data == NULL) || count < 0 || count > UNIX_MAX_FDS ||
+        (count > 0 && fds == NULL)) {
+        tcp_set_error(EINVAL);
+        return -1;
+    }
+    char zero = 0;
+    struct iovec iov;
+    iov.iov_base = len > 0 ? (void*)data : &zero;
+    iov.iov_len = len > 0 ? (size_t)len : 1;
+    
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(UNIX_MAX_FDS * sizeof(int))];
+    } control;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (count > 0) {
+        memset(&control, 0, sizeof(control));
+        msg.msg_control = control.buf;
+        msg.msg_controllen = CMSG_SPACE((size_t)count * sizeof(int));
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN((size_t)count * sizeof(int));
+        int* out = (int*)CMSG_DATA(cmsg);
+        for (int32_t i = 0; i < count; i++) {
+            out[i] = fds[i];
+        }
+    }
+    
+    int flags = MSG_NOSIGNAL | tcp_cooperative_flags();
+    for (;;) {
+        ssize_t sent = sendmsg((int)sock, &msg, flags);
+        if (sent >= 0) {
+            return len > 0 ? (int64_t)sent : 0;
+        }
+        if (errno == EINTR || tcp_park(sock, TCP_WAIT_WRITE)) {
+            continue;
+        }
+        return tcp_would_block() ? TCP_WOULD_BLOCK : -1;
+    }
+#endif
+}
+
+/**
+ * Receives data and any descriptors sent with it (close-on-exec). Up to
+ * max_fds are stored in fds and counted in *fd_count; any beyond that are
+ * closed, as are descriptors the kernel could not fit (MSG_CTRUNC), so none
+ * leak. Descriptors arrive with the byte they were sent with: a stream read
+ * never merges data from two unix_send_fds() calls that both carry them.
+ *
+ * @return Bytes received (0 at end of stream), TCP_WOULD_BLOCK or -1
+ */
+int64_t unix_recv_fds(int64_t sock, char* buf, int64_t len, int32_t* fds, int32_t max_fds, int32_t* fd_count) {
+#ifdef _WIN32
+    (void)sock;
+    (void)buf;
+    (void)len;
+    (void)fds;
+    (void)max_fds;
+    (void)fd_count;
+    tcp_set_error(EOPNOTSUPP);
+    return -1;
+#else
+    if (len < 0 || (len > 0 && buf == NULL) || max_fds < 0 || (max_fds > 0 && fds == NULL)) {
+        tcp_set_error(EINVAL);
+        return -1;
+    }
+    if (fd_count) {
+        *fd_count = 0;
+    }
+    struct iovec iov;
+    iov.iov_base = buf;
+    iov.iov_len = (size_t)len;
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(UNIX_MAX_FDS * sizeof(int))];
+    } control;
+    struct msghdr msg;
+#ifdef MSG_CMSG_CLOEXEC
+    int flags = MSG_CMSG_CLOEXEC | tcp_cooperative_flags();
+#else
+    int flags = tcp_cooperative_flags();
+#endif
+    ssize_t received;
+    for (;;) {
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+        received = recvmsg((int)sock, &msg, flags);
+        if (received >= 0) {
+            break;
+        }
+        if (errno == EINTR || tcp_park(sock, TCP_WAIT_READ)) {
+            continue;
+        }
+        return tcp_would_block() ? TCP_WOULD_BLOCK : -1;
+    }
+    
+    int32_t kept = 0;
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+            continue;
+        }
+        size_t n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        const unsigned char* data = CMSG_DATA(cmsg);
+        for (size_t i = 0; i < n; i++) {
+            int fd;
+            memcpy(&fd, data + i * sizeof(int), sizeof(int));
+            if (kept < max_fds) {
+#ifndef MSG_CMSG_CLOEXEC
+                fcntl(fd, F_SETFD, FD_CLOEXEC);
+#endif
+                fds[kept++] = fd;
+            } else {
+                close(fd);
+            }
+        }
+    }
+    if (fd_count) {
+        *fd_count = kept;
+    }
+    return (int64_t)received;
+#endif
+}
+
+/* Process, user and group of the connected peer as of connect() (pid is
+ * -1 where the platform does not report it). Returns 0 or -1. */
+int32_t unix_peer_credentials(int64_t sock, int32_t* pid, int32_t* uid, int32_t* gid) {
+#if defined(__linux__)
+    struct ucred cred;
+    socklen_t cred_len = sizeof(cred);
+    if (getsockopt((int)sock, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) < 0) {
+        return -1;
+    }
+    if (pid) {
+        *pid = (int32_t)cred.pid;
+    }
+    if (uid) {
+        *uid = (int32_t)cred.uid;
+    }
+    if (gid) {
+        *gid = (int32_t)cred.gid;
+    }
+    return 0;
+#elif defined(_WIN32)
+    (void)sock;
+    (void)pid;
+    (void)uid;
+    (void)gid;
+    tcp_set_error(EOPNOTSUPP);
+    return -1;
+#else
+    uid_t peer_uid;
+    gid_t peer_gid;
+    if (getpeereid((int)sock, &peer_uid, &peer_gid) < 0) {
+        return -1;
+    }
+    if (pid) {
+        *pid = -1;
+    }
+    if (uid) {
+        *uid = (int32_t)peer_uid;
+    }
+    if (gid) {
+        *gid = (int32_t)peer_gid;
+    }
+    return 0;
+#endif
+}
+
+/* Path a Unix socket is bound to, written into buf ("@name" = abstract);
+ * returns its length or -1 */
+int32_t unix_local_path(int64_t sock, char* buf, int32_t cap) {
+#ifdef _WIN32
+    (void)sock;
+    (void)buf;
+    (void)cap;
+    tcp_set_error(EOPNOTSUPP);
+    return -1;
+#else
+    struct sockaddr_un addr;
+    socklen_t addr_len = sizeof(addr);
+    if (getsockname((int)sock, (struct sockaddr*)&addr, &addr_len) < 0) {
+        return -1;
+    }
+    return unix_format_address(&addr, addr_len, buf, cap);
+#endif
+}
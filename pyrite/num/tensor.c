@@ -1,4 +1,19 @@
-/* Tensor implementation in C for Pyrite */
+/* Tensor implementation in C for Pyrite
+ *
+ * A Tensor is a strided view of a shared, refcounted element buffer: up to
+ * TENSOR_MAX_DIMS dimensions, where element (i0, i1, ...) lives at
+ * data[i0 * strides[0] + i1 * strides[1] + ...]. tensor_new() and
+ * tensor_new_nd() create row-major ("contiguous") tensors. Slicing,
+ * selecting, permuting/transposing axes, broadcasting and reshaping
+ * contiguous data only build a new view: O(1), no copy, one more
+ * reference to the storage. Every tensor and every view is released with
+ * tensor_drop(); the storage is freed with its last reference.
+ * tensor_contiguous() materializes a view as a fresh row-major tensor.
+ *
+ * A view can write through to the tensor it came from. Broadcast views
+ * repeat elements (stride 0), so they are read-only by convention: using
+ * one as an output is rejected.
+ */
 
 #include <stdlib.h>
 #include <string.h>
@@ -6,66 +21,375 @@
 #include <stddef.h>
 #include <limits.h>
 #include <errno.h>
+#include <math.h>
 
-typedef struct {
+#ifdef _WIN32
+#include <windows.h>
+#include <malloc.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+#define TENSOR_MAX_DIMS 8
+
+/* Element buffer shared by a tensor and all views of it */
+typedef struct TensorStorage {
     double* data;
-    int64_t rows;
-    int64_t cols;
+    int64_t size;                   /* Elements */
+    int64_t refs;                   /* Updated atomically */
+    int32_t size_class;             /* Buffer pool class, or -1 (not pooled) */
+    struct TensorStorage* next;     /* In the buffer pool */
+} TensorStorage;
+
+typedef struct {
+    double* data;                       /* Element (0, 0, ...) */
+    TensorStorage* storage;             /* NULL when there are no elements */
+    int64_t offset;                     /* data - storage->data */
+    int32_t ndim;                       /* 0 = a single element (scalar) */
+    int64_t shape[TENSOR_MAX_DIMS];
+    int64_t strides[TENSOR_MAX_DIMS];   /* In elements; 0 repeats (broadcast) */
 } Tensor;
 
-Tensor tensor_new(int64_t rows, int64_t cols) {
+/* The value returned on error: no elements, no storage, ndim 0 */
+static Tensor tensor_empty() {
     Tensor t;
-    
-    /* Initialize to empty tensor (all paths must set these consistently) */
-    t.data = NULL;
-    t.rows = 0;
-    t.cols = 0;
-    
-    /* Validate inputs: rows and cols must be non-negative */
-    if (rows < 0 || cols < 0) {
+    memset(&t, 0, sizeof(t));
+    return t;
+}
+
+static int64_t tensor_count(int32_t ndim, const int64_t* shape) {
+    int64_t count = 1;
+    for (int32_t d = 0; d < ndim; d++) {
+        count *= shape[d];
+    }
+    return count;
+}
+
+/* Usable as an input: a sane rank, and storage unless it has no elements */
+static int tensor_valid(const Tensor* t) {
+    return t != NULL && t->ndim >= 0 && t->ndim <= TENSOR_MAX_DIMS &&
+           (t->data != NULL || tensor_count(t->ndim, t->shape) == 0);
+}
+
+/* Usable as an output: valid, and no two indices share an element */
+static int tensor_writable(const Tensor* t) {
+    if (!tensor_valid(t)) {
+        return 0;
+    }
+    for (int32_t d = 0; d < t->ndim; d++) {
+        if (t->strides[d] == 0 && t->shape[d] > 1) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Row-major strides for shape */
+static void tensor_contiguous_strides(int32_t ndim, const int64_t* shape, int64_t* strides) {
+    int64_t stride = 1;
+    for (int32_t d = ndim - 1; d >= 0; d--) {
+        strides[d] = stride;
+        stride *= shape[d] > 1 ? shape[d] : 1;
+    }
+}
+
+/* A new reference to the same view */
+static Tensor tensor_share(const Tensor* t) {
+    Tensor view = *t;
+    if (view.storage) {
+        __atomic_fetch_add(&view.storage->refs, 1, __ATOMIC_RELAXED);
+    }
+    return view;
+}
+
+
+/* ---- Storage allocation ---- */
+
+/* Element buffers start on a cache line, so vector loads never split one,
+ * and large ones on a page. A dropped buffer is kept for reuse in a pool
+ * of size classes, four per doubling (at most 25% slack), up to
+ * tensor_set_pool_limit() bytes in all. A loop that creates and drops the
+ * same shapes every iteration stops calling the allocator after the
+ * first. Scratch buffers (GEMM packing, expression tiles) are aligned the
+ * same way but not pooled. */
+
+#define TENSOR_ALIGN 64
+#define TENSOR_PAGE 4096
+/* Buffers of at least this many bytes are page-aligned */
+#define TENSOR_PAGE_MIN (256 * 1024)
+/* Class c holds (4 + c % 4) << (c / 4 + 4) bytes: 64, 80, 96, 112, 128,
+ * 160, ... up to 3.5 GiB; larger buffers are not pooled */
+#define TENSOR_BUFFER_CLASSES 104
+#define TENSOR_BUFFER_LIMIT ((int64_t)256 * 1024 * 1024)
+
+typedef struct {
+    char lock;                  /* Spin lock: held for a push or a pop */
+    TensorStorage* free;
+} TensorBufferClass;
+
+static TensorBufferClass tensor_buffers[TENSOR_BUFFER_CLASSES];
+static int64_t tensor_buffer_cached;                        /* Bytes pooled */
+static int64_t tensor_buffer_limit = TENSOR_BUFFER_LIMIT;
+
+static void* tensor_memalign(size_t bytes, size_t align) {
+#ifdef _WIN32
+    return _aligned_malloc(bytes, align);
+#else
+    void* p = NULL;
+    return posix_memalign(&p, align, bytes) == 0 ? p : NULL;
+#endif
+}
+
+static void tensor_memfree(void* p) {
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+}
+
+static double* tensor_aligned_alloc(size_t count) {
+    return (double*)tensor_memalign(count * sizeof(double), TENSOR_ALIGN);
+}
+
+static void tensor_aligned_free(double* p) {
+    tensor_memfree(p);
+}
+
+static size_t tensor_class_bytes(int32_t c) {
+    return (size_t)(4 + c % 4) << (c / 4 + 4);
+}
+
+/* Smallest class that holds bytes, or -1 */
+static int32_t tensor_class_of(size_t bytes) {
+    if (bytes <= 64) {
+        return 0;
+    }
+    uint64_t top = (uint64_t)bytes - 1;
+    int32_t shift = 0;
+    while ((top >> shift) >= 8) {
+        shift++;      /* Now 4 <= top >> shift < 8 */
+    }
+    int32_t c = (shift - 4) * 4 + (int32_t)(top >> shift) - 3;
+    return c < TENSOR_BUFFER_CLASSES ? c : -1;
+}
+
+static void tensor_class_lock(TensorBufferClass* bc) {
+    while (__atomic_test_and_set(&bc->lock, __ATOMIC_ACQUIRE)) {
+#ifdef _WIN32
+        SwitchToThread();
+#else
+        sched_yield();
+#endif
+    }
+}
+
+static void tensor_class_unlock(TensorBufferClass* bc) {
+    __atomic_clear(&bc->lock, __ATOMIC_RELEASE);
+}
+
+static void tensor_storage_destroy(TensorStorage* storage) {
+    tensor_memfree(storage->data);
+    free(storage);
+}
+
+/* Storage for count (> 0) elements, zero-filled if zero is set; NULL with
+ * ENOMEM */
+static TensorStorage* tensor_storage_new(int64_t count, int zero) {
+    size_t bytes = (size_t)count * sizeof(double);
+    int32_t c = tensor_class_of(bytes);
+    TensorStorage* storage = NULL;
+    if (c >= 0 && __atomic_load_n(&tensor_buffer_cached, __ATOMIC_RELAXED) > 0) {
+        TensorBufferClass* bc = &tensor_buffers[c];
+        tensor_class_lock(bc);
+        storage = bc->free;
+        if (storage != NULL) {
+            bc->free = storage->next;
+        }
+        tensor_class_unlock(bc);
+        if (storage != NULL) {
+            __atomic_sub_fetch(&tensor_buffer_cached, (int64_t)tensor_class_bytes(c), __ATOMIC_RELAXED);
+        }
+    }
+    if (storage == NULL) {
+        /* A whole class, so the buffer can come back for any size in it */
+        size_t capacity = c >= 0 ? tensor_class_bytes(c) : bytes;
+        size_t align = capacity >= TENSOR_PAGE_MIN ? TENSOR_PAGE : TENSOR_ALIGN;
+        if (c < 0) {
+            capacity = (capacity + align - 1) & ~(align - 1);
+        }
+        storage = (TensorStorage*)malloc(sizeof(TensorStorage));
+        double* data = capacity >= bytes ? (double*)tensor_memalign(capacity, align) : NULL;
+        if (storage == NULL || data == NULL) {
+            free(storage);
+            tensor_memfree(data);
+            errno = ENOMEM;
+            return NULL;
+        }
+        storage->data = data;
+        storage->size_class = c;
+    }
+    storage->size = count;
+    storage->refs = 1;
+    storage->next = NULL;
+    if (zero) {
+        memset(storage->data, 0, bytes);
+    }
+    return storage;
+}
+
+/* Back to the pool, or to the allocator when it is full */
+static void tensor_storage_free(TensorStorage* storage) {
+    int32_t c = storage->size_class;
+    if (c >= 0) {
+        int64_t bytes = (int64_t)tensor_class_bytes(c);
+        int64_t limit = __atomic_load_n(&tensor_buffer_limit, __ATOMIC_RELAXED);
+        if (__atomic_add_fetch(&tensor_buffer_cached, bytes, __ATOMIC_RELAXED) <= limit) {
+            TensorBufferClass* bc = &tensor_buffers[c];
+            tensor_class_lock(bc);
+            storage->next = bc->free;
+            bc->free = storage;
+            tensor_class_unlock(bc);
+            return;
+        }
+        __atomic_sub_fetch(&tensor_buffer_cached, bytes, __ATOMIC_RELAXED);
+    }
+    tensor_storage_destroy(storage);
+}
+
+/* Free pooled buffers, largest first, until at most keep bytes remain;
+ * returns the bytes freed */
+static int64_t tensor_buffers_trim(int64_t keep) {
+    int64_t freed = 0;
+    for (int32_t c = TENSOR_BUFFER_CLASSES - 1; c >= 0; c--) {
+        TensorBufferClass* bc = &tensor_buffers[c];
+        int64_t bytes = (int64_t)tensor_class_bytes(c);
+        while (__atomic_load_n(&tensor_buffer_cached, __ATOMIC_RELAXED) > keep) {
+            tensor_class_lock(bc);
+            TensorStorage* storage = bc->free;
+            if (storage != NULL) {
+                bc->free = storage->next;
+            }
+            tensor_class_unlock(bc);
+            if (storage == NULL) {
+                break;
+            }
+            __atomic_sub_fetch(&tensor_buffer_cached, bytes, __ATOMIC_RELAXED);
+            tensor_storage_destroy(storage);
+            freed += bytes;
+        }
+    }
+    return freed;
+}
+
+/**
+ * Caps the bytes of dropped tensor storage kept for reuse (default 256
+ * MiB); 0 turns the pool off. Buffers beyond a lowered cap are freed now.
+ * Affects every thread.
+ *
+ * @return The cap now in effect, or -1 with errno EINVAL if bytes < 0
+ */
+int64_t tensor_set_pool_limit(int64_t bytes) {
+    if (bytes < 0) {
         errno = EINVAL;
-        return t;  /* Return empty tensor on negative input */
+        return -1;
     }
+    __atomic_store_n(&tensor_buffer_limit, bytes, __ATOMIC_RELAXED);
+    tensor_buffers_trim(bytes);
+    return bytes;
+}
+
+/** Frees every pooled buffer, e.g. after a phase that used large tensors. @return The bytes freed */
+int64_t tensor_pool_trim() {
+    return tensor_buffers_trim(0);
+}
+
+
+/* ---- Creation and element access ---- */
+
+static Tensor tensor_create(int32_t ndim, const int64_t* shape, int zero) {
+    Tensor t = tensor_empty();
     
-    /* Convert to size_t for allocation math */
-    size_t rows_sz = (size_t)rows;
-    size_t cols_sz = (size_t)cols;
-    size_t elem_size = sizeof(double);
+    /* Validate inputs: a supported rank, non-negative dimensions */
+    if (ndim < 0 || ndim > TENSOR_MAX_DIMS || (ndim > 0 && shape == NULL)) {
+        errno = EINVAL;
+        return t;
+    }
     
-    /* Check for zero-size allocation */
-    if (rows_sz == 0 || cols_sz == 0) {
-        return t;  /* Return empty tensor for zero-size */
+    /* Check for overflow: count * sizeof(double) <= SIZE_MAX (and INT64_MAX) */
+    int64_t count = 1;
+    int64_t limit = (int64_t)((SIZE_MAX / sizeof(double)) < (size_t)INT64_MAX
+                              ? SIZE_MAX / sizeof(double) : (size_t)INT64_MAX);
+    for (int32_t d = 0; d < ndim; d++) {
+        if (shape[d] < 0) {
+            errno = EINVAL;
+            return t;
+        }
+        if (shape[d] > 0 && count > limit / shape[d]) {
+            errno = EINVAL;  /* Overflow detected in total size */
+            return t;
+        }
+        count *= shape[d];
     }
     
-    /* Check for integer overflow: rows * cols * sizeof(double) <= SIZE_MAX */
-    /* First check if cols * sizeof(double) would overflow */
-    if (cols_sz > SIZE_MAX / elem_size) {
-        errno = EINVAL;  /* Overflow detected in cols * elem_size */
-        return t;  /* Return empty tensor on overflow */
+    t.ndim = ndim;
+    for (int32_t d = 0; d < ndim; d++) {
+        t.shape[d] = shape[d];
     }
-    /* Then check if rows * (cols * sizeof(double)) would overflow */
-    if (rows_sz > SIZE_MAX / (cols_sz * elem_size)) {
-        errno = EINVAL;  /* Overflow detected in total size */
-        return t;  /* Return empty tensor on overflow */
+    tensor_contiguous_strides(ndim, shape, t.strides);
+    
+    /* Zero-size: the shape, but nothing to allocate */
+    if (count == 0) {
+        return t;
     }
     
-    /* Allocate and zero-initialize using calloc */
-    t.data = (double*)calloc(rows_sz * cols_sz, elem_size);
-    if (t.data == NULL) {
-        errno = ENOMEM;  /* Allocation failed */
-        return t;  /* Return empty tensor on allocation failure */
+    TensorStorage* storage = tensor_storage_new(count, zero);
+    if (storage == NULL) {
+        return tensor_empty();
     }
     
-    /* Success: set dimensions */
-    t.rows = rows;
-    t.cols = cols;
+    /* Success: the tensor owns the only reference */
+    t.data = storage->data;
+    t.storage = storage;
     return t;
 }
 
-/* Get element at position (r, c) from tensor.
+/**
+ * Creates a zero-filled, row-major tensor of the given shape (ndim up to
+ * TENSOR_MAX_DIMS; ndim 0 is a single element). A shape with a zero
+ * dimension gives a tensor with that shape and no storage.
+ *
+ * @return The tensor, or an empty one (data == NULL, ndim 0) with errno
+ *         EINVAL (bad rank, negative or overflowing size) or ENOMEM
+ */
+Tensor tensor_new_nd(int32_t ndim, const int64_t* shape) {
+    return tensor_create(ndim, shape, 1);
+}
+
+/**
+ * Like tensor_new_nd(), but the elements are not zeroed: they hold
+ * whatever the buffer held before. Saves a pass over memory when every
+ * element is written before it is read (as an output of tensor_gemm()
+ * with beta 0, tensor_assign() or tensor_expr_eval()).
+ *
+ * @return As for tensor_new_nd()
+ */
+Tensor tensor_new_uninit(int32_t ndim, const int64_t* shape) {
+    return tensor_create(ndim, shape, 0);
+}
+
+/* Creates a zero-filled rows x cols tensor; see tensor_new_nd() */
+Tensor tensor_new(int64_t rows, int64_t cols) {
+    int64_t shape[2] = { rows, cols };
+    return tensor_new_nd(2, shape);
+}
+
+/* Get element at position (r, c) from a 2-D tensor.
  * 
  * Validation:
- * - Returns 0.0 and sets errno = EINVAL if t is NULL or t->data is NULL
+ * - Returns 0.0 and sets errno = EINVAL if t is NULL, not 2-D, or t->data is NULL
  * - Returns 0.0 and sets errno = EINVAL if indices are out of bounds (r < 0 || r >= rows || c < 0 || c >= cols)
  * - Returns the element value on success (errno unchanged)
  * 
@@ -73,37 +397,2426 @@ Tensor tensor_new(int64_t rows, int64_t cols) {
  */
 double tensor_get(Tensor* t, int64_t r, int64_t c) {
     /* Validate input: check for NULL pointers */
-    if (t == NULL || t->data == NULL) {
+    if (t == NULL || t->data == NULL || t->ndim != 2) {
         errno = EINVAL;
         return 0.0;
     }
     /* Validate bounds: ensure indices are within valid range */
-    if (r < 0 || r >= t->rows || c < 0 || c >= t->cols) {
+    if (r < 0 || r >= t->shape[0] || c < 0 || c >= t->shape[1]) {
         errno = EINVAL;
         return 0.0;
     }
     /* Success: return element value (errno unchanged) */
-    return t->data[r * t->cols + c];
+    return t->data[r * t->strides[0] + c * t->strides[1]];
 }
 
 void tensor_set(Tensor* t, int64_t r, int64_t c, double val) {
     /* Validate input */
-    if (t == NULL || t->data == NULL) {
+    if (t == NULL || t->data == NULL || t->ndim != 2) {
         return;  /* Early return on invalid tensor */
     }
     /* Validate bounds */
-    if (r < 0 || r >= t->rows || c < 0 || c >= t->cols) {
+    if (r < 0 || r >= t->shape[0] || c < 0 || c >= t->shape[1]) {
         return;  /* Early return on out-of-bounds access */
     }
-    t->data[r * t->cols + c] = val;
+    t->data[r * t->strides[0] + c * t->strides[1]] = val;
+}
+
+/* Element pointer for a full index (ndim entries), or NULL if out of bounds */
+static double* tensor_element(const Tensor* t, const int64_t* index) {
+    if (t == NULL || t->data == NULL || (t->ndim > 0 && index == NULL)) {
+        return NULL;
+    }
+    int64_t offset = 0;
+    for (int32_t d = 0; d < t->ndim; d++) {
+        if (index[d] < 0 || index[d] >= t->shape[d]) {
+            return NULL;
+        }
+        offset += index[d] * t->strides[d];
+    }
+    return t->data + offset;
+}
+
+/* Get the element at index (one entry per dimension); same errno rules as tensor_get() */
+double tensor_get_at(const Tensor* t, const int64_t* index) {
+    double* element = tensor_element(t, index);
+    if (element == NULL) {
+        errno = EINVAL;
+        return 0.0;
+    }
+    return *element;
+}
+
+/* Set the element at index; out-of-bounds indices are ignored like tensor_set() */
+void tensor_set_at(Tensor* t, const int64_t* index, double val) {
+    double* element = tensor_element(t, index);
+    if (element != NULL) {
+        *element = val;
+    }
+}
+
+/* Number of elements (1 for a 0-D tensor, 0 on NULL) */
+int64_t tensor_numel(const Tensor* t) {
+    if (t == NULL || t->ndim < 0 || t->ndim > TENSOR_MAX_DIMS) {
+        return 0;
+    }
+    return tensor_count(t->ndim, t->shape);
 }
 
+/* Releases this tensor's reference to its storage and empties it. The
+ * storage is freed when the last tensor or view of it is dropped. */
 void tensor_drop(Tensor* t) {
-    if (t->data) {
-        free(t->data);
-        t->data = NULL;
+    if (t->storage && __atomic_sub_fetch(&t->storage->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        tensor_storage_free(t->storage);
+    }
+    *t = tensor_empty();
+}
+
+
+/* ---- Thread pool ---- */
+
+/* Large tensor operations split their work into tasks: cache-sized tiles of
+ * C for GEMM, contiguous runs of elements for elementwise ops and
+ * reductions, bands of rows for transposes. One process-wide pool of
+ * persistent workers runs them; the calling thread always takes tasks too,
+ * so a job with width n wakes n - 1 workers. Workers start on first use and
+ * then sleep between jobs. Operations below a size threshold stay serial:
+ * waking workers costs more than the work. A job submitted while the pool
+ * is busy (from another thread, or from inside a task) also runs serially
+ * on its caller instead of waiting. */
+
+#define TENSOR_MAX_THREADS 64
+
+typedef void (*TensorTaskFn)(void* ctx, int64_t task, int32_t worker);
+
+#ifdef _WIN32
+typedef SRWLOCK TensorMutex;
+typedef CONDITION_VARIABLE TensorCond;
+#define TENSOR_MUTEX_INIT SRWLOCK_INIT
+#define TENSOR_COND_INIT CONDITION_VARIABLE_INIT
+#define tensor_lock(m) AcquireSRWLockExclusive(m)
+#define tensor_unlock(m) ReleaseSRWLockExclusive(m)
+#define tensor_cond_wait(c, m) SleepConditionVariableSRW(c, m, INFINITE, 0)
+#define tensor_cond_broadcast(c) WakeAllConditionVariable(c)
+#else
+typedef pthread_mutex_t TensorMutex;
+typedef pthread_cond_t TensorCond;
+#define TENSOR_MUTEX_INIT PTHREAD_MUTEX_INITIALIZER
+#define TENSOR_COND_INIT PTHREAD_COND_INITIALIZER
+#define tensor_lock(m) pthread_mutex_lock(m)
+#define tensor_unlock(m) pthread_mutex_unlock(m)
+#define tensor_cond_wait(c, m) pthread_cond_wait(c, m)
+#define tensor_cond_broadcast(c) pthread_cond_broadcast(c)
+#endif
+
+typedef struct {
+    TensorMutex lock;
+    TensorCond work;        /* A new job was posted */
+    TensorCond done;        /* The last worker left the job */
+    int32_t started;        /* Worker threads running; worker i is index i + 1 */
+    int32_t busy;           /* A job is running (claimed by exchange) */
+    uint64_t generation;    /* Bumped for every job */
+    TensorTaskFn fn;
+    void* ctx;
+    int64_t tasks;
+    int64_t next;           /* Next unclaimed task */
+    int32_t width;          /* Workers with index < width take part */
+    int32_t pending;        /* Workers not yet done with the job */
+    uint64_t born[TENSOR_MAX_THREADS];  /* Generation each worker started at */
+} TensorPool;
+
+static TensorPool tensor_pool = { .lock = TENSOR_MUTEX_INIT, .work = TENSOR_COND_INIT, .done = TENSOR_COND_INIT };
+
+/* tensor_set_threads() cap; 0 = one per core */
+static int32_t tensor_thread_cap = 0;
+
+static void tensor_pool_drain(TensorTaskFn fn, void* ctx, int64_t tasks, int32_t worker) {
+    for (;;) {
+        int64_t task = __atomic_fetch_add(&tensor_pool.next, 1, __ATOMIC_RELAXED);
+        if (task >= tasks) {
+            break;
+        }
+        fn(ctx, task, worker);
+    }
+}
+
+static void tensor_pool_worker_loop(int32_t index) {
+    TensorPool* pool = &tensor_pool;
+    tensor_lock(&pool->lock);
+    /* Not pool->generation: the job this worker was started for may
+     * already be posted */
+    uint64_t seen = pool->born[index];
+    for (;;) {
+        while (pool->generation == seen) {
+            tensor_cond_wait(&pool->work, &pool->lock);
+        }
+        seen = pool->generation;
+        if (index >= pool->width) {
+            continue;  /* Not needed for this job */
+        }
+        TensorTaskFn fn = pool->fn;
+        void* ctx = pool->ctx;
+        int64_t tasks = pool->tasks;
+        tensor_unlock(&pool->lock);
+        tensor_pool_drain(fn, ctx, tasks, index);
+        tensor_lock(&pool->lock);
+        if (--pool->pending == 0) {
+            tensor_cond_broadcast(&pool->done);
+        }
+    }
+}
+
+#ifdef _WIN32
+static DWORD WINAPI tensor_pool_worker(LPVOID arg) {
+    tensor_pool_worker_loop((int32_t)(intptr_t)arg);
+    return 0;
+}
+#else
+static void* tensor_pool_worker(void* arg) {
+    tensor_pool_worker_loop((int32_t)(intptr_t)arg);
+    return NULL;
+}
+#endif
+
+/* Start workers until width - 1 run (pool lock held); returns the width
+ * that can actually be served */
+static int32_t tensor_pool_grow(int32_t width) {
+    TensorPool* pool = &tensor_pool;
+    while (pool->started < width - 1) {
+        intptr_t index = pool->started + 1;
+        pool->born[index] = pool->generation;
+#ifdef _WIN32
+        HANDLE thread = CreateThread(NULL, 0, tensor_pool_worker, (LPVOID)index, 0, NULL);
+        if (!thread) {
+            break;
+        }
+        CloseHandle(thread);
+#else
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, tensor_pool_worker, (void*)index) != 0) {
+            break;
+        }
+        pthread_detach(thread);
+#endif
+        pool->started++;
+    }
+    return pool->started + 1 < width ? pool->started + 1 : width;
+}
+
+static int32_t tensor_cpu_count() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    int32_t cpus = (int32_t)info.dwNumberOfProcessors;
+#else
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    int32_t cpus = online > 0 ? (int32_t)online : 1;
+#endif
+    return cpus < TENSOR_MAX_THREADS ? cpus : TENSOR_MAX_THREADS;
+}
+
+/**
+ * Caps the threads tensor operations use, the calling thread included:
+ * 1 runs everything serially, 0 restores the default of one per core.
+ * Affects every thread; workers beyond a lowered cap stay asleep.
+ *
+ * @return The thread count now in effect, or -1 with EINVAL if threads < 0
+ */
+int32_t tensor_set_threads(int32_t threads) {
+    if (threads < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (threads > TENSOR_MAX_THREADS) {
+        threads = TENSOR_MAX_THREADS;
+    }
+    __atomic_store_n(&tensor_thread_cap, threads, __ATOMIC_RELAXED);
+    return threads > 0 ? threads : tensor_cpu_count();
+}
+
+/** @return The number of threads a large tensor operation runs on */
+int32_t tensor_threads() {
+    int32_t cap = __atomic_load_n(&tensor_thread_cap, __ATOMIC_RELAXED);
+    return cap > 0 ? cap : tensor_cpu_count();
+}
+
+/* Width of a job with the given task count: 1 when it should stay serial */
+static int32_t tensor_job_width(int64_t tasks) {
+    int32_t threads = tensor_threads();
+    if (tasks < 1) {
+        return 1;
+    }
+    return tasks < threads ? (int32_t)tasks : threads;
+}
+
+/* Run fn(ctx, task, worker) for every task in [0, tasks) on up to width
+ * threads, and return when all are done. worker is in [0, width) and
+ * unique among concurrently running tasks, for per-thread scratch. */
+static void tensor_parallel(int32_t width, int64_t tasks, TensorTaskFn fn, void* ctx) {
+    TensorPool* pool = &tensor_pool;
+    if (width > 1 && __atomic_exchange_n(&pool->busy, 1, __ATOMIC_ACQUIRE) == 0) {
+        tensor_lock(&pool->lock);
+        width = tensor_pool_grow(width);
+        if (width > 1) {
+            pool->fn = fn;
+            pool->ctx = ctx;
+            pool->tasks = tasks;
+            pool->next = 0;
+            pool->width = width;
+            pool->pending = width - 1;
+            pool->generation++;
+            tensor_cond_broadcast(&pool->work);
+            tensor_unlock(&pool->lock);
+            tensor_pool_drain(fn, ctx, tasks, 0);
+            tensor_lock(&pool->lock);
+            while (pool->pending > 0) {
+                tensor_cond_wait(&pool->done, &pool->lock);
+            }
+            tensor_unlock(&pool->lock);
+            __atomic_store_n(&pool->busy, 0, __ATOMIC_RELEASE);
+            return;
+        }
+        tensor_unlock(&pool->lock);
+        __atomic_store_n(&pool->busy, 0, __ATOMIC_RELEASE);
+    }
+    for (int64_t task = 0; task < tasks; task++) {
+        fn(ctx, task, 0);
+    }
+}
+
+
+/* ---- Strided loops ---- */
+
+/* Elementwise work walks several operands (the output first) over one
+ * shape in row-major order. Dimensions that every operand walks as one
+ * even run are merged first, so contiguous operands become a single flat
+ * loop and the innermost loop is as long as it can be. Work is split by
+ * element index, so an operation does the same arithmetic in the same
+ * order whatever the thread count. */
+
+/* Below this many elements an operation stays on the calling thread */
+#define TENSOR_PARALLEL_MIN 65536
+/* Smallest run of elements one task handles */
+#define TENSOR_ELEMENT_BLOCK 16384
+
+/* The output and up to eight inputs (fused expressions) */
+#define TENSOR_LOOP_OPERANDS 9
+
+typedef struct {
+    int32_t ndim;
+    int32_t operands;
+    int64_t count;
+    int64_t shape[TENSOR_MAX_DIMS];
+    int64_t strides[TENSOR_LOOP_OPERANDS][TENSOR_MAX_DIMS];
+    double* base[TENSOR_LOOP_OPERANDS];
+} TensorLoop;
+
+/* Called for each run of n elements: operand k starts at ptr[k] and steps
+ * by stride[k] */
+typedef void (*TensorRunFn)(void* ctx, double* const* ptr, const int64_t* stride, int64_t n);
+
+static void tensor_loop_init(TensorLoop* loop, int32_t ndim, const int64_t* shape, int32_t operands,
+                             double* const* base, int64_t strides[][TENSOR_MAX_DIMS]) {
+    int64_t merged_shape[TENSOR_MAX_DIMS];
+    int64_t merged[TENSOR_LOOP_OPERANDS][TENSOR_MAX_DIMS];
+    int32_t n = 0;
+    
+    memset(loop, 0, sizeof(*loop));
+    loop->operands = operands;
+    loop->count = tensor_count(ndim, shape);
+    for (int32_t k = 0; k < operands; k++) {
+        loop->base[k] = base[k];
+    }
+    
+    /* Collect dimensions innermost first; size-1 ones drop out */
+    for (int32_t d = ndim - 1; d >= 0; d--) {
+        if (shape[d] == 1) {
+            continue;
+        }
+        if (n > 0) {
+            int merge = 1;
+            for (int32_t k = 0; k < operands; k++) {
+                if (strides[k][d] != merged[k][n - 1] * merged_shape[n - 1]) {
+                    merge = 0;
+                }
+            }
+            if (merge) {
+                merged_shape[n - 1] *= shape[d];
+                continue;
+            }
+        }
+        merged_shape[n] = shape[d];
+        for (int32_t k = 0; k < operands; k++) {
+            merged[k][n] = strides[k][d];
+        }
+        n++;
+    }
+    if (n == 0) {
+        merged_shape[0] = 1;
+        for (int32_t k = 0; k < operands; k++) {
+            merged[k][0] = 1;
+        }
+        n = 1;
+    }
+    
+    loop->ndim = n;
+    for (int32_t d = 0; d < n; d++) {
+        loop->shape[d] = merged_shape[n - 1 - d];
+        for (int32_t k = 0; k < operands; k++) {
+            loop->strides[k][d] = merged[k][n - 1 - d];
+        }
+    }
+}
+
+/* Visit elements [start, end) of the row-major order */
+static void tensor_loop_run(const TensorLoop* loop, int64_t start, int64_t end, TensorRunFn fn, void* ctx) {
+    int32_t last = loop->ndim - 1;
+    int64_t index[TENSOR_MAX_DIMS];
+    double* ptr[TENSOR_LOOP_OPERANDS] = { NULL };
+    int64_t inner[TENSOR_LOOP_OPERANDS] = { 0 };
+    
+    int64_t rest = start;
+    for (int32_t k = 0; k < loop->operands; k++) {
+        ptr[k] = loop->base[k];
+        inner[k] = loop->strides[k][last];
+    }
+    for (int32_t d = last; d >= 0; d--) {
+        index[d] = rest % loop->shape[d];
+        rest /= loop->shape[d];
+        for (int32_t k = 0; k < loop->operands; k++) {
+            ptr[k] += index[d] * loop->strides[k][d];
+        }
+    }
+    
+    int64_t pos = start;
+    while (pos < end) {
+        int64_t n = loop->shape[last] - index[last];
+        if (n > end - pos) {
+            n = end - pos;
+        }
+        fn(ctx, ptr, inner, n);
+        pos += n;
+        if (pos >= end) {
+            break;
+        }
+        
+        /* Step to the start of the next row, carrying outwards */
+        index[last] += n;
+        for (int32_t k = 0; k < loop->operands; k++) {
+            ptr[k] += n * inner[k];
+        }
+        for (int32_t d = last; d > 0 && index[d] == loop->shape[d]; d--) {
+            index[d] = 0;
+            index[d - 1]++;
+            for (int32_t k = 0; k < loop->operands; k++) {
+                ptr[k] += loop->strides[k][d - 1] - loop->shape[d] * loop->strides[k][d];
+            }
+        }
+    }
+}
+
+/* Split count into runs of at least TENSOR_ELEMENT_BLOCK, about four per
+ * thread (some slack for threads the OS preempts); returns the width */
+static int32_t tensor_split(int64_t count, int64_t* block, int64_t* tasks) {
+    int32_t width = count < TENSOR_PARALLEL_MIN ? 1 : tensor_job_width(count / TENSOR_ELEMENT_BLOCK);
+    int64_t size = (count + 4 * (int64_t)width - 1) / (4 * (int64_t)width);
+    size = (size + 7) & ~(int64_t)7;  /* Whole cache lines per task */
+    *block = size < TENSOR_ELEMENT_BLOCK ? TENSOR_ELEMENT_BLOCK : size;
+    *tasks = (count + *block - 1) / *block;
+    return width;
+}
+
+/* Strides that walk t over shape by the usual broadcasting rules: shapes
+ * line up at the last dimension, and a dimension of size 1 (or a missing
+ * leading one) repeats. Returns 0, or -1 if t's shape doesn't fit. */
+static int tensor_broadcast_strides(const Tensor* t, int32_t ndim, const int64_t* shape, int64_t* strides) {
+    if (t->ndim > ndim) {
+        return -1;
+    }
+    int32_t lead = ndim - t->ndim;
+    for (int32_t d = 0; d < ndim; d++) {
+        if (d < lead) {
+            strides[d] = 0;
+        } else if (t->shape[d - lead] == shape[d]) {
+            strides[d] = t->strides[d - lead];
+        } else if (t->shape[d - lead] == 1) {
+            strides[d] = 0;
+        } else {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+/* ---- Views ---- */
+
+/* A view of rows start, start + step, ... (below stop) along one axis.
+ * Bounds are not clamped: 0 <= start <= stop <= shape[axis], step >= 1. */
+Tensor tensor_slice(const Tensor* t, int32_t axis, int64_t start, int64_t stop, int64_t step) {
+    if (!tensor_valid(t) || axis < 0 || axis >= t->ndim || step < 1 ||
+        start < 0 || start > stop || stop > t->shape[axis]) {
+        errno = EINVAL;
+        return tensor_empty();
+    }
+    Tensor view = tensor_share(t);
+    if (view.data) {
+        view.data += start * t->strides[axis];
+        view.offset += start * t->strides[axis];
+    }
+    view.shape[axis] = (stop - start + step - 1) / step;
+    view.strides[axis] *= step;
+    return view;
+}
+
+/* The (ndim - 1)-dimensional view at index along axis, e.g. one row */
+Tensor tensor_select(const Tensor* t, int32_t axis, int64_t index) {
+    if (!tensor_valid(t) || axis < 0 || axis >= t->ndim || index < 0 || index >= t->shape[axis]) {
+        errno = EINVAL;
+        return tensor_empty();
+    }
+    Tensor view = tensor_share(t);
+    view.data += index * t->strides[axis];
+    view.offset += index * t->strides[axis];
+    for (int32_t d = axis; d < t->ndim - 1; d++) {
+        view.shape[d] = t->shape[d + 1];
+        view.strides[d] = t->strides[d + 1];
+    }
+    view.ndim--;
+    view.shape[view.ndim] = 0;
+    view.strides[view.ndim] = 0;
+    return view;
+}
+
+/* A view with the axes reordered: dimension d of the view is dimension
+ * axes[d] of t (axes holds each of 0 .. ndim - 1 once) */
+Tensor tensor_permute(const Tensor* t, const int32_t* axes) {
+    int seen[TENSOR_MAX_DIMS] = { 0 };
+    if (!tensor_valid(t) || (t->ndim > 0 && axes == NULL)) {
+        errno = EINVAL;
+        return tensor_empty();
+    }
+    for (int32_t d = 0; d < t->ndim; d++) {
+        if (axes[d] < 0 || axes[d] >= t->ndim || seen[axes[d]]) {
+            errno = EINVAL;
+            return tensor_empty();
+        }
+        seen[axes[d]] = 1;
+    }
+    Tensor view = tensor_share(t);
+    for (int32_t d = 0; d < t->ndim; d++) {
+        view.shape[d] = t->shape[axes[d]];
+        view.strides[d] = t->strides[axes[d]];
+    }
+    return view;
+}
+
+/* A view with the last two axes swapped (the matrix transpose); tensors
+ * with fewer than two dimensions come back as they are */
+Tensor tensor_transpose(const Tensor* t) {
+    if (!tensor_valid(t)) {
+        errno = EINVAL;
+        return tensor_empty();
+    }
+    Tensor view = tensor_share(t);
+    if (t->ndim >= 2) {
+        int32_t d = t->ndim - 2;
+        view.shape[d] = t->shape[d + 1];
+        view.shape[d + 1] = t->shape[d];
+        view.strides[d] = t->strides[d + 1];
+        view.strides[d + 1] = t->strides[d];
     }
-    t->rows = 0;
-    t->cols = 0;
+    return view;
 }
 
+/* A read-only view of t repeated to shape (see tensor_broadcast_strides()
+ * for the rules); the repeated dimensions get stride 0 */
+Tensor tensor_broadcast_to(const Tensor* t, int32_t ndim, const int64_t* shape) {
+    int64_t strides[TENSOR_MAX_DIMS];
+    if (!tensor_valid(t) || ndim < 0 || ndim > TENSOR_MAX_DIMS || (ndim > 0 && shape == NULL) ||
+        tensor_broadcast_strides(t, ndim, shape, strides) != 0) {
+        errno = EINVAL;
+        return tensor_empty();
+    }
+    Tensor view = tensor_share(t);
+    view.ndim = ndim;
+    for (int32_t d = 0; d < TENSOR_MAX_DIMS; d++) {
+        view.shape[d] = d < ndim ? shape[d] : 0;
+        view.strides[d] = d < ndim ? strides[d] : 0;
+    }
+    return view;
+}
+
+/* 1 if t is laid out row-major without gaps (views included), else 0 */
+int32_t tensor_is_contiguous(const Tensor* t) {
+    if (!tensor_valid(t)) {
+        return 0;
+    }
+    int64_t expected = 1;
+    for (int32_t d = t->ndim - 1; d >= 0; d--) {
+        if (t->shape[d] == 1) {
+            continue;  /* Any stride walks one element */
+        }
+        if (t->strides[d] != expected) {
+            return 0;
+        }
+        expected *= t->shape[d];
+    }
+    return 1;
+}
+
+/* Copies that write row-major but read along another axis (a transposed
+ * or permuted source) go tile by tile: TILE x TILE blocks keep both the
+ * rows read and the rows written in L1 */
+#define TENSOR_COPY_TILE 32
+
+typedef struct {
+    const TensorLoop* loop;     /* Operand 0 = destination, 1 = source */
+    int32_t axis;               /* Loop dimension tiled against the last one */
+    int64_t tiles;              /* Tiles along axis */
+    int64_t block;              /* Units (outer index, tile) per task */
+    int64_t units;
+} TensorTileCopyJob;
+
+static void tensor_tile_copy_task(void* ctx, int64_t task, int32_t worker) {
+    (void)worker;
+    TensorTileCopyJob* job = (TensorTileCopyJob*)ctx;
+    const TensorLoop* loop = job->loop;
+    int32_t last = loop->ndim - 1;
+    int32_t axis = job->axis;
+    int64_t end = job->units - task * job->block < job->block ? job->units : (task + 1) * job->block;
+    const int64_t tile = TENSOR_COPY_TILE;
+    
+    for (int64_t unit = task * job->block; unit < end; unit++) {
+        /* unit = outer index * tiles + tile; the outer index runs over the
+         * dimensions other than axis and last, row-major */
+        int64_t rest = unit / job->tiles;
+        int64_t i0 = unit % job->tiles * tile;
+        double* dst = loop->base[0] + i0 * loop->strides[0][axis];
+        const double* src = loop->base[1] + i0 * loop->strides[1][axis];
+        for (int32_t d = last - 1; d >= 0; d--) {
+            if (d == axis) {
+                continue;
+            }
+            int64_t i = rest % loop->shape[d];
+            rest /= loop->shape[d];
+            dst += i * loop->strides[0][d];
+            src += i * loop->strides[1][d];
+        }
+        
+        int64_t rows = loop->shape[axis] - i0 < tile ? loop->shape[axis] - i0 : tile;
+        int64_t dst_row = loop->strides[0][axis], dst_col = loop->strides[0][last];
+        int64_t src_row = loop->strides[1][axis], src_col = loop->strides[1][last];
+        for (int64_t j0 = 0; j0 < loop->shape[last]; j0 += tile) {
+            int64_t cols = loop->shape[last] - j0 < tile ? loop->shape[last] - j0 : tile;
+            for (int64_t i = 0; i < rows; i++) {
+                double* out = dst + i * dst_row + j0 * dst_col;
+                const double* in = src + i * src_row + j0 * src_col;
+                for (int64_t j = 0; j < cols; j++) {
+                    out[j * dst_col] = in[j * src_col];
+                }
+            }
+        }
+    }
+}
+
+static void tensor_copy_run(void* ctx, double* const* ptr, const int64_t* stride, int64_t n);
+
+typedef struct {
+    const TensorLoop* loop;
+    int64_t block;
+} TensorCopyJob;
+
+static void tensor_copy_task(void* ctx, int64_t task, int32_t worker) {
+    (void)worker;
+    TensorCopyJob* job = (TensorCopyJob*)ctx;
+    int64_t start = task * job->block;
+    int64_t end = job->loop->count - start < job->block ? job->loop->count : start + job->block;
+    tensor_loop_run(job->loop, start, end, tensor_copy_run, NULL);
+}
+
+/* dst = src elementwise (same shape; dst writable, not overlapping src) */
+static void tensor_copy(Tensor* dst, const Tensor* src) {
+    TensorLoop loop;
+    double* base[2] = { dst->data, src->data };
+    int64_t strides[TENSOR_LOOP_OPERANDS][TENSOR_MAX_DIMS];
+    memcpy(strides[0], dst->strides, sizeof(strides[0]));
+    memcpy(strides[1], src->strides, sizeof(strides[1]));
+    tensor_loop_init(&loop, dst->ndim, dst->shape, 2, base, strides);
+    if (loop.count == 0) {
+        return;
+    }
+    
+    /* Tile when the source walks another axis more tightly than the last */
+    int32_t last = loop.ndim - 1;
+    int32_t axis = -1;
+    for (int32_t d = 0; d < last; d++) {
+        int64_t s = loop.strides[1][d] < 0 ? -loop.strides[1][d] : loop.strides[1][d];
+        int64_t best = axis < 0 ? loop.strides[1][last] : loop.strides[1][axis];
+        if (best < 0) {
+            best = -best;
+        }
+        if (s != 0 && s < best) {
+            axis = d;
+        }
+    }
+    
+    int64_t block, tasks;
+    int32_t width = tensor_split(loop.count, &block, &tasks);
+    if (axis < 0) {
+        TensorCopyJob job = { &loop, block };
+        tensor_parallel(width, tasks, tensor_copy_task, &job);
+        return;
+    }
+    TensorTileCopyJob job;
+    job.loop = &loop;
+    job.axis = axis;
+    job.tiles = (loop.shape[axis] + TENSOR_COPY_TILE - 1) / TENSOR_COPY_TILE;
+    job.units = loop.count / (loop.shape[axis] * loop.shape[last]) * job.tiles;
+    int64_t unit_size = TENSOR_COPY_TILE * loop.shape[last];
+    job.block = (block + unit_size - 1) / unit_size;
+    tensor_parallel(width < job.units ? width : (int32_t)job.units,
+                    (job.units + job.block - 1) / job.block, tensor_tile_copy_task, &job);
+}
+
+/**
+ * A row-major tensor with t's elements: t itself (one more reference) if
+ * it already is contiguous, otherwise a fresh copy. Copies from transposed
+ * or permuted views go through L1-sized tiles, on the tensor thread pool
+ * when large.
+ *
+ * @return The tensor, or an empty one (data == NULL) with errno EINVAL or
+ *         ENOMEM
+ */
+Tensor tensor_contiguous(const Tensor* t) {
+    if (!tensor_valid(t)) {
+        errno = EINVAL;
+        return tensor_empty();
+    }
+    if (tensor_is_contiguous(t)) {
+        return tensor_share(t);
+    }
+    Tensor copy = tensor_new_uninit(t->ndim, t->shape);
+    if (copy.data != NULL) {
+        tensor_copy(&copy, t);
+    }
+    return copy;
+}
+
+/**
+ * The same elements in a new shape with the same count. One entry of
+ * shape may be -1, meaning whatever size makes the counts match.
+ * Contiguous data is reshaped as a view; anything else is copied first
+ * (tensor_contiguous()).
+ *
+ * @return The reshaped tensor, or an empty one with errno EINVAL (counts
+ *         differ, bad shape) or ENOMEM
+ */
+Tensor tensor_reshape(const Tensor* t, int32_t ndim, const int64_t* shape) {
+    int64_t resolved[TENSOR_MAX_DIMS];
+    int32_t infer = -1;
+    int64_t known = 1;
+    if (!tensor_valid(t) || ndim < 0 || ndim > TENSOR_MAX_DIMS || (ndim > 0 && shape == NULL)) {
+        errno = EINVAL;
+        return tensor_empty();
+    }
+    for (int32_t d = 0; d < ndim; d++) {
+        resolved[d] = shape[d];
+        if (shape[d] == -1 && infer < 0) {
+            infer = d;
+        } else if (shape[d] < 0) {
+            errno = EINVAL;
+            return tensor_empty();
+        } else {
+            known *= shape[d];
+        }
+    }
+    int64_t count = tensor_count(t->ndim, t->shape);
+    if (infer >= 0) {
+        if (known == 0 || count % known != 0) {
+            errno = EINVAL;
+            return tensor_empty();
+        }
+        resolved[infer] = count / known;
+        known = count;
+    }
+    if (known != count) {
+        errno = EINVAL;
+        return tensor_empty();
+    }
+    
+    Tensor view = tensor_contiguous(t);
+    if (view.data == NULL && count > 0) {
+        return view;
+    }
+    view.ndim = ndim;
+    for (int32_t d = 0; d < TENSOR_MAX_DIMS; d++) {
+        view.shape[d] = d < ndim ? resolved[d] : 0;
+    }
+    memset(view.strides, 0, sizeof(view.strides));
+    tensor_contiguous_strides(ndim, resolved, view.strides);
+    return view;
+}
+
+
+/* ---- Elementwise operations and reductions ---- */
+
+/* Reductions add up at most this many partial sums */
+#define TENSOR_REDUCE_PARTIALS 512
+
+enum {
+    TENSOR_OP_ADD,
+    TENSOR_OP_SUB,
+    TENSOR_OP_MUL,
+    TENSOR_OP_SCALE,    /* out = s * a */
+    TENSOR_OP_FILL,     /* out = s */
+    TENSOR_OP_COPY      /* out = a */
+};
+
+typedef struct {
+    int32_t op;
+    double s;
+} TensorMapOp;
+
+/* Unit-stride runs get loops of their own: those the compiler vectorizes */
+static void tensor_map_run(void* ctx, double* const* ptr, const int64_t* stride, int64_t n) {
+    const TensorMapOp* map = (const TensorMapOp*)ctx;
+    double* out = ptr[0];
+    const double* a = ptr[1];
+    const double* b = ptr[2];
+    int64_t so = stride[0], sa = stride[1], sb = stride[2];
+    double s = map->s;
+    int unit = so == 1 && sa == 1 && sb == 1;
+    switch (map->op) {
+    case TENSOR_OP_ADD:
+        if (unit) {
+            for (int64_t i = 0; i < n; i++) {
+                out[i] = a[i] + b[i];
+            }
+        } else {
+            for (int64_t i = 0; i < n; i++) {
+                out[i * so] = a[i * sa] + b[i * sb];
+            }
+        }
+        break;
+    case TENSOR_OP_SUB:
+        if (unit) {
+            for (int64_t i = 0; i < n; i++) {
+                out[i] = a[i] - b[i];
+            }
+        } else {
+            for (int64_t i = 0; i < n; i++) {
+                out[i * so] = a[i * sa] - b[i * sb];
+            }
+        }
+        break;
+    case TENSOR_OP_MUL:
+        if (unit) {
+            for (int64_t i = 0; i < n; i++) {
+                out[i] = a[i] * b[i];
+            }
+        } else {
+            for (int64_t i = 0; i < n; i++) {
+                out[i * so] = a[i * sa] * b[i * sb];
+            }
+        }
+        break;
+    case TENSOR_OP_SCALE:
+        if (so == 1 && sa == 1) {
+            for (int64_t i = 0; i < n; i++) {
+                out[i] = s * a[i];
+            }
+        } else {
+            for (int64_t i = 0; i < n; i++) {
+                out[i * so] = s * a[i * sa];
+            }
+        }
+        break;
+    case TENSOR_OP_FILL:
+        if (so == 1) {
+            for (int64_t i = 0; i < n; i++) {
+                out[i] = s;
+            }
+        } else {
+            for (int64_t i = 0; i < n; i++) {
+                out[i * so] = s;
+            }
+        }
+        break;
+    case TENSOR_OP_COPY:
+        tensor_copy_run(NULL, ptr, stride, n);
+        break;
+    }
+}
+
+static void tensor_copy_run(void* ctx, double* const* ptr, const int64_t* stride, int64_t n) {
+    (void)ctx;
+    if (stride[0] == 1 && stride[1] == 1) {
+        memcpy(ptr[0], ptr[1], (size_t)n * sizeof(double));
+    } else {
+        for (int64_t i = 0; i < n; i++) {
+            ptr[0][i * stride[0]] = ptr[1][i * stride[1]];
+        }
+    }
+}
+
+typedef struct {
+    TensorLoop loop;
+    TensorMapOp map;
+    int64_t block;      /* Elements per task */
+} TensorMapJob;
+
+static void tensor_map_task(void* ctx, int64_t task, int32_t worker) {
+    (void)worker;
+    TensorMapJob* job = (TensorMapJob*)ctx;
+    int64_t start = task * job->block;
+    int64_t end = job->loop.count - start < job->block ? job->loop.count : start + job->block;
+    tensor_loop_run(&job->loop, start, end, tensor_map_run, &job->map);
+}
+
+/* out = op(a, b, s) over out's shape, a and b broadcast to it (either may
+ * be NULL when op doesn't read it). Returns 0, or -1 with EINVAL. */
+static int32_t tensor_map(int32_t op, Tensor* out, const Tensor* a, const Tensor* b, double s) {
+    if (!tensor_writable(out) || (a != NULL && !tensor_valid(a)) || (b != NULL && !tensor_valid(b))) {
+        errno = EINVAL;
+        return -1;
+    }
+    TensorMapJob job;
+    double* base[TENSOR_LOOP_OPERANDS] = { out->data, a ? a->data : NULL, b ? b->data : NULL };
+    int64_t strides[TENSOR_LOOP_OPERANDS][TENSOR_MAX_DIMS];
+    memset(strides, 0, sizeof(strides));
+    memcpy(strides[0], out->strides, sizeof(strides[0]));
+    if ((a != NULL && tensor_broadcast_strides(a, out->ndim, out->shape, strides[1]) != 0) ||
+        (b != NULL && tensor_broadcast_strides(b, out->ndim, out->shape, strides[2]) != 0)) {
+        errno = EINVAL;
+        return -1;
+    }
+    tensor_loop_init(&job.loop, out->ndim, out->shape, 3, base, strides);
+    job.map.op = op;
+    job.map.s = s;
+    int64_t tasks;
+    int32_t width = tensor_split(job.loop.count, &job.block, &tasks);
+    tensor_parallel(width, tasks, tensor_map_task, &job);
+    return 0;
+}
+
+/**
+ * Elementwise out = a + b. a and b are broadcast to out's shape (see
+ * tensor_broadcast_to()); out may be a or b, but must not otherwise
+ * overlap them. Large tensors are split across the tensor thread pool.
+ *
+ * @return 0, or -1 with errno EINVAL (NULL tensor, shapes that don't
+ *         broadcast, out a broadcast view)
+ */
+int32_t tensor_add(const Tensor* a, const Tensor* b, Tensor* out) {
+    if (a == NULL || b == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    return tensor_map(TENSOR_OP_ADD, out, a, b, 0.0);
+}
+
+/** Elementwise out = a - b; same rules as tensor_add() */
+int32_t tensor_sub(const Tensor* a, const Tensor* b, Tensor* out) {
+    if (a == NULL || b == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    return tensor_map(TENSOR_OP_SUB, out, a, b, 0.0);
+}
+
+/** Elementwise (Hadamard) product out = a * b; same rules as tensor_add() */
+int32_t tensor_mul(const Tensor* a, const Tensor* b, Tensor* out) {
+    if (a == NULL || b == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    return tensor_map(TENSOR_OP_MUL, out, a, b, 0.0);
+}
+
+/** out = s * a, a broadcast to out; out may be a. @return 0, or -1 with errno EINVAL */
+int32_t tensor_scale(const Tensor* a, double s, Tensor* out) {
+    if (a == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    return tensor_map(TENSOR_OP_SCALE, out, a, NULL, s);
+}
+
+/** Sets every element (of a view: every element it covers) to value. @return 0, or -1 with errno EINVAL */
+int32_t tensor_fill(Tensor* t, double value) {
+    return tensor_map(TENSOR_OP_FILL, t, NULL, NULL, value);
+}
+
+/**
+ * Copies src into dst (dst's shape; src is broadcast to it), e.g. to write
+ * a block into a slice. They must not overlap.
+ *
+ * @return 0, or -1 with errno EINVAL
+ */
+int32_t tensor_assign(Tensor* dst, const Tensor* src) {
+    if (src == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    return tensor_map(TENSOR_OP_COPY, dst, src, NULL, 0.0);
+}
+
+typedef struct {
+    TensorLoop loop;    /* Operand 0 = a, 1 = b (dot only) */
+    int dot;
+    int64_t block;
+    double partial[TENSOR_REDUCE_PARTIALS];
+} TensorReduceJob;
+
+/* Four independent sums hide the add latency */
+static void tensor_sum_run(void* ctx, double* const* ptr, const int64_t* stride, int64_t n) {
+    double* acc = (double*)ctx;
+    const double* a = ptr[0];
+    int64_t sa = stride[0];
+    int64_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        acc[0] += a[i * sa];
+        acc[1] += a[(i + 1) * sa];
+        acc[2] += a[(i + 2) * sa];
+        acc[3] += a[(i + 3) * sa];
+    }
+    for (; i < n; i++) {
+        acc[0] += a[i * sa];
+    }
+}
+
+static void tensor_dot_run(void* ctx, double* const* ptr, const int64_t* stride, int64_t n) {
+    double* acc = (double*)ctx;
+    const double* a = ptr[0];
+    const double* b = ptr[1];
+    int64_t sa = stride[0], sb = stride[1];
+    int64_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        acc[0] += a[i * sa] * b[i * sb];
+        acc[1] += a[(i + 1) * sa] * b[(i + 1) * sb];
+        acc[2] += a[(i + 2) * sa] * b[(i + 2) * sb];
+        acc[3] += a[(i + 3) * sa] * b[(i + 3) * sb];
+    }
+    for (; i < n; i++) {
+        acc[0] += a[i * sa] * b[i * sb];
+    }
+}
+
+static void tensor_reduce_task(void* ctx, int64_t task, int32_t worker) {
+    (void)worker;
+    TensorReduceJob* job = (TensorReduceJob*)ctx;
+    int64_t start = task * job->block;
+    int64_t end = job->loop.count - start < job->block ? job->loop.count : start + job->block;
+    double acc[4] = { 0.0, 0.0, 0.0, 0.0 };
+    tensor_loop_run(&job->loop, start, end, job->dot ? tensor_dot_run : tensor_sum_run, acc);
+    job->partial[task] = (acc[0] + acc[1]) + (acc[2] + acc[3]);
+}
+
+/* The chunking depends only on the element count, never on the thread
+ * count, so a reduction gives bit-identical results however many threads
+ * run it */
+static double tensor_reduce(const Tensor* a, const Tensor* b) {
+    TensorReduceJob job;
+    double* base[TENSOR_LOOP_OPERANDS] = { a->data, b ? b->data : NULL, NULL };
+    int64_t strides[TENSOR_LOOP_OPERANDS][TENSOR_MAX_DIMS];
+    memset(strides, 0, sizeof(strides));
+    memcpy(strides[0], a->strides, sizeof(strides[0]));
+    if (b != NULL) {
+        memcpy(strides[1], b->strides, sizeof(strides[1]));
+    }
+    tensor_loop_init(&job.loop, a->ndim, a->shape, b ? 2 : 1, base, strides);
+    job.dot = b != NULL;
+    
+    int64_t count = job.loop.count;
+    job.block = (count + TENSOR_REDUCE_PARTIALS - 1) / TENSOR_REDUCE_PARTIALS;
+    if (job.block < TENSOR_ELEMENT_BLOCK) {
+        job.block = TENSOR_ELEMENT_BLOCK;
+    }
+    int64_t tasks = (count + job.block - 1) / job.block;
+    int32_t width = count < TENSOR_PARALLEL_MIN ? 1 : tensor_job_width(tasks);
+    tensor_parallel(width, tasks, tensor_reduce_task, &job);
+    double sum = 0.0;
+    for (int64_t t = 0; t < tasks; t++) {
+        sum += job.partial[t];
+    }
+    return sum;
+}
+
+/**
+ * Sum of all elements. The result does not depend on the thread count.
+ *
+ * @return The sum (0.0 for an empty tensor), or 0.0 with errno EINVAL if
+ *         t is NULL
+ */
+double tensor_sum(const Tensor* t) {
+    if (!tensor_valid(t)) {
+        errno = EINVAL;
+        return 0.0;
+    }
+    return tensor_reduce(t, NULL);
+}
+
+static int tensor_same_shape(const Tensor* a, const Tensor* b) {
+    if (a->ndim != b->ndim) {
+        return 0;
+    }
+    for (int32_t d = 0; d < a->ndim; d++) {
+        if (a->shape[d] != b->shape[d]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Sum of the elementwise products of two same-shaped tensors (the dot
+ * product of two vectors).
+ *
+ * @return The sum, or 0.0 with errno EINVAL (NULL tensor, mismatched shapes)
+ */
+double tensor_dot(const Tensor* a, const Tensor* b) {
+    if (!tensor_valid(a) || !tensor_valid(b) || !tensor_same_shape(a, b)) {
+        errno = EINVAL;
+        return 0.0;
+    }
+    return tensor_reduce(a, b);
+}
+
+
+/* ---- Matrix multiplication ---- */
+
+/* tensor_gemm() follows the BLIS scheme. C is walked in NC-column and
+ * MC-row blocks and k in KC-deep slices. For each slice, a KC x NC panel
+ * of op(B) and then an MC x KC block of op(A) are packed into contiguous,
+ * zero-padded buffers: B in NR-wide column strips (sized for L3), A in
+ * MR-tall row strips (sized for L2). A register-tiled micro-kernel then
+ * computes each MR x NR tile of C from one strip of each. It keeps the
+ * whole tile in vector registers and streams both strips from L1, so C is
+ * read and written once per slice. The micro-kernel (and with it MR, NR
+ * and the block sizes) is chosen at run time: AVX-512, AVX2+FMA, or
+ * portable C. */
+
+/* tensor_gemm() transpose flags (match tensor.pyrite) */
+#define TENSOR_NO_TRANS 0
+#define TENSOR_TRANS 1
+
+/* tensor_gemm_use_kernel() ids */
+#define TENSOR_GEMM_AUTO (-1)
+#define TENSOR_GEMM_PORTABLE 0
+#define TENSOR_GEMM_AVX2 1
+#define TENSOR_GEMM_AVX512 2
+
+#define TENSOR_GEMM_MR_MAX 12
+#define TENSOR_GEMM_NR_MAX 16
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define TENSOR_HAVE_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+/* C[0..MR, 0..NR] (row stride ldc) = alpha * A_strip * B_strip + beta * C.
+ * beta == 0 never reads C. The strips hold kc columns of MR values and kc
+ * rows of NR values. */
+typedef void (*TensorMicroKernel)(int64_t kc, const double* a, const double* b,
+                                  double* c, int64_t ldc, double alpha, double beta);
+
+typedef struct {
+    int32_t id;
+    int32_t mr;
+    int32_t nr;
+    int64_t mc;     /* Multiple of mr */
+    int64_t kc;
+    int64_t nc;     /* Multiple of nr */
+    TensorMicroKernel kernel;
+} TensorGemmKernel;
+
+static void tensor_kernel_portable(int64_t kc, const double* a, const double* b,
+                                   double* c, int64_t ldc, double alpha, double beta) {
+    double acc[4][4] = {{0.0}};
+    for (int64_t p = 0; p < kc; p++) {
+        for (int i = 0; i < 4; i++) {
+            double ai = a[i];
+            for (int j = 0; j < 4; j++) {
+                acc[i][j] += ai * b[j];
+            }
+        }
+        a += 4;
+        b += 4;
+    }
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            double* out = &c[i * ldc + j];
+            *out = beta == 0.0 ? alpha * acc[i][j] : alpha * acc[i][j] + beta * *out;
+        }
+    }
+}
+
+#ifdef TENSOR_HAVE_X86_KERNELS
+
+/* 6 x 8: twelve ymm accumulators, two B vectors and a broadcast */
+__attribute__((target("avx2,fma")))
+static void tensor_kernel_avx2(int64_t kc, const double* a, const double* b,
+                               double* c, int64_t ldc, double alpha, double beta) {
+    __m256d c00 = _mm256_setzero_pd(), c01 = _mm256_setzero_pd();
+    __m256d c10 = _mm256_setzero_pd(), c11 = _mm256_setzero_pd();
+    __m256d c20 = _mm256_setzero_pd(), c21 = _mm256_setzero_pd();
+    __m256d c30 = _mm256_setzero_pd(), c31 = _mm256_setzero_pd();
+    __m256d c40 = _mm256_setzero_pd(), c41 = _mm256_setzero_pd();
+    __m256d c50 = _mm256_setzero_pd(), c51 = _mm256_setzero_pd();
+    for (int64_t p = 0; p < kc; p++) {
+        __m256d b0 = _mm256_load_pd(b);
+        __m256d b1 = _mm256_load_pd(b + 4);
+        __m256d ai;
+        ai = _mm256_broadcast_sd(a + 0);
+        c00 = _mm256_fmadd_pd(ai, b0, c00);
+        c01 = _mm256_fmadd_pd(ai, b1, c01);
+        ai = _mm256_broadcast_sd(a + 1);
+        c10 = _mm256_fmadd_pd(ai, b0, c10);
+        c11 = _mm256_fmadd_pd(ai, b1, c11);
+        ai = _mm256_broadcast_sd(a + 2);
+        c20 = _mm256_fmadd_pd(ai, b0, c20);
+        c21 = _mm256_fmadd_pd(ai, b1, c21);
+        ai = _mm256_broadcast_sd(a + 3);
+        c30 = _mm256_fmadd_pd(ai, b0, c30);
+        c31 = _mm256_fmadd_pd(ai, b1, c31);
+        ai = _mm256_broadcast_sd(a + 4);
+        c40 = _mm256_fmadd_pd(ai, b0, c40);
+        c41 = _mm256_fmadd_pd(ai, b1, c41);
+        ai = _mm256_broadcast_sd(a + 5);
+        c50 = _mm256_fmadd_pd(ai, b0, c50);
+        c51 = _mm256_fmadd_pd(ai, b1, c51);
+        a += 6;
+        b += 8;
+    }
+    __m256d acc[12] = { c00, c01, c10, c11, c20, c21, c30, c31, c40, c41, c50, c51 };
+    __m256d valpha = _mm256_set1_pd(alpha);
+    __m256d vbeta = _mm256_set1_pd(beta);
+    for (int i = 0; i < 6; i++) {
+        for (int h = 0; h < 2; h++) {
+            double* out = c + i * ldc + h * 4;
+            __m256d r = _mm256_mul_pd(acc[i * 2 + h], valpha);
+            if (beta != 0.0) {
+                r = _mm256_fmadd_pd(_mm256_loadu_pd(out), vbeta, r);
+            }
+            _mm256_storeu_pd(out, r);
+        }
+    }
+}
+
+/* 12 x 16: twenty-four zmm accumulators, two B vectors and a broadcast */
+__attribute__((target("avx512f")))
+static void tensor_kernel_avx512(int64_t kc, const double* a, const double* b,
+                                 double* c, int64_t ldc, double alpha, double beta) {
+    __m512d acc[24];
+    for (int i = 0; i < 24; i++) {
+        acc[i] = _mm512_setzero_pd();
+    }
+    for (int64_t p = 0; p < kc; p++) {
+        __m512d b0 = _mm512_load_pd(b);
+        __m512d b1 = _mm512_load_pd(b + 8);
+#define TENSOR_AVX512_ROW(i) do { \
+            __m512d ai = _mm512_set1_pd(a[i]); \
+            acc[2 * (i)] = _mm512_fmadd_pd(ai, b0, acc[2 * (i)]); \
+            acc[2 * (i) + 1] = _mm512_fmadd_pd(ai, b1, acc[2 * (i) + 1]); \
+        } while (0)
+        TENSOR_AVX512_ROW(0);
+        TENSOR_AVX512_ROW(1);
+        TENSOR_AVX512_ROW(2);
+        TENSOR_AVX512_ROW(3);
+        TENSOR_AVX512_ROW(4);
+        TENSOR_AVX512_ROW(5);
+        TENSOR_AVX512_ROW(6);
+        TENSOR_AVX512_ROW(7);
+        TENSOR_AVX512_ROW(8);
+        TENSOR_AVX512_ROW(9);
+        TENSOR_AVX512_ROW(10);
+        TENSOR_AVX512_ROW(11);
+#undef TENSOR_AVX512_ROW
+        a += 12;
+        b += 16;
+    }
+    __m512d valpha = _mm512_set1_pd(alpha);
+    __m512d vbeta = _mm512_set1_pd(beta);
+    for (int i = 0; i < 12; i++) {
+        for (int h = 0; h < 2; h++) {
+            double* out = c + i * ldc + h * 8;
+            __m512d r = _mm512_mul_pd(acc[i * 2 + h], valpha);
+            if (beta != 0.0) {
+                r = _mm512_fmadd_pd(_mm512_loadu_pd(out), vbeta, r);
+            }
+            _mm512_storeu_pd(out, r);
+        }
+    }
+}
+
+#endif
+
+static const TensorGemmKernel tensor_gemm_kernels[] = {
+    { TENSOR_GEMM_PORTABLE, 4, 4, 128, 256, 2048, tensor_kernel_portable },
+#ifdef TENSOR_HAVE_X86_KERNELS
+    { TENSOR_GEMM_AVX2, 6, 8, 96, 256, 2048, tensor_kernel_avx2 },
+    { TENSOR_GEMM_AVX512, 12, 16, 240, 256, 3072, tensor_kernel_avx512 },
+#endif
+};
+
+static int tensor_gemm_supported(int32_t id) {
+    switch (id) {
+    case TENSOR_GEMM_PORTABLE:
+        return 1;
+#ifdef TENSOR_HAVE_X86_KERNELS
+    case TENSOR_GEMM_AVX2:
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    case TENSOR_GEMM_AVX512:
+        return __builtin_cpu_supports("avx512f");
+#endif
+    default:
+        return 0;
+    }
+}
+
+/* Kernel id in use; resolved on first use */
+static int32_t tensor_gemm_active = TENSOR_GEMM_AUTO;
+
+static const TensorGemmKernel* tensor_gemm_kernel() {
+    int32_t id = __atomic_load_n(&tensor_gemm_active, __ATOMIC_RELAXED);
+    if (id == TENSOR_GEMM_AUTO) {
+        id = TENSOR_GEMM_PORTABLE;
+        for (int32_t candidate = TENSOR_GEMM_AVX512; candidate > TENSOR_GEMM_PORTABLE; candidate--) {
+            if (tensor_gemm_supported(candidate)) {
+                id = candidate;
+                break;
+            }
+        }
+        __atomic_store_n(&tensor_gemm_active, id, __ATOMIC_RELAXED);
+    }
+    return &tensor_gemm_kernels[id];
+}
+
+/**
+ * Selects the GEMM micro-kernel: TENSOR_GEMM_PORTABLE (0), TENSOR_GEMM_AVX2
+ * (1) or TENSOR_GEMM_AVX512 (2), or TENSOR_GEMM_AUTO (-1) for the fastest
+ * the CPU supports (the default). Fused expressions use the same
+ * instruction set. Meant for benchmarks and tests; affects every thread.
+ *
+ * @return The kernel now in use, or -1 with EINVAL if the requested one is
+ *         not available on this CPU or build
+ */
+int32_t tensor_gemm_use_kernel(int32_t kernel) {
+    if (kernel == TENSOR_GEMM_AUTO) {
+        __atomic_store_n(&tensor_gemm_active, TENSOR_GEMM_AUTO, __ATOMIC_RELAXED);
+        return tensor_gemm_kernel()->id;
+    }
+    if (!tensor_gemm_supported(kernel)) {
+        errno = EINVAL;
+        return -1;
+    }
+    __atomic_store_n(&tensor_gemm_active, kernel, __ATOMIC_RELAXED);
+    return kernel;
+}
+
+/* Pack rows [0, mc) x columns [0, kc) of a matrix with strides (rs, cs)
+ * into mr-tall strips: strip s holds, for each p, rows s*mr .. s*mr+mr-1
+ * of column p, zero-padded past mc */
+static void tensor_pack_a(const double* a, int64_t rs, int64_t cs, int64_t mc, int64_t kc,
+                          int32_t mr, double* out) {
+    for (int64_t i0 = 0; i0 < mc; i0 += mr) {
+        int64_t rows = mc - i0 < mr ? mc - i0 : mr;
+        const double* src = a + i0 * rs;
+        if (rows == mr && cs == 1) {
+            for (int64_t p = 0; p < kc; p++) {
+                for (int32_t i = 0; i < mr; i++) {
+                    out[i] = src[i * rs + p];
+                }
+                out += mr;
+            }
+        } else {
+            for (int64_t p = 0; p < kc; p++) {
+                int32_t i = 0;
+                for (; i < rows; i++) {
+                    out[i] = src[i * rs + p * cs];
+                }
+                for (; i < mr; i++) {
+                    out[i] = 0.0;
+                }
+                out += mr;
+            }
+        }
+    }
+}
+
+/* Pack rows [0, kc) x columns [0, nc) into nr-wide strips: strip s holds,
+ * for each p, columns s*nr .. s*nr+nr-1 of row p, zero-padded past nc */
+static void tensor_pack_b(const double* b, int64_t rs, int64_t cs, int64_t kc, int64_t nc,
+                          int32_t nr, double* out) {
+    for (int64_t j0 = 0; j0 < nc; j0 += nr) {
+        int64_t cols = nc - j0 < nr ? nc - j0 : nr;
+        const double* src = b + j0 * cs;
+        if (cols == nr && cs == 1) {
+            for (int64_t p = 0; p < kc; p++) {
+                memcpy(out, src + p * rs, (size_t)nr * sizeof(double));
+                out += nr;
+            }
+        } else {
+            for (int64_t p = 0; p < kc; p++) {
+                int32_t j = 0;
+                for (; j < cols; j++) {
+                    out[j] = src[p * rs + j * cs];
+                }
+                for (; j < nr; j++) {
+                    out[j] = 0.0;
+                }
+                out += nr;
+            }
+        }
+    }
+}
+
+/* One packed MC x KC block of A against one packed KC x NC panel of B */
+static void tensor_gemm_macro(const TensorGemmKernel* k, int64_t mc, int64_t nc, int64_t kc,
+                              const double* a_pack, const double* b_pack,
+                              double* c, int64_t ldc, double alpha, double beta) {
+    double edge[TENSOR_GEMM_MR_MAX * TENSOR_GEMM_NR_MAX];
+    for (int64_t j0 = 0; j0 < nc; j0 += k->nr) {
+        int64_t cols = nc - j0 < k->nr ? nc - j0 : k->nr;
+        const double* b_strip = b_pack + j0 * kc;
+        for (int64_t i0 = 0; i0 < mc; i0 += k->mr) {
+            int64_t rows = mc - i0 < k->mr ? mc - i0 : k->mr;
+            const double* a_strip = a_pack + i0 * kc;
+            double* tile = c + i0 * ldc + j0;
+            if (rows == k->mr && cols == k->nr) {
+                k->kernel(kc, a_strip, b_strip, tile, ldc, alpha, beta);
+                continue;
+            }
+            /* Edge tile: compute the full tile aside, merge the valid part */
+            k->kernel(kc, a_strip, b_strip, edge, k->nr, 1.0, 0.0);
+            for (int64_t i = 0; i < rows; i++) {
+                for (int64_t j = 0; j < cols; j++) {
+                    double* out = &tile[i * ldc + j];
+                    double value = alpha * edge[i * k->nr + j];
+                    *out = beta == 0.0 ? value : value + beta * *out;
+                }
+            }
+        }
+    }
+}
+
+/* C = beta * C (beta == 0 clears without reading C) */
+static void tensor_gemm_scale(Tensor* c, double beta) {
+    if (beta == 0.0) {
+        tensor_map(TENSOR_OP_FILL, c, NULL, NULL, 0.0);
+    } else if (beta != 1.0) {
+        tensor_map(TENSOR_OP_SCALE, c, c, NULL, beta);
+    }
+}
+
+/* Products smaller than this (m * n * k) run on the calling thread */
+#define TENSOR_GEMM_PARALLEL_MIN (128 * 128 * 128)
+/* Packed B panels smaller than this (doubles) are packed by one thread */
+#define TENSOR_GEMM_PARALLEL_PACK 32768
+
+/* One tensor_gemm() call, shared by its tasks. Per KC x NC slice, one job
+ * packs the B panel in column ranges, then one job computes C in a grid of
+ * row block x column range tiles, each packing its own rows of A. */
+typedef struct {
+    const TensorGemmKernel* kernel;
+    const double* a;
+    int64_t rsa, csa;
+    const double* b;
+    int64_t rsb, csb;
+    double* c;
+    int64_t ldc;
+    int64_t m;
+    double alpha;
+    double beta;            /* Of the current slice */
+    int64_t jc, nc, pc, kc; /* Current slice */
+    int64_t pack_block;     /* Panel columns per packing task (multiple of nr) */
+    int64_t row_block;      /* Rows of C per task (multiple of mr, <= mc) */
+    int64_t col_block;      /* Panel columns per task (multiple of nr) */
+    int64_t col_tasks;
+    double* b_pack;
+    double* a_pack;         /* One mc x kc block per worker */
+    int64_t a_pack_size;
+} TensorGemmJob;
+
+static void tensor_gemm_pack_task(void* ctx, int64_t task, int32_t worker) {
+    (void)worker;
+    TensorGemmJob* job = (TensorGemmJob*)ctx;
+    int64_t j0 = task * job->pack_block;
+    int64_t cols = job->nc - j0 < job->pack_block ? job->nc - j0 : job->pack_block;
+    tensor_pack_b(job->b + job->pc * job->rsb + (job->jc + j0) * job->csb, job->rsb, job->csb,
+                  job->kc, cols, job->kernel->nr, job->b_pack + j0 * job->kc);
+}
+
+static void tensor_gemm_tile_task(void* ctx, int64_t task, int32_t worker) {
+    TensorGemmJob* job = (TensorGemmJob*)ctx;
+    int64_t i0 = task / job->col_tasks * job->row_block;
+    int64_t j0 = task % job->col_tasks * job->col_block;
+    int64_t mc = job->m - i0 < job->row_block ? job->m - i0 : job->row_block;
+    int64_t nc = job->nc - j0 < job->col_block ? job->nc - j0 : job->col_block;
+    double* a_pack = job->a_pack + worker * job->a_pack_size;
+    tensor_pack_a(job->a + i0 * job->rsa + job->pc * job->csa, job->rsa, job->csa, mc, job->kc,
+                  job->kernel->mr, a_pack);
+    tensor_gemm_macro(job->kernel, mc, nc, job->kc, a_pack, job->b_pack + j0 * job->kc,
+                      job->c + i0 * job->ldc + job->jc + j0, job->ldc, job->alpha, job->beta);
+}
+
+/* The blocked product proper, into C with unit column stride and row
+ * stride ldc; a and b hold op(A) and op(B) with their strides */
+static int32_t tensor_gemm_run(double alpha, const double* a, int64_t rsa, int64_t csa,
+                               const double* b, int64_t rsb, int64_t csb, double beta,
+                               double* c, int64_t ldc, int64_t m, int64_t n, int64_t k) {
+    TensorGemmJob job;
+    const TensorGemmKernel* kernel = tensor_gemm_kernel();
+    job.kernel = kernel;
+    job.a = a;
+    job.rsa = rsa;
+    job.csa = csa;
+    job.b = b;
+    job.rsb = rsb;
+    job.csb = csb;
+    job.c = c;
+    job.ldc = ldc;
+    job.m = m;
+    job.alpha = alpha;
+
+    /* Rows of C go out in whole rounds of width blocks of at most mc rows,
+     * so no thread idles through a last, partial round. A product too
+     * short to give every thread a block of rows splits columns too. */
+    int64_t row_slots = (m + kernel->mr - 1) / kernel->mr;
+    int64_t col_slots = (n + kernel->nr - 1) / kernel->nr;
+    int32_t width = 1;
+    if (m * n * k >= TENSOR_GEMM_PARALLEL_MIN) {
+        width = tensor_job_width(row_slots * col_slots);
+    }
+    int64_t rounds = (m + kernel->mc * width - 1) / (kernel->mc * width);
+    int64_t rows = (m + rounds * width - 1) / (rounds * width);
+    job.row_block = (rows + kernel->mr - 1) / kernel->mr * kernel->mr;
+    int64_t row_tasks = (m + job.row_block - 1) / job.row_block;
+    int64_t col_split = row_tasks < width ? (width + row_tasks - 1) / row_tasks : 1;
+
+    int64_t nc_max = n < kernel->nc ? col_slots * kernel->nr : kernel->nc;
+    int64_t kc_max = k < kernel->kc ? k : kernel->kc;
+    job.a_pack_size = job.row_block * kc_max;
+    job.a_pack = tensor_aligned_alloc((size_t)(width * job.a_pack_size));
+    job.b_pack = tensor_aligned_alloc((size_t)(kc_max * nc_max));
+    if (job.a_pack == NULL || job.b_pack == NULL) {
+        tensor_aligned_free(job.a_pack);
+        tensor_aligned_free(job.b_pack);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    for (job.jc = 0; job.jc < n; job.jc += kernel->nc) {
+        job.nc = n - job.jc < kernel->nc ? n - job.jc : kernel->nc;
+        int64_t strips = (job.nc + kernel->nr - 1) / kernel->nr;
+        job.col_block = (strips + col_split - 1) / col_split * kernel->nr;
+        job.col_tasks = (job.nc + job.col_block - 1) / job.col_block;
+        for (job.pc = 0; job.pc < k; job.pc += kernel->kc) {
+            job.kc = k - job.pc < kernel->kc ? k - job.pc : kernel->kc;
+            /* Later k slices accumulate onto the first */
+            job.beta = job.pc == 0 ? beta : 1.0;
+            int32_t pack_width = job.kc * job.nc < TENSOR_GEMM_PARALLEL_PACK ? 1 : width;
+            job.pack_block = (strips + pack_width - 1) / pack_width * kernel->nr;
+            tensor_parallel(pack_width, (job.nc + job.pack_block - 1) / job.pack_block,
+                            tensor_gemm_pack_task, &job);
+            tensor_parallel(width, row_tasks * job.col_tasks, tensor_gemm_tile_task, &job);
+        }
+    }
+
+    tensor_aligned_free(job.a_pack);
+    tensor_aligned_free(job.b_pack);
+    return 0;
+}
+
+/**
+ * General matrix multiply: C = alpha * op(A) * op(B) + beta * C, where
+ * op(X) is X, or X transposed when trans_x is TENSOR_TRANS (1). All three
+ * are 2-D and may be views (slices, transposes, broadcasts for A and B):
+ * packing reads any strides. C must already have the shape of the
+ * product. With beta == 0, C is only written, so its old contents (even
+ * NaN) don't matter. A C whose rows are not unit-stride is computed aside
+ * and copied in.
+ *
+ * C must not share storage with A or B. Large products run on the tensor
+ * thread pool (see tensor_set_threads()).
+ *
+ * @return 0, or -1 with errno EINVAL (NULL or non-2-D tensor, mismatched
+ *         shapes, aliasing, C a broadcast view) or ENOMEM
+ */
+int32_t tensor_gemm(double alpha, const Tensor* a, int32_t trans_a,
+                    const Tensor* b, int32_t trans_b, double beta, Tensor* c) {
+    if (!tensor_valid(a) || !tensor_valid(b) || !tensor_writable(c) ||
+        a->ndim != 2 || b->ndim != 2 || c->ndim != 2) {
+        errno = EINVAL;
+        return -1;
+    }
+    int64_t m = c->shape[0];
+    int64_t n = c->shape[1];
+    int64_t k = trans_a ? a->shape[0] : a->shape[1];
+    if ((trans_a ? a->shape[1] : a->shape[0]) != m || (trans_b ? b->shape[1] : b->shape[0]) != k ||
+        (trans_b ? b->shape[0] : b->shape[1]) != n) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (m == 0 || n == 0) {
+        return 0;
+    }
+    if (c->storage == a->storage || c->storage == b->storage) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (k == 0 || alpha == 0.0) {
+        tensor_gemm_scale(c, beta);
+        return 0;
+    }
+
+    /* Element (i, p) of op(A) is a->data[i * rsa + p * csa]; likewise B */
+    int64_t rsa = a->strides[trans_a ? 1 : 0];
+    int64_t csa = a->strides[trans_a ? 0 : 1];
+    int64_t rsb = b->strides[trans_b ? 1 : 0];
+    int64_t csb = b->strides[trans_b ? 0 : 1];
+
+    if ((c->strides[1] == 1 || n == 1) && (c->strides[0] >= n || m == 1)) {
+        int64_t ldc = m == 1 ? n : c->strides[0];
+        return tensor_gemm_run(alpha, a->data, rsa, csa, b->data, rsb, csb, beta, c->data, ldc, m, n, k);
+    }
+    /* Not contiguous here, so tensor_contiguous() copies */
+    int64_t shape[2] = { m, n };
+    Tensor staged = beta == 0.0 ? tensor_new_uninit(2, shape) : tensor_contiguous(c);
+    if (staged.data == NULL) {
+        return -1;
+    }
+    int32_t result = tensor_gemm_run(alpha, a->data, rsa, csa, b->data, rsb, csb, beta,
+                                     staged.data, n, m, n, k);
+    if (result == 0) {
+        tensor_copy(c, &staged);
+    }
+    int error = errno;
+    tensor_drop(&staged);
+    errno = error;
+    return result;
+}
+
+/**
+ * Matrix product a * b of two 2-D tensors (or views) as a new row-major
+ * rows(a) x cols(b) tensor.
+ *
+ * @return The product, or an empty tensor (data == NULL) with errno EINVAL
+ *         if either isn't 2-D or cols(a) != rows(b), or ENOMEM
+ */
+Tensor tensor_matmul(const Tensor* a, const Tensor* b) {
+    if (!tensor_valid(a) || !tensor_valid(b) || a->ndim != 2 || b->ndim != 2 ||
+        a->shape[1] != b->shape[0]) {
+        errno = EINVAL;
+        return tensor_empty();
+    }
+    int64_t shape[2] = { a->shape[0], b->shape[1] };
+    Tensor c = tensor_new_uninit(2, shape);
+    if (c.data == NULL) {
+        return c;
+    }
+    if (tensor_gemm(1.0, a, TENSOR_NO_TRANS, b, TENSOR_NO_TRANS, 0.0, &c) != 0) {
+        int error = errno;
+        tensor_drop(&c);
+        errno = error;
+        return tensor_empty();
+    }
+    return c;
+}
+
+
+/* ---- Fused expressions ---- */
+
+/* An expression records elementwise operations on tensors as a graph
+ * instead of running them. tensor_expr_input() and tensor_expr_const()
+ * add leaves; tensor_expr_unary() and tensor_expr_binary() add operations
+ * on earlier nodes. Each returns the new node's id. tensor_expr_eval()
+ * then computes one node in a single pass over the output.
+ *
+ * The nodes the result depends on are compiled into a short register
+ * program: constant subexpressions are folded, a * b + c becomes one
+ * multiply-add, and a register is reused once its value is dead. The
+ * program is interpreted tile by tile. A register holds TENSOR_EXPR_TILE
+ * elements, so the intermediates of a tile stay in L1 and no full-size
+ * temporary is allocated. Each instruction is one loop over the tile in
+ * 8-wide vectors, built for AVX-512, AVX2+FMA and portable C and picked
+ * like the GEMM micro-kernel. Unit-stride inputs and outputs are used in
+ * place; any other stride is gathered into (or scattered from) a register. */
+
+/* tensor_expr_unary() and tensor_expr_binary() operations (match tensor.pyrite) */
+#define TENSOR_EXPR_ADD 0
+#define TENSOR_EXPR_SUB 1
+#define TENSOR_EXPR_MUL 2
+#define TENSOR_EXPR_DIV 3
+#define TENSOR_EXPR_MIN 4
+#define TENSOR_EXPR_MAX 5
+#define TENSOR_EXPR_NEG 6
+#define TENSOR_EXPR_ABS 7
+#define TENSOR_EXPR_SQRT 8
+#define TENSOR_EXPR_EXP 9
+#define TENSOR_EXPR_LOG 10
+/* Leaves, and instructions only the compiler emits */
+#define TENSOR_EXPR_INPUT 16
+#define TENSOR_EXPR_CONST 17
+#define TENSOR_EXPR_COPY 18
+#define TENSOR_EXPR_FMA 19      /* x * y + z */
+#define TENSOR_EXPR_FMS 20      /* x * y - z */
+
+/* Elements per register: a whole number of vectors */
+#define TENSOR_EXPR_TILE 256
+#define TENSOR_EXPR_VECTOR 8
+/* Limits of one compiled program */
+#define TENSOR_EXPR_MAX_INPUTS (TENSOR_LOOP_OPERANDS - 1)
+#define TENSOR_EXPR_MAX_REGS 32
+#define TENSOR_EXPR_MAX_CODE 128
+
+#if defined(__GNUC__) || defined(__clang__)
+#define TENSOR_EXPR_SIMD 1
+/* Eight doubles; aligned(8) allows loads and stores at any element */
+typedef double TensorExprVec __attribute__((vector_size(64), aligned(8)));
+typedef int64_t TensorExprMask __attribute__((vector_size(64), aligned(8)));
+#define TENSOR_EXPR_BODY static inline __attribute__((always_inline))
+#else
+#define TENSOR_EXPR_BODY static
+#endif
+
+typedef struct {
+    int32_t op;
+    int32_t arg[3];     /* Node ids, or (TENSOR_EXPR_INPUT) the input index */
+    double value;       /* TENSOR_EXPR_CONST */
+} TensorExprNode;
+
+typedef struct {
+    TensorExprNode* nodes;
+    int32_t count;
+    int32_t capacity;
+    Tensor* inputs;     /* References held until tensor_expr_free() */
+    int32_t input_count;
+    int32_t input_capacity;
+} TensorExpr;
+
+typedef struct {
+    int32_t op;
+    int32_t dst;
+    int32_t src[3];
+} TensorExprInstr;
+
+typedef struct {
+    TensorExprInstr code[TENSOR_EXPR_MAX_CODE];
+    int32_t length;
+    int32_t regs;
+    int32_t result;                                     /* Written only by the last instruction */
+    int32_t inputs;
+    const Tensor* input[TENSOR_EXPR_MAX_INPUTS];
+    int32_t input_reg[TENSOR_EXPR_MAX_INPUTS];
+    int32_t constants;
+    double constant[TENSOR_EXPR_MAX_REGS];
+    int32_t constant_reg[TENSOR_EXPR_MAX_REGS];
+} TensorExprProgram;
+
+static int tensor_expr_grow(void** items, int32_t* capacity, int32_t count, size_t size) {
+    if (count < *capacity) {
+        return 0;
+    }
+    if (*capacity > INT32_MAX / 2) {
+        errno = ENOMEM;
+        return -1;
+    }
+    int32_t grown = *capacity ? *capacity * 2 : 16;
+    void* p = realloc(*items, (size_t)grown * size);
+    if (p == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    *items = p;
+    *capacity = grown;
+    return 0;
+}
+
+static int32_t tensor_expr_node(TensorExpr* e, int32_t op, int32_t x, int32_t y, double value) {
+    if (tensor_expr_grow((void**)&e->nodes, &e->capacity, e->count, sizeof(TensorExprNode)) != 0) {
+        return -1;
+    }
+    TensorExprNode* node = &e->nodes[e->count];
+    node->op = op;
+    node->arg[0] = x;
+    node->arg[1] = y;
+    node->arg[2] = -1;
+    node->value = value;
+    return e->count++;
+}
+
+static int tensor_expr_has_node(const TensorExpr* e, int32_t id) {
+    return e != NULL && id >= 0 && id < e->count;
+}
+
+/**
+ * Creates an empty expression. Release it with tensor_expr_free().
+ *
+ * @return The expression handle, or NULL with errno ENOMEM
+ */
+void* tensor_expr_new() {
+    TensorExpr* e = (TensorExpr*)calloc(1, sizeof(TensorExpr));
+    if (e == NULL) {
+        errno = ENOMEM;
+    }
+    return e;
+}
+
+/**
+ * Adds a leaf that reads t (any view). The expression keeps its own
+ * reference, so t may be dropped before evaluation; writes to its
+ * elements made before tensor_expr_eval() are seen.
+ *
+ * @return The node id, or -1 with errno EINVAL or ENOMEM
+ */
+int32_t tensor_expr_input(void* expr, const Tensor* t) {
+    TensorExpr* e = (TensorExpr*)expr;
+    if (e == NULL || !tensor_valid(t)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (tensor_expr_grow((void**)&e->inputs, &e->input_capacity, e->input_count, sizeof(Tensor)) != 0) {
+        return -1;
+    }
+    int32_t id = tensor_expr_node(e, TENSOR_EXPR_INPUT, e->input_count, -1, 0.0);
+    if (id < 0) {
+        return -1;
+    }
+    e->inputs[e->input_count++] = tensor_share(t);
+    return id;
+}
+
+/** Adds a leaf that is value everywhere. @return The node id, or -1 with errno EINVAL or ENOMEM */
+int32_t tensor_expr_const(void* expr, double value) {
+    TensorExpr* e = (TensorExpr*)expr;
+    if (e == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    return tensor_expr_node(e, TENSOR_EXPR_CONST, -1, -1, value);
+}
+
+/**
+ * Adds op(x) for TENSOR_EXPR_NEG, _ABS, _SQRT, _EXP or _LOG. A failed
+ * earlier call's -1 is passed through, so a chain of calls can be
+ * checked once at the end.
+ *
+ * @return The node id, or -1 with errno EINVAL or ENOMEM
+ */
+int32_t tensor_expr_unary(void* expr, int32_t op, int32_t x) {
+    TensorExpr* e = (TensorExpr*)expr;
+    if (op < TENSOR_EXPR_NEG || op > TENSOR_EXPR_LOG || !tensor_expr_has_node(e, x)) {
+        errno = EINVAL;
+        return -1;
+    }
+    return tensor_expr_node(e, op, x, -1, 0.0);
+}
+
+/**
+ * Adds x op y for TENSOR_EXPR_ADD, _SUB, _MUL, _DIV, _MIN or _MAX, the
+ * operands broadcast against each other when evaluated. MIN and MAX give
+ * y when either is NaN.
+ *
+ * @return The node id, or -1 with errno EINVAL or ENOMEM
+ */
+int32_t tensor_expr_binary(void* expr, int32_t op, int32_t x, int32_t y) {
+    TensorExpr* e = (TensorExpr*)expr;
+    if (op < TENSOR_EXPR_ADD || op > TENSOR_EXPR_MAX || !tensor_expr_has_node(e, x) ||
+        !tensor_expr_has_node(e, y)) {
+        errno = EINVAL;
+        return -1;
+    }
+    return tensor_expr_node(e, op, x, y, 0.0);
+}
+
+/** Releases an expression and its references to the input tensors */
+void tensor_expr_free(void* expr) {
+    TensorExpr* e = (TensorExpr*)expr;
+    if (e == NULL) {
+        return;
+    }
+    for (int32_t i = 0; i < e->input_count; i++) {
+        tensor_drop(&e->inputs[i]);
+    }
+    free(e->inputs);
+    free(e->nodes);
+    free(e);
+}
+
+static double tensor_expr_apply(int32_t op, double x, double y) {
+    switch (op) {
+    case TENSOR_EXPR_ADD: return x + y;
+    case TENSOR_EXPR_SUB: return x - y;
+    case TENSOR_EXPR_MUL: return x * y;
+    case TENSOR_EXPR_DIV: return x / y;
+    case TENSOR_EXPR_MIN: return x < y ? x : y;
+    case TENSOR_EXPR_MAX: return x > y ? x : y;
+    case TENSOR_EXPR_NEG: return -x;
+    case TENSOR_EXPR_ABS: return fabs(x);
+    case TENSOR_EXPR_SQRT: return sqrt(x);
+    case TENSOR_EXPR_EXP: return exp(x);
+    default: return log(x);
+    }
+}
+
+/* Mark the nodes root depends on and count each one's uses */
+static void tensor_expr_reach(const TensorExprNode* nodes, int32_t root, int32_t* uses, int32_t* last) {
+    for (int32_t i = 0; i <= root; i++) {
+        uses[i] = 0;
+        last[i] = -1;
+    }
+    uses[root] = 1;
+    for (int32_t i = root; i >= 0; i--) {
+        if (uses[i] == 0 || nodes[i].op == TENSOR_EXPR_INPUT || nodes[i].op == TENSOR_EXPR_CONST) {
+            continue;
+        }
+        for (int32_t k = 0; k < 3 && nodes[i].arg[k] >= 0; k++) {
+            int32_t arg = nodes[i].arg[k];
+            uses[arg]++;
+            if (last[arg] < i) {
+                last[arg] = i;
+            }
+        }
+    }
+}
+
+static int tensor_expr_same_view(const Tensor* a, const Tensor* b) {
+    if (a->data != b->data || a->ndim != b->ndim) {
+        return 0;
+    }
+    for (int32_t d = 0; d < a->ndim; d++) {
+        if (a->shape[d] != b->shape[d] || a->strides[d] != b->strides[d]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int32_t tensor_expr_alloc(int32_t* busy, int32_t* regs) {
+    for (int32_t r = 0; r < TENSOR_EXPR_MAX_REGS; r++) {
+        if (!busy[r]) {
+            busy[r] = 1;
+            if (*regs < r + 1) {
+                *regs = r + 1;
+            }
+            return r;
+        }
+    }
+    return -1;
+}
+
+/* Compile node root of e into p. Returns 0, or -1 with EINVAL (too many
+ * inputs or registers) or ENOMEM. */
+static int tensor_expr_compile(const TensorExpr* e, int32_t root, TensorExprProgram* p) {
+    int32_t count = root + 1;
+    TensorExprNode* nodes = (TensorExprNode*)malloc((size_t)count * sizeof(TensorExprNode));
+    int32_t* scratch = (int32_t*)malloc((size_t)count * 3 * sizeof(int32_t));
+    if (nodes == NULL || scratch == NULL) {
+        free(nodes);
+        free(scratch);
+        errno = ENOMEM;
+        return -1;
+    }
+    int32_t* uses = scratch;
+    int32_t* last = scratch + count;
+    int32_t* reg = scratch + 2 * count;
+    memcpy(nodes, e->nodes, (size_t)count * sizeof(TensorExprNode));
+    
+    /* Fold operations on constants (ids only point backwards, so one pass
+     * in order sees every operand folded first) */
+    for (int32_t i = 0; i < count; i++) {
+        TensorExprNode* n = &nodes[i];
+        if (n->op > TENSOR_EXPR_LOG || nodes[n->arg[0]].op != TENSOR_EXPR_CONST) {
+            continue;
+        }
+        if (n->op < TENSOR_EXPR_NEG && nodes[n->arg[1]].op != TENSOR_EXPR_CONST) {
+            continue;
+        }
+        double y = n->op < TENSOR_EXPR_NEG ? nodes[n->arg[1]].value : 0.0;
+        n->value = tensor_expr_apply(n->op, nodes[n->arg[0]].value, y);
+        n->op = TENSOR_EXPR_CONST;
+        n->arg[0] = n->arg[1] = -1;
+    }
+    
+    /* x * y + z, z + x * y and x * y - z become one instruction when
+     * nothing else needs the product */
+    tensor_expr_reach(nodes, root, uses, last);
+    for (int32_t i = 0; i < count; i++) {
+        TensorExprNode* n = &nodes[i];
+        if (uses[i] == 0 || (n->op != TENSOR_EXPR_ADD && n->op != TENSOR_EXPR_SUB)) {
+            continue;
+        }
+        for (int32_t k = 0; k < 2; k++) {
+            const TensorExprNode* product = &nodes[n->arg[k]];
+            if (product->op != TENSOR_EXPR_MUL || uses[n->arg[k]] != 1) {
+                continue;
+            }
+            if (n->op == TENSOR_EXPR_SUB && k == 1) {
+                continue;
+            }
+            int32_t other = n->arg[1 - k];
+            n->op = n->op == TENSOR_EXPR_ADD ? TENSOR_EXPR_FMA : TENSOR_EXPR_FMS;
+            n->arg[0] = product->arg[0];
+            n->arg[1] = product->arg[1];
+            n->arg[2] = other;
+            break;
+        }
+    }
+    tensor_expr_reach(nodes, root, uses, last);
+    
+    /* Leaves first: each gets a register of its own, which no instruction
+     * writes. A view (or a constant) used by two leaves gets one. */
+    int32_t busy[TENSOR_EXPR_MAX_REGS] = { 0 };
+    memset(p, 0, sizeof(*p));
+    p->result = tensor_expr_alloc(busy, &p->regs);
+    int failed = 0;
+    for (int32_t i = 0; i < count && !failed; i++) {
+        const TensorExprNode* n = &nodes[i];
+        if (uses[i] == 0) {
+            continue;
+        }
+        if (n->op == TENSOR_EXPR_INPUT) {
+            const Tensor* t = &e->inputs[n->arg[0]];
+            int32_t k = 0;
+            while (k < p->inputs && !tensor_expr_same_view(p->input[k], t)) {
+                k++;
+            }
+            if (k == p->inputs) {
+                if (k == TENSOR_EXPR_MAX_INPUTS || (p->input_reg[k] = tensor_expr_alloc(busy, &p->regs)) < 0) {
+                    failed = 1;
+                    break;
+                }
+                p->input[k] = t;
+                p->inputs++;
+            }
+            reg[i] = p->input_reg[k];
+        } else if (n->op == TENSOR_EXPR_CONST) {
+            int32_t c = 0;
+            while (c < p->constants && memcmp(&p->constant[c], &n->value, sizeof(double)) != 0) {
+                c++;
+            }
+            if (c == p->constants) {
+                if ((p->constant_reg[c] = tensor_expr_alloc(busy, &p->regs)) < 0) {
+                    failed = 1;
+                    break;
+                }
+                p->constant[c] = n->value;
+                p->constants++;
+            }
+            reg[i] = p->constant_reg[c];
+        }
+    }
+    
+    /* Then operations in node order. A temporary's register is freed at
+     * its last use, so the instruction there may write over an operand. */
+    for (int32_t i = 0; i < count && !failed; i++) {
+        const TensorExprNode* n = &nodes[i];
+        if (uses[i] == 0 || n->op == TENSOR_EXPR_INPUT || n->op == TENSOR_EXPR_CONST) {
+            continue;
+        }
+        if (p->length == TENSOR_EXPR_MAX_CODE) {
+            failed = 1;
+            break;
+        }
+        TensorExprInstr* in = &p->code[p->length++];
+        in->op = n->op;
+        for (int32_t k = 0; k < 3; k++) {
+            int32_t arg = n->arg[k];
+            in->src[k] = arg >= 0 ? reg[arg] : -1;
+            if (arg >= 0 && last[arg] == i && nodes[arg].op != TENSOR_EXPR_INPUT &&
+                nodes[arg].op != TENSOR_EXPR_CONST) {
+                busy[reg[arg]] = 0;
+            }
+        }
+        reg[i] = i == root ? p->result : tensor_expr_alloc(busy, &p->regs);
+        if (reg[i] < 0) {
+            failed = 1;
+            break;
+        }
+        in->dst = reg[i];
+    }
+    if (!failed && nodes[root].op >= TENSOR_EXPR_INPUT && nodes[root].op <= TENSOR_EXPR_CONST) {
+        TensorExprInstr* in = &p->code[p->length++];
+        in->op = TENSOR_EXPR_COPY;
+        in->dst = p->result;
+        in->src[0] = reg[root];
+        in->src[1] = in->src[2] = -1;
+    }
+    free(nodes);
+    free(scratch);
+    if (failed) {
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+/* Square roots of a whole number of vectors, with the instruction set's
+ * vector sqrt where there is one */
+typedef void (*TensorExprLanes)(double* d, const double* x, int64_t lanes);
+
+static void tensor_expr_sqrt_portable(double* d, const double* x, int64_t lanes) {
+    for (int64_t j = 0; j < lanes; j++) {
+        d[j] = sqrt(x[j]);
+    }
+}
+
+#ifdef TENSOR_HAVE_X86_KERNELS
+
+__attribute__((target("avx2,fma")))
+static void tensor_expr_sqrt_avx2(double* d, const double* x, int64_t lanes) {
+    for (int64_t j = 0; j < lanes; j += 4) {
+        _mm256_storeu_pd(d + j, _mm256_sqrt_pd(_mm256_loadu_pd(x + j)));
+    }
+}
+
+__attribute__((target("avx512f")))
+static void tensor_expr_sqrt_avx512(double* d, const double* x, int64_t lanes) {
+    for (int64_t j = 0; j < lanes; j += 8) {
+        _mm512_storeu_pd(d + j, _mm512_sqrt_pd(_mm512_loadu_pd(x + j)));
+    }
+}
+
+#endif
+
+/* Run p over one tile of `vectors` vectors; reg[r] points at register r */
+TENSOR_EXPR_BODY void tensor_expr_exec_body(const TensorExprProgram* p, double* const* reg, int64_t vectors,
+                                            TensorExprLanes vsqrt) {
+    for (int32_t i = 0; i < p->length; i++) {
+        const TensorExprInstr* in = &p->code[i];
+        int32_t sx = in->src[0];
+        int32_t sy = in->src[1] >= 0 ? in->src[1] : sx;
+        int32_t sz = in->src[2] >= 0 ? in->src[2] : sx;
+#ifdef TENSOR_EXPR_SIMD
+        TensorExprVec* d = (TensorExprVec*)reg[in->dst];
+        const TensorExprVec* x = (const TensorExprVec*)reg[sx];
+        const TensorExprVec* y = (const TensorExprVec*)reg[sy];
+        const TensorExprVec* z = (const TensorExprVec*)reg[sz];
+        int64_t n = vectors;
+#else
+        double* d = reg[in->dst];
+        const double* x = reg[sx];
+        const double* y = reg[sy];
+        const double* z = reg[sz];
+        int64_t n = vectors * TENSOR_EXPR_VECTOR;
+#endif
+        double* ds = reg[in->dst];
+        const double* xs = reg[sx];
+        int64_t lanes = vectors * TENSOR_EXPR_VECTOR;
+        switch (in->op) {
+        case TENSOR_EXPR_ADD:
+            for (int64_t v = 0; v < n; v++) {
+                d[v] = x[v] + y[v];
+            }
+            break;
+        case TENSOR_EXPR_SUB:
+            for (int64_t v = 0; v < n; v++) {
+                d[v] = x[v] - y[v];
+            }
+            break;
+        case TENSOR_EXPR_MUL:
+            for (int64_t v = 0; v < n; v++) {
+                d[v] = x[v] * y[v];
+            }
+            break;
+        case TENSOR_EXPR_DIV:
+            for (int64_t v = 0; v < n; v++) {
+                d[v] = x[v] / y[v];
+            }
+            break;
+        case TENSOR_EXPR_FMA:
+            for (int64_t v = 0; v < n; v++) {
+                d[v] = x[v] * y[v] + z[v];
+            }
+            break;
+        case TENSOR_EXPR_FMS:
+            for (int64_t v = 0; v < n; v++) {
+                d[v] = x[v] * y[v] - z[v];
+            }
+            break;
+        case TENSOR_EXPR_NEG:
+            for (int64_t v = 0; v < n; v++) {
+                d[v] = -x[v];
+            }
+            break;
+        case TENSOR_EXPR_COPY:
+            for (int64_t v = 0; v < n; v++) {
+                d[v] = x[v];
+            }
+            break;
+#ifdef TENSOR_EXPR_SIMD
+        /* Select through comparison masks: C has no ?: on vectors */
+        case TENSOR_EXPR_MIN:
+            for (int64_t v = 0; v < n; v++) {
+                TensorExprMask m = x[v] < y[v];
+                d[v] = (TensorExprVec)((m & (TensorExprMask)x[v]) | (~m & (TensorExprMask)y[v]));
+            }
+            break;
+        case TENSOR_EXPR_MAX:
+            for (int64_t v = 0; v < n; v++) {
+                TensorExprMask m = x[v] > y[v];
+                d[v] = (TensorExprVec)((m & (TensorExprMask)x[v]) | (~m & (TensorExprMask)y[v]));
+            }
+            break;
+        case TENSOR_EXPR_ABS:
+            for (int64_t v = 0; v < n; v++) {
+                d[v] = (TensorExprVec)((TensorExprMask)x[v] & INT64_MAX);
+            }
+            break;
+#else
+        case TENSOR_EXPR_MIN:
+            for (int64_t v = 0; v < n; v++) {
+                d[v] = x[v] < y[v] ? x[v] : y[v];
+            }
+            break;
+        case TENSOR_EXPR_MAX:
+            for (int64_t v = 0; v < n; v++) {
+                d[v] = x[v] > y[v] ? x[v] : y[v];
+            }
+            break;
+        case TENSOR_EXPR_ABS:
+            for (int64_t v = 0; v < n; v++) {
+                d[v] = fabs(x[v]);
+            }
+            break;
+#endif
+        case TENSOR_EXPR_SQRT:
+            vsqrt(ds, xs, lanes);
+            break;
+        /* Library calls, one element at a time */
+        case TENSOR_EXPR_EXP:
+            for (int64_t j = 0; j < lanes; j++) {
+                ds[j] = exp(xs[j]);
+            }
+            break;
+        case TENSOR_EXPR_LOG:
+            for (int64_t j = 0; j < lanes; j++) {
+                ds[j] = log(xs[j]);
+            }
+            break;
+        }
+    }
+}
+
+typedef void (*TensorExprKernel)(const TensorExprProgram* p, double* const* reg, int64_t vectors);
+
+static void tensor_expr_exec_portable(const TensorExprProgram* p, double* const* reg, int64_t vectors) {
+    tensor_expr_exec_body(p, reg, vectors, tensor_expr_sqrt_portable);
+}
+
+#ifdef TENSOR_HAVE_X86_KERNELS
+
+__attribute__((target("avx2,fma")))
+static void tensor_expr_exec_avx2(const TensorExprProgram* p, double* const* reg, int64_t vectors) {
+    tensor_expr_exec_body(p, reg, vectors, tensor_expr_sqrt_avx2);
+}
+
+__attribute__((target("avx512f")))
+static void tensor_expr_exec_avx512(const TensorExprProgram* p, double* const* reg, int64_t vectors) {
+    tensor_expr_exec_body(p, reg, vectors, tensor_expr_sqrt_avx512);
+}
+
+#endif
+
+/* Indexed by GEMM kernel id */
+static const TensorExprKernel tensor_expr_kernels[] = {
+    tensor_expr_exec_portable,
+#ifdef TENSOR_HAVE_X86_KERNELS
+    tensor_expr_exec_avx2,
+    tensor_expr_exec_avx512,
+#endif
+};
+
+typedef struct {
+    TensorLoop loop;                /* Operand 0 = out, k + 1 = input k */
+    const TensorExprProgram* program;
+    TensorExprKernel kernel;
+    double* tiles;                  /* regs tiles per worker */
+    int64_t block;
+} TensorExprJob;
+
+typedef struct {
+    const TensorExprProgram* program;
+    TensorExprKernel kernel;
+    double* tile[TENSOR_EXPR_MAX_REGS];     /* This worker's registers */
+} TensorExprState;
+
+static void tensor_expr_run(void* ctx, double* const* ptr, const int64_t* stride, int64_t n) {
+    TensorExprState* state = (TensorExprState*)ctx;
+    const TensorExprProgram* p = state->program;
+    double* reg[TENSOR_EXPR_MAX_REGS];
+    memcpy(reg, state->tile, sizeof(reg));
+    for (int64_t start = 0; start < n; start += TENSOR_EXPR_TILE) {
+        int64_t len = n - start < TENSOR_EXPR_TILE ? n - start : TENSOR_EXPR_TILE;
+        int64_t vectors = (len + TENSOR_EXPR_VECTOR - 1) / TENSOR_EXPR_VECTOR;
+        int whole = len % TENSOR_EXPR_VECTOR == 0;
+        
+        /* Whole vectors of a unit-stride input are read where they are;
+         * otherwise gather, padding the last vector */
+        for (int32_t k = 0; k < p->inputs; k++) {
+            int64_t s = stride[k + 1];
+            double* src = ptr[k + 1] + start * s;
+            int32_t r = p->input_reg[k];
+            if (whole && s == 1) {
+                reg[r] = src;
+                continue;
+            }
+            double* tile = state->tile[r];
+            for (int64_t i = 0; i < len; i++) {
+                tile[i] = src[i * s];
+            }
+            for (int64_t i = len; i < vectors * TENSOR_EXPR_VECTOR; i++) {
+                tile[i] = 0.0;
+            }
+            reg[r] = tile;
+        }
+        
+        double* out = ptr[0] + start * stride[0];
+        int direct = whole && stride[0] == 1;
+        reg[p->result] = direct ? out : state->tile[p->result];
+        state->kernel(p, reg, vectors);
+        if (!direct) {
+            const double* result = state->tile[p->result];
+            for (int64_t i = 0; i < len; i++) {
+                out[i * stride[0]] = result[i];
+            }
+        }
+    }
+}
+
+static void tensor_expr_task(void* ctx, int64_t task, int32_t worker) {
+    TensorExprJob* job = (TensorExprJob*)ctx;
+    const TensorExprProgram* p = job->program;
+    TensorExprState state;
+    state.program = p;
+    state.kernel = job->kernel;
+    double* tiles = job->tiles + (int64_t)worker * p->regs * TENSOR_EXPR_TILE;
+    for (int32_t r = 0; r < TENSOR_EXPR_MAX_REGS; r++) {
+        state.tile[r] = r < p->regs ? tiles + (int64_t)r * TENSOR_EXPR_TILE : NULL;
+    }
+    for (int32_t c = 0; c < p->constants; c++) {
+        double* tile = state.tile[p->constant_reg[c]];
+        for (int32_t i = 0; i < TENSOR_EXPR_TILE; i++) {
+            tile[i] = p->constant[c];
+        }
+    }
+    int64_t start = task * job->block;
+    int64_t end = job->loop.count - start < job->block ? job->loop.count : start + job->block;
+    tensor_loop_run(&job->loop, start, end, tensor_expr_run, &state);
+}
+
+/* Run p into out, every input broadcast to out's shape */
+static int32_t tensor_expr_execute(const TensorExprProgram* p, Tensor* out) {
+    TensorExprJob job;
+    double* base[TENSOR_LOOP_OPERANDS] = { out->data };
+    int64_t strides[TENSOR_LOOP_OPERANDS][TENSOR_MAX_DIMS];
+    memset(strides, 0, sizeof(strides));
+    memcpy(strides[0], out->strides, sizeof(strides[0]));
+    for (int32_t k = 0; k < p->inputs; k++) {
+        base[k + 1] = p->input[k]->data;
+        if (tensor_broadcast_strides(p->input[k], out->ndim, out->shape, strides[k + 1]) != 0) {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+    tensor_loop_init(&job.loop, out->ndim, out->shape, 1 + p->inputs, base, strides);
+    if (job.loop.count == 0) {
+        return 0;
+    }
+    
+    int64_t tasks;
+    int32_t width = tensor_split(job.loop.count, &job.block, &tasks);
+    job.program = p;
+    job.kernel = tensor_expr_kernels[tensor_gemm_kernel()->id];
+    job.tiles = tensor_aligned_alloc((size_t)width * (size_t)p->regs * TENSOR_EXPR_TILE);
+    if (job.tiles == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    tensor_parallel(width, tasks, tensor_expr_task, &job);
+    tensor_aligned_free(job.tiles);
+    return 0;
+}
+
+/**
+ * Computes node into out. Every input is broadcast to out's shape; out
+ * may be one of the inputs (the same view), which updates it in place,
+ * but must not otherwise overlap them. Large outputs are split across the
+ * tensor thread pool. With AVX2 or AVX-512, a * b + c is rounded once
+ * (fused multiply-add).
+ *
+ * @return 0, or -1 with errno EINVAL (bad node, an input that doesn't
+ *         broadcast, out a broadcast view, more than eight distinct input
+ *         tensors, or an expression too large to compile) or ENOMEM
+ */
+int32_t tensor_expr_eval(void* expr, int32_t node, Tensor* out) {
+    TensorExpr* e = (TensorExpr*)expr;
+    if (!tensor_expr_has_node(e, node) || !tensor_writable(out)) {
+        errno = EINVAL;
+        return -1;
+    }
+    TensorExprProgram p;
+    if (tensor_expr_compile(e, node, &p) != 0) {
+        return -1;
+    }
+    return tensor_expr_execute(&p, out);
+}
+
+/**
+ * Computes node into a new row-major tensor, shaped by broadcasting all
+ * the inputs it reads together (a single element if it reads none).
+ *
+ * @return The tensor, or an empty one (data == NULL) with errno as for
+ *         tensor_expr_eval()
+ */
+Tensor tensor_expr_eval_new(void* expr, int32_t node) {
+    TensorExpr* e = (TensorExpr*)expr;
+    if (!tensor_expr_has_node(e, node)) {
+        errno = EINVAL;
+        return tensor_empty();
+    }
+    TensorExprProgram p;
+    if (tensor_expr_compile(e, node, &p) != 0) {
+        return tensor_empty();
+    }
+    
+    /* Shapes line up at the last dimension; size 1 repeats */
+    int32_t ndim = 0;
+    int64_t shape[TENSOR_MAX_DIMS];
+    for (int32_t k = 0; k < p.inputs; k++) {
+        if (p.input[k]->ndim > ndim) {
+            ndim = p.input[k]->ndim;
+        }
+    }
+    for (int32_t d = 0; d < TENSOR_MAX_DIMS; d++) {
+        shape[d] = 1;
+    }
+    for (int32_t k = 0; k < p.inputs; k++) {
+        const Tensor* t = p.input[k];
+        for (int32_t d = 0; d < t->ndim; d++) {
+            int64_t* size = &shape[ndim - t->ndim + d];
+            if (t->shape[d] == 1 || t->shape[d] == *size) {
+                continue;
+            }
+            if (*size != 1) {
+                errno = EINVAL;
+                return tensor_empty();
+            }
+            *size = t->shape[d];
+        }
+    }
+    
+    Tensor out = tensor_new_uninit(ndim, shape);
+    if (out.data == NULL && tensor_count(ndim, shape) > 0) {
+        return out;
+    }
+    if (tensor_expr_execute(&p, &out) != 0) {
+        int error = errno;
+        tensor_drop(&out);
+        errno = error;
+        return tensor_empty();
+    }
+    return out;
+}
@@ -10,6 +10,9 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <limits.h>
+#include <errno.h>
+
+#include "../io/pathbuf.h"
 
 #ifdef _WIN32
 #include <windows.h>
@@ -20,26 +23,21 @@
 #else
 #include <unistd.h>
 #include <sys/stat.h>
+#include <pthread.h>
 #define PATH_SEP '/'
 #define PATH_SEP_STR "/"
 #define IS_PATH_SEP(c) ((c) == '/')
 #endif
 
-#define MAX_PATH_LEN 4096
-#define MAX_JSON_LEN 8192
-
-/* Helper: Check if character is path separator (cross-platform) */
-static bool is_sep(char c) {
-    return IS_PATH_SEP(c);
-}
 
-/* Helper: Skip trailing separators */
-static const char* skip_trailing_seps(const char* s) {
-    const char* end = s + strlen(s) - 1;
-    while (end > s && is_sep(*end)) {
-        end--;
+/* Helper: Copy a PathBuf into a caller buffer (NUL-terminated) */
+static int32_t copy_out(const PathBuf* buf, uint8_t* result, int64_t result_cap, int64_t* result_len) {
+    if (buf->len >= result_cap) {
+        return -1;
     }
-    return end + 1;
+    memcpy(result, buf->data, (size_t)buf->len + 1);
+    *result_len = buf->len;
+    return 0;
 }
 
 /* Check if path is absolute */
@@ -48,12 +46,7 @@ int32_t is_absolute_c(const uint8_t* path, int64_t path_len, int32_t* result) {
         return -1;
     }
     
-    char* path_str = (char*)malloc(path_len + 1);
-    if (!path_str) {
-        return -1;
-    }
-    memcpy(path_str, path, path_len);
-    path_str[path_len] = '\0';
+    const char* path_str = (const char*)path;
     
 #ifdef _WIN32
     // Windows: absolute if starts with drive letter (C:) or UNC (\\)
@@ -63,137 +56,215 @@ int32_t is_absolute_c(const uint8_t* path, int64_t path_len, int32_t* result) {
              (path_str[0] >= 'a' && path_str[0] <= 'z')) && 
             path_str[1] == ':') {
             *result = 1;
-            free(path_str);
             return 0;
         }
         // UNC: \\server\share
         if (path_str[0] == '\\' && path_str[1] == '\\') {
             *result = 1;
-            free(path_str);
             return 0;
         }
     }
 #else
     // POSIX: absolute if starts with /
-    if (path_len > 0 && path_str[0] == '/') {
+    if (path_str[0] == '/') {
         *result = 1;
-        free(path_str);
         return 0;
     }
 #endif
     
     *result = 0;
-    free(path_str);
     return 0;
 }
 
-/* Normalize path (resolve . and .., normalize separators) */
-static void normalize_path(char* path) {
-    if (!path || strlen(path) == 0) {
-        return;
-    }
-    
-    int len = strlen(path);
-    char* result = (char*)malloc(len + 1);
-    if (!result) {
-        return;
-    }
-    
-    int result_pos = 0;
-    bool is_abs = false;
-    
+/* Helper: Set buf to the current working directory */
+static int pathbuf_set_cwd(PathBuf* buf) {
+    for (;;) {
 #ifdef _WIN32
-    // Check for absolute path (drive or UNC)
-    if (len >= 2 && ((path[0] >= 'A' && path[0] <= 'Z') || (path[0] >= 'a' && path[0] <= 'z')) && path[1] == ':') {
-        result[result_pos++] = path[0];
-        result[result_pos++] = ':';
-        is_abs = true;
-        if (len > 2 && is_sep(path[2])) {
-            result[result_pos++] = PATH_SEP;
-        }
-    } else if (len >= 2 && path[0] == '\\' && path[1] == '\\') {
-        result[result_pos++] = '\\';
-        result[result_pos++] = '\\';
-        is_abs = true;
-    }
+        if (_getcwd(buf->data, (int)(buf->cap + 1)) != NULL) {
 #else
-    if (len > 0 && path[0] == '/') {
-        result[result_pos++] = '/';
-        is_abs = true;
-    }
+        if (getcwd(buf->data, (size_t)buf->cap + 1) != NULL) {
 #endif
-    
-    // Parse components
-    const char* start = path + (is_abs ? (len >= 2 && path[1] == ':' ? 2 : (path[0] == '/' ? 1 : 0)) : 0);
-    if (is_abs && len >= 2 && path[1] == ':') {
-        start = path + 2;
-    } else if (is_abs && path[0] == '/') {
-        start = path + 1;
-    }
-    
-    char components[256][256];
-    int comp_count = 0;
-    const char* comp_start = start;
-    
-    for (int i = 0; i <= len; i++) {
-        char c = (i < len) ? path[i] : '\0';
-        if (is_sep(c) || c == '\0') {
-            int comp_len = &path[i] - comp_start;
-            if (comp_len > 0) {
-                if (comp_len == 1 && comp_start[0] == '.') {
-                    // Skip .
-                } else if (comp_len == 2 && comp_start[0] == '.' && comp_start[1] == '.') {
-                    // Go up one level
-                    if (comp_count > 0) {
-                        comp_count--;
-                    }
-                } else {
-                    // Add component
-                    if (comp_len < 256) {
-                        memcpy(components[comp_count], comp_start, comp_len);
-                        components[comp_count][comp_len] = '\0';
-                        comp_count++;
-                    }
-                }
-            }
-            comp_start = &path[i + 1];
+            buf->len = (int64_t)strlen(buf->data);
+            return 1;
+        }
+        if (errno != ERANGE || !pathbuf_reserve(buf, buf->cap + 1)) {
+            return 0;
         }
     }
-    
-    // Rebuild path
-    result_pos = 0;
-    if (is_abs) {
+}
+
+/* Resolution cache */
+/* Quarry resolves the same workspace-relative paths over and over, so the
+ * results of resolve_path_c are memoized, keyed by (base, path) or, for a
+ * relative path without a base, by (working directory, path). They are
+ * lexical, so neither chdir() nor changed symlinks can make them stale.
+ * canonicalize_path_c depends on the file system and is never cached: every
+ * component is lstat()ed on each call, so a relinked directory is seen at
+ * once. path_canon_cache_clear() drops the memo (e.g. to bound memory). */
+
+typedef struct {
+    char* key;          /* Key bytes, NUL, value bytes, NUL (one allocation) */
+    int64_t key_len;
+    int64_t value_len;
+    uint64_t hash;
+} CanonEntry;
+
+typedef struct {
+    CanonEntry* entries;
+    int64_t capacity;   /* Power of two */
+    int64_t count;
+} CanonTable;
+
+/* A table past this many entries is cleared instead of grown */
+#define CANON_TABLE_MAX_ENTRIES 65536
+/* Symlinks followed per canonicalization before giving up (ELOOP) */
+#define CANON_MAX_LINKS 40
+
+static CanonTable canon_resolved = { NULL, 0, 0 };
+
 #ifdef _WIN32
-        if (len >= 2 && path[1] == ':') {
-            result[result_pos++] = path[0];
-            result[result_pos++] = ':';
-            result[result_pos++] = PATH_SEP;
-        } else if (len >= 2 && path[0] == '\\' && path[1] == '\\') {
-            result[result_pos++] = '\\';
-            result[result_pos++] = '\\';
-        } else {
-            result[result_pos++] = PATH_SEP;
-        }
+static SRWLOCK canon_lock = SRWLOCK_INIT;
+#define CANON_LOCK() AcquireSRWLockExclusive(&canon_lock)
+#define CANON_UNLOCK() ReleaseSRWLockExclusive(&canon_lock)
 #else
-        result[result_pos++] = '/';
+static pthread_mutex_t canon_lock = PTHREAD_MUTEX_INITIALIZER;
+#define CANON_LOCK() pthread_mutex_lock(&canon_lock)
+#define CANON_UNLOCK() pthread_mutex_unlock(&canon_lock)
 #endif
+
+/* FNV-1a */
+static uint64_t canon_hash(const char* s, int64_t len) {
+    uint64_t h = 1469598103934665603ULL;
+    for (int64_t i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+/* Find the slot for key (occupied by key, or the empty slot to insert into) */
+static CanonEntry* canon_slot(CanonTable* table, const char* key, int64_t len, uint64_t hash) {
+    int64_t mask = table->capacity - 1;
+    int64_t i = (int64_t)(hash & (uint64_t)mask);
+    for (;;) {
+        CanonEntry* e = &table->entries[i];
+        if (!e->key || (e->hash == hash && e->key_len == len && memcmp(e->key, key, (size_t)len) == 0)) {
+            return e;
+        }
+        i = (i + 1) & mask;
     }
+}
+
+static void canon_table_clear(CanonTable* table) {
+    for (int64_t i = 0; i < table->capacity; i++) {
+        free(table->entries[i].key);
+    }
+    free(table->entries);
+    table->entries = NULL;
+    table->capacity = 0;
+    table->count = 0;
+}
+
+static int canon_table_grow(CanonTable* table) {
+    int64_t new_capacity = table->capacity ? table->capacity * 2 : 256;
+    CanonEntry* old = table->entries;
+    int64_t old_capacity = table->capacity;
+    
+    CanonEntry* entries = calloc((size_t)new_capacity, sizeof(CanonEntry));
+    if (!entries) {
+        return 0;
+    }
+    table->entries = entries;
+    table->capacity = new_capacity;
     
-    for (int i = 0; i < comp_count; i++) {
-        if (i > 0) {
-            result[result_pos++] = PATH_SEP;
+    for (int64_t i = 0; i < old_capacity; i++) {
+        if (old[i].key) {
+            *canon_slot(table, old[i].key, old[i].key_len, old[i].hash) = old[i];
         }
-        int comp_len = strlen(components[i]);
-        memcpy(&result[result_pos], components[i], comp_len);
-        result_pos += comp_len;
     }
-    result[result_pos] = '\0';
+    free(old);
+    return 1;
+}
+
+/* Caller holds the lock */
+static const CanonEntry* canon_table_get(CanonTable* table, const char* key, int64_t len, uint64_t hash) {
+    if (table->count == 0) {
+        return NULL;
+    }
+    CanonEntry* e = canon_slot(table, key, len, hash);
+    return e->key ? e : NULL;
+}
+
+/* Caller holds the lock. Failure to insert only costs a later cache miss. */
+static void canon_table_put(CanonTable* table, const char* key, int64_t len, uint64_t hash,
+                            const char* value, int64_t value_len) {
+    if (table->count >= CANON_TABLE_MAX_ENTRIES) {
+        canon_table_clear(table);
+    }
+    /* Keep load factor under 70% */
+    if ((table->count + 1) * 10 > table->capacity * 7 && !canon_table_grow(table)) {
+        return;
+    }
+    CanonEntry* e = canon_slot(table, key, len, hash);
+    if (e->key) {
+        return;
+    }
+    e->key = malloc((size_t)len + (size_t)value_len + 2);
+    if (!e->key) {
+        return;
+    }
+    memcpy(e->key, key, (size_t)len);
+    e->key[len] = '\0';
+    memcpy(e->key + len + 1, value, (size_t)value_len);
+    e->key[len + 1 + value_len] = '\0';
+    e->key_len = len;
+    e->value_len = value_len;
+    e->hash = hash;
+    table->count++;
+}
+
+/* Forget the memoized resolve_path_c results */
+void path_canon_cache_clear() {
+    CANON_LOCK();
+    canon_table_clear(&canon_resolved);
+    CANON_UNLOCK();
+}
+
+/* Number of memoized resolve_path_c results */
+int64_t path_canon_cache_count() {
+    CANON_LOCK();
+    int64_t count = canon_resolved.count;
+    CANON_UNLOCK();
+    return count;
+}
+
+/* Helper: Resolve path against base (or CWD) and normalize, into buf */
+static int resolve_into(PathBuf* buf, const uint8_t* path, int64_t path_len,
+                        const uint8_t* base, int64_t base_len) {
+    int32_t is_abs = 0;
+    is_absolute_c(path, path_len, &is_abs);
+    
+    int ok;
+    if (is_abs) {
+        // Path is absolute, just normalize it
+        ok = pathbuf_set(buf, (const char*)path, path_len);
+    } else if (base && base_len > 0) {
+        // Path is relative, resolve against base
+        ok = pathbuf_set(buf, (const char*)base, base_len) &&
+             pathbuf_push(buf, (const char*)path, path_len);
+    } else {
+        // Resolve against current working directory
+        ok = pathbuf_set_cwd(buf) && pathbuf_push(buf, (const char*)path, path_len);
+    }
     
-    memcpy(path, result, result_pos + 1);
-    free(result);
+    if (ok) {
+        pathbuf_normalize(buf);
+    }
+    return ok;
 }
 
-/* Resolve path to absolute */
+/* Resolve path to absolute (memoized; the result is lexical, symlinks are
+ * not followed) */
 int32_t resolve_path_c(const uint8_t* path, int64_t path_len,
                        const uint8_t* base, int64_t base_len,
                        uint8_t* result, int64_t result_cap, int64_t* result_len) {
@@ -201,87 +272,213 @@ int32_t resolve_path_c(const uint8_t* path, int64_t path_len,
         return -1;
     }
     
-    char* path_str = (char*)malloc(path_len + 1);
-    if (!path_str) {
-        return -1;
-    }
-    memcpy(path_str, path, path_len);
-    path_str[path_len] = '\0';
+    // Key: base, NUL, path. The base is empty for absolute paths and the
+    // working directory for relative ones without base. The directory is
+    // read with getcwd() on every such call rather than cached: checking a
+    // cached copy (stat(".") against its st_dev/st_ino) is a system call
+    // too, and the runtime cannot see chdir() to bump a generation instead.
+    int32_t is_abs = 0;
+    is_absolute_c(path, path_len, &is_abs);
     
-    char* base_str = NULL;
-    if (base && base_len > 0) {
-        base_str = (char*)malloc(base_len + 1);
-        if (!base_str) {
-            free(path_str);
-            return -1;
+    PathBuf key;
+    PathBuf resolved;
+    pathbuf_init(&key);
+    pathbuf_init(&resolved);
+    
+    int32_t status = -1;
+    int ok;
+    if (is_abs) {
+        ok = 1;
+    } else if (base && base_len > 0) {
+        ok = pathbuf_set(&key, (const char*)base, base_len);
+    } else {
+        ok = pathbuf_set_cwd(&key);
+    }
+    if (!ok || !pathbuf_reserve(&key, 1 + path_len)) {
+        goto done;
+    }
+    int64_t key_base_len = key.len;
+    key.data[key_base_len] = '\0';
+    memcpy(key.data + key_base_len + 1, path, (size_t)path_len);
+    key.len = key_base_len + 1 + path_len;
+    uint64_t hash = canon_hash(key.data, key.len);
+    
+    CANON_LOCK();
+    const CanonEntry* hit = canon_table_get(&canon_resolved, key.data, key.len, hash);
+    if (hit) {
+        if (hit->value_len < result_cap) {
+            memcpy(result, hit->key + hit->key_len + 1, (size_t)hit->value_len + 1);
+            *result_len = hit->value_len;
+            status = 0;
         }
-        memcpy(base_str, base, base_len);
-        base_str[base_len] = '\0';
+        CANON_UNLOCK();
+        goto done;
     }
-    
-    char resolved[MAX_PATH_LEN];
-    
-    // Check if path is absolute
-    int32_t is_abs = 0;
-    is_absolute_c(path, path_len, &is_abs);
+    CANON_UNLOCK();
     
     if (is_abs) {
-        // Path is absolute, just normalize it
-        strncpy(resolved, path_str, MAX_PATH_LEN - 1);
-        resolved[MAX_PATH_LEN - 1] = '\0';
-        normalize_path(resolved);
+        ok = pathbuf_set(&resolved, (const char*)path, path_len);
     } else {
-        // Path is relative, resolve against base or CWD
-        if (base_str) {
-            // Resolve against base
-            strncpy(resolved, base_str, MAX_PATH_LEN - 1);
-            resolved[MAX_PATH_LEN - 1] = '\0';
-            normalize_path(resolved);
-            
-            // Append path
-            int resolved_len = strlen(resolved);
-            if (resolved_len > 0 && !is_sep(resolved[resolved_len - 1])) {
-                resolved[resolved_len++] = PATH_SEP;
-            }
-            strncat(resolved, path_str, MAX_PATH_LEN - resolved_len - 1);
+        ok = pathbuf_set(&resolved, key.data, key_base_len) &&
+             pathbuf_push(&resolved, (const char*)path, path_len);
+    }
+    if (ok) {
+        pathbuf_normalize(&resolved);
+        CANON_LOCK();
+        canon_table_put(&canon_resolved, key.data, key.len, hash, resolved.data, resolved.len);
+        CANON_UNLOCK();
+        status = copy_out(&resolved, result, result_cap, result_len);
+    }
+    
+done:
+    pathbuf_free(&key);
+    pathbuf_free(&resolved);
+    return status;
+}
+
+#ifndef _WIN32
+static int canon_walk(PathBuf* real, const char* path, int64_t len, int* links);
+
+/* Helper: Append one component to the real path in buf, following it if it
+ * is a symlink. Missing components are kept as they are (like Python's
+ * non-strict resolve). */
+static int canon_step(PathBuf* real, const char* name, int64_t len, int* links) {
+    if (!pathbuf_push(real, name, len)) {
+        return 0;
+    }
+    
+    struct stat st;
+    if (lstat(real->data, &st) != 0 || !S_ISLNK(st.st_mode)) {
+        return 1;
+    }
+    if (++*links > CANON_MAX_LINKS) {
+        errno = ELOOP;
+        return 0;
+    }
+    
+    // Read the target, then walk it from the link's parent
+    PathBuf link_path;
+    PathBuf target;
+    pathbuf_init(&link_path);
+    pathbuf_init(&target);
+    int ok = pathbuf_set(&link_path, real->data, real->len);
+    while (ok) {
+        ssize_t n = readlink(link_path.data, target.data, (size_t)target.cap + 1);
+        if (n < 0) {
+            ok = 0;
+        } else if (n <= target.cap) {
+            target.len = n;
+            target.data[n] = '\0';
+            break;
         } else {
-            // Resolve against current working directory
-#ifdef _WIN32
-            if (_getcwd(resolved, MAX_PATH_LEN) == NULL) {
-                free(path_str);
-                if (base_str) free(base_str);
-                return -1;
-            }
-#else
-            if (getcwd(resolved, MAX_PATH_LEN) == NULL) {
-                free(path_str);
-                if (base_str) free(base_str);
-                return -1;
-            }
-#endif
-            int resolved_len = strlen(resolved);
-            if (resolved_len > 0 && !is_sep(resolved[resolved_len - 1])) {
-                resolved[resolved_len++] = PATH_SEP;
-            }
-            strncat(resolved, path_str, MAX_PATH_LEN - resolved_len - 1);
+            ok = pathbuf_reserve(&target, target.cap + 1);
         }
-        normalize_path(resolved);
+    }
+    if (ok) {
+        pathbuf_pop(real);
+        ok = canon_walk(real, target.data, target.len, links);
     }
     
-    // Copy to result
-    int resolved_len = strlen(resolved);
-    if (resolved_len >= result_cap) {
-        free(path_str);
-        if (base_str) free(base_str);
+    pathbuf_free(&link_path);
+    pathbuf_free(&target);
+    return ok;
+}
+
+/* Helper: Walk path onto the real path in buf ("/" at least) */
+static int canon_walk(PathBuf* real, const char* path, int64_t len, int* links) {
+    PathComponents it;
+    PathComponent comp;
+    path_components_init(&it, path, len);
+    while (path_components_next(&it, &comp)) {
+        switch (comp.kind) {
+            case PATH_COMPONENT_ROOT:
+                if (!pathbuf_set(real, "/", 1)) {
+                    return 0;
+                }
+                break;
+            case PATH_COMPONENT_PARENT_DIR:
+                pathbuf_pop(real);
+                break;
+            case PATH_COMPONENT_NORMAL:
+                if (!canon_step(real, comp.ptr, comp.len, links)) {
+                    return 0;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    return 1;
+}
+#endif
+
+/* Resolve path to its canonical absolute form, following symlinks (the
+ * equivalent of realpath(), but components that do not exist are kept, like
+ * Python's Path.resolve()). Not cached: every component is lstat()ed, so
+ * symlinks changed since the last call are followed to their new targets.
+ * On Windows this is the lexical resolve_path_c.
+ *
+ * A per-prefix cache of real paths was tried and dropped. A cached prefix
+ * is only valid while none of its components has been relinked, and the
+ * sole way to know that is to lstat() each of them again, which is the
+ * walk this function does anyway. Comparing st_dev/st_ino of the prefix
+ * and of its cached real path is cheaper but misses a directory that was
+ * moved and replaced by a link to its new place. Callers that resolve the
+ * same paths repeatedly can keep the results while they know the tree is
+ * unchanged. */
+int32_t canonicalize_path_c(const uint8_t* path, int64_t path_len,
+                            const uint8_t* base, int64_t base_len,
+                            uint8_t* result, int64_t result_cap, int64_t* result_len) {
+#ifdef _WIN32
+    return resolve_path_c(path, path_len, base, base_len, result, result_cap, result_len);
+#else
+    if (!path || !result || result_cap < 2 || !result_len) {
         return -1;
     }
-    memcpy(result, resolved, resolved_len);
-    result[resolved_len] = '\0';
-    *result_len = resolved_len;
     
-    free(path_str);
-    if (base_str) free(base_str);
-    return 0;
+    int32_t path_abs = 0;
+    int32_t base_abs = 0;
+    is_absolute_c(path, path_len, &path_abs);
+    if (!base || base_len <= 0) {
+        base_len = 0;
+    } else {
+        is_absolute_c(base, base_len, &base_abs);
+    }
+    
+    PathBuf real;
+    pathbuf_init(&real);
+    
+    // getcwd() already returns a real path
+    int links = 0;
+    int ok;
+    if (path_abs || base_abs) {
+        ok = pathbuf_set(&real, "/", 1);
+    } else {
+        ok = pathbuf_set_cwd(&real);
+    }
+    if (ok && !path_abs && base_len > 0) {
+        ok = canon_walk(&real, (const char*)base, base_len, &links);
+    }
+    if (ok) {
+        ok = canon_walk(&real, (const char*)path, path_len, &links);
+    }
+    
+    int32_t status = ok ? copy_out(&real, result, result_cap, result_len) : -1;
+    pathbuf_free(&real);
+    return status;
+#endif
+}
+
+/* Helper: Undo JSON string escaping (\\, \", \/) in place; returns new length */
+static int64_t json_unescape(char* s, int64_t len) {
+    int64_t w = 0;
+    for (int64_t r = 0; r < len; r++) {
+        if (s[r] == '\\' && r + 1 < len) {
+            r++;
+        }
+        s[w++] = s[r];
+    }
+    return w;
 }
 
 /* Join path components */
@@ -291,83 +488,95 @@ int32_t join_paths_c(const uint8_t* parts_json, int64_t json_len,
         return -1;
     }
     
-    // Simple JSON array parsing for path strings
-    char* json_str = (char*)malloc(json_len + 1);
-    if (!json_str) {
-        return -1;
-    }
-    memcpy(json_str, parts_json, json_len);
-    json_str[json_len] = '\0';
+    // Simple JSON array parsing for path strings, pushed straight into one buffer
+    PathBuf joined;
+    pathbuf_init(&joined);
     
-    char parts[64][MAX_PATH_LEN];
+    const char* pos = (const char*)parts_json;
+    const char* end = pos + json_len;
     int part_count = 0;
-    const char* pos = json_str;
+    int ok = 1;
     
     // Skip opening bracket
-    while (*pos && (*pos == '[' || *pos == ' ' || *pos == '\t' || *pos == '\n')) pos++;
+    while (pos < end && (*pos == '[' || *pos == ' ' || *pos == '\t' || *pos == '\n')) {
+        pos++;
+    }
     
     // Parse quoted strings
-    while (*pos && *pos != ']' && part_count < 64) {
-        while (*pos && (*pos == ' ' || *pos == '\t' || *pos == ',' || *pos == '\n')) pos++;
-        if (*pos == ']') break;
+    while (ok && pos < end && *pos != ']') {
+        while (pos < end && (*pos == ' ' || *pos == '\t' || *pos == ',' || *pos == '\n')) {
+            pos++;
+        }
+        if (pos >= end || *pos == ']') {
+            break;
+        }
         
         if (*pos == '"') {
             pos++; // Skip opening quote
             const char* str_start = pos;
-            while (*pos && *pos != '"') pos++;
-            if (*pos == '"') {
-                int str_len = pos - str_start;
-                if (str_len < MAX_PATH_LEN) {
-                    memcpy(parts[part_count], str_start, str_len);
-                    parts[part_count][str_len] = '\0';
-                    part_count++;
+            while (pos < end && *pos != '"') {
+                if (*pos == '\\' && pos + 1 < end) {
+                    pos++;
                 }
-                pos++; // Skip closing quote
+                pos++;
             }
+            if (pos >= end) {
+                break;
+            }
+            int64_t str_len = pos - str_start;
+            pos++; // Skip closing quote
+            
+            // An absolute part replaces everything before it
+            int32_t is_abs = 0;
+            is_absolute_c((const uint8_t*)str_start, str_len, &is_abs);
+            if (is_abs || part_count == 0) {
+                ok = pathbuf_set(&joined, str_start, str_len);
+            } else {
+                ok = pathbuf_push(&joined, str_start, str_len);
+            }
+            if (ok) {
+                // The raw part is now the tail of the buffer
+                int64_t part_start = joined.len - str_len;
+                joined.len = part_start + json_unescape(joined.data + part_start, str_len);
+                joined.data[joined.len] = '\0';
+            }
+            part_count++;
         } else {
             pos++;
         }
     }
     
-    if (part_count == 0) {
-        result[0] = '\0';
-        *result_len = 0;
-        free(json_str);
-        return 0;
+    int32_t status = ok ? copy_out(&joined, result, result_cap, result_len) : -1;
+    pathbuf_free(&joined);
+    return status;
+}
+
+/* Helper: Compare two components (case-insensitive on Windows) */
+static bool component_eq(const PathComponent* a, const PathComponent* b) {
+    if (a->len != b->len || a->kind != b->kind) {
+        return false;
     }
-    
-    // Join parts
-    char joined[MAX_PATH_LEN] = {0};
-    strncpy(joined, parts[0], MAX_PATH_LEN - 1);
-    
-    for (int i = 1; i < part_count; i++) {
-        // Check if part is absolute (overrides previous)
-        int32_t is_abs = 0;
-        is_absolute_c((uint8_t*)parts[i], strlen(parts[i]), &is_abs);
-        
-        if (is_abs) {
-            strncpy(joined, parts[i], MAX_PATH_LEN - 1);
-        } else {
-            int joined_len = strlen(joined);
-            if (joined_len > 0 && !is_sep(joined[joined_len - 1])) {
-                joined[joined_len++] = PATH_SEP;
-            }
-            strncat(joined, parts[i], MAX_PATH_LEN - joined_len - 1);
+#ifdef _WIN32
+    for (int64_t i = 0; i < a->len; i++) {
+        char ca = a->ptr[i];
+        char cb = b->ptr[i];
+        if (ca >= 'A' && ca <= 'Z') {
+            ca = ca - 'A' + 'a';
+        }
+        if (cb >= 'A' && cb <= 'Z') {
+            cb = cb - 'A' + 'a';
+        }
+        if (IS_PATH_SEP(ca) && IS_PATH_SEP(cb)) {
+            continue;
+        }
+        if (ca != cb) {
+            return false;
         }
     }
-    
-    // Copy to result
-    int joined_len = strlen(joined);
-    if (joined_len >= result_cap) {
-        free(json_str);
-        return -1;
-    }
-    memcpy(result, joined, joined_len);
-    result[joined_len] = '\0';
-    *result_len = joined_len;
-    
-    free(json_str);
-    return 0;
+    return true;
+#else
+    return memcmp(a->ptr, b->ptr, (size_t)a->len) == 0;
+#endif
 }
 
 /* Get relative path from base to path */
@@ -379,113 +588,66 @@ int32_t relative_path_c(const uint8_t* path, int64_t path_len,
     }
     
     // Resolve both paths to absolute
-    char path_abs[MAX_PATH_LEN];
-    char base_abs[MAX_PATH_LEN];
-    int64_t path_abs_len = 0;
-    int64_t base_abs_len = 0;
-    
-    if (resolve_path_c(path, path_len, NULL, 0, (uint8_t*)path_abs, MAX_PATH_LEN, &path_abs_len) != 0) {
-        return -1;
-    }
-    if (resolve_path_c(base, base_len, NULL, 0, (uint8_t*)base_abs, MAX_PATH_LEN, &base_abs_len) != 0) {
-        return -1;
-    }
-    
-    // Normalize paths (lowercase on Windows for comparison)
-#ifdef _WIN32
-    for (int i = 0; i < path_abs_len; i++) {
-        if (path_abs[i] >= 'A' && path_abs[i] <= 'Z') {
-            path_abs[i] = path_abs[i] - 'A' + 'a';
-        }
-    }
-    for (int i = 0; i < base_abs_len; i++) {
-        if (base_abs[i] >= 'A' && base_abs[i] <= 'Z') {
-            base_abs[i] = base_abs[i] - 'A' + 'a';
-        }
-    }
-#endif
+    PathBuf path_abs;
+    PathBuf base_abs;
+    PathBuf relative;
+    pathbuf_init(&path_abs);
+    pathbuf_init(&base_abs);
+    pathbuf_init(&relative);
+    
+    int32_t status = -1;
+    if (!resolve_into(&path_abs, path, path_len, NULL, 0) ||
+        !resolve_into(&base_abs, base, base_len, NULL, 0)) {
+        goto done;
+    }
+    
+    // Walk both component lists past the common prefix
+    PathComponents path_it;
+    PathComponents base_it;
+    PathComponent path_comp;
+    PathComponent base_comp;
+    path_components_init(&path_it, path_abs.data, path_abs.len);
+    path_components_init(&base_it, base_abs.data, base_abs.len);
+    
+    int has_path = path_components_next(&path_it, &path_comp);
+    int has_base = path_components_next(&base_it, &base_comp);
     
-    // Check if paths are on same root (Windows: same drive, POSIX: always same)
 #ifdef _WIN32
-    if (path_abs_len >= 2 && base_abs_len >= 2) {
-        if (path_abs[0] != base_abs[0] || path_abs[1] != ':' || base_abs[1] != ':') {
-            // Different drives or not drive paths
-            if (path_abs[0] != '\\' || base_abs[0] != '\\') {
-                // Return null (no relative path)
-                memcpy(result, "null", 4);
-                *result_len = 4;
-                return 0;
-            }
-        }
+    // Different drives (or drive vs UNC): no relative path
+    if (has_path && has_base && !component_eq(&path_comp, &base_comp)) {
+        memcpy(result, "null", 5);
+        *result_len = 4;
+        status = 0;
+        goto done;
     }
 #endif
     
-    // Find common prefix
-    int common_len = 0;
-    int min_len = (path_abs_len < base_abs_len) ? path_abs_len : base_abs_len;
-    
-    for (int i = 0; i < min_len; i++) {
-        if (path_abs[i] == base_abs[i]) {
-            if (is_sep(path_abs[i])) {
-                common_len = i + 1;
-            }
-        } else {
-            break;
-        }
-    }
-    
-    // Build relative path
-    char relative[MAX_PATH_LEN] = {0};
-    int rel_pos = 0;
-    
-    // Count .. needed for base
-    const char* base_remainder = base_abs + common_len;
-    int dotdot_count = 0;
-    const char* p = base_remainder;
-    while (*p) {
-        if (is_sep(*p)) {
-            dotdot_count++;
-        }
-        p++;
-    }
-    if (strlen(base_remainder) > 0 && !is_sep(base_remainder[strlen(base_remainder) - 1])) {
-        dotdot_count++;
+    while (has_path && has_base && component_eq(&path_comp, &base_comp)) {
+        has_path = path_components_next(&path_it, &path_comp);
+        has_base = path_components_next(&base_it, &base_comp);
     }
     
-    // Add .. components
-    for (int i = 0; i < dotdot_count && rel_pos < MAX_PATH_LEN - 4; i++) {
-        if (i > 0) {
-            relative[rel_pos++] = PATH_SEP;
-        }
-        relative[rel_pos++] = '.';
-        relative[rel_pos++] = '.';
+    // One .. per remaining base component, then the rest of path
+    int ok = 1;
+    while (ok && has_base) {
+        ok = pathbuf_push(&relative, "..", 2);
+        has_base = path_components_next(&base_it, &base_comp);
     }
-    
-    // Add path remainder
-    const char* path_remainder = path_abs + common_len;
-    if (strlen(path_remainder) > 0) {
-        if (rel_pos > 0 && !is_sep(relative[rel_pos - 1])) {
-            relative[rel_pos++] = PATH_SEP;
-        }
-        int remainder_len = strlen(path_remainder);
-        if (rel_pos + remainder_len < MAX_PATH_LEN) {
-            memcpy(&relative[rel_pos], path_remainder, remainder_len);
-            rel_pos += remainder_len;
-        }
+    while (ok && has_path) {
+        ok = pathbuf_push(&relative, path_comp.ptr, path_comp.len);
+        has_path = path_components_next(&path_it, &path_comp);
     }
-    
-    if (rel_pos == 0) {
-        relative[rel_pos++] = '.';
+    if (ok && relative.len == 0) {
+        ok = pathbuf_set(&relative, ".", 1);
     }
-    relative[rel_pos] = '\0';
     
-    // Copy to result
-    if (rel_pos >= result_cap) {
-        return -1;
+    if (ok) {
+        status = copy_out(&relative, result, result_cap, result_len);
     }
-    memcpy(result, relative, rel_pos);
-    result[rel_pos] = '\0';
-    *result_len = rel_pos;
     
-    return 0;
+done:
+    pathbuf_free(&path_abs);
+    pathbuf_free(&base_abs);
+    pathbuf_free(&relative);
+    return status;
 }
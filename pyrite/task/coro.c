@@ -0,0 +1,1159 @@
+/* Stackful coroutines in C for Pyrite standard library
+ *
+ * A coroutine is an ordinary function running on its own stack. It can
+ * suspend anywhere - deep inside a call chain, in the middle of a blocking
+ * socket call - and resume later exactly there, so concurrent code stays
+ * straight-line: no callbacks, no state machines, no function colouring
+ * below the await point.
+ *
+ * - Stacks: each coroutine gets a private mapping (256 KiB by default) with
+ *   a guard page at the bottom. The mapping is reserved, not committed:
+ *   pages become real memory only when touched, so a typical coroutine costs
+ *   a few KiB of RAM however large its reserve, and an overflow faults on
+ *   the guard page instead of corrupting a neighbour. Stacks of finished
+ *   coroutines are pooled for reuse.
+ * - Switching: on x86-64 (System V) a hand-written switch saves only the
+ *   callee-saved registers plus the SSE/x87 control words - a few
+ *   nanoseconds, no syscalls, no signal mask. Other POSIX targets fall back
+ *   to ucontext, Windows to fibers.
+ * - Scheduling: one scheduler per thread runs ready coroutines in FIFO
+ *   order and, when none is ready, waits on a reactor (net/reactor.c) for
+ *   sockets and timers. coro_wait_fd() parks the caller until an fd is
+ *   ready; coro_sleep(), coro_yield() and coro_join() do what they say.
+ * - Blocking I/O: while a coroutine runs, the scheduler installs a wait hook
+ *   in socket.c (tcp_set_wait_hook). tcp_connect, tcp_accept, tcp_send,
+ *   tcp_recv, the vectored and 64-bit transfers then park the coroutine
+ *   instead of the thread, so plain blocking-style code serves thousands of
+ *   connections on one thread. Disk I/O (file.c) still blocks.
+ *
+ * Two ways to run: coro_scheduler_new() + coro_spawn() + coro_scheduler_run()
+ * from ordinary code, or coro_main_enter() / coro_main_exit() around a
+ * thread's own code (what Forge emits for `async fn main`), which turns the
+ * calling stack itself into the first coroutine.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#endif
+
+#if defined(__x86_64__) && !defined(_WIN32)
+#define CORO_ASM_X86_64 1
+#elif defined(_WIN32)
+#define CORO_FIBERS 1
+#else
+#define CORO_UCONTEXT 1
+#include <ucontext.h>
+#endif
+
+/* AddressSanitizer must be told about stack switches */
+#if defined(__SANITIZE_ADDRESS__)
+#define CORO_ASAN 1
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define CORO_ASAN 1
+#endif
+#endif
+#ifdef CORO_ASAN
+#include <sanitizer/common_interface_defs.h>
+#endif
+
+#ifdef _MSC_VER
+#define CORO_THREAD_LOCAL __declspec(thread)
+#else
+#define CORO_THREAD_LOCAL __thread
+#endif
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+#ifndef MAP_STACK
+#define MAP_STACK 0
+#endif
+
+#define CORO_DEFAULT_STACK (256 * 1024)
+#define CORO_MIN_STACK (16 * 1024)
+#define CORO_STACK_POOL 256         /* Finished coroutines' stacks kept for reuse */
+#define CORO_MAX_FD (1 << 24)
+
+/* Wait flags (same values as REACTOR_*; match coro.pyrite) */
+#define CORO_READ 1
+#define CORO_WRITE 2
+#define CORO_HUP 4
+#define CORO_ERROR 8
+#define REACTOR_TIMER 16
+
+/* Reactor tokens: fds as themselves, timers tagged with the coroutine slot */
+#define CORO_TOKEN_TIMER ((int64_t)1 << 62)
+
+enum {
+    CORO_FREE,
+    CORO_READY,             /* In the run queue */
+    CORO_RUNNING,
+    CORO_WAITING,           /* Parked on an fd, a timer or another coroutine */
+    CORO_DONE
+};
+
+extern void* reactor_new();
+extern int32_t reactor_register(void* reactor, int64_t fd, int32_t interest, int64_t token);
+extern int32_t reactor_modify(void* reactor, int64_t fd, int32_t interest, int64_t token);
+extern int32_t reactor_unregister(void* reactor, int64_t fd);
+extern int64_t reactor_timer_add(void* reactor, int64_t after_ms, int64_t interval_ms, int64_t token);
+extern int32_t reactor_timer_cancel(void* reactor, int64_t timer_id);
+extern int32_t reactor_poll(void* reactor, int32_t timeout_ms);
+extern int64_t reactor_event_token(void* reactor, int32_t index);
+extern int32_t reactor_event_flags(void* reactor, int32_t index);
+extern void reactor_free(void* reactor);
+extern void tcp_set_wait_hook(int32_t (*hook)(int64_t sock, int32_t events, int32_t timeout_ms));
+
+typedef struct {
+#if defined(CORO_ASM_X86_64)
+    void* sp;
+#elif defined(CORO_UCONTEXT)
+    ucontext_t uc;
+#else
+    LPVOID fiber;
+#endif
+    void (*boot)(void*);    /* Runs on first entry */
+    void* boot_arg;
+} CoroContext;
+
+typedef struct Coro Coro;
+typedef struct CoroScheduler CoroScheduler;
+
+struct Coro {
+    CoroContext ctx;
+    char* stack;            /* Mapping with the guard page; NULL for the main coroutine and fibers */
+    void (*entry)(void*);
+    void* arg;
+    CoroScheduler* sched;
+    uint32_t generation;    /* Bumped on release so stale ids are rejected */
+    int32_t slot;
+    int32_t state;
+    int32_t io_wait;        /* Parked on an fd or timer (counted in io_waiting) */
+    int32_t wake_flags;     /* What ended the last wait: CORO_* flags, 0 on timeout, -1 deadlock */
+    int64_t timer_id;
+    Coro* joiners;          /* Coroutines in coro_join() on this one */
+    Coro* next_joiner;
+#ifdef CORO_ASAN
+    void* fake_stack;
+    const void* asan_bottom;
+    size_t asan_size;
+#endif
+};
+
+typedef struct {
+    Coro* reader;
+    Coro* writer;
+    int32_t registered;     /* Known to the reactor */
+} CoroFdWaiters;
+
+struct CoroScheduler {
+    void* reactor;
+    CoroContext sched_ctx;  /* Where parked coroutines return to */
+    Coro** coros;
+    int32_t coro_count;
+    int32_t coro_cap;
+    int32_t* free_slots;
+    int32_t free_count;
+    Coro** run_queue;       /* Ring */
+    int32_t run_head;
+    int32_t run_len;
+    int32_t run_cap;
+    CoroFdWaiters* fds;     /* Indexed by fd */
+    int64_t fd_cap;
+    int32_t live;           /* Spawned coroutines not finished yet */
+    int32_t io_waiting;
+    size_t stack_size;      /* Mapping size, guard page included */
+    size_t page_size;
+    char** stack_pool;
+    int32_t pool_count;
+    int32_t running;
+    Coro* current;
+    Coro* main;             /* coro_main_enter(): the thread's own stack */
+    char* loop_stack;       /* coro_main_enter(): the scheduler loop's stack */
+    int32_t loop_result;
+    int32_t loop_errno;
+#ifdef CORO_ASAN
+    void* sched_fake_stack;
+    const void* sched_bottom;
+    size_t sched_size;
+#endif
+};
+
+/* Scheduler running on this thread (coro_scheduler_run or main mode) */
+static CORO_THREAD_LOCAL CoroScheduler* coro_tls;
+
+void coro_scheduler_free(void* handle);
+
+/* ---- Context switching ---- */
+
+#if defined(CORO_ASM_X86_64)
+
+#if defined(__APPLE__)
+#define CORO_SYM(name) "_" #name
+#else
+#define CORO_SYM(name) #name
+#endif
+
+/* pyrite_coro_switch(save_sp, new_sp): push the callee-saved registers and
+ * the MXCSR / x87 control words, store rsp in *save_sp, load new_sp and pop
+ * the same frame from there. A fresh context is a hand-built frame whose
+ * return address is the trampoline, which calls r13(r12). */
+void pyrite_coro_switch(void** save_sp, void* new_sp);
+void pyrite_coro_trampoline(void);
+
+__asm__(
+    ".text\n"
+    ".p2align 4\n"
+    ".globl " CORO_SYM(pyrite_coro_switch) "\n"
+#if defined(__ELF__)
+    ".hidden " CORO_SYM(pyrite_coro_switch) "\n"
+    ".type " CORO_SYM(pyrite_coro_switch) ", @function\n"
+#endif
+    CORO_SYM(pyrite_coro_switch) ":\n"
+    "    pushq %rbp\n"
+    "    pushq %rbx\n"
+    "    pushq %r12\n"
+    "    pushq %r13\n"
+    "    pushq %r14\n"
+    "    pushq %r15\n"
+    "    subq $8, %rsp\n"
+    "    stmxcsr (%rsp)\n"
+    "    fnstcw 4(%rsp)\n"
+    "    movq %rsp, (%rdi)\n"
+    "    movq %rsi, %rsp\n"
+    "    ldmxcsr (%rsp)\n"
+    "    fldcw 4(%rsp)\n"
+    "    addq $8, %rsp\n"
+    "    popq %r15\n"
+    "    popq %r14\n"
+    "    popq %r13\n"
+    "    popq %r12\n"
+    "    popq %rbx\n"
+    "    popq %rbp\n"
+    "    ret\n"
+#if defined(__ELF__)
+    ".size " CORO_SYM(pyrite_coro_switch) ", .-" CORO_SYM(pyrite_coro_switch) "\n"
+#endif
+    ".p2align 4\n"
+    ".globl " CORO_SYM(pyrite_coro_trampoline) "\n"
+#if defined(__ELF__)
+    ".hidden " CORO_SYM(pyrite_coro_trampoline) "\n"
+    ".type " CORO_SYM(pyrite_coro_trampoline) ", @function\n"
+#endif
+    CORO_SYM(pyrite_coro_trampoline) ":\n"
+    "    movq %r12, %rdi\n"
+    "    callq *%r13\n"
+    "    ud2\n"
+#if defined(__ELF__)
+    ".size " CORO_SYM(pyrite_coro_trampoline) ", .-" CORO_SYM(pyrite_coro_trampoline) "\n"
+#endif
+);
+
+static void coro_context_boot(CoroContext* ctx) {
+    ctx->boot(ctx->boot_arg);
+}
+
+static int coro_context_init(CoroContext* ctx, char* stack_lo, size_t size) {
+    /* Frame popped by the first switch: control words, r15..rbp, return
+     * address. The return address sits 24 bytes below the 16-aligned top so
+     * the trampoline's call sees the ABI's alignment. */
+    uintptr_t top = ((uintptr_t)stack_lo + size) & ~(uintptr_t)15;
+    uint64_t* sp = (uint64_t*)(top - 80);
+    sp[0] = 0x1f80 | ((uint64_t)0x037f << 32);      /* MXCSR and x87 defaults */
+    sp[1] = 0;                                      /* r15 */
+    sp[2] = 0;                                      /* r14 */
+    sp[3] = (uint64_t)(uintptr_t)coro_context_boot; /* r13 */
+    sp[4] = (uint64_t)(uintptr_t)ctx;               /* r12 */
+    sp[5] = 0;                                      /* rbx */
+    sp[6] = 0;                                      /* rbp */
+    sp[7] = (uint64_t)(uintptr_t)pyrite_coro_trampoline;
+    ctx->sp = sp;
+    return 0;
+}
+
+static void coro_jump(CoroContext* from, CoroContext* to) {
+    pyrite_coro_switch(&from->sp, to->sp);
+}
+
+#elif defined(CORO_UCONTEXT)
+
+/* makecontext() can only pass ints: the context being entered is handed
+ * over through this instead */
+static CORO_THREAD_LOCAL CoroContext* coro_uc_entering;
+
+static void coro_uc_boot(void) {
+    CoroContext* ctx = coro_uc_entering;
+    ctx->boot(ctx->boot_arg);
+}
+
+static int coro_context_init(CoroContext* ctx, char* stack_lo, size_t size) {
+    if (getcontext(&ctx->uc) != 0) {
+        return -1;
+    }
+    ctx->uc.uc_stack.ss_sp = stack_lo;
+    ctx->uc.uc_stack.ss_size = size;
+    ctx->uc.uc_link = NULL;
+    makecontext(&ctx->uc, coro_uc_boot, 0);
+    return 0;
+}
+
+static void coro_jump(CoroContext* from, CoroContext* to) {
+    coro_uc_entering = to;
+    swapcontext(&from->uc, &to->uc);
+}
+
+#else
+
+static VOID CALLBACK coro_fiber_boot(LPVOID param) {
+    CoroContext* ctx = (CoroContext*)param;
+    ctx->boot(ctx->boot_arg);
+}
+
+static int coro_context_init(CoroContext* ctx, char* stack_lo, size_t size) {
+    (void)stack_lo;
+    ctx->fiber = CreateFiberEx(64 * 1024, size, FIBER_FLAG_FLOAT_SWITCH, coro_fiber_boot, ctx);
+    return ctx->fiber ? 0 : -1;
+}
+
+static void coro_jump(CoroContext* from, CoroContext* to) {
+    (void)from;
+    SwitchToFiber(to->fiber);
+}
+
+/* Fibers can only switch from a fiber */
+static int coro_thread_context(CoroContext* ctx) {
+    ctx->fiber = IsThreadAFiber() ? GetCurrentFiber() : ConvertThreadToFiberEx(NULL, FIBER_FLAG_FLOAT_SWITCH);
+    return ctx->fiber ? 0 : -1;
+}
+
+#endif
+
+/* ---- Stacks ---- */
+
+/* A reserved mapping with a guard page at the low end (stacks grow down) */
+static char* coro_stack_alloc(CoroScheduler* s) {
+#ifdef CORO_FIBERS
+    (void)s;
+    return NULL;
+#else
+    if (s->pool_count > 0) {
+        return s->stack_pool[--s->pool_count];
+    }
+    char* stack = mmap(NULL, s->stack_size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+    if (stack == MAP_FAILED) {
+        return NULL;
+    }
+    if (mprotect(stack, s->page_size, PROT_NONE) != 0) {
+        munmap(stack, s->stack_size);
+        return NULL;
+    }
+    return stack;
+#endif
+}
+
+static void coro_stack_release(CoroScheduler* s, char* stack) {
+#ifdef CORO_FIBERS
+    (void)s;
+    (void)stack;
+#else
+    if (!stack) {
+        return;
+    }
+    if (s->pool_count < CORO_STACK_POOL) {
+        s->stack_pool[s->pool_count++] = stack;
+    } else {
+        munmap(stack, s->stack_size);
+    }
+#endif
+}
+
+/* ---- Scheduling ---- */
+
+static int64_t coro_id(const Coro* c) {
+    return ((int64_t)c->generation << 32) | (int64_t)(uint32_t)c->slot;
+}
+
+static Coro* coro_lookup(CoroScheduler* s, int64_t id) {
+    if (!s || id <= 0) {
+        return NULL;
+    }
+    int32_t slot = (int32_t)(id & 0xffffffff);
+    if (slot >= s->coro_count) {
+        return NULL;
+    }
+    Coro* c = s->coros[slot];
+    if (c->generation != (uint32_t)((uint64_t)id >> 32) || c->state == CORO_FREE) {
+        return NULL;
+    }
+    return c;
+}
+
+static int coro_enqueue(CoroScheduler* s, Coro* c) {
+    if (s->run_len == s->run_cap) {
+        int32_t next = s->run_cap ? s->run_cap * 2 : 64;
+        Coro** ring = malloc((size_t)next * sizeof(Coro*));
+        if (!ring) {
+            return -1;
+        }
+        for (int32_t i = 0; i < s->run_len; i++) {
+            ring[i] = s->run_queue[(s->run_head + i) % s->run_cap];
+        }
+        free(s->run_queue);
+        s->run_queue = ring;
+        s->run_head = 0;
+        s->run_cap = next;
+    }
+    s->run_queue[(s->run_head + s->run_len) % s->run_cap] = c;
+    s->run_len++;
+    c->state = CORO_READY;
+    return 0;
+}
+
+static Coro* coro_dequeue(CoroScheduler* s) {
+    Coro* c = s->run_queue[s->run_head];
+    s->run_head = (s->run_head + 1) % s->run_cap;
+    s->run_len--;
+    return c;
+}
+
+/* A coroutine slot (allocated once, reused after release); NULL on failure */
+static Coro* coro_slot_new(CoroScheduler* s) {
+    if (s->free_count > 0) {
+        return s->coros[s->free_slots[--s->free_count]];
+    }
+    if (s->coro_count == s->coro_cap) {
+        int32_t next = s->coro_cap ? s->coro_cap * 2 : 64;
+        Coro** coros = realloc(s->coros, (size_t)next * sizeof(Coro*));
+        if (coros) {
+            s->coros = coros;
+        }
+        int32_t* slots = realloc(s->free_slots, (size_t)next * sizeof(int32_t));
+        if (slots) {
+            s->free_slots = slots;
+        }
+        if (!coros || !slots) {
+            return NULL;
+        }
+        s->coro_cap = next;
+    }
+    Coro* c = calloc(1, sizeof(Coro));
+    if (!c) {
+        return NULL;
+    }
+    c->slot = s->coro_count;
+    c->generation = 1;
+    c->sched = s;
+    s->coros[s->coro_count++] = c;
+    return c;
+}
+
+static void coro_release(CoroScheduler* s, Coro* c) {
+    coro_stack_release(s, c->stack);
+#ifdef CORO_FIBERS
+    if (c->ctx.fiber && c != s->main) {
+        DeleteFiber(c->ctx.fiber);
+    }
+    c->ctx.fiber = NULL;
+#endif
+    c->stack = NULL;
+    c->state = CORO_FREE;
+    c->joiners = NULL;
+    c->generation++;
+    s->free_slots[s->free_count++] = c->slot;
+}
+
+/* Scheduler context -> c, until c parks or finishes */
+static void coro_resume(CoroScheduler* s, Coro* c) {
+    c->state = CORO_RUNNING;
+    s->current = c;
+#ifdef CORO_ASAN
+    __sanitizer_start_switch_fiber(&s->sched_fake_stack, c->asan_bottom, c->asan_size);
+#endif
+    coro_jump(&s->sched_ctx, &c->ctx);
+#ifdef CORO_ASAN
+    __sanitizer_finish_switch_fiber(s->sched_fake_stack, NULL, NULL);
+#endif
+    /* The scheduler itself must block for real */
+    tcp_set_wait_hook(NULL);
+    s->current = NULL;
+    if (c->state == CORO_DONE && c != s->main) {
+        coro_release(s, c);
+    }
+}
+
+static int32_t coro_socket_wait(int64_t sock, int32_t events, int32_t timeout_ms);
+
+/* c -> scheduler context; returns when c is resumed */
+static void coro_switch_out(CoroScheduler* s, Coro* c) {
+#ifdef CORO_ASAN
+    __sanitizer_start_switch_fiber(c->state == CORO_DONE ? NULL : &c->fake_stack, s->sched_bottom, s->sched_size);
+#endif
+    coro_jump(&c->ctx, &s->sched_ctx);
+#ifdef CORO_ASAN
+    __sanitizer_finish_switch_fiber(c->fake_stack, NULL, NULL);
+#endif
+    tcp_set_wait_hook(coro_socket_wait);
+}
+
+static void coro_wake(CoroScheduler* s, Coro* c, int32_t flags) {
+    if (c->state != CORO_WAITING) {
+        return;
+    }
+    if (c->io_wait) {
+        if (c->timer_id > 0) {
+            reactor_timer_cancel(s->reactor, c->timer_id);
+        }
+        c->timer_id = 0;
+        c->io_wait = 0;
+        s->io_waiting--;
+    }
+    c->wake_flags = flags;
+    if (coro_enqueue(s, c) != 0) {
+        /* Out of memory for the run queue: nothing sensible is left */
+        fprintf(stderr, "coro: cannot grow the run queue\n");
+        abort();
+    }
+}
+
+/* First code on a coroutine's stack */
+static void coro_boot(void* arg) {
+    Coro* c = (Coro*)arg;
+    CoroScheduler* s = c->sched;
+#ifdef CORO_ASAN
+    __sanitizer_finish_switch_fiber(NULL, &s->sched_bottom, &s->sched_size);
+#endif
+    tcp_set_wait_hook(coro_socket_wait);
+    c->entry(c->arg);
+    c->state = CORO_DONE;
+    s->live--;
+    for (Coro* j = c->joiners; j;) {
+        Coro* next = j->next_joiner;
+        coro_wake(s, j, 0);
+        j = next;
+    }
+    c->joiners = NULL;
+    coro_switch_out(s, c);
+}
+
+static int coro_fd_reserve(CoroScheduler* s, int64_t fd) {
+    if (fd < s->fd_cap) {
+        return 0;
+    }
+    if (fd >= CORO_MAX_FD) {
+        errno = EINVAL;
+        return -1;
+    }
+    int64_t next = s->fd_cap ? s->fd_cap : 1024;
+    while (next <= fd) {
+        next *= 2;
+    }
+    CoroFdWaiters* fds = realloc(s->fds, (size_t)next * sizeof(CoroFdWaiters));
+    if (!fds) {
+        return -1;
+    }
+    memset(fds + s->fd_cap, 0, (size_t)(next - s->fd_cap) * sizeof(CoroFdWaiters));
+    s->fds = fds;
+    s->fd_cap = next;
+    return 0;
+}
+
+static void coro_dispatch(CoroScheduler* s, int32_t n) {
+    for (int32_t i = 0; i < n; i++) {
+        int64_t token = reactor_event_token(s->reactor, i);
+        int32_t flags = reactor_event_flags(s->reactor, i);
+        if (flags & REACTOR_TIMER) {
+            if (!(token & CORO_TOKEN_TIMER)) {
+                continue;
+            }
+            int32_t slot = (int32_t)(token & 0xffffffff);
+            if (slot >= s->coro_count) {
+                continue;
+            }
+            Coro* c = s->coros[slot];
+            if (c->state == CORO_WAITING && c->io_wait) {
+                c->timer_id = 0;   /* Already expired */
+                coro_wake(s, c, 0);
+            }
+            continue;
+        }
+        if (token < 0 || token >= s->fd_cap) {
+            continue;
+        }
+        CoroFdWaiters* w = &s->fds[token];
+        int32_t unwanted = 0;
+        if (flags & (CORO_READ | CORO_HUP | CORO_ERROR)) {
+            if (w->reader) {
+                Coro* c = w->reader;
+                w->reader = NULL;
+                coro_wake(s, c, flags);
+            } else if (flags & CORO_READ) {
+                unwanted = 1;
+            }
+        }
+        if (flags & (CORO_WRITE | CORO_HUP | CORO_ERROR)) {
+            if (w->writer) {
+                Coro* c = w->writer;
+                w->writer = NULL;
+                coro_wake(s, c, flags);
+            } else if (flags & CORO_WRITE) {
+                unwanted = 1;
+            }
+        }
+        if (unwanted) {
+            /* Readiness nobody waits for: narrow the interest (a
+             * level-triggered reactor would report it forever) */
+            reactor_modify(s->reactor, token, (w->reader ? CORO_READ : 0) | (w->writer ? CORO_WRITE : 0), token);
+        }
+    }
+}
+
+/* Run until no coroutine is left (0) or all remaining ones wait on each
+ * other (-1, EDEADLK) */
+static int32_t coro_loop(CoroScheduler* s) {
+    for (;;) {
+        /* One round over what is ready now; yields go to the next round so
+         * I/O is polled between rounds */
+        for (int32_t n = s->run_len; n > 0 && s->run_len > 0; n--) {
+            coro_resume(s, coro_dequeue(s));
+        }
+        if (s->run_len == 0 && s->io_waiting == 0) {
+            if (s->live == 0) {
+                return 0;
+            }
+            errno = EDEADLK;
+            return -1;
+        }
+        if (s->io_waiting == 0) {
+            continue;   /* Nothing to poll for */
+        }
+        int32_t n = reactor_poll(s->reactor, s->run_len > 0 ? 0 : -1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        coro_dispatch(s, n);
+    }
+}
+
+/* Park the running coroutine until coro_wake(); timeout_ms >= 0 arms a timer.
+ * Returns the wake flags (0 on timeout) or -1 if the timer can't be armed. */
+static int32_t coro_block_io(CoroScheduler* s, Coro* c, int32_t timeout_ms) {
+    c->timer_id = 0;
+    if (timeout_ms >= 0) {
+        c->timer_id = reactor_timer_add(s->reactor, timeout_ms, 0, CORO_TOKEN_TIMER | c->slot);
+        if (c->timer_id < 0) {
+            return -1;
+        }
+    }
+    c->state = CORO_WAITING;
+    c->io_wait = 1;
+    c->wake_flags = 0;
+    s->io_waiting++;
+    coro_switch_out(s, c);
+    return c->wake_flags;
+}
+
+/* ---- Public API ---- */
+
+/**
+ * Creates a scheduler. stack_size is the stack reserved per coroutine
+ * (rounded up to pages, guard page included); <= 0 picks 256 KiB. Only
+ * touched pages use memory, so a large reserve is cheap; the count of
+ * stacks is bounded by the process map limit (vm.max_map_count, two maps
+ * per stack).
+ *
+ * @return The scheduler, or NULL on failure
+ */
+void* coro_scheduler_new(int32_t stack_size) {
+    CoroScheduler* s = calloc(1, sizeof(CoroScheduler));
+    if (!s) {
+        return NULL;
+    }
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    s->page_size = info.dwPageSize;
+#else
+    long page = sysconf(_SC_PAGESIZE);
+    s->page_size = page > 0 ? (size_t)page : 4096;
+#endif
+    size_t size = stack_size > 0 ? (size_t)stack_size : CORO_DEFAULT_STACK;
+    if (size < CORO_MIN_STACK) {
+        size = CORO_MIN_STACK;
+    }
+    s->stack_size = (size + s->page_size - 1) / s->page_size * s->page_size;
+    s->stack_pool = malloc(CORO_STACK_POOL * sizeof(char*));
+    s->reactor = reactor_new();
+    if (!s->stack_pool || !s->reactor) {
+        coro_scheduler_free(s);
+        return NULL;
+    }
+    return s;
+}
+
+/**
+ * Starts entry(arg) as a new coroutine on scheduler (NULL = the one running
+ * on this thread, i.e. spawning from inside a coroutine). It runs once the
+ * scheduler gets to it; the caller continues meanwhile.
+ *
+ * @return The coroutine id (> 0, for coro_join), or -1 on failure
+ */
+int64_t coro_spawn(void* scheduler, void (*entry)(void*), void* arg) {
+    CoroScheduler* s = scheduler ? (CoroScheduler*)scheduler : coro_tls;
+    if (!s || !entry) {
+        errno = EINVAL;
+        return -1;
+    }
+    Coro* c = coro_slot_new(s);
+    if (!c) {
+        return -1;
+    }
+    c->stack = coro_stack_alloc(s);
+    c->ctx.boot = coro_boot;
+    c->ctx.boot_arg = c;
+#ifndef CORO_FIBERS
+    if (!c->stack) {
+        c->state = CORO_DONE;
+        coro_release(s, c);
+        return -1;
+    }
+#endif
+    char* usable = c->stack ? c->stack + s->page_size : NULL;
+    size_t usable_size = s->stack_size - s->page_size;
+    if (coro_context_init(&c->ctx, usable, usable_size) != 0) {
+        coro_release(s, c);
+        return -1;
+    }
+#ifdef CORO_ASAN
+    c->asan_bottom = usable;
+    c->asan_size = usable_size;
+    c->fake_stack = NULL;
+#endif
+    c->entry = entry;
+    c->arg = arg;
+    c->joiners = NULL;
+    c->timer_id = 0;
+    c->io_wait = 0;
+    if (coro_enqueue(s, c) != 0) {
+        coro_release(s, c);
+        return -1;
+    }
+    s->live++;
+    return coro_id(c);
+}
+
+/* coro_spawn() on the scheduler running the caller; -1 outside coroutines */
+int64_t coro_spawn_current(void (*entry)(void*), void* arg) {
+    if (!coro_tls) {
+        errno = EPERM;
+        return -1;
+    }
+    return coro_spawn(coro_tls, entry, arg);
+}
+
+/**
+ * Runs coroutines until all have finished.
+ *
+ * @return 0, or -1 with errno EDEADLK if the remaining coroutines all wait
+ *         for each other (coro_join cycles), EBUSY if a scheduler already
+ *         runs on this thread
+ */
+int32_t coro_scheduler_run(void* handle) {
+    CoroScheduler* s = (CoroScheduler*)handle;
+    if (!s) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (coro_tls) {
+        errno = EBUSY;
+        return -1;
+    }
+#ifdef CORO_FIBERS
+    if (coro_thread_context(&s->sched_ctx) != 0) {
+        return -1;
+    }
+#endif
+    coro_tls = s;
+    s->running = 1;
+    int32_t result = coro_loop(s);
+    int saved = errno;
+    s->running = 0;
+    coro_tls = NULL;
+    tcp_set_wait_hook(NULL);
+    errno = saved;
+    return result;
+}
+
+/* Coroutines spawned and not finished */
+int32_t coro_scheduler_count(void* handle) {
+    CoroScheduler* s = (CoroScheduler*)handle;
+    return s ? s->live : 0;
+}
+
+/* Id of the running coroutine, or 0 outside coroutines */
+int64_t coro_current() {
+    CoroScheduler* s = coro_tls;
+    return s && s->current ? coro_id(s->current) : 0;
+}
+
+/* Let the other ready coroutines run (no-op outside coroutines); 0 or -1 */
+int32_t coro_yield() {
+    CoroScheduler* s = coro_tls;
+    if (!s || !s->current) {
+        return 0;
+    }
+    Coro* c = s->current;
+    if (coro_enqueue(s, c) != 0) {
+        return -1;
+    }
+    coro_switch_out(s, c);
+    return 0;
+}
+
+/* Suspend the running coroutine (or sleep the thread) for ms; 0 or -1 */
+int32_t coro_sleep(int64_t ms) {
+    if (ms < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    CoroScheduler* s = coro_tls;
+    if (!s || !s->current) {
+#ifdef _WIN32
+        Sleep((DWORD)ms);
+#else
+        struct timespec ts = { (time_t)(ms / 1000), (long)(ms % 1000) * 1000000L };
+        while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+        }
+#endif
+        return 0;
+    }
+    return coro_block_io(s, s->current, ms > INT32_MAX ? INT32_MAX : (int32_t)ms) < 0 ? -1 : 0;
+}
+
+/**
+ * Waits until fd is ready for events (CORO_READ | CORO_WRITE) or
+ * timeout_ms passes (< 0 = no limit). Inside a coroutine only the
+ * coroutine waits; elsewhere this is a plain poll(). One coroutine at a time
+ * may wait per fd and direction.
+ *
+ * @return The ready flags (CORO_READ, CORO_WRITE, CORO_HUP, CORO_ERROR), 0 on
+ *         timeout, or -1 on error (EBUSY: another coroutine waits already)
+ */
+int32_t coro_wait_fd(int64_t fd, int32_t events, int32_t timeout_ms) {
+    events &= CORO_READ | CORO_WRITE;
+    if (fd < 0 || events == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    CoroScheduler* s = coro_tls;
+    if (!s || !s->current) {
+#ifdef _WIN32
+        WSAPOLLFD pfd;
+        pfd.fd = (SOCKET)fd;
+        pfd.events = (SHORT)(((events & CORO_READ) ? POLLRDNORM : 0) | ((events & CORO_WRITE) ? POLLWRNORM : 0));
+        pfd.revents = 0;
+        int ready = WSAPoll(&pfd, 1, timeout_ms);
+#else
+        struct pollfd pfd = { (int)fd, (short)(((events & CORO_READ) ? POLLIN : 0) | ((events & CORO_WRITE) ? POLLOUT : 0)), 0 };
+        int ready;
+        do {
+            ready = poll(&pfd, 1, timeout_ms);
+        } while (ready < 0 && errno == EINTR);
+#endif
+        if (ready <= 0) {
+            return ready;
+        }
+        int32_t flags = 0;
+        if (pfd.revents & POLLIN) {
+            flags |= CORO_READ;
+        }
+        if (pfd.revents & POLLOUT) {
+            flags |= CORO_WRITE;
+        }
+        if (pfd.revents & POLLHUP) {
+            flags |= CORO_HUP | CORO_READ;
+        }
+        if (pfd.revents & (POLLERR | POLLNVAL)) {
+            flags |= CORO_ERROR;
+        }
+        return flags;
+    }
+
+    Coro* c = s->current;
+    if (coro_fd_reserve(s, fd) != 0) {
+        return -1;
+    }
+    CoroFdWaiters* w = &s->fds[fd];
+    if (((events & CORO_READ) && w->reader) || ((events & CORO_WRITE) && w->writer)) {
+        errno = EBUSY;
+        return -1;
+    }
+    /* Re-arming also re-reports readiness that is already there */
+    int32_t interest = events | (w->reader ? CORO_READ : 0) | (w->writer ? CORO_WRITE : 0);
+    if (!w->registered || reactor_modify(s->reactor, fd, interest, fd) != 0) {
+        /* New, or closed behind our back and the number reused */
+        if (w->registered) {
+            reactor_unregister(s->reactor, fd);
+        }
+        if (reactor_register(s->reactor, fd, interest, fd) != 0) {
+            return -1;
+        }
+        w->registered = 1;
+    }
+    if (events & CORO_READ) {
+        w->reader = c;
+    }
+    if (events & CORO_WRITE) {
+        w->writer = c;
+    }
+    int32_t flags = coro_block_io(s, c, timeout_ms);
+    w = &s->fds[fd];   /* The table may have grown meanwhile */
+    if (w->reader == c) {
+        w->reader = NULL;
+    }
+    if (w->writer == c) {
+        w->writer = NULL;
+    }
+    if (flags < 0) {
+        return -1;
+    }
+    return flags;
+}
+
+/* Forget fd before it is closed, waking its waiters with CORO_ERROR */
+static void coro_fd_closing(CoroScheduler* s, int64_t fd) {
+    if (fd < 0 || fd >= s->fd_cap) {
+        return;
+    }
+    CoroFdWaiters* w = &s->fds[fd];
+    if (w->reader) {
+        coro_wake(s, w->reader, CORO_ERROR);
+    }
+    if (w->writer && w->writer != w->reader) {
+        coro_wake(s, w->writer, CORO_ERROR);
+    }
+    w->reader = w->writer = NULL;
+    if (w->registered) {
+        reactor_unregister(s->reactor, fd);
+    }
+    w->registered = 0;
+}
+
+/* socket.c's wait hook: events 0 announces a close */
+static int32_t coro_socket_wait(int64_t sock, int32_t events, int32_t timeout_ms) {
+    CoroScheduler* s = coro_tls;
+    if (events == 0) {
+        if (s) {
+            coro_fd_closing(s, sock);
+        }
+        return 0;
+    }
+    return coro_wait_fd(sock, events, timeout_ms);
+}
+
+/**
+ * Waits for coroutine id to finish (immediately if it already has).
+ *
+ * @return 0, or -1 with errno EPERM outside a coroutine, EDEADLK when
+ *         joining itself or when the scheduler found a join cycle
+ */
+int32_t coro_join(int64_t id) {
+    CoroScheduler* s = coro_tls;
+    if (!s || !s->current) {
+        errno = EPERM;
+        return -1;
+    }
+    Coro* self = s->current;
+    Coro* target = coro_lookup(s, id);
+    if (!target || target->state == CORO_DONE) {
+        return 0;
+    }
+    if (target == self) {
+        errno = EDEADLK;
+        return -1;
+    }
+    self->next_joiner = target->joiners;
+    target->joiners = self;
+    self->state = CORO_WAITING;
+    self->wake_flags = 0;
+    coro_switch_out(s, self);
+    if (self->wake_flags < 0) {
+        errno = EDEADLK;
+        return -1;
+    }
+    return 0;
+}
+
+/* ---- Main coroutine ---- */
+
+/* Entry of the scheduler loop's own stack in main mode */
+static void coro_loop_boot(void* arg) {
+    CoroScheduler* s = (CoroScheduler*)arg;
+#ifdef CORO_ASAN
+    __sanitizer_finish_switch_fiber(NULL, &s->main->asan_bottom, &s->main->asan_size);
+#endif
+    s->current = NULL;
+    for (;;) {
+        s->loop_result = coro_loop(s);
+        s->loop_errno = errno;
+        /* Everything else is done (or stuck): back to coro_main_exit() or
+         * the join main is blocked in */
+        Coro* m = s->main;
+        if (m->state == CORO_WAITING && !m->io_wait) {
+            m->wake_flags = s->loop_result < 0 ? -1 : 0;
+            m->state = CORO_READY;
+            coro_resume(s, m);
+        } else {
+            /* Unreachable: main can't be parked on I/O with io_waiting == 0 */
+            abort();
+        }
+    }
+}
+
+/**
+ * Turns the calling thread's current stack into a coroutine running on a
+ * new scheduler: from here until coro_main_exit(), blocking socket calls
+ * park instead of blocking and coro_spawn(NULL, ...) starts siblings. This
+ * is what `async fn main` lowers to.
+ *
+ * @return 0, or -1 (EBUSY if a scheduler already runs on this thread)
+ */
+int32_t coro_main_enter() {
+    if (coro_tls) {
+        errno = EBUSY;
+        return -1;
+    }
+    CoroScheduler* s = coro_scheduler_new(0);
+    if (!s) {
+        return -1;
+    }
+    Coro* m = coro_slot_new(s);
+    s->loop_stack = coro_stack_alloc(s);
+#ifdef CORO_FIBERS
+    if (!m || coro_thread_context(&m->ctx) != 0) {
+#else
+    if (!m || !s->loop_stack) {
+#endif
+        coro_scheduler_free(s);
+        return -1;
+    }
+    s->sched_ctx.boot = coro_loop_boot;
+    s->sched_ctx.boot_arg = s;
+    char* usable = s->loop_stack ? s->loop_stack + s->page_size : NULL;
+    if (coro_context_init(&s->sched_ctx, usable, s->stack_size - s->page_size) != 0) {
+        coro_scheduler_free(s);
+        return -1;
+    }
+#ifdef CORO_ASAN
+    s->sched_bottom = usable;
+    s->sched_size = s->stack_size - s->page_size;
+#endif
+    m->state = CORO_RUNNING;
+    s->main = m;
+    s->current = m;
+    s->running = 1;
+    coro_tls = s;
+    tcp_set_wait_hook(coro_socket_wait);
+    return 0;
+}
+
+/**
+ * Waits for every coroutine spawned since coro_main_enter() to finish, then
+ * returns the thread to normal blocking mode and frees the scheduler.
+ *
+ * @return 0, or -1 with errno EDEADLK if the others were stuck (they are
+ *         abandoned), EPERM if not called from the main coroutine
+ */
+int32_t coro_main_exit() {
+    CoroScheduler* s = coro_tls;
+    if (!s || !s->main || s->current != s->main) {
+        errno = EPERM;
+        return -1;
+    }
+    Coro* m = s->main;
+    int32_t result = 0;
+    if (s->live > 0 || s->run_len > 0 || s->io_waiting > 0) {
+        m->state = CORO_WAITING;
+        m->wake_flags = 0;
+        coro_switch_out(s, m);
+        if (m->wake_flags < 0) {
+            result = -1;
+        }
+    }
+    tcp_set_wait_hook(NULL);
+    coro_tls = NULL;
+    s->running = 0;
+    s->current = NULL;
+    coro_scheduler_free(s);
+    if (result < 0) {
+        errno = EDEADLK;
+    }
+    return result;
+}
+
+void coro_scheduler_free(void* handle) {
+    CoroScheduler* s = (CoroScheduler*)handle;
+    if (!s || (s->running && coro_tls == s)) {
+        return;
+    }
+    for (int32_t i = 0; i < s->coro_count; i++) {
+        Coro* c = s->coros[i];
+        if (c->state != CORO_FREE && c != s->main) {
+            /* Unfinished coroutines are abandoned with their stacks */
+#ifndef CORO_FIBERS
+            if (c->stack) {
+                munmap(c->stack, s->stack_size);
+            }
+#else
+            if (c->ctx.fiber) {
+                DeleteFiber(c->ctx.fiber);
+            }
+#endif
+        }
+        free(c);
+    }
+#ifndef CORO_FIBERS
+    for (int32_t i = 0; i < s->pool_count; i++) {
+        munmap(s->stack_pool[i], s->stack_size);
+    }
+    if (s->loop_stack) {
+        munmap(s->loop_stack, s->stack_size);
+    }
+#else
+    if (s->main && s->sched_ctx.fiber) {
+        DeleteFiber(s->sched_ctx.fiber);
+    }
+#endif
+    if (s->reactor) {
+        reactor_free(s->reactor);
+    }
+    free(s->coros);
+    free(s->free_slots);
+    free(s->run_queue);
+    free(s->fds);
+    free(s->stack_pool);
+    free(s);
+}
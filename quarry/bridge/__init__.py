@@ -9,10 +9,13 @@ Modules:
     build_graph_bridge: Build graph bridge
     dep_fingerprint_bridge: Dependency fingerprinting bridge
     dep_source_bridge: Dependency source tracking bridge
+    file_bridge: File copy bridge
+    glob_bridge: Glob matching and directory walking bridge
     locked_validate_bridge: Locked validation bridge
     lockfile_bridge: Lockfile handling bridge
     path_utils_bridge: Path utilities bridge
     resolve_bridge: Dependency resolution bridge
+    tar_bridge: Tarball extraction bridge
     toml_bridge: TOML parsing bridge
     version_bridge: Version handling bridge
 
@@ -25,15 +28,18 @@ See Also:
 from .build_graph_bridge import *
 from .dep_fingerprint_bridge import *
 from .dep_source_bridge import *
+from .file_bridge import *
+from .glob_bridge import *
 from .locked_validate_bridge import *
 from .lockfile_bridge import *
 from .path_utils_bridge import *
 from .resolve_bridge import *
+from .tar_bridge import *
 from .toml_bridge import *
 from .version_bridge import *
 
 __all__ = [
     'build_graph_bridge', 'dep_fingerprint_bridge',
-    'dep_source_bridge', 'locked_validate_bridge', 'lockfile_bridge',
-    'path_utils_bridge', 'resolve_bridge', 'toml_bridge', 'version_bridge'
+    'dep_source_bridge', 'file_bridge', 'glob_bridge', 'locked_validate_bridge', 'lockfile_bridge',
+    'path_utils_bridge', 'resolve_bridge', 'tar_bridge', 'toml_bridge', 'version_bridge'
 ]
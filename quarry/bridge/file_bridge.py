@@ -0,0 +1,90 @@
+"""FFI Bridge for Pyrite file module
+
+This module provides a Python interface to the Pyrite file.pyrite module.
+The Pyrite module calls C functions for the core logic, and this bridge loads
+the shared library and provides Python wrappers.
+"""
+
+import os
+import sys
+import errno
+import shutil
+import ctypes
+from pathlib import Path
+
+# Feature flags
+# Master flag: PYRITE_ACCELERATE enables all Pyrite acceleration features
+# Individual flag: PYRITE_USE_FILE_FFI (can override master flag if explicitly set)
+PYRITE_ACCELERATE = os.getenv("PYRITE_ACCELERATE", "").lower() in ("1", "true", "yes", "on")
+PYRITE_USE_FILE_FFI_EXPLICIT = "PYRITE_USE_FILE_FFI" in os.environ
+USE_FFI = PYRITE_USE_FILE_FFI_EXPLICIT and os.getenv("PYRITE_USE_FILE_FFI", "false").lower() == "true"
+USE_FFI = USE_FFI or (PYRITE_ACCELERATE and not PYRITE_USE_FILE_FFI_EXPLICIT)
+
+# Try to load shared library
+_lib = None
+if USE_FFI:
+    try:
+        # Find library path (will be built during compilation)
+        compiler_dir = Path(__file__).parent.parent
+        lib_name = "file"
+        if sys.platform == "win32":
+            lib_path = compiler_dir / "target" / f"{lib_name}.dll"
+        elif sys.platform == "darwin":
+            lib_path = compiler_dir / "target" / f"lib{lib_name}.dylib"
+        else:
+            lib_path = compiler_dir / "target" / f"lib{lib_name}.so"
+        
+        if lib_path.exists():
+            _lib = ctypes.CDLL(str(lib_path), use_errno=True)
+            
+            # Define function signatures
+            _lib.file_copy.argtypes = [ctypes.c_char_p, ctypes.c_char_p]
+            _lib.file_copy.restype = ctypes.c_int32
+            
+            _lib.dir_copy_tree.argtypes = [ctypes.c_char_p, ctypes.c_char_p]
+            _lib.dir_copy_tree.restype = ctypes.c_int32
+        else:
+            # Library not found, fall back to Python
+            USE_FFI = False
+    except Exception as e:
+        # FFI failed, fall back to Python
+        USE_FFI = False
+        print(f"Warning: Failed to load file FFI library: {e}", file=sys.stderr)
+
+
+def copy_file_ffi(src: Path, dst: Path) -> None:
+    """Copy a single file using FFI (reflink / copy_file_range when available)"""
+    if USE_FFI and _lib:
+        try:
+            if _lib.file_copy(os.fsencode(src), os.fsencode(dst)) == 1:
+                return
+        except Exception:
+            pass
+    copy_file_python(src, dst)
+
+
+def copy_file_python(src: Path, dst: Path) -> None:
+    """Python fallback implementation"""
+    shutil.copy2(src, dst)
+
+
+def copy_tree_ffi(src: Path, dst: Path) -> None:
+    """Recursively copy a directory tree using FFI (files copied in parallel)
+
+    Same contract as copy_tree_python: dst must not exist, symlinks are copied
+    as links, and a failed copy raises OSError and leaves what was copied in
+    place rather than deleting anything.
+    """
+    if USE_FFI and _lib:
+        if os.path.lexists(dst):
+            raise FileExistsError(errno.EEXIST, os.strerror(errno.EEXIST), str(dst))
+        if _lib.dir_copy_tree(os.fsencode(src), os.fsencode(dst)) != 1:
+            err = ctypes.get_errno() or errno.EIO
+            raise OSError(err, f"Failed to copy tree {src} to {dst}: {os.strerror(err)}")
+        return
+    copy_tree_python(src, dst)
+
+
+def copy_tree_python(src: Path, dst: Path) -> None:
+    """Python fallback implementation"""
+    shutil.copytree(src, dst, symlinks=True)
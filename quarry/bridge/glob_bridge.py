@@ -0,0 +1,313 @@
+"""FFI Bridge for Pyrite glob module
+
+This module provides a Python interface to the Pyrite glob.pyrite module.
+The Pyrite module calls C functions for the core logic, and this bridge loads
+the shared library and provides Python wrappers.
+
+Pattern syntax (both paths): '/' separates segments, * and ? stay within a
+segment, ** as a whole segment spans any number of segments, [a-z] / [!a-z]
+are classes and {a,b} is alternation. The native walker skips directories
+that cannot contain a match; results are relative paths in sorted order.
+"""
+
+import os
+import re
+import sys
+import ctypes
+from pathlib import Path
+from typing import List, Optional, Sequence
+
+# Feature flags
+# Master flag: PYRITE_ACCELERATE enables all Pyrite acceleration features
+# Individual flag: PYRITE_USE_GLOB_FFI (can override master flag if explicitly set)
+PYRITE_ACCELERATE = os.getenv("PYRITE_ACCELERATE", "").lower() in ("1", "true", "yes", "on")
+PYRITE_USE_GLOB_FFI_EXPLICIT = "PYRITE_USE_GLOB_FFI" in os.environ
+USE_FFI = PYRITE_USE_GLOB_FFI_EXPLICIT and os.getenv("PYRITE_USE_GLOB_FFI", "false").lower() == "true"
+USE_FFI = USE_FFI or (PYRITE_ACCELERATE and not PYRITE_USE_GLOB_FFI_EXPLICIT)
+
+# Walk flags (match glob.c)
+WALK_FILES = 1
+WALK_DIRS = 2
+
+# Try to load shared library
+_lib = None
+if USE_FFI:
+    try:
+        # Find library path (will be built during compilation)
+        compiler_dir = Path(__file__).parent.parent
+        lib_name = "glob"
+        if sys.platform == "win32":
+            lib_path = compiler_dir / "target" / f"{lib_name}.dll"
+        elif sys.platform == "darwin":
+            lib_path = compiler_dir / "target" / f"lib{lib_name}.dylib"
+        else:
+            lib_path = compiler_dir / "target" / f"lib{lib_name}.so"
+        
+        if lib_path.exists():
+            _lib = ctypes.CDLL(str(lib_path))
+            
+            # Define function signatures
+            _lib.glob_set_new.argtypes = []
+            _lib.glob_set_new.restype = ctypes.c_void_p
+            
+            _lib.glob_set_add.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+            _lib.glob_set_add.restype = ctypes.c_int32
+            
+            _lib.glob_set_match.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_int64]
+            _lib.glob_set_match.restype = ctypes.c_int32
+            
+            _lib.glob_set_free.argtypes = [ctypes.c_void_p]
+            _lib.glob_set_free.restype = None
+            
+            _lib.glob_walk_open.argtypes = [ctypes.c_char_p, ctypes.c_void_p, ctypes.c_void_p, ctypes.c_int32]
+            _lib.glob_walk_open.restype = ctypes.c_void_p
+            
+            _lib.glob_walk_next.argtypes = [ctypes.c_void_p]
+            _lib.glob_walk_next.restype = ctypes.c_int32
+            
+            _lib.glob_walk_relative.argtypes = [ctypes.c_void_p]
+            _lib.glob_walk_relative.restype = ctypes.c_char_p
+            
+            _lib.glob_walk_close.argtypes = [ctypes.c_void_p]
+            _lib.glob_walk_close.restype = None
+        else:
+            # Library not found, fall back to Python
+            USE_FFI = False
+    except Exception as e:
+        # FFI failed, fall back to Python
+        USE_FFI = False
+        print(f"Warning: Failed to load glob FFI library: {e}", file=sys.stderr)
+
+
+def _new_set(patterns: Optional[Sequence[str]]):
+    if not patterns:
+        return None
+    handle = _lib.glob_set_new()
+    if not handle:
+        raise MemoryError("glob_set_new failed")
+    for pattern in patterns:
+        if _lib.glob_set_add(handle, os.fsencode(pattern)) < 0:
+            _lib.glob_set_free(handle)
+            raise ValueError(f"Cannot compile glob pattern: {pattern}")
+    return handle
+
+
+def glob_match_ffi(patterns: Sequence[str], path: str) -> int:
+    """Index of the first pattern matching path (or -1) using FFI"""
+    if USE_FFI and _lib:
+        try:
+            handle = _new_set(patterns)
+            if handle is None:
+                return -1
+            try:
+                data = os.fsencode(path)
+                return _lib.glob_set_match(handle, data, len(data))
+            finally:
+                _lib.glob_set_free(handle)
+        except (ValueError, MemoryError):
+            pass
+    return glob_match_python(patterns, path)
+
+
+def glob_files_ffi(root: Path, include: Sequence[str], exclude: Optional[Sequence[str]] = None,
+                   flags: int = WALK_FILES) -> List[str]:
+    """Walk root and return the relative paths matching include but not exclude
+    
+    Excluded entries are skipped together with everything beneath them.
+    """
+    if USE_FFI and _lib:
+        include_set = exclude_set = None
+        try:
+            include_set = _new_set(include)
+            exclude_set = _new_set(exclude)
+            walk = _lib.glob_walk_open(os.fsencode(root), include_set, exclude_set, flags)
+            if walk:
+                results = []
+                try:
+                    status = _lib.glob_walk_next(walk)
+                    while status == 1:
+                        results.append(os.fsdecode(_lib.glob_walk_relative(walk)))
+                        status = _lib.glob_walk_next(walk)
+                finally:
+                    _lib.glob_walk_close(walk)
+                if status == 0:
+                    return results
+        except (ValueError, MemoryError):
+            pass
+        finally:
+            if include_set:
+                _lib.glob_set_free(include_set)
+            if exclude_set:
+                _lib.glob_set_free(exclude_set)
+    return glob_files_python(root, include, exclude, flags)
+
+
+def _find_braces(pattern: str):
+    """Span of the first top-level {a,b} group, or None"""
+    i = 0
+    while i < len(pattern):
+        if pattern[i] == '\\':
+            i += 2
+            continue
+        if pattern[i] == '{':
+            depth = 0
+            has_comma = False
+            j = i
+            while j < len(pattern):
+                c = pattern[j]
+                if c == '\\':
+                    j += 2
+                    continue
+                if c == '{':
+                    depth += 1
+                elif c == '}':
+                    depth -= 1
+                    if depth == 0:
+                        if has_comma:
+                            return i, j
+                        break
+                elif c == ',' and depth == 1:
+                    has_comma = True
+                j += 1
+        i += 1
+    return None
+
+
+def _expand_braces(pattern: str) -> List[str]:
+    span = _find_braces(pattern)
+    if span is None:
+        return [pattern]
+    open_, close = span
+    alternatives = []
+    depth = 0
+    start = open_ + 1
+    j = open_ + 1
+    while j <= close:
+        c = pattern[j]
+        if c == '\\' and j < close:
+            j += 2
+            continue
+        if c == '{':
+            depth += 1
+        elif c == '}' and depth > 0:
+            depth -= 1
+        elif (c == ',' and depth == 0) or j == close:
+            alternatives.append(pattern[start:j])
+            start = j + 1
+        j += 1
+    expanded = []
+    for alt in alternatives:
+        expanded.extend(_expand_braces(pattern[:open_] + alt + pattern[close + 1:]))
+    return expanded
+
+
+def _class_to_regex(pattern: str, i: int):
+    """Translate a [...] class starting after '['; returns (regex, end) or None"""
+    n = len(pattern)
+    negate = i < n and pattern[i] in "!^"
+    if negate:
+        i += 1
+    first = i
+    chars = set()
+    while i < n and (pattern[i] != ']' or i == first):
+        lo = pattern[i]
+        if lo == '\\' and i + 1 < n:
+            i += 1
+            lo = pattern[i]
+        hi = lo
+        if i + 2 < n and pattern[i + 1] == '-' and pattern[i + 2] != ']':
+            hi = pattern[i + 2]
+            if hi == '\\' and i + 3 < n:
+                i += 1
+                hi = pattern[i + 2]
+            i += 2
+        chars.update(chr(c) for c in range(ord(lo), ord(hi) + 1))
+        i += 1
+    if i >= n:
+        return None
+    chars.discard('/')
+    body = ''.join(re.escape(c) for c in sorted(chars))
+    if negate:
+        return f"[^/{body}]", i + 1
+    return (f"[{body}]" if body else "(?!)"), i + 1
+
+
+def _glob_to_regex(pattern: str) -> str:
+    out = []
+    i = 0
+    n = len(pattern)
+    while i < n:
+        c = pattern[i]
+        segment_start = i == 0 or pattern[i - 1] == '/'
+        if c == '*' and pattern[i:i + 2] == "**" and segment_start and (i + 2 == n or pattern[i + 2] == '/'):
+            if i + 2 == n:
+                out.append(".*")
+                i += 2
+            else:
+                out.append("(?:.*/)?")
+                i += 3
+            continue
+        if c == '*':
+            while i < n and pattern[i] == '*':
+                i += 1
+            out.append("[^/]*")
+            continue
+        if c == '?':
+            out.append("[^/]")
+            i += 1
+            continue
+        if c == '[':
+            translated = _class_to_regex(pattern, i + 1)
+            if translated is not None:
+                out.append(translated[0])
+                i = translated[1]
+                continue
+        if c == '\\' and i + 1 < n:
+            i += 1
+            c = pattern[i]
+        out.append(re.escape(c))
+        i += 1
+    return ''.join(out)
+
+
+def _compile_python(patterns: Optional[Sequence[str]]):
+    return [[re.compile(_glob_to_regex(p), re.S) for p in _expand_braces(pattern)] for pattern in patterns or []]
+
+
+def _first_match(compiled, path: str) -> int:
+    for index, alternatives in enumerate(compiled):
+        if any(regex.fullmatch(path) for regex in alternatives):
+            return index
+    return -1
+
+
+def glob_match_python(patterns: Sequence[str], path: str) -> int:
+    """Python fallback implementation"""
+    return _first_match(_compile_python(patterns), path)
+
+
+def glob_files_python(root: Path, include: Sequence[str], exclude: Optional[Sequence[str]] = None,
+                      flags: int = WALK_FILES) -> List[str]:
+    """Python fallback implementation"""
+    include_re = _compile_python(include)
+    exclude_re = _compile_python(exclude)
+    results = []
+    
+    def walk(directory: str, prefix: str):
+        try:
+            entries = sorted(os.scandir(directory), key=lambda e: e.name)
+        except OSError:
+            return
+        for entry in entries:
+            rel = prefix + entry.name
+            if exclude_re and _first_match(exclude_re, rel) >= 0:
+                continue
+            is_dir = entry.is_dir()
+            matched = not include_re or _first_match(include_re, rel) >= 0
+            if matched and (flags & (WALK_DIRS if is_dir else WALK_FILES)):
+                results.append(rel)
+            if is_dir and not entry.is_symlink():
+                walk(entry.path, rel + "/")
+    
+    walk(str(root), "")
+    return results
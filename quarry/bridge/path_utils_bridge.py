@@ -3,6 +3,11 @@
 This module provides a Python interface to the Pyrite path_utils.pyrite module.
 The Pyrite module calls C functions for the core logic, and this bridge loads
 the shared library and provides Python wrappers.
+
+resolve_path_ffi follows symlinks like Path.resolve() and checks every
+component on each call, so relinked directories are seen immediately. The
+native side memoizes only lexical resolution (keyed by base or working
+directory); clear_path_cache() drops that memo.
 """
 
 import os
@@ -38,34 +43,45 @@ if USE_FFI:
             _lib = ctypes.CDLL(str(lib_path))
             
             # Define function signatures
-            _lib.is_absolute.argtypes = [
+            _lib.is_absolute_c.argtypes = [
                 ctypes.POINTER(ctypes.c_uint8), ctypes.c_int64,
                 ctypes.POINTER(ctypes.c_int32)
             ]
-            _lib.is_absolute.restype = ctypes.c_int32
+            _lib.is_absolute_c.restype = ctypes.c_int32
             
-            _lib.resolve_path.argtypes = [
+            _lib.resolve_path_c.argtypes = [
                 ctypes.POINTER(ctypes.c_uint8), ctypes.c_int64,
                 ctypes.POINTER(ctypes.c_uint8), ctypes.c_int64,
                 ctypes.POINTER(ctypes.c_uint8), ctypes.c_int64,
                 ctypes.POINTER(ctypes.c_int64)
             ]
-            _lib.resolve_path.restype = ctypes.c_int32
+            _lib.resolve_path_c.restype = ctypes.c_int32
             
-            _lib.join_paths.argtypes = [
+            _lib.canonicalize_path_c.argtypes = [
+                ctypes.POINTER(ctypes.c_uint8), ctypes.c_int64,
                 ctypes.POINTER(ctypes.c_uint8), ctypes.c_int64,
                 ctypes.POINTER(ctypes.c_uint8), ctypes.c_int64,
                 ctypes.POINTER(ctypes.c_int64)
             ]
-            _lib.join_paths.restype = ctypes.c_int32
+            _lib.canonicalize_path_c.restype = ctypes.c_int32
+            
+            _lib.path_canon_cache_clear.argtypes = []
+            _lib.path_canon_cache_clear.restype = None
             
-            _lib.relative_path.argtypes = [
+            _lib.join_paths_c.argtypes = [
+                ctypes.POINTER(ctypes.c_uint8), ctypes.c_int64,
+                ctypes.POINTER(ctypes.c_uint8), ctypes.c_int64,
+                ctypes.POINTER(ctypes.c_int64)
+            ]
+            _lib.join_paths_c.restype = ctypes.c_int32
+            
+            _lib.relative_path_c.argtypes = [
                 ctypes.POINTER(ctypes.c_uint8), ctypes.c_int64,
                 ctypes.POINTER(ctypes.c_uint8), ctypes.c_int64,
                 ctypes.POINTER(ctypes.c_uint8), ctypes.c_int64,
                 ctypes.POINTER(ctypes.c_int64)
             ]
-            _lib.relative_path.restype = ctypes.c_int32
+            _lib.relative_path_c.restype = ctypes.c_int32
         else:
             # Library not found, fall back to Python
             USE_FFI = False
@@ -82,7 +98,7 @@ def is_absolute_ffi(path: str) -> bool:
             path_bytes = path.encode('utf-8')
             path_arr = (ctypes.c_uint8 * len(path_bytes)).from_buffer_copy(path_bytes)
             result = ctypes.c_int32(0)
-            ret = _lib.is_absolute(path_arr, len(path_bytes), ctypes.byref(result))
+            ret = _lib.is_absolute_c(path_arr, len(path_bytes), ctypes.byref(result))
             if ret == 0:
                 return bool(result.value)
         except Exception:
@@ -109,7 +125,7 @@ def resolve_path_ffi(path: str, base: Optional[str] = None) -> str:
             result_buf = (ctypes.c_uint8 * result_cap)()
             result_len = ctypes.c_int64(0)
             
-            ret = _lib.resolve_path(
+            ret = _lib.canonicalize_path_c(
                 path_arr, len(path_bytes),
                 base_arr if base else None, len(base_bytes) if base else 0,
                 result_buf, result_cap,
@@ -132,6 +148,12 @@ def resolve_path_python(path: str, base: Optional[str] = None) -> str:
         return str(Path(path).resolve())
 
 
+def clear_path_cache() -> None:
+    """Drop the native resolution memo (no-op without FFI)"""
+    if USE_FFI and _lib:
+        _lib.path_canon_cache_clear()
+
+
 def join_paths_ffi(*parts: str) -> str:
     """Join path components using FFI"""
     if USE_FFI and _lib and len(parts) > 0:
@@ -144,7 +166,7 @@ def join_paths_ffi(*parts: str) -> str:
             result_buf = (ctypes.c_uint8 * result_cap)()
             result_len = ctypes.c_int64(0)
             
-            ret = _lib.join_paths(parts_arr, len(parts_bytes), result_buf, result_cap, ctypes.byref(result_len))
+            ret = _lib.join_paths_c(parts_arr, len(parts_bytes), result_buf, result_cap, ctypes.byref(result_len))
             
             if ret == 0:
                 result_bytes = bytes(result_buf[:result_len.value])
@@ -178,7 +200,7 @@ def relative_path_ffi(path: str, base: str) -> Optional[str]:
             result_buf = (ctypes.c_uint8 * result_cap)()
             result_len = ctypes.c_int64(0)
             
-            ret = _lib.relative_path(
+            ret = _lib.relative_path_c(
                 path_arr, len(path_bytes),
                 base_arr, len(base_bytes),
                 result_buf, result_cap,
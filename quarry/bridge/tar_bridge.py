@@ -0,0 +1,211 @@
+"""FFI Bridge for Pyrite tar module
+
+This module provides a Python interface to the Pyrite tar.pyrite module.
+The Pyrite module calls C functions for the core logic, and this bridge loads
+the shared library and provides Python wrappers.
+
+Tarballs are read once: the compressed bytes are hashed (SHA-256) while the
+decompressed stream is fed to the C extractor, whose writer threads create
+the files. The returned digest is the package checksum used by Quarry.lock.
+"""
+
+import copy
+import errno
+import os
+import sys
+import ctypes
+import hashlib
+import tarfile
+import zlib
+from pathlib import Path
+
+# Feature flags
+# Master flag: PYRITE_ACCELERATE enables all Pyrite acceleration features
+# Individual flag: PYRITE_USE_TAR_FFI (can override master flag if explicitly set)
+PYRITE_ACCELERATE = os.getenv("PYRITE_ACCELERATE", "").lower() in ("1", "true", "yes", "on")
+PYRITE_USE_TAR_FFI_EXPLICIT = "PYRITE_USE_TAR_FFI" in os.environ
+USE_FFI = PYRITE_USE_TAR_FFI_EXPLICIT and os.getenv("PYRITE_USE_TAR_FFI", "false").lower() == "true"
+USE_FFI = USE_FFI or (PYRITE_ACCELERATE and not PYRITE_USE_TAR_FFI_EXPLICIT)
+
+# Read size for streaming tarballs
+CHUNK_SIZE = 1 << 20
+
+# Try to load shared library
+_lib = None
+if USE_FFI:
+    try:
+        # Find library path (will be built during compilation)
+        compiler_dir = Path(__file__).parent.parent
+        lib_name = "tar"
+        if sys.platform == "win32":
+            lib_path = compiler_dir / "target" / f"{lib_name}.dll"
+        elif sys.platform == "darwin":
+            lib_path = compiler_dir / "target" / f"lib{lib_name}.dylib"
+        else:
+            lib_path = compiler_dir / "target" / f"lib{lib_name}.so"
+        
+        if lib_path.exists():
+            _lib = ctypes.CDLL(str(lib_path))
+            
+            # Define function signatures
+            _lib.tar_extractor_new.argtypes = [ctypes.c_char_p, ctypes.c_int32, ctypes.c_int32]
+            _lib.tar_extractor_new.restype = ctypes.c_void_p
+            
+            _lib.tar_extractor_feed.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_int64]
+            _lib.tar_extractor_feed.restype = ctypes.c_int32
+            
+            _lib.tar_extractor_finish.argtypes = [ctypes.c_void_p]
+            _lib.tar_extractor_finish.restype = ctypes.c_int64
+            
+            _lib.tar_extractor_free.argtypes = [ctypes.c_void_p]
+            _lib.tar_extractor_free.restype = None
+        else:
+            # Library not found, fall back to Python
+            USE_FFI = False
+    except Exception as e:
+        # FFI failed, fall back to Python
+        USE_FFI = False
+        print(f"Warning: Failed to load tar FFI library: {e}", file=sys.stderr)
+
+
+def _is_gzip(path: Path) -> bool:
+    with open(path, 'rb') as f:
+        return f.read(2) == b"\x1f\x8b"
+
+
+def extract_tarball_ffi(tarball: Path, dest: Path) -> str:
+    """Extract a .tar or .tar.gz into dest using FFI (parallel file writes)
+    
+    Returns:
+        Hex SHA-256 of the tarball file, computed in the same pass
+    
+    Raises:
+        RuntimeError: If the archive is malformed or contains unsafe paths.
+            The native rejection is final: there is no retry in Python, and
+            whatever was extracted is left for the caller to remove.
+    """
+    if USE_FFI and _lib:
+        return _extract_tarball_native(Path(tarball), Path(dest))
+    return extract_tarball_python(tarball, dest)
+
+
+def _extract_tarball_native(tarball: Path, dest: Path) -> str:
+    sha256 = hashlib.sha256()
+    inflater = zlib.decompressobj(wbits=31) if _is_gzip(tarball) else None
+    
+    handle = _lib.tar_extractor_new(os.fsencode(dest), 0, 0)
+    if not handle:
+        raise RuntimeError(f"Cannot create extraction directory: {dest}")
+    try:
+        ok = True
+        with open(tarball, 'rb') as f:
+            for chunk in iter(lambda: f.read(CHUNK_SIZE), b""):
+                sha256.update(chunk)
+                if not ok:
+                    continue
+                while inflater is not None and chunk:
+                    data = inflater.decompress(chunk)
+                    ok = ok and _lib.tar_extractor_feed(handle, data, len(data)) == 1
+                    # Concatenated gzip members: restart on the remainder
+                    chunk = inflater.unused_data
+                    if chunk:
+                        inflater = zlib.decompressobj(wbits=31)
+                if inflater is None:
+                    ok = _lib.tar_extractor_feed(handle, chunk, len(chunk)) == 1
+        if _lib.tar_extractor_finish(handle) < 0 or not ok:
+            raise RuntimeError(f"Invalid or unsafe tar archive: {tarball}")
+    except zlib.error as e:
+        raise RuntimeError(f"Corrupt gzip stream in {tarball}: {e}")
+    finally:
+        _lib.tar_extractor_free(handle)
+    return sha256.hexdigest()
+
+
+class _HashingReader:
+    """File wrapper that hashes everything read through it"""
+    
+    def __init__(self, f):
+        self.f = f
+        self.sha256 = hashlib.sha256()
+    
+    def read(self, size=-1):
+        data = self.f.read(size)
+        self.sha256.update(data)
+        return data
+
+
+def _within(root: str, path: str) -> bool:
+    return os.path.commonpath([root, path]) == root
+
+
+def _checked_member(member: tarfile.TarInfo, root: str) -> tarfile.TarInfo:
+    """Manual stand-in for tarfile's "data" filter on Pythons without it
+    
+    root is the realpath of the destination. Paths are resolved through what
+    is already on disk, so nothing is written through an earlier symlink that
+    leads outside root.
+    """
+    name = member.name
+    if os.path.isabs(name) or ".." in Path(name).parts:
+        raise RuntimeError(f"unsafe path {name!r}")
+    if not _within(root, os.path.realpath(os.path.join(root, name))):
+        raise RuntimeError(f"{name!r} would be written outside the destination")
+    if not (member.isreg() or member.isdir() or member.issym() or member.islnk()):
+        raise RuntimeError(f"{name!r} is a special file")
+    if member.issym():
+        target = os.path.join(root, os.path.dirname(name), member.linkname)
+        if os.path.isabs(member.linkname) or not _within(root, os.path.realpath(target)):
+            raise RuntimeError(f"symlink {name!r} points outside the destination")
+    if member.islnk():
+        target = os.path.join(root, member.linkname)
+        if os.path.isabs(member.linkname) or not _within(root, os.path.realpath(target)):
+            raise RuntimeError(f"hard link {name!r} points outside the destination")
+    member = copy.copy(member)
+    member.mode = (member.mode & 0o755) | (0o700 if member.isdir() else 0o600)
+    if hasattr(os, "getuid"):
+        member.uid, member.gid = os.getuid(), os.getgid()
+    member.uname = member.gname = ""
+    return member
+
+
+def _check_symlinks_contained(root: str) -> None:
+    """Every symlink under root must resolve inside it once all exist
+    
+    Per-member checks cannot see a later link changing what an earlier one
+    resolves to (d -> ".", then e -> "d/d/d/.." extracted before d). Link
+    loops are refused as well, like the native extractor does.
+    """
+    for dirpath, dirnames, filenames in os.walk(root):
+        for name in dirnames + filenames:
+            path = os.path.join(dirpath, name)
+            if not os.path.islink(path):
+                continue
+            if not _within(root, os.path.realpath(path)):
+                raise RuntimeError(f"symlink {os.path.relpath(path, root)!r} points outside the destination")
+            try:
+                os.stat(path)
+            except OSError as e:
+                if e.errno == errno.ELOOP:
+                    raise RuntimeError(f"symlink {os.path.relpath(path, root)!r} is a loop")
+
+
+def extract_tarball_python(tarball: Path, dest: Path) -> str:
+    """Python fallback implementation"""
+    Path(dest).mkdir(parents=True, exist_ok=True)
+    root = os.path.realpath(dest)
+    with open(tarball, 'rb') as f:
+        reader = _HashingReader(f)
+        try:
+            with tarfile.open(fileobj=reader, mode="r|*") as archive:
+                if hasattr(tarfile, "data_filter"):
+                    archive.extractall(dest, filter="data")
+                else:
+                    for member in archive:
+                        archive.extract(_checked_member(member, root), dest)
+            _check_symlinks_contained(root)
+        except (tarfile.TarError, OSError, zlib.error, RuntimeError) as e:
+            raise RuntimeError(f"Invalid or unsafe tar archive: {tarball}: {e}")
+        # Hash any trailing padding the tar reader did not consume
+        while reader.read(CHUNK_SIZE):
+            pass
+    return reader.sha256.hexdigest()
@@ -7,10 +7,26 @@ from typing import Optional
 
 # Import path_utils bridge (FFI to Pyrite implementation)
 try:
-    from .bridge.path_utils_bridge import resolve_path_ffi
+    from .bridge.path_utils_bridge import resolve_path_ffi, clear_path_cache
 except ImportError:
     # Fallback to local implementation if bridge not available
-    pass
+    def clear_path_cache():
+        pass
+
+# Import file bridge (FFI to Pyrite file module: reflink / in-kernel tree copy)
+try:
+    from .bridge.file_bridge import copy_tree_ffi
+except ImportError:
+    import shutil
+
+    def copy_tree_ffi(src, dst):
+        shutil.copytree(src, dst, symlinks=True)
+
+# Import tar bridge (FFI to Pyrite tar module: streaming, parallel extraction)
+try:
+    from .bridge.tar_bridge import extract_tarball_ffi
+except ImportError:
+    extract_tarball_ffi = None
 
 # Import DependencySource (handle both relative and absolute imports)
 try:
@@ -235,16 +251,54 @@ def install_path_dependency(name: str, path: str, deps_dir: Path = None) -> Path
             shutil.rmtree(target_dir)
     
     # Try to create symlink (works on Unix and Windows with admin rights)
+    # deps/<name> may have pointed elsewhere; drop memoized resolutions
     try:
         target_dir.symlink_to(source_path, target_is_directory=True)
+        clear_path_cache()
         return target_dir
     except (OSError, NotImplementedError):
         # Symlink failed, fall back to copying
-        import shutil
-        shutil.copytree(source_path, target_dir)
+        copy_tree_ffi(source_path, target_dir)
+        clear_path_cache()
         return target_dir
 
 
+def install_registry_tarball(name: str, version: str, tarball: Path, target_dir: Path, expected_checksum: Optional[str] = None) -> Path:
+    """Install a registry package from a .tar / .tar.gz archive
+    
+    The archive is hashed while it is extracted, so the checksum (which for
+    packed packages is the SHA-256 of the tarball) costs no extra read.
+    
+    Raises:
+        RuntimeError: If extraction fails or the checksum does not match
+    """
+    import shutil
+    
+    try:
+        actual_hex = extract_tarball_ffi(tarball, target_dir)
+    except RuntimeError:
+        if target_dir.exists():
+            shutil.rmtree(target_dir)
+        raise
+    
+    if expected_checksum:
+        expected_hex = expected_checksum[7:] if expected_checksum.startswith("sha256:") else expected_checksum
+        if actual_hex.lower() != expected_hex.lower():
+            shutil.rmtree(target_dir)
+            raise RuntimeError(f"Checksum mismatch for package '{name}' version '{version}'")
+    
+    # Tarballs usually wrap the package in a single top-level directory
+    if not (target_dir / "Quarry.toml").exists():
+        children = list(target_dir.iterdir())
+        if len(children) == 1 and (children[0] / "Quarry.toml").exists():
+            wrapper = target_dir.with_name(target_dir.name + ".extract")
+            target_dir.rename(wrapper)
+            (wrapper / children[0].name).rename(target_dir)
+            shutil.rmtree(wrapper)
+    
+    return target_dir
+
+
 def install_registry_dependency(name: str, version: str, cache_dir: Path = None, deps_dir: Path = None, expected_checksum: Optional[str] = None) -> Path:
     """Install a registry dependency from cache or mock registry
     
@@ -307,6 +361,11 @@ def install_registry_dependency(name: str, version: str, cache_dir: Path = None,
                     if registry_package_path.exists() and (registry_package_path / "Quarry.toml").exists():
                         package_cache = registry_package_path
                     else:
+                        # Packed registry package: extract and verify in one pass
+                        from .registry import get_package_path
+                        tarball = get_package_path(name, version)
+                        if tarball is not None and tarball.is_file() and extract_tarball_ffi is not None:
+                            return install_registry_tarball(name, version, tarball, target_dir, expected_checksum)
                         raise RuntimeError(f"Package '{name}' version '{version}' not found in registry cache or registry")
                 except (ImportError, AttributeError):
                     # Registry module not available, but we already checked home/local
@@ -315,7 +374,7 @@ def install_registry_dependency(name: str, version: str, cache_dir: Path = None,
     
     # Copy package to deps directory
     import shutil
-    shutil.copytree(package_cache, target_dir)
+    copy_tree_ffi(package_cache, target_dir)
     
     # Verify checksum if expected_checksum is provided
     if expected_checksum:
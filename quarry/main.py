@@ -5,6 +5,7 @@ import os
 import json
 import subprocess
 from pathlib import Path
+from typing import Optional, Set
 
 # Set up path to forge before any other imports
 # This allows quarry modules to import from forge/src
@@ -19,6 +20,12 @@ try:
 except ImportError:
     IncrementalCompiler = None
 
+# Import file watcher for watch-mode builds
+try:
+    from src.utils.file_watch import FileWatcher
+except ImportError:
+    FileWatcher = None
+
 # Import version bridge (FFI to Pyrite implementation)
 try:
     from .bridge.version_bridge import _compare_versions, _version_satisfies_constraint
@@ -191,7 +198,7 @@ quarry run
     print(f"\nProject created successfully!")
 
 
-def cmd_build(release: bool = False, incremental: bool = True, deterministic: bool = False, locked: bool = False, dogfood: bool = False):
+def cmd_build(release: bool = False, incremental: bool = True, deterministic: bool = False, locked: bool = False, dogfood: bool = False, watched_changes: Optional[Set[str]] = None):
     """Build the current project
     
     Args:
@@ -200,6 +207,8 @@ def cmd_build(release: bool = False, incremental: bool = True, deterministic: bo
         deterministic: Enable deterministic builds (default: False)
         locked: Require Quarry.lock to match Quarry.toml (default: False)
         dogfood: Build predefined sample workspaces for dogfood validation (default: False)
+        watched_changes: Paths a FileWatcher saw change since the previous
+            build (see cmd_build_watch); None rehashes every source
     """
     # If --dogfood flag is set, build predefined workspaces
     if dogfood:
@@ -395,6 +404,7 @@ def cmd_build(release: bool = False, incremental: bool = True, deterministic: bo
                 
                 inc_compiler = IncrementalCompiler(cache_dir)
                 inc_compiler.load_cache_metadata()
+                inc_compiler.set_watched_changes(watched_changes)
                 
                 # Check each package in build order
                 all_cached = True
@@ -427,6 +437,7 @@ def cmd_build(release: bool = False, incremental: bool = True, deterministic: bo
                 
                 inc_compiler = IncrementalCompiler(cache_dir)
                 inc_compiler.load_cache_metadata()
+                inc_compiler.set_watched_changes(watched_changes)
                 
                 should_compile, reason = inc_compiler.should_recompile(str(entry_file))
                 
@@ -551,6 +562,55 @@ def cmd_build(release: bool = False, incremental: bool = True, deterministic: bo
     return 0
 
 
+# Build outputs and caches; changes under these never trigger a rebuild
+WATCH_IGNORED_DIRS = {"target", ".pyrite", ".quarry", ".git"}
+
+
+def _watched_source_changes(changes: Set[str], root: Path) -> Set[str]:
+    """Drop paths under the build's own output and cache directories"""
+    relevant = set()
+    for path in changes:
+        try:
+            parts = Path(path).relative_to(root).parts
+        except ValueError:
+            continue
+        if parts and parts[0] not in WATCH_IGNORED_DIRS:
+            relevant.add(path)
+    return relevant
+
+
+def cmd_build_watch(release: bool = False, incremental: bool = True, deterministic: bool = False, locked: bool = False):
+    """Build, then rebuild every time a project file changes (quarry build --watch)
+    
+    One FileWatcher stays open on the project root for the whole session. Each
+    rebuild gets the paths it reported since the previous build started, so
+    the incremental check only rehashes those; the set is taken fresh for
+    every build and never carried over.
+    """
+    watcher = FileWatcher(Path(".")) if FileWatcher is not None else None
+    if watcher is None or not watcher.available:
+        print("Error: --watch needs the runtime file watcher (Linux, PYRITE_USE_WATCH_FFI=true)")
+        return 1
+    
+    # First build: nothing has been watched yet, so every source is hashed
+    changes = None
+    try:
+        with watcher:
+            while True:
+                cmd_build(release, incremental=incremental, deterministic=deterministic,
+                          locked=locked, watched_changes=changes)
+                print("   Watching for changes (Ctrl-C to stop)...")
+                changes = set()
+                while not changes:
+                    if watcher.wait() < 0:
+                        print("Error: file watcher failed")
+                        return 1
+                    # Includes edits made while the previous build was running
+                    changes = _watched_source_changes(watcher.take_changes(), watcher.root)
+    except KeyboardInterrupt:
+        return 0
+
+
 def cmd_run():
     """Build and run the project"""
     # Build first
@@ -1283,6 +1343,7 @@ Usage:
     quarry build            Build the project
     quarry build --release  Build in release mode
     quarry build --dogfood  Build predefined sample workspaces for validation
+    quarry build --watch    Rebuild whenever a project file changes
     quarry run              Build and run the project
     quarry clean            Remove build artifacts
     quarry test             Run tests
@@ -1342,6 +1403,8 @@ def main():
         incremental = "--no-incremental" not in sys.argv  # Default to True, disable with flag
         locked = "--locked" in sys.argv
         dogfood = "--dogfood" in sys.argv
+        if "--watch" in sys.argv:
+            return cmd_build_watch(release, incremental=incremental, deterministic=deterministic, locked=locked)
         return cmd_build(release, incremental=incremental, deterministic=deterministic, locked=locked, dogfood=dogfood)
     
     elif command == "run":
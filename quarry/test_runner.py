@@ -5,6 +5,13 @@ import subprocess
 from pathlib import Path
 from typing import List, Tuple
 
+# Import glob bridge (FFI to Pyrite implementation)
+try:
+    from .bridge.glob_bridge import glob_files_ffi
+except ImportError:
+    # Fallback to local implementation if bridge not available
+    pass
+
 
 class TestResult:
     """Result of running a test"""
@@ -28,8 +35,12 @@ class TestRunner:
             return []
         
         # Find all .pyrite files in tests/
-        test_files = [f for f in self.tests_dir.rglob("*.pyrite") if f.is_file()]
-        return test_files
+        try:
+            glob_files_ffi  # Check if imported
+            return [self.tests_dir / rel for rel in glob_files_ffi(self.tests_dir, ["**/*.pyrite"])]
+        except NameError:
+            # Python fallback
+            return [f for f in self.tests_dir.rglob("*.pyrite") if f.is_file()]
     
     def extract_test_functions(self, source: str) -> List[str]:
         """Extract function names marked with @test"""
@@ -11,6 +11,13 @@ except ImportError:
     # Fallback to local implementation if bridge not available
     pass
 
+# Import glob bridge (FFI to Pyrite implementation)
+try:
+    from .bridge.glob_bridge import glob_files_ffi, WALK_DIRS
+except ImportError:
+    # Fallback to local implementation if bridge not available
+    pass
+
 # Try to import TOML parser
 try:
     import tomllib  # Python 3.11+
@@ -139,8 +146,21 @@ def get_workspace_packages(workspace_root: Path) -> List[Path]:
     """
     members = parse_workspace_toml(str(workspace_root / "Workspace.toml"))
     
-    packages = []
+    # Glob members ("crates/*") expand to the matching directories
+    expanded = []
     for member in members:
+        if any(c in member for c in "*?[{"):
+            try:
+                glob_files_ffi  # Check if imported
+                expanded.extend(glob_files_ffi(workspace_root, [member], ["**/.*", "**/target"], WALK_DIRS))
+            except NameError:
+                # Python fallback
+                expanded.extend(str(p.relative_to(workspace_root)) for p in sorted(workspace_root.glob(member)) if p.is_dir())
+        else:
+            expanded.append(member)
+    
+    packages = []
+    for member in expanded:
         # Resolve member path relative to workspace root
         try:
             join_paths_ffi  # Check if imported
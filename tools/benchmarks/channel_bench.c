@@ -0,0 +1,154 @@
+/* Cross-process message rate benchmark for pyrite/net/channel.c
+ *
+ * P forked producers each send N messages of S bytes to the parent, which
+ * checks every message (per-producer sequence numbers and payload) as it
+ * consumes it. "chan" goes through a shared-memory channel (MPSC, or SPSC
+ * with one producer) without copying: producers build messages in place
+ * with chan_reserve/chan_commit and the parent reads them with
+ * chan_peek/chan_release. "unix" sends the same messages over a Unix
+ * datagram socketpair for comparison.
+ *
+ * Build and run through channel_bench.py, or by hand:
+ *   cc -O2 tools/benchmarks/channel_bench.c pyrite/net/channel.c \
+ *      pyrite/net/socket.c -o channel_bench
+ *   ./channel_bench chan 1 5000000 64 4194304
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define CHAN_SPSC 1
+#define UNIX_DATAGRAM 2
+
+extern void* chan_create(int64_t capacity, int32_t flags);
+extern char* chan_reserve(void* chan, int64_t len, int32_t timeout_ms);
+extern int32_t chan_commit(void* chan, char* slot, int64_t len);
+extern char* chan_peek(void* chan, int64_t* len, int32_t timeout_ms);
+extern int32_t chan_release(void* chan);
+extern int32_t chan_shutdown(void* chan);
+extern void chan_close(void* chan);
+extern int64_t unix_socketpair(int32_t type, int32_t flags, int64_t* other);
+extern int32_t tcp_send(int64_t sock, const char* data, int64_t len);
+extern int32_t tcp_recv(int64_t sock, char* buf, int64_t len);
+extern void tcp_close(int64_t sock);
+
+#define MAX_PRODUCERS 64
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int fail(const char* what, long long detail) {
+    printf("FAILED: %s (%lld)\n", what, detail);
+    return 1;
+}
+
+/* Message: u32 producer, u32 padding, u64 sequence, then the sequence's low byte */
+static void fill(char* msg, int64_t size, uint32_t producer, uint64_t seq) {
+    memcpy(msg, &producer, 4);
+    memset(msg + 4, 0, 4);
+    memcpy(msg + 8, &seq, 8);
+    memset(msg + 16, (int)(seq & 0xff), (size_t)(size - 16));
+}
+
+static int check(const char* msg, int64_t len, int64_t size, uint64_t* next, int32_t producers) {
+    uint32_t producer;
+    uint64_t seq;
+    if (len != size) return fail("wrong length", len);
+    memcpy(&producer, msg, 4);
+    memcpy(&seq, msg + 8, 8);
+    if ((int32_t)producer >= producers) return fail("bad producer", producer);
+    if (seq != next[producer]) return fail("out of order", (long long)seq);
+    if (size > 16 && (msg[16] != (char)seq || msg[size - 1] != (char)seq)) return fail("corrupt payload", (long long)seq);
+    next[producer]++;
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 6) {
+        fprintf(stderr, "usage: %s chan|unix producers messages size capacity\n", argv[0]);
+        return 2;
+    }
+    int use_chan = strcmp(argv[1], "chan") == 0;
+    int32_t producers = atoi(argv[2]);
+    long long messages = atoll(argv[3]);
+    int64_t size = atoll(argv[4]);
+    int64_t capacity = atoll(argv[5]);
+    if (producers < 1 || producers > MAX_PRODUCERS || messages < 1 || size < 16 || size > 65536) {
+        return fail("bad arguments", 0);
+    }
+
+    void* chan = NULL;
+    int64_t sock = -1, peer = -1;
+    if (use_chan) {
+        chan = chan_create(capacity, producers == 1 ? CHAN_SPSC : 0);
+        if (!chan) return fail("chan_create", errno);
+    } else {
+        sock = unix_socketpair(UNIX_DATAGRAM, 0, &peer);
+        if (sock < 0) return fail("unix_socketpair", errno);
+    }
+
+    double start = now_seconds();
+    for (int32_t p = 0; p < producers; p++) {
+        pid_t pid = fork();
+        if (pid < 0) return fail("fork", errno);
+        if (pid > 0) continue;
+        /* Producer: the channel mapping and the socket are inherited */
+        char* msg = (char*)malloc((size_t)size);
+        for (long long seq = 0; seq < messages; seq++) {
+            if (use_chan) {
+                char* slot = chan_reserve(chan, size, -1);
+                if (!slot) _exit(1);
+                fill(slot, size, (uint32_t)p, (uint64_t)seq);
+                chan_commit(chan, slot, size);
+            } else {
+                fill(msg, size, (uint32_t)p, (uint64_t)seq);
+                if (tcp_send(peer, msg, size) != size) _exit(1);
+            }
+        }
+        _exit(0);
+    }
+
+    uint64_t next[MAX_PRODUCERS] = {0};
+    long long total = messages * producers;
+    char* buf = (char*)malloc((size_t)size);
+    for (long long received = 0; received < total; received++) {
+        if (use_chan) {
+            int64_t len = 0;
+            char* msg = chan_peek(chan, &len, 10000);
+            if (!msg) return fail("chan_peek", errno);
+            if (check(msg, len, size, next, producers)) return 1;
+            chan_release(chan);
+        } else {
+            int32_t len = tcp_recv(sock, buf, size);
+            if (len < 0) return fail("recv", errno);
+            if (check(buf, len, size, next, producers)) return 1;
+        }
+    }
+    double elapsed = now_seconds() - start;
+
+    for (int32_t p = 0; p < producers; p++) {
+        int status = 0;
+        if (wait(&status) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) return fail("producer", p);
+    }
+    printf("%-4s producers=%d messages=%lld size=%lld capacity=%lld: %.3fs, %.2f M msg/s, %.1f MiB/s\n",
+           use_chan ? "chan" : "unix", producers, messages, (long long)size, (long long)capacity, elapsed,
+           (double)total / elapsed / 1e6, (double)total * (double)size / elapsed / (1024.0 * 1024.0));
+    if (use_chan) {
+        chan_shutdown(chan);
+        chan_close(chan);
+    } else {
+        tcp_close(sock);
+        tcp_close(peer);
+    }
+    free(buf);
+    return 0;
+}
@@ -0,0 +1,81 @@
+#!/usr/bin/env python3
+"""
+Cross-process message rate benchmark for the shared-memory channel.
+Builds channel_bench.c against pyrite/net with the system C compiler and
+runs each workload through a channel and, for comparison, a Unix datagram
+socketpair.
+
+Usage:
+    python tools/benchmarks/channel_bench.py
+    python tools/benchmarks/channel_bench.py --producers=4 --messages=1000000 --size=128
+"""
+
+import argparse
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+from pathlib import Path
+
+
+REPO_ROOT = Path(__file__).resolve().parent.parent.parent
+SOURCES = [
+    REPO_ROOT / "tools" / "benchmarks" / "channel_bench.c",
+    REPO_ROOT / "pyrite" / "net" / "channel.c",
+    REPO_ROOT / "pyrite" / "net" / "socket.c",
+]
+
+# (producers, messages per producer, message size, ring capacity)
+DEFAULT_WORKLOADS = [
+    (1, 5000000, 64, 4 * 1024 * 1024),
+    (4, 1000000, 64, 4 * 1024 * 1024),
+    (1, 200000, 16384, 16 * 1024 * 1024),
+]
+
+
+def build(output: Path) -> None:
+    """Compile the benchmark driver together with the channel sources"""
+    compiler = os.environ.get("CC") or shutil.which("cc") or shutil.which("gcc")
+    if not compiler:
+        print("Error: no C compiler found (set CC)")
+        sys.exit(1)
+    cmd = [compiler, "-O2", *[str(s) for s in SOURCES], "-o", str(output)]
+    result = subprocess.run(cmd, capture_output=True, text=True)
+    if result.returncode != 0:
+        print(result.stderr)
+        print("Error: build failed")
+        sys.exit(1)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Shared-memory channel benchmark")
+    parser.add_argument("--producers", type=int, help="Producer processes (with --messages and --size)")
+    parser.add_argument("--messages", type=int, default=1000000, help="Messages per producer")
+    parser.add_argument("--size", type=int, default=64, help="Message size in bytes (16-65536)")
+    parser.add_argument("--capacity", type=int, default=4 * 1024 * 1024, help="Ring capacity in bytes")
+    parser.add_argument("--transport", choices=["chan", "unix", "both"], default="both")
+    args = parser.parse_args()
+
+    if args.producers:
+        workloads = [(args.producers, args.messages, args.size, args.capacity)]
+    else:
+        workloads = DEFAULT_WORKLOADS
+    transports = ["chan", "unix"] if args.transport == "both" else [args.transport]
+
+    with tempfile.TemporaryDirectory() as tmp:
+        binary = Path(tmp) / "channel_bench"
+        build(binary)
+        failed = False
+        for producers, messages, size, capacity in workloads:
+            for transport in transports:
+                result = subprocess.run(
+                    [str(binary), transport, str(producers), str(messages), str(size), str(capacity)],
+                    capture_output=True, text=True)
+                print((result.stdout or result.stderr).strip())
+                failed = failed or result.returncode != 0
+        sys.exit(1 if failed else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,180 @@
+/* Loopback load generator for the Pyrite HTTP engine (pyrite/net/http.c)
+ *
+ * A server thread answers every request, either with a small fixed body
+ * ("hello") or with a file of the given size through
+ * http_server_serve_static (sendfile). Client threads each keep one
+ * connection and send requests in batches of `depth` (depth > 1 pipelines
+ * them), checking every response status and body length.
+ *
+ * Build and run through http_bench.py, or by hand:
+ *   cc -O2 tools/benchmarks/http_bench.c pyrite/net/http.c \
+ *      pyrite/net/reactor.c pyrite/net/socket.c -lpthread -o http_bench
+ *   ./http_bench 4 20000 16 0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+
+typedef struct {
+    char* data;
+    int64_t len;
+} String;
+
+extern void* http_server_new(const char* address, int32_t port, int32_t flags);
+extern int32_t http_server_port(void* server);
+extern int32_t http_server_poll(void* server, int32_t timeout_ms);
+extern int64_t http_server_request_id(void* server, int32_t index);
+extern void* http_server_request(void* server, int64_t id);
+extern int32_t http_server_respond(void* server, int64_t id, int32_t status, const char* headers, int64_t headers_len,
+                                   const char* body, int64_t body_len);
+extern int32_t http_server_serve_static(void* server, int64_t id, const char* root);
+extern void http_server_free(void* server);
+extern void* http_client_connect(const char* address, int32_t port);
+extern int32_t http_client_send(void* client, const char* method, const char* target, const char* headers,
+                                int64_t headers_len, const char* body, int64_t body_len);
+extern void* http_client_response(void* client, int32_t timeout_ms);
+extern void http_client_close(void* client);
+extern int32_t http_message_status(void* msg);
+extern String http_message_target(void* msg);
+extern String http_message_body(void* msg);
+
+static const char* static_root;
+static volatile int stopping;
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void* run_server(void* server) {
+    static const char headers[] = "Content-Type: text/plain\r\n";
+    while (!stopping) {
+        int32_t n = http_server_poll(server, 20);
+        for (int32_t i = 0; i < n; i++) {
+            int64_t id = http_server_request_id(server, i);
+            String target = http_message_target(http_server_request(server, id));
+            if (static_root && target.len > 1) {
+                http_server_serve_static(server, id, static_root);
+            } else {
+                http_server_respond(server, id, 200, headers, sizeof(headers) - 1, "hello", 5);
+            }
+        }
+    }
+    return NULL;
+}
+
+typedef struct {
+    int32_t port;
+    int64_t requests;
+    int32_t depth;
+    int64_t body_size;      /* Expected body length */
+    int64_t bytes;
+    int32_t failed;
+} Client;
+
+static void* run_client(void* arg) {
+    Client* c = (Client*)arg;
+    void* client = http_client_connect("127.0.0.1", c->port);
+    if (!client) {
+        c->failed = 1;
+        return NULL;
+    }
+    const char* target = static_root ? "/payload.bin" : "/";
+    for (int64_t done = 0; done < c->requests && !c->failed;) {
+        int32_t batch = c->requests - done < c->depth ? (int32_t)(c->requests - done) : c->depth;
+        for (int32_t i = 0; i < batch; i++) {
+            if (http_client_send(client, "GET", target, NULL, 0, NULL, 0) != 0) c->failed = 1;
+        }
+        for (int32_t i = 0; i < batch && !c->failed; i++) {
+            void* response = http_client_response(client, 10000);
+            if (!response || http_message_status(response) != 200 ||
+                http_message_body(response).len != c->body_size) {
+                c->failed = 1;
+                break;
+            }
+            c->bytes += c->body_size;
+        }
+        done += batch;
+    }
+    http_client_close(client);
+    return NULL;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 5) {
+        fprintf(stderr, "usage: %s <clients> <requests per client> <pipeline depth> <file size, 0 = small body>\n",
+                argv[0]);
+        return 2;
+    }
+    int32_t clients = atoi(argv[1]);
+    int64_t requests = atoll(argv[2]);
+    int32_t depth = atoi(argv[3]);
+    int64_t file_size = atoll(argv[4]);
+    if (clients <= 0 || requests <= 0 || depth <= 0 || file_size < 0) return 2;
+
+    char root[] = "/tmp/http_bench_XXXXXX";
+    if (file_size > 0) {
+        if (!mkdtemp(root)) return 1;
+        char path[64];
+        snprintf(path, sizeof(path), "%s/payload.bin", root);
+        FILE* f = fopen(path, "wb");
+        if (!f) return 1;
+        char block[4096];
+        memset(block, 'x', sizeof(block));
+        for (int64_t left = file_size; left > 0; left -= (int64_t)sizeof(block)) {
+            fwrite(block, 1, left < (int64_t)sizeof(block) ? (size_t)left : sizeof(block), f);
+        }
+        fclose(f);
+        static_root = root;
+    }
+
+    void* server = http_server_new("127.0.0.1", 0, 0);
+    if (!server) {
+        perror("http_server_new");
+        return 1;
+    }
+    pthread_t server_thread;
+    pthread_create(&server_thread, NULL, run_server, server);
+
+    Client* table = calloc((size_t)clients, sizeof(Client));
+    pthread_t* threads = calloc((size_t)clients, sizeof(pthread_t));
+    double start = now_seconds();
+    for (int32_t i = 0; i < clients; i++) {
+        table[i].port = http_server_port(server);
+        table[i].requests = requests;
+        table[i].depth = depth;
+        table[i].body_size = file_size > 0 ? file_size : 5;
+        pthread_create(&threads[i], NULL, run_client, &table[i]);
+    }
+    int32_t failed = 0;
+    int64_t bytes = 0;
+    for (int32_t i = 0; i < clients; i++) {
+        pthread_join(threads[i], NULL);
+        failed |= table[i].failed;
+        bytes += table[i].bytes;
+    }
+    double elapsed = now_seconds() - start;
+    stopping = 1;
+    pthread_join(server_thread, NULL);
+    http_server_free(server);
+
+    if (file_size > 0) {
+        char path[64];
+        snprintf(path, sizeof(path), "%s/payload.bin", root);
+        unlink(path);
+        rmdir(root);
+    }
+    double total = (double)clients * (double)requests;
+    printf("clients=%d requests=%lld depth=%d %s: %.3fs, %.0f req/s, %.1f MiB/s%s\n", clients,
+           (long long)requests, depth, file_size > 0 ? "static" : "small", elapsed, total / elapsed,
+           (double)bytes / elapsed / (1024.0 * 1024.0), failed ? " FAILED" : "");
+    free(table);
+    free(threads);
+    return failed ? 1 : 0;
+}
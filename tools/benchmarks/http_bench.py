@@ -0,0 +1,80 @@
+#!/usr/bin/env python3
+"""
+Loopback load benchmark for the HTTP engine (pyrite/net/http.c).
+Builds http_bench.c against pyrite/net with the system C compiler and runs
+small-response workloads with and without pipelining, plus sendfile-backed
+static file serving.
+
+Usage:
+    python tools/benchmarks/http_bench.py
+    python tools/benchmarks/http_bench.py --clients=8 --requests=50000 --depth=32
+    python tools/benchmarks/http_bench.py --clients=4 --requests=200 --file-size=4194304
+"""
+
+import argparse
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+from pathlib import Path
+
+
+REPO_ROOT = Path(__file__).resolve().parent.parent.parent
+SOURCES = [
+    REPO_ROOT / "tools" / "benchmarks" / "http_bench.c",
+    REPO_ROOT / "pyrite" / "net" / "http.c",
+    REPO_ROOT / "pyrite" / "net" / "reactor.c",
+    REPO_ROOT / "pyrite" / "net" / "socket.c",
+]
+
+# (clients, requests per client, pipeline depth, file size; 0 = small body)
+DEFAULT_WORKLOADS = [
+    (4, 20000, 1, 0),
+    (4, 20000, 16, 0),
+    (64, 1000, 1, 0),
+    (4, 200, 1, 4 * 1024 * 1024),
+]
+
+
+def build(output: Path) -> None:
+    """Compile the load generator together with the HTTP engine sources"""
+    compiler = os.environ.get("CC") or shutil.which("cc") or shutil.which("gcc")
+    if not compiler:
+        print("Error: no C compiler found (set CC)")
+        sys.exit(1)
+    cmd = [compiler, "-O2", *[str(s) for s in SOURCES], "-lpthread", "-o", str(output)]
+    result = subprocess.run(cmd, capture_output=True, text=True)
+    if result.returncode != 0:
+        print(result.stderr)
+        print("Error: build failed")
+        sys.exit(1)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="HTTP engine loopback benchmark")
+    parser.add_argument("--clients", type=int, help="Client connections (with --requests etc.)")
+    parser.add_argument("--requests", type=int, default=10000, help="Requests per client")
+    parser.add_argument("--depth", type=int, default=1, help="Requests pipelined per batch")
+    parser.add_argument("--file-size", type=int, default=0, help="Serve a static file of this size")
+    args = parser.parse_args()
+
+    if args.clients:
+        workloads = [(args.clients, args.requests, args.depth, args.file_size)]
+    else:
+        workloads = DEFAULT_WORKLOADS
+
+    with tempfile.TemporaryDirectory() as tmp:
+        binary = Path(tmp) / "http_bench"
+        build(binary)
+        failed = False
+        for clients, requests, depth, file_size in workloads:
+            result = subprocess.run([str(binary), str(clients), str(requests), str(depth), str(file_size)],
+                                    capture_output=True, text=True)
+            print((result.stdout or result.stderr).strip())
+            failed = failed or result.returncode != 0
+        sys.exit(1 if failed else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,215 @@
+/* Loopback echo benchmark for the Pyrite network engine (pyrite/net/engine.c)
+ *
+ * One thread, one engine: N client connections each send a message, wait for
+ * the server side (same engine) to echo it back, verify it and repeat M times.
+ * Client messages go out as two linked halves (zero-copy from 16 KiB), so
+ * the run exercises multishot accept/recv, the buffer pool, send chains and
+ * cancellation on whichever backend is selected.
+ *
+ * Build and run through net_engine_bench.py, or by hand:
+ *   cc -O2 tools/benchmarks/net_engine_bench.c pyrite/net/engine.c \
+ *      pyrite/net/reactor.c pyrite/net/socket.c -o net_engine_bench
+ *   ./net_engine_bench uring 256 2000 4096
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#define NET_BACKEND_EPOLL 1
+#define NET_BACKEND_URING 2
+#define NET_ENGINE_FORCE_EPOLL 1
+#define NET_OP_ACCEPT 1
+#define NET_OP_RECV 2
+#define NET_OP_SEND 3
+#define NET_SEND_LINK 1
+#define NET_SEND_ZC 2
+#define NET_CQE_MORE 1
+#define TCP_LISTEN_REUSEADDR 1
+
+extern void* net_engine_new(int32_t buffer_count, int32_t buffer_size, int32_t flags);
+extern int32_t net_engine_backend(void* engine);
+extern int32_t net_engine_has_zero_copy(void* engine);
+extern int32_t net_engine_accept(void* engine, int64_t listener, int64_t token);
+extern int32_t net_engine_recv(void* engine, int64_t sock, int64_t token);
+extern int32_t net_engine_send(void* engine, int64_t sock, const char* data, int64_t len, int64_t token, int32_t flags);
+extern int32_t net_engine_cancel(void* engine, int64_t sock);
+extern int32_t net_engine_poll(void* engine, int32_t timeout_ms);
+extern int64_t net_engine_completion_token(void* engine, int32_t index);
+extern int32_t net_engine_completion_kind(void* engine, int32_t index);
+extern int64_t net_engine_completion_result(void* engine, int32_t index);
+extern int32_t net_engine_completion_flags(void* engine, int32_t index);
+extern const char* net_engine_completion_data(void* engine, int32_t index);
+extern void net_engine_free(void* engine);
+extern int64_t tcp_listen(const char* address, int32_t port, int32_t backlog, int32_t flags);
+extern int32_t tcp_local_port(int64_t sock);
+extern int64_t tcp_connect(const char* address, int32_t port);
+extern int32_t tcp_set_nonblocking(int64_t sock, int32_t enabled);
+extern void tcp_close(int64_t sock);
+
+/* Token = connection index << 2 | role */
+#define ROLE_LISTENER 0
+#define ROLE_SERVER 1
+#define ROLE_CLIENT 2
+
+typedef struct {
+    int64_t client;
+    int64_t server;
+    char* echo;         /* Server side: message being collected / echoed */
+    int64_t echo_len;
+    int64_t received;   /* Client side: bytes of the current echo */
+    int64_t rounds;
+    int32_t sends_pending;
+} Conn;
+
+/* Messages go out as two sends: keep Nagle from holding the second half */
+static void set_nodelay(int64_t sock) {
+    int one = 1;
+    setsockopt((int)sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int fail(const char* what, int64_t value) {
+    fprintf(stderr, "net_engine_bench: %s (%lld)\n", what, (long long)value);
+    return 1;
+}
+
+int main(int argc, char** argv) {
+    const char* backend = argc > 1 ? argv[1] : "uring";
+    int32_t conns = argc > 2 ? atoi(argv[2]) : 64;
+    int64_t rounds = argc > 3 ? atoll(argv[3]) : 1000;
+    int64_t size = argc > 4 ? atoll(argv[4]) : 1024;
+    if (conns <= 0 || rounds <= 0 || size < 2) return fail("bad arguments", 0);
+
+    void* engine = net_engine_new(0, 0, strcmp(backend, "epoll") == 0 ? NET_ENGINE_FORCE_EPOLL : 0);
+    if (!engine) return fail("net_engine_new failed", 0);
+    int32_t actual = net_engine_backend(engine);
+    int32_t send_flags = NET_SEND_LINK | (size / 2 >= 16384 ? NET_SEND_ZC : 0);
+
+    char* message = malloc((size_t)size);
+    Conn* table = calloc((size_t)conns, sizeof(Conn));
+    if (!message || !table) return fail("out of memory", 0);
+    for (int64_t i = 0; i < size; i++) message[i] = (char)('a' + i % 23);
+
+    int64_t listener = tcp_listen("127.0.0.1", 0, 4096, TCP_LISTEN_REUSEADDR);
+    if (listener < 0) return fail("tcp_listen failed", listener);
+    if (net_engine_accept(engine, listener, ROLE_LISTENER) != 0) return fail("accept failed", 0);
+    int32_t port = tcp_local_port(listener);
+
+    /* Connect every client first; the accept order matches the connect order */
+    for (int32_t i = 0; i < conns; i++) {
+        table[i].client = tcp_connect("127.0.0.1", port);
+        table[i].server = -1;
+        table[i].echo = malloc((size_t)size);
+        if (table[i].client < 0 || !table[i].echo) return fail("connect failed", i);
+        tcp_set_nonblocking(table[i].client, 1);
+        set_nodelay(table[i].client);
+    }
+    int32_t accepted = 0;
+    while (accepted < conns) {
+        int32_t n = net_engine_poll(engine, 5000);
+        if (n <= 0) return fail("accept stalled", n);
+        for (int32_t k = 0; k < n; k++) {
+            int64_t fd = net_engine_completion_result(engine, k);
+            if (net_engine_completion_kind(engine, k) != NET_OP_ACCEPT || fd < 0) return fail("bad accept", fd);
+            table[accepted].server = fd;
+            set_nodelay(fd);
+            net_engine_recv(engine, fd, ((int64_t)accepted << 2) | ROLE_SERVER);
+            accepted++;
+        }
+    }
+
+    double start = now_seconds();
+    for (int32_t i = 0; i < conns; i++) {
+        net_engine_recv(engine, table[i].client, ((int64_t)i << 2) | ROLE_CLIENT);
+        net_engine_send(engine, table[i].client, message, size / 2, ((int64_t)i << 2) | ROLE_CLIENT, send_flags);
+        net_engine_send(engine, table[i].client, message + size / 2, size - size / 2, ((int64_t)i << 2) | ROLE_CLIENT, 0);
+        table[i].sends_pending = 2;
+    }
+
+    int32_t done = 0;
+    while (done < conns) {
+        int32_t n = net_engine_poll(engine, 5000);
+        if (n <= 0) return fail("echo stalled", n);
+        for (int32_t k = 0; k < n; k++) {
+            int64_t token = net_engine_completion_token(engine, k);
+            int64_t result = net_engine_completion_result(engine, k);
+            Conn* c = &table[token >> 2];
+            int32_t role = (int32_t)(token & 3);
+            if (result < 0) return fail("operation failed", result);
+            if (net_engine_completion_kind(engine, k) == NET_OP_SEND) {
+                if (role == ROLE_CLIENT) c->sends_pending--;
+                continue;
+            }
+            if (net_engine_completion_kind(engine, k) != NET_OP_RECV) continue;
+            if (result == 0 || !(net_engine_completion_flags(engine, k) & NET_CQE_MORE)) {
+                return fail("unexpected end of stream", token);
+            }
+            const char* data = net_engine_completion_data(engine, k);
+            if (role == ROLE_SERVER) {
+                if (c->echo_len + result > size) return fail("server overrun", token);
+                memcpy(c->echo + c->echo_len, data, (size_t)result);
+                c->echo_len += result;
+                if (c->echo_len == size) {
+                    net_engine_send(engine, c->server, c->echo, size, token, 0);
+                    c->echo_len = 0;
+                }
+                continue;
+            }
+            if (memcmp(data, message + c->received, (size_t)result) != 0) return fail("corrupt echo", token);
+            c->received += result;
+            if (c->received < size) continue;
+            c->received = 0;
+            if (++c->rounds == rounds) {
+                done++;
+                continue;
+            }
+            net_engine_send(engine, c->client, message, size / 2, token, send_flags);
+            net_engine_send(engine, c->client, message + size / 2, size - size / 2, token, 0);
+            c->sends_pending += 2;
+        }
+    }
+    double elapsed = now_seconds() - start;
+
+    /* Cancel everything and drain: every armed request must finish */
+    int32_t armed = 1 + 2 * conns;
+    for (int32_t i = 0; i < conns; i++) armed += table[i].sends_pending;
+    net_engine_cancel(engine, listener);
+    for (int32_t i = 0; i < conns; i++) {
+        net_engine_cancel(engine, table[i].client);
+        net_engine_cancel(engine, table[i].server);
+    }
+    while (armed > 0) {
+        int32_t n = net_engine_poll(engine, 5000);
+        if (n <= 0) return fail("cancel stalled", armed);
+        for (int32_t k = 0; k < n; k++) {
+            if (!(net_engine_completion_flags(engine, k) & NET_CQE_MORE)) armed--;
+        }
+    }
+    for (int32_t i = 0; i < conns; i++) {
+        tcp_close(table[i].client);
+        tcp_close(table[i].server);
+        free(table[i].echo);
+    }
+    tcp_close(listener);
+
+    double messages = (double)conns * (double)rounds;
+    printf("%-5s conns=%d rounds=%lld size=%lld zc=%d: %.3fs, %.0f msg/s, %.1f MiB/s\n",
+           actual == NET_BACKEND_URING ? "uring" : "epoll", conns, (long long)rounds, (long long)size,
+           (send_flags & NET_SEND_ZC) && net_engine_has_zero_copy(engine), elapsed,
+           messages / elapsed, messages * (double)size * 2 / elapsed / (1024.0 * 1024.0));
+    net_engine_free(engine);
+    free(table);
+    free(message);
+    return 0;
+}
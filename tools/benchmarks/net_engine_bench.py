@@ -0,0 +1,77 @@
+#!/usr/bin/env python3
+"""
+Loopback echo benchmark for the network engine (io_uring vs epoll).
+Builds net_engine_bench.c against pyrite/net with the system C compiler and
+runs the same workloads on both backends.
+
+Usage:
+    python tools/benchmarks/net_engine_bench.py
+    python tools/benchmarks/net_engine_bench.py --conns=1000 --rounds=50 --size=512
+"""
+
+import argparse
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+from pathlib import Path
+
+
+REPO_ROOT = Path(__file__).resolve().parent.parent.parent
+SOURCES = [
+    REPO_ROOT / "tools" / "benchmarks" / "net_engine_bench.c",
+    REPO_ROOT / "pyrite" / "net" / "engine.c",
+    REPO_ROOT / "pyrite" / "net" / "reactor.c",
+    REPO_ROOT / "pyrite" / "net" / "socket.c",
+]
+
+# (connections, rounds, message size): small-message rate, many connections, bulk
+DEFAULT_WORKLOADS = [
+    (64, 2000, 64),
+    (1000, 50, 512),
+    (16, 200, 256 * 1024),
+]
+
+
+def build(output: Path) -> None:
+    """Compile the benchmark driver together with the engine sources"""
+    compiler = os.environ.get("CC") or shutil.which("cc") or shutil.which("gcc")
+    if not compiler:
+        print("Error: no C compiler found (set CC)")
+        sys.exit(1)
+    cmd = [compiler, "-O2", *[str(s) for s in SOURCES], "-o", str(output)]
+    result = subprocess.run(cmd, capture_output=True, text=True)
+    if result.returncode != 0:
+        print(result.stderr)
+        print("Error: build failed")
+        sys.exit(1)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Network engine loopback benchmark")
+    parser.add_argument("--conns", type=int, help="Connections (with --rounds and --size)")
+    parser.add_argument("--rounds", type=int, default=1000, help="Echo round trips per connection")
+    parser.add_argument("--size", type=int, default=1024, help="Message size in bytes")
+    parser.add_argument("--backend", choices=["uring", "epoll", "both"], default="both")
+    args = parser.parse_args()
+
+    workloads = [(args.conns, args.rounds, args.size)] if args.conns else DEFAULT_WORKLOADS
+    backends = ["uring", "epoll"] if args.backend == "both" else [args.backend]
+
+    with tempfile.TemporaryDirectory() as tmp:
+        binary = Path(tmp) / "net_engine_bench"
+        build(binary)
+        failed = False
+        for conns, rounds, size in workloads:
+            for backend in backends:
+                result = subprocess.run([str(binary), backend, str(conns), str(rounds), str(size)],
+                                        capture_output=True, text=True)
+                print((result.stdout or result.stderr).strip())
+                failed = failed or result.returncode != 0
+        # An "epoll" line under "uring" means io_uring is unavailable here
+        sys.exit(1 if failed else 0)
+
+
+if __name__ == "__main__":
+    main()
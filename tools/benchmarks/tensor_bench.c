@@ -0,0 +1,133 @@
+/* Matrix multiplication benchmark for pyrite/num/tensor.c
+ *
+ * For an n x n problem, times tensor_matmul (packed, register-tiled GEMM
+ * with the selected micro-kernel) against the naive i-j-k triple loop
+ * over row-major arrays, and checks that both agree. The naive loop is
+ * skipped above naive_max: at n = 4096 it takes minutes. In that case,
+ * sampled entries of the product are checked against dot products instead.
+ * The optional threads argument caps the tensor thread pool (0 = one
+ * thread per core, the default); compare 1 with 0 for the parallel scaling.
+ *
+ * Build and run through tensor_bench.py, or by hand:
+ *   cc -O2 tools/benchmarks/tensor_bench.c pyrite/num/tensor.c -lm -lpthread -o tensor_bench
+ *   ./tensor_bench 1024 auto 2048 [threads]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+
+typedef struct {
+    double* data;
+    void* storage;
+    int64_t offset;
+    int32_t ndim;
+    int64_t shape[8];
+    int64_t strides[8];
+} Tensor;
+
+extern Tensor tensor_new(int64_t rows, int64_t cols);
+extern void tensor_drop(Tensor* t);
+extern Tensor tensor_matmul(const Tensor* a, const Tensor* b);
+extern int32_t tensor_gemm_use_kernel(int32_t kernel);
+extern int32_t tensor_set_threads(int32_t threads);
+
+static const char* KERNEL_NAMES[] = { "portable", "avx2", "avx512" };
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void naive_matmul(const double* a, const double* b, double* c, int64_t n) {
+    for (int64_t i = 0; i < n; i++) {
+        for (int64_t j = 0; j < n; j++) {
+            double sum = 0.0;
+            for (int64_t p = 0; p < n; p++) sum += a[i * n + p] * b[p * n + j];
+            c[i * n + j] = sum;
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc < 4) {
+        fprintf(stderr, "usage: %s n portable|avx2|avx512|auto naive_max [threads]\n", argv[0]);
+        return 2;
+    }
+    int64_t n = atoll(argv[1]);
+    int64_t naive_max = atoll(argv[3]);
+    int32_t threads = tensor_set_threads(argc > 4 ? atoi(argv[4]) : 0);
+    int32_t requested = -1;
+    for (int32_t i = 0; i < 3; i++) {
+        if (strcmp(argv[2], KERNEL_NAMES[i]) == 0) requested = i;
+    }
+    int32_t kernel = tensor_gemm_use_kernel(requested);
+    if (kernel < 0) {
+        printf("n=%lld %s: not supported on this CPU\n", (long long)n, argv[2]);
+        return 0;
+    }
+
+    Tensor a = tensor_new(n, n);
+    Tensor b = tensor_new(n, n);
+    if (!a.data || !b.data) {
+        printf("FAILED: allocation\n");
+        return 1;
+    }
+    srand(42);
+    for (int64_t i = 0; i < n * n; i++) {
+        a.data[i] = (double)(rand() % 2001 - 1000) / 1000.0;
+        b.data[i] = (double)(rand() % 2001 - 1000) / 1000.0;
+    }
+    double flops = 2.0 * (double)n * (double)n * (double)n;
+
+    /* Repeat small sizes so each measurement runs long enough */
+    int reps = n <= 128 ? 50 : n <= 512 ? 5 : 1;
+    Tensor c = tensor_matmul(&a, &b);
+    double start = now_seconds();
+    for (int r = 0; r < reps; r++) {
+        tensor_drop(&c);
+        c = tensor_matmul(&a, &b);
+    }
+    double gemm_time = (now_seconds() - start) / reps;
+    if (!c.data) {
+        printf("FAILED: tensor_matmul\n");
+        return 1;
+    }
+
+    double max_error = 0.0;
+    char naive_text[64] = "naive skipped";
+    if (n <= naive_max) {
+        double* ref = (double*)malloc((size_t)(n * n) * sizeof(double));
+        int naive_reps = n <= 128 ? 5 : 1;
+        start = now_seconds();
+        for (int r = 0; r < naive_reps; r++) naive_matmul(a.data, b.data, ref, n);
+        double naive_time = (now_seconds() - start) / naive_reps;
+        for (int64_t i = 0; i < n * n; i++) {
+            double error = fabs(c.data[i] - ref[i]);
+            if (error > max_error) max_error = error;
+        }
+        free(ref);
+        snprintf(naive_text, sizeof(naive_text), "naive %8.3fs %6.2f GFLOP/s, speedup %6.1fx",
+                 naive_time, flops / naive_time / 1e9, naive_time / gemm_time);
+    } else {
+        for (int s = 0; s < 1000; s++) {
+            int64_t i = rand() % n, j = rand() % n;
+            double sum = 0.0;
+            for (int64_t p = 0; p < n; p++) sum += a.data[i * n + p] * b.data[p * n + j];
+            double error = fabs(c.data[i * n + j] - sum);
+            if (error > max_error) max_error = error;
+        }
+    }
+
+    printf("n=%-5lld %-8s %2d thr gemm %8.4fs %7.2f GFLOP/s | %s | max error %.1e\n",
+           (long long)n, KERNEL_NAMES[kernel], threads, gemm_time, flops / gemm_time / 1e9,
+           naive_text, max_error);
+    tensor_drop(&a);
+    tensor_drop(&b);
+    tensor_drop(&c);
+    return max_error <= 1e-9 * (double)n ? 0 : 1;
+}
@@ -0,0 +1,77 @@
+#!/usr/bin/env python3
+"""
+Matrix multiplication benchmark for the tensor GEMM kernels.
+Builds tensor_bench.c against pyrite/num/tensor.c with the system C compiler
+and compares tensor_matmul with a naive triple loop on square matrices,
+on one thread and on the whole tensor thread pool.
+
+Usage:
+    python tools/benchmarks/tensor_bench.py
+    python tools/benchmarks/tensor_bench.py --sizes=512,1024 --kernel=all
+    python tools/benchmarks/tensor_bench.py --threads=1,2,4,8
+    python tools/benchmarks/tensor_bench.py --naive-max=4096   # slow: minutes at 4096
+"""
+
+import argparse
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+from pathlib import Path
+
+
+REPO_ROOT = Path(__file__).resolve().parent.parent.parent
+SOURCES = [
+    REPO_ROOT / "tools" / "benchmarks" / "tensor_bench.c",
+    REPO_ROOT / "pyrite" / "num" / "tensor.c",
+]
+
+DEFAULT_SIZES = [64, 128, 256, 512, 1024, 2048, 4096]
+KERNELS = ["portable", "avx2", "avx512"]
+
+
+def build(output: Path) -> None:
+    """Compile the benchmark driver together with the tensor sources"""
+    compiler = os.environ.get("CC") or shutil.which("cc") or shutil.which("gcc")
+    if not compiler:
+        print("Error: no C compiler found (set CC)")
+        sys.exit(1)
+    cmd = [compiler, "-O2", *[str(s) for s in SOURCES], "-lm", "-lpthread", "-o", str(output)]
+    result = subprocess.run(cmd, capture_output=True, text=True)
+    if result.returncode != 0:
+        print(result.stderr)
+        print("Error: build failed")
+        sys.exit(1)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Tensor GEMM benchmark")
+    parser.add_argument("--sizes", help="Comma-separated matrix sizes (default 64..4096)")
+    parser.add_argument("--kernel", choices=KERNELS + ["auto", "all"], default="auto")
+    parser.add_argument("--naive-max", type=int, default=2048,
+                        help="Largest size to also run the naive loop on")
+    parser.add_argument("--threads", default="1,0",
+                        help="Comma-separated thread caps (0 = one per core)")
+    args = parser.parse_args()
+
+    sizes = [int(s) for s in args.sizes.split(",")] if args.sizes else DEFAULT_SIZES
+    kernels = KERNELS if args.kernel == "all" else [args.kernel]
+    thread_caps = [int(t) for t in args.threads.split(",")]
+
+    with tempfile.TemporaryDirectory() as tmp:
+        binary = Path(tmp) / "tensor_bench"
+        build(binary)
+        failed = False
+        for size in sizes:
+            for kernel in kernels:
+                for threads in thread_caps:
+                    result = subprocess.run([str(binary), str(size), kernel, str(args.naive_max),
+                                             str(threads)], capture_output=True, text=True)
+                    print((result.stdout or result.stderr).strip())
+                    failed = failed or result.returncode != 0
+        sys.exit(1 if failed else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,181 @@
+/* Fused expression benchmark for pyrite/num/tensor.c
+ *
+ * For n-element vectors, evaluates two expressions three ways: one fused
+ * pass (tensor_expr_eval), one tensor operation per node with a fresh
+ * temporary for each intermediate (what chaining tensor_mul/tensor_add
+ * does), and a hand-written C loop, the bound a fused pass can hope to
+ * reach. All three are checked against each other.
+ *
+ *   axpy:  a * b + c
+ *   norm:  sqrt(a * a + b * b) * c - a
+ *
+ * Build and run through tensor_expr_bench.py, or by hand:
+ *   cc -O2 tools/benchmarks/tensor_expr_bench.c pyrite/num/tensor.c -lm -lpthread -o tensor_expr_bench
+ *   ./tensor_expr_bench 10000000 auto [threads]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+
+typedef struct {
+    double* data;
+    void* storage;
+    int64_t offset;
+    int32_t ndim;
+    int64_t shape[8];
+    int64_t strides[8];
+} Tensor;
+
+extern Tensor tensor_new_nd(int32_t ndim, const int64_t* shape);
+extern void tensor_drop(Tensor* t);
+extern int32_t tensor_add(const Tensor* a, const Tensor* b, Tensor* out);
+extern int32_t tensor_sub(const Tensor* a, const Tensor* b, Tensor* out);
+extern int32_t tensor_mul(const Tensor* a, const Tensor* b, Tensor* out);
+extern int32_t tensor_gemm_use_kernel(int32_t kernel);
+extern int32_t tensor_set_threads(int32_t threads);
+extern void* tensor_expr_new();
+extern int32_t tensor_expr_input(void* expr, const Tensor* t);
+extern int32_t tensor_expr_unary(void* expr, int32_t op, int32_t x);
+extern int32_t tensor_expr_binary(void* expr, int32_t op, int32_t x, int32_t y);
+extern int32_t tensor_expr_eval(void* expr, int32_t node, Tensor* out);
+extern void tensor_expr_free(void* expr);
+
+#define EXPR_ADD 0
+#define EXPR_SUB 1
+#define EXPR_MUL 2
+#define EXPR_SQRT 8
+
+static const char* KERNEL_NAMES[] = { "portable", "avx2", "avx512" };
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static Tensor vector(int64_t n) {
+    return tensor_new_nd(1, &n);
+}
+
+/* One operation per node, each into a new temporary */
+static Tensor unfused(int norm, const Tensor* a, const Tensor* b, const Tensor* c, int64_t n) {
+    Tensor out = vector(n);
+    if (!norm) {
+        Tensor ab = vector(n);
+        tensor_mul(a, b, &ab);
+        tensor_add(&ab, c, &out);
+        tensor_drop(&ab);
+        return out;
+    }
+    Tensor aa = vector(n), bb = vector(n), sum = vector(n), root = vector(n), scaled = vector(n);
+    tensor_mul(a, a, &aa);
+    tensor_mul(b, b, &bb);
+    tensor_add(&aa, &bb, &sum);
+    for (int64_t i = 0; i < n; i++) root.data[i] = sqrt(sum.data[i]);  /* No tensor_sqrt */
+    tensor_mul(&root, c, &scaled);
+    tensor_sub(&scaled, a, &out);
+    tensor_drop(&aa);
+    tensor_drop(&bb);
+    tensor_drop(&sum);
+    tensor_drop(&root);
+    tensor_drop(&scaled);
+    return out;
+}
+
+static void by_hand(int norm, const double* a, const double* b, const double* c, double* out, int64_t n) {
+    if (!norm) {
+        for (int64_t i = 0; i < n; i++) out[i] = a[i] * b[i] + c[i];
+    } else {
+        for (int64_t i = 0; i < n; i++) out[i] = sqrt(a[i] * a[i] + b[i] * b[i]) * c[i] - a[i];
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s n portable|avx2|avx512|auto [threads]\n", argv[0]);
+        return 2;
+    }
+    int64_t n = atoll(argv[1]);
+    int32_t threads = tensor_set_threads(argc > 3 ? atoi(argv[3]) : 0);
+    int32_t requested = -1;
+    for (int32_t i = 0; i < 3; i++) {
+        if (strcmp(argv[2], KERNEL_NAMES[i]) == 0) requested = i;
+    }
+    int32_t kernel = tensor_gemm_use_kernel(requested);
+    if (kernel < 0) {
+        printf("n=%lld %s: not supported on this CPU\n", (long long)n, argv[2]);
+        return 0;
+    }
+
+    Tensor a = vector(n), b = vector(n), c = vector(n), fused = vector(n);
+    double* ref = (double*)malloc((size_t)n * sizeof(double));
+    if (!a.data || !b.data || !c.data || !fused.data || !ref) {
+        printf("FAILED: allocation\n");
+        return 1;
+    }
+    srand(42);
+    for (int64_t i = 0; i < n; i++) {
+        a.data[i] = (double)(rand() % 2001 - 1000) / 1000.0;
+        b.data[i] = (double)(rand() % 2001 - 1000) / 1000.0;
+        c.data[i] = (double)(rand() % 2001 - 1000) / 1000.0;
+    }
+
+    void* expr = tensor_expr_new();
+    int32_t x = tensor_expr_input(expr, &a);
+    int32_t y = tensor_expr_input(expr, &b);
+    int32_t z = tensor_expr_input(expr, &c);
+    int32_t roots[2];
+    roots[0] = tensor_expr_binary(expr, EXPR_ADD, tensor_expr_binary(expr, EXPR_MUL, x, y), z);
+    int32_t squares = tensor_expr_binary(expr, EXPR_ADD, tensor_expr_binary(expr, EXPR_MUL, x, x),
+                                         tensor_expr_binary(expr, EXPR_MUL, y, y));
+    roots[1] = tensor_expr_binary(expr, EXPR_SUB,
+                                  tensor_expr_binary(expr, EXPR_MUL, tensor_expr_unary(expr, EXPR_SQRT, squares), z), x);
+
+    /* Repeat small sizes so each measurement runs long enough */
+    int reps = n <= 100000 ? 200 : n <= 1000000 ? 20 : 3;
+    int failed = 0;
+    for (int norm = 0; norm < 2; norm++) {
+        double start = now_seconds();
+        for (int r = 0; r < reps; r++) tensor_expr_eval(expr, roots[norm], &fused);
+        double fused_time = (now_seconds() - start) / reps;
+
+        Tensor separate = unfused(norm, &a, &b, &c, n);
+        start = now_seconds();
+        for (int r = 0; r < reps; r++) {
+            tensor_drop(&separate);
+            separate = unfused(norm, &a, &b, &c, n);
+        }
+        double separate_time = (now_seconds() - start) / reps;
+
+        start = now_seconds();
+        for (int r = 0; r < reps; r++) by_hand(norm, a.data, b.data, c.data, ref, n);
+        double hand_time = (now_seconds() - start) / reps;
+
+        double max_error = 0.0;
+        for (int64_t i = 0; i < n; i++) {
+            double error = fabs(fused.data[i] - ref[i]) + fabs(separate.data[i] - ref[i]);
+            if (error > max_error) max_error = error;
+        }
+        tensor_drop(&separate);
+        failed = failed || max_error > 1e-12;
+
+        /* Bytes the expression must move: three inputs read, one output written */
+        double bytes = 4.0 * 8.0 * (double)n;
+        printf("n=%-9lld %-8s %2d thr %-4s fused %9.3f ms %6.1f GB/s | unfused %9.3f ms (%4.2fx) | "
+               "C loop %9.3f ms | max error %.1e\n",
+               (long long)n, KERNEL_NAMES[kernel], threads, norm ? "norm" : "axpy",
+               fused_time * 1e3, bytes / fused_time / 1e9, separate_time * 1e3,
+               separate_time / fused_time, hand_time * 1e3, max_error);
+    }
+    tensor_expr_free(expr);
+    tensor_drop(&a);
+    tensor_drop(&b);
+    tensor_drop(&c);
+    tensor_drop(&fused);
+    free(ref);
+    return failed;
+}
@@ -0,0 +1,74 @@
+#!/usr/bin/env python3
+"""
+Benchmark for fused tensor expressions.
+Builds tensor_expr_bench.c against pyrite/num/tensor.c with the system C
+compiler and times a * b + c and sqrt(a * a + b * b) * c - a evaluated in
+one fused pass, one tensor operation at a time, and as a hand-written loop.
+
+Usage:
+    python tools/benchmarks/tensor_expr_bench.py
+    python tools/benchmarks/tensor_expr_bench.py --sizes=1000000 --kernel=all
+    python tools/benchmarks/tensor_expr_bench.py --threads=1,2,4,8
+"""
+
+import argparse
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+from pathlib import Path
+
+
+REPO_ROOT = Path(__file__).resolve().parent.parent.parent
+SOURCES = [
+    REPO_ROOT / "tools" / "benchmarks" / "tensor_expr_bench.c",
+    REPO_ROOT / "pyrite" / "num" / "tensor.c",
+]
+
+DEFAULT_SIZES = [10000, 100000, 1000000, 10000000]
+KERNELS = ["portable", "avx2", "avx512"]
+
+
+def build(output: Path) -> None:
+    """Compile the benchmark driver together with the tensor sources"""
+    compiler = os.environ.get("CC") or shutil.which("cc") or shutil.which("gcc")
+    if not compiler:
+        print("Error: no C compiler found (set CC)")
+        sys.exit(1)
+    cmd = [compiler, "-O2", *[str(s) for s in SOURCES], "-lm", "-lpthread", "-o", str(output)]
+    result = subprocess.run(cmd, capture_output=True, text=True)
+    if result.returncode != 0:
+        print(result.stderr)
+        print("Error: build failed")
+        sys.exit(1)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Fused tensor expression benchmark")
+    parser.add_argument("--sizes", help="Comma-separated element counts (default 1e4..1e7)")
+    parser.add_argument("--kernel", choices=KERNELS + ["auto", "all"], default="auto")
+    parser.add_argument("--threads", default="1,0",
+                        help="Comma-separated thread caps (0 = one per core)")
+    args = parser.parse_args()
+
+    sizes = [int(s) for s in args.sizes.split(",")] if args.sizes else DEFAULT_SIZES
+    kernels = KERNELS if args.kernel == "all" else [args.kernel]
+    thread_caps = [int(t) for t in args.threads.split(",")]
+
+    with tempfile.TemporaryDirectory() as tmp:
+        binary = Path(tmp) / "tensor_expr_bench"
+        build(binary)
+        failed = False
+        for size in sizes:
+            for kernel in kernels:
+                for threads in thread_caps:
+                    result = subprocess.run([str(binary), str(size), kernel, str(threads)],
+                                            capture_output=True, text=True)
+                    print((result.stdout or result.stderr).strip())
+                    failed = failed or result.returncode != 0
+        sys.exit(1 if failed else 0)
+
+
+if __name__ == "__main__":
+    main()